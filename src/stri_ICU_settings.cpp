@@ -31,6 +31,16 @@
 
 
 #include "stri_stringi.h"
+#include "stri_usage.h"
+
+
+// the per-service churn tallies (see stri_usage.h); the cache sites
+// increment them, this file reports them
+StriUsageCounters stri__usage_collator;
+StriUsageCounters stri__usage_converter;
+StriUsageCounters stri__usage_regex;
+StriUsageCounters stri__usage_brkiter;
+StriUsageCounters stri__usage_usearch;
 
 
 #ifndef STRI_ICU_FOUND
@@ -39,7 +49,7 @@
 
 /** Get curent-default ICU locale and charset information
  *
- *  @return an R named list with 7 components:
+ *  @return an R named list with 8 components:
  *  \code{Unicode.version} == ICU Unicode version,
  *  \code{ICU.version} == U_ICU_VERSION
  *  \code{Locale} == \code{stri_locale_info()},
@@ -47,6 +57,7 @@
  *  \code{Charset.native} == \code{stri_enc_info()})
  *  \code{ICU.system} == is system ICU used?
  *  \code{ICU.UTF8} == is U_CHARSET_IS_UTF8 set?
+ *  \code{ICU.usage} == ICU service-object opens vs cache hits since load
  *
  *  @version 0.1-?? (Marek Gagolewski)
  *
@@ -64,11 +75,15 @@
  *
  * @version 1.3.1 (Marek Gagolewski, 2019-02-06)
  *    new retval field: ICU.UTF8
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    new retval field: ICU.usage - collator/converter/regex/brkiter
+ *    opens vs cache hits, for quantifying object churn
 */
 SEXP stri_info()
 {
    STRI__ERROR_HANDLER_BEGIN(0)
-   const R_len_t infosize = 7;
+   const R_len_t infosize = 8;
    SEXP vals;
 
    STRI__PROTECT(vals = Rf_allocVector(VECSXP, infosize));
@@ -87,9 +102,28 @@ SEXP stri_info()
 #endif
 #endif
 
+   SEXP usage;
+   STRI__PROTECT(usage = Rf_allocVector(INTSXP, 8));
+   int* usage_tab = INTEGER(usage);
+   usage_tab[0] = (int)stri__usage_collator.opens;
+   usage_tab[1] = (int)stri__usage_collator.hits;
+   usage_tab[2] = (int)stri__usage_converter.opens;
+   usage_tab[3] = (int)stri__usage_converter.hits;
+   usage_tab[4] = (int)stri__usage_regex.opens;
+   usage_tab[5] = (int)stri__usage_regex.hits;
+   usage_tab[6] = (int)stri__usage_brkiter.opens;
+   usage_tab[7] = (int)stri__usage_brkiter.hits;
+   stri__set_names(usage, 8,
+      "Collator.opens", "Collator.hits",
+      "Converter.opens", "Converter.hits",
+      "RegexPattern.opens", "RegexPattern.hits",
+      "BreakIterator.opens", "BreakIterator.hits");
+   SET_VECTOR_ELT(vals, 7, usage);
+
    stri__set_names(vals, infosize,
       "Unicode.version", "ICU.version", "Locale",
-      "Charset.internal", "Charset.native", "ICU.system", "ICU.UTF8");
+      "Charset.internal", "Charset.native", "ICU.system", "ICU.UTF8",
+      "ICU.usage");
 
    STRI__UNPROTECT_ALL
    return vals;
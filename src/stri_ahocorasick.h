@@ -0,0 +1,312 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_ahocorasick_h
+#define __stri_ahocorasick_h
+
+#include <map>
+#include <vector>
+
+
+// below this many patterns a batch of plain KMP scans is still cheaper
+// than building the automaton
+#define STRI_AHOCORASICK_MIN_PATTERNS 16
+
+
+/**
+ * An Aho-Corasick automaton over UTF-8 bytes
+ *
+ * Answers "which of these patterns occur in this haystack" in a single
+ * pass, regardless of the number of patterns. Used by the fixed-search
+ * functions when one haystack is to be matched against many patterns -
+ * a batch of independent KMP scans is O(patterns x text), the automaton
+ * is O(text + matches).
+ *
+ * Patterns are byte sequences here (exact search), mirroring
+ * StriByteSearchMatcher; case-insensitive search is not supported.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+class StriAhoCorasick {
+
+   private:
+
+      struct Node {
+         std::map<unsigned char, int> edges;
+         int fail;       ///< fail link
+         int out_link;   ///< nearest output node along the fail chain
+         std::vector<int> out; ///< ids of the patterns ending here
+
+         Node() : fail(0), out_link(0) { }
+      };
+
+      std::vector<Node> m_nodes; ///< m_nodes[0] is the root
+      bool m_built;
+
+      StriAhoCorasick(const StriAhoCorasick&); /* not copy-able */
+      StriAhoCorasick& operator=(const StriAhoCorasick&);
+
+   public:
+
+      StriAhoCorasick() : m_nodes(1), m_built(false) { }
+
+
+      /** add a pattern to the automaton (before build())
+       *
+       * @param s pattern, UTF-8 bytes
+       * @param n length of s, in bytes, > 0
+       * @param id value reported when this pattern is found
+       */
+      void addPattern(const char* s, R_len_t n, int id) {
+#ifndef NDEBUG
+         if (m_built) throw StriException("StriAhoCorasick: already built");
+         if (n <= 0)  throw StriException("StriAhoCorasick: empty pattern");
+#endif
+         int cur = 0;
+         for (R_len_t j=0; j<n; ++j) {
+            unsigned char c = (unsigned char)s[j];
+            std::map<unsigned char, int>::iterator e = m_nodes[cur].edges.find(c);
+            if (e != m_nodes[cur].edges.end())
+               cur = e->second;
+            else {
+               m_nodes.push_back(Node());
+               int fresh = (int)m_nodes.size()-1;
+               m_nodes[cur].edges.insert(std::pair<unsigned char, int>(c, fresh));
+               cur = fresh;
+            }
+         }
+         m_nodes[cur].out.push_back(id);
+      }
+
+
+      /** add a pattern with its bytes reversed (before build());
+       *  for suffix queries via scanSuffix()
+       *
+       * @param s pattern, UTF-8 bytes
+       * @param n length of s, in bytes, > 0
+       * @param id value reported when this pattern is found
+       */
+      void addPatternReversed(const char* s, R_len_t n, int id) {
+#ifndef NDEBUG
+         if (m_built) throw StriException("StriAhoCorasick: already built");
+         if (n <= 0)  throw StriException("StriAhoCorasick: empty pattern");
+#endif
+         int cur = 0;
+         for (R_len_t j=n-1; j>=0; --j) {
+            unsigned char c = (unsigned char)s[j];
+            std::map<unsigned char, int>::iterator e = m_nodes[cur].edges.find(c);
+            if (e != m_nodes[cur].edges.end())
+               cur = e->second;
+            else {
+               m_nodes.push_back(Node());
+               int fresh = (int)m_nodes.size()-1;
+               m_nodes[cur].edges.insert(std::pair<unsigned char, int>(c, fresh));
+               cur = fresh;
+            }
+         }
+         m_nodes[cur].out.push_back(id);
+      }
+
+
+      /** mark the patterns that are prefixes of a haystack
+       *
+       * A plain trie walk from the root - one pass over at most
+       * maxPatternLen bytes answers "which of these patterns does the
+       * string start with" for all the patterns at once. Does not
+       * require build() and does not use the fail links.
+       *
+       * @param s haystack, UTF-8 bytes
+       * @param n length of s, in bytes
+       * @param found found[id] is set to 1 for each pattern the
+       *    haystack starts with; other entries are left untouched
+       */
+      void scanPrefix(const char* s, R_len_t n, std::vector<char>& found) const {
+         int cur = 0;
+         for (R_len_t j=0; j<n; ++j) {
+            std::map<unsigned char, int>::const_iterator e =
+               m_nodes[cur].edges.find((unsigned char)s[j]);
+            if (e == m_nodes[cur].edges.end()) return;
+            cur = e->second;
+            for (size_t k=0; k<m_nodes[cur].out.size(); ++k)
+               found[m_nodes[cur].out[k]] = 1;
+         }
+      }
+
+
+      /** mark the patterns that are suffixes of a haystack;
+       *  the patterns must have been inserted with addPatternReversed()
+       *
+       * @param s haystack, UTF-8 bytes
+       * @param n length of s, in bytes
+       * @param found found[id] is set to 1 for each pattern the
+       *    haystack ends with; other entries are left untouched
+       */
+      void scanSuffix(const char* s, R_len_t n, std::vector<char>& found) const {
+         int cur = 0;
+         for (R_len_t j=n-1; j>=0; --j) {
+            std::map<unsigned char, int>::const_iterator e =
+               m_nodes[cur].edges.find((unsigned char)s[j]);
+            if (e == m_nodes[cur].edges.end()) return;
+            cur = e->second;
+            for (size_t k=0; k<m_nodes[cur].out.size(); ++k)
+               found[m_nodes[cur].out[k]] = 1;
+         }
+      }
+
+
+      /** compute the fail and output links (BFS over the trie) */
+      void build() {
+         std::vector<int> queue;
+         queue.reserve(m_nodes.size());
+         for (std::map<unsigned char, int>::iterator e = m_nodes[0].edges.begin();
+               e != m_nodes[0].edges.end(); ++e) {
+            m_nodes[e->second].fail = 0;
+            m_nodes[e->second].out_link = 0;
+            queue.push_back(e->second);
+         }
+
+         for (size_t qi=0; qi<queue.size(); ++qi) {
+            int cur = queue[qi];
+            for (std::map<unsigned char, int>::iterator e = m_nodes[cur].edges.begin();
+                  e != m_nodes[cur].edges.end(); ++e) {
+               unsigned char c = e->first;
+               int child = e->second;
+               int f = m_nodes[cur].fail;
+               while (f != 0 && m_nodes[f].edges.find(c) == m_nodes[f].edges.end())
+                  f = m_nodes[f].fail;
+               std::map<unsigned char, int>::iterator g = m_nodes[f].edges.find(c);
+               if (g != m_nodes[f].edges.end() && g->second != child)
+                  m_nodes[child].fail = g->second;
+               else
+                  m_nodes[child].fail = 0;
+               int fl = m_nodes[child].fail;
+               m_nodes[child].out_link =
+                  m_nodes[fl].out.empty() ? m_nodes[fl].out_link : fl;
+               queue.push_back(child);
+            }
+         }
+         m_built = true;
+      }
+
+
+      /** mark all the patterns occurring in a haystack
+       *
+       * @param s haystack, UTF-8 bytes
+       * @param n length of s, in bytes
+       * @param found found[id] is set to 1 for each pattern that occurs;
+       *    other entries are left untouched
+       */
+      void scan(const char* s, R_len_t n, std::vector<char>& found) const {
+#ifndef NDEBUG
+         if (!m_built) throw StriException("StriAhoCorasick: build() not called");
+#endif
+         int cur = 0;
+         for (R_len_t j=0; j<n; ++j) {
+            unsigned char c = (unsigned char)s[j];
+            while (cur != 0 && m_nodes[cur].edges.find(c) == m_nodes[cur].edges.end())
+               cur = m_nodes[cur].fail;
+            std::map<unsigned char, int>::const_iterator e = m_nodes[cur].edges.find(c);
+            if (e != m_nodes[cur].edges.end())
+               cur = e->second;
+
+            int t = m_nodes[cur].out.empty() ? m_nodes[cur].out_link : cur;
+            for (; t != 0; t = m_nodes[t].out_link) {
+               for (size_t k=0; k<m_nodes[t].out.size(); ++k)
+                  found[m_nodes[t].out[k]] = 1;
+            }
+         }
+      }
+
+
+      /** record every occurrence of every pattern
+       *
+       * @param s haystack, UTF-8 bytes
+       * @param n length of s, in bytes
+       * @param out appended with one (match end, pattern id) pair per
+       *    occurrence, ends nondecreasing; the end index points at the
+       *    last byte of the match, so the match starts at
+       *    end+1-patternLength(id) - the caller knows the lengths
+       */
+      void scanAll(const char* s, R_len_t n,
+            std::vector< std::pair<int,int> >& out) const {
+#ifndef NDEBUG
+         if (!m_built) throw StriException("StriAhoCorasick: build() not called");
+#endif
+         int cur = 0;
+         for (R_len_t j=0; j<n; ++j) {
+            unsigned char c = (unsigned char)s[j];
+            while (cur != 0 && m_nodes[cur].edges.find(c) == m_nodes[cur].edges.end())
+               cur = m_nodes[cur].fail;
+            std::map<unsigned char, int>::const_iterator e = m_nodes[cur].edges.find(c);
+            if (e != m_nodes[cur].edges.end())
+               cur = e->second;
+
+            int t = m_nodes[cur].out.empty() ? m_nodes[cur].out_link : cur;
+            for (; t != 0; t = m_nodes[t].out_link) {
+               for (size_t k=0; k<m_nodes[t].out.size(); ++k)
+                  out.push_back(std::pair<int,int>((int)j, m_nodes[t].out[k]));
+            }
+         }
+      }
+
+
+      /** does any of the patterns occur in a haystack?
+       *
+       * Like scan(), but returns at the very first hit - for any-of
+       * queries the identity of the matching pattern does not matter,
+       * so the rest of the haystack need not be looked at.
+       *
+       * @param s haystack, UTF-8 bytes
+       * @param n length of s, in bytes
+       * @return true iff at least one pattern occurs in s
+       */
+      bool scanAny(const char* s, R_len_t n) const {
+#ifndef NDEBUG
+         if (!m_built) throw StriException("StriAhoCorasick: build() not called");
+#endif
+         int cur = 0;
+         for (R_len_t j=0; j<n; ++j) {
+            unsigned char c = (unsigned char)s[j];
+            while (cur != 0 && m_nodes[cur].edges.find(c) == m_nodes[cur].edges.end())
+               cur = m_nodes[cur].fail;
+            std::map<unsigned char, int>::const_iterator e = m_nodes[cur].edges.find(c);
+            if (e != m_nodes[cur].edges.end())
+               cur = e->second;
+
+            if (!m_nodes[cur].out.empty() || m_nodes[cur].out_link != 0)
+               return true; // a pattern ends here - no need to read on
+         }
+         return false;
+      }
+};
+
+#endif
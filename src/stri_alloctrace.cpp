@@ -0,0 +1,93 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+
+
+#ifdef STRI_ALLOCTRACE
+StriAllocTrace stri__alloctrace = { NULL, -1, 0 }; // ev[]: zero-initialized
+#endif
+
+
+/** Dump the buffer-regrowth trace
+ *
+ * Only meaningful in builds configured with -DSTRI_ALLOCTRACE, see
+ * stri_alloctrace.h. Returns the events recorded since the previous
+ * dump, oldest first, and clears the ring; if more events occurred
+ * than the ring holds, only the newest ones survive (compare the
+ * returned length with the "seen" attribute).
+ *
+ * @return a list with components site (character), elem, old_size,
+ *    new_size (integer), one entry per event, with attribute "seen" -
+ *    the number of events recorded since the previous dump; or NULL
+ *    if the trace was compiled out
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_alloc_trace()
+{
+#ifdef STRI_ALLOCTRACE
+   R_len_t n = (stri__alloctrace.seen < (size_t)STRI__ALLOCTRACE_RING)?
+      (R_len_t)stri__alloctrace.seen:(R_len_t)STRI__ALLOCTRACE_RING;
+   // with a full ring, seen%RING is both the oldest surviving event
+   // and one past the newest one
+   R_len_t first = (stri__alloctrace.seen < (size_t)STRI__ALLOCTRACE_RING)?
+      0:(R_len_t)(stri__alloctrace.seen % STRI__ALLOCTRACE_RING);
+
+   SEXP ret, names, site, elem, old_size, new_size;
+   PROTECT(ret = Rf_allocVector(VECSXP, 4));
+   PROTECT(site     = Rf_allocVector(STRSXP, n));
+   PROTECT(elem     = Rf_allocVector(INTSXP, n));
+   PROTECT(old_size = Rf_allocVector(INTSXP, n));
+   PROTECT(new_size = Rf_allocVector(INTSXP, n));
+   for (R_len_t k=0; k<n; ++k) {
+      const StriAllocTraceEvent& e =
+         stri__alloctrace.ev[(first+k) % STRI__ALLOCTRACE_RING];
+      SET_STRING_ELT(site, k, (e.site)?Rf_mkChar(e.site):NA_STRING);
+      INTEGER(elem)[k]     = (e.elem >= 0)?(e.elem+1):NA_INTEGER; // 1-based
+      INTEGER(old_size)[k] = e.old_size;
+      INTEGER(new_size)[k] = e.new_size;
+   }
+   SET_VECTOR_ELT(ret, 0, site);
+   SET_VECTOR_ELT(ret, 1, elem);
+   SET_VECTOR_ELT(ret, 2, old_size);
+   SET_VECTOR_ELT(ret, 3, new_size);
+   stri__set_names(ret, 4, "site", "elem", "old_size", "new_size");
+   Rf_setAttrib(ret, Rf_install("seen"),
+      Rf_ScalarReal((double)stri__alloctrace.seen)); // may exceed INT_MAX
+   stri__alloctrace.seen = 0;
+   UNPROTECT(5);
+   return ret;
+#else
+   return R_NilValue;
+#endif
+}
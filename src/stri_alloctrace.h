@@ -0,0 +1,107 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_alloctrace_h
+#define __stri_alloctrace_h
+
+
+/* Reallocation-event tracing (compile-time opt-in)
+ *
+ * Build with -DSTRI_ALLOCTRACE (e.g. via PKG_CPPFLAGS) to record one
+ * event per buffer regrowth in the replace/casemap paths: the function
+ * that owns the buffer, the vector element being processed, and the
+ * old and new buffer sizes. This is the per-event companion of the
+ * STRI_MEMSTATS totals (stri_memstats.h) - the totals tell you how
+ * much was reallocated, the trace tells you where and in what pattern
+ * (e.g. a buffer regrown once per element instead of monotonically).
+ *
+ * Read the events from R with .Call(C_stri_alloc_trace); the call
+ * returns the events recorded since the previous one (at most
+ * STRI__ALLOCTRACE_RING of them - older events are dropped, see the
+ * "seen" attribute) and clears the ring. Without the flag the hooks
+ * compile to nothing and that call returns NULL.
+ *
+ * Like the STRI_MEMSTATS counters, the trace is deliberately plain
+ * (not atomic) and only meaningful for work done on the main R thread;
+ * regrowth inside pooled worker threads is not attributed.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+#ifdef STRI_ALLOCTRACE
+
+#define STRI__ALLOCTRACE_RING 4096
+
+struct StriAllocTraceEvent {
+   const char* site;  ///< owning function (a string literal), may be NULL
+   R_len_t elem;      ///< vector element index, -1 outside a vectorized loop
+   R_len_t old_size;  ///< buffer size before the regrowth, in bytes
+   R_len_t new_size;  ///< buffer size after the regrowth, in bytes
+};
+
+struct StriAllocTrace {
+   const char* site;  ///< current owning function, set at function entry
+   R_len_t elem;      ///< current element index
+   size_t seen;       ///< events recorded since the last dump (may exceed the ring)
+   StriAllocTraceEvent ev[STRI__ALLOCTRACE_RING];
+};
+
+extern StriAllocTrace stri__alloctrace;
+
+/** name the function whose buffers are about to grow (string literal) */
+#define STRI__ALLOCTRACE_SITE(name)                            \
+   {                                                           \
+      stri__alloctrace.site = (name);                          \
+      stri__alloctrace.elem = -1;                              \
+   }
+
+/** name the vector element currently being processed */
+#define STRI__ALLOCTRACE_ELEM(i)                               \
+   { stri__alloctrace.elem = (i); }
+
+/** record one regrowth event under the current site/elem context */
+#define STRI__ALLOCTRACE_EVENT(oldsize, newsize)               \
+   {                                                           \
+      StriAllocTraceEvent& __e = stri__alloctrace.ev[          \
+         stri__alloctrace.seen++ % STRI__ALLOCTRACE_RING];     \
+      __e.site = stri__alloctrace.site;                        \
+      __e.elem = stri__alloctrace.elem;                        \
+      __e.old_size = (R_len_t)(oldsize);                       \
+      __e.new_size = (R_len_t)(newsize);                       \
+   }
+
+#else
+#define STRI__ALLOCTRACE_SITE(name)              /* nothing */
+#define STRI__ALLOCTRACE_ELEM(i)                 /* nothing */
+#define STRI__ALLOCTRACE_EVENT(oldsize, newsize) /* nothing */
+#endif
+
+#endif
@@ -0,0 +1,217 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stri_stringi.h"
+#include <cstring>
+
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 5, 0)
+#define STRI_HAVE_ALTREP 1
+#include <R_ext/Altrep.h>
+#endif
+
+
+#ifdef STRI_HAVE_ALTREP
+
+/* A deferred (lazily computed) character vector.
+ *
+ * data1 is a 4-element list:
+ *   [0] fun    - a unary R function returning a character vector
+ *   [1] input  - the argument to apply fun to
+ *   [2] cache  - STRSXP holding the computed elements
+ *   [3] filled - LGLSXP; TRUE where cache[i] is valid
+ *
+ * Elt() computes a single element on first access (fun applied to a
+ * length-1 slice); Dataptr() and Duplicate() materialize everything
+ * still pending with ONE vectorized call of fun, so a full read costs
+ * the same as the eager computation would have.
+ */
+
+static R_altrep_class_t stri__deferred_string_class;
+
+#define STRI__DEFERRED_FUN(x)    VECTOR_ELT(R_altrep_data1(x), 0)
+#define STRI__DEFERRED_INPUT(x)  VECTOR_ELT(R_altrep_data1(x), 1)
+#define STRI__DEFERRED_CACHE(x)  VECTOR_ELT(R_altrep_data1(x), 2)
+#define STRI__DEFERRED_FILLED(x) VECTOR_ELT(R_altrep_data1(x), 3)
+
+
+static R_xlen_t stri__deferred_length(SEXP x)
+{
+   return XLENGTH(STRI__DEFERRED_CACHE(x));
+}
+
+
+/** [internal] compute all pending elements with one vectorized call */
+static void stri__deferred_materialize(SEXP x)
+{
+   SEXP cache = STRI__DEFERRED_CACHE(x);
+   int* filled = LOGICAL(STRI__DEFERRED_FILLED(x));
+   R_xlen_t n = XLENGTH(cache);
+
+   bool any_pending = false;
+   for (R_xlen_t i=0; i<n; ++i)
+      if (!filled[i]) { any_pending = true; break; }
+   if (!any_pending) return;
+
+   SEXP call, res;
+   PROTECT(call = Rf_lang2(STRI__DEFERRED_FUN(x), STRI__DEFERRED_INPUT(x)));
+   PROTECT(res = Rf_eval(call, R_GlobalEnv));
+   if (!isString(res) || XLENGTH(res) != n)
+      Rf_error(MSG__DEFERRED_RESULT_TYPE); // allowed here
+   for (R_xlen_t i=0; i<n; ++i)
+      if (!filled[i]) {
+         SET_STRING_ELT(cache, i, STRING_ELT(res, i));
+         filled[i] = TRUE;
+      }
+   UNPROTECT(2);
+}
+
+
+static SEXP stri__deferred_elt(SEXP x, R_xlen_t i)
+{
+   SEXP cache = STRI__DEFERRED_CACHE(x);
+   int* filled = LOGICAL(STRI__DEFERRED_FILLED(x));
+   if (!filled[i]) {
+      SEXP input, call, res;
+      PROTECT(input = Rf_ScalarString(STRING_ELT(STRI__DEFERRED_INPUT(x), i)));
+      PROTECT(call = Rf_lang2(STRI__DEFERRED_FUN(x), input));
+      PROTECT(res = Rf_eval(call, R_GlobalEnv));
+      if (!isString(res) || XLENGTH(res) != 1)
+         Rf_error(MSG__DEFERRED_RESULT_TYPE); // allowed here
+      SET_STRING_ELT(cache, i, STRING_ELT(res, 0));
+      filled[i] = TRUE;
+      UNPROTECT(3);
+   }
+   return STRING_ELT(cache, i);
+}
+
+
+static void stri__deferred_set_elt(SEXP x, R_xlen_t i, SEXP v)
+{
+   SET_STRING_ELT(STRI__DEFERRED_CACHE(x), i, v);
+   LOGICAL(STRI__DEFERRED_FILLED(x))[i] = TRUE;
+}
+
+
+static void* stri__deferred_dataptr(SEXP x, Rboolean writeable)
+{
+   stri__deferred_materialize(x);
+   return DATAPTR(STRI__DEFERRED_CACHE(x));
+}
+
+
+static const void* stri__deferred_dataptr_or_null(SEXP x)
+{
+   return NULL; // force the accessors through Elt()
+}
+
+
+static SEXP stri__deferred_duplicate(SEXP x, Rboolean deep)
+{
+   stri__deferred_materialize(x);
+   return Rf_duplicate(STRI__DEFERRED_CACHE(x));
+}
+
+
+/** Register the deferred string class (called from R_init_stringi)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void stri__altrep_init(DllInfo* dll)
+{
+   R_altrep_class_t cls =
+      R_make_altstring_class("stri_deferred_string", "stringi", dll);
+   R_set_altrep_Length_method(cls, stri__deferred_length);
+   R_set_altrep_Duplicate_method(cls, stri__deferred_duplicate);
+   R_set_altvec_Dataptr_method(cls, stri__deferred_dataptr);
+   R_set_altvec_Dataptr_or_null_method(cls, stri__deferred_dataptr_or_null);
+   R_set_altstring_Elt_method(cls, stri__deferred_elt);
+   R_set_altstring_Set_elt_method(cls, stri__deferred_set_elt);
+   stri__deferred_string_class = cls;
+}
+
+#else
+
+void stri__altrep_init(DllInfo* dll)
+{
+   // no ALTREP framework in this R - stri_deferred computes eagerly
+}
+
+#endif /* STRI_HAVE_ALTREP */
+
+
+/**
+ * Create a deferred (lazily computed) character vector
+ *
+ * See stri_deferred in R. On R versions without the ALTREP framework
+ * (< 3.5.0) the result is computed eagerly instead - same values,
+ * no laziness.
+ *
+ * @param fun unary R function returning character vector of matching length
+ * @param str character vector
+ * @return character vector (possibly an ALTREP one)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_deferred_string(SEXP fun, SEXP str)
+{
+   if (!Rf_isFunction(fun))
+      Rf_error(MSG__INCORRECT_INTERNAL_ARG); // allowed here
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+
+#ifdef STRI_HAVE_ALTREP
+   R_xlen_t n = XLENGTH(str);
+   SEXP data1;
+   PROTECT(data1 = Rf_allocVector(VECSXP, 4));
+   SET_VECTOR_ELT(data1, 0, fun);
+   SET_VECTOR_ELT(data1, 1, str);
+   SET_VECTOR_ELT(data1, 2, Rf_allocVector(STRSXP, n));
+   SEXP filled;
+   SET_VECTOR_ELT(data1, 3, (filled = Rf_allocVector(LGLSXP, n)));
+   int* filled_tab = LOGICAL(filled);
+   for (R_xlen_t i=0; i<n; ++i)
+      filled_tab[i] = FALSE;
+
+   SEXP ret;
+   PROTECT(ret = R_new_altrep(stri__deferred_string_class, data1, R_NilValue));
+   UNPROTECT(3);
+   return ret;
+#else
+   SEXP call, ret;
+   PROTECT(call = Rf_lang2(fun, str));
+   PROTECT(ret = Rf_eval(call, R_GlobalEnv));
+   if (!isString(ret) || LENGTH(ret) != LENGTH(str))
+      Rf_error(MSG__DEFERRED_RESULT_TYPE); // allowed here
+   UNPROTECT(3);
+   return ret;
+#endif
+}
@@ -31,6 +31,226 @@
 
 #include "stri_stringi.h"
 #include "stri_brkiter.h"
+#include "stri_usage.h"
+#include "stri_cache.h"
+#include "stri_opts_memo.h"
+#include <string>
+#include <cstdio>
+#include <vector>
+
+
+// how many distinct (type, locale) break iterator configurations are
+// kept alive; word/sentence instances load dictionaries (notably for
+// CJK) costing tens of milliseconds per ubrk_open
+#define STRI__UBRK_CACHE_SIZE 8
+
+
+/** one cached master break iterator; the C and C++ flavors live side
+ *  by side, as StriUBreakIterator and StriRuleBasedBreakIterator use
+ *  different ICU APIs */
+struct StriCachedBrkIter {
+   std::string key;            ///< type + locale, "" if the slot is free
+   UBreakIterator* c_master;   ///< master for ubrk_safeClone(), may be NULL
+   BreakIterator* cpp_master;  ///< master for BreakIterator::clone(), may be NULL
+   unsigned stamp;             ///< last use, for LRU eviction
+
+   StriCachedBrkIter() : c_master(NULL), cpp_master(NULL), stamp(0) { }
+};
+
+static StriCachedBrkIter stri__ubrk_cache[STRI__UBRK_CACHE_SIZE];
+// entries are stamped from the shared cross-cache clock, see stri_cache.h
+
+
+/** the cache slot for the given key - an existing entry if there is
+ *  one, otherwise the least recently used slot, evicted and re-keyed
+ */
+static StriCachedBrkIter* stri__ubrk_cache_slot_key(const std::string& key)
+{
+   int slot = 0;
+   for (int i=0; i<STRI__UBRK_CACHE_SIZE; ++i) {
+      StriCachedBrkIter* e = &stri__ubrk_cache[i];
+      if ((e->c_master || e->cpp_master) && e->key == key) {
+         e->stamp = stri__cache_tick();
+         return e;
+      }
+      if (!e->c_master && !e->cpp_master) { slot = i; break; }
+      if (e->stamp < stri__ubrk_cache[slot].stamp)
+         slot = i;
+   }
+
+   StriCachedBrkIter* e = &stri__ubrk_cache[slot];
+   if (e->c_master)   { ubrk_close(e->c_master);  e->c_master = NULL;   }
+   if (e->cpp_master) { delete e->cpp_master;     e->cpp_master = NULL; }
+   e->key = key;
+   e->stamp = stri__cache_tick();
+   return e;
+}
+
+
+/** the cache slot for (type, locale) */
+static StriCachedBrkIter* stri__ubrk_cache_slot(UBreakIteratorType type,
+   const char* locale)
+{
+   char key_buf[16];
+   snprintf(key_buf, sizeof(key_buf), "%d|", (int)type);
+   std::string key(key_buf);
+   key += (locale?locale:"");
+   return stri__ubrk_cache_slot_key(key);
+}
+
+
+/** the cache slot for a custom rule set (the "R|" namespace cannot
+ *  collide with the numeric (type, locale) keys)
+ */
+static StriCachedBrkIter* stri__ubrk_cache_slot_rules(const UnicodeString& rules)
+{
+   std::string key("R|");
+   rules.toUTF8String(key);
+   return stri__ubrk_cache_slot_key(key);
+}
+
+
+// the stri_cache.cpp hooks, see stri_cache.h
+
+R_len_t stri__ubrk_cache_count()
+{
+   R_len_t count = 0;
+   for (int i=0; i<STRI__UBRK_CACHE_SIZE; ++i)
+      if (stri__ubrk_cache[i].c_master || stri__ubrk_cache[i].cpp_master)
+         ++count;
+   return count;
+}
+
+R_len_t stri__ubrk_cache_capacity()
+{
+   return STRI__UBRK_CACHE_SIZE;
+}
+
+unsigned stri__ubrk_cache_oldest()
+{
+   unsigned oldest = 0;
+   for (int i=0; i<STRI__UBRK_CACHE_SIZE; ++i) {
+      StriCachedBrkIter* e = &stri__ubrk_cache[i];
+      if ((e->c_master || e->cpp_master) &&
+            (oldest == 0 || e->stamp < oldest))
+         oldest = e->stamp;
+   }
+   return oldest;
+}
+
+void stri__ubrk_cache_evict_oldest()
+{
+   int slot = -1;
+   for (int i=0; i<STRI__UBRK_CACHE_SIZE; ++i) {
+      StriCachedBrkIter* e = &stri__ubrk_cache[i];
+      if ((e->c_master || e->cpp_master) &&
+            (slot < 0 || e->stamp < stri__ubrk_cache[slot].stamp))
+         slot = i;
+   }
+   if (slot < 0) return;
+   StriCachedBrkIter* e = &stri__ubrk_cache[slot];
+   if (e->c_master)   { ubrk_close(e->c_master);  e->c_master = NULL;   }
+   if (e->cpp_master) { delete e->cpp_master;     e->cpp_master = NULL; }
+   e->key.clear();
+   e->stamp = 0;
+}
+
+void stri__ubrk_cache_clear()
+{
+   for (int i=0; i<STRI__UBRK_CACHE_SIZE; ++i) {
+      StriCachedBrkIter* e = &stri__ubrk_cache[i];
+      if (e->c_master)   { ubrk_close(e->c_master);  e->c_master = NULL;   }
+      if (e->cpp_master) { delete e->cpp_master;     e->cpp_master = NULL; }
+      e->key.clear();
+      e->stamp = 0;
+   }
+}
+
+
+/** a private clone of the cached (type, locale) break iterator
+ *  [C API flavor]
+ *
+ * The master is opened on the first request; steady-state calls pay
+ * only for ubrk_safeClone + ubrk_setText. The caller owns the clone
+ * and ubrk_close()s it as before.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+UBreakIterator* stri__ubrk_open_cached(UBreakIteratorType type,
+   const char* locale)
+{
+   StriCachedBrkIter* e = stri__ubrk_cache_slot(type, locale);
+   UErrorCode status = U_ZERO_ERROR;
+   bool had_master = (e->c_master != NULL);
+   if (!had_master) {
+      e->c_master = ubrk_open(type, locale, NULL, 0, &status);
+      if (U_FAILURE(status)) e->c_master = NULL;
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      ++stri__usage_brkiter.opens;
+   }
+
+   status = U_ZERO_ERROR;
+   UBreakIterator* clone = ubrk_safeClone(e->c_master, NULL, NULL, &status);
+   if (U_FAILURE(status) || !clone) { // fall back to a fresh instance
+      status = U_ZERO_ERROR;
+      clone = ubrk_open(type, locale, NULL, 0, &status);
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      ++stri__usage_brkiter.opens;
+   }
+   else if (had_master)
+      ++stri__usage_brkiter.hits;
+   if (!had_master)
+      stri__cache_enforce_budget(); // see options(stringi.cache_max_entries=)
+   return clone;
+}
+
+
+/** a private clone of the cached (type, locale) break iterator
+ *  [C++ API flavor]
+ *
+ * As above, but for StriRuleBasedBreakIterator; the caller owns the
+ * clone and delete-s it as before.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+BreakIterator* stri__brkiter_open_cached(UBreakIteratorType type,
+   const char* locale)
+{
+   StriCachedBrkIter* e = stri__ubrk_cache_slot(type, locale);
+   UErrorCode status = U_ZERO_ERROR;
+   bool had_master = (e->cpp_master != NULL);
+   if (!had_master) {
+      Locale loc = Locale::createFromName(locale);
+      switch (type) {
+      case UBRK_CHARACTER:
+         e->cpp_master = BreakIterator::createCharacterInstance(loc, status);
+         break;
+      case UBRK_LINE:
+         e->cpp_master = BreakIterator::createLineInstance(loc, status);
+         break;
+      case UBRK_SENTENCE:
+         e->cpp_master = BreakIterator::createSentenceInstance(loc, status);
+         break;
+      case UBRK_WORD:
+         e->cpp_master = BreakIterator::createWordInstance(loc, status);
+         break;
+      default:
+         throw StriException(MSG__INTERNAL_ERROR);
+      }
+      if (U_FAILURE(status)) e->cpp_master = NULL;
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      ++stri__usage_brkiter.opens;
+   }
+
+   BreakIterator* clone = e->cpp_master->clone();
+   if (!clone)
+      throw StriException(MSG__MEM_ALLOC_ERROR);
+   if (had_master)
+      ++stri__usage_brkiter.hits;
+   else
+      stri__cache_enforce_budget(); // see options(stringi.cache_max_entries=)
+   return clone;
+}
 
 
 /** Select Break Iterator
@@ -230,7 +450,94 @@ void StriBrkIterOptions::setSkipRuleStatus(SEXP opts_brkiter) {
 }
 
 
-/**
+// parsed form of a recently seen opts_brkiter list (stri_opts_memo.h);
+// the locale is deliberately absent - it may resolve against the
+// default locale, which can change mid-session, so a memo hit re-runs
+// setLocale (one cheap walk; the canonicalization behind it has its
+// own cache). The type is stored only when the list actually carries a
+// "type" entry - otherwise it comes from the caller's default, and the
+// same list may serve entry points with different defaults.
+struct StriBrkIterOptsParsed {
+   bool has_type;            ///< list had a "type" entry?
+   UBreakIteratorType type;  ///< only meaningful if has_type
+   UnicodeString rules;      ///< custom rules, empty for named types
+   std::vector<int32_t> skip;
+
+   StriBrkIterOptsParsed() : has_type(false), type(UBRK_CHARACTER) { }
+};
+static StriOptsMemo<StriBrkIterOptsParsed> stri__brkiter_opts_memo;
+
+
+/** Restore a memoized parse of opts_brkiter, if there is one
+ *
+ * @param opts_brkiter named list
+ * @param _default default break iterator type
+ * @return true if this object is now fully set up
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+bool StriBrkIterOptions::setMemoized(SEXP opts_brkiter, const char* _default)
+{
+   StriBrkIterOptsParsed* p = stri__brkiter_opts_memo.find(opts_brkiter);
+   if (!p) return false;
+
+   setLocale(opts_brkiter); // never memoized, see StriBrkIterOptsParsed
+
+   if (!p->skip.empty()) {
+      skip_size = (R_len_t)p->skip.size();
+      skip_rules = (int32_t*)R_alloc((size_t)skip_size, (int)sizeof(int32_t));
+      for (R_len_t i=0; i<skip_size; ++i)
+         skip_rules[i] = p->skip[(size_t)i];
+   }
+
+   if (p->has_type) {
+      this->type = p->type;
+      this->rules = p->rules;
+   }
+   else
+      setType(R_NilValue, _default); // resolve the caller's default
+   return true;
+}
+
+
+/** Remember the (successful) parse of opts_brkiter
+ *
+ * No-op if the list does not qualify for memoization.
+ *
+ * @param opts_brkiter named list
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void StriBrkIterOptions::memoize(SEXP opts_brkiter)
+{
+   if (!Rf_isVectorList(opts_brkiter)) return; // NULL etc.
+
+   StriBrkIterOptsParsed parsed;
+   R_len_t narg = LENGTH(opts_brkiter);
+   SEXP names = Rf_getAttrib(opts_brkiter, R_NamesSymbol);
+   if (names == R_NilValue || LENGTH(names) != narg) return;
+   for (R_len_t i=0; i<narg; ++i) {
+      if (STRING_ELT(names, i) != NA_STRING
+            && !strcmp(CHAR(STRING_ELT(names, i)), "type")) {
+         parsed.has_type = true;
+         parsed.type = this->type;
+         parsed.rules = this->rules;
+         break;
+      }
+   }
+   if (skip_size > 0)
+      parsed.skip.assign(skip_rules, skip_rules+skip_size);
+   stri__brkiter_opts_memo.put(opts_brkiter, parsed);
+}
+
+
+/** Bind the iterator to a UTF-8 byte range
+ *
+ * The text is wrapped in a UText over the UTF-8 bytes themselves
+ * (utext_openUTF8, reusing the previous UText's storage), so the whole
+ * boundary family - count/locate/split/extract - iterates without ever
+ * transcoding an element to UTF-16; all reported offsets are native
+ * byte indices.
  *
  * @ version 0.4-1 (Marek Gagolewski, 2014-12-03)
  */
@@ -242,13 +549,10 @@ void StriRuleBasedBreakIterator::setupMatcher(const char* _searchStr, R_len_t _s
    this->searchLen = _searchLen;
    this->searchPos = BreakIterator::DONE;
 
-   UErrorCode status = U_ZERO_ERROR;
-   this->searchText = utext_openUTF8(this->searchText,
-      _searchStr, _searchLen, &status);
-   STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+   this->searchText.wrap(_searchStr, _searchLen);
 
-   status = U_ZERO_ERROR;
-   this->rbiterator->setText(this->searchText, status);
+   UErrorCode status = U_ZERO_ERROR;
+   this->rbiterator->setText(this->searchText.get(), status);
    STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
 }
 
@@ -266,7 +570,7 @@ void StriRuleBasedBreakIterator::setupMatcher(const char* _searchStr, R_len_t _s
  */
 bool StriRuleBasedBreakIterator::ignoreBoundary() {
 #ifndef NDEBUG
-   if (!rbiterator || !searchText)
+   if (!rbiterator || !searchText.get())
       throw StriException("!NDEBUG: StriRuleBasedBreakIterator::ignoreBoundary()");
 #endif
 
@@ -379,3 +683,80 @@ bool StriRuleBasedBreakIterator::previous(std::pair<R_len_t, R_len_t>& bdr)
    while (searchPos != BreakIterator::DONE);
    return false;
 }
+
+
+/** a private clone of the cached custom-rules break iterator
+ *  [C API flavor]
+ *
+ * Compiling a rule set is among the slowest ICU object creations;
+ * the compiled master is kept, keyed by the rule text, and steady-state
+ * calls pay only for ubrk_safeClone. The caller owns the clone.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+UBreakIterator* stri__ubrk_open_rules_cached(const UnicodeString& rules)
+{
+   StriCachedBrkIter* e = stri__ubrk_cache_slot_rules(rules);
+   UErrorCode status = U_ZERO_ERROR;
+   bool had_master = (e->c_master != NULL);
+   if (!had_master) {
+      UParseError parseErr;
+      e->c_master = ubrk_openRules(rules.getTerminatedBuffer(),
+         -1/*null-terminated*/, NULL, 0, &parseErr, &status);
+      if (U_FAILURE(status)) e->c_master = NULL;
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      ++stri__usage_brkiter.opens;
+   }
+
+   status = U_ZERO_ERROR;
+   UBreakIterator* clone = ubrk_safeClone(e->c_master, NULL, NULL, &status);
+   if (U_FAILURE(status) || !clone) { // fall back to a fresh instance
+      status = U_ZERO_ERROR;
+      UParseError parseErr;
+      clone = ubrk_openRules(rules.getTerminatedBuffer(),
+         -1/*null-terminated*/, NULL, 0, &parseErr, &status);
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      ++stri__usage_brkiter.opens;
+   }
+   else if (had_master)
+      ++stri__usage_brkiter.hits;
+   if (!had_master)
+      stri__cache_enforce_budget(); // see options(stringi.cache_max_entries=)
+   return clone;
+}
+
+
+/** a private clone of the cached custom-rules break iterator
+ *  [C++ API flavor]
+ *
+ * As above, but for StriRuleBasedBreakIterator; the caller owns the
+ * clone and delete-s it as before.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+BreakIterator* stri__brkiter_open_rules_cached(const UnicodeString& rules)
+{
+   StriCachedBrkIter* e = stri__ubrk_cache_slot_rules(rules);
+   bool had_master = (e->cpp_master != NULL);
+   if (!had_master) {
+      UParseError parseErr;
+      UErrorCode status = U_ZERO_ERROR;
+      BreakIterator* fresh = (BreakIterator*) new RuleBasedBreakIterator(
+         UnicodeString(rules), parseErr, status);
+      if (U_FAILURE(status)) {
+         if (fresh) delete fresh;
+         STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      }
+      e->cpp_master = fresh;
+      ++stri__usage_brkiter.opens;
+   }
+
+   BreakIterator* clone = e->cpp_master->clone();
+   if (!clone)
+      throw StriException(MSG__MEM_ALLOC_ERROR);
+   if (had_master)
+      ++stri__usage_brkiter.hits;
+   else
+      stri__cache_enforce_budget(); // see options(stringi.cache_max_entries=)
+   return clone;
+}
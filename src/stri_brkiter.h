@@ -37,10 +37,21 @@
 #include <utility>
 #include <vector>
 #include <unicode/brkiter.h>
+#include "stri_utext.h"
 #include <unicode/uloc.h>
 #include <unicode/locid.h>
 
 
+// cached break iterator factories, see stri_brkiter.cpp;
+// the caller owns (and closes/deletes) the returned clone
+UBreakIterator* stri__ubrk_open_cached(UBreakIteratorType type,
+   const char* locale);
+BreakIterator* stri__brkiter_open_cached(UBreakIteratorType type,
+   const char* locale);
+UBreakIterator* stri__ubrk_open_rules_cached(const UnicodeString& rules);
+BreakIterator* stri__brkiter_open_rules_cached(const UnicodeString& rules);
+
+
 /**
  * A class to manage a break iterator's options
  *
@@ -72,6 +83,8 @@ class StriBrkIterOptions {
       void setType(SEXP opts_brkiter, const char* default_type);
       void setLocale(SEXP opts_brkiter);
       void setSkipRuleStatus(SEXP opts_brkiter);
+      bool setMemoized(SEXP opts_brkiter, const char* default_type);
+      void memoize(SEXP opts_brkiter);
 
 
    public:
@@ -83,9 +96,31 @@ class StriBrkIterOptions {
 
       StriBrkIterOptions(SEXP opts_brkiter, const char* default_type) {
          setEmptyOpts();
+         if (setMemoized(opts_brkiter, default_type))
+            return; // a recently parsed list, see stri_opts_memo.h
          setLocale(opts_brkiter);
          setSkipRuleStatus(opts_brkiter);
          setType(opts_brkiter, default_type);
+         memoize(opts_brkiter);
+      }
+
+      /** an untailored word iterator with no custom rules and no
+       *  rule-status skipping? (enables ASCII fast paths) */
+      bool isDefaultWord() const {
+         return type == UBRK_WORD && rules.isEmpty() && skip_size == 0;
+      }
+
+      /** an untailored character (grapheme cluster) iterator with no
+       *  custom rules and no rule-status skipping? (allows a persistent
+       *  grapheme index to stand in for the iterator) */
+      bool isDefaultCharacter() const {
+         return type == UBRK_CHARACTER && rules.isEmpty() && skip_size == 0;
+      }
+
+      /** replace the locale, e.g. for locale-grouped batch processing;
+       *  loc must outlive this object */
+      void setLocaleValue(const char* loc) {
+         locale = loc;
       }
 };
 
@@ -100,6 +135,8 @@ class StriBrkIterOptions {
  * @version 1.1.3 (Marek Gagolewski, 2017-01-07) UBRK_COUNT deprecated
  *
  * @version 1.1.6 (Marek Gagolewski, 2017-04-22) Add support for RBBI
+ *
+ * @version 1.4.6 (2020-01-24) custom rule sets are compiled once and cached
  */
 class StriUBreakIterator : public StriBrkIterOptions {
    private:
@@ -112,24 +149,19 @@ class StriUBreakIterator : public StriBrkIterOptions {
 #endif
          UErrorCode status = U_ZERO_ERROR;
          if (!rules.isEmpty()) {
-            UParseError parseErr;
-            uiterator = ubrk_openRules(rules.getTerminatedBuffer(),
-                                       -1/*null-terminated*/, NULL, 0,
-                                       &parseErr, &status);
+            // a clone of a cached master - each distinct rule set is
+            // compiled at most once
+            uiterator = stri__ubrk_open_rules_cached(rules);
          }
          else {
             switch (type) {
             case UBRK_CHARACTER: // character
-               uiterator = ubrk_open(UBRK_CHARACTER, locale, NULL, 0, &status);
-               break;
-            case UBRK_LINE: // line_break
-               uiterator = ubrk_open(UBRK_LINE, locale, NULL, 0, &status);
-               break;
-            case UBRK_SENTENCE: // sentence
-               uiterator = ubrk_open(UBRK_SENTENCE, locale, NULL, 0, &status);
-               break;
-            case UBRK_WORD: // word
-               uiterator = ubrk_open(UBRK_WORD, locale, NULL, 0, &status);
+            case UBRK_LINE:      // line_break
+            case UBRK_SENTENCE:  // sentence
+            case UBRK_WORD:      // word
+               // a clone of a cached master - dictionaries and rules
+               // are loaded at most once per (type, locale)
+               uiterator = stri__ubrk_open_cached(type, locale);
                break;
             default:
                throw StriException(MSG__INTERNAL_ERROR);
@@ -194,19 +226,21 @@ class StriUBreakIterator : public StriBrkIterOptions {
  * separate class
  *
  * @version 1.1.6 (Marek Gagolewski, 2017-04-22) Add support for RBBI
+ *
+ * @version 1.4.6 (2020-01-24) custom rule sets are compiled once and cached
  */
 class StriRuleBasedBreakIterator : public StriBrkIterOptions {
    private:
 
       BreakIterator* rbiterator;
-      UText* searchText;
+      StriUText searchText;
       R_len_t searchPos; // may be BreakIterator::DONE
       const char* searchStr; // owned by caller
       R_len_t searchLen; // in bytes
 
       void setEmptyOpts() {
          rbiterator = NULL;
-         searchText = NULL;
+         searchText.close();
          searchPos = BreakIterator::DONE;
          searchStr = NULL;
          searchLen = 0;
@@ -214,26 +248,20 @@ class StriRuleBasedBreakIterator : public StriBrkIterOptions {
 
       void open() {
          UErrorCode status = U_ZERO_ERROR;
-         Locale loc = Locale::createFromName(locale);
          if (!rules.isEmpty()) {
-            UParseError parseErr;
-            rbiterator = (BreakIterator*) new RuleBasedBreakIterator(
-               UnicodeString(rules), parseErr, status
-            );
+            // a clone of a cached master - each distinct rule set is
+            // compiled at most once
+            rbiterator = stri__brkiter_open_rules_cached(rules);
          }
          else {
             switch (type) {
             case UBRK_CHARACTER: // character
-               rbiterator = (BreakIterator*)BreakIterator::createCharacterInstance(loc, status);
-               break;
-            case UBRK_LINE: // line_break
-               rbiterator = (BreakIterator*)BreakIterator::createLineInstance(loc, status);
-               break;
-            case UBRK_SENTENCE: // sentence
-               rbiterator = (BreakIterator*)BreakIterator::createSentenceInstance(loc, status);
-               break;
-            case UBRK_WORD: // word
-               rbiterator = (BreakIterator*)BreakIterator::createWordInstance(loc, status);
+            case UBRK_LINE:      // line_break
+            case UBRK_SENTENCE:  // sentence
+            case UBRK_WORD:      // word
+               // a clone of a cached master - dictionaries and rules
+               // are loaded at most once per (type, locale)
+               rbiterator = stri__brkiter_open_cached(type, locale);
                break;
             default:
                throw StriException(MSG__INTERNAL_ERROR);
@@ -269,10 +297,7 @@ class StriRuleBasedBreakIterator : public StriBrkIterOptions {
             rbiterator = NULL;
          }
 
-         if (searchText) {
-            utext_close(searchText);
-            searchText = NULL;
-         }
+         searchText.close();
       }
 
       void setupMatcher(const char* searchStr, R_len_t searchLen);
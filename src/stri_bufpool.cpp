@@ -0,0 +1,100 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_bufpool.h"
+
+
+#define STRI__BUFPOOL_SLOTS 4
+#define STRI__BUFPOOL_KEEP_MAX 4194304 ///< do not cache buffers > 4 MiB
+
+
+// C++11 is optional in stringi (see configure's --disable-cxx11);
+// without it there are no worker threads either (see stri_threads.h),
+// so a plain static pool is only ever touched from the main R thread
+#if defined(__cplusplus) && __cplusplus >= 201103L
+static thread_local String8buf* bufpool[STRI__BUFPOOL_SLOTS] = {NULL};
+#else
+static String8buf* bufpool[STRI__BUFPOOL_SLOTS] = {NULL};
+#endif
+
+
+/** Lease a scratch buffer of at least a given size [internal]
+ *
+ * The buffer is taken out of the current thread's pool (and grown if
+ * needed) or, if the pool is empty, freshly allocated. Its contents are
+ * undefined. Hand it back with stri__bufpool_release - or do not: a
+ * leaked lease (e.g. after a longjmp out of an R API call) merely loses
+ * the buffer, the pool itself stays consistent.
+ *
+ * Use via StriScratchBuf, not directly.
+ *
+ * @param size requested buffer size-1, as in the String8buf constructor
+ * @return a buffer owned by the caller until released
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+String8buf* stri__bufpool_acquire(R_len_t size)
+{
+   for (int k=0; k<STRI__BUFPOOL_SLOTS; ++k) {
+      if (bufpool[k]) {
+         String8buf* buf = bufpool[k];
+         bufpool[k] = NULL;
+         buf->resize(size, false/*destroy contents*/);
+         return buf;
+      }
+   }
+   return new String8buf(size);
+}
+
+
+/** Return a leased scratch buffer to the current thread's pool [internal]
+ *
+ * Oversized buffers and buffers not fitting into the pool are freed.
+ *
+ * @param buf buffer obtained from stri__bufpool_acquire, may be NULL
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void stri__bufpool_release(String8buf* buf)
+{
+   if (!buf) return;
+   if (buf->size() <= STRI__BUFPOOL_KEEP_MAX) {
+      for (int k=0; k<STRI__BUFPOOL_SLOTS; ++k) {
+         if (!bufpool[k]) {
+            bufpool[k] = buf;
+            return;
+         }
+      }
+   }
+   delete buf;
+}
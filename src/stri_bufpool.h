@@ -0,0 +1,102 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_bufpool_h
+#define __stri_bufpool_h
+
+#include "stri_string8buf.h"
+
+
+String8buf* stri__bufpool_acquire(R_len_t size);
+void stri__bufpool_release(String8buf* buf);
+
+
+/**
+ * A scratch String8buf leased from a small per-thread pool
+ *
+ * Buffers are grow-only and survive between leases, so the tight
+ * vectorized loops that used to construct a fresh String8buf on
+ * every call (casemap, pad, replace, ...) reach a steady state with
+ * no allocation at all. The destructor puts the buffer back, so the
+ * class is used exactly like a function-local String8buf; the only
+ * restriction is that a lease must not be handed over to another
+ * thread.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+class StriScratchBuf {
+
+   private:
+
+      String8buf* m_buf;
+
+      // leases are not copyable
+      StriScratchBuf(const StriScratchBuf&);
+      StriScratchBuf& operator=(const StriScratchBuf&);
+
+   public:
+
+      StriScratchBuf(R_len_t size=0) {
+         this->m_buf = stri__bufpool_acquire(size);
+      }
+
+      ~StriScratchBuf() {
+         stri__bufpool_release(this->m_buf);
+         this->m_buf = NULL;
+      }
+
+      /* return data */
+      inline char* data() {
+         return this->m_buf->data();
+      }
+
+      /** buffer size in bytes */
+      inline R_len_t size() const {
+         return this->m_buf->size();
+      }
+
+      /** increase buffer size, see String8buf::resize */
+      inline void resize(R_len_t size, bool copy=true) {
+         this->m_buf->resize(size, copy);
+      }
+
+      /** see String8buf::replaceAllAtPos */
+      inline int replaceAllAtPos(const char* str_cur_s, R_len_t str_cur_n,
+         const char* replacement_cur_s, R_len_t replacement_cur_n,
+         std::deque< std::pair<R_len_t, R_len_t> >& occurrences)
+      {
+         return this->m_buf->replaceAllAtPos(str_cur_s, str_cur_n,
+            replacement_cur_s, replacement_cur_n, occurrences);
+      }
+};
+
+#endif
@@ -38,6 +38,50 @@
 #define USEARCH_DONE -1
 #endif
 
+#include <vector>
+
+// vectorized kernels for the byte matchers; SSE2 is part of the x86-64
+// baseline, everything else gracefully falls back to the scalar code
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define STRI__BYTESEARCH_SIMD 1
+#endif
+
+
+/** fold an ASCII byte to upper case; non-letters map to themselves.
+ *  branchless in practice - this is what a 256-byte lookup table would
+ *  give us, without the cache line */
+inline unsigned char stri__ascii_toupper(unsigned char c) {
+   return (c >= 'a' && c <= 'z') ? (unsigned char)(c-('a'-'A')) : c;
+}
+
+
+/** can two occurrences of this pattern overlap each other?
+ *  (i.e. does the pattern have a nonempty border - a proper suffix
+ *  that is also a prefix, like "aba"?)
+ *
+ *  if not, the greedy non-overlapping match enumeration visits every
+ *  occurrence, which makes chunked (parallel) scans exact */
+inline bool stri__bytesearch_pattern_self_overlaps(const char* p, R_len_t m) {
+   for (R_len_t b=1; b<m; ++b)
+      if (0 == memcmp(p, p+m-b, (size_t)b)) return true;
+   return false;
+}
+
+
+/** length of the smallest period of the pattern
+ *  (== m for patterns with no border at all) */
+inline R_len_t stri__bytesearch_pattern_period(const char* p, R_len_t m) {
+   std::vector<int> border(m+1);
+   border[0] = -1;
+   int k = -1;
+   for (R_len_t i=0; i<m; ++i) {
+      while (k >= 0 && p[k] != p[i]) k = border[k];
+      border[i+1] = ++k;
+   }
+   return m - border[m];
+}
+
 
 /**
  * Performs actual pattern matching on behalf of StriContainerByteSearch
@@ -89,7 +133,7 @@ class StriByteSearchMatcher {
       virtual R_len_t findFirst() = 0;
       virtual R_len_t findLast() = 0;
 
-      R_len_t findNext() {
+      virtual R_len_t findNext() {
          if (m_searchPos < 0) return findFirst();
 
          if (m_optOverlap) {
@@ -102,6 +146,30 @@ class StriByteSearchMatcher {
       }
 
 
+      /** enumerate all the matches in one scan, appending each
+       * (start, end) byte offset pair to `arena`
+       *
+       * The arena is not cleared here - the caller owns it and may
+       * reuse it (clear() keeps the capacity), so a vectorized loop
+       * allocates at most once per call, not once per element.
+       *
+       * @param arena [in/out] recorded offsets, 2 ints per match
+       * @return the number of matches appended
+       *
+       * @version 1.4.6 (2020-01-24)
+       */
+      virtual R_len_t recordAll(std::vector<int>& arena) {
+         R_len_t found = 0;
+         R_len_t pos;
+         while (USEARCH_DONE != (pos = findNext())) {
+            arena.push_back((int)pos);
+            arena.push_back((int)m_searchEnd);
+            ++found;
+         }
+         return found;
+      }
+
+
       /** get start index of pattern match from the last search
        *
        * @return byte index in searchStr
@@ -256,11 +324,33 @@ class StriByteSearchMatcherKMPci : public StriByteSearchMatcher {
       int m_patternPos;
       R_len_t m_patternLenCaseInsensitive;
       UChar32* m_patternStrCaseInsensitive;
+      bool m_patternAscii;  ///< all pattern code points < 128?
+      bool m_searchAscii;   ///< all haystack bytes < 128? (only if m_patternAscii)
 
       virtual R_len_t findFromPos(R_len_t startPos) {
          int j = startPos;
          m_patternPos = 0;
 
+         if (m_patternAscii && m_searchAscii) {
+            // byte-wise fold, no U8_NEXT/u_toupper per character;
+            // for ASCII, code point positions == byte positions, so the
+            // very same KMP table applies
+            while (j < m_searchLen) {
+               UChar32 b = stri__ascii_toupper((unsigned char)m_searchStr[j]);
+               ++j;
+               while (m_patternPos >= 0 && m_patternStrCaseInsensitive[m_patternPos] != b)
+                  m_patternPos = m_kmpNext[m_patternPos];
+               m_patternPos++;
+               if (m_patternPos == m_patternLenCaseInsensitive) {
+                  m_searchEnd = j;
+                  m_searchPos = j-m_patternLenCaseInsensitive;
+                  return m_searchPos;
+               }
+            }
+            m_searchPos = m_searchEnd = m_searchLen;
+            return USEARCH_DONE;
+         }
+
          UChar32 c = 0;
          while (j < m_searchLen) {
             U8_NEXT(m_searchStr, j, m_searchLen, c);
@@ -309,12 +399,15 @@ class StriByteSearchMatcherKMPci : public StriByteSearchMatcher {
             UChar32 c = 0;
          R_len_t j = 0;
          m_patternLenCaseInsensitive = 0;
+         m_patternAscii = true;
+         m_searchAscii = false;
          while (j < patternLen) {
             U8_NEXT(patternStr, j, patternLen, c);
 #ifndef NDEBUG
             if (m_patternLenCaseInsensitive >= kmpMaxSize)
                throw StriException("!NDEBUG: StriByteSearchMatcherKMPci::StriByteSearchMatcherKMPci()");
 #endif
+            if (c >= 128) m_patternAscii = false;
             m_patternStrCaseInsensitive[m_patternLenCaseInsensitive++] = u_toupper(c);
          }
          m_patternStrCaseInsensitive[m_patternLenCaseInsensitive] = 0;
@@ -323,6 +416,18 @@ class StriByteSearchMatcherKMPci : public StriByteSearchMatcher {
       virtual void reset(const char* searchStr, R_len_t searchLen) {
          StriByteSearchMatcher::reset(searchStr, searchLen);
          m_patternPos = -1;
+
+         // an ASCII pattern may still match non-ASCII text under full
+         // case folding (e.g. U+0131 uppercases to I), so the byte-wise
+         // path additionally requires a pure-ASCII haystack; this single
+         // pass is trivially auto-vectorized and far cheaper than the
+         // per-character u_toupper calls it saves
+         if (m_patternAscii) {
+            unsigned char acc = 0;
+            for (R_len_t k=0; k<searchLen; ++k)
+               acc |= (unsigned char)searchStr[k];
+            m_searchAscii = (acc < 128);
+         }
       }
 
       virtual R_len_t findFirst() {
@@ -355,6 +460,25 @@ class StriByteSearchMatcherKMPci : public StriByteSearchMatcher {
 
          int j = m_searchLen;
          m_patternPos = 0;
+
+         if (m_patternAscii && m_searchAscii) {
+            while (j > 0) {
+               --j;
+               UChar32 b = stri__ascii_toupper((unsigned char)m_searchStr[j]);
+               while (m_patternPos >= 0 &&
+                     m_patternStrCaseInsensitive[m_patternLenCaseInsensitive-1-m_patternPos] != b)
+                  m_patternPos = m_kmpNext[m_patternPos];
+               m_patternPos++;
+               if (m_patternPos == m_patternLenCaseInsensitive) {
+                  m_searchPos = j;
+                  m_searchEnd = j+m_patternLenCaseInsensitive;
+                  return m_searchPos;
+               }
+            }
+            m_searchPos = m_searchEnd = m_searchLen;
+            return USEARCH_DONE;
+         }
+
          while (j > 0) {
             UChar32 c;
             U8_PREV(m_searchStr, 0, j, c);
@@ -402,7 +526,11 @@ class StriByteSearchMatcher1 : public StriByteSearchMatcher {
             return USEARCH_DONE;
          }
 
-         const char* res = strchr(m_searchStr+startPos, m_patternStr[0]);
+         // memchr, not strchr: the haystack may be a view into a larger
+         // buffer (e.g. a memory-mapped file) and need not be
+         // NUL-terminated
+         const char* res = (const char*)memchr(m_searchStr+startPos,
+            m_patternStr[0], (size_t)(m_searchLen-startPos));
          if (res) {
             m_searchPos = (int)(res-m_searchStr);
             m_searchEnd = m_searchPos+1;
@@ -449,6 +577,16 @@ class StriByteSearchMatcher1 : public StriByteSearchMatcher {
             return USEARCH_DONE;
          }
 
+#if defined(__GLIBC__)
+         // memrchr scans backwards a word (or vector) at a time
+         const char* res = (const char*)memrchr(m_searchStr,
+            (unsigned char)m_patternStr[0], m_searchLen);
+         if (res) {
+            m_searchPos = (R_len_t)(res-m_searchStr);
+            m_searchEnd = m_searchPos + 1;
+            return m_searchPos;
+         }
+#else
          unsigned char pat = (unsigned char)m_patternStr[0];
          for (m_searchPos = startPos-0; m_searchPos>=0; --m_searchPos) {
             if (pat == (unsigned char)m_searchStr[m_searchPos]) {
@@ -456,11 +594,232 @@ class StriByteSearchMatcher1 : public StriByteSearchMatcher {
                return m_searchPos;
             }
          }
+#endif
+
+         // else not found
+         m_searchPos = m_searchEnd = m_searchLen;
+         return USEARCH_DONE;
+      }
+};
+
+
+/** Boyer-Moore-Horspool - used for long patterns
+ *
+ * KMP inspects every haystack byte; with a long pattern the
+ * bad-character table lets us hop over most of the text
+ * (typically patternLen bytes at a time).
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+class StriByteSearchMatcherBMH : public StriByteSearchMatcher {
+
+   private:
+
+      StriByteSearchMatcherBMH(const StriByteSearchMatcherBMH&); /* no copy-able */
+      StriByteSearchMatcherBMH& operator=(const StriByteSearchMatcherBMH&);
+
+   protected:
+
+      R_len_t m_badchar[256];     ///< forward shift table
+      R_len_t m_badcharBack[256]; ///< backward shift table
+      bool m_badcharBackReady;
+
+      virtual R_len_t findFromPos(R_len_t startPos) {
+#ifndef NDEBUG
+         if (!m_searchStr) throw StriException("!m_searchStr");
+#endif
+         const unsigned char* s = (const unsigned char*)m_searchStr;
+         const unsigned char* p = (const unsigned char*)m_patternStr;
+         R_len_t j = startPos;
+         while (j <= m_searchLen-m_patternLen) {
+            unsigned char last = s[j+m_patternLen-1];
+            if (last == p[m_patternLen-1]
+                  && 0 == memcmp(s+j, p, m_patternLen-1)) {
+               m_searchPos = j;
+               m_searchEnd = j+m_patternLen;
+               return m_searchPos;
+            }
+            j += m_badchar[last];
+         }
+
+         // else not found
+         m_searchPos = m_searchEnd = m_searchLen;
+         return USEARCH_DONE;
+      }
+
+
+   public:
+
+      StriByteSearchMatcherBMH(const char* patternStr, R_len_t patternLen, bool optOverlap)
+         : StriByteSearchMatcher(patternStr, patternLen, optOverlap)
+      {
+         for (int c=0; c<256; ++c)
+            m_badchar[c] = patternLen;
+         for (R_len_t i=0; i<patternLen-1; ++i)
+            m_badchar[(unsigned char)patternStr[i]] = patternLen-1-i;
+         m_badcharBackReady = false;
+      }
+
+      virtual R_len_t findFirst() {
+         return findFromPos(0);
+      }
+
+      virtual R_len_t findLast()  {
+         if (!m_badcharBackReady) {
+            // the same table, over the reversed pattern
+            for (int c=0; c<256; ++c)
+               m_badcharBack[c] = m_patternLen;
+            for (R_len_t i=m_patternLen-1; i>0; --i)
+               m_badcharBack[(unsigned char)m_patternStr[i]] = i;
+            m_badcharBackReady = true;
+         }
+
+         const unsigned char* s = (const unsigned char*)m_searchStr;
+         const unsigned char* p = (const unsigned char*)m_patternStr;
+         R_len_t j = m_searchLen-m_patternLen;
+         while (j >= 0) {
+            unsigned char first = s[j];
+            if (first == p[0]
+                  && 0 == memcmp(s+j+1, p+1, m_patternLen-1)) {
+               m_searchPos = j;
+               m_searchEnd = j+m_patternLen;
+               return m_searchPos;
+            }
+            j -= m_badcharBack[first];
+         }
+
+         // else not found
+         m_searchPos = m_searchEnd = m_searchLen;
+         return USEARCH_DONE;
+      }
+};
+
+
+/** Two-Way string matching (Crochemore & Perrin, as in glibc memmem)
+ *
+ *  Linear time, constant extra space, no shift tables. Selected for
+ *  long patterns with a short period ("abababab...", repeated
+ *  delimiters) where Boyer-Moore-Horspool's bad-character skips
+ *  degenerate to 1 and it goes quadratic.
+ *
+ *  @version 1.4.6 (2020-01-24)
+ */
+class StriByteSearchMatcherTwoWay : public StriByteSearchMatcher {
+
+   private:
+
+      StriByteSearchMatcherTwoWay(const StriByteSearchMatcherTwoWay&); /* no copy-able */
+      StriByteSearchMatcherTwoWay& operator=(const StriByteSearchMatcherTwoWay&);
+
+   protected:
+
+      R_len_t m_ell;      ///< critical position (end of the left factor)
+      R_len_t m_per;      ///< period to shift by
+      bool m_periodic;    ///< does the left factor repeat with m_per?
+
+      /** maximal suffix of the pattern, w.r.t. <= (invert=false)
+       *  or >= (invert=true); returns its starting position - 1
+       *  and the corresponding period */
+      static R_len_t maxSuffix(const unsigned char* x, R_len_t m,
+            R_len_t& per, bool invert)
+      {
+         R_len_t ms = -1, j = 0, k = 1;
+         per = 1;
+         while (j+k < m) {
+            unsigned char a = x[j+k], b = x[ms+k];
+            if (invert ? (a > b) : (a < b)) {
+               j += k; k = 1; per = j-ms;
+            }
+            else if (a == b) {
+               if (k != per) ++k;
+               else { j += per; k = 1; }
+            }
+            else {
+               ms = j; j = ms+1; k = 1; per = 1;
+            }
+         }
+         return ms;
+      }
+
+      virtual R_len_t findFromPos(R_len_t startPos) {
+#ifndef NDEBUG
+         if (!m_searchStr) throw StriException("!m_searchStr");
+#endif
+         const unsigned char* x = (const unsigned char*)m_patternStr;
+         const unsigned char* y = (const unsigned char*)m_searchStr;
+         R_len_t m = m_patternLen, n = m_searchLen;
+         R_len_t j = startPos;
+         R_len_t memory = -1; // rightmost verified position (periodic case)
+
+         while (j <= n-m) {
+            R_len_t i = ((m_ell > memory) ? m_ell : memory) + 1;
+            while (i < m && x[i] == y[i+j]) ++i;
+            if (i >= m) {
+               i = m_ell;
+               while (i > memory && x[i] == y[i+j]) --i;
+               if (i <= memory) {
+                  m_searchPos = j;
+                  m_searchEnd = j+m;
+                  return m_searchPos;
+               }
+               j += m_per;
+               memory = m_periodic ? m-m_per-1 : -1;
+            }
+            else {
+               j += i-m_ell;
+               memory = -1;
+            }
+         }
 
          // else not found
          m_searchPos = m_searchEnd = m_searchLen;
          return USEARCH_DONE;
       }
+
+
+   public:
+
+      StriByteSearchMatcherTwoWay(const char* patternStr, R_len_t patternLen, bool optOverlap)
+         : StriByteSearchMatcher(patternStr, patternLen, optOverlap)
+      {
+         const unsigned char* x = (const unsigned char*)patternStr;
+         R_len_t per1, per2;
+         R_len_t i = maxSuffix(x, patternLen, per1, false);
+         R_len_t j = maxSuffix(x, patternLen, per2, true);
+         if (i > j) { m_ell = i; m_per = per1; }
+         else       { m_ell = j; m_per = per2; }
+
+         m_periodic = (0 == memcmp(patternStr, patternStr+m_per, (size_t)(m_ell+1)));
+         if (!m_periodic) {
+            // a large, always-safe shift
+            R_len_t a = m_ell+1, b = patternLen-m_ell-1;
+            m_per = ((a > b) ? a : b) + 1;
+         }
+      }
+
+      virtual R_len_t findFirst() {
+         return findFromPos(0);
+      }
+
+      virtual R_len_t findLast()  {
+         // rightmost occurrence: walk the (overlapping) occurrences
+         // left to right - linear, since each restart resumes at most
+         // one period behind the previous match
+         R_len_t last = USEARCH_DONE;
+         R_len_t pos = findFromPos(0);
+         while (pos != USEARCH_DONE) {
+            last = pos;
+            if (pos+1 > m_searchLen-m_patternLen) break;
+            pos = findFromPos(pos+1);
+         }
+         if (last == USEARCH_DONE) {
+            m_searchPos = m_searchEnd = m_searchLen;
+            return USEARCH_DONE;
+         }
+         m_searchPos = last;
+         m_searchEnd = last+m_patternLen;
+         return m_searchPos;
+      }
 };
 
 
@@ -483,16 +842,67 @@ class StriByteSearchMatcherShort : public StriByteSearchMatcher {
             return USEARCH_DONE;
          }
 
-         const char* res = strstr(m_searchStr+startPos, m_patternStr);
-         if (res) {
-            m_searchPos = (int)(res-m_searchStr);
-            m_searchEnd = m_searchPos+m_patternLen;
-            return m_searchPos;
+#ifdef STRI__BYTESEARCH_SIMD
+         // 16 candidate windows per iteration: compare the first and
+         // the last pattern byte across the block, confirm the few
+         // surviving candidates with memcmp
+         const unsigned char* s = (const unsigned char*)m_searchStr;
+         const unsigned char* p = (const unsigned char*)m_patternStr;
+         R_len_t m = m_patternLen;
+         R_len_t last_window = m_searchLen-m; // last valid match start
+         R_len_t j = startPos;
+         const __m128i first_byte = _mm_set1_epi8((char)p[0]);
+         const __m128i last_byte  = _mm_set1_epi8((char)p[m-1]);
+         while (j+15 <= last_window) {
+            __m128i blk_first = _mm_loadu_si128((const __m128i*)(s+j));
+            __m128i blk_last  = _mm_loadu_si128((const __m128i*)(s+j+m-1));
+            int mask = _mm_movemask_epi8(_mm_and_si128(
+               _mm_cmpeq_epi8(first_byte, blk_first),
+               _mm_cmpeq_epi8(last_byte,  blk_last)));
+            while (mask) {
+#if defined(__GNUC__) || defined(__clang__)
+               int bit = __builtin_ctz((unsigned)mask);
+#else
+               int bit = 0;
+               while (!((mask >> bit) & 1)) ++bit;
+#endif
+               mask &= mask-1;
+               if (m <= 2 || 0 == memcmp(s+j+bit+1, p+1, m-2)) {
+                  m_searchPos = j+bit;
+                  m_searchEnd = m_searchPos+m;
+                  return m_searchPos;
+               }
+            }
+            j += 16;
          }
-         else {
-            m_searchPos = m_searchEnd = m_searchLen;
-            return USEARCH_DONE;
+         // scalar tail (< 16 remaining candidate windows)
+         for (; j <= last_window; ++j) {
+            if (s[j] == p[0] && 0 == memcmp(s+j+1, p+1, m-1)) {
+               m_searchPos = j;
+               m_searchEnd = m_searchPos+m;
+               return m_searchPos;
+            }
+         }
+         m_searchPos = m_searchEnd = m_searchLen;
+         return USEARCH_DONE;
+#else
+         // bounded window scan, not strstr: the haystack may be a view
+         // into a larger buffer (e.g. a memory-mapped file) and need
+         // not be NUL-terminated
+         const unsigned char* s = (const unsigned char*)m_searchStr;
+         const unsigned char* p = (const unsigned char*)m_patternStr;
+         R_len_t m = m_patternLen;
+         R_len_t last_window = m_searchLen-m; // last valid match start
+         for (R_len_t j=startPos; j<=last_window; ++j) {
+            if (s[j] == p[0] && 0 == memcmp(s+j+1, p+1, m-1)) {
+               m_searchPos = j;
+               m_searchEnd = m_searchPos+m;
+               return m_searchPos;
+            }
          }
+         m_searchPos = m_searchEnd = m_searchLen;
+         return USEARCH_DONE;
+#endif
       }
 
 
@@ -525,4 +935,50 @@ class StriByteSearchMatcherShort : public StriByteSearchMatcher {
 };
 
 
+/** final, compile-time specialized variant of a concrete matcher
+ *
+ * OPT_OVERLAP becomes a template constant, so the per-match branch in
+ * findNext() is folded out, and - MATCHER being the most derived type
+ * here - the qualified calls below resolve statically: the match
+ * enumeration loop of recordAll() gets the concrete findFromPos()
+ * inlined into it instead of paying a virtual dispatch per match.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+template <class MATCHER, bool OPT_OVERLAP>
+class StriByteSearchMatcherSpec : public MATCHER {
+
+   public:
+
+      StriByteSearchMatcherSpec(const char* patternStr, R_len_t patternLen)
+         : MATCHER(patternStr, patternLen, OPT_OVERLAP)
+      {
+      }
+
+      virtual R_len_t findNext() {
+         if (this->m_searchPos < 0) return this->MATCHER::findFirst();
+
+         if (OPT_OVERLAP) {
+            int pos = this->m_searchPos;
+            U8_FWD_1(this->m_searchStr, pos, this->m_searchLen);
+            return this->MATCHER::findFromPos(pos);
+         }
+         else
+            return this->MATCHER::findFromPos(this->m_searchEnd);
+      }
+
+      virtual R_len_t recordAll(std::vector<int>& arena) {
+         R_len_t found = 0;
+         R_len_t pos;
+         while (USEARCH_DONE !=
+               (pos = StriByteSearchMatcherSpec::findNext())) {
+            arena.push_back((int)pos);
+            arena.push_back((int)this->m_searchEnd);
+            ++found;
+         }
+         return found;
+      }
+};
+
+
 #endif
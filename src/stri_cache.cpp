@@ -0,0 +1,198 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_cache.h"
+#include "stri_container_regex.h"
+#include "stri_usage.h"
+#include <cstring>
+
+
+unsigned stri__cache_clock = 0;
+
+
+static R_len_t stri__cache_regex_count()    { return StriRegexPatternCache::getSize(); }
+static R_len_t stri__cache_regex_capacity() { return StriRegexPatternCache::getBudget(); }
+static void    stri__cache_regex_clear()    { StriRegexPatternCache::clear(); }
+
+
+/** the hook set of one managed cache, see stri_cache.h */
+struct StriCacheHooks {
+   const char* name;
+   R_len_t  (*count)();
+   R_len_t  (*capacity)();
+   unsigned (*oldest)();
+   void     (*evict_oldest)();
+   void     (*clear)();
+   StriUsageCounters* usage;
+};
+
+#define STRI__CACHE_NUM 5
+static const StriCacheHooks stri__cache_hooks[STRI__CACHE_NUM] = {
+   { "collator",  stri__ucol_cache_count,    stri__ucol_cache_capacity,
+     stri__ucol_cache_oldest,    stri__ucol_cache_evict_oldest,
+     stri__ucol_cache_clear,     &stri__usage_collator },
+   { "converter", stri__ucnv_cache_count,    stri__ucnv_cache_capacity,
+     stri__ucnv_cache_oldest,    stri__ucnv_cache_evict_oldest,
+     stri__ucnv_cache_clear,     &stri__usage_converter },
+   { "regex",     stri__cache_regex_count,   stri__cache_regex_capacity,
+     stri__regex_cache_oldest,   stri__regex_cache_evict_oldest,
+     stri__cache_regex_clear,    &stri__usage_regex },
+   { "brkiter",   stri__ubrk_cache_count,    stri__ubrk_cache_capacity,
+     stri__ubrk_cache_oldest,    stri__ubrk_cache_evict_oldest,
+     stri__ubrk_cache_clear,     &stri__usage_brkiter },
+   { "usearch",   stri__usearch_pool_count,  stri__usearch_pool_capacity,
+     stri__usearch_pool_oldest,  stri__usearch_pool_evict_oldest,
+     stri__usearch_pool_clear,   &stri__usage_usearch },
+};
+
+
+/** evict globally-LRU entries until the caches fit the entry budget
+ *
+ * Reads \code{getOption("stringi.cache_max_entries")}; unset, NA, or
+ * negative means unlimited (each cache still enforces its own fixed
+ * capacity). The budget counts entries, not bytes - ICU does not
+ * expose the footprint of a configured service object - and it is
+ * enforced after a new entry is admitted, so the total may exceed the
+ * budget by one entry for the duration of a call.
+ */
+void stri__cache_enforce_budget()
+{
+   SEXP val = Rf_GetOption1(Rf_install("stringi.cache_max_entries"));
+   if (Rf_isNull(val)) return;
+   int budget = Rf_asInteger(val);
+   if (budget == NA_INTEGER || budget < 0) return;
+
+   for (;;) {
+      R_len_t total = 0;
+      int victim = -1;
+      unsigned victim_stamp = 0;
+      for (int i=0; i<STRI__CACHE_NUM; ++i) {
+         total += stri__cache_hooks[i].count();
+         unsigned o = stri__cache_hooks[i].oldest();
+         if (o != 0 && (victim < 0 || o < victim_stamp)) {
+            victim = i;
+            victim_stamp = o;
+         }
+      }
+      if (total <= (R_len_t)budget || victim < 0) return;
+      stri__cache_hooks[victim].evict_oldest();
+   }
+}
+
+
+/** Inspect the native object caches
+ *
+ * @return list with components `cache` (character), `entries`,
+ *    `capacity`, `hits`, `opens` (integer) - one element per cache
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_cache_info()
+{
+   SEXP ret, names, tmp;
+   PROTECT(ret = Rf_allocVector(VECSXP, 5));
+   PROTECT(names = Rf_allocVector(STRSXP, 5));
+   SET_STRING_ELT(names, 0, Rf_mkChar("cache"));
+   SET_STRING_ELT(names, 1, Rf_mkChar("entries"));
+   SET_STRING_ELT(names, 2, Rf_mkChar("capacity"));
+   SET_STRING_ELT(names, 3, Rf_mkChar("hits"));
+   SET_STRING_ELT(names, 4, Rf_mkChar("opens"));
+   Rf_setAttrib(ret, R_NamesSymbol, names);
+
+   PROTECT(tmp = Rf_allocVector(STRSXP, STRI__CACHE_NUM));
+   for (int i=0; i<STRI__CACHE_NUM; ++i)
+      SET_STRING_ELT(tmp, i, Rf_mkChar(stri__cache_hooks[i].name));
+   SET_VECTOR_ELT(ret, 0, tmp);
+   UNPROTECT(1);
+
+   for (int j=1; j<5; ++j) {
+      PROTECT(tmp = Rf_allocVector(INTSXP, STRI__CACHE_NUM));
+      int* tab = INTEGER(tmp);
+      for (int i=0; i<STRI__CACHE_NUM; ++i) {
+         const StriCacheHooks& h = stri__cache_hooks[i];
+         switch (j) {
+            case 1: tab[i] = (int)h.count();        break;
+            case 2: tab[i] = (int)h.capacity();     break;
+            case 3: tab[i] = (int)h.usage->hits;    break;
+            default: tab[i] = (int)h.usage->opens;  break;
+         }
+      }
+      SET_VECTOR_ELT(ret, j, tmp);
+      UNPROTECT(1);
+   }
+
+   UNPROTECT(2);
+   return ret;
+}
+
+
+/** Drop entries from the native object caches
+ *
+ * @param which character vector of cache names, or NULL for all
+ * @return NULL, invisibly [R wrapper]
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_cache_clear(SEXP which)
+{
+   if (Rf_isNull(which)) {
+      for (int i=0; i<STRI__CACHE_NUM; ++i)
+         stri__cache_hooks[i].clear();
+      return R_NilValue;
+   }
+
+   PROTECT(which = stri_prepare_arg_string(which, "which"));
+   R_len_t n = LENGTH(which);
+   for (R_len_t k=0; k<n; ++k) {
+      if (STRING_ELT(which, k) == NA_STRING) {
+         UNPROTECT(1);
+         Rf_error(MSG__ARG_EXPECTED_NOT_NA, "which"); // error() call allowed here
+      }
+      const char* name = CHAR(STRING_ELT(which, k));
+      int found = 0;
+      for (int i=0; i<STRI__CACHE_NUM; ++i) {
+         if (!strcmp(name, stri__cache_hooks[i].name)) {
+            stri__cache_hooks[i].clear();
+            found = 1;
+            break;
+         }
+      }
+      if (!found) {
+         UNPROTECT(1);
+         Rf_error(MSG__INCORRECT_CACHE_NAME, name); // error() call allowed here
+      }
+   }
+
+   UNPROTECT(1);
+   return R_NilValue;
+}
@@ -0,0 +1,104 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_cache_h
+#define __stri_cache_h
+
+
+/** Unified management of the native object caches
+ *
+ * The collator, converter, regex, break-iterator, and UStringSearch
+ * caches each keep recently configured ICU objects alive between
+ * .Call invocations. So that they can be inspected, cleared, and
+ * bounded as one (stri_cache_info, stri_cache_clear,
+ * options(stringi.cache_max_entries=...)), every cache stamps its
+ * entries from the shared clock below and exposes the small hook set
+ * declared here; the cross-cache logic lives in stri_cache.cpp.
+ *
+ * Main R thread only, like the caches themselves.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+
+// the shared LRU clock; stamps from different caches are comparable
+extern unsigned stri__cache_clock;
+
+inline unsigned stri__cache_tick() {
+   return ++stri__cache_clock;
+}
+
+
+// per-cache hooks; `oldest` returns the stamp of the least recently
+// used evictable entry, or 0 if nothing may be evicted right now
+
+// stri_collator.cpp
+R_len_t  stri__ucol_cache_count();
+R_len_t  stri__ucol_cache_capacity();
+unsigned stri__ucol_cache_oldest();
+void     stri__ucol_cache_evict_oldest();
+void     stri__ucol_cache_clear();
+
+// stri_ucnv.cpp
+R_len_t  stri__ucnv_cache_count();
+R_len_t  stri__ucnv_cache_capacity();
+unsigned stri__ucnv_cache_oldest();
+void     stri__ucnv_cache_evict_oldest();
+void     stri__ucnv_cache_clear();
+
+// stri_container_regex.cpp (count/capacity/clear sit on
+// StriRegexPatternCache, see stri_container_regex.h)
+unsigned stri__regex_cache_oldest();
+void     stri__regex_cache_evict_oldest();
+
+// stri_brkiter.cpp
+R_len_t  stri__ubrk_cache_count();
+R_len_t  stri__ubrk_cache_capacity();
+unsigned stri__ubrk_cache_oldest();
+void     stri__ubrk_cache_evict_oldest();
+void     stri__ubrk_cache_clear();
+
+// stri_container_usearch.cpp; entries currently on loan are neither
+// counted as evictable nor touched by clear
+R_len_t  stri__usearch_pool_count();
+R_len_t  stri__usearch_pool_capacity();
+unsigned stri__usearch_pool_oldest();
+void     stri__usearch_pool_evict_oldest();
+void     stri__usearch_pool_clear();
+
+
+/** evict globally-least-recently-used entries until the total number
+ *  of cached objects fits options(stringi.cache_max_entries=...);
+ *  a no-op when the option is unset. Caches call this after admitting
+ *  a new entry. */
+void stri__cache_enforce_budget();
+
+#endif
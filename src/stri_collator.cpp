@@ -31,8 +31,162 @@
 
 
 #include "stri_stringi.h"
+#include "stri_usage.h"
+#include "stri_cache.h"
+#include "stri_opts_memo.h"
 #include <unicode/ucol.h>
 #include <unicode/usearch.h>
+#include <unicode/uloc.h>
+#include <string>
+#include <cstdio>
+#include <map>
+
+
+// how many distinct (locale, attribute set) configurations are kept alive;
+// API-server-style workloads use one or two, interactive sessions a handful
+#define STRI__UCOL_CACHE_SIZE 8
+
+
+/** one cached, fully configured master collator */
+struct StriCachedCollator {
+   std::string key;   ///< locale + attribute values, "" if the slot is free
+   UCollator* col;    ///< the master instance; only clones leave this file
+   unsigned stamp;    ///< last use, for LRU eviction
+
+   StriCachedCollator() : col(NULL), stamp(0) { }
+};
+
+static StriCachedCollator stri__ucol_cache[STRI__UCOL_CACHE_SIZE];
+// entries are stamped from the shared cross-cache clock, see stri_cache.h
+
+// collator clones handed out by stri__ucol_open, mapped to their
+// configuration key; lets dependent caches (the UStringSearch pool in
+// stri_container_usearch.cpp) recognize equivalent collators across calls
+static std::map<const UCollator*, std::string> stri__ucol_issued;
+
+// parsed form of a recently seen opts_collator list (stri_opts_memo.h);
+// the locale is re-resolved on every hit - both the default locale and
+// the resolution of "@keyword=value" queries may change mid-session -
+// so only the element to resolve it from is remembered
+struct StriCollatorOptsParsed {
+   std::string key_suffix; ///< the attribute-value part of the cache key
+   R_len_t locale_idx;     ///< index of the "locale" element, -1 if absent
+};
+static StriOptsMemo<StriCollatorOptsParsed> stri__ucol_opts_memo;
+
+
+static void stri__ucol_remember(const UCollator* col, const std::string& key)
+{
+   if (stri__ucol_issued.size() > 64)
+      stri__ucol_issued.clear(); // drop stale (long since closed) entries
+   stri__ucol_issued[col] = key;
+}
+
+
+/** the configuration key a collator was issued under, or NULL if this
+ *  instance did not come from stri__ucol_open (or was forgotten)
+ */
+const char* stri__ucol_identify(const UCollator* col)
+{
+   std::map<const UCollator*, std::string>::const_iterator it
+      = stri__ucol_issued.find(col);
+   return (it == stri__ucol_issued.end())?NULL:(it->second.c_str());
+}
+
+
+/** return a private clone of the cached master for `key`, or NULL
+ *
+ * Cloning an already configured collator is a plain memcpy-scale
+ * operation; it is ucol_open (locale data load, tailoring build)
+ * that we are amortizing here.
+ */
+static UCollator* stri__ucol_cache_get(const std::string& key)
+{
+   for (int i=0; i<STRI__UCOL_CACHE_SIZE; ++i) {
+      if (stri__ucol_cache[i].col && stri__ucol_cache[i].key == key) {
+         stri__ucol_cache[i].stamp = stri__cache_tick();
+         UErrorCode status = U_ZERO_ERROR;
+         UCollator* clone = ucol_safeClone(stri__ucol_cache[i].col, NULL, NULL, &status);
+         if (U_FAILURE(status)) return NULL; // fall back to a fresh ucol_open
+         stri__ucol_remember(clone, key);
+         ++stri__usage_collator.hits;
+         return clone;
+      }
+   }
+   return NULL;
+}
+
+
+/** hand `col` over to the cache (it becomes the master for `key`),
+ *  evicting the least recently used entry if need be
+ */
+static void stri__ucol_cache_put(const std::string& key, UCollator* col)
+{
+   int slot = 0;
+   for (int i=0; i<STRI__UCOL_CACHE_SIZE; ++i) {
+      if (!stri__ucol_cache[i].col) { slot = i; break; }
+      if (stri__ucol_cache[i].stamp < stri__ucol_cache[slot].stamp)
+         slot = i;
+   }
+   if (stri__ucol_cache[slot].col)
+      ucol_close(stri__ucol_cache[slot].col);
+   stri__ucol_cache[slot].key = key;
+   stri__ucol_cache[slot].col = col;
+   stri__ucol_cache[slot].stamp = stri__cache_tick();
+   stri__cache_enforce_budget(); // see options(stringi.cache_max_entries=)
+}
+
+
+// the stri_cache.cpp hooks, see stri_cache.h
+
+R_len_t stri__ucol_cache_count()
+{
+   R_len_t count = 0;
+   for (int i=0; i<STRI__UCOL_CACHE_SIZE; ++i)
+      if (stri__ucol_cache[i].col) ++count;
+   return count;
+}
+
+R_len_t stri__ucol_cache_capacity()
+{
+   return STRI__UCOL_CACHE_SIZE;
+}
+
+unsigned stri__ucol_cache_oldest()
+{
+   unsigned oldest = 0;
+   for (int i=0; i<STRI__UCOL_CACHE_SIZE; ++i)
+      if (stri__ucol_cache[i].col &&
+            (oldest == 0 || stri__ucol_cache[i].stamp < oldest))
+         oldest = stri__ucol_cache[i].stamp;
+   return oldest;
+}
+
+void stri__ucol_cache_evict_oldest()
+{
+   int slot = -1;
+   for (int i=0; i<STRI__UCOL_CACHE_SIZE; ++i)
+      if (stri__ucol_cache[i].col &&
+            (slot < 0 || stri__ucol_cache[i].stamp < stri__ucol_cache[slot].stamp))
+         slot = i;
+   if (slot < 0) return;
+   ucol_close(stri__ucol_cache[slot].col);
+   stri__ucol_cache[slot].col = NULL;
+   stri__ucol_cache[slot].key.clear();
+   stri__ucol_cache[slot].stamp = 0;
+}
+
+void stri__ucol_cache_clear()
+{
+   for (int i=0; i<STRI__UCOL_CACHE_SIZE; ++i) {
+      if (stri__ucol_cache[i].col) {
+         ucol_close(stri__ucol_cache[i].col);
+         stri__ucol_cache[i].col = NULL;
+      }
+      stri__ucol_cache[i].key.clear();
+      stri__ucol_cache[i].stamp = 0;
+   }
+}
 
 /**
  * Create & set up an ICU Collator
@@ -64,6 +218,14 @@
  *
  * @version 1.1.6 (Marek Gagolewski, 2017-11-10)
  *    PROTECT STRING_ELT(names, i)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    configured collators are cached by (locale, attribute set);
+ *    the caller receives a private clone - ucol_close() it as before
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    parses of recently seen opts lists are memoized - a hit maps the
+ *    list straight to its cache key without walking it again
  */
 UCollator* stri__ucol_open(SEXP opts_collator)
 {
@@ -73,10 +235,35 @@ UCollator* stri__ucol_open(SEXP opts_collator)
    R_len_t narg = isNull(opts_collator)?0:LENGTH(opts_collator);
 
    if (narg <= 0) { // no custom settings - use default Collator
+      // the default locale may change during the session (stri_locale_set),
+      // hence its name is part of the cache key
+      std::string key(uloc_getDefault());
+      UCollator* cached = stri__ucol_cache_get(key);
+      if (cached) return cached;
+
       UErrorCode status = U_ZERO_ERROR;
       UCollator* col = ucol_open(NULL, &status);
       STRI__CHECKICUSTATUS_RFERROR(status, {/* do nothing special on err */}) // error() allowed here
-      return col;
+      ++stri__usage_collator.opens;
+
+      status = U_ZERO_ERROR;
+      UCollator* clone = ucol_safeClone(col, NULL, NULL, &status);
+      if (U_FAILURE(status)) return col; // do not cache, just hand it out
+      stri__ucol_cache_put(key, col);
+      stri__ucol_remember(clone, key);
+      return clone;
+   }
+
+   StriCollatorOptsParsed* memoized = stri__ucol_opts_memo.find(opts_collator);
+   if (memoized) {
+      const char* mloc = (memoized->locale_idx >= 0)?
+         stri__prepare_arg_locale(VECTOR_ELT(opts_collator, memoized->locale_idx),
+            "locale", true):uloc_getDefault();
+      std::string mkey(mloc);
+      mkey += memoized->key_suffix;
+      UCollator* cached = stri__ucol_cache_get(mkey);
+      if (cached) return cached;
+      // master evicted meanwhile - fall through to the full parse/open
    }
 
    SEXP names = PROTECT(Rf_getAttrib(opts_collator, R_NamesSymbol));
@@ -94,6 +281,7 @@ UCollator* stri__ucol_open(SEXP opts_collator)
    UColAttributeValue  opt_NUMERIC_COLLATION = UCOL_DEFAULT;
 //   USearchAttributeValue  opt_OVERLAP = USEARCH_OFF;
    const char*         opt_LOCALE = NULL;
+   R_len_t             opt_LOCALE_idx = -1; // for the opts memo
 
    for (R_len_t i=0; i<narg; ++i) {
       if (STRING_ELT(names, i) == NA_STRING)
@@ -107,6 +295,7 @@ UCollator* stri__ucol_open(SEXP opts_collator)
       PROTECT(tmp_arg = VECTOR_ELT(opts_collator, i));
       if (!strcmp(curname, "locale")) {
          opt_LOCALE = stri__prepare_arg_locale(tmp_arg, "locale", true); /* this is R_alloc'ed */
+         opt_LOCALE_idx = i;
       } else if  (!strcmp(curname, "strength")) {
          int val = stri__prepare_arg_integer_1_notNA(tmp_arg, "strength");
          if (val < (int)UCOL_PRIMARY + 1) val = (int)UCOL_PRIMARY + 1;
@@ -143,10 +332,28 @@ UCollator* stri__ucol_open(SEXP opts_collator)
    }
    UNPROTECT(1); /* names */
 
+   char key_buf[64];
+   snprintf(key_buf, 64, "|%d|%d|%d|%d|%d|%d|%d",
+      (int)opt_FRENCH_COLLATION, (int)opt_ALTERNATE_HANDLING,
+      (int)opt_CASE_FIRST, (int)opt_CASE_LEVEL,
+      (int)opt_NORMALIZATION_MODE, (int)opt_STRENGTH,
+      (int)opt_NUMERIC_COLLATION);
+   std::string key(opt_LOCALE?opt_LOCALE:uloc_getDefault());
+   key += key_buf;
+
+   StriCollatorOptsParsed parsed;
+   parsed.key_suffix = key_buf;
+   parsed.locale_idx = opt_LOCALE_idx;
+   stri__ucol_opts_memo.put(opts_collator, parsed);
+
+   UCollator* cached = stri__ucol_cache_get(key);
+   if (cached) return cached;
+
    // create collator
    UErrorCode status = U_ZERO_ERROR;
    UCollator* col = ucol_open(opt_LOCALE, &status);
    STRI__CHECKICUSTATUS_RFERROR(status, { /* nothing special on err */ }) // error() allowed here
+   ++stri__usage_collator.opens;
 
    // set other opts
 //   if (opt_OVERLAP != UCOL_OFF) {
@@ -197,5 +404,10 @@ UCollator* stri__ucol_open(SEXP opts_collator)
       STRI__CHECKICUSTATUS_RFERROR(status, { ucol_close(col); }) // error() allowed here
    }
 
-   return col;
+   status = U_ZERO_ERROR;
+   UCollator* clone = ucol_safeClone(col, NULL, NULL, &status);
+   if (U_FAILURE(status)) return col; // do not cache, just hand it out
+   stri__ucol_cache_put(key, col);
+   stri__ucol_remember(clone, key);
+   return clone;
 }
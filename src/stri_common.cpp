@@ -326,3 +326,60 @@ int stri__match_arg(const char* option, const char** set) {
    }
    return which;
 }
+
+
+/** Build a duplicate-input index over a character vector [internal]
+ *
+ * R interns CHARSXPs in a global cache, so two identical strings in a
+ * character vector are the very same pointer - duplicates can be
+ * spotted by hashing pointers, without touching the bytes. Factors
+ * prepared by stri_prepare_arg_string index their levels vector
+ * directly, so a 100M-element, 50-level input collapses to 50
+ * distinct pointers here.
+ *
+ * @param sexp a STRSXP (or NULL)
+ * @param n number of elements to inspect
+ * @return a length-n array with idx[i] = the smallest j such that the
+ *    j-th element is the identical CHARSXP (delete [] it when done),
+ *    or NULL if there is nothing to index or no duplicates at all
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+R_len_t* stri__duplicate_index(SEXP sexp, R_len_t n)
+{
+   if (!sexp || n <= 1) return NULL;
+
+   size_t m = 1; // open addressing, linear probing, load factor <= 0.5
+   while (m < 2*(size_t)n) m <<= 1;
+   std::vector<R_len_t> table(m, (R_len_t)-1);
+
+   R_len_t* idx = new R_len_t[n];
+   if (!idx) throw StriException(MSG__MEM_ALLOC_ERROR);
+
+   bool anydup = false;
+   for (R_len_t i=0; i<n; ++i) {
+      SEXP curs = STRING_ELT(sexp, i);
+      size_t h = ((size_t)(const void*)curs >> 4) & (m-1);
+      R_len_t fst = i;
+      while (true) {
+         R_len_t k = table[h];
+         if (k < 0) {
+            table[h] = i;
+            break;
+         }
+         if (STRING_ELT(sexp, k) == curs) {
+            fst = k;
+            anydup = true;
+            break;
+         }
+         h = (h+1) & (m-1);
+      }
+      idx[i] = fst;
+   }
+
+   if (!anydup) {
+      delete [] idx; // all unique - not worth keeping around
+      return NULL;
+   }
+   return idx;
+}
@@ -105,6 +105,9 @@
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    pointer-identity shortcut before the bytewise compare
  */
 SEXP stri_cmp_codepoints(SEXP e1, SEXP e2, int _negate)
 {
@@ -138,10 +141,14 @@ SEXP stri_cmp_codepoints(SEXP e1, SEXP e2, int _negate)
       R_len_t     cur2_n = e2_cont.get(i).length();
       const char* cur2_s = e2_cont.get(i).c_str();
 
+      // byte equality decides codepoint equality for valid UTF-8:
+      // a length check, then one memcmp (the libc one is vectorized),
+      // with identical CHARSXPs (R interns them) settled pointer-wise
       if (cur1_n != cur2_n) // different number of bytes => not equal
          ret_tab[i] = FALSE;
       else
-         ret_tab[i] = (memcmp(cur1_s, cur2_s, cur1_n) == 0);
+         ret_tab[i] = (cur1_s == cur2_s
+            || memcmp(cur1_s, cur2_s, cur1_n) == 0);
 
       if (_negate)
          ret_tab[i] = !ret_tab[i];
@@ -210,6 +217,9 @@ SEXP stri_cmp_neq(SEXP e1, SEXP e2) {
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    byte-identical arguments short-circuit to "equal" without ICU
  */
 SEXP stri__cmp_logical(SEXP e1, SEXP e2, SEXP opts_collator, int _type, int _negate)
 {
@@ -249,6 +259,15 @@ SEXP stri__cmp_logical(SEXP e1, SEXP e2, SEXP opts_collator, int _type, int _neg
       R_len_t     cur2_n = e2_cont.get(i).length();
       const char* cur2_s = e2_cont.get(i).c_str();
 
+      // byte-identical payloads collate as equal under any settings
+      if (cur1_n == cur2_n
+            && (cur1_s == cur2_s || 0 == memcmp(cur1_s, cur2_s, cur1_n))) {
+         ret_tab[i] = (_type == 0);
+         if (_negate)
+            ret_tab[i] = !ret_tab[i];
+         continue;
+      }
+
       // with collation
       UErrorCode status = U_ZERO_ERROR;
       ret_tab[i] = (_type == (int)ucol_strcollUTF8(col,
@@ -408,6 +427,9 @@ SEXP stri_cmp_ge(SEXP e1, SEXP e2, SEXP opts_collator) {
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    byte-identical arguments short-circuit to 0 without ICU
  */
 SEXP stri_cmp(SEXP e1, SEXP e2, SEXP opts_collator)
 {
@@ -443,6 +465,13 @@ SEXP stri_cmp(SEXP e1, SEXP e2, SEXP opts_collator)
       R_len_t     cur2_n = e2_cont.get(i).length();
       const char* cur2_s = e2_cont.get(i).c_str();
 
+      // byte-identical payloads collate as equal under any settings
+      if (cur1_n == cur2_n
+            && (cur1_s == cur2_s || 0 == memcmp(cur1_s, cur2_s, cur1_n))) {
+         ret_int[i] = 0;
+         continue;
+      }
+
       // cmp with collation
       UErrorCode status = U_ZERO_ERROR;
       ret_int[i] = (int)ucol_strcollUTF8(col,
@@ -37,6 +37,13 @@
 /**
  * Base class for all StriContainers
  *
+ * Indexing is deliberately 32-bit (R_len_t): ICU takes int32_t string
+ * offsets everywhere, so individual strings cannot exceed 2^31-1 bytes
+ * regardless, and widening only the element index would ripple through
+ * every vectorized loop for no gain until the ICU boundary is chunked
+ * as well. Long-vector (2^31+ element) inputs are rejected up front
+ * with a clear message in stri_prepare_arg.cpp; callers must chunk.
+ *
  * @version 0.1-?? (Marek Gagolewski)
  *
  * @version 0.1-?? (Marek Gagolewski)
@@ -47,6 +54,9 @@
  *
  * @version 0.2-1 (Marek Gagolewski, 2014-03-22)
  *          added sexp field
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          added recycled_index: no integer division when not recycling
  */
 class StriContainerBase {
 
@@ -71,6 +81,16 @@ class StriContainerBase {
       //StriContainerBase& operator=(StriContainerBase& container); // use default (shallow)
 
       inline R_len_t get_n() { return n; }
+
+      /** Translate a vectorization index to a data index (recycle rule)
+       *
+       * In the overwhelmingly common n == nrecycle case i is already
+       * in range and the integer division never executes, so the
+       * accessors in the innermost loops index the data directly. */
+      inline R_len_t recycled_index(R_len_t i) const {
+         return (i < n)?i:(i%n);
+      }
+
       inline R_len_t get_nrecycle() { return nrecycle; }
       inline void set_nrecycle(R_len_t nval) { nrecycle = nval; }
 
@@ -43,6 +43,7 @@ StriContainerByteSearch::StriContainerByteSearch()
    : StriContainerUTF8()
 {
    this->matcher = NULL;
+   this->matcher_borrowed = false;
    this->flags = 0;
 }
 
@@ -51,12 +52,16 @@ StriContainerByteSearch::StriContainerByteSearch()
  * Construct String Container from R character vector
  * @param rstr R character vector
  * @param _nrecycle extend length [vectorization]
+ * @param _prepared matcher owned by a stri_fixed_pattern handle, or NULL;
+ *    if given, rstr must be the handle's own 1-element pattern vector
  */
-StriContainerByteSearch::StriContainerByteSearch(SEXP rstr, R_len_t _nrecycle, uint32_t _flags)
+StriContainerByteSearch::StriContainerByteSearch(SEXP rstr, R_len_t _nrecycle,
+   uint32_t _flags, StriByteSearchMatcher* _prepared)
    : StriContainerUTF8(rstr, _nrecycle, true)
 {
    this->flags = _flags;
-   this->matcher = NULL;
+   this->matcher = _prepared;
+   this->matcher_borrowed = (_prepared != NULL);
 
    R_len_t n = get_n();
    for (R_len_t i=0; i<n; ++i) {
@@ -74,6 +79,7 @@ StriContainerByteSearch::StriContainerByteSearch(StriContainerByteSearch& contai
    :    StriContainerUTF8((StriContainerUTF8&)container)
 {
    this->matcher = NULL;
+   this->matcher_borrowed = false;
    this->flags = container.flags;
 }
 
@@ -96,16 +102,75 @@ StriContainerByteSearch& StriContainerByteSearch::operator=(StriContainerByteSea
 StriContainerByteSearch::~StriContainerByteSearch()
 {
    if (matcher) {
-      delete matcher;
+      if (!matcher_borrowed) delete matcher;
       matcher = NULL;
    }
 }
 
 
+/** instantiate the matcher picked for the given pattern, with the
+ * overlap flag folded out at compile time (StriByteSearchMatcherSpec)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+template <bool OPT_OVERLAP>
+static StriByteSearchMatcher* stri__bytesearch_create_matcher(
+   const char* patternStr, R_len_t patternLen, bool ci)
+{
+   if (ci)
+      return new StriByteSearchMatcherSpec<StriByteSearchMatcherKMPci,
+         OPT_OVERLAP>(patternStr, patternLen);
+   else if (patternLen == 1)
+      return new StriByteSearchMatcherSpec<StriByteSearchMatcher1,
+         OPT_OVERLAP>(patternStr, patternLen);
+   else if (patternLen < 16)
+      return new StriByteSearchMatcherSpec<StriByteSearchMatcherShort,
+         OPT_OVERLAP>(patternStr, patternLen);
+   else if (patternLen >= STRI__BYTESEARCH_BMH_THRESHOLD) {
+      // highly periodic patterns ("ababab...") defeat BMH's skips -
+      // Two-Way stays linear on them with no tables at all
+      if (2*stri__bytesearch_pattern_period(patternStr, patternLen) <= patternLen)
+         return new StriByteSearchMatcherSpec<StriByteSearchMatcherTwoWay,
+            OPT_OVERLAP>(patternStr, patternLen);
+      return new StriByteSearchMatcherSpec<StriByteSearchMatcherBMH,
+         OPT_OVERLAP>(patternStr, patternLen);
+   }
+   else
+      return new StriByteSearchMatcherSpec<StriByteSearchMatcherKMP,
+         OPT_OVERLAP>(patternStr, patternLen);
+}
+
+
+/** pick a matcher implementation for the given pattern
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    factored out of getMatcher so that stri_fixed_pattern handles
+ *    can precompile matchers with exactly the same selection rules
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    each (matcher, overlap) combination is a separate template
+ *    instantiation - no option flag survives into the match loops
+ */
+StriByteSearchMatcher* StriContainerByteSearch::createMatcher(
+   const char* patternStr, R_len_t patternLen, uint32_t _flags)
+{
+   bool ci = (bool)(_flags&BYTESEARCH_CASE_INSENSITIVE);
+   if (_flags&BYTESEARCH_OVERLAP)
+      return stri__bytesearch_create_matcher<true>(patternStr, patternLen, ci);
+   else
+      return stri__bytesearch_create_matcher<false>(patternStr, patternLen, ci);
+}
+
+
 /**
  * @version 0.5-1 (Marek Gagolewski, 2015-02-14)
  */
 StriByteSearchMatcher* StriContainerByteSearch::getMatcher(R_len_t i) {
+   if (matcher_borrowed) {
+      // a stri_fixed_pattern handle: one pattern, prepared up front
+      return matcher;
+   }
+
    if (i >= n && matcher && matcher->getPatternStr() == get(i).c_str()) {
       // matcher reuse
    }
@@ -115,14 +180,7 @@ StriByteSearchMatcher* StriContainerByteSearch::getMatcher(R_len_t i) {
          matcher = NULL;
       }
 
-      if (isCaseInsensitive())
-         matcher = new StriByteSearchMatcherKMPci(get(i).c_str(), get(i).length(), isOverlap());
-      else if (get(i).length() == 1)
-         matcher = new StriByteSearchMatcher1(get(i).c_str(), get(i).length(), isOverlap());
-      else if (get(i).length() < 16)
-         matcher = new StriByteSearchMatcherShort(get(i).c_str(), get(i).length(), isOverlap());
-      else
-         matcher = new StriByteSearchMatcherKMP(get(i).c_str(), get(i).length(), isOverlap());
+      matcher = createMatcher(get(i).c_str(), get(i).length(), flags);
    }
 
    return matcher;
@@ -38,6 +38,14 @@
 
 // #define STRI__BYTESEARCH_DISABLE_SHORTPAT
 
+// patterns at least this long use Boyer-Moore-Horspool; medium-sized
+// ones stay with KMP (linear worst case, table cheap to build)
+#define STRI__BYTESEARCH_BMH_THRESHOLD 32
+
+// minimal per-thread slice (in bytes) when splitting a single very long
+// haystack across worker threads; shorter strings are scanned serially
+#define STRI__BYTESEARCH_PARALLEL_MIN_CHUNK 1048576
+
 
 /**
  * A class to handle StriByteSearch patterns
@@ -78,15 +86,19 @@ class StriContainerByteSearch : public StriContainerUTF8 {
       } ByteSearchFlag;
 
       StriByteSearchMatcher* matcher;
+      bool matcher_borrowed; ///< is `matcher` owned by a stri_fixed_pattern handle?
       uint32_t flags; ///< ByteSearch flags
 
 
    public:
 
       static uint32_t getByteSearchFlags(SEXP opts_fixed, bool allow_overlap=false);
+      static StriByteSearchMatcher* createMatcher(const char* patternStr,
+         R_len_t patternLen, uint32_t flags);
 
       StriContainerByteSearch();
-      StriContainerByteSearch(SEXP rstr, R_len_t nrecycle, uint32_t flags);
+      StriContainerByteSearch(SEXP rstr, R_len_t nrecycle, uint32_t flags,
+         StriByteSearchMatcher* prepared=NULL);
       StriContainerByteSearch(StriContainerByteSearch& container);
       ~StriContainerByteSearch();
       StriContainerByteSearch& operator=(StriContainerByteSearch& container);
@@ -100,6 +112,16 @@ class StriContainerByteSearch : public StriContainerUTF8 {
       inline bool isOverlap() {
          return (bool)(flags&BYTESEARCH_OVERLAP);
       }
+
+      inline uint32_t getFlags() {
+         return flags;
+      }
 };
 
+
+// precompiled pattern handles (externalptr), see stri_fixed_pattern.cpp
+bool stri__is_fixed_pattern(SEXP pattern);
+SEXP stri__fixed_pattern_unwrap(SEXP pattern, uint32_t& pattern_flags,
+   StriByteSearchMatcher*& prepared);
+
 #endif
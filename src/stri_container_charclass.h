@@ -35,9 +35,49 @@
 
 #include "stri_container_base.h"
 #include "stri_container_utf8.h"
+#include "stri_utf8dfa.h"
 #include <unicode/uniset.h>
 
 
+/**
+ * A compiled charclass with an inline ASCII prefilter
+ *
+ * Wraps a (frozen) UnicodeSet together with a 128-bit bitmap of its
+ * ASCII subset; code points below 0x80 - the bulk of most inputs -
+ * are answered straight from the bitmap, everything else goes to
+ * the set.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+class StriCharClass {
+
+   private:
+
+      const UnicodeSet* uset;
+      uint32_t ascii[4]; ///< 128-bit bitmap of the ASCII subset
+
+   public:
+
+      StriCharClass() : uset(NULL) {
+         ascii[0] = ascii[1] = ascii[2] = ascii[3] = 0;
+      }
+
+      StriCharClass(const UnicodeSet* s) : uset(s) {
+         ascii[0] = ascii[1] = ascii[2] = ascii[3] = 0;
+         for (UChar32 c=0; c<128; ++c)
+            if (s->contains(c))
+               ascii[c>>5] |= ((uint32_t)1 << (c&31));
+      }
+
+      /** membership test; ASCII via the precomputed bitmap */
+      inline bool contains(UChar32 c) const {
+         if ((uint32_t)c < 128u)
+            return (ascii[c>>5] >> (c&31)) & 1u;
+         return (bool)uset->contains(c);
+      }
+};
+
+
 /**
  * A container handling charclass searches
  *
@@ -49,18 +89,35 @@
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-02)
  *          New method: locateAll
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          ASCII membership bitmaps (see StriCharClass, getView)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          locateAll sweeps ASCII runs without decoding
  */
 class StriContainerCharClass : public StriContainerBase {
 
    private:
 
       UnicodeSet* data; // array
+      StriCharClass* view; // array, parallel to data
+
+
+      void buildViews() {
+         if (!data) { view = NULL; return; }
+         view = new StriCharClass[n];
+         for (int i=0; i<n; ++i)
+            if (!data[i].isBogus())
+               view[i] = StriCharClass(&data[i]);
+      }
 
    public:
 
       StriContainerCharClass() : StriContainerBase()
       {
          data = NULL;
+         view = NULL;
       }
 
       StriContainerCharClass(SEXP rvec, R_len_t _nrecycle)
@@ -73,6 +130,7 @@ class StriContainerCharClass : public StriContainerBase {
          this->init_Base(_n, _nrecycle, true);
 
          this->data = NULL;
+         this->view = NULL;
          if (_n > 0) {
             StriContainerUTF8 rvec_cont(rvec, _n, true);
             this->data = new UnicodeSet[_n];
@@ -87,6 +145,7 @@ class StriContainerCharClass : public StriContainerBase {
                   this->data[i].freeze();
                }
             }
+            buildViews();
          }
       }
 
@@ -97,13 +156,17 @@ class StriContainerCharClass : public StriContainerBase {
             this->data = new UnicodeSet[container.n];
             for (int i=0; i<container.n; ++i)
                this->data[i] = container.data[i];
+            buildViews(); // must point at our own copies of the sets
          }
-         else
+         else {
             this->data = NULL;
+            this->view = NULL;
+         }
       }
 
       ~StriContainerCharClass() {
          if (data) delete [] data;
+         if (view) delete [] view;
       }
 
       StriContainerCharClass& operator=(StriContainerCharClass& container)
@@ -114,9 +177,12 @@ class StriContainerCharClass : public StriContainerBase {
             this->data = new UnicodeSet[container.n];
             for (int i=0; i<container.n; ++i)
                this->data[i] = container.data[i];
+            buildViews(); // must point at our own copies of the sets
          }
-         else
+         else {
             this->data = NULL;
+            this->view = NULL;
+         }
          return *this;
       }
 
@@ -130,7 +196,7 @@ class StriContainerCharClass : public StriContainerBase {
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerCharClass::isNA(): INDEX OUT OF BOUNDS");
 #endif
-         return data[i%n].isBogus();
+         return data[recycled_index(i)].isBogus();
       }
 
 
@@ -142,10 +208,25 @@ class StriContainerCharClass : public StriContainerBase {
 #ifndef NDEBUG
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerCharClass::get(): INDEX OUT OF BOUNDS");
-         if (data[i%n].isBogus())
+         if (data[recycled_index(i)].isBogus())
             throw StriException("StriContainerCharClass::get(): isNA");
 #endif
-         return (data[i%n]);
+         return (data[recycled_index(i)]);
+      }
+
+
+      /** get the vectorized ith element, with an ASCII prefilter
+       * @param i index
+       * @return charclass view for membership tests
+       */
+      inline const StriCharClass& getView(R_len_t i) const {
+#ifndef NDEBUG
+         if (i < 0 || i >= nrecycle)
+            throw StriException("StriContainerCharClass::getView(): INDEX OUT OF BOUNDS");
+         if (data[recycled_index(i)].isBogus())
+            throw StriException("StriContainerCharClass::getView(): isNA");
+#endif
+         return (view[recycled_index(i)]);
       }
 
 
@@ -155,19 +236,28 @@ class StriContainerCharClass : public StriContainerBase {
        * or total number of codepoints matched (idx_codepoint==true)
        */
       static R_len_t locateAll(deque< pair<R_len_t, R_len_t> >& occurrences,
-            const UnicodeSet* pattern_cur,
+            const StriCharClass* pattern_cur,
             const char* str_cur_s, R_len_t str_cur_n,
             bool merge_cur, bool idx_codepoint)
       {
          if (idx_codepoint) {
             R_len_t j, k;
+            R_len_t run = 0; // end of the current ASCII run
             UChar32 chr;
             R_len_t sumcodepoints = 0;
             for (k=j=0; j<str_cur_n; ) {
                ++k;
-               U8_NEXT(str_cur_s, j, str_cur_n, chr);
-               if (chr < 0) // invalid utf-8 sequence
-                  throw StriException(MSG__INVALID_UTF8);
+               if (j < run) // within an ASCII run: the byte is the code point
+                  chr = (UChar32)(uint8_t)str_cur_s[j++];
+               else if ((uint8_t)str_cur_s[j] < 0x80) {
+                  run = stri__ascii_run_end(str_cur_s, j, str_cur_n);
+                  chr = (UChar32)(uint8_t)str_cur_s[j++];
+               }
+               else {
+                  chr = stri__utf8dfa_next(str_cur_s, j, str_cur_n);
+                  if (chr < 0) // invalid utf-8 sequence
+                     throw StriException(MSG__INVALID_UTF8);
+               }
                if (pattern_cur->contains(chr)) {
                   if (merge_cur && occurrences.size() > 0 &&
                         occurrences.back().second == k-1)
@@ -181,12 +271,21 @@ class StriContainerCharClass : public StriContainerBase {
          }
          else {
             R_len_t j, jlast;
+            R_len_t run = 0; // end of the current ASCII run
             UChar32 chr;
             R_len_t sumbytes = 0;
             for (jlast=j=0; j<str_cur_n; ) {
-               U8_NEXT(str_cur_s, j, str_cur_n, chr);
-               if (chr < 0) // invalid utf-8 sequence
-                  throw StriException(MSG__INVALID_UTF8);
+               if (j < run) // within an ASCII run: the byte is the code point
+                  chr = (UChar32)(uint8_t)str_cur_s[j++];
+               else if ((uint8_t)str_cur_s[j] < 0x80) {
+                  run = stri__ascii_run_end(str_cur_s, j, str_cur_n);
+                  chr = (UChar32)(uint8_t)str_cur_s[j++];
+               }
+               else {
+                  chr = stri__utf8dfa_next(str_cur_s, j, str_cur_n);
+                  if (chr < 0) // invalid utf-8 sequence
+                     throw StriException(MSG__INVALID_UTF8);
+               }
                if (pattern_cur->contains(chr)) {
                   if (merge_cur && occurrences.size() > 0 &&
                         occurrences.back().second == jlast)
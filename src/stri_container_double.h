@@ -80,7 +80,7 @@ class StriContainerDouble : public StriContainerBase {
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerDouble::isNA(): INDEX OUT OF BOUNDS");
 #endif
-         return (ISNA(data[i%n]));
+         return (ISNA(data[recycled_index(i)]));
       }
 
 
@@ -92,10 +92,10 @@ class StriContainerDouble : public StriContainerBase {
 #ifndef NDEBUG
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerDouble::get(): INDEX OUT OF BOUNDS");
-         if (ISNA(data[i%n]))
+         if (ISNA(data[recycled_index(i)]))
             throw StriException("StriContainerDouble::get(): isNA");
 #endif
-         return (data[i%n]);
+         return (data[recycled_index(i)]);
       }
 };
 
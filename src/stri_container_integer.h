@@ -80,7 +80,7 @@ class StriContainerInteger : public StriContainerBase {
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerInteger::isNA(): INDEX OUT OF BOUNDS");
 #endif
-         return (data[i%n] == NA_INTEGER);
+         return (data[recycled_index(i)] == NA_INTEGER);
       }
 
 
@@ -92,10 +92,10 @@ class StriContainerInteger : public StriContainerBase {
 #ifndef NDEBUG
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerInteger::get(): INDEX OUT OF BOUNDS");
-         if (data[i%n] == NA_INTEGER)
+         if (data[recycled_index(i)] == NA_INTEGER)
             throw StriException("StriContainerInteger::get(): isNA");
 #endif
-         return (data[i%n]);
+         return (data[recycled_index(i)]);
       }
 };
 
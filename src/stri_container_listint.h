@@ -70,7 +70,7 @@ class StriContainerListInt : public StriContainerBase {
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerListInt::isNA(): INDEX OUT OF BOUNDS");
 #endif
-         return (data[i%n].isNA());
+         return (data[recycled_index(i)].isNA());
       }
 
 
@@ -82,10 +82,10 @@ class StriContainerListInt : public StriContainerBase {
 #ifndef NDEBUG
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerListInt::get(): INDEX OUT OF BOUNDS");
-         if (data[i%n].isNA())
+         if (data[recycled_index(i)].isNA())
             throw StriException("StriContainerListInt::get(): isNA");
 #endif
-         return data[i%n];
+         return data[recycled_index(i)];
       }
 };
 
@@ -73,7 +73,7 @@ class StriContainerListRaw : public StriContainerBase {
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerListRaw::isNA(): INDEX OUT OF BOUNDS");
 #endif
-         return (data[i%n].isNA());
+         return (data[recycled_index(i)].isNA());
       }
 
 
@@ -85,10 +85,10 @@ class StriContainerListRaw : public StriContainerBase {
 #ifndef NDEBUG
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerListRaw::get(): INDEX OUT OF BOUNDS");
-         if (data[i%n].isNA())
+         if (data[recycled_index(i)].isNA())
             throw StriException("StriContainerListRaw::get(): isNA");
 #endif
-         return data[i%n];
+         return data[recycled_index(i)];
       }
 };
 
@@ -32,6 +32,7 @@
 
 #include "stri_stringi.h"
 #include "stri_container_listutf8.h"
+#include <climits>
 
 
 /**
@@ -42,6 +43,10 @@ StriContainerListUTF8::StriContainerListUTF8()
    : StriContainerBase()
 {
    data = NULL;
+   flat_data = NULL;
+   flat_offset = NULL;
+   flat_length = NULL;
+   flat_ncol = 0;
 }
 
 
@@ -54,6 +59,10 @@ StriContainerListUTF8::StriContainerListUTF8()
 StriContainerListUTF8::StriContainerListUTF8(SEXP rvec, R_len_t _nrecycle, bool _shallowrecycle)
 {
    this->data = NULL;
+   this->flat_data = NULL;
+   this->flat_offset = NULL;
+   this->flat_length = NULL;
+   this->flat_ncol = 0;
 #ifndef NDEBUG
    if (!Rf_isVectorList(rvec))
       throw StriException("DEBUG: !isVectorList in StriContainerListUTF8::StriContainerListUTF8(SEXP rvec)");
@@ -86,6 +95,11 @@ StriContainerListUTF8::StriContainerListUTF8(SEXP rvec, R_len_t _nrecycle, bool
 StriContainerListUTF8::StriContainerListUTF8(StriContainerListUTF8& container)
    :    StriContainerBase((StriContainerBase&)container)
 {
+   // the flattened layout, if any, is not copied - rebuild on demand
+   this->flat_data = NULL;
+   this->flat_offset = NULL;
+   this->flat_length = NULL;
+   this->flat_ncol = 0;
    if (container.data) {
       this->data = new StriContainerUTF8*[this->n];
       if (!this->data) throw StriException(MSG__MEM_ALLOC_ERROR);
@@ -109,6 +123,11 @@ StriContainerListUTF8& StriContainerListUTF8::operator=(StriContainerListUTF8& c
    this->~StriContainerListUTF8();
    (StriContainerBase&) (*this) = (StriContainerBase&)container;
 
+   // the flattened layout, if any, is not copied - rebuild on demand
+   this->flat_data = NULL;
+   this->flat_offset = NULL;
+   this->flat_length = NULL;
+   this->flat_ncol = 0;
    if (container.data) {
       this->data = new StriContainerUTF8*[this->n];
       if (!this->data) throw StriException(MSG__MEM_ALLOC_ERROR);
@@ -139,4 +158,75 @@ StriContainerListUTF8::~StriContainerListUTF8()
       delete [] data;
       data = NULL;
    }
+   if (flat_data)   { delete [] flat_data;   flat_data = NULL;   }
+   if (flat_offset) { delete [] flat_offset; flat_offset = NULL; }
+   if (flat_length) { delete [] flat_length; flat_length = NULL; }
+   flat_ncol = 0;
+}
+
+
+/** Build the flattened (arena+offsets) layout
+ *
+ * All the strings are copied, back to back, into one contiguous byte
+ * arena, in the order a whole-container scan visits them (element i of
+ * each of the n vectors in turn, then element i+1, ...); per-string
+ * (offset, length) pairs go into two plain arrays. Tight loops that
+ * touch every string - stri_join's collapse path in particular - then
+ * read the data strictly sequentially instead of chasing
+ * container/String8/CHARSXP pointers all over the heap.
+ *
+ * A no-op if already flattened, if any of the vectors is NA, or if the
+ * strings do not fit in a single R_len_t-addressed arena; isFlat()
+ * tells whether the layout is available. The pointer-based get() API
+ * stays valid either way.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void StriContainerListUTF8::flatten()
+{
+   if (flat_data || n <= 0) return;
+
+   R_len_t m = 0; // the common vectorization length
+   for (R_len_t j=0; j<n; ++j) {
+      if (!data[j]) return; // an NA vector - keep the pointer-based layout
+      m = data[j]->get_nrecycle();
+   }
+   if (m <= 0) return;
+
+   size_t total = 0;
+   for (R_len_t j=0; j<n; ++j)
+      for (R_len_t i=0; i<m; ++i)
+         if (!data[j]->isNA(i))
+            total += (size_t)data[j]->get(i).length();
+   if (total > (size_t)INT_MAX) return; // R_len_t offsets would overflow
+
+   char* new_data = new char[(total>0)?total:1];
+   if (!new_data) throw StriException(MSG__MEM_ALLOC_ERROR);
+   R_len_t* new_offset = new R_len_t[(size_t)n*(size_t)m];
+   if (!new_offset) { delete [] new_data; throw StriException(MSG__MEM_ALLOC_ERROR); }
+   R_len_t* new_length = new R_len_t[(size_t)n*(size_t)m];
+   if (!new_length) { delete [] new_data; delete [] new_offset; throw StriException(MSG__MEM_ALLOC_ERROR); }
+
+   R_len_t cur = 0;
+   for (R_len_t i=0; i<m; ++i) {
+      for (R_len_t j=0; j<n; ++j) {
+         size_t k = (size_t)i*(size_t)n+(size_t)j;
+         if (data[j]->isNA(i)) {
+            new_offset[k] = cur;
+            new_length[k] = -1;
+            continue;
+         }
+         const String8* cursd = &(data[j]->get(i));
+         R_len_t curn = cursd->length();
+         memcpy(new_data+cur, cursd->c_str(), (size_t)curn);
+         new_offset[k] = cur;
+         new_length[k] = curn;
+         cur += curn;
+      }
+   }
+
+   this->flat_data = new_data;
+   this->flat_offset = new_offset;
+   this->flat_length = new_length;
+   this->flat_ncol = m;
 }
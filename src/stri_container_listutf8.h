@@ -43,6 +43,8 @@
  * @version 0.1-?? (Marek Gagolewski, 2013-06-16)
  * @version 0.5-3 (Marek Gagolewski, 2015-06-27)
  *      warning on recycling rule, #174
+ * @version 1.4.6 (2020-01-24)
+ *      optional flattened (arena+offsets) layout, see flatten()
  */
 class StriContainerListUTF8 : public StriContainerBase {
 
@@ -50,6 +52,12 @@ class StriContainerListUTF8 : public StriContainerBase {
 
       StriContainerUTF8 **data;
 
+      // the flattened layout, see flatten(); NULL/0 until built
+      char* flat_data;        ///< all strings, back to back, in scan order
+      R_len_t* flat_offset;   ///< nrecycle*n offsets into flat_data
+      R_len_t* flat_length;   ///< nrecycle*n lengths, -1 for NA
+      R_len_t flat_ncol;      ///< common vectorization length of the items
+
 
    public:
 
@@ -60,6 +68,46 @@ class StriContainerListUTF8 : public StriContainerBase {
       StriContainerListUTF8& operator=(StriContainerListUTF8& container);
       SEXP toR(R_len_t i) const;
       SEXP toR() const;
+      void flatten();
+
+
+      /** is the flattened layout available? see flatten() */
+      inline bool isFlat() const {
+         return (flat_data != NULL);
+      }
+
+
+      /** length of the i-th string of the j-th vector [flattened layout],
+       *  -1 for NA
+       * @param i index within a vector [with recycle]
+       * @param j vector index
+       */
+      inline R_len_t getFlatLength(R_len_t i, R_len_t j) const {
+#ifndef NDEBUG
+         if (!flat_data)
+            throw StriException("StriContainerListUTF8::getFlatLength(): not flattened");
+         if (i < 0 || i >= flat_ncol || j < 0 || j >= n)
+            throw StriException("StriContainerListUTF8::getFlatLength(): INDEX OUT OF BOUNDS");
+#endif
+         return flat_length[(size_t)i*(size_t)n+(size_t)j];
+      }
+
+
+      /** data of the i-th string of the j-th vector [flattened layout];
+       *  consecutive (i, j) pairs, iterated j fastest, are contiguous
+       *  in memory
+       * @param i index within a vector [with recycle]
+       * @param j vector index
+       */
+      inline const char* getFlatData(R_len_t i, R_len_t j) const {
+#ifndef NDEBUG
+         if (!flat_data)
+            throw StriException("StriContainerListUTF8::getFlatData(): not flattened");
+         if (i < 0 || i >= flat_ncol || j < 0 || j >= n)
+            throw StriException("StriContainerListUTF8::getFlatData(): INDEX OUT OF BOUNDS");
+#endif
+         return flat_data + flat_offset[(size_t)i*(size_t)n+(size_t)j];
+      }
 
 
       /** check if the vectorized ith element is NA
@@ -71,7 +119,7 @@ class StriContainerListUTF8 : public StriContainerBase {
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerListUTF8::isNA(): INDEX OUT OF BOUNDS");
 #endif
-         return (data[i%n] == NULL);
+         return (data[recycled_index(i)] == NULL);
       }
 
 
@@ -83,10 +131,10 @@ class StriContainerListUTF8 : public StriContainerBase {
 #ifndef NDEBUG
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerListUTF8::get(): INDEX OUT OF BOUNDS");
-         if (data[i%n] == NULL)
+         if (data[recycled_index(i)] == NULL)
             throw StriException("StriContainerListUTF8::get(): isNA");
 #endif
-         return (*(data[i%n]));
+         return (*(data[recycled_index(i)]));
       }
 };
 
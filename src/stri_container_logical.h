@@ -81,7 +81,7 @@ class StriContainerLogical : public StriContainerBase {
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerLogical::isNA(): INDEX OUT OF BOUNDS");
 #endif
-         return (data[i%n] == NA_LOGICAL);
+         return (data[recycled_index(i)] == NA_LOGICAL);
       }
 
 
@@ -93,10 +93,10 @@ class StriContainerLogical : public StriContainerBase {
 #ifndef NDEBUG
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerLogical::get(): INDEX OUT OF BOUNDS");
-         if (data[i%n] == NA_LOGICAL)
+         if (data[recycled_index(i)] == NA_LOGICAL)
             throw StriException("StriContainerLogical::get(): isNA");
 #endif
-         return (data[i%n]);
+         return (data[recycled_index(i)]);
       }
 };
 
@@ -0,0 +1,88 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_container_mmap.h"
+#include <climits>
+
+
+/** map the file and build the line offset table
+ *
+ * The split mirrors stri_read_lines_utf8: lines end at LF and a CR
+ * just before the LF is dropped. Unlike there, the file as a whole may
+ * exceed INT_MAX bytes - only each single line and the line count are
+ * bound by R's vector limits - and validation is per line, so even a
+ * multi-gigabyte corpus is checked with bounded look-back.
+ *
+ * @param path file path
+ * @param err [out] untouched on success; on failure, a message taking
+ *    the path as its `%s` (the caller owns the Rf_error call)
+ * @return false on I/O failure, oversized content or invalid UTF-8
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+bool StriContainerMMapUTF8::open(const char* path, const char*& err)
+{
+   if (!m_file.open(path)) {
+      err = MSG__FILE_READ_ERROR;
+      return false;
+   }
+
+   const char* cur = m_file.data;
+   const char* end = m_file.data+m_file.size;
+   while (cur < end) {
+      const char* nl = (const char*)memchr(cur, '\n', (size_t)(end-cur));
+      const char* eol = (nl)?nl:end;
+      size_t curn = (size_t)(eol-cur);
+      if (curn > 0 && eol[-1] == '\r') --curn; // CR LF
+      if (curn > (size_t)INT_MAX || m_offset.size() >= (size_t)INT_MAX) {
+         err = MSG__MMAP_LINES_TOO_LARGE;
+         m_offset.clear();
+         m_length.clear();
+         m_file.close();
+         return false;
+      }
+      if (curn > 0 && stri__enc_check_utf8(cur, (R_len_t)curn, false) < 1.0) {
+         err = MSG__INVALID_UTF8;
+         m_offset.clear();
+         m_length.clear();
+         m_file.close();
+         return false;
+      }
+      m_offset.push_back((size_t)(cur-m_file.data));
+      m_length.push_back((R_len_t)curn);
+      if (!nl) break;
+      cur = nl+1;
+   }
+
+   return true;
+}
@@ -0,0 +1,101 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __stri_container_mmap_h
+#define __stri_container_mmap_h
+
+#include "stri_files.h"
+#include <vector>
+
+
+/**
+ * A read-only sibling of StriContainerUTF8 over a memory-mapped file
+ *
+ * Elements are the text lines of a UTF-8 file; they point straight
+ * into the mapping, so a corpus never has to fit in R memory - the OS
+ * pages it in as the scanners touch it. Only the offset table lives on
+ * the heap. There are no NAs (every line of a file exists) and the
+ * elements are immutable; functions needing to write or to re-encode
+ * must go through the regular containers.
+ *
+ * open() splits at LF and strips a CR preceding it, exactly like
+ * stri_read_lines_utf8, and validates each line as UTF-8 - so queries
+ * against the container agree with the same queries against
+ * stri_read_lines(fname) element by element.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+class StriContainerMMapUTF8 {
+
+   private:
+
+      StriMappedFile m_file;
+      std::vector<size_t> m_offset; ///< line start offsets
+      std::vector<R_len_t> m_length; ///< line lengths [bytes], sans CR LF
+
+      // the mapping is owned - no copying
+      StriContainerMMapUTF8(const StriContainerMMapUTF8&);
+      StriContainerMMapUTF8& operator=(const StriContainerMMapUTF8&);
+
+   public:
+
+      StriContainerMMapUTF8() { }
+
+      ~StriContainerMMapUTF8() {
+         m_file.close();
+      }
+
+      /** map the file and build the line offset table
+       *
+       * @param path file path
+       * @param err [out] untouched on success; on failure, the message
+       *    to report (the caller owns the Rf_error call)
+       * @return false on I/O failure, oversized content or invalid UTF-8
+       */
+      bool open(const char* path, const char*& err);
+
+      inline R_len_t get_n() const {
+         return (R_len_t)m_length.size();
+      }
+
+      /** the i-th line, a view into the mapping (not NUL-terminated) */
+      inline const char* get_s(R_len_t i) const {
+         return m_file.data+m_offset[(size_t)i];
+      }
+
+      inline R_len_t get_length(R_len_t i) const {
+         return m_length[(size_t)i];
+      }
+};
+
+#endif
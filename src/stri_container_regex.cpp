@@ -32,6 +32,161 @@
 
 #include "stri_stringi.h"
 #include "stri_container_regex.h"
+#include "stri_usage.h"
+#include "stri_cache.h"
+#include "stri_opts_memo.h"
+#include <vector>
+
+
+#define STRI__REGEX_CACHE_DEFAULT_BUDGET 32
+#define STRI__REGEX_CACHE_MAX_BUDGET 1024
+
+
+/** An entry in StriRegexPatternCache */
+struct StriRegexCacheEntry {
+   UnicodeString pattern;  ///< the pattern string, as passed to the compiler
+   uint32_t flags;         ///< RegexMatcher flags
+   RegexPattern* compiled; ///< owned by the cache
+   unsigned last_used;     ///< LRU stamp from the shared clock, see stri_cache.h
+};
+
+static std::vector<StriRegexCacheEntry> stri__regex_cache; ///< main R thread only
+
+
+/** Get the maximal number of cached compiled patterns
+ *
+ * Reads \code{getOption("stringi.regex_cache_size")};
+ * non-numeric, missing, or negative settings yield the default budget.
+ *
+ * @return number of entries, 0 disables the cache
+ */
+R_len_t StriRegexPatternCache::getBudget()
+{
+   SEXP val = Rf_GetOption1(Rf_install("stringi.regex_cache_size"));
+   if (Rf_isNull(val))
+      return STRI__REGEX_CACHE_DEFAULT_BUDGET;
+
+   int budget = Rf_asInteger(val);
+   if (budget == NA_INTEGER || budget < 0)
+      return STRI__REGEX_CACHE_DEFAULT_BUDGET;
+   if (budget > STRI__REGEX_CACHE_MAX_BUDGET)
+      budget = STRI__REGEX_CACHE_MAX_BUDGET;
+   return (R_len_t)budget;
+}
+
+
+/** Get the current number of cached compiled patterns
+ */
+R_len_t StriRegexPatternCache::getSize()
+{
+   return (R_len_t)stri__regex_cache.size();
+}
+
+
+/** Drop all cached compiled patterns
+ */
+void StriRegexPatternCache::clear()
+{
+   for (size_t j=0; j<stri__regex_cache.size(); ++j)
+      delete stri__regex_cache[j].compiled;
+   stri__regex_cache.clear();
+}
+
+
+/** Fetch a compiled pattern from the cache, compiling it on a miss
+ *
+ * The returned object is owned by the cache; it stays valid until
+ * this function is called again (a miss may evict it). In particular,
+ * any \code{RegexMatcher} created from it must be deleted before
+ * another pattern is requested.
+ *
+ * @param pattern regex
+ * @param flags RegexMatcher flags
+ * @param status set on compilation failure
+ * @return compiled pattern or NULL on error
+ */
+const RegexPattern* StriRegexPatternCache::getCompiled(
+   const UnicodeString& pattern, uint32_t flags, UErrorCode& status)
+{
+   R_len_t budget = getBudget();
+
+   for (size_t j=0; j<stri__regex_cache.size(); ++j) {
+      StriRegexCacheEntry& e = stri__regex_cache[j];
+      if (e.flags == flags && e.pattern == pattern) {
+         e.last_used = stri__cache_tick();
+         ++stri__usage_regex.hits;
+         return e.compiled; // cache hit
+      }
+   }
+
+   UParseError pe;
+   RegexPattern* compiled = RegexPattern::compile(pattern, flags, pe, status);
+   if (U_FAILURE(status)) {
+      if (compiled) delete compiled;
+      return NULL;
+   }
+   ++stri__usage_regex.opens;
+
+   if (budget <= 0) {
+      // caching disabled: hand the ownership over to a 1-element
+      // "cache" consisting of the most recent pattern only
+      clear();
+      StriRegexCacheEntry entry;
+      entry.pattern = pattern;
+      entry.flags = flags;
+      entry.compiled = compiled;
+      entry.last_used = stri__cache_tick();
+      stri__regex_cache.push_back(entry);
+      return compiled;
+   }
+
+   while ((R_len_t)stri__regex_cache.size() >= budget) {
+      // evict the least recently used entry
+      size_t oldest = 0;
+      for (size_t j=1; j<stri__regex_cache.size(); ++j)
+         if (stri__regex_cache[j].last_used < stri__regex_cache[oldest].last_used)
+            oldest = j;
+      delete stri__regex_cache[oldest].compiled;
+      stri__regex_cache.erase(stri__regex_cache.begin()+oldest);
+   }
+
+   // the global budget is enforced before the new entry is admitted -
+   // the caller still holds a pointer into this cache, so the entry
+   // about to be created must survive the current call
+   stri__cache_enforce_budget();
+
+   StriRegexCacheEntry entry;
+   entry.pattern = pattern;
+   entry.flags = flags;
+   entry.compiled = compiled;
+   entry.last_used = stri__cache_tick();
+   stri__regex_cache.push_back(entry);
+   return compiled;
+}
+
+
+// the stri_cache.cpp hooks, see stri_cache.h; count, capacity, and
+// clear are served by the static methods above
+
+unsigned stri__regex_cache_oldest()
+{
+   unsigned oldest = 0;
+   for (size_t j=0; j<stri__regex_cache.size(); ++j)
+      if (oldest == 0 || stri__regex_cache[j].last_used < oldest)
+         oldest = stri__regex_cache[j].last_used;
+   return oldest;
+}
+
+void stri__regex_cache_evict_oldest()
+{
+   if (stri__regex_cache.empty()) return;
+   size_t oldest = 0;
+   for (size_t j=1; j<stri__regex_cache.size(); ++j)
+      if (stri__regex_cache[j].last_used < stri__regex_cache[oldest].last_used)
+         oldest = j;
+   delete stri__regex_cache[oldest].compiled;
+   stri__regex_cache.erase(stri__regex_cache.begin()+oldest);
+}
 
 
 /**
@@ -44,6 +199,7 @@ StriContainerRegexPattern::StriContainerRegexPattern()
    this->lastMatcherIndex = -1;
    this->lastMatcher = NULL;
    this->flags =0;
+   this->prepared = NULL;
 }
 
 
@@ -52,13 +208,17 @@ StriContainerRegexPattern::StriContainerRegexPattern()
  * @param rstr R character vector
  * @param nrecycle extend length [vectorization]
  * @param flags regexp flags
+ * @param prepared precompiled pattern (a stri_regex_pattern handle's,
+ *    which must outlive this container) or NULL
  */
-StriContainerRegexPattern::StriContainerRegexPattern(SEXP rstr, R_len_t _nrecycle, uint32_t _flags)
+StriContainerRegexPattern::StriContainerRegexPattern(SEXP rstr, R_len_t _nrecycle, uint32_t _flags,
+   const RegexPattern* _prepared)
    : StriContainerUTF16(rstr, _nrecycle, true)
 {
    this->lastMatcherIndex = -1;
    this->lastMatcher = NULL;
    this->flags = _flags;
+   this->prepared = _prepared;
 
    R_len_t n = get_n();
    for (R_len_t i=0; i<n; ++i) {
@@ -78,6 +238,7 @@ StriContainerRegexPattern::StriContainerRegexPattern(StriContainerRegexPattern&
    this->lastMatcherIndex = -1;
    this->lastMatcher = NULL;
    this->flags = container.flags;
+   this->prepared = container.prepared;
 }
 
 
@@ -88,6 +249,7 @@ StriContainerRegexPattern& StriContainerRegexPattern::operator=(StriContainerReg
    this->lastMatcherIndex = -1;
    this->lastMatcher = NULL;
    this->flags = container.flags;
+   this->prepared = container.prepared;
    return *this;
 }
 
@@ -110,6 +272,14 @@ StriContainerRegexPattern::~StriContainerRegexPattern()
  * for \code{i >= this->n} the last matcher is returned
  *
  * @param i index
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    compiled patterns are fetched via StriRegexPatternCache,
+ *    so that repeated .Calls with the same pattern skip recompilation
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    a stri_regex_pattern handle supplies its own compiled pattern,
+ *    bypassing the cache entirely
  */
 RegexMatcher* StriContainerRegexPattern::getMatcher(R_len_t i)
 {
@@ -124,7 +294,12 @@ RegexMatcher* StriContainerRegexPattern::getMatcher(R_len_t i)
    }
 
    UErrorCode status = U_ZERO_ERROR;
-   lastMatcher = new RegexMatcher(this->get(i), flags, status);
+   const RegexPattern* compiled = prepared;
+   if (!compiled) {
+      compiled = StriRegexPatternCache::getCompiled(this->get(i), flags, status);
+      STRI__CHECKICUSTATUS_THROW(status, {/* nothing on err */})
+   }
+   lastMatcher = compiled->matcher(status);
    STRI__CHECKICUSTATUS_THROW(status, {if (lastMatcher) delete lastMatcher; lastMatcher = NULL;})
    if (!lastMatcher) throw StriException(MSG__MEM_ALLOC_ERROR);
    this->lastMatcherIndex = (i % n);
@@ -133,6 +308,277 @@ RegexMatcher* StriContainerRegexPattern::getMatcher(R_len_t i)
 }
 
 
+/** Should the regex engines run over UText-wrapped UTF-8 inputs?
+ *
+ * Reads \code{getOption("stringi.regex_use_utext")}. When set, the
+ * functions that support it skip the UTF-8 -> UTF-16 conversion of the
+ * haystack and run the matcher over the native UTF-8 bytes instead.
+ * Off by default: UText character access is slower per se, so this
+ * only pays off when the conversion dominates (long, rarely-matching
+ * inputs).
+ *
+ * Call from the main R thread only (reads R options).
+ */
+bool stri__regex_use_utext()
+{
+   SEXP val = Rf_GetOption1(Rf_install("stringi.regex_use_utext"));
+   if (Rf_isNull(val)) return false;
+   int use = Rf_asLogical(val);
+   return (use != NA_LOGICAL && use);
+}
+
+
+/** find() the first match without letting typical scans see the tail
+ *
+ * For first-match semantics over a very long input, the matcher is
+ * first confined to a small prefix region (4 KiB, then 64 KiB, then
+ * everything) so that an early hit never traverses the rest of the
+ * document. A region-limited result is only accepted when the engine
+ * reports that it never touched the artificial end (hitEnd, and
+ * requireEnd for successes involving `$`); anything else - a miss, or
+ * a match that an end-of-region anchor may have shaped - widens the
+ * region and tries again, so the outcome is always identical to an
+ * unrestricted scan.
+ *
+ * @param matcher matcher with its pattern set; reset by this function
+ * @param str_text the haystack, as passed to \code{reset()}
+ * @param str_length haystack length, in native (UTF-8 byte) units
+ * @param status [in/out] ICU error code
+ * @return \code{find()}'s result; if \code{true}, the matcher holds
+ *    the accepted match
+ */
+bool stri__regex_find_first_adaptive(RegexMatcher* matcher, UText* str_text,
+   R_len_t str_length, UErrorCode& status)
+{
+   static const R_len_t prefixes[2] = { 4096, 65536 };
+   for (int p=0; p<2; ++p) {
+      if (str_length <= prefixes[p]) break; // the full scan is as cheap
+      matcher->reset(str_text);
+      matcher->region(0, (int64_t)prefixes[p], status);
+      if (U_FAILURE(status)) return false;
+      UBool m_res = matcher->find(status);
+      if (U_FAILURE(status)) return false;
+      if (m_res && !matcher->hitEnd() && !matcher->requireEnd())
+         return true; // the tail could not have influenced this match
+   }
+   matcher->reset(str_text);
+   return (bool)matcher->find(status);
+}
+
+
+/** Create an independent matcher for the i-th pattern
+ *
+ * Unlike with \code{getMatcher()}, the returned object is owned by the
+ * caller and must be deleted when done with. This is the way to obtain
+ * per-worker matchers for parallel loops: call it (from the main
+ * R thread!) once per worker thread; each clone may then be used
+ * concurrently with the others.
+ *
+ * @param i index
+ */
+RegexMatcher* StriContainerRegexPattern::cloneMatcher(R_len_t i)
+{
+   UErrorCode status = U_ZERO_ERROR;
+   const RegexPattern* compiled = prepared;
+   if (!compiled) {
+      compiled = StriRegexPatternCache::getCompiled(this->get(i), flags, status);
+      STRI__CHECKICUSTATUS_THROW(status, {/* nothing on err */})
+   }
+   RegexMatcher* matcher = compiled->matcher(status);
+   STRI__CHECKICUSTATUS_THROW(status, {if (matcher) delete matcher;})
+   if (!matcher) throw StriException(MSG__MEM_ALLOC_ERROR);
+   return matcher;
+}
+
+
+/** Extract the mandatory literal prefix of a regex, if any
+ *
+ * Returns the longest initial run of characters that any match of the
+ * pattern must start with. This enables a cheap prescan of the haystack
+ * (\code{indexOf}/\code{startsWith}) before firing up the backtracking
+ * matcher - a big win on low-hit-rate workloads.
+ *
+ * The extraction is conservative: it stops at the first regex
+ * metacharacter, drops a trailing character that is subject to
+ * a quantifier, and bails out entirely for flag combinations under
+ * which a bytewise comparison would be unsound
+ * (\code{case_insensitive}, \code{comments}) or pointless
+ * (\code{literal} - the whole pattern is literal anyway).
+ *
+ * @param pattern regex source string
+ * @param flags RegexMatcher flags
+ * @param anchored [out] true if the pattern starts with `^`
+ *    and each match must thus begin at position 0 (no \code{multiline})
+ * @return literal prefix, possibly empty (=> no prescan possible)
+ */
+UnicodeString StriContainerRegexPattern::getLiteralPrefix(
+   const UnicodeString& pattern, uint32_t flags, bool& anchored)
+{
+   anchored = false;
+   UnicodeString prefix;
+
+   if (flags & (UREGEX_CASE_INSENSITIVE|UREGEX_COMMENTS|UREGEX_LITERAL))
+      return prefix; // empty
+
+   R_len_t n = pattern.length();
+   R_len_t i = 0;
+   if (n > 0 && pattern.charAt(0) == (UChar)'^') {
+      anchored = !(flags & UREGEX_MULTILINE);
+      i = 1; // with multiline the prefix is still a necessary substring
+   }
+
+   for (; i<n; ++i) {
+      UChar c = pattern.charAt(i);
+      switch (c) {
+         case '\\': case '.': case '[': case ']': case '(': case ')':
+         case '{': case '}': case '*': case '+': case '?': case '|':
+         case '^': case '$':
+            return prefix; // metacharacter - stop here
+         default:
+            break;
+      }
+      // quantifiers apply to whole code points - step over surrogate pairs
+      R_len_t clen = (U16_IS_LEAD(c) && i+1 < n
+         && U16_IS_TRAIL(pattern.charAt(i+1)))?2:1;
+      if (i+clen < n) {
+         UChar next = pattern.charAt(i+clen);
+         if (next == (UChar)'*' || next == (UChar)'+' ||
+             next == (UChar)'?' || next == (UChar)'{')
+            return prefix; // `c` is quantified, hence optional/repeatable
+      }
+      prefix.append(c);
+      if (clen == 2) prefix.append(pattern.charAt(++i));
+   }
+
+   return prefix;
+}
+
+
+/** Check whether a regex is really a fixed-text search in disguise
+ *
+ * API-uniform code bases routinely pass plain literals (or
+ * \code{^literal$}) to the regex functions. Such degenerate patterns
+ * can be answered with a simple string comparison, 10-50x faster than
+ * a run of the ICU backtracker.
+ *
+ * Recognized shapes: \code{lit}, \code{^lit}, \code{lit$},
+ * \code{^lit$}, where \code{lit} is metacharacter-free. A pattern
+ * compiled with the \code{literal} flag is a substring search by
+ * definition. Under \code{case_insensitive} or \code{comments} we
+ * always report \code{STRI_REGEX_LITERAL_NO}, as are anchored shapes
+ * under \code{multiline} (anchors then match at line boundaries).
+ *
+ * @param pattern regex source string
+ * @param flags RegexMatcher flags
+ * @param literal [out] the fixed text to search for
+ * @return the type of the fixed-text search, or STRI_REGEX_LITERAL_NO
+ */
+StriRegexLiteralType StriContainerRegexPattern::getLiteralPattern(
+   const UnicodeString& pattern, uint32_t flags, UnicodeString& literal)
+{
+   literal.remove();
+
+   if (flags & (UREGEX_CASE_INSENSITIVE|UREGEX_COMMENTS))
+      return STRI_REGEX_LITERAL_NO;
+
+   if (flags & UREGEX_LITERAL) {
+      literal = pattern;
+      return STRI_REGEX_LITERAL_SUBSTR;
+   }
+
+   R_len_t n = pattern.length();
+   R_len_t from = 0, to = n;
+   bool anchor_start = false, anchor_end = false;
+   if (to > from && pattern.charAt(0) == (UChar)'^') {
+      anchor_start = true;
+      ++from;
+   }
+   if (to > from && pattern.charAt(to-1) == (UChar)'$') {
+      anchor_end = true;
+      --to;
+   }
+
+   if ((anchor_start || anchor_end) && (flags & UREGEX_MULTILINE))
+      return STRI_REGEX_LITERAL_NO;
+
+   for (R_len_t i=from; i<to; ++i) {
+      switch (pattern.charAt(i)) {
+         case '\\': case '.': case '[': case ']': case '(': case ')':
+         case '{': case '}': case '*': case '+': case '?': case '|':
+         case '^': case '$':
+            return STRI_REGEX_LITERAL_NO;
+         default:
+            break;
+      }
+   }
+
+   literal.setTo(pattern, from, to-from);
+   if (anchor_start)
+      return anchor_end?STRI_REGEX_LITERAL_EXACT:STRI_REGEX_LITERAL_PREFIX;
+   else
+      return anchor_end?STRI_REGEX_LITERAL_SUFFIX:STRI_REGEX_LITERAL_SUBSTR;
+}
+
+
+/** Check whether a regex is a plain alternation of literals
+ *
+ * Patterns of the shape \code{foo|bar|baz} - frequent in high-volume
+ * scanning - need no backtracking at all: occurrence of any branch can
+ * be established with independent substring searches. This is the
+ * profitable core of a "simple pattern" engine; everything else
+ * falls back to ICU.
+ *
+ * The same soundness restrictions as in \code{getLiteralPattern()}
+ * apply; additionally every branch must be a nonempty literal (an
+ * empty branch matches everywhere, anchors change the semantics of
+ * the whole alternation - both are left to the engine).
+ *
+ * @param pattern regex source string
+ * @param flags RegexMatcher flags
+ * @param branches [out] the alternatives, cleared first
+ * @return true if the pattern is an alternation of >= 2 literals
+ */
+bool StriContainerRegexPattern::getLiteralAlternation(
+   const UnicodeString& pattern, uint32_t flags,
+   std::vector<UnicodeString>& branches)
+{
+   branches.clear();
+
+   if (flags & (UREGEX_CASE_INSENSITIVE|UREGEX_COMMENTS|UREGEX_LITERAL))
+      return false;
+
+   R_len_t n = pattern.length();
+   UnicodeString cur_branch;
+   R_len_t num_branches = 0;
+   for (R_len_t i=0; i<n; ++i) {
+      UChar c = pattern.charAt(i);
+      if (c == (UChar)'|') {
+         if (cur_branch.isEmpty()) { branches.clear(); return false; }
+         branches.push_back(cur_branch);
+         cur_branch.remove();
+         ++num_branches;
+         continue;
+      }
+      switch (c) {
+         case '\\': case '.': case '[': case ']': case '(': case ')':
+         case '{': case '}': case '*': case '+': case '?':
+         case '^': case '$':
+            branches.clear();
+            return false;
+         default:
+            cur_branch.append(c);
+      }
+   }
+
+   if (num_branches < 1 || cur_branch.isEmpty()) {
+      branches.clear();
+      return false; // no `|` at all, or a trailing empty branch
+   }
+   branches.push_back(cur_branch);
+   return true;
+}
+
+
 /** Read regex flags from a list
  *
  * may call Rf_error
@@ -150,9 +596,14 @@ RegexMatcher* StriContainerRegexPattern::getMatcher(R_len_t i)
  *
  * @version 1.1.6 (Marek Gagolewski, 2017-11-10)
  *    PROTECT STRING_ELT(names, i)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    parses of recently seen lists are memoized, see stri_opts_memo.h
  */
 uint32_t StriContainerRegexPattern::getRegexFlags(SEXP opts_regex)
 {
+   static StriOptsMemo<uint32_t> memo;
+
    uint32_t flags = 0;
    if (!isNull(opts_regex) && !Rf_isVectorList(opts_regex))
       Rf_error(MSG__ARG_EXPECTED_LIST, "opts_regex"); // error() call allowed here
@@ -161,6 +612,9 @@ uint32_t StriContainerRegexPattern::getRegexFlags(SEXP opts_regex)
 
    if (narg > 0) {
 
+      uint32_t* memoized = memo.find(opts_regex);
+      if (memoized) return *memoized;
+
       SEXP names = PROTECT(Rf_getAttrib(opts_regex, R_NamesSymbol));
       if (names == R_NilValue || LENGTH(names) != narg)
          Rf_error(MSG__REGEXP_CONFIG_FAILED); // error() call allowed here
@@ -205,6 +659,8 @@ uint32_t StriContainerRegexPattern::getRegexFlags(SEXP opts_regex)
          UNPROTECT(1);
       }
       UNPROTECT(1); /* names */
+
+      memo.put(opts_regex, flags);
    }
 
    return flags;
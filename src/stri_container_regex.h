@@ -35,10 +35,57 @@
 
 
 #include <unicode/regex.h>
+#include <vector>
 
 #include "stri_container_utf16.h"
 
 
+bool stri__regex_use_utext();
+bool stri__regex_find_first_adaptive(RegexMatcher* matcher, UText* str_text,
+   R_len_t str_length, UErrorCode& status);
+
+
+/** What kind of fixed-text search a regex actually denotes, if any */
+enum StriRegexLiteralType {
+   STRI_REGEX_LITERAL_NO = 0,  ///< a "real" regex - use the ICU engine
+   STRI_REGEX_LITERAL_SUBSTR,  ///< \code{lit}    - substring search
+   STRI_REGEX_LITERAL_PREFIX,  ///< \code{^lit}   - prefix comparison
+   STRI_REGEX_LITERAL_SUFFIX,  ///< \code{lit$}   - suffix comparison
+   STRI_REGEX_LITERAL_EXACT    ///< \code{^lit$}  - whole-string comparison
+};
+
+
+/**
+ * A process-global LRU cache of compiled \code{RegexPattern} objects
+ *
+ * Compiling a regex is expensive relative to matching it against
+ * a short string. As the same few patterns tend to be used over
+ * and over again across .Call invocations, we keep the most recently
+ * used compiled patterns alive between calls, keyed by
+ * (pattern string, regex flags).
+ *
+ * The entry budget may be tuned via
+ * \code{options(stringi.regex_cache_size=...)};
+ * set it to 0 to disable caching altogether.
+ *
+ * All methods shall be called from the main R thread only.
+ */
+class StriRegexPatternCache {
+
+   private:
+
+      StriRegexPatternCache() {} // static members only
+
+   public:
+
+      static const RegexPattern* getCompiled(const UnicodeString& pattern,
+         uint32_t flags, UErrorCode& status);
+      static R_len_t getBudget();
+      static R_len_t getSize();
+      static void clear();
+};
+
+
 /**
  * A class to handle regex searches
  *
@@ -58,6 +105,7 @@ class StriContainerRegexPattern : public StriContainerUTF16 {
    private:
 
       uint32_t flags; ///< RegexMatcher flags
+      const RegexPattern* prepared; ///< precompiled pattern (owned by a stri_regex_pattern handle) or NULL
       RegexMatcher* lastMatcher; ///< recently used \code{RegexMatcher}
       R_len_t lastMatcherIndex;  ///< used by vectorize_getMatcher
 
@@ -65,13 +113,27 @@ class StriContainerRegexPattern : public StriContainerUTF16 {
    public:
 
       static uint32_t getRegexFlags(SEXP opts_regex);
+      static UnicodeString getLiteralPrefix(const UnicodeString& pattern,
+         uint32_t flags, bool& anchored);
+      static StriRegexLiteralType getLiteralPattern(const UnicodeString& pattern,
+         uint32_t flags, UnicodeString& literal);
+      static bool getLiteralAlternation(const UnicodeString& pattern,
+         uint32_t flags, std::vector<UnicodeString>& branches);
 
       StriContainerRegexPattern();
-      StriContainerRegexPattern(SEXP rstr, R_len_t nrecycle, uint32_t flags);
+      StriContainerRegexPattern(SEXP rstr, R_len_t nrecycle, uint32_t flags,
+         const RegexPattern* prepared=NULL);
       StriContainerRegexPattern(StriContainerRegexPattern& container);
       ~StriContainerRegexPattern();
       StriContainerRegexPattern& operator=(StriContainerRegexPattern& container);
       RegexMatcher* getMatcher(R_len_t i);
+      RegexMatcher* cloneMatcher(R_len_t i);
 };
 
+
+// precompiled pattern handles (externalptr), see stri_regex_pattern.cpp
+bool stri__is_regex_pattern(SEXP pattern);
+SEXP stri__regex_pattern_unwrap(SEXP pattern, uint32_t& pattern_flags,
+   const RegexPattern*& prepared);
+
 #endif
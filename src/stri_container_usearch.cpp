@@ -32,6 +32,189 @@
 
 #include "stri_stringi.h"
 #include "stri_container_usearch.h"
+#include "stri_usage.h"
+#include "stri_cache.h"
+#include <string>
+
+
+// how many opened UStringSearch objects are kept alive between calls
+#define STRI__USEARCH_POOL_SIZE 16
+
+
+/** one pooled, ready-made UStringSearch
+ *
+ * usearch_open processes the whole pattern into collation elements and
+ * is far more expensive than usearch_setText; keeping configured
+ * searchers alive across calls lets e.g. stri_count_coll in a tight
+ * loop rebind the text only. Each entry owns a private collator clone,
+ * so the pool does not depend on the caller's collator lifetime; a
+ * caller's collator is matched via its configuration key
+ * (stri__ucol_identify, see stri_collator.cpp).
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+struct StriUSearchPoolEntry {
+   UnicodeString pattern;
+   std::string key;        ///< collator configuration key
+   UStringSearch* search;  ///< NULL marks a free slot
+   UCollator* col;         ///< private clone backing \code{search}
+   bool in_use;
+   unsigned stamp;         ///< last use, for LRU eviction
+
+   StriUSearchPoolEntry() : search(NULL), col(NULL), in_use(false), stamp(0) { }
+};
+
+static StriUSearchPoolEntry stri__usearch_pool[STRI__USEARCH_POOL_SIZE];
+// entries are stamped from the shared cross-cache clock, see stri_cache.h
+
+
+/** borrow a matcher for (pattern, col) from the pool, opening and
+ *  pooling a new one on a miss; NULL if the collator is anonymous,
+ *  all slots are busy, or opening failed (caller opens a transient one)
+ */
+static UStringSearch* stri__usearch_pool_acquire(const UnicodeString& pattern,
+   UCollator* col)
+{
+   const char* key = stri__ucol_identify(col);
+   if (!key) return NULL;
+
+   for (int i=0; i<STRI__USEARCH_POOL_SIZE; ++i) {
+      StriUSearchPoolEntry* e = &stri__usearch_pool[i];
+      if (e->search && !e->in_use && e->key == key && e->pattern == pattern) {
+         e->in_use = true;
+         e->stamp = stri__cache_tick();
+         ++stri__usage_usearch.hits;
+         return e->search;
+      }
+   }
+
+   int slot = -1;
+   for (int i=0; i<STRI__USEARCH_POOL_SIZE; ++i) {
+      if (!stri__usearch_pool[i].search) { slot = i; break; }
+      if (!stri__usearch_pool[i].in_use && (slot < 0 ||
+            stri__usearch_pool[i].stamp < stri__usearch_pool[slot].stamp))
+         slot = i;
+   }
+   if (slot < 0) return NULL; // everything is on loan
+
+   UErrorCode status = U_ZERO_ERROR;
+   UCollator* own = ucol_safeClone(col, NULL, NULL, &status);
+   if (U_FAILURE(status)) return NULL;
+
+   StriUSearchPoolEntry* e = &stri__usearch_pool[slot];
+   if (e->search) { // evict
+      usearch_close(e->search);
+      ucol_close(e->col);
+      e->search = NULL;
+      e->col = NULL;
+   }
+
+   // usearch works on the pattern by reference, so the searcher must be
+   // bound to the pool entry's own copy, which outlives the call
+   e->pattern = pattern;
+   static const UChar placeholder_text[1] = { 0x0020 };
+   status = U_ZERO_ERROR;
+   UStringSearch* search = usearch_openFromCollator(
+      e->pattern.getBuffer(), e->pattern.length(),
+      placeholder_text, 1, own, NULL, &status);
+   if (U_FAILURE(status)) {
+      if (search) usearch_close(search);
+      ucol_close(own);
+      return NULL;
+   }
+
+   e->key = key;
+   e->search = search;
+   e->col = own;
+   e->in_use = true;
+   e->stamp = stri__cache_tick();
+   ++stri__usage_usearch.opens;
+   stri__cache_enforce_budget(); // the fresh entry is in_use, hence safe
+   return search;
+}
+
+
+// the stri_cache.cpp hooks, see stri_cache.h; entries currently on
+// loan (in_use) are neither evictable nor touched by clear
+
+R_len_t stri__usearch_pool_count()
+{
+   R_len_t count = 0;
+   for (int i=0; i<STRI__USEARCH_POOL_SIZE; ++i)
+      if (stri__usearch_pool[i].search) ++count;
+   return count;
+}
+
+R_len_t stri__usearch_pool_capacity()
+{
+   return STRI__USEARCH_POOL_SIZE;
+}
+
+unsigned stri__usearch_pool_oldest()
+{
+   unsigned oldest = 0;
+   for (int i=0; i<STRI__USEARCH_POOL_SIZE; ++i)
+      if (stri__usearch_pool[i].search && !stri__usearch_pool[i].in_use &&
+            (oldest == 0 || stri__usearch_pool[i].stamp < oldest))
+         oldest = stri__usearch_pool[i].stamp;
+   return oldest;
+}
+
+void stri__usearch_pool_evict_oldest()
+{
+   int slot = -1;
+   for (int i=0; i<STRI__USEARCH_POOL_SIZE; ++i)
+      if (stri__usearch_pool[i].search && !stri__usearch_pool[i].in_use &&
+            (slot < 0 || stri__usearch_pool[i].stamp < stri__usearch_pool[slot].stamp))
+         slot = i;
+   if (slot < 0) return;
+   usearch_close(stri__usearch_pool[slot].search);
+   ucol_close(stri__usearch_pool[slot].col);
+   stri__usearch_pool[slot].search = NULL;
+   stri__usearch_pool[slot].col = NULL;
+   stri__usearch_pool[slot].stamp = 0;
+}
+
+void stri__usearch_pool_clear()
+{
+   for (int i=0; i<STRI__USEARCH_POOL_SIZE; ++i) {
+      if (stri__usearch_pool[i].search && !stri__usearch_pool[i].in_use) {
+         usearch_close(stri__usearch_pool[i].search);
+         ucol_close(stri__usearch_pool[i].col);
+         stri__usearch_pool[i].search = NULL;
+         stri__usearch_pool[i].col = NULL;
+         stri__usearch_pool[i].stamp = 0;
+      }
+   }
+}
+
+
+/** hand a borrowed matcher back to the pool */
+static void stri__usearch_pool_release(UStringSearch* search)
+{
+   for (int i=0; i<STRI__USEARCH_POOL_SIZE; ++i)
+      if (stri__usearch_pool[i].search == search) {
+         stri__usearch_pool[i].in_use = false;
+         return;
+      }
+}
+
+
+/** drop a borrowed matcher from the pool entirely (after an ICU error
+ *  its internal state is not to be trusted)
+ */
+static void stri__usearch_pool_discard(UStringSearch* search)
+{
+   for (int i=0; i<STRI__USEARCH_POOL_SIZE; ++i)
+      if (stri__usearch_pool[i].search == search) {
+         usearch_close(stri__usearch_pool[i].search);
+         ucol_close(stri__usearch_pool[i].col);
+         stri__usearch_pool[i].search = NULL;
+         stri__usearch_pool[i].col = NULL;
+         stri__usearch_pool[i].in_use = false;
+         return;
+      }
+}
 
 
 /**
@@ -42,6 +225,7 @@ StriContainerUStringSearch::StriContainerUStringSearch()
    : StriContainerUTF16()
 {
    this->lastMatcherIndex = -1;
+   this->lastMatcherPooled = false;
    this->str = NULL;
    this->col = NULL;
 }
@@ -58,6 +242,7 @@ StriContainerUStringSearch::StriContainerUStringSearch(SEXP rstr, R_len_t _nrecy
 {
    this->lastMatcherIndex = -1;
    this->lastMatcher = NULL;
+   this->lastMatcherPooled = false;
    this->col = _col;
 
    R_len_t n = get_n();
@@ -77,6 +262,7 @@ StriContainerUStringSearch::StriContainerUStringSearch(StriContainerUStringSearc
 {
    this->lastMatcherIndex = -1;
    this->lastMatcher = NULL;
+   this->lastMatcherPooled = false;
    this->col = container.col;
 }
 
@@ -87,6 +273,7 @@ StriContainerUStringSearch& StriContainerUStringSearch::operator=(StriContainerU
    (StriContainerUTF16&) (*this) = (StriContainerUTF16&)container;
    this->lastMatcherIndex = -1;
    this->lastMatcher = NULL;
+   this->lastMatcherPooled = false;
    this->col = container.col;
    return *this;
 }
@@ -96,13 +283,24 @@ StriContainerUStringSearch& StriContainerUStringSearch::operator=(StriContainerU
  *
  */
 StriContainerUStringSearch::~StriContainerUStringSearch()
+{
+   disposeLastMatcher();
+   col = NULL;
+   // col is owned by the caller
+}
+
+
+/** return the current matcher to the pool (or close it, if transient) */
+void StriContainerUStringSearch::disposeLastMatcher()
 {
    if (lastMatcher) {
-      usearch_close(lastMatcher);
+      if (lastMatcherPooled)
+         stri__usearch_pool_release(lastMatcher);
+      else
+         usearch_close(lastMatcher);
       lastMatcher = NULL;
+      lastMatcherPooled = false;
    }
-   col = NULL;
-   // col is owned by the caller
 }
 
 
@@ -135,16 +333,33 @@ UStringSearch* StriContainerUStringSearch::getMatcher(R_len_t i, const UChar* se
 {
    if (!lastMatcher) {
       this->lastMatcherIndex = (i % n);
-      UErrorCode status = U_ZERO_ERROR;
-      lastMatcher = usearch_openFromCollator(this->get(i).getBuffer(), this->get(i).length(),
-            searchStr, searchStr_len, col, NULL, &status);
-      STRI__CHECKICUSTATUS_THROW(status, {usearch_close(lastMatcher); lastMatcher = NULL;})
-      return lastMatcher;
+      lastMatcher = stri__usearch_pool_acquire(this->get(i), col);
+      lastMatcherPooled = (lastMatcher != NULL);
+      if (!lastMatcher) { // pool unavailable - open a transient matcher
+         UErrorCode status = U_ZERO_ERROR;
+         lastMatcher = usearch_openFromCollator(this->get(i).getBuffer(), this->get(i).length(),
+               searchStr, searchStr_len, col, NULL, &status);
+         STRI__CHECKICUSTATUS_THROW(status, {usearch_close(lastMatcher); lastMatcher = NULL;})
+         return lastMatcher;
+      }
    }
-
-   if (this->lastMatcherIndex == (i % n)) {
+   else if (this->lastMatcherIndex == (i % n)) {
       // do nothing => matcher reuse
    }
+   else if (lastMatcherPooled) {
+      // never mutate a pooled matcher's pattern - swap it for another one
+      this->lastMatcherIndex = (i % n);
+      stri__usearch_pool_release(lastMatcher);
+      lastMatcher = stri__usearch_pool_acquire(this->get(i), col);
+      lastMatcherPooled = (lastMatcher != NULL);
+      if (!lastMatcher) {
+         UErrorCode status = U_ZERO_ERROR;
+         lastMatcher = usearch_openFromCollator(this->get(i).getBuffer(), this->get(i).length(),
+               searchStr, searchStr_len, col, NULL, &status);
+         STRI__CHECKICUSTATUS_THROW(status, {usearch_close(lastMatcher); lastMatcher = NULL;})
+         return lastMatcher;
+      }
+   }
    else {
       this->lastMatcherIndex = (i % n);
       UErrorCode status = U_ZERO_ERROR;
@@ -154,7 +369,11 @@ UStringSearch* StriContainerUStringSearch::getMatcher(R_len_t i, const UChar* se
 
    UErrorCode status = U_ZERO_ERROR;
    usearch_setText(lastMatcher, searchStr, searchStr_len, &status);
-   STRI__CHECKICUSTATUS_THROW(status, {usearch_close(lastMatcher); lastMatcher = NULL;})
+   STRI__CHECKICUSTATUS_THROW(status, {
+      if (lastMatcherPooled) stri__usearch_pool_discard(lastMatcher);
+      else usearch_close(lastMatcher);
+      lastMatcher = NULL; lastMatcherPooled = false;
+   })
 
    return lastMatcher;
 }
@@ -55,6 +55,9 @@
  *
  * @version 1.3.1 (Marek Gagolewski, 2019-02-06)
  *          #337: warn on empty search pattern here
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          opened UStringSearch objects are pooled across calls
  */
 class StriContainerUStringSearch : public StriContainerUTF16 {
 
@@ -62,8 +65,11 @@ class StriContainerUStringSearch : public StriContainerUTF16 {
 
       UCollator* col; ///< collator, owned by creator
       UStringSearch* lastMatcher; ///< recently used \code{UStringSearch}
+      bool lastMatcherPooled; ///< is \code{lastMatcher} on loan from the pool?
       R_len_t lastMatcherIndex;  ///< used by vectorize_getMatcher
 
+      void disposeLastMatcher();
+
 
    public:
 
@@ -31,6 +31,7 @@
 
 
 #include "stri_stringi.h"
+#include "stri_perfstats.h"
 #include "stri_container_utf16.h"
 #include "stri_string8buf.h"
 #include "stri_ucnv.h"
@@ -44,6 +45,12 @@ StriContainerUTF16::StriContainerUTF16()
    : StriContainerBase()
 {
    this->str = NULL;
+   this->lazyconv = false;
+   this->materialized = NULL;
+   this->m_ucnvASCII = NULL;
+   this->m_ucnvLatin1 = NULL;
+   this->m_ucnvNative = NULL;
+   this->dupidx = NULL;
 }
 
 
@@ -56,6 +63,12 @@ StriContainerUTF16::StriContainerUTF16()
 StriContainerUTF16::StriContainerUTF16(R_len_t _nrecycle)
 {
    this->str = NULL;
+   this->lazyconv = false;
+   this->materialized = NULL;
+   this->m_ucnvASCII = NULL;
+   this->m_ucnvLatin1 = NULL;
+   this->m_ucnvNative = NULL;
+   this->dupidx = NULL;
    this->init_Base(_nrecycle, _nrecycle, false);
    if (this->n > 0) {
       this->str = new UnicodeString[this->n];
@@ -73,22 +86,55 @@ StriContainerUTF16::StriContainerUTF16(R_len_t _nrecycle)
  *
  * @version 1.0.6 (Marek Gagolewski, 2017-05-25)
  *    #270 latin-1 is windows-1252 on Windows
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    read-only containers convert elements on first access
  */
 StriContainerUTF16::StriContainerUTF16(SEXP rstr, R_len_t _nrecycle, bool _shallowrecycle)
 {
+   STRI__PERFSTATS_SCOPE(container)
+
    this->str = NULL;
+   this->lazyconv = false;
+   this->materialized = NULL;
+   this->m_ucnvASCII = NULL;
+   this->m_ucnvLatin1 = NULL;
+   this->m_ucnvNative = NULL;
+   this->dupidx = NULL;
 #ifndef NDEBUG
    if (!isString(rstr))
       throw StriException("DEBUG: !isString in StriContainerUTF16::StriContainerUTF16(SEXP rstr)");
 #endif
    R_len_t nrstr = LENGTH(rstr);
-   this->init_Base(nrstr, _nrecycle, _shallowrecycle); // calling LENGTH(rstr) fails on constructor call
+   this->init_Base(nrstr, _nrecycle, _shallowrecycle, rstr); // calling LENGTH(rstr) fails on constructor call
 
    if (this->n == 0)
       return; /* nothing more to do */
 
    this->str = new UnicodeString[this->n];
    if (!this->str) throw StriException(MSG__MEM_ALLOC_ERROR);
+   STRI__MEMSTATS_ADD(container, this->n*sizeof(UnicodeString))
+
+   if (_shallowrecycle) {
+      // a read-only container: mark the NAs, reject "bytes" marks right
+      // away, and leave everything else to be converted on first get()
+      this->lazyconv = true;
+      this->materialized = new char[this->n];
+      if (!this->materialized) throw StriException(MSG__MEM_ALLOC_ERROR);
+      for (R_len_t i=0; i<nrstr; ++i) {
+         SEXP curs = STRING_ELT(rstr, i);
+         if (curs == NA_STRING) {
+            this->str[i].setToBogus();
+            this->materialized[i] = 1;
+         }
+         else if (IS_BYTES(curs))
+            throw StriException(MSG__BYTESENC);
+         else
+            this->materialized[i] = 0;
+      }
+      return;
+   }
+
    for (R_len_t i=0; i<this->n; ++i)
       this->str[i].setToBogus(); // in case it fails during conversion (this is NA)
 
@@ -111,6 +157,30 @@ StriContainerUTF16::StriContainerUTF16(SEXP rstr, R_len_t _nrecycle, bool _shall
          continue; // keep NA
       }
 
+      this->convertOne(i, curs, ucnvASCII, ucnvLatin1, ucnvNative);
+   }
+
+   if (!_shallowrecycle) {
+      for (R_len_t i=nrstr; i<this->n; ++i) {
+         this->str[i].setTo(str[i%nrstr]);
+      }
+   }
+}
+
+
+/** Convert the i-th element (a non-NA, non-"bytes" CHARSXP) to UTF-16
+ *
+ * @param i element index
+ * @param curs the CHARSXP
+ * @param ucnvASCII, ucnvLatin1, ucnvNative the converters to use
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    extracted from the SEXP constructor; also serves lazy conversion
+ */
+void StriContainerUTF16::convertOne(R_len_t i, SEXP curs,
+   StriUcnv& ucnvASCII, StriUcnv& ucnvLatin1, StriUcnv& ucnvNative) const
+{
+   {
       if (IS_ASCII(curs)) {
          // Version 1:
          UConverter* ucnv = ucnvASCII.getConverter();
@@ -171,12 +241,67 @@ StriContainerUTF16::StriContainerUTF16(SEXP rstr, R_len_t _nrecycle, bool _shall
          }
       }
    }
+}
 
-   if (!_shallowrecycle) {
-      for (R_len_t i=nrstr; i<this->n; ++i) {
-         this->str[i].setTo(str[i%nrstr]);
-      }
+
+/** Convert a not-yet-materialized element of a lazy container [internal]
+ *
+ * @param j element index, 0 <= j < n, materialized[j] == 0
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void StriContainerUTF16::materializeOne(R_len_t j) const
+{
+   if (!m_ucnvASCII) {
+      // shared by all lazily-converted elements of this container
+      m_ucnvASCII  = new StriUcnv("US-ASCII");
+#if defined(_WIN32) || defined(_WIN64)
+      // #270: latin-1 is windows-1252 on Windows
+      m_ucnvLatin1 = new StriUcnv("WINDOWS-1252");
+#else
+      m_ucnvLatin1 = new StriUcnv("ISO-8859-1");
+#endif
+      m_ucnvNative = new StriUcnv(NULL);
+      if (!m_ucnvASCII || !m_ucnvLatin1 || !m_ucnvNative)
+         throw StriException(MSG__MEM_ALLOC_ERROR);
    }
+
+   this->convertOne(j, STRING_ELT(sexp, j),
+      *m_ucnvASCII, *m_ucnvLatin1, *m_ucnvNative);
+   this->materialized[j] = 1;
+}
+
+
+/** Convert all the not-yet-materialized elements [internal]
+ *
+ * To be called before a full scan and, most importantly, before any
+ * worker thread may touch the container - materialization is not
+ * thread-safe.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void StriContainerUTF16::materializeAll() const
+{
+   if (!lazyconv) return;
+   for (R_len_t j=0; j<n; ++j)
+      if (!materialized[j])
+         materializeOne(j);
+}
+
+
+/** Build an opt-in duplicate-input index
+ *
+ * See StriContainerUTF8::buildDuplicateIndex - the very same
+ * pointer-identity hashing of the backing CHARSXPs, so loops over
+ * UTF-16 elements may also reuse the result computed for the first
+ * identical input (getDuplicateOf).
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void StriContainerUTF16::buildDuplicateIndex()
+{
+   if (dupidx) return;
+   dupidx = stri__duplicate_index(sexp, n); // NULL if nothing to share
 }
 
 
@@ -187,6 +312,13 @@ StriContainerUTF16::StriContainerUTF16(SEXP rstr, R_len_t _nrecycle, bool _shall
 StriContainerUTF16::StriContainerUTF16(StriContainerUTF16& container)
    :    StriContainerBase((StriContainerBase&)container)
 {
+   container.materializeAll(); // the copy is eager
+   this->lazyconv = false;
+   this->materialized = NULL;
+   this->m_ucnvASCII = NULL;
+   this->m_ucnvLatin1 = NULL;
+   this->m_ucnvNative = NULL;
+   this->dupidx = NULL;
    if (container.str) {
       this->str = new UnicodeString[this->n];
       if (!this->str) throw StriException(MSG__MEM_ALLOC_ERROR);
@@ -209,6 +341,13 @@ StriContainerUTF16& StriContainerUTF16::operator=(StriContainerUTF16& container)
    this->~StriContainerUTF16();
    (StriContainerBase&) (*this) = (StriContainerBase&)container;
 
+   container.materializeAll(); // the copy is eager
+   this->lazyconv = false;
+   this->materialized = NULL;
+   this->m_ucnvASCII = NULL;
+   this->m_ucnvLatin1 = NULL;
+   this->m_ucnvNative = NULL;
+   this->dupidx = NULL;
    if (container.str) {
       this->str = new UnicodeString[this->n];
       if (!this->str) throw StriException(MSG__MEM_ALLOC_ERROR);
@@ -232,6 +371,18 @@ StriContainerUTF16::~StriContainerUTF16()
       delete [] str;
       str = NULL;
    }
+   if (materialized) {
+      delete [] materialized;
+      materialized = NULL;
+   }
+   if (m_ucnvASCII)  { delete m_ucnvASCII;  m_ucnvASCII  = NULL; }
+   if (m_ucnvLatin1) { delete m_ucnvLatin1; m_ucnvLatin1 = NULL; }
+   if (m_ucnvNative) { delete m_ucnvNative; m_ucnvNative = NULL; }
+   if (dupidx) {
+      delete [] dupidx;
+      dupidx = NULL;
+   }
+   lazyconv = false;
 }
 
 
@@ -250,10 +401,13 @@ StriContainerUTF16::~StriContainerUTF16()
  */
 SEXP StriContainerUTF16::toR() const
 {
+   STRI__PERFSTATS_SCOPE(materialize)
+
+   this->materializeAll(); // a full scan anyway
    R_len_t outbufsize = 0;
    for (R_len_t i=0; i<nrecycle; ++i) {
-      if (!str[i%n].isBogus()) {
-         R_len_t thissize = str[i%n].length();
+      if (!str[recycled_index(i)].isBogus()) {
+         R_len_t thissize = str[recycled_index(i)].length();
          if (thissize > outbufsize)
             outbufsize = thissize;
       }
@@ -268,12 +422,12 @@ SEXP StriContainerUTF16::toR() const
 
    UErrorCode status = U_ZERO_ERROR;
    for (R_len_t i=0; i<nrecycle; ++i) {
-      if (str[i%n].isBogus())
+      if (str[recycled_index(i)].isBogus())
          SET_STRING_ELT(ret, i, NA_STRING);
       else {
          int outrealsize = 0;
          u_strToUTF8(outbuf.data(), outbufsize, &outrealsize,
-            str[i%n].getBuffer(), str[i%n].length(), &status);
+            str[recycled_index(i)].getBuffer(), str[recycled_index(i)].length(), &status);
          STRI__CHECKICUSTATUS_THROW(status, {UNPROTECT(1);})
          SET_STRING_ELT(ret, i,
             Rf_mkCharLenCE(outbuf.data(), outrealsize, (cetype_t)CE_UTF8));
@@ -299,11 +453,13 @@ SEXP StriContainerUTF16::toR(R_len_t i) const
       throw StriException("StriContainerUTF16::toR(): INDEX OUT OF BOUNDS");
 #endif
 
-   if (str[i%n].isBogus())
+   if (str[recycled_index(i)].isBogus())
       return NA_STRING;
    else {
+      if (lazyconv && !materialized[recycled_index(i)])
+         materializeOne(recycled_index(i));
       std::string s;
-      str[i%n].toUTF8String(s);
+      str[recycled_index(i)].toUTF8String(s);
       return Rf_mkCharLenCE(s.c_str(), (int)s.length(), (cetype_t)CE_UTF8);
    }
 }
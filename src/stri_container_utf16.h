@@ -35,6 +35,8 @@
 
 #include "stri_container_base.h"
 
+class StriUcnv;
+
 /**
  * A class to handle conversion between R character vectors
  * and UTF-16 string vectors
@@ -55,12 +57,28 @@
  *          UnicodeString::fromUTF8 (for speedup);
  *          str now is UnicodeString*, and not UnicodeString**;
  *          using UnicodeString::isBogus to represent NA
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          read-only (shallow) containers convert elements on first
+ *          get() - early-exiting and subsetting callers no longer pay
+ *          for data they never read
  */
 class StriContainerUTF16 : public StriContainerBase {
 
    protected:
 
-      UnicodeString* str;       ///< data - \code{UnicodeString}s
+      mutable UnicodeString* str; ///< data - \code{UnicodeString}s
+
+      bool lazyconv;              ///< convert elements on first access?
+      mutable char* materialized; ///< lazy mode: which elements are ready
+      mutable StriUcnv* m_ucnvASCII;  ///< lazy mode converters (on demand)
+      mutable StriUcnv* m_ucnvLatin1;
+      mutable StriUcnv* m_ucnvNative;
+      R_len_t* dupidx;            ///< duplicate-input index or NULL, see buildDuplicateIndex()
+
+      void convertOne(R_len_t i, SEXP curs, StriUcnv& ucnvASCII,
+         StriUcnv& ucnvLatin1, StriUcnv& ucnvNative) const;
+      void materializeOne(R_len_t j) const;
 
 
    public:
@@ -73,6 +91,20 @@ class StriContainerUTF16 : public StriContainerBase {
       StriContainerUTF16& operator=(StriContainerUTF16& container);
       SEXP toR(R_len_t i) const;
       SEXP toR() const;
+      void materializeAll() const;
+      void buildDuplicateIndex();
+
+
+      /** index of the first element identical to the vectorized i-th one
+       *
+       * Always <= i%n; equal to i%n unless buildDuplicateIndex() has
+       * been called and an earlier duplicate exists. Loops that process
+       * elements in ascending order may reuse the result computed at
+       * the returned position. */
+      inline R_len_t getDuplicateOf(R_len_t i) const {
+         R_len_t j = recycled_index(i);
+         return (dupidx)?dupidx[j]:j;
+      }
 
 
       /** check if the vectorized ith element is NA
@@ -86,7 +118,7 @@ class StriContainerUTF16 : public StriContainerBase {
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerUTF16::isNA(): INDEX OUT OF BOUNDS");
 #endif
-         return str[i%n].isBogus();
+         return str[recycled_index(i)].isBogus();
       }
 
 
@@ -99,7 +131,10 @@ class StriContainerUTF16 : public StriContainerBase {
          if (isNA(i))
             throw StriException("StriContainerUTF16::get(): isNA");
 #endif
-         return str[i%n];
+         R_len_t j = recycled_index(i);
+         if (lazyconv && !materialized[j])
+            materializeOne(j);
+         return str[j];
       }
 
       /** get the vectorized ith element
@@ -117,7 +152,7 @@ class StriContainerUTF16 : public StriContainerBase {
          if (isNA(i))
             throw StriException("StriContainerUTF16::getWritable(): isNA");
 #endif
-         return str[i%n]; // in fact, "%n" is not necessary
+         return str[recycled_index(i)]; // in fact, i is always < n here
       }
 
 
@@ -133,7 +168,7 @@ class StriContainerUTF16 : public StriContainerBase {
          if (i < 0 || i >= n)
             throw StriException("StriContainerUTF16::getWritable(): INDEX OUT OF BOUNDS");
 #endif
-         str[i%n].setToBogus();
+         str[recycled_index(i)].setToBogus();
       }
 
       /** set the vectorized ith element
@@ -148,10 +183,10 @@ class StriContainerUTF16 : public StriContainerBase {
             throw StriException("StriContainerUTF16::set(): n!=nrecycle");
          if (i < 0 || i >= n)
             throw StriException("StriContainerUTF16::set(): INDEX OUT OF BOUNDS");
-         if (str[i%n].isBogus())
+         if (str[recycled_index(i)].isBogus())
             throw StriException("StriContainerUTF16::set(): isNA");
 #endif
-         str[i%n].setTo(s); // in fact, "%n" is not necessary
+         str[recycled_index(i)].setTo(s); // in fact, i is always < n here
       }
 
       // @QUESTION: separate StriContainerUTF16_indexable?
@@ -31,6 +31,7 @@
 
 
 #include "stri_stringi.h"
+#include "stri_perfstats.h"
 #include "stri_container_utf8.h"
 #include "stri_ucnv.h"
 #include "stri_string8buf.h"
@@ -43,6 +44,65 @@ StriContainerUTF8::StriContainerUTF8()
    : StriContainerBase()
 {
    str = NULL;
+   refcount = NULL;
+   dupidx = NULL;
+   na_mask = NULL;
+   na_count = 0;
+   all_ascii = false;
+   arena_last = NULL;
+   arena_cur = NULL;
+   arena_avail = 0;
+}
+
+
+// re-encoded elements are appended to blocks of (at least) this many bytes
+#define STRI__ARENA_BLOCK_SIZE 65536
+
+
+/** [internal] claim size bytes of arena storage
+ *
+ * A bump-pointer append; a fresh block is chained in when the current
+ * one is too small. The returned buffer stays valid until the container
+ * is destroyed.
+ *
+ * @param size number of bytes, incl. the terminating NUL
+ * @return uninitialized buffer of size bytes
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+char* StriContainerUTF8::arenaAllocate(R_len_t size)
+{
+   if ((size_t)size > arena_avail) {
+      size_t blocksize = ((size_t)size > (size_t)STRI__ARENA_BLOCK_SIZE)?
+         (size_t)size:(size_t)STRI__ARENA_BLOCK_SIZE;
+      char* block = new char[sizeof(char*)+blocksize];
+      if (!block) throw StriException(MSG__MEM_ALLOC_ERROR);
+      STRI__MEMSTATS_ADD(arena, sizeof(char*)+blocksize)
+      *((char**)block) = arena_last; // chain
+      arena_last = block;
+      arena_cur = block+sizeof(char*);
+      arena_avail = blocksize;
+   }
+   char* ret = arena_cur;
+   arena_cur += size;
+   arena_avail -= (size_t)size;
+   return ret;
+}
+
+
+/** [internal] release all the arena blocks
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void StriContainerUTF8::arenaFree()
+{
+   while (arena_last) {
+      char* prev = *((char**)arena_last);
+      delete [] arena_last;
+      arena_last = prev;
+   }
+   arena_cur = NULL;
+   arena_avail = 0;
 }
 
 
@@ -55,15 +115,52 @@ StriContainerUTF8::StriContainerUTF8()
  *
  * @version 1.0.6 (Marek Gagolewski, 2017-05-25)
  *    #270 latin-1 is windows-1252 on Windows
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    build the NA bitmask, see nextNA()/nextNonNA()
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    honour a corpus-stats record, see stri_prepared(deep=FALSE):
+ *    known-ASCII/UTF-8 input takes a no-dispatch kernel, known-no-NA
+ *    input skips the NA-bitmask pass
  */
 StriContainerUTF8::StriContainerUTF8(SEXP rstr, R_len_t _nrecycle, bool _shallowrecycle)
 {
+   STRI__PERFSTATS_SCOPE(container)
+
    this->str = NULL;
+   this->refcount = NULL;
+   this->dupidx = NULL;
+   this->na_mask = NULL;
+   this->na_count = 0;
+   this->all_ascii = false;
+   this->arena_last = NULL;
+   this->arena_cur = NULL;
+   this->arena_avail = 0;
 
 #ifndef NDEBUG
    if (!isString(rstr))
       throw StriException("DEBUG: !isString in StriContainerUTF8::StriContainerUTF8(SEXP rstr)");
 #endif
+
+   unsigned corpus_flags = 0;
+   if (_nrecycle > 0) {
+      // an immutable vector prepared with stri_prepared() already carries
+      // a validated, converted payload - share it (copy-on-write) instead
+      // of re-checking and re-encoding every element
+      if (_shallowrecycle) {
+         const StriContainerUTF8* prep = stri__prepared_from_attrib(rstr);
+         if (prep) {
+            *this = *const_cast<StriContainerUTF8*>(prep);
+            this->set_nrecycle(_nrecycle);
+            return;
+         }
+      }
+      // otherwise, a compact stats record may still settle the
+      // per-element questions for the whole vector up front
+      corpus_flags = stri__corpus_stats_from_attrib(rstr);
+   }
+
    R_len_t nrstr = LENGTH(rstr);
    this->init_Base(nrstr, _nrecycle, _shallowrecycle, rstr); // calling LENGTH(rstr) fails on constructor call
 
@@ -73,6 +170,27 @@ StriContainerUTF8::StriContainerUTF8(SEXP rstr, R_len_t _nrecycle, bool _shallow
 
    this->str = new String8[this->n];
    if (!this->str) throw StriException(MSG__MEM_ALLOC_ERROR);
+   STRI__MEMSTATS_ADD(container, this->n*sizeof(String8))
+   this->refcount = new int(1);
+   if (!this->refcount) throw StriException(MSG__MEM_ALLOC_ERROR);
+
+   // vector known to hold no NAs and only ASCII/UTF-8 content:
+   // no per-element encoding dispatch, no NA test, no bitmask pass
+   if ((corpus_flags & STRI__CORPUS_NO_NA) &&
+         (corpus_flags & (STRI__CORPUS_ALL_ASCII | STRI__CORPUS_ALL_UTF8))) {
+      bool is_ascii = (corpus_flags & STRI__CORPUS_ALL_ASCII) != 0;
+      for (R_len_t i=0; i<nrstr; ++i) {
+         SEXP curs = STRING_ELT(rstr, i);
+         this->str[i].initialize(CHAR(curs), LENGTH(curs),
+            false/*!_shallowrecycle*/, !is_ascii/*killbom*/, is_ascii/*isASCII*/);
+      }
+      if (!_shallowrecycle) {
+         for (R_len_t i=nrstr; i<this->n; ++i)
+            this->str[i] = str[i%nrstr];
+      }
+      this->all_ascii = is_ascii;
+      return; // na_count == 0; hasNA()/nextNA() need no mask at all
+   }
 
    /* Important: ICU provides full internationalization functionality
    without any conversion table data. The common library contains
@@ -92,6 +210,7 @@ StriContainerUTF8::StriContainerUTF8(SEXP rstr, R_len_t _nrecycle, bool _shallow
 //      UChar* tmpbuf = NULL;
 
 
+   bool track_ascii = true; // falsified below; NAs do not count
    for (R_len_t i=0; i<nrstr; ++i) {
       SEXP curs = STRING_ELT(rstr, i);
       if (curs == NA_STRING) {
@@ -104,6 +223,7 @@ StriContainerUTF8::StriContainerUTF8(SEXP rstr, R_len_t _nrecycle, bool _shallow
       }
       else if (IS_UTF8(curs)) {
          // UTF-8 - ultra fast
+         track_ascii = false;
          this->str[i].initialize(CHAR(curs), LENGTH(curs), false/*!_shallowrecycle*/, true/*killbom*/, false/*isASCII*/);
          // the same is done for native encoding && ucnvNative_isUTF8
          // @TODO: use macro (here & ucnvNative_isUTF8 below)
@@ -115,6 +235,7 @@ StriContainerUTF8::StriContainerUTF8(SEXP rstr, R_len_t _nrecycle, bool _shallow
       }
       else {
 //             LATIN1 ------- OR ------ Native encoding
+         track_ascii = false;
 
          UConverter* ucnvCurrent;
          if (IS_LATIN1(curs)) {
@@ -194,7 +315,12 @@ StriContainerUTF8::StriContainerUTF8(SEXP rstr, R_len_t _nrecycle, bool _shallow
                tmp.getBuffer(), tmp.length(), &status);
          STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
 
-         this->str[i].initialize(outbuf.data(), outrealsize, true/*memalloc*/, false/*killbom*/, false/*isASCII*/);
+         // append to the arena - no per-element heap allocation
+         char* dest = this->arenaAllocate(outrealsize+1);
+         memcpy(dest, outbuf.data(), (size_t)outrealsize);
+         dest[outrealsize] = '\0';
+         this->str[i].initialize(dest, outrealsize, false/*borrowed from the arena*/,
+            false/*killbom*/, false/*isASCII*/, false/*!fromSexp*/);
 
          // version 3: use tmpbuf (slower than v2)
 //               UErrorCode status = U_ZERO_ERROR;
@@ -220,54 +346,144 @@ StriContainerUTF8::StriContainerUTF8(SEXP rstr, R_len_t _nrecycle, bool _shallow
             this->str[i] = str[i%nrstr];
       }
    }
+
+   this->all_ascii = track_ascii;
+
+   if (corpus_flags & STRI__CORPUS_NO_NA)
+      return; // na_count == 0; hasNA()/nextNA() need no mask at all
+
+   // the NA bitmask: one scan here lets every later loop skip whole
+   // 64-element words of non-NA (or all-NA) entries, see nextNA()
+   R_len_t nwords = (this->n+63)/64;
+   this->na_mask = new uint64_t[nwords];
+   if (!this->na_mask) throw StriException(MSG__MEM_ALLOC_ERROR);
+   for (R_len_t w=0; w<nwords; ++w)
+      this->na_mask[w] = 0;
+   for (R_len_t i=0; i<this->n; ++i)
+      if (this->str[i].isNA()) {
+         this->na_mask[i>>6] |= (UINT64_C(1) << (i&63));
+         ++this->na_count;
+      }
 }
 
 
+/** Copy constructor - O(1), the payload is shared (copy-on-write) */
 StriContainerUTF8::StriContainerUTF8(StriContainerUTF8& container)
    :    StriContainerBase((StriContainerBase&)container)
 {
-   if (container.str) {
-      this->str = new String8[this->n];
-      if (!this->str) throw StriException(MSG__MEM_ALLOC_ERROR);
-      for (int i=0; i<this->n; ++i) {
-         this->str[i] = container.str[i];
-      }
-   }
-   else {
-      this->str = NULL;
-   }
+   this->str = container.str;
+   this->refcount = container.refcount;
+   this->dupidx = NULL; // rebuild on demand
+   this->na_mask = NULL; // unknown - helpers degrade to plain scans
+   this->na_count = -1;
+   this->all_ascii = container.all_ascii; // the payload is shared
+   this->arena_last = container.arena_last;
+   this->arena_cur = container.arena_cur;
+   this->arena_avail = container.arena_avail;
+   if (this->refcount)
+      ++(*this->refcount);
 }
 
 
 StriContainerUTF8& StriContainerUTF8::operator=(StriContainerUTF8& container)
 {
+   if (this == &container) return *this;
    this->~StriContainerUTF8();
    (StriContainerBase&) (*this) = (StriContainerBase&)container;
 
-   if (container.str) {
-      this->str = new String8[this->n];
-      if (!this->str) throw StriException(MSG__MEM_ALLOC_ERROR);
-      for (int i=0; i<this->n; ++i) {
-         this->str[i] = container.str[i];
-      }
-   }
-   else {
-      this->str = NULL;
-   }
+   this->str = container.str;
+   this->refcount = container.refcount;
+   this->dupidx = NULL; // rebuild on demand
+   this->na_mask = NULL; // unknown - helpers degrade to plain scans
+   this->na_count = -1;
+   this->all_ascii = container.all_ascii; // the payload is shared
+   this->arena_last = container.arena_last;
+   this->arena_cur = container.arena_cur;
+   this->arena_avail = container.arena_avail;
+   if (this->refcount)
+      ++(*this->refcount);
    return *this;
 }
 
 
 StriContainerUTF8::~StriContainerUTF8()
 {
+   if (dupidx) {
+      delete [] dupidx;
+      dupidx = NULL;
+   }
+   if (na_mask) {
+      delete [] na_mask;
+      na_mask = NULL;
+   }
    if (str) {
-//      for (int i=0; i<n; ++i) {
-//         if (str[i])
-//            delete str[i];
-//      }
+      if (--(*refcount) > 0) {
+         // other containers still share this payload
+         str = NULL;
+         refcount = NULL;
+         arena_last = NULL;
+         arena_cur = NULL;
+         arena_avail = 0;
+         return;
+      }
+      delete refcount;
+      refcount = NULL;
       delete [] str;
       str = NULL;
    }
+   arenaFree();
+}
+
+
+/** Build the duplicate-input index (opt-in)
+ *
+ * Categorical-like inputs (many elements, few unique values) make
+ * vectorized functions recompute the same answer over and over. R
+ * interns CHARSXPs in a global cache, so two identical strings in a
+ * character vector are the very same pointer - duplicates can be
+ * spotted by hashing pointers, without touching the bytes. After this
+ * call, getDuplicateOf(i) names the first element identical to the
+ * i-th one, and a loop may scatter the result computed there instead
+ * of recomputing it.
+ *
+ * A no-op for containers not backed by a SEXP; if no duplicates are
+ * found, the index is dropped right away (getDuplicateOf then keeps
+ * returning i%n).
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void StriContainerUTF8::buildDuplicateIndex()
+{
+   if (dupidx) return;
+   dupidx = stri__duplicate_index(sexp, n); // NULL if nothing to share
+}
+
+
+/** [internal] give this container a payload of its own (copy-on-write)
+ *
+ * Called before any mutation of a payload shared with another
+ * container: the String8 array is deep-copied (String8's copy
+ * semantics make arena-backed strings self-contained, see the copy
+ * path notes there), so the arena stays with the other owners.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void StriContainerUTF8::unshare()
+{
+   String8* new_str = new String8[this->n];
+   if (!new_str) throw StriException(MSG__MEM_ALLOC_ERROR);
+   STRI__MEMSTATS_ADD(container, this->n*sizeof(String8))
+   int* new_refcount = new int(1);
+   if (!new_refcount) { delete [] new_str; throw StriException(MSG__MEM_ALLOC_ERROR); }
+   for (int i=0; i<this->n; ++i)
+      new_str[i] = this->str[i];
+
+   --(*this->refcount); // someone else keeps the old payload (and arena)
+   this->str = new_str;
+   this->refcount = new_refcount;
+   this->arena_last = NULL;
+   this->arena_cur = NULL;
+   this->arena_avail = 0;
 }
 
 
@@ -286,14 +502,39 @@ StriContainerUTF8::~StriContainerUTF8()
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-02)
  *    call toR(int)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    single batched pass: each distinct element is materialized once
+ *    and shared by all its recycled positions
  */
 SEXP StriContainerUTF8::toR() const
 {
+   STRI__PERFSTATS_SCOPE(materialize)
+
    SEXP ret;
    PROTECT(ret = Rf_allocVector(STRSXP, nrecycle));
 
-   for (R_len_t i=0; i<nrecycle; ++i) {
-      SET_STRING_ELT(ret, i, this->toR(i));
+   for (R_len_t j=0; j<n && j<nrecycle; ++j) {
+      String8* curs = &(str[j]);
+      SEXP cur;
+      if (curs->isNA()) {
+         cur = NA_STRING;
+      }
+      else if (curs->isReadOnly() && curs->isFromSexp()) {
+         // a shallow copy of the input, so surely in ASCII or UTF-8
+         // and without BOMs (see the SEXP-constructor) -
+         // reuse the input CHARSXP, no string-cache lookup at all
+         cur = STRING_ELT(sexp, j);
+      }
+      else {
+         // This is already in UTF-8
+         cur = Rf_mkCharLenCE(curs->c_str(), curs->length(), CE_UTF8);
+      }
+      // no per-element PROTECT: `cur` is anchored in `ret` right away
+      SET_STRING_ELT(ret, j, cur);
+      // recycled positions share the CHARSXP made for position j
+      for (R_len_t i=j+n; i<nrecycle; i+=n)
+         SET_STRING_ELT(ret, i, cur);
    }
 
    UNPROTECT(1);
@@ -319,16 +560,56 @@ SEXP StriContainerUTF8::toR(R_len_t i) const
       throw StriException("StriContainerUTF8::toR(): INDEX OUT OF BOUNDS");
 #endif
 
-   String8* curs = &(str[i%n]);
+   String8* curs = &(str[recycled_index(i)]);
    if (curs->isNA()) {
       return NA_STRING;
    }
-   else if (curs->isReadOnly()) {
-      // if ReadOnly, then surely in ASCII or UTF-8 and without BOMS (see SEXP-constructor)
-      return STRING_ELT(sexp, i%n);
+   else if (curs->isReadOnly() && curs->isFromSexp()) {
+      // a shallow copy of the input, so surely in ASCII or UTF-8
+      // and without BOMs (see the SEXP-constructor)
+      return STRING_ELT(sexp, recycled_index(i));
    }
    else {
       // This is already in UTF-8
       return Rf_mkCharLenCE(curs->c_str(), curs->length(), CE_UTF8);
    }
 }
+
+
+/** Export a computed string to R, sharing the input CHARSXP when the
+ *  operation turned out to be a no-op
+ *  THE OUTPUT IS ALWAYS IN UTF-8
+ *
+ * The package-wide convention for operations that rewrite their
+ * input (trim, replace, case mapping, ...): intern the produced
+ * bytes, unless they are identical to the i-th input element's bytes
+ * and that element's CHARSXP can be shared as-is (ASCII/UTF-8,
+ * straight from the input vector) - then no allocation and no
+ * string-cache lookup happen at all. No-op-heavy workloads are the
+ * common case for such operations.
+ *
+ * An equal-length memcmp is the only extra cost, and only the
+ * byte-identical outputs pay the full one.
+ *
+ * @param i index [with recycle]
+ * @param s the produced bytes (UTF-8)
+ * @param n number of bytes
+ * @return CHARSXP
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP StriContainerUTF8::toR(R_len_t i, const char* s, R_len_t n) const
+{
+#ifndef NDEBUG
+   if (i < 0 || i >= nrecycle)
+      throw StriException("StriContainerUTF8::toR(): INDEX OUT OF BOUNDS");
+#endif
+
+   const String8* curs = &(str[recycled_index(i)]);
+   if (!curs->isNA() && curs->isReadOnly() && curs->isFromSexp()
+         && n == curs->length()
+         && (s == curs->c_str() || 0 == memcmp(s, curs->c_str(), (size_t)n)))
+      return STRING_ELT(sexp, recycled_index(i));
+
+   return Rf_mkCharLenCE(s, n, CE_UTF8);
+}
@@ -34,6 +34,9 @@
 #define __stri_container_utf8_h
 
 #include "stri_container_base.h"
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#include <utility> // std::move
+#endif
 
 
 /**
@@ -72,6 +75,18 @@
  * @version 0.3-1 (Marek Gagolewski, 2014-11-02)
  *          New methods: set, getWritable, isNA;
  *          Always try to use shallow copy of char* data in SEXP-based constructor (be lazy)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          Re-encoded elements now live in an arena owned by the
+ *          container (a bump-pointer append per element, one free
+ *          per block) instead of one heap buffer each
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          Copy-on-write: copies share the str/arena payload via a
+ *          reference count; a deep copy happens only on mutation
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          Opt-in duplicate-input index, see buildDuplicateIndex()
  */
 class StriContainerUTF8 : public StriContainerBase {
 
@@ -79,6 +94,45 @@ class StriContainerUTF8 : public StriContainerBase {
 
       String8* str;  ///< data - \code{string}
 
+      /** number of containers sharing \code{str} and the arena
+          (copy-on-write); NULL iff \code{str} is NULL; containers
+          are copied on the main R thread only, so a plain int works */
+      int* refcount;
+
+      /** last arena block or NULL; the first sizeof(char*) bytes
+          of each block point to the previous one */
+      char* arena_last;
+      char* arena_cur;     ///< append position within the last block
+      size_t arena_avail;  ///< bytes left in the last block
+
+      char* arenaAllocate(R_len_t size);
+      void arenaFree();
+      void unshare();
+
+      R_len_t* dupidx; ///< duplicate-input index or NULL, see buildDuplicateIndex()
+
+      /** NA bitmask (bit set == NA) over the data indices [0, n), or
+          NULL; built by the SEXP constructor, dropped (conservatively)
+          by any mutator, never shared between containers */
+      uint64_t* na_mask;
+      R_len_t na_count; ///< number of NA elements; -1 == unknown
+
+      /** every non-NA element is pure ASCII; established by the SEXP
+          constructor (or taken from a corpus-stats record), dropped
+          (conservatively) by any mutator */
+      bool all_ascii;
+
+      /** any mutation invalidates the mask and the corpus-level
+          claims - correctness first */
+      inline void dropNAMask() {
+         if (na_mask) {
+            delete [] na_mask;
+            na_mask = NULL;
+         }
+         na_count = -1;
+         all_ascii = false;
+      }
+
 
    public:
 
@@ -88,7 +142,25 @@ class StriContainerUTF8 : public StriContainerBase {
       ~StriContainerUTF8();
       StriContainerUTF8& operator=(StriContainerUTF8& container);
       SEXP toR(R_len_t i) const;
+      SEXP toR(R_len_t i, const char* s, R_len_t n) const;
       SEXP toR() const;
+      void buildDuplicateIndex();
+
+
+      /** index of the first element identical to the vectorized i-th one
+       *
+       * Always <= i%n; equal to i%n unless buildDuplicateIndex() has
+       * been called and an earlier duplicate exists. Loops that process
+       * elements in increasing index order may thus reuse the result
+       * computed for the returned index.
+       *
+       * @param i index [with recycle]
+       * @version 1.4.6 (2020-01-24)
+       */
+      inline R_len_t getDuplicateOf(R_len_t i) const {
+         R_len_t j = recycled_index(i);
+         return (dupidx)?dupidx[j]:j;
+      }
 
 
       /** check if the vectorized ith element is NA
@@ -100,7 +172,7 @@ class StriContainerUTF8 : public StriContainerBase {
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerUTF8::isNA(): INDEX OUT OF BOUNDS");
 #endif
-         return (str[i%n].isNA());
+         return (str[recycled_index(i)].isNA());
       }
 
 
@@ -112,10 +184,10 @@ class StriContainerUTF8 : public StriContainerBase {
 #ifndef NDEBUG
          if (i < 0 || i >= nrecycle)
             throw StriException("StriContainerUTF8::get(): INDEX OUT OF BOUNDS");
-         if (str[i%n].isNA())
+         if (str[recycled_index(i)].isNA())
             throw StriException("StriContainerUTF8::get(): isNA");
 #endif
-         return str[i%n];
+         return str[recycled_index(i)];
       }
 
 
@@ -124,6 +196,7 @@ class StriContainerUTF8 : public StriContainerBase {
        * @return string
        */
       inline String8& getWritable(R_len_t i) {
+         if (refcount && *refcount > 1) unshare();
 #ifndef NDEBUG
          if (isShallow)
             throw StriException("StriContainerUTF8::getWritable(): shallow StriContainerUTF8");
@@ -133,10 +206,11 @@ class StriContainerUTF8 : public StriContainerBase {
             throw StriException("StriContainerUTF8::getWritable(): INDEX OUT OF BOUNDS");
 //         if (str[i%n].isReadOnly()) // not needed: readOnly here => changes are possible (but not on m_str directly)
 //            throw StriException("StriContainerUTF8::getWritable(): isReadOnly");
-         if (str[i%n].isNA())
+         if (str[recycled_index(i)].isNA())
             throw StriException("StriContainerUTF8::getWritable(): isNA");
 #endif
-         return str[i%n]; // in fact, "%n" is not necessary
+         dropNAMask();
+         return str[recycled_index(i)]; // in fact, i is always < n here
       }
 
 
@@ -144,6 +218,7 @@ class StriContainerUTF8 : public StriContainerBase {
        * @param i index
        */
       inline void setNA(R_len_t i) {
+         if (refcount && *refcount > 1) unshare();
 #ifndef NDEBUG
          if (isShallow)
             throw StriException("StriContainerUTF8::setNA(): shallow StriContainerUTF8");
@@ -152,18 +227,93 @@ class StriContainerUTF8 : public StriContainerBase {
          if (i < 0 || i >= n)
             throw StriException("StriContainerUTF8::setNA(): INDEX OUT OF BOUNDS");
 #endif
-         str[i%n].setNA();
+         dropNAMask();
+         str[recycled_index(i)].setNA();
+      }
+
+
+      /** might any element be NA? false lets loops drop the test */
+      inline bool hasNA() const {
+         return (na_count != 0);
+      }
+
+
+      /** is every non-NA element pure ASCII? true lets a kernel be
+       *  selected once per vector instead of once per element
+       *
+       * @version 1.4.6 (2020-01-24)
+       */
+      inline bool isAllASCII() const {
+         return all_ascii;
+      }
+
+
+      /** first NA at data index >= i (or end); whole 64-element words
+       *  of non-NA entries are skipped without per-element tests
+       *
+       * Data indices only: i, end must be <= n (no recycling). Falls
+       * back to element-wise scanning when the mask has been dropped.
+       *
+       * @version 1.4.6 (2020-01-24)
+       */
+      inline R_len_t nextNA(R_len_t i, R_len_t end) const {
+         if (na_count == 0) return end;
+         if (!na_mask) {
+            while (i < end && !str[i].isNA()) ++i;
+            return i;
+         }
+         while (i < end) {
+            if ((i & 63) == 0) {
+               while (i+64 <= end && na_mask[i>>6] == 0)
+                  i += 64;
+               if (i >= end) break;
+            }
+            if (na_mask[i>>6] & (UINT64_C(1) << (i&63))) return i;
+            ++i;
+         }
+         return end;
+      }
+
+
+      /** first non-NA at data index >= i (or end); whole 64-element
+       *  words of NA entries are skipped without per-element tests
+       *
+       * Data indices only: i, end must be <= n (no recycling). Falls
+       * back to element-wise scanning when the mask has been dropped.
+       *
+       * @version 1.4.6 (2020-01-24)
+       */
+      inline R_len_t nextNonNA(R_len_t i, R_len_t end) const {
+         if (na_count == 0) return i;
+         if (!na_mask) {
+            while (i < end && str[i].isNA()) ++i;
+            return i;
+         }
+         while (i < end) {
+            if ((i & 63) == 0) {
+               while (i+64 <= end && na_mask[i>>6] == ~UINT64_C(0))
+                  i += 64;
+               if (i >= end) break;
+            }
+            if (!(na_mask[i>>6] & (UINT64_C(1) << (i&63)))) return i;
+            ++i;
+         }
+         return end;
       }
 
 
       /** get the number of bytes used to represent the longest string */
       R_len_t getMaxNumBytes() const {
          R_len_t bufsize = 0;
-         for (R_len_t i=0; i<n; ++i) {
-            if (isNA(i)) continue;
-            R_len_t cursize = get(i).length();
-            if (cursize > bufsize)
-               bufsize = cursize;
+         R_len_t i = 0;
+         while (i < n) {
+            R_len_t run = nextNA(i, n);
+            for (; i < run; ++i) {
+               R_len_t cursize = get(i).length();
+               if (cursize > bufsize)
+                  bufsize = cursize;
+            }
+            i = nextNonNA(i, n);
          }
          return bufsize;
       }
@@ -172,11 +322,15 @@ class StriContainerUTF8 : public StriContainerBase {
       /** get the length of the longest string */
       R_len_t getMaxLength() const {
          R_len_t bufsize = 0;
-         for (R_len_t i=0; i<n; ++i) {
-            if (isNA(i)) continue;
-            R_len_t cursize = get(i).countCodePoints();
-            if (cursize > bufsize)
-               bufsize = cursize;
+         R_len_t i = 0;
+         while (i < n) {
+            R_len_t run = nextNA(i, n);
+            for (; i < run; ++i) {
+               R_len_t cursize = get(i).countCodePoints();
+               if (cursize > bufsize)
+                  bufsize = cursize;
+            }
+            i = nextNonNA(i, n);
          }
          return bufsize;
       }
@@ -187,6 +341,29 @@ class StriContainerUTF8 : public StriContainerBase {
        * @param s string to be copied
        */
       inline void set(R_len_t i, const String8& s) {
+         if (refcount && *refcount > 1) unshare();
+#ifndef NDEBUG
+         if (isShallow)
+            throw StriException("StriContainerUTF8::set(): shallow StriContainerUTF8");
+         if (n != nrecycle)
+            throw StriException("StriContainerUTF8::set(): n!=nrecycle");
+         if (i < 0 || i >= n)
+            throw StriException("StriContainerUTF8::set(): INDEX OUT OF BOUNDS");
+#endif
+         dropNAMask();
+         str[recycled_index(i)] = s; // in fact, i is always < n here
+      }
+
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+      /** set the vectorized ith element, stealing the buffer
+       * @param i index
+       * @param s string whose contents are taken over
+       *
+       * @version 1.4.6 (2020-01-24)
+       */
+      inline void set(R_len_t i, String8&& s) {
+         if (refcount && *refcount > 1) unshare();
 #ifndef NDEBUG
          if (isShallow)
             throw StriException("StriContainerUTF8::set(): shallow StriContainerUTF8");
@@ -195,9 +372,25 @@ class StriContainerUTF8 : public StriContainerBase {
          if (i < 0 || i >= n)
             throw StriException("StriContainerUTF8::set(): INDEX OUT OF BOUNDS");
 #endif
-         str[i%n] = s; // in fact, "%n" is not necessary
+         dropNAMask();
+         str[recycled_index(i)] = std::move(s); // in fact, i is always < n here
       }
+#endif
 
 };
 
+
+// prepared-corpus handle, see stri_prepared.cpp;
+// NULL unless a valid handle is attached to str
+const StriContainerUTF8* stri__prepared_from_attrib(SEXP str);
+
+// compact corpus-stats record, see stri_prepared.cpp (deep=FALSE);
+// facts established once per vector, from R's encoding flags only
+#define STRI__CORPUS_STATS_KNOWN 0x01u ///< the record is present and fresh
+#define STRI__CORPUS_ALL_ASCII   0x02u ///< every non-NA element is pure ASCII
+#define STRI__CORPUS_ALL_UTF8    0x04u ///< ... is ASCII or UTF-8 (nothing to re-encode)
+#define STRI__CORPUS_NO_NA       0x08u ///< no NA elements
+unsigned stri__corpus_stats_scan(SEXP str);
+unsigned stri__corpus_stats_from_attrib(SEXP str);
+
 #endif
@@ -45,6 +45,8 @@ StriContainerUTF8_indexable::StriContainerUTF8_indexable()
 {
    last_ind_back_str = NULL;
    last_ind_fwd_str = NULL;
+   last_ind_back_ncp = -1;
+   cpindex = NULL;
 }
 
 
@@ -62,6 +64,8 @@ StriContainerUTF8_indexable::StriContainerUTF8_indexable(SEXP rstr, R_len_t _nre
 {
    last_ind_back_str = NULL;
    last_ind_fwd_str = NULL;
+   last_ind_back_ncp = -1;
+   cpindex = NULL;
 }
 
 
@@ -75,6 +79,8 @@ StriContainerUTF8_indexable::StriContainerUTF8_indexable(StriContainerUTF8_index
 {
    last_ind_back_str = NULL;
    last_ind_fwd_str = NULL;
+   last_ind_back_ncp = -1;
+   cpindex = NULL;
 }
 
 
@@ -90,6 +96,8 @@ StriContainerUTF8_indexable& StriContainerUTF8_indexable::operator=(StriContaine
 
    last_ind_back_str = NULL;
    last_ind_fwd_str = NULL;
+   last_ind_back_ncp = -1;
+   cpindex = NULL;
 
    return *this;
 }
@@ -120,6 +128,12 @@ StriContainerUTF8_indexable& StriContainerUTF8_indexable::operator=(StriContaine
  *
  * @version 1.1.3 (Marek Gagolewski, 2017-03-21)
  *          Issue#227: buffering bug in stri_sub
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          O(1) via a persistent code point index, when one is attached
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          reuse the total code point count once a walk has discovered it
  */
 R_len_t StriContainerUTF8_indexable::UChar32_to_UTF8_index_back(R_len_t i, R_len_t wh)
 {
@@ -133,13 +147,36 @@ R_len_t StriContainerUTF8_indexable::UChar32_to_UTF8_index_back(R_len_t i, R_len
       throw StriException("StriContainerUTF8::UChar32_to_UTF8_index_back: NULL cur_s");
 #endif
 
+   if (stri__cpindex_available(cpindex, recycled_index(i))) {
+      // the total code point count is known, so "wh from the end" is
+      // just a forward position - jump to the nearest sample
+      R_len_t ncp = cpindex->ncp[recycled_index(i)];
+      R_len_t p = ncp-wh;
+      if (p <= 0) return 0;
+      R_len_t j, jres;
+      stri__cpindex_jump(cpindex, recycled_index(i), p, j, jres);
+      while (j < p && jres < cur_n) {
+         U8_FWD_1((const uint8_t*)cur_s, jres, cur_n);
+         ++j;
+      }
+      return jres;
+   }
+
    if (last_ind_back_str != cur_s) {
       // starting search in a different string
       last_ind_back_codepoint = 0;
       last_ind_back_utf8 = cur_n;
       last_ind_back_str = cur_s;
+      last_ind_back_ncp = -1;
    }
 
+   if (last_ind_back_ncp >= 0) {
+      // the string's total length is already known, so this is just
+      // a forward lookup - and the forward cache may continue it
+      R_len_t p = last_ind_back_ncp-wh;
+      if (p <= 0) return 0;
+      return UChar32_to_UTF8_index_fwd(i, p);
+   }
 
    R_len_t j = 0;
    R_len_t jres = cur_n;
@@ -175,6 +212,9 @@ R_len_t StriContainerUTF8_indexable::UChar32_to_UTF8_index_back(R_len_t i, R_len
       ++j;
    }
 
+   if (jres == 0)
+      last_ind_back_ncp = j; // we have seen the whole string
+
    last_ind_back_codepoint = j; // it's not wh, as we can advance at the end of the string, compare #227
    last_ind_back_utf8 = jres;
 
@@ -207,6 +247,12 @@ R_len_t StriContainerUTF8_indexable::UChar32_to_UTF8_index_back(R_len_t i, R_len
  *
  * @version 1.1.3 (Marek Gagolewski, 2017-03-21)
  *          Issue#227: buffering bug in stri_sub
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          O(1) via a persistent code point index, when one is attached
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          record the total code point count when the walk hits the end
  */
 R_len_t StriContainerUTF8_indexable::UChar32_to_UTF8_index_fwd(R_len_t i, R_len_t wh)
 {
@@ -221,6 +267,17 @@ R_len_t StriContainerUTF8_indexable::UChar32_to_UTF8_index_fwd(R_len_t i, R_len_
       throw StriException("StriContainerUTF8::UChar32_to_UTF8_index_fwd: NULL cur_s");
 #endif
 
+   if (stri__cpindex_available(cpindex, recycled_index(i))) {
+      // at most STRI__CPINDEX_STEP forward steps from the nearest sample
+      R_len_t j, jres;
+      stri__cpindex_jump(cpindex, recycled_index(i), wh, j, jres);
+      while (j < wh && jres < cur_n) {
+         U8_FWD_1((const uint8_t*)cur_s, jres, cur_n);
+         ++j;
+      }
+      return jres;
+   }
+
 
    if (last_ind_fwd_str != cur_s) {
       // starting search in a different string
@@ -263,6 +320,16 @@ R_len_t StriContainerUTF8_indexable::UChar32_to_UTF8_index_fwd(R_len_t i, R_len_
       ++j;
    }
 
+   if (jres == cur_n) {
+      // we have seen the whole string - let end-anchored lookups know
+      if (last_ind_back_str != cur_s) {
+         last_ind_back_codepoint = 0;
+         last_ind_back_utf8 = cur_n;
+         last_ind_back_str = cur_s;
+      }
+      last_ind_back_ncp = j;
+   }
+
    last_ind_fwd_codepoint = j; // it's not wh, as we can advance at the end of the string, compare #227
    last_ind_fwd_utf8 = jres;
    return jres;
@@ -34,6 +34,7 @@
 #define __stri_container_utf8_indexable_h
 
 #include "stri_container_utf8.h"
+#include "stri_index.h"
 
 
 /**
@@ -47,6 +48,12 @@
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-02-14)
  *          use String8::isASCII
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          may consult a persistent StriCpIndex, see setPersistentIndex()
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          memoize the total code point count discovered by full walks
  */
 class StriContainerUTF8_indexable : public StriContainerUTF8 {
 
@@ -62,6 +69,14 @@ class StriContainerUTF8_indexable : public StriContainerUTF8 {
       R_len_t last_ind_back_utf8;
       const char* last_ind_back_str;
 
+      /** total code point count of \code{last_ind_back_str}, or -1 if
+          not discovered yet; once a walk has traversed the whole string,
+          later end-anchored lookups on the same element are resolved
+          through the forward cache instead of re-walking from the end */
+      R_len_t last_ind_back_ncp;
+
+      const StriCpIndex* cpindex; ///< persistent index or NULL, see stri_index.h
+
    public:
 
       StriContainerUTF8_indexable();
@@ -72,6 +87,19 @@ class StriContainerUTF8_indexable : public StriContainerUTF8 {
       void UTF8_to_UChar32_index(R_len_t i, int* i1, int* i2, const int ni, int adj1, int adj2);
       R_len_t UChar32_to_UTF8_index_back(R_len_t i, R_len_t wh);
       R_len_t UChar32_to_UTF8_index_fwd(R_len_t i, R_len_t wh);
+
+
+      /** attach a persistent (cross-call) code point index
+       *
+       * The index must have been built for, and validated against,
+       * the very character vector this container wraps
+       * (see stri__cpindex_from_attrib); it stays owned by the caller.
+       *
+       * @version 1.4.6 (2020-01-24)
+       */
+      inline void setPersistentIndex(const StriCpIndex* idx) {
+         this->cpindex = idx;
+      }
 };
 
 #endif
@@ -37,7 +37,17 @@
 #include "stri_container_listint.h"
 #include "stri_string8buf.h"
 #include "stri_ucnv.h"
+#include "stri_threads.h"
 #include <vector>
+#include <string>
+
+
+// minimal per-thread payload (in bytes, summed over elements) when
+// converting a character vector with several threads
+#define STRI__ENCODE_PARALLEL_MIN_CHUNK 4194304
+
+// the fixed UTF-16 pivot size (in UChars) for chunked re-encoding
+#define STRI__ENCODE_STREAM_PIVOT 4096
 
 
 /** Convert from UTF-32
@@ -213,6 +223,14 @@ SEXP stri_enc_toutf32(SEXP str)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    return the input as-is when a scan of the encoding marks shows
+ *    there is nothing to do (defensive pipeline-boundary calls)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    the as-is return is taken for bare vectors only, so the result
+ *    carries no attributes whichever path is taken
  */
 SEXP stri_enc_toutf8(SEXP str, SEXP is_unknown_8bit, SEXP validate)
 {
@@ -225,6 +243,36 @@ SEXP stri_enc_toutf8(SEXP str, SEXP is_unknown_8bit, SEXP validate)
    STRI__ERROR_HANDLER_BEGIN(2)
    SEXP ret;
    if (!is_unknown_8bit_logical) {
+      // zero-copy fast path: if every element is NA, ASCII, or BOM-free
+      // UTF-8, and no validation was requested, the input needs no work;
+      // inputs with attributes are copied nevertheless - the copying
+      // path returns a bare vector, and the result must not depend on
+      // which path was taken
+      if (LOGICAL(validate)[0] == FALSE && ATTRIB(str) == R_NilValue) {
+         bool no_work = true;
+         for (R_len_t i=0; i<n; ++i) {
+            SEXP curs = STRING_ELT(str, i);
+            if (curs == NA_STRING || IS_ASCII(curs))
+               continue;
+            if (!IS_UTF8(curs)) {
+               no_work = false;
+               break;
+            }
+            const char* curs_s = CHAR(curs);
+            if (LENGTH(curs) >= 3 &&
+                  (uint8_t)(curs_s[0]) == UTF8_BOM_BYTE1 &&
+                  (uint8_t)(curs_s[1]) == UTF8_BOM_BYTE2 &&
+                  (uint8_t)(curs_s[2]) == UTF8_BOM_BYTE3) {
+               no_work = false; // the BOM is to be removed
+               break;
+            }
+         }
+         if (no_work) {
+            STRI__UNPROTECT_ALL
+            return str;
+         }
+      }
+
       // Trivial - everything we need is in StriContainerUTF8 :)
       // which removes BOMs silently
       StriContainerUTF8 str_cont(str, n);
@@ -530,6 +578,158 @@ SEXP stri_encode_from_marked(SEXP str, SEXP to, SEXP to_raw)
 }
 
 
+
+/** re-encode one payload in bounded-memory chunks [internal]
+ *
+ * ucnv_convertEx pumps the bytes through a fixed-size UTF-16 pivot, so
+ * the auxiliary memory stays at STRI__ENCODE_STREAM_PIVOT UChars
+ * regardless of the payload size - the two-step route materializes a
+ * whole-string UTF-16 copy, roughly doubling the footprint for
+ * file-sized inputs. The sink grows geometrically as the target fills
+ * up; conversion resumes exactly where it stopped.
+ *
+ * Both converters are reset here; their callbacks apply as usual.
+ * Thread-safe as long as the converters are private to the caller
+ * (the parallel workers rely on that).
+ *
+ * @param src, n the payload
+ * @param buf [in/out] the sink, reused and grown across calls
+ * @param status [out] the ICU status - no exceptions are thrown here
+ * @return number of bytes written to `buf`, 0 on failure
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+R_len_t stri__encode_streamed(const char* src, R_len_t n,
+   UConverter* uconv_from, UConverter* uconv_to, String8buf& buf,
+   UErrorCode& status)
+{
+   UChar pivot[STRI__ENCODE_STREAM_PIVOT];
+   UChar* pivot_source = pivot;
+   UChar* pivot_target = pivot;
+
+   ucnv_resetToUnicode(uconv_from);
+   ucnv_resetFromUnicode(uconv_to);
+
+   const char* source = src;
+   const char* source_limit = src+n;
+
+   if (buf.size() < n) buf.resize(n, false/*destroy contents*/);
+   char* target = buf.data();
+
+   status = U_ZERO_ERROR;
+   for (;;) {
+      const char* target_limit = buf.data()+buf.size();
+      ucnv_convertEx(uconv_to, uconv_from, &target, target_limit,
+         &source, source_limit, pivot, &pivot_source, &pivot_target,
+         pivot+STRI__ENCODE_STREAM_PIVOT, FALSE/*reset - done above*/,
+         TRUE/*flush*/, &status);
+      if (status != U_BUFFER_OVERFLOW_ERROR) break;
+
+      R_len_t done = (R_len_t)(target - buf.data());
+      buf.resize(buf.size() + buf.size()/2 + 64, true/*keep contents*/);
+      target = buf.data()+done;
+      status = U_ZERO_ERROR;
+   }
+   if (U_FAILURE(status)) return 0;
+
+   return (R_len_t)(target - buf.data());
+}
+
+
+#ifdef STRI_HAVE_THREADS
+/** convert a batch of elements with per-worker converter clones
+ *
+ * Elements are split into nth contiguous ranges carrying roughly equal
+ * numbers of input bytes. Each worker gets private ucnv_safeClone-d
+ * "from" and "to" converters (callbacks and options are inherited) and
+ * writes the converted bytes of its elements into `out`; workers never
+ * touch the R API. Errors are aggregated after the join - the first
+ * failing ICU status is re-raised on the main thread.
+ *
+ * @param is_na NA elements - left untouched in `out`
+ * @param in_s, in_n per-element input bytes
+ * @param out [out] per-element converted bytes
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__encode_parallel(const std::vector<char>& is_na,
+   const std::vector<const char*>& in_s, const std::vector<R_len_t>& in_n,
+   std::vector<std::string>& out,
+   UConverter* uconv_from, UConverter* uconv_to, int nth)
+{
+   R_len_t str_n = (R_len_t)in_s.size();
+
+   // clones are made on the main thread - this may throw
+   std::vector<UConverter*> clones_from(nth, (UConverter*)NULL);
+   std::vector<UConverter*> clones_to(nth, (UConverter*)NULL);
+   UErrorCode status = U_ZERO_ERROR;
+   for (int t=0; t<nth && U_SUCCESS(status); ++t) {
+      clones_from[t] = ucnv_safeClone(uconv_from, NULL, NULL, &status);
+      if (U_SUCCESS(status))
+         clones_to[t] = ucnv_safeClone(uconv_to, NULL, NULL, &status);
+   }
+   STRI__CHECKICUSTATUS_THROW(status, {
+      for (int t=0; t<nth; ++t) {
+         if (clones_from[t]) ucnv_close(clones_from[t]);
+         if (clones_to[t])   ucnv_close(clones_to[t]);
+      }
+   })
+
+   // contiguous ranges with roughly equal payloads
+   size_t total_bytes = 0;
+   for (R_len_t i=0; i<str_n; ++i)
+      if (!is_na[i]) total_bytes += (size_t)in_n[i];
+   std::vector<R_len_t> bounds(nth+1, str_n);
+   bounds[0] = 0;
+   size_t acc = 0;
+   int cur_bound = 1;
+   for (R_len_t i=0; i<str_n && cur_bound<nth; ++i) {
+      if (!is_na[i]) acc += (size_t)in_n[i];
+      if (acc >= total_bytes*(size_t)cur_bound/(size_t)nth)
+         bounds[cur_bound++] = i+1;
+   }
+
+   std::vector<int> errors(nth, 0); // first failing UErrorCode per worker
+   std::vector<std::thread> workers;
+   for (int t=0; t<nth; ++t) {
+      R_len_t begin = bounds[t], end = bounds[t+1];
+      UConverter* myfrom = clones_from[t];
+      UConverter* myto   = clones_to[t];
+      workers.push_back(std::thread(
+         [begin, end, myfrom, myto, t, &is_na, &in_s, &in_n, &out, &errors]() {
+            try {
+               String8buf mybuf(1024); // grow-only, reused across elements
+               for (R_len_t i=begin; i<end; ++i) {
+                  if (is_na[i]) continue;
+
+                  UErrorCode status = U_ZERO_ERROR;
+                  R_len_t got = stri__encode_streamed(in_s[i], in_n[i],
+                     myfrom, myto, mybuf, status);
+                  if (U_FAILURE(status)) { errors[t] = (int)status; return; }
+
+                  out[i].assign(mybuf.data(), (size_t)got);
+               }
+            }
+            catch (...) {
+               errors[t] = (int)U_MEMORY_ALLOCATION_ERROR;
+            }
+         }));
+   }
+
+   status = U_ZERO_ERROR;
+   for (int t=0; t<nth; ++t) {
+      workers[t].join();
+      if (errors[t] && U_SUCCESS(status)) status = (UErrorCode)errors[t];
+   }
+   for (int t=0; t<nth; ++t) {
+      ucnv_close(clones_from[t]);
+      ucnv_close(clones_to[t]);
+   }
+   STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+}
+#endif
+
+
 /**
  * Convert character vector between given encodings
  *
@@ -561,6 +761,19 @@ SEXP stri_encode_from_marked(SEXP str, SEXP to, SEXP to_raw)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    multi-megabyte inputs may be converted by several threads
+ *    (opt-in, see options(stringi.num_threads=...))
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    file-sized elements stream through a fixed-size pivot
+ *    (ucnv_convertEx) - constant auxiliary memory, no whole-string
+ *    UTF-16 copy
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    all elements now take the streamed route, reusing one grow-only
+ *    target buffer - no per-element UnicodeString allocations
  */
 SEXP stri_encode(SEXP str, SEXP from, SEXP to, SEXP to_raw)
 {
@@ -596,6 +809,51 @@ SEXP stri_encode(SEXP str, SEXP from, SEXP to, SEXP to_raw)
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(to_raw_logical?VECSXP:STRSXP, str_n));
 
+#ifdef STRI_HAVE_THREADS
+   {
+      size_t total_bytes = 0;
+      for (R_len_t i=0; i<str_n; ++i)
+         if (!str_cont.isNA(i)) total_bytes += (size_t)str_cont.get(i).length();
+      int nth = (total_bytes >= 2*(size_t)STRI__ENCODE_PARALLEL_MIN_CHUNK) ?
+         stri__threads_requested(
+            (R_len_t)(total_bytes/STRI__ENCODE_PARALLEL_MIN_CHUNK)) : 1;
+      if (nth >= 2) {
+         std::vector<char> is_na(str_n, 0);
+         std::vector<const char*> in_s(str_n, (const char*)NULL);
+         std::vector<R_len_t> in_n(str_n, 0);
+         for (R_len_t i=0; i<str_n; ++i) {
+            if (str_cont.isNA(i)) { is_na[i] = 1; continue; }
+            in_s[i] = str_cont.get(i).c_str();
+            in_n[i] = str_cont.get(i).length();
+         }
+
+         std::vector<std::string> out(str_n);
+         stri__encode_parallel(is_na, in_s, in_n, out,
+            uconv_from, uconv_to, nth);
+
+         for (R_len_t i=0; i<str_n; ++i) {
+            if (is_na[i]) {
+               if (to_raw_logical) SET_VECTOR_ELT(ret, i, R_NilValue);
+               else                SET_STRING_ELT(ret, i, NA_STRING);
+            }
+            else if (to_raw_logical) {
+               SEXP outobj;
+               STRI__PROTECT(outobj = Rf_allocVector(RAWSXP, (R_len_t)out[i].size()));
+               memcpy(RAW(outobj), out[i].c_str(), out[i].size());
+               SET_VECTOR_ELT(ret, i, outobj);
+               STRI__UNPROTECT(1);
+            }
+            else {
+               SET_STRING_ELT(ret, i,
+                  Rf_mkCharLenCE(out[i].c_str(), (R_len_t)out[i].size(), encmark_to));
+            }
+         }
+
+         STRI__UNPROTECT_ALL
+         return ret;
+      }
+   }
+#endif
 
    // estimate required buf size
    R_len_t bufsize = 0;
@@ -616,37 +874,13 @@ SEXP stri_encode(SEXP str, SEXP from, SEXP to, SEXP to_raw)
       const char* curs = str_cont.get(i).c_str();
       R_len_t curn     = str_cont.get(i).length();
 
+      // every element streams through the same fixed pivot and the
+      // one grow-only target buffer - no per-element allocations
       UErrorCode status = U_ZERO_ERROR;
-      UnicodeString encs(curs, curn, uconv_from, status); // FROM -> UTF-16 [this is the slow part]
+      R_len_t bufneed = stri__encode_streamed(curs, curn,
+         uconv_from, uconv_to, buf, status);
       STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
 
-      R_len_t curn_tmp = encs.length();
-      const UChar* curs_tmp = encs.getBuffer(); // The buffer contents is (probably) not NUL-terminated.
-      if (!curs_tmp) {
-         throw StriException(MSG__INTERNAL_ERROR);
-      }
-
-      R_len_t bufneed = UCNV_GET_MAX_BYTES_FOR_STRING(curn_tmp, ucnv_getMaxCharSize(uconv_to));
-      // "The calculated size is guaranteed to be sufficient for this conversion."
-      buf.resize(bufneed, false/*destroy contents*/); // grows or stays as it was
-
-      status = U_ZERO_ERROR;
-//      bufneed = encs.extract(buf.data(), buf.size(), uconv_to, status); // UTF-16 -> TO
-      ucnv_resetFromUnicode(uconv_to);
-      bufneed = ucnv_fromUChars(uconv_to, buf.data(), buf.size(), curs_tmp,
-         curn_tmp, &status);
-      if (bufneed <= buf.size()) {
-         STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
-      }
-      else {// larger buffer needed [this shouldn't happen?]
-//         warning("buf extending");
-         buf.resize(bufneed, false/*destroy contents*/);
-         status = U_ZERO_ERROR;
-         bufneed = ucnv_fromUChars(uconv_to, buf.data(), buf.size(), curs_tmp,
-            curn_tmp, &status);
-         STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
-      }
-
       if (to_raw_logical) {
          SEXP outobj;
          STRI__PROTECT(outobj = Rf_allocVector(RAWSXP, bufneed));
@@ -40,6 +40,24 @@
 #include <map>
 #include <vector>
 #include <algorithm>
+#include <cstring>
+#include <string>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// inputs longer than this are not scored in full by the encoding
+// guessers - detection accuracy converges after a few KB anyway
+#define STRI__ENC_DETECT_SAMPLE_MAX 65536
+
+// how many windows the sample is spread over
+#define STRI__ENC_DETECT_SAMPLE_WINDOWS 8
+
+static void stri__enc_detect_sample(const char* src, R_len_t n,
+   std::vector<char>& sample, bool utf8_align);
 #include "stri_container_listraw.h"
 #include "stri_container_logical.h"
 #include "stri_ucnv.h"
@@ -85,6 +103,57 @@ double stri__enc_check_8bit(const char* str_cur_s, R_len_t str_cur_n, bool get_c
 }
 
 
+/** Advance over a run of non-NUL ASCII bytes, a whole block at a time
+ *
+ * Most validated payloads are dominated by 7-bit bytes; these need no
+ * sequence checks at all, only "high bit clear and not NUL". Wide
+ * blocks are tested with AVX2 or SSE2 when the compiler targets them
+ * (R packages are compiled on the machine they run on, so the target
+ * flags are the effective runtime dispatch), or with a 64-bit word
+ * trick otherwise. Validation of whatever this stops at is left to
+ * the caller.
+ *
+ * @param str_cur_s the string
+ * @param j current position
+ * @param str_cur_n number of bytes
+ * @return position of the first byte not skipped over, <= str_cur_n
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static inline R_len_t stri__enc_utf8_skip_ascii(const char* str_cur_s,
+   R_len_t j, R_len_t str_cur_n)
+{
+#if defined(__AVX2__)
+   while (j+32 <= str_cur_n) {
+      __m256i block = _mm256_loadu_si256((const __m256i*)(str_cur_s+j));
+      int nonascii = _mm256_movemask_epi8(block);
+      int nul = _mm256_movemask_epi8(
+         _mm256_cmpeq_epi8(block, _mm256_setzero_si256()));
+      if (nonascii || nul) break;
+      j += 32;
+   }
+#elif defined(__SSE2__)
+   while (j+16 <= str_cur_n) {
+      __m128i block = _mm_loadu_si128((const __m128i*)(str_cur_s+j));
+      int nonascii = _mm_movemask_epi8(block);
+      int nul = _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_setzero_si128()));
+      if (nonascii || nul) break;
+      j += 16;
+   }
+#else
+   while (j+8 <= str_cur_n) {
+      uint64_t w;
+      memcpy(&w, str_cur_s+j, 8);
+      if ((w & 0x8080808080808080ULL) != 0 ||
+            (((w - 0x0101010101010101ULL) & ~w) & 0x8080808080808080ULL) != 0)
+         break; // a high bit set or a NUL byte within this word
+      j += 8;
+   }
+#endif
+   return j;
+}
+
+
 /** Check if a string is valid ASCII
  *
  *  simple check whether charcodes are in [1..127]
@@ -103,8 +172,22 @@ double stri__enc_check_8bit(const char* str_cur_s, R_len_t str_cur_n, bool get_c
  *
  * @version 0.1-?? (Marek Gagolewski, 2013-08-13)
  *          warnchars count added
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    the exact check scans a vector-register-wide block at a time,
+ *    see stri__enc_utf8_skip_ascii()
  */
 double stri__enc_check_ascii(const char* str_cur_s, R_len_t str_cur_n, bool get_confidence) {
+   if (!get_confidence) {
+      // exactly the blockwise stop condition: a high bit set or a NUL
+      R_len_t j = stri__enc_utf8_skip_ascii(str_cur_s, 0, str_cur_n);
+      for (; j < str_cur_n; ++j) {
+         if (!U8_IS_SINGLE(str_cur_s[j]) || str_cur_s[j] == 0)
+            return 0.0;
+      }
+      return 1.0;
+   }
+
    R_len_t warnchars = 0;
    for (R_len_t j=0; j < str_cur_n; ++j) {
       if (!U8_IS_SINGLE(str_cur_s[j]) || str_cur_s[j] == 0) // i.e., 0 < c <= 127
@@ -144,12 +227,19 @@ double stri__enc_check_ascii(const char* str_cur_s, R_len_t str_cur_n, bool get_
  *
  * @version 0.1-?? (Marek Gagolewski, 2013-08-13)
  *          confidence calculation basing on ICU's i18n/csrutf8.cpp
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    the exact check skips ASCII runs a vector-register-wide block
+ *    at a time, see stri__enc_utf8_skip_ascii()
  */
 double stri__enc_check_utf8(const char* str_cur_s, R_len_t str_cur_n, bool get_confidence)
 {
    if (!get_confidence) {
       UChar32 c;
       for (R_len_t j=0; j < str_cur_n; ) {
+         j = stri__enc_utf8_skip_ascii(str_cur_s, j, str_cur_n);
+         if (j >= str_cur_n) break;
+
          if (str_cur_s[j] == 0)
             return 0.0; // definitely not valid UTF-8
 
@@ -234,6 +324,70 @@ double stri__enc_check_utf8(const char* str_cur_s, R_len_t str_cur_n, bool get_c
 }
 
 
+/** [internal] advance over UTF-16 code units that need no further checks
+ *
+ * Classifies a whole block of units at once: anything in
+ * [0x0001, 0x052F] is nonzero, not a surrogate and below the
+ * confidence-penalty threshold of stri__enc_check_utf16, so a block
+ * made up of such units only can be skipped outright. The first block
+ * containing a NUL, a surrogate or a >= U+0530 unit is left for the
+ * scalar loop to inspect.
+ *
+ * @param str_cur_s string
+ * @param i current position, in bytes, even
+ * @param str_cur_n buffer length, in bytes, even
+ * @param le little-endian input?
+ * @return new position, i <= result <= str_cur_n, even
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static inline R_len_t stri__enc_utf16_skip_ordinary(const char* str_cur_s,
+   R_len_t i, R_len_t str_cur_n, bool le)
+{
+#if defined(__AVX2__)
+   // x86, so the host is little-endian
+   const __m256i zero = _mm256_setzero_si256();
+   const __m256i ubnd = _mm256_set1_epi16(0x052F);
+   while (i+32 <= str_cur_n) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(str_cur_s+i));
+      if (!le) // byte-swap each 16-bit lane
+         v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+      int above = _mm256_movemask_epi8(
+         _mm256_cmpeq_epi16(_mm256_subs_epu16(v, ubnd), zero));
+      int isnul = _mm256_movemask_epi8(_mm256_cmpeq_epi16(v, zero));
+      if (above != (int)0xFFFFFFFF || isnul != 0) break;
+      i += 32;
+   }
+#elif defined(__SSE2__)
+   // x86, so the host is little-endian
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i ubnd = _mm_set1_epi16(0x052F);
+   while (i+16 <= str_cur_n) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(str_cur_s+i));
+      if (!le) // byte-swap each 16-bit lane
+         v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+      int above = _mm_movemask_epi8(
+         _mm_cmpeq_epi16(_mm_subs_epu16(v, ubnd), zero));
+      int isnul = _mm_movemask_epi8(_mm_cmpeq_epi16(v, zero));
+      if (above != 0xFFFF || isnul != 0) break;
+      i += 16;
+   }
+#else
+   // portable block of 4; simple enough for compilers to vectorize
+   while (i+8 <= str_cur_n) {
+      uint16_t c0 = (le)?STRI__GET_INT16_LE(str_cur_s, i  ):STRI__GET_INT16_BE(str_cur_s, i  );
+      uint16_t c1 = (le)?STRI__GET_INT16_LE(str_cur_s, i+2):STRI__GET_INT16_BE(str_cur_s, i+2);
+      uint16_t c2 = (le)?STRI__GET_INT16_LE(str_cur_s, i+4):STRI__GET_INT16_BE(str_cur_s, i+4);
+      uint16_t c3 = (le)?STRI__GET_INT16_LE(str_cur_s, i+6):STRI__GET_INT16_BE(str_cur_s, i+6);
+      if ((uint16_t)(c0-1) > 0x052E || (uint16_t)(c1-1) > 0x052E ||
+          (uint16_t)(c2-1) > 0x052E || (uint16_t)(c3-1) > 0x052E) break;
+      i += 8;
+   }
+#endif
+   return i;
+}
+
+
 /** Check if a string is valid UTF-16LE or UTF-16BE
  *
  * @param str_cur_s character vector
@@ -247,6 +401,9 @@ double stri__enc_check_utf8(const char* str_cur_s, R_len_t str_cur_n, bool get_c
  *
  * @version 0.1-?? (Marek Gagolewski, 2013-08-14)
  *          confidence calculation basing on ICU's i18n/csucode.cpp
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          runs of ordinary units are classified a block at a time
  */
 double stri__enc_check_utf16(const char* str_cur_s, R_len_t str_cur_n,
    bool get_confidence, bool le)
@@ -263,6 +420,9 @@ double stri__enc_check_utf16(const char* str_cur_s, R_len_t str_cur_n,
    R_len_t warnchars = 0;
 
    for (R_len_t i=0; i<str_cur_n; i += 2) {
+      i = stri__enc_utf16_skip_ordinary(str_cur_s, i, str_cur_n, le);
+      if (i >= str_cur_n) break;
+
       uint16_t c = (le)?
                   STRI__GET_INT16_LE(str_cur_s, i):
                   STRI__GET_INT16_BE(str_cur_s, i);
@@ -572,6 +732,11 @@ SEXP stri_enc_isutf32le(SEXP str) {
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    long inputs are represented by evenly spread sample windows, as
+ *    in stri_enc_detect2 - the detector's cost no longer grows with
+ *    the input size
  */
 SEXP stri_enc_detect(SEXP str, SEXP filter_angle_brackets)
 {
@@ -617,6 +782,16 @@ SEXP stri_enc_detect(SEXP str, SEXP filter_angle_brackets)
       const char* str_cur_s = str_cont.get(i).c_str();
       R_len_t str_cur_n     = str_cont.get(i).length();
 
+      std::vector<char> sample;
+      if (str_cur_n > STRI__ENC_DETECT_SAMPLE_MAX) {
+         // hand the detector evenly spread windows, not the whole
+         // input; the UTF-8 alignment keeps window seams from being
+         // mistaken for encoding errors
+         stri__enc_detect_sample(str_cur_s, str_cur_n, sample, true);
+         str_cur_s = &sample[0];
+         str_cur_n = (R_len_t)sample.size();
+      }
+
       status = U_ZERO_ERROR;
       ucsdet_setText(ucsdet, str_cur_s, str_cur_n, &status);
    	STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
@@ -792,6 +967,48 @@ struct Converter8bit {
 // -----------------------------------------------------------------------
 
 
+/** take evenly spread windows of a long input for encoding detection
+ *
+ * Scoring converges after a few KB, so inputs longer than
+ * STRI__ENC_DETECT_SAMPLE_MAX are represented by
+ * STRI__ENC_DETECT_SAMPLE_WINDOWS windows spread across the text
+ * (the first one keeps the head, including any BOM). Window starts
+ * are rounded down to multiples of 4, so UTF-16/32 code unit phase
+ * is preserved; with `utf8_align`, windows additionally start at a
+ * UTF-8 lead byte and drop a trailing incomplete sequence, so that
+ * boundaries do not masquerade as encoding errors.
+ *
+ * @param sample [out] the concatenated windows
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__enc_detect_sample(const char* src, R_len_t n,
+   std::vector<char>& sample, bool utf8_align)
+{
+   R_len_t win = STRI__ENC_DETECT_SAMPLE_MAX/STRI__ENC_DETECT_SAMPLE_WINDOWS;
+   R_len_t stride = (n-win)/(STRI__ENC_DETECT_SAMPLE_WINDOWS-1);
+   sample.reserve(STRI__ENC_DETECT_SAMPLE_MAX);
+
+   for (int w=0; w<STRI__ENC_DETECT_SAMPLE_WINDOWS; ++w) {
+      R_len_t begin = (w*stride) & ~3; // keep the 2-/4-byte phase
+      R_len_t end = begin+win;
+
+      if (utf8_align) {
+         while (begin < end && ((uint8_t)src[begin] & 0xC0) == 0x80)
+            ++begin; // do not start inside a multibyte sequence
+         R_len_t lead = end-1;
+         while (lead > begin && ((uint8_t)src[lead] & 0xC0) == 0x80)
+            --lead; // the last lead byte within this window
+         if (((uint8_t)src[lead] & 0x80) != 0 &&
+               end-lead < U8_COUNT_TRAIL_BYTES((uint8_t)src[lead])+1)
+            end = lead; // drop a trailing incomplete sequence
+      }
+
+      sample.insert(sample.end(), src+begin, src+end);
+   }
+}
+
+
 /** Guesses text encoding; help struct for stri_enc_detect2
  *
  * @version 0.1-?? (Marek Gagolewski)
@@ -896,28 +1113,42 @@ struct EncGuess {
    static void do_8bit_locale(vector<EncGuess>& guesses, const char* str_cur_s,
       R_len_t str_cur_n, const char* qloc)
    {
-      vector<Converter8bit> converters;
       if (!qloc) throw StriException(MSG__INTERNAL_ERROR); // just to be sure
 
-      UErrorCode status = U_ZERO_ERROR;
-      ULocaleData* uld = ulocdata_open(qloc, &status);
+      // the scoring tables depend on the locale only - compute them
+      // once per locale, not once per scored element
+      static std::map< std::string, vector<Converter8bit> > converters_cache;
+      if (converters_cache.size() > 8)
+         converters_cache.clear(); // unlikely; bound the footprint
+      std::map< std::string, vector<Converter8bit> >::iterator cached
+         = converters_cache.find(std::string(qloc));
+      if (cached == converters_cache.end()) {
+         UErrorCode status = U_ZERO_ERROR;
+         ULocaleData* uld = ulocdata_open(qloc, &status);
    	STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
 
-      USet* exset_tmp = ulocdata_getExemplarSet(uld, NULL,
-         USET_ADD_CASE_MAPPINGS, ULOCDATA_ES_STANDARD, &status);
+         USet* exset_tmp = ulocdata_getExemplarSet(uld, NULL,
+            USET_ADD_CASE_MAPPINGS, ULOCDATA_ES_STANDARD, &status);
    	STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
-      UnicodeSet* exset = UnicodeSet::fromUSet(exset_tmp); // don't delete, just a pointer
-      exset->removeAllStrings();
+         UnicodeSet* exset = UnicodeSet::fromUSet(exset_tmp); // don't delete, just a pointer
+         exset->removeAllStrings();
+
+         vector<Converter8bit> fresh;
+         R_len_t ucnv_count = (R_len_t)ucnv_countAvailable();
+         for (R_len_t i=0; i<ucnv_count; ++i) { // for each converter
+            // ucnv_getAvailableName and getFriendlyName return pointers
+            // to static data - safe to keep across calls
+            Converter8bit conv(ucnv_getAvailableName(i), StriUcnv::getFriendlyName(ucnv_getAvailableName(i)), exset);
+            if (!conv.isNA) fresh.push_back(conv);
+         }
 
+         uset_close(exset_tmp); exset = NULL;
+         ulocdata_close(uld);
 
-      R_len_t ucnv_count = (R_len_t)ucnv_countAvailable();
-      for (R_len_t i=0; i<ucnv_count; ++i) { // for each converter
-         Converter8bit conv(ucnv_getAvailableName(i), StriUcnv::getFriendlyName(ucnv_getAvailableName(i)), exset);
-         if (!conv.isNA) converters.push_back(conv);
+         cached = converters_cache.insert(
+            std::make_pair(std::string(qloc), fresh)).first;
       }
-
-      uset_close(exset_tmp); exset = NULL;
-      ulocdata_close(uld);
+      const vector<Converter8bit>& converters = cached->second;
 
       if (converters.size() <= 0)
          return;
@@ -990,6 +1221,10 @@ struct EncGuess {
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    long inputs are scored on evenly spread sample windows; the
+ *    per-locale 8-bit scoring tables are computed once and cached
  */
 SEXP stri_enc_detect2(SEXP str, SEXP loc)
 {
@@ -1033,9 +1268,23 @@ SEXP stri_enc_detect2(SEXP str, SEXP loc)
       vector<EncGuess> guesses;
       guesses.reserve(6);
 
-      EncGuess::do_utf32(guesses, str_cur_s, str_cur_n);
-      EncGuess::do_utf16(guesses, str_cur_s, str_cur_n);
-      EncGuess::do_8bit(guesses, str_cur_s, str_cur_n, qloc);  // includes UTF-8
+      if (str_cur_n > STRI__ENC_DETECT_SAMPLE_MAX) {
+         // score evenly spread windows, not the whole input
+         std::vector<char> sample_aligned, sample_utf8;
+         stri__enc_detect_sample(str_cur_s, str_cur_n, sample_aligned, false);
+         stri__enc_detect_sample(str_cur_s, str_cur_n, sample_utf8, true);
+         EncGuess::do_utf32(guesses, &sample_aligned[0],
+            (R_len_t)sample_aligned.size());
+         EncGuess::do_utf16(guesses, &sample_aligned[0],
+            (R_len_t)sample_aligned.size());
+         EncGuess::do_8bit(guesses, &sample_utf8[0],
+            (R_len_t)sample_utf8.size(), qloc);  // includes UTF-8
+      }
+      else {
+         EncGuess::do_utf32(guesses, str_cur_s, str_cur_n);
+         EncGuess::do_utf16(guesses, str_cur_s, str_cur_n);
+         EncGuess::do_8bit(guesses, str_cur_s, str_cur_n, qloc);  // includes UTF-8
+      }
 
       R_len_t matchesFound = (R_len_t)guesses.size();
       if (matchesFound <= 0) {
@@ -33,6 +33,13 @@
 #include "stri_stringi.h"
 #include "stri_ucnv.h"
 
+// read-only access to a character vector's CHARSXP table, without a
+// function call per element (materializes ALTREP input, which the
+// whole-vector scan in stri_enc_mark would do anyway)
+#if !(defined(R_VERSION) && R_VERSION >= R_Version(3, 5, 0))
+#define STRING_PTR_RO(x) ((const SEXP*)STRING_PTR(x))
+#endif
+
 
 /**
  * Sets current (default) ICU charset
@@ -263,6 +270,10 @@ SEXP stri_enc_info(SEXP enc)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    scan the CHARSXP table directly; the encoding bits are folded into
+ *    a factor-like code via a 16-entry table instead of an if-chain
  */
 SEXP stri_enc_mark(SEXP str) {
    PROTECT(str = stri_prepare_arg_string(str, "str"));    // prepare string argument
@@ -270,34 +281,41 @@ SEXP stri_enc_mark(SEXP str) {
    STRI__ERROR_HANDLER_BEGIN(1)
    R_len_t str_len = LENGTH(str);
 
+   // the five possible marks, indexed by the codes computed below;
    // some of them will not be used in this call, but we're lazy
-   SEXP mark_ascii, mark_latin1, mark_utf8, mark_native, mark_bytes;
-   STRI__PROTECT(mark_ascii  = Rf_mkChar("ASCII"));
-   STRI__PROTECT(mark_latin1 = Rf_mkChar("latin1"));
-   STRI__PROTECT(mark_utf8   = Rf_mkChar("UTF-8"));
-   STRI__PROTECT(mark_native = Rf_mkChar("native"));
-   STRI__PROTECT(mark_bytes  = Rf_mkChar("bytes"));
+   SEXP marks[5];
+   STRI__PROTECT(marks[0] = Rf_mkChar("ASCII"));
+   STRI__PROTECT(marks[1] = Rf_mkChar("UTF-8"));
+   STRI__PROTECT(marks[2] = Rf_mkChar("bytes"));
+   STRI__PROTECT(marks[3] = Rf_mkChar("latin1"));
+   STRI__PROTECT(marks[4] = Rf_mkChar("native"));
+
+   // encoding code by (ascii, utf8, latin1, bytes) bit nibble;
+   // the precedence mirrors the old if-chain (ASCII beats UTF-8,
+   // which beats bytes, which beats latin1)
+   uint8_t code_of[16];
+   for (int b=0; b<16; ++b)
+      code_of[b] = (b&8) ? 0 : (b&4) ? 1 : (b&1) ? 2 : (b&2) ? 3 : 4;
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, str_len));
+   const SEXP* str_tab = STRING_PTR_RO(str);
 
    for (R_len_t i=0; i<str_len; ++i) {
-      SEXP curs = STRING_ELT(str, i);
+      SEXP curs = str_tab[i];
       if (curs == NA_STRING) {
          SET_STRING_ELT(ret, i, NA_STRING);
          continue;
       }
 
-      if (IS_ASCII(curs))
-         SET_STRING_ELT(ret, i, mark_ascii);
-      else if (IS_UTF8(curs))
-         SET_STRING_ELT(ret, i, mark_utf8);
-      else if (IS_BYTES(curs))
-         SET_STRING_ELT(ret, i, mark_bytes);
-      else if (IS_LATIN1(curs))
-         SET_STRING_ELT(ret, i, mark_latin1);
-      else
-         SET_STRING_ELT(ret, i, mark_native);
+      // the IS_* macros read the same gp field, so this compiles to
+      // one load and a few shifts - no per-element R API calls
+      unsigned int idx =
+         (IS_BYTES(curs)  ? 1u : 0u) |
+         (IS_LATIN1(curs) ? 2u : 0u) |
+         (IS_UTF8(curs)   ? 4u : 0u) |
+         (IS_ASCII(curs)  ? 8u : 0u);
+      SET_STRING_ELT(ret, i, marks[code_of[idx]]);
    }
 
    STRI__UNPROTECT_ALL
@@ -0,0 +1,135 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_engine_sample_h
+#define __stri_engine_sample_h
+
+// like the thread pool, runtime sampling needs a monotonic clock and
+// therefore C++11; without it the sampler degenerates to the caller's
+// static choice (see the constructor)
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define STRI_HAVE_ENGINE_SAMPLING 1
+#include <chrono>
+#endif
+
+
+/** Races two interchangeable engines over the first few work units
+ *
+ * Several vectorized loops can answer an element with either of two
+ * engines that are guaranteed to produce identical results (a literal
+ * "regex" via a plain text scan or via the compiled pattern; a batch
+ * of KMP scans or one Aho-Corasick pass). Static dispatch guesses
+ * which is faster from the pattern alone, but the answer also depends
+ * on the data. This sampler alternates the engines over the first
+ * few units, accumulates wall-clock time normalized per input byte,
+ * and then locks in the cheaper engine for the rest of the call.
+ *
+ * Protocol, per unit of work:
+ * \code{int e = s.choose(); s.begin();} run engine \code{e};
+ * \code{s.end(e, nbytes);} - begin/end are no-ops once locked in, so
+ * the steady-state overhead is one branch per unit. Units answered
+ * without any engine (NA input etc.) simply skip the protocol.
+ *
+ * One instance per (pattern, call); main R thread only.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+class StriEngineSampler {
+
+   private:
+
+      int m_winner;          ///< locked-in engine; -1 while sampling
+#ifdef STRI_HAVE_ENGINE_SAMPLING
+      int m_runs_left[2];    ///< timed runs still wanted per engine
+      double m_ns[2];        ///< accumulated time per engine
+      double m_bytes[2];     ///< accumulated input bytes per engine
+      std::chrono::steady_clock::time_point m_t0;
+#endif
+
+   public:
+
+      /** @param sample_each how many units to time with each engine
+       *  @param fallback engine to use if timing is unavailable */
+      StriEngineSampler(int sample_each, int fallback) {
+#ifdef STRI_HAVE_ENGINE_SAMPLING
+         (void)fallback;
+         m_winner = -1;
+         m_runs_left[0] = m_runs_left[1] = sample_each;
+         m_ns[0] = m_ns[1] = 0.0;
+         m_bytes[0] = m_bytes[1] = 0.0;
+#else
+         (void)sample_each;
+         m_winner = fallback;
+#endif
+      }
+
+      /** the engine to run the next unit with (alternates while
+       *  sampling, the winner afterwards) */
+      inline int choose() const {
+#ifdef STRI_HAVE_ENGINE_SAMPLING
+         if (m_winner >= 0) return m_winner;
+         return (m_runs_left[0] >= m_runs_left[1])?0:1;
+#else
+         return m_winner;
+#endif
+      }
+
+      /** start timing the current unit (no-op once locked in) */
+      inline void begin() {
+#ifdef STRI_HAVE_ENGINE_SAMPLING
+         if (m_winner < 0)
+            m_t0 = std::chrono::steady_clock::now();
+#endif
+      }
+
+      /** record the current unit; locks the winner in once both
+       *  engines have had their timed runs
+       *  @param engine the engine that ran (the choose() result)
+       *  @param nbytes input bytes processed - costs are compared
+       *     per byte, so differently sized samples stay comparable */
+      inline void end(int engine, double nbytes) {
+#ifdef STRI_HAVE_ENGINE_SAMPLING
+         if (m_winner >= 0) return;
+         m_ns[engine] += (double)std::chrono::duration_cast
+            <std::chrono::nanoseconds>
+            (std::chrono::steady_clock::now() - m_t0).count();
+         m_bytes[engine] += nbytes + 1.0; // +1: empty units still count
+         if (--m_runs_left[engine] <= 0 && m_runs_left[1-engine] <= 0)
+            m_winner =
+               (m_ns[0]/m_bytes[0] <= m_ns[1]/m_bytes[1])?0:1;
+#else
+         (void)engine; (void)nbytes;
+#endif
+      }
+};
+
+#endif
@@ -33,6 +33,34 @@
 #include "stri_stringi.h"
 #include "stri_container_utf8.h"
 #include "stri_container_utf16.h"
+#include "stri_string8buf.h"
+#include <cstring>
+
+
+// Escaped length of each possible byte in stri_escape_unicode's output.
+// An ASCII byte fully determines its own cost; for a UTF-8 sequence the
+// whole cost is charged to the lead byte (continuations cost 0), so the
+// exact output size is a plain sum over input bytes. Invalid lead bytes
+// get 0 here - the escape pass decodes for real and throws on them
+// before writing anything for such a sequence.
+static const unsigned char stri__escape_bytecost[256] = {
+    6,  6,  6,  6,  6,  6,  6,  2,  2,  2,  2,  2,  2,  2,  6,  6,
+    6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,
+    1,  1,  2,  1,  1,  1,  1,  2,  1,  1,  1,  1,  1,  1,  1,  1,
+    1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+    1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+    1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  2,  1,  1,  1,
+    1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+    1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  6,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,
+    6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,
+    6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,
+   10, 10, 10, 10, 10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+};
 
 
 /**
@@ -51,6 +79,10 @@
  *
  * @version 1.1.6 (Steve Grubb, 2017-07-20)
  *          if ((char)c >= 32 || (char)c <= 126) should be &&
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    byte cost table gives the exact output size up front; runs of
+ *    plain printable ASCII are passed through eight bytes at a time
 */
 SEXP stri_escape_unicode(SEXP str)
 {
@@ -63,7 +95,7 @@ SEXP stri_escape_unicode(SEXP str)
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, str_length));
 
-   std::string out; // @TODO: estimate len a priori?
+   String8buf buf(0); // grows to the longest escaped element
 
    for (R_len_t i = str_cont.vectorize_init();
          i != str_cont.vectorize_end();
@@ -77,67 +109,82 @@ SEXP stri_escape_unicode(SEXP str)
       const char* str_cur_s = str_cont.get(i).c_str();
       R_len_t     str_cur_n = str_cont.get(i).length();
 
-      // estimate buf size
+      // exact output size - a plain byte-table sum (valid input never
+      // writes past it; invalid input throws before the undercounted
+      // sequence is reached)
       R_len_t bufsize = 0;
-      UChar32 c;
-      R_len_t j = 0;
+      for (R_len_t k=0; k<str_cur_n; ++k)
+         bufsize += stri__escape_bytecost[(uint8_t)str_cur_s[k]];
+      if (buf.size() < bufsize)
+         buf.resize(bufsize, false/*destroy contents*/);
 
+      // do escape
+      char* out = buf.data();
+      R_len_t o = 0;
+      R_len_t j = 0;
+      UChar32 c;
+      char tmp[11];
+      const uint64_t ones = UINT64_C(0x0101010101010101);
+      const uint64_t high = ones*UINT64_C(0x80);
       while (j < str_cur_n) {
+         // bulk pass-through: whole words of plain printable ASCII
+         // (no quotes, no apostrophes, no backslashes) copied verbatim
+         while (j+8 <= str_cur_n) {
+            uint64_t w;
+            memcpy(&w, str_cur_s+j, 8);
+            if (w & high) break; // a non-ASCII byte somewhere
+            // the high bit marks bytes in [0x20, 0x7e] (no carries -
+            // all bytes are ASCII here)
+            uint64_t printable = ((w + ones*UINT64_C(0x60)) & ~(w + ones)) & high;
+            if (printable != high) break; // a control char or DEL
+            if (stri__swar_eq(w, 0x22) | stri__swar_eq(w, 0x27) | stri__swar_eq(w, 0x5c))
+               break;
+            memcpy(out+o, str_cur_s+j, 8);
+            o += 8;
+            j += 8;
+         }
+         if (j >= str_cur_n) break;
+
          U8_NEXT(str_cur_s, j, str_cur_n, c);
          if (c < 0)
             throw StriException(MSG__INVALID_UTF8);
-         else if ((char)c >= 32 && (char)c <= 126)
-            bufsize += 1;
-         else if (c <= 0xff)
-            bufsize += 6; // for \a, \n this will be overestimated
-         else
-            bufsize += 10;
-      }
-      out.clear();
-      if ((size_t)bufsize > (size_t)out.size())
-         out.reserve(bufsize);
-
-      // do escape
-      j = 0;
-      char buf[11];
-      while (j < str_cur_n) {
-         U8_NEXT(str_cur_s, j, str_cur_n, c);
-         /* if (c < 0)
-            throw StriException(MSG__INVALID_UTF8); // this has already been checked :)
-         else */ if (c <= ASCII_MAXCHARCODE) {
+         else if (c <= ASCII_MAXCHARCODE) {
             switch ((char)c) {
-               case 0x07: out.append("\\a"); break;
-               case 0x08: out.append("\\b"); break;
-               case 0x09: out.append("\\t"); break;
-               case 0x0a: out.append("\\n"); break;
-               case 0x0b: out.append("\\v"); break;
-               case 0x0c: out.append("\\f"); break;
-               case 0x0d: out.append("\\r"); break;
-//               case 0x1b: out.append("\\e"); break; // R doesn't know that
-               case 0x22: out.append("\\\""); break;
-               case 0x27: out.append("\\'"); break;
-               case 0x5c: out.append("\\\\"); break;
+               case 0x07: memcpy(out+o, "\\a",  2); o += 2; break;
+               case 0x08: memcpy(out+o, "\\b",  2); o += 2; break;
+               case 0x09: memcpy(out+o, "\\t",  2); o += 2; break;
+               case 0x0a: memcpy(out+o, "\\n",  2); o += 2; break;
+               case 0x0b: memcpy(out+o, "\\v",  2); o += 2; break;
+               case 0x0c: memcpy(out+o, "\\f",  2); o += 2; break;
+               case 0x0d: memcpy(out+o, "\\r",  2); o += 2; break;
+//               case 0x1b: \e - R doesn't know that
+               case 0x22: memcpy(out+o, "\\\"", 2); o += 2; break;
+               case 0x27: memcpy(out+o, "\\'",  2); o += 2; break;
+               case 0x5c: memcpy(out+o, "\\\\", 2); o += 2; break;
                default:
                   if ((char)c >= 32 && (char)c <= 126) // printable characters
-                     out.append(1, (char)c);
+                     out[o++] = (char)c;
                   else {
-                     sprintf(buf, "\\u%4.4x", (uint16_t)c);
-                     out.append(buf, 6);
+                     sprintf(tmp, "\\u%4.4x", (uint16_t)c);
+                     memcpy(out+o, tmp, 6);
+                     o += 6;
                   }
             }
          }
          else if (c <= 0xffff) {
-            sprintf(buf, "\\u%4.4x", (uint16_t)c);
-            out.append(buf, 6);
+            sprintf(tmp, "\\u%4.4x", (uint16_t)c);
+            memcpy(out+o, tmp, 6);
+            o += 6;
          }
          else {
-            sprintf(buf, "\\U%8.8x", (uint32_t)c);
-            out.append(buf, 10);
+            sprintf(tmp, "\\U%8.8x", (uint32_t)c);
+            memcpy(out+o, tmp, 10);
+            o += 10;
          }
       }
 
       SET_STRING_ELT(ret, i,
-         Rf_mkCharLenCE(out.c_str(), (int)out.size(), (cetype_t)CE_UTF8)
+         Rf_mkCharLenCE(out, (int)o, (cetype_t)CE_UTF8)
       );
    }
 
@@ -157,6 +204,14 @@ SEXP stri_escape_unicode(SEXP str)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    backslash-free input (the common case) is returned unchanged,
+ *    without the UTF-16 round-trip
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    the as-is return is taken for bare vectors only, so the result
+ *    carries no attributes whichever path is taken
 */
 SEXP stri_unescape_unicode(SEXP str)
 {
@@ -164,6 +219,28 @@ SEXP stri_unescape_unicode(SEXP str)
 
    STRI__ERROR_HANDLER_BEGIN(1)
    R_len_t str_length = LENGTH(str);
+
+   // unescaping is the identity on anything without a backslash, so a
+   // plain memchr for 0x5c decides whether an element needs any work;
+   // a stray hit (0x5c may occur inside a multibyte char in some
+   // native encodings) merely takes the conversion path below;
+   // inputs with attributes are rebuilt nevertheless - the conversion
+   // path returns a bare vector, and the result must not depend on
+   // which path was taken
+   if (ATTRIB(str) == R_NilValue) {
+      R_len_t first_esc = 0;
+      for (; first_esc < str_length; ++first_esc) {
+         SEXP curs = STRING_ELT(str, first_esc);
+         if (curs == NA_STRING) continue;
+         if (memchr(CHAR(curs), '\\', LENGTH(curs)) != NULL) break;
+      }
+      if (first_esc >= str_length) {
+         // no escapes anywhere - the result is the input itself
+         STRI__UNPROTECT_ALL
+         return str;
+      }
+   }
+
    StriContainerUTF16 str_cont(str, str_length, false); // writable
 
    for (R_len_t i = str_cont.vectorize_init();
@@ -173,6 +250,10 @@ SEXP stri_unescape_unicode(SEXP str)
       if (str_cont.isNA(i) || str_cont.get(i).length() == 0)
          continue; // leave as-is
 
+      SEXP curs = STRING_ELT(str, i);
+      if (memchr(CHAR(curs), '\\', LENGTH(curs)) == NULL)
+         continue; // nothing to unescape in this element
+
       str_cont.getWritable(i).setTo(str_cont.get(i).unescape());
 
       if (str_cont.get(i).length() == 0) {
@@ -40,7 +40,13 @@ using namespace std;
 #define StriException_BUFSIZE 1024
 
 
+// deferred ICU warm-up (u_init), see stri_stringi.cpp
+extern bool stri__icu_initialized;
+void stri__icu_init();
+
+
 #define STRI__ERROR_HANDLER_BEGIN(nprotect)                 \
+   if (!stri__icu_initialized) stri__icu_init();            \
    int __stri_protected_sexp_num = nprotect;                \
    char* __stri_error_msg = (char*)NULL;                    \
    try {
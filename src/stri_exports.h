@@ -55,6 +55,7 @@ SEXP stri_order(SEXP str, SEXP decreasing=Rf_ScalarLogical(FALSE),
    SEXP na_last=Rf_ScalarLogical(TRUE), SEXP opts_collator=R_NilValue);
 
 SEXP stri_unique(SEXP str, SEXP opts_collator=R_NilValue);
+SEXP stri_rank(SEXP str, SEXP opts_collator=R_NilValue);
 SEXP stri_duplicated(SEXP str, SEXP fromLast=Rf_ScalarLogical(FALSE),
    SEXP opts_collator=R_NilValue);
 SEXP stri_duplicated_any(SEXP str, SEXP fromLast=Rf_ScalarLogical(FALSE),
@@ -92,6 +93,13 @@ SEXP stri_sub_replacement(SEXP str, SEXP from, SEXP to, SEXP length, SEXP omit_n
 SEXP stri_sub_all(SEXP str, SEXP from, SEXP to, SEXP length);
 SEXP stri_sub_replacement_all(SEXP str, SEXP from, SEXP to, SEXP length, SEXP omit_na, SEXP value);
 
+// index.cpp:
+SEXP stri_sub_index(SEXP str);
+SEXP stri_boundaries_index(SEXP str);
+SEXP stri_deferred_string(SEXP fun, SEXP str);
+SEXP stri_prepared(SEXP str, SEXP deep=Rf_ScalarLogical(TRUE));
+SEXP stri_pipeline(SEXP str, SEXP steps, SEXP locale=R_NilValue);
+
 // encoding_management.cpp:
 SEXP stri_enc_list();
 SEXP stri_enc_info(SEXP enc=R_NilValue);
@@ -123,6 +131,9 @@ SEXP stri_trans_general(SEXP str, SEXP id);
 // utils.cpp
 SEXP stri_list2matrix(SEXP x, SEXP byrow=Rf_ScalarLogical(FALSE),
    SEXP fill=Rf_ScalarString(NA_STRING), SEXP n_min=Rf_ScalarInteger(0));
+SEXP stri_na2empty(SEXP x);
+SEXP stri_remove_empty(SEXP x, SEXP na_empty=Rf_ScalarLogical(FALSE));
+SEXP stri_remove_na(SEXP x);
 
 
 // encoding_conversion.cpp:
@@ -135,6 +146,35 @@ SEXP stri_enc_toutf8(SEXP str, SEXP is_unknown_8bit=Rf_ScalarLogical(FALSE),
 SEXP stri_enc_toascii(SEXP str);
 
 
+// files.cpp:
+SEXP stri_read_lines_utf8(SEXP fname);
+SEXP stri_read_lines_conv(SEXP fname, SEXP encoding);
+SEXP stri_write_lines_native(SEXP str, SEXP fname, SEXP encoding, SEXP sep);
+SEXP stri_read_segments_utf8(SEXP fname, SEXP offset, SEXP max_bytes, SEXP opts_brkiter);
+
+// serialize.cpp:
+SEXP stri_save_strings(SEXP str, SEXP fname);
+SEXP stri_load_strings(SEXP fname);
+
+// search_regex_file.cpp:
+SEXP stri_count_regex_file(SEXP fname, SEXP pattern,
+   SEXP max_match_bytes=Rf_ScalarInteger(65536), SEXP opts_regex=R_NilValue);
+SEXP stri_locate_all_regex_file(SEXP fname, SEXP pattern,
+   SEXP max_match_bytes=Rf_ScalarInteger(65536), SEXP opts_regex=R_NilValue);
+
+// memstats.cpp:
+SEXP stri_mem_stats();
+
+// alloctrace.cpp:
+SEXP stri_alloc_trace();
+
+// perfstats.cpp:
+SEXP stri_perf_stats();
+
+// cache.cpp:
+SEXP stri_cache_info();
+SEXP stri_cache_clear(SEXP which=R_NilValue);
+
 // encoding_detection.cpp:
 SEXP stri_enc_detect2(SEXP str, SEXP loc=R_NilValue);
 SEXP stri_enc_detect(SEXP str, SEXP filter_angle_brackets=Rf_ScalarLogical(FALSE));
@@ -163,6 +203,7 @@ SEXP stri_trans_char(SEXP str, SEXP pattern, SEXP replacement);
 SEXP stri_trans_totitle(SEXP str, SEXP opts_brkiter=R_NilValue);
 SEXP stri_trans_tolower(SEXP str, SEXP locale=R_NilValue);
 SEXP stri_trans_toupper(SEXP str, SEXP locale=R_NilValue);
+SEXP stri_unique_casefold(SEXP str);
 
 // trans_normalization.cpp:
 SEXP stri_trans_nfc(SEXP s);
@@ -185,7 +226,7 @@ SEXP stri_replace_na(SEXP str, SEXP replacement=Rf_mkString("NA"));
 SEXP stri_detect_coll(SEXP str, SEXP pattern,
     SEXP negate=Rf_ScalarLogical(FALSE), SEXP max_count=Rf_ScalarInteger(-1),
     SEXP opts_collator=R_NilValue);
-SEXP stri_count_coll(SEXP str, SEXP pattern, SEXP opts_collator=R_NilValue);
+SEXP stri_count_coll(SEXP str, SEXP pattern, SEXP max_count=Rf_ScalarInteger(-1), SEXP opts_collator=R_NilValue);
 SEXP stri_locate_all_coll(SEXP str, SEXP pattern,
    SEXP omit_no_match=Rf_ScalarLogical(FALSE), SEXP opts_collator=R_NilValue);
 SEXP stri_locate_first_coll(SEXP str, SEXP pattern, SEXP opts_collator=R_NilValue);
@@ -212,14 +253,48 @@ SEXP stri_subset_coll(SEXP str, SEXP pattern,
    SEXP omit_na=Rf_ScalarLogical(FALSE), SEXP negate=Rf_ScalarLogical(FALSE), SEXP opts_collator=R_NilValue);
 SEXP stri_subset_coll_replacement(SEXP str, SEXP pattern, SEXP negate, SEXP opts_collator, SEXP value);
 
+SEXP stri_fixed_pattern(SEXP pattern, SEXP opts_fixed=R_NilValue);
+SEXP stri_trigram_index(SEXP str);
+SEXP stri_detect_fixed_indexed(SEXP index, SEXP pattern,
+   SEXP negate=Rf_ScalarLogical(FALSE));
+SEXP stri_count_fixed_indexed(SEXP index, SEXP pattern);
+SEXP stri_subset_fixed_indexed(SEXP index, SEXP pattern,
+   SEXP omit_na=Rf_ScalarLogical(FALSE), SEXP negate=Rf_ScalarLogical(FALSE));
+SEXP stri_suffix_index(SEXP str);
+SEXP stri_locate_all_suffix(SEXP index, SEXP pattern,
+   SEXP omit_no_match=Rf_ScalarLogical(FALSE),
+   SEXP overlap=Rf_ScalarLogical(FALSE));
+SEXP stri_mmap_lines(SEXP fname);
+SEXP stri_mmap_lines_count(SEXP map);
+SEXP stri_detect_fixed_mapped(SEXP map, SEXP pattern,
+   SEXP negate=Rf_ScalarLogical(FALSE));
+SEXP stri_count_fixed_mapped(SEXP map, SEXP pattern);
+SEXP stri_length_mapped(SEXP map);
 SEXP stri_detect_fixed(SEXP str, SEXP pattern,
     SEXP negate=Rf_ScalarLogical(FALSE), SEXP max_count=Rf_ScalarInteger(-1),
     SEXP opts_fixed=R_NilValue);
-SEXP stri_count_fixed(SEXP str, SEXP pattern, SEXP opts_fixed=R_NilValue);
+SEXP stri_detect_any_fixed(SEXP str, SEXP pattern,
+    SEXP negate=Rf_ScalarLogical(FALSE), SEXP opts_fixed=R_NilValue);
+SEXP stri_detect_each_fixed(SEXP str, SEXP pattern,
+   SEXP negate=Rf_ScalarLogical(FALSE), SEXP opts_fixed=R_NilValue);
+SEXP stri_count_fixed(SEXP str, SEXP pattern, SEXP max_count=Rf_ScalarInteger(-1), SEXP opts_fixed=R_NilValue);
 SEXP stri_locate_all_fixed(SEXP str, SEXP pattern,
-   SEXP omit_no_match=Rf_ScalarLogical(FALSE), SEXP opts_fixed=R_NilValue);
+   SEXP omit_no_match=Rf_ScalarLogical(FALSE),
+   SEXP invert=Rf_ScalarLogical(FALSE), SEXP opts_fixed=R_NilValue);
 SEXP stri_locate_first_fixed(SEXP str, SEXP pattern, SEXP opts_fixed=R_NilValue);
 SEXP stri_locate_last_fixed(SEXP str, SEXP pattern, SEXP opts_fixed=R_NilValue);
+SEXP stri_detect_fuzzy(SEXP str, SEXP pattern,
+   SEXP negate=Rf_ScalarLogical(FALSE),
+   SEXP max_distance=Rf_ScalarInteger(1));
+SEXP stri_count_fuzzy(SEXP str, SEXP pattern,
+   SEXP max_distance=Rf_ScalarInteger(1));
+SEXP stri_locate_all_fuzzy(SEXP str, SEXP pattern,
+   SEXP omit_no_match=Rf_ScalarLogical(FALSE),
+   SEXP max_distance=Rf_ScalarInteger(1));
+SEXP stri_locate_first_fuzzy(SEXP str, SEXP pattern,
+   SEXP max_distance=Rf_ScalarInteger(1));
+SEXP stri_locate_last_fuzzy(SEXP str, SEXP pattern,
+   SEXP max_distance=Rf_ScalarInteger(1));
 SEXP stri_extract_first_fixed(SEXP str, SEXP pattern, SEXP opts_fixed=R_NilValue);
 SEXP stri_extract_last_fixed(SEXP str, SEXP pattern, SEXP opts_fixed=R_NilValue);
 SEXP stri_extract_all_fixed(SEXP str, SEXP pattern,
@@ -231,6 +306,7 @@ SEXP stri_replace_first_fixed(SEXP str, SEXP pattern, SEXP replacement,
    SEXP opts_fixed=R_NilValue);
 SEXP stri_replace_last_fixed(SEXP str, SEXP pattern, SEXP replacement,
    SEXP opts_fixed=R_NilValue);
+SEXP stri_replace_map_fixed(SEXP str, SEXP pattern, SEXP replacement);
 SEXP stri_split_fixed(SEXP str, SEXP split, SEXP n=Rf_ScalarInteger(-1),
    SEXP omit_empty=Rf_ScalarLogical(FALSE), SEXP tokens_only=Rf_ScalarLogical(FALSE),
    SEXP simplify=Rf_ScalarLogical(FALSE), SEXP opts_fixed=R_NilValue);
@@ -242,10 +318,11 @@ SEXP stri_startswith_fixed(SEXP str, SEXP pattern, SEXP from=Rf_ScalarInteger(1)
    SEXP opts_fixed=R_NilValue);
 SEXP stri_subset_fixed_replacement(SEXP str, SEXP pattern, SEXP negate, SEXP opts_fixed, SEXP value);
 
+SEXP stri_regex_pattern(SEXP pattern, SEXP opts_regex=R_NilValue);
 SEXP stri_detect_regex(SEXP str, SEXP pattern,
     SEXP negate=Rf_ScalarLogical(FALSE), SEXP max_count=Rf_ScalarInteger(-1),
     SEXP opts_regex=R_NilValue);
-SEXP stri_count_regex(SEXP str, SEXP pattern, SEXP opts_regex=R_NilValue);
+SEXP stri_count_regex(SEXP str, SEXP pattern, SEXP max_count=Rf_ScalarInteger(-1), SEXP opts_regex=R_NilValue);
 SEXP stri_locate_all_regex(SEXP str, SEXP pattern,
    SEXP omit_no_match=Rf_ScalarLogical(FALSE), SEXP opts_regex=R_NilValue);
 SEXP stri_locate_first_regex(SEXP str, SEXP pattern, SEXP opts_regex=R_NilValue);
@@ -311,6 +388,7 @@ SEXP stri_split_boundaries(SEXP str, SEXP n=Rf_ScalarInteger(-1),
    SEXP tokens_only=Rf_ScalarLogical(FALSE),
    SEXP simplify=Rf_ScalarLogical(FALSE), SEXP opts_brkiter=R_NilValue);
 SEXP stri_count_boundaries(SEXP str, SEXP opts_brkiter=R_NilValue);
+SEXP stri_count_boundaries_locales(SEXP str, SEXP locale, SEXP opts_brkiter=R_NilValue);
 
 
 // date/time
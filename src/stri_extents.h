@@ -0,0 +1,110 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_extents_h
+#define __stri_extents_h
+
+#include <deque>
+#include <vector>
+#include <utility>
+
+
+/**
+ * Byte extents collected for an *_extract_all-style result
+ *
+ * The scan loop (break iteration, pattern matching) appends plain
+ * integer pairs here, away from the R allocator; toR() then performs
+ * all the R allocations in one tight batched pass. This keeps garbage
+ * collection out of the scan loops and builds each CHARSXP while its
+ * source bytes are still cache-hot.
+ *
+ * Extents must be pushed in element order (i non-decreasing), which is
+ * what every vectorized loop does anyway.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+class StriExtractExtents {
+
+   private:
+
+      R_len_t n;                                         ///< number of elements
+      std::deque< std::pair<R_len_t,R_len_t> > extents;  ///< element-major [from,to)
+      std::vector<R_len_t> counts;  ///< extents per element; NA_INTEGER - NA element
+
+
+   public:
+
+      StriExtractExtents(R_len_t _n)
+         : n(_n), counts((size_t)_n, 0) { }
+
+      /** the i-th element of the result is NA */
+      void markNA(R_len_t i) {
+         counts[i] = NA_INTEGER;
+      }
+
+      /** append a [from,to) byte extent to the i-th element */
+      void push(R_len_t i, R_len_t from, R_len_t to) {
+         extents.push_back(std::pair<R_len_t,R_len_t>(from, to));
+         counts[i]++;
+      }
+
+      /** build the list of character vectors; the returned object is
+       *  freshly allocated and not protected - the caller protects */
+      SEXP toR(const StriContainerUTF8& str_cont, bool omit_no_match) {
+         SEXP ret;
+         PROTECT(ret = Rf_allocVector(VECSXP, n));
+         std::deque< std::pair<R_len_t,R_len_t> >::iterator iter = extents.begin();
+         for (R_len_t i=0; i<n; ++i) {
+            if (counts[i] == NA_INTEGER) {
+               SET_VECTOR_ELT(ret, i, stri__vector_NA_strings(1));
+               continue;
+            }
+            if (counts[i] <= 0) {
+               SET_VECTOR_ELT(ret, i, stri__vector_NA_strings(omit_no_match?0:1));
+               continue;
+            }
+
+            const char* str_cur_s = str_cont.get(i).c_str();
+            SEXP cur_res;
+            PROTECT(cur_res = Rf_allocVector(STRSXP, counts[i]));
+            for (R_len_t j=0; j<counts[i]; ++j, ++iter)
+               SET_STRING_ELT(cur_res, j, Rf_mkCharLenCE(
+                  str_cur_s+(*iter).first, (*iter).second-(*iter).first, CE_UTF8));
+            SET_VECTOR_ELT(ret, i, cur_res);
+            UNPROTECT(1);
+         }
+         UNPROTECT(1);
+         return ret;
+      }
+};
+
+#endif
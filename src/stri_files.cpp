@@ -0,0 +1,396 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_brkiter.h"
+#include "stri_ucnv.h"
+#include "stri_string8buf.h"
+#include "stri_files.h"
+#include <utility>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+/**
+ * Read a UTF-8 (or ASCII) text file and split it into lines
+ *
+ * The file is mapped, validated as a whole and cut at the newlines
+ * in a single memchr-driven pass - no intermediate raw vector and
+ * no whole-file string are ever materialized on the R heap.
+ * A CR preceding a LF is stripped (Windows line ends); the other
+ * Unicode newline markers are left alone, mirroring what
+ * stri_split_lines1 would do only for files that actually use them.
+ *
+ * @param fname single string, file path
+ * @return character vector (UTF-8), or NULL if the content is not
+ *    valid UTF-8 (the caller is expected to fall back to re-encoding)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_read_lines_utf8(SEXP fname)
+{
+   const char* fname_s = stri__prepare_arg_string_1_notNA(fname, "fname");
+
+   StriMappedFile file;
+   if (!file.open(fname_s))
+      Rf_error(MSG__FILE_READ_ERROR, fname_s);
+
+   if (file.size > (size_t)INT_MAX) {
+      // too large for the R_len_t-based machinery - let R handle it
+      file.close();
+      return R_NilValue;
+   }
+
+   if (file.size > 0 &&
+         stri__enc_check_utf8(file.data, (R_len_t)file.size, false) < 1.0) {
+      // not valid UTF-8 (or embedded NULs) - fall back to re-encoding
+      file.close();
+      return R_NilValue;
+   }
+
+   STRI__ERROR_HANDLER_BEGIN(0)
+
+   R_len_t nlines = 0;
+   const char* cur = file.data;
+   const char* end = file.data+file.size;
+   while (cur < end) {
+      const char* nl = (const char*)memchr(cur, '\n', (size_t)(end-cur));
+      ++nlines;
+      if (!nl) break;
+      cur = nl+1;
+   }
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(STRSXP, nlines));
+   cur = file.data;
+   R_len_t i = 0;
+   while (cur < end) {
+      const char* nl = (const char*)memchr(cur, '\n', (size_t)(end-cur));
+      const char* eol = (nl)?nl:end;
+      R_len_t curn = (R_len_t)(eol-cur);
+      if (curn > 0 && eol[-1] == '\r') --curn; // CR LF
+      SET_STRING_ELT(ret, i++, Rf_mkCharLenCE(cur, curn, CE_UTF8));
+      if (!nl) break;
+      cur = nl+1;
+   }
+
+   file.close();
+   STRI__UNPROTECT_ALL
+   return ret;
+
+   STRI__ERROR_HANDLER_END({ file.close(); })
+}
+
+
+/**
+ * Read one batch of boundary-delimited segments from a UTF-8 text file
+ *
+ * One step of the streaming segmenter, see stri_read_segments in R.
+ * The file is mapped (no R-heap copy of its contents is made) and a
+ * window of at most max_bytes is handed to a break iterator. In a
+ * non-final window the last field is withheld - text beyond the window
+ * could still extend it - and the next call resumes at its start, so
+ * every emitted boundary is exact. Windows that are too small to hold
+ * two fields are grown automatically.
+ *
+ * @param fname single string, file path
+ * @param offset double, byte offset to resume at (0 for the first call)
+ * @param max_bytes single integer, soft window size
+ * @param opts_brkiter named list, the default type is "sentence"
+ * @return NULL when offset is at end of file, otherwise
+ *    list(segments [character], next_offset [double])
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_read_segments_utf8(SEXP fname, SEXP offset, SEXP max_bytes, SEXP opts_brkiter)
+{
+   const char* fname_s = stri__prepare_arg_string_1_notNA(fname, "fname");
+   double offset_1 = stri__prepare_arg_double_1_notNA(offset, "offset");
+   int max_bytes_1 = stri__prepare_arg_integer_1_notNA(max_bytes, "max_bytes");
+   if (offset_1 < 0 || max_bytes_1 < 1024)
+      Rf_error(MSG__INCORRECT_INTERNAL_ARG);
+   StriBrkIterOptions opts_brkiter2(opts_brkiter, "sentence");
+
+   StriMappedFile file;
+   if (!file.open(fname_s))
+      Rf_error(MSG__FILE_READ_ERROR, fname_s);
+
+   if ((size_t)offset_1 >= file.size) { // end of file
+      file.close();
+      return R_NilValue;
+   }
+
+   STRI__ERROR_HANDLER_BEGIN(0)
+   size_t from = (size_t)offset_1;
+   const char* s = file.data+from;
+   size_t remaining = file.size-from;
+   size_t len = ((size_t)max_bytes_1 < remaining)?(size_t)max_bytes_1:remaining;
+   StriRuleBasedBreakIterator brkiter(opts_brkiter2);
+
+   deque< pair<R_len_t,R_len_t> > fields;
+   bool final_window;
+   for (;;) {
+      final_window = (len == remaining);
+      if (!final_window) // cut at a code point boundary
+         while (len > 0 && ((unsigned char)s[len] & 0xc0) == 0x80) --len;
+      if (len > (size_t)INT_MAX)
+         throw StriException(MSG__EXPECTED_SMALLER, "max_bytes");
+      if (stri__enc_check_utf8(s, (R_len_t)len, false) < 1.0)
+         throw StriException(MSG__INVALID_UTF8);
+
+      fields.clear();
+      brkiter.setupMatcher(s, (R_len_t)len);
+      brkiter.first();
+      pair<R_len_t,R_len_t> curpair;
+      while (brkiter.next(curpair))
+         fields.push_back(curpair);
+
+      if (final_window || fields.size() >= 2) break;
+      // the whole window is one field - it may continue past the end;
+      // grow the window and retry
+      len = (2*len < remaining)?2*len:remaining;
+   }
+
+   double next_offset;
+   if (final_window)
+      next_offset = (double)file.size;
+   else {
+      next_offset = (double)(from+(size_t)fields.back().first);
+      fields.pop_back(); // its closing boundary is not certain yet
+   }
+
+   SEXP segments;
+   STRI__PROTECT(segments = Rf_allocVector(STRSXP, (R_len_t)fields.size()));
+   deque< pair<R_len_t,R_len_t> >::iterator iter = fields.begin();
+   for (R_len_t k = 0; iter != fields.end(); ++iter, ++k) {
+      SET_STRING_ELT(segments, k, Rf_mkCharLenCE(s+(*iter).first,
+         (*iter).second-(*iter).first, CE_UTF8));
+   }
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(VECSXP, 2));
+   SET_VECTOR_ELT(ret, 0, segments);
+   SET_VECTOR_ELT(ret, 1, Rf_ScalarReal(next_offset));
+   stri__set_names(ret, 2, "segments", "next_offset");
+
+   file.close();
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({ file.close(); })
+}
+
+
+/**
+ * Read a text file in a declared encoding and split it into lines
+ *
+ * The native companion of the UTF-8 fast path for every other charset:
+ * the file is mapped, its bytes are pumped through a bounded-memory
+ * streaming converter (stri__encode_streamed) into one UTF-8 arena,
+ * and the lines are carved out of that arena directly - the only
+ * whole-file copy on the R heap is the final STRSXP. The readLines /
+ * stri_read_raw + stri_encode route materializes the raw vector, the
+ * re-encoded string and the line list all at once.
+ *
+ * @param fname single string, file path
+ * @param encoding single string, name of the input encoding
+ * @return character vector (UTF-8), or NULL if the file does not fit
+ *    the R_len_t-based machinery (the caller falls back to R)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_read_lines_conv(SEXP fname, SEXP encoding)
+{
+   const char* fname_s = stri__prepare_arg_string_1_notNA(fname, "fname");
+   const char* selected_from = stri__prepare_arg_enc(encoding, "encoding", true); /* this is R_alloc'ed */
+
+   StriMappedFile file;
+   if (!file.open(fname_s))
+      Rf_error(MSG__FILE_READ_ERROR, fname_s); // error() call allowed here
+
+   if (file.size > (size_t)INT_MAX) {
+      // too large for the R_len_t-based machinery - let R handle it
+      file.close();
+      return R_NilValue;
+   }
+
+   STRI__ERROR_HANDLER_BEGIN(0)
+
+   StriUcnv ucnv_from_obj(selected_from);
+   StriUcnv ucnv_to_obj("UTF-8");
+   UConverter* uconv_from = ucnv_from_obj.getConverter(true/*register_callbacks*/);
+   UConverter* uconv_to = ucnv_to_obj.getConverter(true/*register_callbacks*/);
+
+   String8buf arena((R_len_t)file.size+16);
+   R_len_t arena_n = 0;
+   if (file.size > 0) {
+      UErrorCode status = U_ZERO_ERROR;
+      arena_n = stri__encode_streamed(file.data, (R_len_t)file.size,
+         uconv_from, uconv_to, arena, status);
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+   }
+   file.close(); // the arena owns everything we still need
+
+   R_len_t nlines = 0;
+   const char* cur = arena.data();
+   const char* end = arena.data()+arena_n;
+   while (cur < end) {
+      const char* nl = (const char*)memchr(cur, '\n', (size_t)(end-cur));
+      ++nlines;
+      if (!nl) break;
+      cur = nl+1;
+   }
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(STRSXP, nlines));
+   cur = arena.data();
+   R_len_t i = 0;
+   while (cur < end) {
+      const char* nl = (const char*)memchr(cur, '\n', (size_t)(end-cur));
+      const char* eol = (nl)?nl:end;
+      R_len_t curn = (R_len_t)(eol-cur);
+      if (curn > 0 && eol[-1] == '\r') --curn; // CR LF
+      SET_STRING_ELT(ret, i++, Rf_mkCharLenCE(cur, curn, CE_UTF8));
+      if (!nl) break;
+      cur = nl+1;
+   }
+
+   STRI__UNPROTECT_ALL
+   return ret;
+
+   STRI__ERROR_HANDLER_END({ file.close(); })
+}
+
+
+/**
+ * Write a character vector to a file, one element per line
+ *
+ * The writer counterpart of stri_read_lines_conv: elements are handed
+ * to a large stdio buffer one by one - straight from the UTF-8
+ * payloads when the target encoding is UTF-8, or through the
+ * bounded-memory streaming converter into one reused scratch buffer
+ * otherwise. The full concatenated copy that the join + re-encode +
+ * writeBin route builds (twice, for multi-GB outputs) is never
+ * materialized. Missing values are written as "NA", as in writeLines.
+ *
+ * @param str character vector
+ * @param fname single string, file path
+ * @param encoding single string, name of the output encoding
+ * @param sep single string (UTF-8), appended after every element
+ * @return R_NilValue
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_write_lines_native(SEXP str, SEXP fname, SEXP encoding, SEXP sep)
+{
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+   PROTECT(sep = stri_prepare_arg_string_1(sep, "sep"));
+   const char* fname_s = stri__prepare_arg_string_1_notNA(fname, "fname");
+   const char* selected_to = stri__prepare_arg_enc(encoding, "encoding", true); /* this is R_alloc'ed */
+
+   FILE* out = fopen(fname_s, "wb");
+   if (!out)
+      Rf_error(MSG__FILE_WRITE_ERROR, fname_s); // error() call allowed here
+   setvbuf(out, NULL, _IOFBF, 1<<20); // gather the short lines into 1 MiB writes
+
+   STRI__ERROR_HANDLER_BEGIN(2)
+   R_len_t vectorize_length = LENGTH(str);
+   StriContainerUTF8 str_cont(str, vectorize_length);
+   StriContainerUTF8 sep_cont(sep, 1);
+
+   StriUcnv ucnv_to_obj(selected_to);
+   bool to_utf8 = ucnv_to_obj.isUTF8();
+
+   UConverter* uconv_from = NULL;
+   UConverter* uconv_to = NULL;
+   String8buf convbuf(0);
+   std::string sep_conv; // the separator converted once, reused
+   const char* sep_s = sep_cont.isNA(0) ? "" : sep_cont.get(0).c_str();
+   R_len_t sep_n = sep_cont.isNA(0) ? 0 : sep_cont.get(0).length();
+   if (!to_utf8) {
+      StriUcnv ucnv_from_obj("UTF-8");
+      uconv_from = ucnv_from_obj.getConverter(true/*register_callbacks*/);
+      uconv_to = ucnv_to_obj.getConverter(true/*register_callbacks*/);
+      // converters stay valid as long as the StriUcnv objects live -
+      // keep them alive for the whole loop below
+      UErrorCode status = U_ZERO_ERROR;
+      if (sep_n > 0) {
+         R_len_t got = stri__encode_streamed(sep_s, sep_n,
+            uconv_from, uconv_to, convbuf, status);
+         STRI__CHECKICUSTATUS_THROW(status, { fclose(out); })
+         sep_conv.assign(convbuf.data(), (size_t)got);
+         sep_s = sep_conv.data();
+         sep_n = (R_len_t)sep_conv.size();
+      }
+
+      for (R_len_t i=0; i<vectorize_length; ++i) {
+         const char* cur_s = str_cont.isNA(i) ? "NA" : str_cont.get(i).c_str();
+         R_len_t cur_n = str_cont.isNA(i) ? 2 : str_cont.get(i).length();
+         if (cur_n > 0) {
+            R_len_t got = stri__encode_streamed(cur_s, cur_n,
+               uconv_from, uconv_to, convbuf, status);
+            STRI__CHECKICUSTATUS_THROW(status, { fclose(out); })
+            if (got > 0 && fwrite(convbuf.data(), 1, (size_t)got, out) != (size_t)got)
+               throw StriException(MSG__FILE_WRITE_ERROR, fname_s);
+         }
+         if (sep_n > 0 && fwrite(sep_s, 1, (size_t)sep_n, out) != (size_t)sep_n)
+            throw StriException(MSG__FILE_WRITE_ERROR, fname_s);
+      }
+   }
+   else {
+      // target is UTF-8: the payloads are written as they are
+      for (R_len_t i=0; i<vectorize_length; ++i) {
+         const char* cur_s = str_cont.isNA(i) ? "NA" : str_cont.get(i).c_str();
+         R_len_t cur_n = str_cont.isNA(i) ? 2 : str_cont.get(i).length();
+         if (cur_n > 0 && fwrite(cur_s, 1, (size_t)cur_n, out) != (size_t)cur_n)
+            throw StriException(MSG__FILE_WRITE_ERROR, fname_s);
+         if (sep_n > 0 && fwrite(sep_s, 1, (size_t)sep_n, out) != (size_t)sep_n)
+            throw StriException(MSG__FILE_WRITE_ERROR, fname_s);
+      }
+   }
+
+   if (fclose(out) != 0) {
+      out = NULL;
+      throw StriException(MSG__FILE_WRITE_ERROR, fname_s);
+   }
+   out = NULL;
+   STRI__UNPROTECT_ALL
+   return R_NilValue;
+   STRI__ERROR_HANDLER_END({ if (out) fclose(out); })
+}
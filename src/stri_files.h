@@ -0,0 +1,131 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __stri_files_h
+#define __stri_files_h
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+/** a whole file exposed as a read-only byte range
+ *
+ * On POSIX systems the file is memory-mapped, so opening is O(1) and
+ * pages are faulted in only as the line scanner reaches them. On Windows
+ * the file is simply read into a malloc'd buffer.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+struct StriMappedFile {
+   const char* data;
+   size_t size;
+#ifndef _WIN32
+   bool mapped;
+#endif
+
+   StriMappedFile() : data(NULL), size(0) {
+#ifndef _WIN32
+      mapped = false;
+#endif
+   }
+
+   /** maps/reads the file; returns false on any I/O failure */
+   bool open(const char* path) {
+#ifndef _WIN32
+      int fd = ::open(path, O_RDONLY);
+      if (fd < 0) return false;
+      struct stat st;
+      if (fstat(fd, &st) != 0 || st.st_size < 0 || !S_ISREG(st.st_mode)) {
+         ::close(fd);
+         return false;
+      }
+      size = (size_t)st.st_size;
+      if (size > 0) {
+         void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+         if (map == MAP_FAILED) {
+            ::close(fd);
+            return false;
+         }
+#ifdef MADV_SEQUENTIAL
+         madvise(map, size, MADV_SEQUENTIAL);
+#endif
+         data = (const char*)map;
+         mapped = true;
+      }
+      ::close(fd); // the mapping outlives the descriptor
+      return true;
+#else
+      FILE* f = fopen(path, "rb");
+      if (!f) return false;
+      if (fseek(f, 0, SEEK_END) != 0) { fclose(f); return false; }
+      long fsize = ftell(f);
+      if (fsize < 0) { fclose(f); return false; }
+      size = (size_t)fsize;
+      if (size > 0) {
+         char* buf = (char*)malloc(size);
+         if (!buf) { fclose(f); return false; }
+         rewind(f);
+         if (fread(buf, 1, size, f) != size) {
+            free(buf);
+            fclose(f);
+            return false;
+         }
+         data = buf;
+      }
+      fclose(f);
+      return true;
+#endif
+   }
+
+   void close() {
+#ifndef _WIN32
+      if (mapped) munmap((void*)data, size);
+      mapped = false;
+#else
+      if (data) free((void*)data);
+#endif
+      data = NULL;
+      size = 0;
+   }
+};
+
+
+
+#endif
@@ -0,0 +1,161 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_container_utf8.h"
+#include "stri_container_bytesearch.h"
+#include <cstring>
+
+
+/** the payload of a stri_fixed_pattern externalptr */
+struct StriFixedPatternPrepared {
+   char* pattern;     ///< own copy of the UTF-8 pattern (the matcher points at it)
+   R_len_t pattern_len;
+   uint32_t flags;
+   StriByteSearchMatcher* matcher;
+
+   StriFixedPatternPrepared(const char* s, R_len_t n, uint32_t _flags) {
+      pattern = new char[n+1];
+      if (!pattern) throw StriException(MSG__MEM_ALLOC_ERROR);
+      memcpy(pattern, s, (size_t)n);
+      pattern[n] = '\0';
+      pattern_len = n;
+      flags = _flags;
+      matcher = NULL;
+      try {
+         matcher = StriContainerByteSearch::createMatcher(pattern, pattern_len, flags);
+      }
+      catch (...) {
+         delete [] pattern;
+         throw;
+      }
+   }
+
+   ~StriFixedPatternPrepared() {
+      if (matcher) delete matcher;
+      delete [] pattern;
+   }
+};
+
+
+static void stri__fixed_pattern_finalizer(SEXP ptr)
+{
+   StriFixedPatternPrepared* p = (StriFixedPatternPrepared*)R_ExternalPtrAddr(ptr);
+   if (p) {
+      delete p;
+      R_ClearExternalPtr(ptr);
+   }
+}
+
+
+/** is this a stri_fixed_pattern externalptr? */
+bool stri__is_fixed_pattern(SEXP pattern)
+{
+   return (TYPEOF(pattern) == EXTPTRSXP
+      && R_ExternalPtrTag(pattern) == Rf_install("stri_fixed_pattern"));
+}
+
+
+/** accept a stri_fixed_pattern handle wherever a fixed search pattern goes
+ *
+ * For an ordinary argument this is equivalent to
+ * stri_prepare_arg_string(pattern, "pattern"). For a handle it returns the
+ * handle's own 1-element pattern vector and overrides pattern_flags and
+ * prepared with the precompiled state - opts_fixed passed alongside a
+ * handle are thus ignored (they were fixed at stri_fixed_pattern() time).
+ *
+ * @param pattern character vector or a stri_fixed_pattern externalptr
+ * @param pattern_flags [in/out] ByteSearch flags
+ * @param prepared [out] precompiled matcher (owned by the handle) or NULL
+ * @return character vector, ready to PROTECT
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri__fixed_pattern_unwrap(SEXP pattern, uint32_t& pattern_flags,
+   StriByteSearchMatcher*& prepared)
+{
+   if (!stri__is_fixed_pattern(pattern))
+      return stri_prepare_arg_string(pattern, "pattern");
+
+   StriFixedPatternPrepared* p =
+      (StriFixedPatternPrepared*)R_ExternalPtrAddr(pattern);
+   if (!p)
+      Rf_error(MSG__FIXED_PATTERN_INVALIDATED); // error() call allowed here
+
+   pattern_flags = p->flags;
+   prepared = p->matcher;
+   return R_ExternalPtrProtected(pattern);
+}
+
+
+/**
+ * Precompile a fixed search pattern
+ *
+ * The returned externalptr may be passed as `pattern` to the
+ * stri_*_fixed functions; the byte-search tables are then built once
+ * here instead of on every call.
+ *
+ * @param pattern single string
+ * @param opts_fixed list
+ * @return externalptr of class `stri_fixed_pattern`
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_fixed_pattern(SEXP pattern, SEXP opts_fixed)
+{
+   uint32_t pattern_flags =
+      StriContainerByteSearch::getByteSearchFlags(opts_fixed, /*allow_overlap*/true);
+   PROTECT(pattern = stri_prepare_arg_string_1(pattern, "pattern"));
+
+   if (STRING_ELT(pattern, 0) == NA_STRING) {
+      UNPROTECT(1);
+      Rf_error(MSG__ARG_EXPECTED_NOT_NA, "pattern"); // error() call allowed here
+   }
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriContainerUTF8 pattern_cont(pattern, 1);
+   if (pattern_cont.get(0).length() <= 0)
+      throw StriException(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+
+   StriFixedPatternPrepared* p = new StriFixedPatternPrepared(
+      pattern_cont.get(0).c_str(), pattern_cont.get(0).length(), pattern_flags);
+
+   SEXP ret;
+   STRI__PROTECT(ret = R_MakeExternalPtr(p,
+      Rf_install("stri_fixed_pattern"), pattern));
+   R_RegisterCFinalizerEx(ret, stri__fixed_pattern_finalizer, TRUE);
+   Rf_setAttrib(ret, R_ClassSymbol, Rf_mkString("stri_fixed_pattern"));
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
+}
@@ -0,0 +1,324 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_fuzzy_matcher_h
+#define __stri_fuzzy_matcher_h
+
+
+#ifndef USEARCH_DONE
+#define USEARCH_DONE -1
+#endif
+
+#include <vector>
+#include <stdint.h>
+
+
+/** maximal pattern length (in code points) supported by StriFuzzyMatcher;
+ *  one bit of the machine word per pattern position */
+#define STRI__FUZZY_MAX_PATTERN_LENGTH 64
+
+
+/**
+ * Approximate (edit distance <= k) substring matcher
+ *
+ * Myers' bit-parallel algorithm [G. Myers, A fast bit-vector algorithm
+ * for approximate string matching based on dynamic programming,
+ * J. ACM 46(3), 1999] in its semi-global variant: the whole pattern is
+ * matched against every substring of the text, O(n) words of work for
+ * patterns of up to 64 code points. The unit of comparison is the
+ * Unicode code point, so a single multibyte character counts as one
+ * insertion/deletion/substitution, not as several.
+ *
+ * Reported occurrences do not overlap: each scan resumes just past the
+ * previous match. A maximal run of viable end positions (prefix edit
+ * distance <= k) yields one occurrence, ending where the distance over
+ * that run is the smallest (ties: the earliest such end). The reported
+ * start gives the shortest substring attaining that distance.
+ *
+ * Byte offsets in, byte offsets out - exactly like StriByteSearchMatcher,
+ * so the frontends can share the container/index-translation machinery.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+class StriFuzzyMatcher {
+
+   private:
+
+      StriFuzzyMatcher(const StriFuzzyMatcher&); // no copy
+      void operator=(const StriFuzzyMatcher&);   // no assign
+
+      R_len_t m_patternLenCps;            ///< pattern length [code points]
+      int m_maxDistance;                  ///< maximal allowed edit distance
+      std::vector<UChar32> m_patternCps;  ///< decoded pattern
+      uint64_t m_peqAscii[128];           ///< position bit masks, ASCII
+      std::vector<UChar32> m_peqOtherChar; ///< non-ASCII pattern chars, sorted
+      std::vector<uint64_t> m_peqOtherMask; ///< their position bit masks
+
+      const char* m_searchStr;            ///< search string [not owned]
+      R_len_t m_searchLen;                ///< search string length [bytes]
+      R_len_t m_resumePos;                ///< where the next scan starts
+      R_len_t m_matchStart;               ///< last match, first byte
+      R_len_t m_matchEnd;                 ///< last match, one past last byte
+      int m_matchDistance;                ///< last match, edit distance
+
+
+      /** position bit mask of a text character (0 if not in the pattern) */
+      inline uint64_t getCharMask(UChar32 c) const
+      {
+         if ((uint32_t)c < 128) return m_peqAscii[c];
+         R_len_t lo = 0, hi = (R_len_t)m_peqOtherChar.size();
+         while (lo < hi) { // binary search, m_peqOtherChar is sorted
+            R_len_t mid = (lo+hi)/2;
+            if (m_peqOtherChar[mid] < c) lo = mid+1;
+            else hi = mid;
+         }
+         if (lo < (R_len_t)m_peqOtherChar.size() && m_peqOtherChar[lo] == c)
+            return m_peqOtherMask[lo];
+         return 0;
+      }
+
+
+      /** find the start of a distance-d occurrence ending at byte `end`
+       *
+       * The forward automaton only knows where matches end. Here we walk
+       * at most patternLen+maxDistance code points back from `end` and run
+       * the ordinary O(m*(m+k)) edit distance recurrence on the reversed
+       * pattern vs the reversed window; the shortest window whose distance
+       * equals d starts the occurrence. This costs O(m^2) per reported
+       * match only, not per scanned character.
+       */
+      R_len_t findMatchStart(R_len_t end, int d, R_len_t floor) const
+      {
+         R_len_t wmax = m_patternLenCps + m_maxDistance;
+         std::vector<UChar32> wcps;   // window code points, last-to-first
+         std::vector<R_len_t> woffs;  // their byte offsets
+         wcps.reserve(wmax); woffs.reserve(wmax);
+         R_len_t p = end;
+         // never cross `floor` (the end of the previous occurrence) -
+         // the forward scan has not seen anything before it either
+         while (p > floor && (R_len_t)wcps.size() < wmax) {
+            UChar32 c;
+            U8_PREV(m_searchStr, floor, p, c);
+            wcps.push_back(c); woffs.push_back(p);
+         }
+
+         R_len_t m = m_patternLenCps;
+         std::vector<int> col(m+1), ncol(m+1);
+         for (R_len_t i=0; i<=m; ++i) col[i] = (int)i;
+         for (R_len_t j=0; j<(R_len_t)wcps.size(); ++j) {
+            ncol[0] = (int)(j+1);
+            for (R_len_t i=1; i<=m; ++i) {
+               // reversed pattern char no. i is m_patternCps[m-i]
+               int cost = (m_patternCps[m-i] == wcps[j]) ? 0 : 1;
+               int v = col[i-1]+cost;
+               if (col[i]+1 < v)  v = col[i]+1;
+               if (ncol[i-1]+1 < v) v = ncol[i-1]+1;
+               ncol[i] = v;
+            }
+            col.swap(ncol);
+            if (col[m] == d)
+               return woffs[j]; // shortest such window - done
+         }
+
+#ifndef NDEBUG
+         throw StriException("StriFuzzyMatcher: match start not found");
+#endif
+         return 0; // not reached: the forward scan guarantees a witness
+      }
+
+
+   public:
+
+      /** construct the matcher for a given pattern
+       *
+       * @param patternStr UTF-8 pattern
+       * @param patternLen pattern length [bytes]
+       * @param maxDistance maximal edit distance, in [0, patternLenCps)
+       */
+      StriFuzzyMatcher(const char* patternStr, R_len_t patternLen,
+         int maxDistance)
+      {
+         R_len_t j = 0;
+         while (j < patternLen) {
+            UChar32 c;
+            U8_NEXT(patternStr, j, patternLen, c);
+            if (c < 0) throw StriException(MSG__INVALID_UTF8);
+            m_patternCps.push_back(c);
+         }
+         m_patternLenCps = (R_len_t)m_patternCps.size();
+         if (m_patternLenCps > STRI__FUZZY_MAX_PATTERN_LENGTH)
+            throw StriException(MSG__FUZZY_PATTERN_TOO_LONG,
+               STRI__FUZZY_MAX_PATTERN_LENGTH);
+         if (maxDistance < 0 || maxDistance >= m_patternLenCps)
+            throw StriException(MSG__FUZZY_MAX_DISTANCE_INVALID);
+         m_maxDistance = maxDistance;
+
+         for (int t=0; t<128; ++t) m_peqAscii[t] = 0;
+         for (R_len_t i=0; i<m_patternLenCps; ++i) {
+            UChar32 c = m_patternCps[i];
+            uint64_t bit = ((uint64_t)1) << i;
+            if ((uint32_t)c < 128) { m_peqAscii[c] |= bit; continue; }
+            // keep (char, mask) sorted by char; patterns are short,
+            // insertion by shifting is fine
+            R_len_t k = (R_len_t)m_peqOtherChar.size();
+            m_peqOtherChar.push_back(0); m_peqOtherMask.push_back(0);
+            while (k > 0 && m_peqOtherChar[k-1] > c) {
+               m_peqOtherChar[k] = m_peqOtherChar[k-1];
+               m_peqOtherMask[k] = m_peqOtherMask[k-1];
+               --k;
+            }
+            if (k > 0 && m_peqOtherChar[k-1] == c) {
+               m_peqOtherMask[k-1] |= bit;
+               m_peqOtherChar.pop_back(); m_peqOtherMask.pop_back();
+            }
+            else {
+               m_peqOtherChar[k] = c; m_peqOtherMask[k] = bit;
+            }
+         }
+
+         m_searchStr = NULL;
+         m_searchLen = 0;
+         m_resumePos = 0;
+         m_matchStart = -1;
+         m_matchEnd = -1;
+         m_matchDistance = -1;
+      }
+
+
+      virtual ~StriFuzzyMatcher() { }
+
+
+      /** set/reset the search string
+       *
+       * @param searchStr UTF-8 search string [not copied]
+       * @param searchLen search string length [bytes]
+       */
+      void reset(const char* searchStr, R_len_t searchLen)
+      {
+         m_searchStr = searchStr;
+         m_searchLen = searchLen;
+         m_resumePos = 0;
+         m_matchStart = -1;
+         m_matchEnd = -1;
+         m_matchDistance = -1;
+      }
+
+
+      /** find the next occurrence (non-overlapping enumeration)
+       * @return byte index of the match start or USEARCH_DONE
+       */
+      R_len_t findNext()
+      {
+         R_len_t m = m_patternLenCps;
+         uint64_t highbit = ((uint64_t)1) << (m-1);
+         uint64_t PV = ~((uint64_t)0), MV = 0;
+         int score = (int)m;
+         R_len_t best_end = -1;
+         int best_score = m_maxDistance+1;
+
+         R_len_t pos = m_resumePos;
+         while (pos < m_searchLen) {
+            UChar32 c;
+            U8_NEXT(m_searchStr, pos, m_searchLen, c);
+            if (c < 0) throw StriException(MSG__INVALID_UTF8);
+            uint64_t EQ = getCharMask(c);
+
+            // [Myers 1999] one column of the DP table per machine word
+            uint64_t XV = EQ | MV;
+            uint64_t XH = (((EQ & PV) + PV) ^ PV) | EQ;
+            uint64_t PH = MV | ~(XH | PV);
+            uint64_t MH = PV & XH;
+            if (PH & highbit) ++score;
+            else if (MH & highbit) --score;
+            PH = (PH << 1) | ((uint64_t)1);
+            MH = (MH << 1);
+            PV = MH | ~(XV | PH);
+            MV = PH & XV;
+
+            if (score <= m_maxDistance) {
+               if (score < best_score) {
+                  best_score = score;
+                  best_end = pos;
+               }
+            }
+            else if (best_end >= 0)
+               break; // the run of viable ends is over - report its best
+         }
+
+         if (best_end < 0) {
+            m_matchStart = m_matchEnd = m_searchLen;
+            m_matchDistance = -1;
+            return USEARCH_DONE;
+         }
+
+         m_matchEnd = best_end;
+         m_matchDistance = best_score;
+         m_matchStart = findMatchStart(best_end, best_score, m_resumePos);
+         m_resumePos = best_end;
+         return m_matchStart;
+      }
+
+
+      /** get the start of the last match [byte index] */
+      inline R_len_t getMatchedStart() const
+      {
+#ifndef NDEBUG
+         if (m_matchStart < 0 || m_matchStart >= m_matchEnd)
+            throw StriException("StriFuzzyMatcher: no match at hand");
+#endif
+         return m_matchStart;
+      }
+
+
+      /** get the length of the last match [bytes] */
+      inline R_len_t getMatchedLength() const
+      {
+#ifndef NDEBUG
+         if (m_matchStart < 0 || m_matchStart >= m_matchEnd)
+            throw StriException("StriFuzzyMatcher: no match at hand");
+#endif
+         return m_matchEnd-m_matchStart;
+      }
+
+
+      /** get the edit distance of the last match */
+      inline int getMatchedDistance() const
+      {
+#ifndef NDEBUG
+         if (m_matchDistance < 0)
+            throw StriException("StriFuzzyMatcher: no match at hand");
+#endif
+         return m_matchDistance;
+      }
+};
+
+#endif
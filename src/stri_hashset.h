@@ -0,0 +1,115 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_hashset_h
+#define __stri_hashset_h
+
+#include <vector>
+#include <cstring>
+
+
+/** an open-addressed hash set of byte-string keys [internal]
+ *
+ * Keys are NUL-terminated byte strings with no interior zero bytes
+ * (true for collation keys and for UTF-8 text alike), kept in one
+ * contiguous arena; the slot table stores arena offsets. Used for
+ * single-pass deduplication: two elements are equal iff their keys
+ * are byte-identical, so one hash lookup replaces a comparison
+ * cascade.
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    factored out of stri_sort.cpp (where it held collation keys)
+ */
+class StriByteKeyHashSet {
+
+   private:
+
+      std::vector<uint8_t> arena; ///< the keys, back to back
+      std::vector<size_t> slots;  ///< arena offset+1; 0 marks an empty slot
+      size_t mask;                ///< slots.size()-1 (a power of two)
+      size_t used;
+
+      static inline uint32_t hashKey(const uint8_t* key) {
+         uint32_t h = 2166136261u; // FNV-1a
+         for (const uint8_t* p=key; *p; ++p)
+            h = (h ^ (uint32_t)*p) * 16777619u;
+         return h;
+      }
+
+      void rehash() {
+         size_t cap = slots.size()*2;
+         std::vector<size_t> fresh(cap, 0);
+         size_t m = cap-1;
+         size_t off = 0;
+         while (off < arena.size()) {
+            const uint8_t* key = &arena[off];
+            size_t j = (size_t)hashKey(key) & m;
+            while (fresh[j]) j = (j+1)&m;
+            fresh[j] = off+1;
+            off += strlen((const char*)key)+1;
+         }
+         slots.swap(fresh);
+         mask = m;
+      }
+
+      StriByteKeyHashSet(const StriByteKeyHashSet&); /* not copy-able */
+      StriByteKeyHashSet& operator=(const StriByteKeyHashSet&);
+
+   public:
+
+      StriByteKeyHashSet(R_len_t expected) {
+         size_t cap = 16;
+         while (cap < (size_t)expected*2) cap <<= 1;
+         slots.resize(cap, 0);
+         mask = cap-1;
+         used = 0;
+         arena.reserve((size_t)expected*8);
+      }
+
+      /** insert a key; true iff it was not present yet */
+      bool insert(const uint8_t* key, R_len_t keylen) {
+         size_t j = (size_t)hashKey(key) & mask;
+         while (slots[j]) {
+            if (0 == strcmp((const char*)&arena[slots[j]-1], (const char*)key))
+               return false;
+            j = (j+1)&mask;
+         }
+         slots[j] = arena.size()+1;
+         arena.insert(arena.end(), key, key+keylen);
+         ++used;
+         if (2*used > slots.size())
+            rehash();
+         return true;
+      }
+};
+
+#endif
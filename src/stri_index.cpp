@@ -0,0 +1,281 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_container_utf8.h"
+#include "stri_index.h"
+#include "stri_brkiter.h"
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+
+/** [internal] release everything a StriCpIndex owns */
+static void stri__cpindex_free(StriCpIndex* idx)
+{
+   if (!idx) return;
+   if (idx->samples) {
+      for (R_len_t k=0; k<idx->n; ++k)
+         if (idx->samples[k]) free(idx->samples[k]);
+      free(idx->samples);
+   }
+   if (idx->elems)    free(idx->elems);
+   if (idx->ncp)      free(idx->ncp);
+   if (idx->nsamples) free(idx->nsamples);
+   free(idx);
+}
+
+
+/** [internal] externalptr finalizer */
+static void stri__cpindex_finalizer(SEXP ptr)
+{
+   StriCpIndex* idx = (StriCpIndex*)R_ExternalPtrAddr(ptr);
+   if (idx) {
+      stri__cpindex_free(idx);
+      R_ClearExternalPtr(ptr);
+   }
+}
+
+
+/** [internal] fetch and validate the index attached to a character vector
+ *
+ * @param str character vector (before any re-preparation)
+ * @return the index, or NULL if absent, of the wrong type, or built
+ *    for different strings (every CHARSXP pointer is compared - an
+ *    O(n) pointer scan, negligible next to the work the index saves)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+const StriCpIndex* stri__cpindex_from_attrib(SEXP str)
+{
+   if (!isString(str)) return NULL;
+   SEXP ptr = Rf_getAttrib(str, Rf_install("stri_cpindex"));
+   if (TYPEOF(ptr) != EXTPTRSXP) return NULL;
+   if (R_ExternalPtrTag(ptr) != Rf_install("stri_cpindex")) return NULL;
+   const StriCpIndex* idx = (const StriCpIndex*)R_ExternalPtrAddr(ptr);
+   if (!idx || idx->n != LENGTH(str)) return NULL;
+   for (R_len_t k=0; k<idx->n; ++k)
+      if (idx->elems[k] != STRING_ELT(str, k))
+         return NULL; // the vector has been modified since indexing
+   return idx;
+}
+
+
+/**
+ * Build a persistent code point index for a character vector
+ *
+ * See stri_index.h for the layout; offsets refer to the UTF-8 form
+ * the containers convert to, so they remain valid for every later
+ * call working on the same (immutable) CHARSXPs.
+ *
+ * @param str character vector
+ * @return externalptr (finalized on gc), with the input kept alive
+ *    through the protected slot
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_sub_index(SEXP str)
+{
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+   R_len_t str_len = LENGTH(str);
+   StriCpIndex* idx = NULL;
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriContainerUTF8 str_cont(str, str_len);
+
+   idx = (StriCpIndex*)calloc(1, sizeof(StriCpIndex));
+   if (!idx) throw StriException(MSG__MEM_ALLOC_ERROR);
+   idx->n = str_len;
+   idx->elems    = (SEXP*)malloc(sizeof(SEXP)*((str_len>0)?str_len:1));
+   idx->ncp      = (R_len_t*)malloc(sizeof(R_len_t)*((str_len>0)?str_len:1));
+   idx->samples  = (R_len_t**)calloc((str_len>0)?str_len:1, sizeof(R_len_t*));
+   idx->nsamples = (R_len_t*)calloc((str_len>0)?str_len:1, sizeof(R_len_t));
+   if (!idx->elems || !idx->ncp || !idx->samples || !idx->nsamples)
+      throw StriException(MSG__MEM_ALLOC_ERROR);
+
+   std::vector<R_len_t> tmp;
+   for (R_len_t k=0; k<str_len; ++k) {
+      idx->elems[k] = STRING_ELT(str, k);
+      idx->ncp[k] = -1; // not indexed
+      if (str_cont.isNA(k) || str_cont.get(k).isASCII()
+            || str_cont.get(k).length() < STRI__CPINDEX_MIN_BYTES)
+         continue; // position lookups are already cheap here
+
+      const char* cur_s = str_cont.get(k).c_str();
+      R_len_t cur_n = str_cont.get(k).length();
+      tmp.clear();
+      R_len_t i8 = 0, i32 = 0;
+      while (i8 < cur_n) {
+         if (i32 % STRI__CPINDEX_STEP == 0)
+            tmp.push_back(i8);
+         U8_FWD_1((const uint8_t*)cur_s, i8, cur_n);
+         ++i32;
+      }
+
+      idx->samples[k] = (R_len_t*)malloc(sizeof(R_len_t)*tmp.size());
+      if (!idx->samples[k])
+         throw StriException(MSG__MEM_ALLOC_ERROR);
+      for (size_t z=0; z<tmp.size(); ++z)
+         idx->samples[k][z] = tmp[z];
+      idx->nsamples[k] = (R_len_t)tmp.size();
+      idx->ncp[k] = i32;
+   }
+
+   SEXP ret;
+   STRI__PROTECT(ret = R_MakeExternalPtr(idx, Rf_install("stri_cpindex"), str));
+   R_RegisterCFinalizerEx(ret, stri__cpindex_finalizer, TRUE);
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({
+      // the finalizer has not been registered yet
+      if (idx) stri__cpindex_free(idx);
+   })
+}
+
+
+/** [internal] release everything a StriGcIndex owns */
+static void stri__gcindex_free(StriGcIndex* idx)
+{
+   if (!idx) return;
+   if (idx->starts) {
+      for (R_len_t k=0; k<idx->n; ++k)
+         if (idx->starts[k]) free(idx->starts[k]);
+      free(idx->starts);
+   }
+   if (idx->elems)   free(idx->elems);
+   if (idx->nstarts) free(idx->nstarts);
+   free(idx);
+}
+
+
+/** [internal] externalptr finalizer */
+static void stri__gcindex_finalizer(SEXP ptr)
+{
+   StriGcIndex* idx = (StriGcIndex*)R_ExternalPtrAddr(ptr);
+   if (idx) {
+      stri__gcindex_free(idx);
+      R_ClearExternalPtr(ptr);
+   }
+}
+
+
+/** [internal] fetch and validate the grapheme index attached to a vector
+ *
+ * @param str character vector (before any re-preparation)
+ * @return the index, or NULL if absent, of the wrong type, or built
+ *    for different strings (every CHARSXP pointer is compared)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+const StriGcIndex* stri__gcindex_from_attrib(SEXP str)
+{
+   if (!isString(str)) return NULL;
+   SEXP ptr = Rf_getAttrib(str, Rf_install("stri_gcindex"));
+   if (TYPEOF(ptr) != EXTPTRSXP) return NULL;
+   if (R_ExternalPtrTag(ptr) != Rf_install("stri_gcindex")) return NULL;
+   const StriGcIndex* idx = (const StriGcIndex*)R_ExternalPtrAddr(ptr);
+   if (!idx || idx->n != LENGTH(str)) return NULL;
+   for (R_len_t k=0; k<idx->n; ++k)
+      if (idx->elems[k] != STRING_ELT(str, k))
+         return NULL; // the vector has been modified since indexing
+   return idx;
+}
+
+
+/**
+ * Build a persistent grapheme cluster index for a character vector
+ *
+ * See stri_index.h for the layout. The clusters are enumerated once
+ * with a default "character" break iterator; every later boundary
+ * analysis of the same vector with such an iterator can then read the
+ * offsets back instead of iterating.
+ *
+ * @param str character vector
+ * @return externalptr (finalized on gc), with the input kept alive
+ *    through the protected slot
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_boundaries_index(SEXP str)
+{
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+   R_len_t str_len = LENGTH(str);
+   StriBrkIterOptions opts_brkiter2(R_NilValue, "character");
+   StriGcIndex* idx = NULL;
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriContainerUTF8 str_cont(str, str_len);
+   StriRuleBasedBreakIterator brkiter(opts_brkiter2);
+
+   idx = (StriGcIndex*)calloc(1, sizeof(StriGcIndex));
+   if (!idx) throw StriException(MSG__MEM_ALLOC_ERROR);
+   idx->n = str_len;
+   idx->elems   = (SEXP*)malloc(sizeof(SEXP)*((str_len>0)?str_len:1));
+   idx->starts  = (R_len_t**)calloc((str_len>0)?str_len:1, sizeof(R_len_t*));
+   idx->nstarts = (R_len_t*)malloc(sizeof(R_len_t)*((str_len>0)?str_len:1));
+   if (!idx->elems || !idx->starts || !idx->nstarts)
+      throw StriException(MSG__MEM_ALLOC_ERROR);
+
+   std::vector<R_len_t> tmp;
+   for (R_len_t k=0; k<str_len; ++k) {
+      idx->elems[k] = STRING_ELT(str, k);
+      idx->nstarts[k] = -1; // not indexed
+      if (str_cont.isNA(k)) continue;
+
+      const char* cur_s = str_cont.get(k).c_str();
+      R_len_t cur_n = str_cont.get(k).length();
+      tmp.clear();
+      brkiter.setupMatcher(cur_s, cur_n);
+      brkiter.first();
+      std::pair<R_len_t,R_len_t> curpair;
+      while (brkiter.next(curpair))
+         tmp.push_back(curpair.first);
+      tmp.push_back(cur_n); // closes the last cluster
+
+      idx->starts[k] = (R_len_t*)malloc(sizeof(R_len_t)*tmp.size());
+      if (!idx->starts[k])
+         throw StriException(MSG__MEM_ALLOC_ERROR);
+      for (size_t z=0; z<tmp.size(); ++z)
+         idx->starts[k][z] = tmp[z];
+      idx->nstarts[k] = (R_len_t)tmp.size();
+   }
+
+   SEXP ret;
+   STRI__PROTECT(ret = R_MakeExternalPtr(idx, Rf_install("stri_gcindex"), str));
+   R_RegisterCFinalizerEx(ret, stri__gcindex_finalizer, TRUE);
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({
+      // the finalizer has not been registered yet
+      if (idx) stri__gcindex_free(idx);
+   })
+}
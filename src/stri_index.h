@@ -0,0 +1,130 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_index_h
+#define __stri_index_h
+
+
+// sample the byte offset of every this-many-th code point
+#define STRI__CPINDEX_STEP 128
+// do not bother indexing strings shorter than this many bytes
+#define STRI__CPINDEX_MIN_BYTES 256
+
+
+/**
+ * A persistent code point index for a character vector
+ *
+ * For each sufficiently long non-ASCII string, the byte offsets of the
+ * code points number 0, STRI__CPINDEX_STEP, 2*STRI__CPINDEX_STEP, ...
+ * (in the UTF-8 form the containers work on) plus the total code point
+ * count. Random character-position access then costs at most
+ * STRI__CPINDEX_STEP forward steps from the nearest sample, instead of
+ * a walk from the start (or the last-call position) of the string.
+ *
+ * Built once with stri_sub_index() and carried across calls inside an
+ * externalptr; the CHARSXPs it was built for are recorded so that the
+ * index can be validated by pointer comparison (CHARSXPs are interned
+ * and immutable, so equal pointers imply equal payloads).
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+struct StriCpIndex {
+   R_len_t n;          ///< number of elements
+   SEXP* elems;        ///< the CHARSXPs the index was built for
+   R_len_t* ncp;       ///< per-element code point counts; -1 == not indexed
+   R_len_t** samples;  ///< per-element sampled byte offsets, or NULL
+   R_len_t* nsamples;  ///< number of samples per element
+};
+
+
+const StriCpIndex* stri__cpindex_from_attrib(SEXP str);
+
+
+/**
+ * A persistent grapheme cluster index for a character vector
+ *
+ * For each non-NA string, the byte offsets (in the UTF-8 form the
+ * containers work on) of every grapheme cluster start, closed by the
+ * total byte length, so that cluster j spans
+ * [starts[j], starts[j+1]). Boundary analysis with a default
+ * "character" break iterator then reduces to reading the offsets back,
+ * with no ICU iteration at all.
+ *
+ * Built once with stri_boundaries_index() and carried across calls
+ * inside an externalptr; validated like StriCpIndex, by comparing the
+ * recorded CHARSXP pointers.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+struct StriGcIndex {
+   R_len_t n;          ///< number of elements
+   SEXP* elems;        ///< the CHARSXPs the index was built for
+   R_len_t** starts;   ///< per-element cluster start byte offsets + total length
+   R_len_t* nstarts;   ///< number of entries in starts[k]; -1 == not indexed
+};
+
+
+const StriGcIndex* stri__gcindex_from_attrib(SEXP str);
+
+
+/** is the k-th element covered by the index? */
+inline bool stri__cpindex_available(const StriCpIndex* idx, R_len_t k)
+{
+   return (idx && k >= 0 && k < idx->n && idx->ncp[k] >= 0);
+}
+
+
+/** nearest sampled position at or before code point wh
+ *
+ * @param idx the index; element k must be covered
+ * @param k element index
+ * @param wh target code point position, >= 0
+ * @param j [out] sampled code point position, <= wh
+ * @param jres [out] its byte offset
+ */
+inline void stri__cpindex_jump(const StriCpIndex* idx, R_len_t k,
+   R_len_t wh, R_len_t& j, R_len_t& jres)
+{
+   R_len_t s = wh/STRI__CPINDEX_STEP;
+   if (s >= idx->nsamples[k]) s = idx->nsamples[k]-1;
+   j = s*STRI__CPINDEX_STEP;
+   jres = idx->samples[k][s];
+}
+
+
+/** is the k-th element covered by the grapheme index? */
+inline bool stri__gcindex_available(const StriGcIndex* idx, R_len_t k)
+{
+   return (idx && k >= 0 && k < idx->n && idx->nstarts[k] >= 0);
+}
+
+#endif
@@ -0,0 +1,90 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_interrupt.h"
+
+
+// target spacing between interrupt polls, in seconds of work
+#define STRI__INTERRUPT_PERIOD 0.1
+
+// stride hard cap; keeps the first post-resize poll reasonably close
+// even if the clock has too coarse a resolution to ever measure > 0
+#define STRI__INTERRUPT_MAX_STRIDE 16777216
+
+
+/** [internal] R_ToplevelExec payload, see stri__interrupt_pending */
+static void stri__interrupt_exec_body(void* data)
+{
+   R_CheckUserInterrupt();
+}
+
+
+/** Has the user requested an interrupt?
+ *
+ * See stri_interrupt.h.
+ *
+ * @return true iff an interrupt is pending
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+bool stri__interrupt_pending()
+{
+   // R_CheckUserInterrupt longjmps on a pending interrupt; running it
+   // under R_ToplevelExec confines the jump and reports it as `false`
+   return !R_ToplevelExec(stri__interrupt_exec_body, NULL);
+}
+
+
+/** Poll for an interrupt and recalibrate the stride
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void StriInterruptCheckpoint::check()
+{
+   clock_t now = clock();
+   double elapsed = (double)(now-last)/CLOCKS_PER_SEC;
+
+   // settle at roughly one poll per STRI__INTERRUPT_PERIOD seconds;
+   // the dead zone between the two thresholds avoids oscillation
+   if (elapsed*4.0 < STRI__INTERRUPT_PERIOD
+         && stride < STRI__INTERRUPT_MAX_STRIDE)
+      stride *= 2;
+   else if (elapsed > STRI__INTERRUPT_PERIOD && stride > 1)
+      stride /= 2;
+
+   countdown = stride;
+   last = now;
+
+   if (stri__interrupt_pending())
+      throw StriException(MSG__INTERRUPTED);
+}
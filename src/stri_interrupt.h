@@ -0,0 +1,102 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_interrupt_h
+#define __stri_interrupt_h
+
+#include <ctime>
+
+
+/**
+ * Has the user requested an interrupt?
+ *
+ * Polls R without longjmp-ing: R_CheckUserInterrupt is confined to
+ * an R_ToplevelExec, so C++ destructors and the STRI__ERROR_HANDLER
+ * cleanup still run normally after a positive answer.
+ *
+ * Call from the main R thread only.
+ *
+ * @return true iff an interrupt is pending
+ */
+bool stri__interrupt_pending();
+
+
+/**
+ * An adaptive cooperative-interruption checkpoint for vectorized loops
+ *
+ * Polling R for a pending interrupt on every element would dominate
+ * cheap per-element work, and never polling leaves runaway patterns
+ * uncancellable. A checkpoint starts with a small stride and retimes
+ * itself on every poll, doubling or halving the stride so that polls
+ * settle at roughly one per STRI__INTERRUPT_PERIOD seconds of work -
+ * between polls the cost is a single decrement and branch per element.
+ *
+ * On a pending interrupt, check() throws a StriException, which the
+ * surrounding STRI__ERROR_HANDLER turns into an R error after the
+ * usual cleanup; resources held across iterations should be owned by
+ * objects declared inside the handler block (e.g. StriUText), so that
+ * the unwinding releases them.
+ *
+ * Use from the main R thread only (worker threads must not touch R).
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+class StriInterruptCheckpoint {
+
+   private:
+
+      R_len_t countdown;
+      R_len_t stride;
+      clock_t last;
+
+   public:
+
+      StriInterruptCheckpoint() {
+         stride = 64; // recalibrated at the first poll
+         countdown = stride;
+         last = clock();
+      }
+
+      /** is a poll due? costs one decrement+branch per element */
+      inline bool due() {
+         return (--countdown <= 0);
+      }
+
+      /** call once per element */
+      inline void touch() {
+         if (due()) check();
+      }
+
+      void check();
+};
+
+#endif
@@ -36,7 +36,9 @@
 #include "stri_container_integer.h"
 #include "stri_container_listutf8.h"
 #include "stri_string8buf.h"
+#include "stri_threads.h"
 #include <vector>
+#include <algorithm>
 using namespace std;
 
 
@@ -131,6 +133,9 @@ SEXP stri__prepare_arg_list_ignore_null(SEXP x, bool ignore_null)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    fill the buffer by doubling - O(log times) memcpys per element
 */
 SEXP stri_dup(SEXP str, SEXP times)
 {
@@ -194,10 +199,18 @@ SEXP stri_dup(SEXP str, SEXP times)
          str_last_index = 0;
       }
 
-      // we paste only "additional" duplicates
+      // we paste only "additional" duplicates; the part already in the
+      // buffer is extended by doubling (copying the built prefix), so a
+      // single long fill takes O(log times) memcpys, not O(times)
       R_len_t max_index = str_cur_n*times_cur;
-      for (; str_last_index < max_index; str_last_index += str_cur_n) {
-         memcpy(buf.data()+str_last_index, str_cur->c_str(), (size_t)str_cur_n);
+      if (str_last_index == 0) {
+         memcpy(buf.data(), str_cur->c_str(), (size_t)str_cur_n);
+         str_last_index = str_cur_n;
+      }
+      while (str_last_index < max_index) {
+         R_len_t chunk = std::min(str_last_index, max_index-str_last_index);
+         memcpy(buf.data()+str_last_index, buf.data(), (size_t)chunk);
+         str_last_index += chunk;
       }
 
       // the result is always in UTF-8
@@ -333,6 +346,9 @@ SEXP stri_join2(SEXP e1, SEXP e2) // a.k.a. stri_join2_nocollapse
  *
  *  @version 0.4-1 (Marek Gagolewski, 2014-11-26)
  *    Issue #114: inconsistent behavior w.r.t. paste()
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    exact layout computed up front; parallel copies to disjoint offsets
 */
 SEXP stri_join2_withcollapse(SEXP e1, SEXP e2, SEXP collapse)
 {
@@ -370,7 +386,8 @@ SEXP stri_join2_withcollapse(SEXP e1, SEXP e2, SEXP collapse)
    const char* collapse_s = collapse_cont.get(0).c_str();
 
 
-   // find maximal length of the buffer needed:
+   // exact size of the buffer needed and each row's output offset:
+   std::vector<R_len_t> offset(vectorize_length);
    R_len_t nchar = 0;
    for (int i=0; i<vectorize_length; ++i) {
       if (e1_cont.isNA(i) || e2_cont.isNA(i)) {
@@ -378,35 +395,67 @@ SEXP stri_join2_withcollapse(SEXP e1, SEXP e2, SEXP collapse)
          return stri__vector_NA_strings(1); // at least 1 NA => return NA
       }
 
-      nchar += e1_cont.get(i).length() + e2_cont.get(i).length()
-               + ((i>0)?collapse_nbytes:0);
+      if (i > 0) nchar += collapse_nbytes;
+      offset[i] = nchar;
+      nchar += e1_cont.get(i).length() + e2_cont.get(i).length();
    }
 
 
+   // every row owns a disjoint output range, so the copies
+   // may proceed in parallel
    String8buf buf(nchar);
-   R_len_t last_buf_idx = 0;
-   for (R_len_t i = 0; i < vectorize_length; ++i) // don't change this order, see #114
+   char* bufdata = buf.data();
+#ifdef STRI_HAVE_THREADS
+   int num_threads = stri__threads_requested(vectorize_length);
+   if (num_threads > 1) {
+      // workers shall not touch R nor throw
+      std::vector<std::thread> workers;
+      for (int t=0; t<num_threads; ++t) {
+         R_len_t chunk_from = (R_len_t)((double)vectorize_length*t/num_threads);
+         R_len_t chunk_to   = (R_len_t)((double)vectorize_length*(t+1)/num_threads);
+         workers.push_back(std::thread(
+            [&e1_cont, &e2_cont, &offset, bufdata,
+                  collapse_s, collapse_nbytes, chunk_from, chunk_to]() {
+               for (R_len_t i=chunk_from; i<chunk_to; ++i) {
+                  R_len_t cur = offset[i];
+                  if (collapse_nbytes > 0 && i > 0)
+                     memcpy(bufdata+cur-collapse_nbytes, collapse_s,
+                        (size_t)collapse_nbytes);
+                  R_len_t cur_len_1 = e1_cont.get(i).length();
+                  memcpy(bufdata+cur, e1_cont.get(i).c_str(), (size_t)cur_len_1);
+                  cur += cur_len_1;
+                  memcpy(bufdata+cur, e2_cont.get(i).c_str(),
+                     (size_t)e2_cont.get(i).length());
+               }
+            }));
+      }
+      for (int t=0; t<num_threads; ++t) workers[t].join();
+   }
+   else
+#endif
    {
-      // no need to detect NAs - they already have been excluded
-      if (collapse_nbytes > 0 && i > 0) { // copy collapse (separator)
-         memcpy(buf.data()+last_buf_idx, collapse_s, (size_t)collapse_nbytes);
-         last_buf_idx += collapse_nbytes;
+      for (R_len_t i = 0; i < vectorize_length; ++i) // don't change this order, see #114
+      {
+         // no need to detect NAs - they already have been excluded
+         R_len_t last_buf_idx = offset[i];
+         if (collapse_nbytes > 0 && i > 0) // copy collapse (separator)
+            memcpy(bufdata+last_buf_idx-collapse_nbytes, collapse_s,
+               (size_t)collapse_nbytes);
+
+         const String8* cur_string_1 = &(e1_cont.get(i));
+         R_len_t  cur_len_1 = cur_string_1->length();
+         memcpy(bufdata+last_buf_idx, cur_string_1->c_str(), (size_t)cur_len_1);
+         last_buf_idx += cur_len_1;
+
+         const String8* cur_string_2 = &(e2_cont.get(i));
+         memcpy(bufdata+last_buf_idx, cur_string_2->c_str(),
+            (size_t)cur_string_2->length());
       }
-
-      const String8* cur_string_1 = &(e1_cont.get(i));
-      R_len_t  cur_len_1 = cur_string_1->length();
-      memcpy(buf.data()+last_buf_idx, cur_string_1->c_str(), (size_t)cur_len_1);
-      last_buf_idx += cur_len_1;
-
-      const String8* cur_string_2 = &(e2_cont.get(i));
-      R_len_t  cur_len_2 = cur_string_2->length();
-      memcpy(buf.data()+last_buf_idx, cur_string_2->c_str(), (size_t)cur_len_2);
-      last_buf_idx += cur_len_2;
    }
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, 1)); // output vector
-   SET_STRING_ELT(ret, 0, Rf_mkCharLenCE(buf.data(), last_buf_idx, CE_UTF8));
+   SET_STRING_ELT(ret, 0, Rf_mkCharLenCE(bufdata, nchar, CE_UTF8));
    STRI__UNPROTECT_ALL
    return ret;
    STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
@@ -442,6 +491,9 @@ SEXP stri_join2_withcollapse(SEXP e1, SEXP e2, SEXP collapse)
  *
  * @version 0.4-1 (Marek Gagolewski, 2014-11-27)
  *    FR #116: ignore_null arg added
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    fused sizing+writing: column-at-a-time passes, single output arena
  */
 SEXP stri_join_nocollapse(SEXP strlist, SEXP sep, SEXP ignore_null)
 {
@@ -499,51 +551,59 @@ SEXP stri_join_nocollapse(SEXP strlist, SEXP sep, SEXP ignore_null)
    StriContainerListUTF8 strlist_cont(strlist, vectorize_length);
 
 
-   // 4. Get buf size and determine where NAs will occur
-   R_len_t buf_maxbytes = 0;
+   // 4. Get per-row output sizes and determine where NAs will occur;
+   // one pass per argument (column-at-a-time), so that every container's
+   // strings are visited in their original, cache-friendly order
+   std::vector<R_len_t> rowbytes(vectorize_length, 0);
    vector<bool> whichNA(vectorize_length, false); // where are NAs in out?
-   for (R_len_t i=0; i<vectorize_length; ++i) {
-
-      R_len_t curchar = 0;
-      for (R_len_t j=0; j<strlist_length; ++j) {
-         if (strlist_cont.get(j).isNA(i)) {
-            whichNA[i] = true;
-            break;
-         }
-         else {
-            curchar += strlist_cont.get(j).get(i).length()
-               + ((j>0)?sep_len:0);
-         }
+   for (R_len_t j=0; j<strlist_length; ++j) {
+      const StriContainerUTF8& cur_cont = strlist_cont.get(j);
+      for (R_len_t i=0; i<vectorize_length; ++i) {
+         if (whichNA[i]) continue;
+         if (cur_cont.isNA(i)) whichNA[i] = true;
+         else                  rowbytes[i] += cur_cont.get(i).length();
       }
-      if (!whichNA[i] && curchar > buf_maxbytes)
-         buf_maxbytes = curchar;
    }
 
-   // 5. Create ret val
-   String8buf buf(buf_maxbytes);
-   STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
-
+   // 5. Lay the rows out back to back in a single arena
+   std::vector<R_len_t> offset(vectorize_length);
+   R_len_t arena_size = 0;
    for (R_len_t i=0; i<vectorize_length; ++i) {
-      if (whichNA[i]) {
-         SET_STRING_ELT(ret, i, NA_STRING);
-         continue;
-      }
+      offset[i] = arena_size;
+      if (!whichNA[i])
+         arena_size += rowbytes[i] + sep_len*(strlist_length-1);
+   }
+
+   String8buf buf(arena_size);
+   char* bufdata = buf.data();
+   STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
 
-      R_len_t cursize = 0;
-      for (R_len_t j=0; j<strlist_length; ++j) {
+   // 6. Fill the arena, again column-at-a-time; rows are disjoint,
+   // so each per-row cursor advances independently
+   std::vector<R_len_t> cursor(offset);
+   for (R_len_t j=0; j<strlist_length; ++j) {
+      const StriContainerUTF8& cur_cont = strlist_cont.get(j);
+      for (R_len_t i=0; i<vectorize_length; ++i) {
+         if (whichNA[i]) continue;
 
-         if (sep_len >= 0 && j > 0) {
-            memcpy(buf.data()+cursize, sep_char, (size_t)sep_len);
-            cursize += sep_len;
+         if (sep_len > 0 && j > 0) {
+            memcpy(bufdata+cursor[i], sep_char, (size_t)sep_len);
+            cursor[i] += sep_len;
          }
 
-         const String8* curstring = &(strlist_cont.get(j).get(i));
+         const String8* curstring = &(cur_cont.get(i));
          R_len_t curstring_n = curstring->length();
-         memcpy(buf.data()+cursize, curstring->c_str(), (size_t)curstring_n);
-         cursize += curstring_n;
+         memcpy(bufdata+cursor[i], curstring->c_str(), (size_t)curstring_n);
+         cursor[i] += curstring_n;
       }
+   }
 
-      SET_STRING_ELT(ret, i, Rf_mkCharLenCE(buf.data(), cursize, CE_UTF8));
+   for (R_len_t i=0; i<vectorize_length; ++i) {
+      if (whichNA[i])
+         SET_STRING_ELT(ret, i, NA_STRING);
+      else
+         SET_STRING_ELT(ret, i, Rf_mkCharLenCE(bufdata+offset[i],
+            cursor[i]-offset[i], CE_UTF8));
    }
 
    // nothing more to do:
@@ -578,6 +638,17 @@ SEXP stri_join_nocollapse(SEXP strlist, SEXP sep, SEXP ignore_null)
  *
  * @version 0.4-1 (Marek Gagolewski, 2014-11-27)
  *    FR #116: ignore_null arg added
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    the copy loop prefers the flattened (sequential-access) layout
+ *    of StriContainerListUTF8
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    the sizing pass also runs column-at-a-time
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    collapsing: workers concatenate disjoint ranges of rows in
+ *    parallel (see options(stringi.num_threads=...))
  */
 SEXP stri_join(SEXP strlist, SEXP sep, SEXP collapse, SEXP ignore_null)
 {
@@ -645,56 +716,138 @@ SEXP stri_join(SEXP strlist, SEXP sep, SEXP collapse, SEXP ignore_null)
    const char* collapse_s = collapse_cont.get(0).c_str();
    R_len_t     collapse_n = collapse_cont.get(0).length();
 
-   // Get required buffer size
-   R_len_t buf_maxbytes = 0;
-   for (R_len_t i=0; i<vectorize_length; ++i) {   // for each vectorized string (vertically)
-      for (R_len_t j=0; j<strlist_length; ++j) {  // for each character vector  (horizontally)
-         if (strlist_cont.get(j).isNA(i)) {
+   // Get required buffer size; one pass per argument
+   // (column-at-a-time), so that every container's strings are
+   // visited in their original, cache-friendly order
+   std::vector<R_len_t> rowbytes(vectorize_length, 0);
+   R_len_t buf_maxbytes = sep_n*(strlist_length-1)*vectorize_length
+      + collapse_n*(vectorize_length-1);
+   for (R_len_t j=0; j<strlist_length; ++j) {
+      const StriContainerUTF8& cur_cont = strlist_cont.get(j);
+      for (R_len_t i=0; i<vectorize_length; ++i) {
+         if (cur_cont.isNA(i)) {
             STRI__UNPROTECT_ALL
             return stri__vector_NA_strings(1);
          }
-
-         buf_maxbytes += strlist_cont.get(j).get(i).length()+ ((j>0)?sep_n:0);
+         rowbytes[i] += cur_cont.get(i).length();
+      }
+   }
+   std::vector<R_len_t> offset(vectorize_length); // content start per row
+   {
+      R_len_t cur = 0;
+      for (R_len_t i=0; i<vectorize_length; ++i) {
+         if (i > 0) cur += collapse_n;
+         offset[i] = cur;
+         cur += rowbytes[i] + sep_n*(strlist_length-1);
+         buf_maxbytes += rowbytes[i];
       }
-
-      if (i>0) buf_maxbytes += collapse_n;
    }
 
    // 5. Create ret val
    String8buf buf(buf_maxbytes);
-   R_len_t last_buf_idx = 0;
-
-   for (R_len_t i=0; i<vectorize_length; ++i) {
-      // there is no NA anywhere
-
-      if (collapse_n > 0 && i > 0) {
-         memcpy(buf.data()+last_buf_idx, collapse_s, (size_t)collapse_n);
-         last_buf_idx += collapse_n;
+   char* bufdata = buf.data();
+
+   // every string is about to be read exactly once - lay them out
+   // back to back in scan order first, so the copy loop below streams
+   // through two contiguous blocks of memory
+   strlist_cont.flatten();
+
+   // every row owns a disjoint output range (see offset), so the
+   // copies may proceed in parallel, each worker stitching its own
+   // range of rows
+#ifdef STRI_HAVE_THREADS
+   int num_threads = stri__threads_requested(vectorize_length);
+   if (num_threads > 1) {
+      // workers shall not touch R nor throw
+      std::vector<std::thread> workers;
+      for (int t=0; t<num_threads; ++t) {
+         R_len_t chunk_from = (R_len_t)((double)vectorize_length*t/num_threads);
+         R_len_t chunk_to   = (R_len_t)((double)vectorize_length*(t+1)/num_threads);
+         workers.push_back(std::thread(
+            [&strlist_cont, &offset, bufdata, strlist_length,
+                  sep_s, sep_n, collapse_s, collapse_n,
+                  chunk_from, chunk_to]() {
+               bool flat = strlist_cont.isFlat();
+               for (R_len_t i=chunk_from; i<chunk_to; ++i) {
+                  R_len_t cur = offset[i];
+                  if (collapse_n > 0 && i > 0)
+                     memcpy(bufdata+cur-collapse_n, collapse_s,
+                        (size_t)collapse_n);
+                  for (R_len_t j=0; j<strlist_length; ++j) {
+                     if (sep_n > 0 && j > 0) {
+                        memcpy(bufdata+cur, sep_s, (size_t)sep_n);
+                        cur += sep_n;
+                     }
+                     R_len_t curstring_n;
+                     const char* curstring_s;
+                     if (flat) {
+                        curstring_n = strlist_cont.getFlatLength(i, j);
+                        curstring_s = strlist_cont.getFlatData(i, j);
+                     }
+                     else {
+                        const String8* curstring = &(strlist_cont.get(j).get(i));
+                        curstring_n = curstring->length();
+                        curstring_s = curstring->c_str();
+                     }
+                     memcpy(bufdata+cur, curstring_s, (size_t)curstring_n);
+                     cur += curstring_n;
+                  }
+               }
+            }));
       }
+      for (int t=0; t<num_threads; ++t) workers[t].join();
+   }
+   else
+#endif
+   {
+      R_len_t last_buf_idx = 0;
+      for (R_len_t i=0; i<vectorize_length; ++i) {
+         // there is no NA anywhere
 
-      for (R_len_t j=0; j<strlist_length; ++j) {
+         if (collapse_n > 0 && i > 0) {
+            memcpy(bufdata+last_buf_idx, collapse_s, (size_t)collapse_n);
+            last_buf_idx += collapse_n;
+         }
 
-         if (sep_n > 0 && j > 0) {
-            memcpy(buf.data()+last_buf_idx, sep_s, (size_t)sep_n);
-            last_buf_idx += sep_n;
+         if (strlist_cont.isFlat()) {
+            for (R_len_t j=0; j<strlist_length; ++j) {
+               if (sep_n > 0 && j > 0) {
+                  memcpy(bufdata+last_buf_idx, sep_s, (size_t)sep_n);
+                  last_buf_idx += sep_n;
+               }
+
+               R_len_t curstring_n = strlist_cont.getFlatLength(i, j);
+               memcpy(bufdata+last_buf_idx, strlist_cont.getFlatData(i, j),
+                  (size_t)curstring_n);
+               last_buf_idx += curstring_n;
+            }
+            continue;
          }
 
-         const String8* curstring = &(strlist_cont.get(j).get(i));
-         R_len_t curstring_n = curstring->length();
-         memcpy(buf.data()+last_buf_idx, curstring->c_str(), (size_t)curstring_n);
-         last_buf_idx += curstring_n;
+         for (R_len_t j=0; j<strlist_length; ++j) {
+
+            if (sep_n > 0 && j > 0) {
+               memcpy(bufdata+last_buf_idx, sep_s, (size_t)sep_n);
+               last_buf_idx += sep_n;
+            }
+
+            const String8* curstring = &(strlist_cont.get(j).get(i));
+            R_len_t curstring_n = curstring->length();
+            memcpy(bufdata+last_buf_idx, curstring->c_str(), (size_t)curstring_n);
+            last_buf_idx += curstring_n;
+         }
       }
-   }
 
 #ifndef NDEBUG
-   if (buf_maxbytes != last_buf_idx)
-      throw StriException("stri_join_withcollapse: buffer overrun");
+      if (buf_maxbytes != last_buf_idx)
+         throw StriException("stri_join_withcollapse: buffer overrun");
 #endif
+   }
 
    // we are done
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, 1));
-   SET_STRING_ELT(ret, 0, Rf_mkCharLenCE(buf.data(), last_buf_idx, CE_UTF8));
+   SET_STRING_ELT(ret, 0, Rf_mkCharLenCE(bufdata, buf_maxbytes, CE_UTF8));
    STRI__UNPROTECT_ALL
    return ret;
 
@@ -720,6 +873,9 @@ SEXP stri_join(SEXP strlist, SEXP sep, SEXP collapse, SEXP ignore_null)
  * @version 0.2-1 (Marek Gagolewski, 2014-03-18)
  *          This function hasn't been used at all before (strange, isn't it?);
  *          From now on it's being called by stri_flatten_withressep
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          exact one-shot allocation; parallel copies to disjoint offsets
  *          (a small performance gain)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
@@ -740,29 +896,51 @@ SEXP stri_flatten_noressep(SEXP str, bool na_empty)
    STRI__ERROR_HANDLER_BEGIN(1)
    StriContainerUTF8 str_cont(str, str_length);
 
-   // 1. Get required buffer size
+   // 1. Get the exact buffer size and each element's output offset
+   std::vector<R_len_t> offset(str_length);
    R_len_t nchar = 0;
    for (int i=0; i<str_length; ++i) {
+      offset[i] = nchar;
       if (str_cont.isNA(i)) {
-         if (na_empty) {
-            nchar += 0; // ignore
-         }
-         else {
+         if (!na_empty) {
             STRI__UNPROTECT_ALL
             return stri__vector_NA_strings(1); // at least 1 NA => return NA
          }
+         continue; // ignore
       }
       nchar += str_cont.get(i).length();
    }
 
-   // 2. Fill the buf!
+   // 2. Fill the buf - every element owns a disjoint output range,
+   // so the copies may proceed in parallel
    String8buf buf(nchar);
-   R_len_t cur = 0;
-   for (int i=0; i<str_length; ++i) {
-      if (!str_cont.isNA(i)) {
-         R_len_t ncur = str_cont.get(i).length();
-         memcpy(buf.data()+cur, str_cont.get(i).c_str(), (size_t)ncur);
-         cur += ncur;
+   char* bufdata = buf.data();
+#ifdef STRI_HAVE_THREADS
+   int num_threads = stri__threads_requested(str_length);
+   if (num_threads > 1) {
+      // workers shall not touch R nor throw
+      std::vector<std::thread> workers;
+      for (int t=0; t<num_threads; ++t) {
+         R_len_t chunk_from = (R_len_t)((double)str_length*t/num_threads);
+         R_len_t chunk_to   = (R_len_t)((double)str_length*(t+1)/num_threads);
+         workers.push_back(std::thread(
+            [&str_cont, &offset, bufdata, chunk_from, chunk_to]() {
+               for (R_len_t i=chunk_from; i<chunk_to; ++i) {
+                  if (str_cont.isNA(i)) continue;
+                  memcpy(bufdata+offset[i], str_cont.get(i).c_str(),
+                     (size_t)str_cont.get(i).length());
+               }
+            }));
+      }
+      for (int t=0; t<num_threads; ++t) workers[t].join();
+   }
+   else
+#endif
+   {
+      for (int i=0; i<str_length; ++i) {
+         if (str_cont.isNA(i)) continue;
+         memcpy(bufdata+offset[i], str_cont.get(i).c_str(),
+            (size_t)str_cont.get(i).length());
       }
    }
 
@@ -770,7 +948,7 @@ SEXP stri_flatten_noressep(SEXP str, bool na_empty)
    // 3. Get ret val & good bye
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, 1));
-   SET_STRING_ELT(ret, 0, Rf_mkCharLenCE(buf.data(), cur, CE_UTF8));
+   SET_STRING_ELT(ret, 0, Rf_mkCharLenCE(bufdata, nchar, CE_UTF8));
    STRI__UNPROTECT_ALL
    return ret;
    STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
@@ -805,6 +983,8 @@ SEXP stri_flatten_noressep(SEXP str, bool na_empty)
  * @version 1.2.1 (Marek Gagolewski, 2018-04-20)
  *    na_empty, omit_empty arg added
  *
+ * @version 1.4.6 (2020-01-24)
+ *    exact layout computed up front; parallel copies to disjoint offsets
  */
 SEXP stri_flatten(SEXP str, SEXP collapse, SEXP na_empty, SEXP omit_empty) // a.k.a. C_stri_flatten_withressep
 {
@@ -838,45 +1018,73 @@ SEXP stri_flatten(SEXP str, SEXP collapse, SEXP na_empty, SEXP omit_empty) // a.
    const char* collapse_s = collapse_cont.get(0).c_str();
 
 
-   // 1. Get required minimal buffer size
+   // 1. Lay the output out: exact size and, per element, the offsets
+   // of its collapse copy and its contents (-1 - nothing to copy)
+   std::vector<R_len_t> collapse_off(str_length, -1);
+   std::vector<R_len_t> content_off(str_length, -1);
    R_len_t nbytes = 0;
+   bool already_started = false;
    for (int i=0; i<str_length; ++i) {
-      if (str_cont.isNA(i)) {
-         if (na_empty_1) {
-            nbytes += ((i>0 && !omit_empty_1)?collapse_nbytes:0);
-         }
-         else {
-            STRI__UNPROTECT_ALL
-            return stri__vector_NA_strings(1); // at least 1 NA => return NA
-         }
-      }
-      else {
-         nbytes += str_cont.get(i).length() + ((i>0)?collapse_nbytes:0);
+      if (str_cont.isNA(i) && !na_empty_1) {
+         STRI__UNPROTECT_ALL
+         return stri__vector_NA_strings(1); // at least 1 NA => return NA
       }
-   }
 
-
-   // 2. Fill the buf!
-   String8buf buf(nbytes);
-   R_len_t cur = 0;
-   bool already_started = false;
-   for (int i=0; i<str_length; ++i) {
       if (omit_empty_1 && (str_cont.isNA(i) || str_cont.get(i).length() == 0))
          continue;
 
       if (already_started) {
          if (collapse_nbytes > 0) {
-            memcpy(buf.data()+cur, collapse_s, (size_t)collapse_nbytes);
-            cur += collapse_nbytes;
+            collapse_off[i] = nbytes;
+            nbytes += collapse_nbytes;
          }
       }
       else
          already_started = true;
 
       if (!str_cont.isNA(i)) {
-         R_len_t ncur = str_cont.get(i).length();
-         memcpy(buf.data()+cur, str_cont.get(i).c_str(), (size_t)ncur);
-         cur += ncur;
+         content_off[i] = nbytes;
+         nbytes += str_cont.get(i).length();
+      }
+   }
+
+
+   // 2. Fill the buf - all output ranges are disjoint,
+   // so the copies may proceed in parallel
+   String8buf buf(nbytes);
+   char* bufdata = buf.data();
+#ifdef STRI_HAVE_THREADS
+   int num_threads = stri__threads_requested(str_length);
+   if (num_threads > 1) {
+      // workers shall not touch R nor throw
+      std::vector<std::thread> workers;
+      for (int t=0; t<num_threads; ++t) {
+         R_len_t chunk_from = (R_len_t)((double)str_length*t/num_threads);
+         R_len_t chunk_to   = (R_len_t)((double)str_length*(t+1)/num_threads);
+         workers.push_back(std::thread(
+            [&str_cont, &collapse_off, &content_off, bufdata,
+                  collapse_s, collapse_nbytes, chunk_from, chunk_to]() {
+               for (R_len_t i=chunk_from; i<chunk_to; ++i) {
+                  if (collapse_off[i] >= 0)
+                     memcpy(bufdata+collapse_off[i], collapse_s,
+                        (size_t)collapse_nbytes);
+                  if (content_off[i] >= 0)
+                     memcpy(bufdata+content_off[i], str_cont.get(i).c_str(),
+                        (size_t)str_cont.get(i).length());
+               }
+            }));
+      }
+      for (int t=0; t<num_threads; ++t) workers[t].join();
+   }
+   else
+#endif
+   {
+      for (int i=0; i<str_length; ++i) {
+         if (collapse_off[i] >= 0)
+            memcpy(bufdata+collapse_off[i], collapse_s, (size_t)collapse_nbytes);
+         if (content_off[i] >= 0)
+            memcpy(bufdata+content_off[i], str_cont.get(i).c_str(),
+               (size_t)str_cont.get(i).length());
       }
    }
 
@@ -884,7 +1092,7 @@ SEXP stri_flatten(SEXP str, SEXP collapse, SEXP na_empty, SEXP omit_empty) // a.
    // 3. Get ret val & return
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, 1));
-   SET_STRING_ELT(ret, 0, Rf_mkCharLenCE(buf.data(), cur, CE_UTF8));
+   SET_STRING_ELT(ret, 0, Rf_mkCharLenCE(bufdata, nbytes, CE_UTF8));
    STRI__UNPROTECT_ALL
    return ret;
    STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
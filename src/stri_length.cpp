@@ -32,6 +32,19 @@
 #include "stri_stringi.h"
 #include "stri_ucnv.h"
 #include "stri_container_utf8.h"
+#include "stri_utf8dfa.h"
+#include <cstring>
+#include <cstdlib>
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#include <atomic>
+#endif
+
+// read-only access to a character vector's CHARSXP table, without a
+// function call per element (materializes ALTREP input, which the
+// whole-vector scans below would do anyway)
+#if !(defined(R_VERSION) && R_VERSION >= R_Version(3, 5, 0))
+#define STRING_PTR_RO(x) ((const SEXP*)STRING_PTR(x))
+#endif
 
 
 /**
@@ -65,6 +78,50 @@ R_len_t stri__numbytes_max(SEXP str)
 }
 
 
+/** [internal] count the code points in (and validate) a UTF-8 string
+ *
+ * ASCII runs, which dominate even in marked-UTF-8 data, are skimmed
+ * one machine word at a time (a word with no byte >= 0x80 contributes
+ * sizeof(word) code points at once); only bytes with the high bit set
+ * go through the table-driven decoder, which is what detects malformed
+ * sequences.
+ *
+ * @param s string
+ * @param n number of bytes in s
+ * @return number of code points, or -1 if s is not valid UTF-8
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static R_len_t stri__length_string_utf8(const char* s, R_len_t n)
+{
+   R_len_t i = 0;
+   R_len_t count = 0;
+   while (i < n) {
+      if ((uint8_t)s[i] < 0x80) {
+         ++i;
+         ++count;
+         while (i+(R_len_t)sizeof(uint64_t) <= n) {
+            uint64_t w; // memcpy - s+i may be unaligned
+            memcpy(&w, s+i, sizeof(uint64_t));
+            if (w & UINT64_C(0x8080808080808080)) break;
+            i += (R_len_t)sizeof(uint64_t);
+            count += (R_len_t)sizeof(uint64_t);
+         }
+         while (i < n && (uint8_t)s[i] < 0x80) {
+            ++i;
+            ++count;
+         }
+      }
+      else {
+         UChar32 c = stri__utf8dfa_next(s, i, n);
+         if (c < 0) return -1; // invalid utf-8 sequence
+         ++count;
+      }
+   }
+   return count;
+}
+
+
 /**
  * Count the number of characters in a string
  *
@@ -86,6 +143,9 @@ R_len_t stri__numbytes_max(SEXP str)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    word-at-a-time UTF-8 counting, see stri__length_string_utf8
  */
 SEXP stri_length(SEXP str)
 {
@@ -115,16 +175,8 @@ SEXP stri_length(SEXP str)
          throw StriException(MSG__BYTESENC);
       }
       else if (IS_UTF8(curs) || ucnvNative.isUTF8()) { // utf8 or native-utf8
-         UChar32 c = 0;
-         const char* curs_s = CHAR(curs);
-         R_len_t j = 0;
-         R_len_t i = 0;
-         while (c >= 0 && j < curs_n) {
-            U8_NEXT(curs_s, j, curs_n, c); // faster that U8_FWD_1 & gives bad UChar32s
-            i++;
-         }
-
-         if (c < 0) { // invalid utf-8 sequence
+         R_len_t i = stri__length_string_utf8(CHAR(curs), curs_n);
+         if (i < 0) { // invalid utf-8 sequence
             Rf_warning(MSG__INVALID_UTF8);
             retint[k] = NA_INTEGER;
          }
@@ -174,6 +226,9 @@ SEXP stri_length(SEXP str)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    scan the CHARSXP table directly; the NA select compiles branchless
  */
 SEXP stri_numbytes(SEXP str)
 {
@@ -184,10 +239,12 @@ SEXP stri_numbytes(SEXP str)
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(INTSXP, str_n));
    int* retint = INTEGER(ret);
+   const SEXP* str_tab = STRING_PTR_RO(str);
    for (R_len_t i=0; i<str_n; ++i) {
-      SEXP curs = STRING_ELT(str, i);
+      SEXP curs = str_tab[i];
       /* INPUT ENCODING CHECK: this function does not need this. */
-      retint[i] = (curs == NA_STRING)?NA_INTEGER:LENGTH(curs); // O(1) - stored by R
+      R_len_t curs_n = LENGTH(curs); // O(1) - stored by R (harmless for NA)
+      retint[i] = (curs == NA_STRING)?NA_INTEGER:curs_n;
    }
    STRI__UNPROTECT_ALL
    return ret;
@@ -210,6 +267,9 @@ SEXP stri_numbytes(SEXP str)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    scan the CHARSXP table directly; the NA select compiles branchless
  */
 SEXP stri_isempty(SEXP str)
 {
@@ -220,10 +280,12 @@ SEXP stri_isempty(SEXP str)
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(LGLSXP, str_n));
    int* retlog = LOGICAL(ret);
+   const SEXP* str_tab = STRING_PTR_RO(str);
    for (R_len_t i=0; i<str_n; ++i) {
-      SEXP curs = STRING_ELT(str, i);
+      SEXP curs = str_tab[i];
       /* INPUT ENCODING CHECK: this function does not need this. */
-      retlog[i] = (curs == NA_STRING)?NA_LOGICAL:(LENGTH(curs) <= 0);
+      R_len_t curs_n = LENGTH(curs); // O(1) - stored by R (harmless for NA)
+      retlog[i] = (curs == NA_STRING)?NA_LOGICAL:(curs_n <= 0);
    }
    STRI__UNPROTECT_ALL
    return ret;
@@ -272,28 +334,131 @@ int stri__width_char(UChar32 c) {
 }
 
 
-/** Get width of a single UTF-8 string
+/** [internal] width of a BMP code point, with caching
+ *
+ * Widths are memoized in 256-code-point blocks allocated on first
+ * touch, so each ICU property query is made at most once per process
+ * and typical text exercises only a handful of blocks (~256 B each).
+ * The cache is deliberately never freed. On C++11 builds the block
+ * pointers are atomic, as width measurement may run on worker threads
+ * (see stri_pad); when two threads race to fill a block, the loser's
+ * copy is discarded.
+ *
+ * @param c code point, must be <= 0xFFFF
+ * @return 0, 1, or 2
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+int stri__width_char_cached(UChar32 c)
+{
+#if defined(__cplusplus) && __cplusplus >= 201103L
+   static std::atomic<uint8_t*> blocks[256]; // zero-initialized
+   uint8_t* b = blocks[c >> 8].load(std::memory_order_acquire);
+   if (!b) {
+      uint8_t* fresh = (uint8_t*)malloc(256);
+      if (!fresh) return stri__width_char(c); // just don't cache
+      for (int k=0; k<256; ++k)
+         fresh[k] = (uint8_t)stri__width_char((UChar32)((c & ~(UChar32)0xff) | k));
+      if (blocks[c >> 8].compare_exchange_strong(b, fresh,
+            std::memory_order_acq_rel))
+         b = fresh;
+      else
+         free(fresh); // someone else has just filled this block
+   }
+   return (int)b[c & 0xff];
+#else
+   // no C++11 implies no worker threads - a plain static is fine
+   static uint8_t* blocks[256] = {NULL};
+   uint8_t* b = blocks[c >> 8];
+   if (!b) {
+      b = (uint8_t*)malloc(256);
+      if (!b) return stri__width_char(c); // just don't cache
+      for (int k=0; k<256; ++k)
+         b[k] = (uint8_t)stri__width_char((UChar32)((c & ~(UChar32)0xff) | k));
+      blocks[c >> 8] = b;
+   }
+   return (int)b[c & 0xff];
+#endif
+}
+
+
+/** [internal] does a word consist of printable ASCII only?
+ *
+ * Printable ASCII (0x20..0x7E) is exactly the width-1 part of ASCII;
+ * controls have width 0 and need the scalar path.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static inline bool stri__width_word_printable(uint64_t w)
+{
+   if (w & UINT64_C(0x8080808080808080)) return false; // non-ASCII byte
+   if ((w - UINT64_C(0x2020202020202020)) & ~w & UINT64_C(0x8080808080808080))
+      return false; // some byte < 0x20
+   uint64_t x = w ^ UINT64_C(0x7f7f7f7f7f7f7f7f);
+   if ((x - UINT64_C(0x0101010101010101)) & ~x & UINT64_C(0x8080808080808080))
+      return false; // some 0x7f (DEL)
+   return true;
+}
+
+
+/** Get width of a single UTF-8 string, no-throw variant
+ *
+ * Safe to call off the main R thread (no R API, no exceptions).
  *
  * @param str_cur_s string
  * @param str_cur_n number of bytes in str_cur_s
- * @return width
+ * @return width, or -1 if str_cur_s is not valid UTF-8
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    printable-ASCII runs word at a time, cached BMP widths elsewhere
  */
-int stri__width_string(const char* str_cur_s, int str_cur_n) {
+int stri__width_string_or_negative(const char* str_cur_s, int str_cur_n) {
    int cur_width = 0;
 
    UChar32 c;
    R_len_t j = 0;
    while (j < str_cur_n) {
-      U8_NEXT(str_cur_s, j, str_cur_n, c);
-      if (c < 0)
-         throw StriException(MSG__INVALID_UTF8);
-      else
-         cur_width += stri__width_char(c);
+      if ((uint8_t)str_cur_s[j] < 0x80) {
+         while (j+(R_len_t)sizeof(uint64_t) <= str_cur_n) {
+            uint64_t w; // memcpy - str_cur_s+j may be unaligned
+            memcpy(&w, str_cur_s+j, sizeof(uint64_t));
+            if (!stri__width_word_printable(w)) break;
+            j += (R_len_t)sizeof(uint64_t);
+            cur_width += (R_len_t)sizeof(uint64_t);
+         }
+         while (j < str_cur_n && (uint8_t)str_cur_s[j] < 0x80) {
+            uint8_t a = (uint8_t)str_cur_s[j++];
+            cur_width += (a >= 0x20 && a != 0x7f)?1:0; // controls: GC Cc
+         }
+      }
+      else {
+         c = stri__utf8dfa_next(str_cur_s, j, str_cur_n);
+         if (c < 0)
+            return -1; // invalid utf-8 sequence
+         else if (c <= (UChar32)0xFFFF)
+            cur_width += stri__width_char_cached(c);
+         else
+            cur_width += stri__width_char(c);
+      }
    }
 
    return cur_width;
 }
 
+
+/** Get width of a single UTF-8 string
+ *
+ * @param str_cur_s string
+ * @param str_cur_n number of bytes in str_cur_s
+ * @return width
+ */
+int stri__width_string(const char* str_cur_s, int str_cur_n) {
+   int cur_width = stri__width_string_or_negative(str_cur_s, str_cur_n);
+   if (cur_width < 0)
+      throw StriException(MSG__INVALID_UTF8);
+   return cur_width;
+}
+
 /**
   * Determine the width of strings
   *
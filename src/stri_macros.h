@@ -166,4 +166,17 @@
 #define UCHAR_LS  0x2028
 #define UCHAR_PS  0x2029
 
+
+/** [internal] per-byte mask: the high bit of each byte equal to b is set
+ *
+ * Exact for any input word (the classic zero-byte detection identity).
+ * Load words with memcpy - the input need not be aligned.
+ */
+static inline uint64_t stri__swar_eq(uint64_t w, uint8_t b)
+{
+   const uint64_t ones = UINT64_C(0x0101010101010101);
+   uint64_t x = w ^ (ones*(uint64_t)b);
+   return (x - ones) & ~x & (ones*UINT64_C(0x80));
+}
+
 #endif
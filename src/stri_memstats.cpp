@@ -0,0 +1,83 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+
+
+#ifdef STRI_MEMSTATS
+StriMemStats stri__memstats = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+#endif
+
+
+/** Report the internal allocation counters
+ *
+ * Only meaningful in builds configured with -DSTRI_MEMSTATS, see
+ * stri_memstats.h; counters are cumulative since the library was
+ * loaded.
+ *
+ * @return a named numeric vector, or NULL if the counters were
+ *    compiled out
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_mem_stats()
+{
+#ifdef STRI_MEMSTATS
+   const int NV = 9;
+   const char* stat_names[NV] = {
+      "string8_allocs", "string8_bytes",
+      "string8buf_allocs", "string8buf_bytes", "string8buf_resizes",
+      "arena_allocs", "arena_bytes",
+      "container_allocs", "container_bytes"
+   };
+   const size_t stat_values[NV] = {
+      stri__memstats.string8_allocs, stri__memstats.string8_bytes,
+      stri__memstats.string8buf_allocs, stri__memstats.string8buf_bytes,
+      stri__memstats.string8buf_resizes,
+      stri__memstats.arena_allocs, stri__memstats.arena_bytes,
+      stri__memstats.container_allocs, stri__memstats.container_bytes
+   };
+
+   SEXP ret, names;
+   PROTECT(ret = Rf_allocVector(REALSXP, NV));
+   PROTECT(names = Rf_allocVector(STRSXP, NV));
+   for (int k=0; k<NV; ++k) {
+      REAL(ret)[k] = (double)stat_values[k]; // may exceed INT_MAX
+      SET_STRING_ELT(names, k, Rf_mkChar(stat_names[k]));
+   }
+   Rf_setAttrib(ret, R_NamesSymbol, names);
+   UNPROTECT(2);
+   return ret;
+#else
+   return R_NilValue;
+#endif
+}
@@ -0,0 +1,80 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_memstats_h
+#define __stri_memstats_h
+
+
+/* Allocation counters (compile-time opt-in)
+ *
+ * Build with -DSTRI_MEMSTATS (e.g. via PKG_CPPFLAGS) to count heap
+ * allocations, bytes, and buffer-growth events in String8, String8buf,
+ * the container arenas, and the container element arrays. Read the
+ * counters from R with .Call(C_stri_mem_stats); without the flag the
+ * hooks compile to nothing and that call returns NULL.
+ *
+ * The counters are cumulative, never reset, and deliberately plain
+ * (not atomic): with worker threads enabled the totals may be slightly
+ * off, which is fine for the sizing/profiling reports they exist for.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+#ifdef STRI_MEMSTATS
+
+struct StriMemStats {
+   size_t string8_allocs;     ///< heap buffers allocated by String8
+   size_t string8_bytes;
+   size_t string8buf_allocs;  ///< String8buf buffers allocated
+   size_t string8buf_bytes;
+   size_t string8buf_resizes; ///< String8buf growth (realloc) events
+   size_t arena_allocs;       ///< container arena blocks allocated
+   size_t arena_bytes;
+   size_t container_allocs;   ///< container element arrays allocated
+   size_t container_bytes;
+};
+
+extern StriMemStats stri__memstats;
+
+#define STRI__MEMSTATS_ADD(group, bytes)                       \
+   {                                                           \
+      ++stri__memstats.group##_allocs;                         \
+      stri__memstats.group##_bytes += (size_t)(bytes);         \
+   }
+#define STRI__MEMSTATS_COUNT(field)                            \
+   { ++stri__memstats.field; }
+
+#else
+#define STRI__MEMSTATS_ADD(group, bytes)    /* nothing */
+#define STRI__MEMSTATS_COUNT(field)         /* nothing */
+#endif
+
+#endif
@@ -125,6 +125,18 @@
 #define MSG__EXPECTED_ASCII \
    "incorrect argument: the string contains non-ASCII characters"
 
+#define MSG__LONG_VECTORS_NOT_SUPPORTED \
+   "argument `%s`: long vectors (2^31 or more elements) are not supported"
+
+#define MSG__DEFERRED_RESULT_TYPE \
+   "the deferred function must return a character vector of the proper length"
+
+#define MSG__INCORRECT_PIPELINE_STEP \
+   "incorrect pipeline step specification"
+
+#define MSG__INTERRUPTED \
+   "operation interrupted"
+
 #define MSG__TIMEZONE_INCORRECT_ID \
    "incorrect time zone identifier"
 
@@ -164,6 +176,39 @@
 #define MSG__FIXED_CONFIG_FAILED \
    "fixed search engine config failed"
 
+#define MSG__FIXED_PATTERN_INVALIDATED \
+   "the 'stri_fixed_pattern' object is no longer valid"
+
+#define MSG__REGEX_PATTERN_INVALIDATED \
+   "the 'stri_regex_pattern' object is no longer valid"
+
+#define MSG__INCORRECT_CACHE_NAME \
+   "unknown cache: `%s`"
+
+#define MSG__ARG_EXPECTED_TRIGRAM_INDEX \
+   "argument `%s` should be a 'stri_trigram_index' object"
+
+#define MSG__TRIGRAM_INDEX_INVALIDATED \
+   "the 'stri_trigram_index' object is no longer valid"
+
+#define MSG__ARG_EXPECTED_SUFFIX_INDEX \
+   "argument `%s` should be a 'stri_suffix_index' object"
+
+#define MSG__SUFFIX_INDEX_INVALIDATED \
+   "the 'stri_suffix_index' object is no longer valid"
+
+#define MSG__ARG_EXPECTED_MMAP_LINES \
+   "argument `%s` should be a 'stri_mmap_lines' object"
+
+#define MSG__MMAP_LINES_INVALIDATED \
+   "the 'stri_mmap_lines' object is no longer valid"
+
+#define MSG__MMAP_LINES_TOO_LARGE \
+   "file '%s' has more lines, or a longer line, than an R vector can hold"
+
+#define MSG__SERIALIZED_FORMAT_ERROR \
+   "file '%s' is not a valid stringi string dump (or is corrupted)"
+
 #define MSG__REGEXP_FAILED_DETAILS \
    "regexp search failed: %s"
 
@@ -280,12 +325,27 @@
 #define MSG__OVERLAPPING_PATTERN_UNSUPPORTED \
    "overlapping pattern matches are not supported"
 
+#define MSG__FUZZY_PATTERN_TOO_LONG \
+   "approximate matching supports patterns of at most %d code points"
+
+#define MSG__FUZZY_MAX_DISTANCE_INVALID \
+   "`max_distance` should be nonnegative and less than the number of code points in the search pattern"
+
 #define MSG__OVERLAPPING_OR_UNSORTED_INDEXES \
    "index ranges must be sorted and mutually disjoint"
 
 #define MSG__MEM_ALLOC_ERROR \
    "memory allocation or access error"
 
+#define MSG__FILE_READ_ERROR \
+   "could not read file '%s'"
+
+#define MSG__FILE_WRITE_ERROR \
+   "could not write file '%s'"
+
+#define MSG__TEMPFILE_ERROR \
+   "could not create or use a temporary file"
+
 
 #define MSG__U_CHARSET_IS_UTF8 \
    "system ICU assumes that the default charset is always UTF-8, and hence this function has no effect"
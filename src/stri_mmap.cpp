@@ -0,0 +1,285 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_container_mmap.h"
+#include "stri_container_utf8.h"
+#include "stri_container_bytesearch.h"
+#include "stri_bytesearch_matcher.h"
+#include "stri_interrupt.h"
+
+
+/** [internal] externalptr finalizer */
+static void stri__mmap_lines_finalizer(SEXP ptr)
+{
+   StriContainerMMapUTF8* map = (StriContainerMMapUTF8*)R_ExternalPtrAddr(ptr);
+   if (map) {
+      delete map;
+      R_ClearExternalPtr(ptr);
+   }
+}
+
+
+/** fetch and validate a stri_mmap_lines handle
+ *
+ * Calls Rf_error on anything else, including a handle that has been
+ * serialized and restored (its address slot comes back NULL).
+ */
+static StriContainerMMapUTF8* stri__mmap_lines_unwrap(SEXP map)
+{
+   if (TYPEOF(map) != EXTPTRSXP
+         || R_ExternalPtrTag(map) != Rf_install("stri_mmap_lines"))
+      Rf_error(MSG__ARG_EXPECTED_MMAP_LINES, "map"); // error() call allowed here
+   StriContainerMMapUTF8* ret = (StriContainerMMapUTF8*)R_ExternalPtrAddr(map);
+   if (!ret)
+      Rf_error(MSG__MMAP_LINES_INVALIDATED); // error() call allowed here
+   return ret;
+}
+
+
+/** prepare the single query pattern shared by the mapped frontends
+ *
+ * @param pattern single string, not NA
+ * @return PROTECTed character vector of length 1
+ */
+static SEXP stri__mmap_prepare_pattern(SEXP pattern)
+{
+   PROTECT(pattern = stri_prepare_arg_string_1(pattern, "pattern"));
+   if (STRING_ELT(pattern, 0) == NA_STRING) {
+      UNPROTECT(1);
+      Rf_error(MSG__ARG_EXPECTED_NOT_NA, "pattern"); // error() call allowed here
+   }
+   return pattern;
+}
+
+
+/**
+ * Map a text file as a read-only vector of lines
+ *
+ * See stri_mmap_lines in R. The file's bytes stay in the OS page
+ * cache; only the per-line offset table is allocated, so corpora far
+ * larger than the available RAM (and than INT_MAX bytes) become
+ * queryable - each single line and the line count still have to fit
+ * in an R vector.
+ *
+ * @param fname single string, file path
+ * @return externalptr of class `stri_mmap_lines` (finalized on gc)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_mmap_lines(SEXP fname)
+{
+   const char* fname_s = stri__prepare_arg_string_1_notNA(fname, "fname");
+
+   StriContainerMMapUTF8* map = NULL;
+   STRI__ERROR_HANDLER_BEGIN(0)
+   map = new StriContainerMMapUTF8();
+   if (!map) throw StriException(MSG__MEM_ALLOC_ERROR);
+   const char* err = NULL;
+   if (!map->open(fname_s, err)) {
+      const char* msg = err;
+      delete map; map = NULL;
+      throw StriException(msg, fname_s);
+   }
+
+   SEXP ret;
+   STRI__PROTECT(ret = R_MakeExternalPtr(map,
+      Rf_install("stri_mmap_lines"), fname));
+   R_RegisterCFinalizerEx(ret, stri__mmap_lines_finalizer, TRUE);
+   Rf_setAttrib(ret, R_ClassSymbol, Rf_mkString("stri_mmap_lines"));
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({
+      // the finalizer has not been registered yet
+      if (map) delete map;
+   })
+}
+
+
+/**
+ * The number of lines behind a stri_mmap_lines handle
+ *
+ * @param map a stri_mmap_lines externalptr
+ * @return single integer
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_mmap_lines_count(SEXP map)
+{
+   StriContainerMMapUTF8* map_cont = stri__mmap_lines_unwrap(map);
+   return Rf_ScalarInteger(map_cont->get_n());
+}
+
+
+/**
+ * Detect which mapped lines contain a fixed pattern
+ *
+ * A scan straight over the mapping - no line is ever copied onto the
+ * R heap. There are no NAs: every line of a file exists.
+ *
+ * @param map a stri_mmap_lines externalptr
+ * @param pattern single string
+ * @param negate single bool
+ * @return logical vector, one element per mapped line
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_detect_fixed_mapped(SEXP map, SEXP pattern, SEXP negate)
+{
+   StriContainerMMapUTF8* map_cont = stri__mmap_lines_unwrap(map);
+   bool negate_1 = stri__prepare_arg_logical_1_notNA(negate, "negate");
+   PROTECT(pattern = stri__mmap_prepare_pattern(pattern));
+
+   StriByteSearchMatcher* matcher = NULL;
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriContainerUTF8 pattern_cont(pattern, 1);
+   const char* p = pattern_cont.get(0).c_str();
+   R_len_t p_len = pattern_cont.get(0).length();
+   if (p_len <= 0)
+      throw StriException(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+   matcher = StriContainerByteSearch::createMatcher(p, p_len,
+      StriContainerByteSearch::getByteSearchFlags(R_NilValue));
+
+   R_len_t n = map_cont->get_n();
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(LGLSXP, n));
+   int* ret_tab = LOGICAL(ret);
+   StriInterruptCheckpoint checkpoint;
+   for (R_len_t i=0; i<n; ++i) {
+      checkpoint.touch();
+      R_len_t cur_n = map_cont->get_length(i);
+      if (cur_n <= 0) {
+         ret_tab[i] = (int)negate_1;
+         continue;
+      }
+      matcher->reset(map_cont->get_s(i), cur_n);
+      ret_tab[i] = (matcher->findFirst() != USEARCH_DONE)
+         ?(int)(!negate_1):(int)negate_1;
+   }
+
+   delete matcher; matcher = NULL;
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(
+      if (matcher) { delete matcher; matcher = NULL; }
+   )
+}
+
+
+/**
+ * Count occurrences of a fixed pattern in each mapped line
+ *
+ * @param map a stri_mmap_lines externalptr
+ * @param pattern single string
+ * @return integer vector, one element per mapped line
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_count_fixed_mapped(SEXP map, SEXP pattern)
+{
+   StriContainerMMapUTF8* map_cont = stri__mmap_lines_unwrap(map);
+   PROTECT(pattern = stri__mmap_prepare_pattern(pattern));
+
+   StriByteSearchMatcher* matcher = NULL;
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriContainerUTF8 pattern_cont(pattern, 1);
+   const char* p = pattern_cont.get(0).c_str();
+   R_len_t p_len = pattern_cont.get(0).length();
+   if (p_len <= 0)
+      throw StriException(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+   matcher = StriContainerByteSearch::createMatcher(p, p_len,
+      StriContainerByteSearch::getByteSearchFlags(R_NilValue));
+
+   R_len_t n = map_cont->get_n();
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(INTSXP, n));
+   int* ret_tab = INTEGER(ret);
+   StriInterruptCheckpoint checkpoint;
+   for (R_len_t i=0; i<n; ++i) {
+      checkpoint.touch();
+      R_len_t cur_n = map_cont->get_length(i);
+      if (cur_n <= 0) {
+         ret_tab[i] = 0;
+         continue;
+      }
+      matcher->reset(map_cont->get_s(i), cur_n);
+      int found = 0;
+      while (USEARCH_DONE != matcher->findNext())
+         ++found;
+      ret_tab[i] = found;
+   }
+
+   delete matcher; matcher = NULL;
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(
+      if (matcher) { delete matcher; matcher = NULL; }
+   )
+}
+
+
+/**
+ * The number of code points in each mapped line
+ *
+ * The lines were validated as UTF-8 when the handle was built, so
+ * counting amounts to skipping the continuation bytes.
+ *
+ * @param map a stri_mmap_lines externalptr
+ * @return integer vector, one element per mapped line
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_length_mapped(SEXP map)
+{
+   StriContainerMMapUTF8* map_cont = stri__mmap_lines_unwrap(map);
+
+   STRI__ERROR_HANDLER_BEGIN(0)
+   R_len_t n = map_cont->get_n();
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(INTSXP, n));
+   int* ret_tab = INTEGER(ret);
+   StriInterruptCheckpoint checkpoint;
+   for (R_len_t i=0; i<n; ++i) {
+      checkpoint.touch();
+      const char* s = map_cont->get_s(i);
+      R_len_t cur_n = map_cont->get_length(i);
+      R_len_t cps = 0;
+      for (R_len_t j=0; j<cur_n; ++j)
+         if (((unsigned char)s[j] & 0xc0) != 0x80) ++cps;
+      ret_tab[i] = cps;
+   }
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(;)
+}
@@ -0,0 +1,175 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_opts_memo_h
+#define __stri_opts_memo_h
+
+
+// how many distinct option lists one parser remembers, and how long a
+// list still qualifies (real opts_* lists have a handful of entries)
+#define STRI__OPTS_MEMO_SLOTS  8
+#define STRI__OPTS_MEMO_MAXARG 12
+
+
+/** identity signature of a named option list
+ *
+ * Callers usually construct their opts_collator/opts_regex/opts_brkiter
+ * list once (e.g. via stri_opts_collator) and pass the very same object
+ * on every call, so the list SEXP, its names vector, and all its
+ * element SEXPs are pointer-identical from call to call. That tuple is
+ * the memo key. While an entry is stored its list is protected with
+ * R_PreserveObject, so the address cannot be recycled for a different
+ * object, and any user-level modification of the (now shared) list
+ * copies it first - an equal signature therefore implies equal content.
+ */
+struct StriOptsMemoKey {
+   SEXP obj;    ///< the option list itself
+   SEXP names;  ///< its names attribute
+   R_len_t narg;
+   SEXP elem[STRI__OPTS_MEMO_MAXARG];
+};
+
+
+/** fill in the signature of opts; false if opts does not qualify for
+ *  memoization (not a nonempty named list, or too long) */
+static inline bool stri__opts_memo_capture(SEXP opts, StriOptsMemoKey& key)
+{
+   if (!Rf_isVectorList(opts)) return false;
+   R_len_t narg = LENGTH(opts);
+   if (narg <= 0 || narg > STRI__OPTS_MEMO_MAXARG) return false;
+   SEXP names = Rf_getAttrib(opts, R_NamesSymbol);
+   if (names == R_NilValue || LENGTH(names) != narg) return false;
+   key.obj = opts;
+   key.names = names;
+   key.narg = narg;
+   for (R_len_t i=0; i<narg; ++i)
+      key.elem[i] = VECTOR_ELT(opts, i);
+   return true;
+}
+
+
+static inline bool stri__opts_memo_same(const StriOptsMemoKey& a,
+   const StriOptsMemoKey& b)
+{
+   if (a.obj != b.obj || a.names != b.names || a.narg != b.narg)
+      return false;
+   for (R_len_t i=0; i<a.narg; ++i)
+      if (a.elem[i] != b.elem[i]) return false;
+   return true;
+}
+
+
+/** Memoizes the parsed form of one kind of options list
+ *
+ * Option parsing walks the list, copies the names, and validates each
+ * value on every single call; in call-per-string workloads that rivals
+ * the actual work, and the collator/regex/break-iterator object caches
+ * cannot help because they sit behind the parse. One static instance
+ * per parser maps recently seen lists (by the identity signature
+ * above) to their parsed representation, LRU-evicted like the other
+ * fixed-size caches in this package.
+ *
+ * Note that a memo hit replays neither warnings (unknown option names)
+ * nor errors - both were already delivered when the list was first
+ * parsed, and a stored entry can only come from a successful parse.
+ *
+ * Values that depend on session state - notably anything resolved
+ * against the default locale - must not be baked into the parsed
+ * representation; store what is needed to re-resolve them cheaply
+ * instead (see the call sites).
+ *
+ * Main R thread only.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+template <class T>
+class StriOptsMemo {
+
+   private:
+
+      struct Entry {
+         StriOptsMemoKey key;
+         T parsed;
+         unsigned stamp;
+         bool used;
+         Entry() : stamp(0), used(false) { }
+      };
+
+      Entry m_slot[STRI__OPTS_MEMO_SLOTS];
+      unsigned m_clock;
+
+   public:
+
+      StriOptsMemo() : m_clock(0) { }
+
+      /** the memoized parse of opts, or NULL (unseen/evicted/not
+       *  memoizable) */
+      T* find(SEXP opts) {
+         StriOptsMemoKey key;
+         if (!stri__opts_memo_capture(opts, key)) return NULL;
+         for (int i=0; i<STRI__OPTS_MEMO_SLOTS; ++i) {
+            if (m_slot[i].used && stri__opts_memo_same(m_slot[i].key, key)) {
+               m_slot[i].stamp = ++m_clock;
+               return &m_slot[i].parsed;
+            }
+         }
+         return NULL;
+      }
+
+      /** remember the parse of opts, evicting the least recently used
+       *  entry if need be (no-op if opts is not memoizable) */
+      void put(SEXP opts, const T& parsed) {
+         StriOptsMemoKey key;
+         if (!stri__opts_memo_capture(opts, key)) return;
+         int slot = 0;
+         for (int i=0; i<STRI__OPTS_MEMO_SLOTS; ++i) {
+            if (m_slot[i].used && stri__opts_memo_same(m_slot[i].key, key)) {
+               // reparse of a list we already hold - refresh in place
+               m_slot[i].parsed = parsed;
+               m_slot[i].stamp = ++m_clock;
+               return;
+            }
+            if (!m_slot[i].used) { slot = i; break; }
+            if (m_slot[i].stamp < m_slot[slot].stamp)
+               slot = i;
+         }
+         if (m_slot[slot].used)
+            R_ReleaseObject(m_slot[slot].key.obj);
+         R_PreserveObject(key.obj);
+         m_slot[slot].key = key;
+         m_slot[slot].parsed = parsed;
+         m_slot[slot].stamp = ++m_clock;
+         m_slot[slot].used = true;
+      }
+};
+
+#endif
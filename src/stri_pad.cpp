@@ -34,10 +34,73 @@
 #include "stri_container_utf8.h"
 #include "stri_container_integer.h"
 #include "stri_string8buf.h"
+#include "stri_bufpool.h"
+#include "stri_threads.h"
 #include <cstring>
 #include <vector>
 
 
+/** [internal] measure one element for stri_pad
+ *
+ * No R API, no exceptions - safe to run on a worker thread; problems
+ * are reported through the return value and handled on the main thread.
+ *
+ * @param str_cont string container
+ * @param pad_cont padding container
+ * @param use_length_val count code points instead of widths?
+ * @param i element index
+ * @param str_width [out] width (or code point count) of the i-th string
+ * @return 0 - OK; 1 - pad is not a single code point;
+ *    2 - pad is not of width 1; 3 - invalid UTF-8 in str (error);
+ *    4 - invalid UTF-8 in str (warn, code point count kept)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static int stri__pad_measure(const StriContainerUTF8& str_cont,
+   const StriContainerUTF8& pad_cont, bool use_length_val, R_len_t i,
+   R_len_t& str_width)
+{
+   const char* pad_cur_s = pad_cont.get(i).c_str();
+   R_len_t pad_cur_n = pad_cont.get(i).length();
+
+   if (use_length_val) {
+      R_len_t k = 0;
+      UChar32 pad_cur = 0;
+      U8_NEXT(pad_cur_s, k, pad_cur_n, pad_cur);
+      if (pad_cur <= 0 || k < pad_cur_n)
+         return 1;
+
+      // String8::countCodePoints may call Rf_warning - count here instead
+      const String8& cur = str_cont.get(i);
+      if (cur.isASCII()) {
+         str_width = cur.length();
+         return 0;
+      }
+      const char* cur_s = cur.c_str();
+      R_len_t cur_n = cur.length();
+      UChar32 c = 0;
+      R_len_t j = 0;
+      str_width = 0;
+      int retval = 0;
+      while (j < cur_n) {
+         U8_NEXT(cur_s, j, cur_n, c);
+         str_width++;
+         if (c < 0) retval = 4;
+      }
+      return retval;
+   }
+   else {
+      if (stri__width_string_or_negative(pad_cur_s, pad_cur_n) != 1)
+         return 2;
+      str_width = stri__width_string_or_negative(
+         str_cont.get(i).c_str(), str_cont.get(i).length());
+      if (str_width < 0)
+         return 3;
+      return 0;
+   }
+}
+
+
 /**
  * Pad a string
  *
@@ -62,6 +125,10 @@
  * @version 0.5-1 (Marek Gagolewski, 2015-04-22)
  *    `use_length` arg added,
  *    second argument renamed `width`
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    widths are measured in a separate pass (optionally in parallel,
+ *    see stri__threads_requested) and shared with the padding pass
 */
 SEXP stri_pad(SEXP str, SEXP width, SEXP side, SEXP pad, SEXP use_length)
 {
@@ -97,7 +164,48 @@ SEXP stri_pad(SEXP str, SEXP width, SEXP side, SEXP pad, SEXP use_length)
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
 
-   String8buf buf(0); // TODO: prealloc
+   // phase 1: measure all elements; the results feed the buffer sizing
+   // and padding decisions below, so nothing is walked twice
+   std::vector<R_len_t> str_width(vectorize_length);
+   std::vector<int> measure_err(vectorize_length, 0);
+
+#ifdef STRI_HAVE_THREADS
+   // workers shall not touch R; errors are thrown as StriExceptions,
+   // which stri__parallel_for rethrows here once all chunks joined
+   int num_threads = stri__threads_requested(vectorize_length);
+   stri__parallel_for(vectorize_length, num_threads,
+      [&str_cont, &pad_cont, &width_cont, use_length_val,
+            &str_width, &measure_err](R_len_t chunk_from, R_len_t chunk_to, int) {
+         for (R_len_t i=chunk_from; i<chunk_to; ++i) {
+            if (str_cont.isNA(i) || pad_cont.isNA(i) || width_cont.isNA(i))
+               continue;
+            measure_err[i] = stri__pad_measure(str_cont, pad_cont,
+               use_length_val, i, str_width[i]);
+            if (measure_err[i] == 1)
+               throw StriException(MSG__NOT_EQ_N_CODEPOINTS, "pad", 1);
+            else if (measure_err[i] == 2)
+               throw StriException(MSG__NOT_EQ_N_WIDTH, "pad", 1);
+            else if (measure_err[i] == 3)
+               throw StriException(MSG__INVALID_UTF8);
+         }
+      });
+#else
+   for (R_len_t i=0; i<vectorize_length; ++i) {
+      if (str_cont.isNA(i) || pad_cont.isNA(i) || width_cont.isNA(i))
+         continue;
+      measure_err[i] = stri__pad_measure(str_cont, pad_cont,
+         use_length_val, i, str_width[i]);
+      if (measure_err[i] == 1)
+         throw StriException(MSG__NOT_EQ_N_CODEPOINTS, "pad", 1);
+      else if (measure_err[i] == 2)
+         throw StriException(MSG__NOT_EQ_N_WIDTH, "pad", 1);
+      else if (measure_err[i] == 3)
+         throw StriException(MSG__INVALID_UTF8);
+   }
+#endif
+
+   // phase 2: pad, reusing the measured widths
+   StriScratchBuf buf(0); // pooled scratch, grow-only
    for (R_len_t i=0; i<vectorize_length; ++i) {
       if (str_cont.isNA(i) || pad_cont.isNA(i)
           || /*side_cont.isNA(i) ||*/ width_cont.isNA(i)) {
@@ -105,30 +213,17 @@ SEXP stri_pad(SEXP str, SEXP width, SEXP side, SEXP pad, SEXP use_length)
          continue;
       }
 
+      if (measure_err[i] == 4)
+         Rf_warning(MSG__INVALID_UTF8);
+
       // get the current string
       R_len_t str_cur_n = str_cont.get(i).length();
       const char* str_cur_s = str_cont.get(i).c_str();
-      R_len_t str_cur_width;
+      R_len_t str_cur_width = str_width[i];
 
-      // get the width/length of padding code point(s)
+      // get the padding code point
       R_len_t pad_cur_n = pad_cont.get(i).length();
       const char* pad_cur_s = pad_cont.get(i).c_str();
-      R_len_t pad_cur_width;
-      if (use_length_val) {
-         pad_cur_width = 1;
-         str_cur_width = str_cont.get(i).countCodePoints();
-         R_len_t k = 0;
-         UChar32 pad_cur = 0;
-         U8_NEXT(pad_cur_s, k, pad_cur_n, pad_cur);
-         if (pad_cur <= 0 || k < pad_cur_n)
-            throw StriException(MSG__NOT_EQ_N_CODEPOINTS, "pad", 1);
-      }
-      else {
-         pad_cur_width = stri__width_string(pad_cur_s, pad_cur_n);
-         str_cur_width = stri__width_string(str_cur_s, str_cur_n);
-         if (pad_cur_width != 1)
-            throw StriException(MSG__NOT_EQ_N_WIDTH, "pad", 1);
-      }
 
       // get the minimal width
       R_len_t width_cur = width_cont.get(i);
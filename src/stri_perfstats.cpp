@@ -0,0 +1,95 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_perfstats.h"
+
+#ifdef STRI_PERFSTATS
+#include <ctime>
+
+StriPerfStats stri__perfstats = { 0.0, 0, 0.0, 0, 0.0, 0, 0.0, 0 };
+
+double stri__perf_now_ns()
+{
+#if defined(CLOCK_MONOTONIC)
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec*1.0e9 + (double)ts.tv_nsec;
+#else
+   return (double)clock() * (1.0e9 / (double)CLOCKS_PER_SEC);
+#endif
+}
+#endif
+
+
+/** Report the internal phase timing counters
+ *
+ * Only meaningful in builds configured with -DSTRI_PERFSTATS, see
+ * stri_perfstats.h; counters are cumulative since the library was
+ * loaded.
+ *
+ * @return a named numeric vector, or NULL if the counters were
+ *    compiled out
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_perf_stats()
+{
+#ifdef STRI_PERFSTATS
+   const int NV = 8;
+   const char* stat_names[NV] = {
+      "prepare_ns", "prepare_events",
+      "container_ns", "container_events",
+      "engine_ns", "engine_events",
+      "materialize_ns", "materialize_events"
+   };
+   const double stat_values[NV] = {
+      stri__perfstats.prepare_ns, (double)stri__perfstats.prepare_events,
+      stri__perfstats.container_ns, (double)stri__perfstats.container_events,
+      stri__perfstats.engine_ns, (double)stri__perfstats.engine_events,
+      stri__perfstats.materialize_ns, (double)stri__perfstats.materialize_events
+   };
+
+   SEXP ret, names;
+   PROTECT(ret = Rf_allocVector(REALSXP, NV));
+   PROTECT(names = Rf_allocVector(STRSXP, NV));
+   for (int k=0; k<NV; ++k) {
+      REAL(ret)[k] = stat_values[k];
+      SET_STRING_ELT(names, k, Rf_mkChar(stat_names[k]));
+   }
+   Rf_setAttrib(ret, R_NamesSymbol, names);
+   UNPROTECT(2);
+   return ret;
+#else
+   return R_NilValue;
+#endif
+}
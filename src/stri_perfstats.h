@@ -0,0 +1,100 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_perfstats_h
+#define __stri_perfstats_h
+
+
+/* Phase timing counters (compile-time opt-in)
+ *
+ * Build with -DSTRI_PERFSTATS (e.g. via PKG_CPPFLAGS) to accumulate
+ * wall-clock time spent in the major phases of a vectorized call:
+ *
+ *   prepare     - argument coercion (stri_prepare_arg.cpp)
+ *   container   - UTF-8/UTF-16 container construction (conversion in)
+ *   engine      - the matching/transforming loop proper (hooked
+ *                 per function; see e.g. the fixed/regex detectors)
+ *   materialize - container-to-R conversion (conversion out)
+ *
+ * Read the counters from R with .Call(C_stri_perf_stats); without the
+ * flag the hooks compile to nothing and that call returns NULL. The
+ * phases do not nest at their chosen hook points, so the four numbers
+ * answer directly whether time goes to conversion or to matching.
+ *
+ * Like the STRI_MEMSTATS counters, these are cumulative, never reset,
+ * main-R-thread-only, and deliberately plain (not atomic).
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+#ifdef STRI_PERFSTATS
+
+struct StriPerfStats {
+   double prepare_ns;        ///< time in argument preparation
+   size_t prepare_events;
+   double container_ns;      ///< time constructing string containers
+   size_t container_events;
+   double engine_ns;         ///< time in instrumented engine loops
+   size_t engine_events;
+   double materialize_ns;    ///< time converting containers back to R
+   size_t materialize_events;
+};
+
+extern StriPerfStats stri__perfstats;
+
+/** current monotonic time, in nanoseconds */
+double stri__perf_now_ns();
+
+/** accumulates the lifetime of a scope into one phase's counters */
+class StriPerfScope {
+   private:
+      double* m_ns;
+      size_t* m_events;
+      double m_t0;
+
+   public:
+      StriPerfScope(double* ns, size_t* events) :
+         m_ns(ns), m_events(events), m_t0(stri__perf_now_ns()) { }
+      ~StriPerfScope() {
+         *m_ns += stri__perf_now_ns() - m_t0;
+         ++(*m_events);
+      }
+};
+
+#define STRI__PERFSTATS_SCOPE(phase)                                 \
+   StriPerfScope stri__perf_scope_##phase(                           \
+      &stri__perfstats.phase##_ns, &stri__perfstats.phase##_events);
+
+#else
+#define STRI__PERFSTATS_SCOPE(phase)       /* nothing */
+#endif
+
+#endif
@@ -0,0 +1,308 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2017, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_container_utf8.h"
+#include "stri_string8buf.h"
+#include "stri_bufpool.h"
+#include <unicode/ucasemap.h>
+#include <unicode/uchar.h>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <utility>
+
+
+// operation codes for stri_pipeline steps
+#define STRI__PIPELINE_TRIM_BOTH          1
+#define STRI__PIPELINE_TRIM_LEFT          2
+#define STRI__PIPELINE_TRIM_RIGHT         3
+#define STRI__PIPELINE_TOLOWER            4
+#define STRI__PIPELINE_TOUPPER            5
+#define STRI__PIPELINE_REPLACE_ALL_FIXED  6
+
+
+/** [internal] one parsed pipeline step
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+struct StriPipelineStep {
+   int op;
+   const String8* pattern;       // STRI__PIPELINE_REPLACE_ALL_FIXED only
+   const String8* replacement;   // STRI__PIPELINE_REPLACE_ALL_FIXED only
+
+   StriPipelineStep(int _op) {
+      op = _op;
+      pattern = NULL;
+      replacement = NULL;
+   }
+};
+
+
+/** [internal] number of leading White_Space bytes in a UTF-8 string
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static R_len_t stri__pipeline_span_ws_front(const char* s, R_len_t n)
+{
+   R_len_t j = 0;
+   while (j < n) {
+      R_len_t jprev = j;
+      UChar32 c;
+      U8_NEXT(s, j, n, c); // the container guarantees well-formed UTF-8
+      if (!u_isUWhiteSpace(c)) return jprev;
+   }
+   return n;
+}
+
+
+/** [internal] length of a UTF-8 string without its White_Space tail
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static R_len_t stri__pipeline_span_ws_back(const char* s, R_len_t n)
+{
+   R_len_t j = n;
+   while (j > 0) {
+      R_len_t jprev = j;
+      UChar32 c;
+      U8_PREV(s, 0, j, c);
+      if (!u_isUWhiteSpace(c)) return jprev;
+   }
+   return 0;
+}
+
+
+/**
+ * Run a chain of simple string operations in one pass over each element
+ *
+ * The intermediate results live in two alternating scratch buffers;
+ * only the final form of each element is interned as a CHARSXP, so a
+ * k-step chain costs one output vector instead of k.
+ *
+ * @param str character vector
+ * @param steps list of character vectors, each c(op, args...);
+ *    recognized ops: trim, trim_left, trim_right, tolower, toupper,
+ *    replace_all_fixed (the latter takes pattern and replacement)
+ * @param locale single string or NULL; used by the case-mapping steps
+ * @return character vector
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_pipeline(SEXP str, SEXP steps, SEXP locale)
+{
+   if (!Rf_isVectorList(steps))
+      Rf_error(MSG__INCORRECT_PIPELINE_STEP);
+   const char* qloc = stri__prepare_arg_locale(locale, "locale", true); /* this is R_alloc'ed */
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+
+   UCaseMap* ucasemap = NULL;
+   STRI__ERROR_HANDLER_BEGIN(1)
+
+   // STEP 1.
+   // Compile the step list; the pattern/replacement arguments are
+   // re-encoded once, up front (the containers in step_conts own them)
+   R_len_t steps_n = LENGTH(steps);
+   std::vector<StriPipelineStep> plan;
+   plan.reserve(steps_n);
+   std::deque<StriContainerUTF8> step_conts;
+   bool any_casemap = false;
+   for (R_len_t k=0; k<steps_n; ++k) {
+      SEXP s = VECTOR_ELT(steps, k);
+      if (TYPEOF(s) != STRSXP || LENGTH(s) < 1 || STRING_ELT(s, 0) == NA_STRING)
+         throw StriException(MSG__INCORRECT_PIPELINE_STEP);
+      const char* opname = CHAR(STRING_ELT(s, 0));
+
+      if (!strcmp(opname, "trim") || !strcmp(opname, "trim_both"))
+         plan.push_back(StriPipelineStep(STRI__PIPELINE_TRIM_BOTH));
+      else if (!strcmp(opname, "trim_left"))
+         plan.push_back(StriPipelineStep(STRI__PIPELINE_TRIM_LEFT));
+      else if (!strcmp(opname, "trim_right"))
+         plan.push_back(StriPipelineStep(STRI__PIPELINE_TRIM_RIGHT));
+      else if (!strcmp(opname, "tolower")) {
+         plan.push_back(StriPipelineStep(STRI__PIPELINE_TOLOWER));
+         any_casemap = true;
+      }
+      else if (!strcmp(opname, "toupper")) {
+         plan.push_back(StriPipelineStep(STRI__PIPELINE_TOUPPER));
+         any_casemap = true;
+      }
+      else if (!strcmp(opname, "replace_all_fixed")) {
+         if (LENGTH(s) != 3)
+            throw StriException(MSG__INCORRECT_PIPELINE_STEP);
+         step_conts.push_back(StriContainerUTF8(s, LENGTH(s)));
+         const StriContainerUTF8& args = step_conts.back();
+         if (args.isNA(1) || args.isNA(2) || args.get(1).length() <= 0)
+            throw StriException(MSG__INCORRECT_PIPELINE_STEP);
+         StriPipelineStep step(STRI__PIPELINE_REPLACE_ALL_FIXED);
+         step.pattern     = &args.get(1);
+         step.replacement = &args.get(2);
+         plan.push_back(step);
+      }
+      else
+         throw StriException(MSG__INCORRECT_PIPELINE_STEP);
+   }
+
+   if (any_casemap) {
+      UErrorCode status = U_ZERO_ERROR;
+      ucasemap = ucasemap_open(qloc, U_FOLD_CASE_DEFAULT, &status);
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+   }
+
+   R_len_t str_n = LENGTH(str);
+   StriContainerUTF8 str_cont(str, str_n);
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(STRSXP, str_n));
+
+   R_len_t bufsize = str_cont.getMaxNumBytes();
+   bufsize += 10; // a small margin
+   StriScratchBuf buf0(bufsize);
+   StriScratchBuf buf1(bufsize);
+   StriScratchBuf* bufs[2] = { &buf0, &buf1 };
+
+   // inputs are often categorical-like - run each unique value once
+   str_cont.buildDuplicateIndex();
+
+   // STEP 2.
+   // Run the whole chain element-wise
+   std::deque< std::pair<R_len_t, R_len_t> > occurrences;
+   for (R_len_t i = str_cont.vectorize_init();
+         i != str_cont.vectorize_end();
+         i = str_cont.vectorize_next(i))
+   {
+      if (str_cont.isNA(i)) {
+         SET_STRING_ELT(ret, i, NA_STRING);
+         continue;
+      }
+
+      R_len_t fst = str_cont.getDuplicateOf(i);
+      if (fst < i) {
+         // same input as an earlier element - reuse its result
+         SET_STRING_ELT(ret, i, STRING_ELT(ret, fst));
+         continue;
+      }
+
+      const char* cur_s = str_cont.get(i).c_str();
+      R_len_t     cur_n = str_cont.get(i).length();
+      int cur_buf = -1; // which scratch buffer backs cur_s (-1: the container)
+
+      for (std::vector<StriPipelineStep>::const_iterator it = plan.begin();
+            it != plan.end(); ++it)
+      {
+         switch (it->op) {
+         case STRI__PIPELINE_TRIM_BOTH:
+         case STRI__PIPELINE_TRIM_LEFT:
+         case STRI__PIPELINE_TRIM_RIGHT: {
+            // trimming only moves the ends - no copy at all
+            if (it->op != STRI__PIPELINE_TRIM_RIGHT) {
+               R_len_t jfront = stri__pipeline_span_ws_front(cur_s, cur_n);
+               cur_s += jfront;
+               cur_n -= jfront;
+            }
+            if (it->op != STRI__PIPELINE_TRIM_LEFT)
+               cur_n = stri__pipeline_span_ws_back(cur_s, cur_n);
+            break;
+         }
+
+         case STRI__PIPELINE_TOLOWER:
+         case STRI__PIPELINE_TOUPPER: {
+            // always write into the buffer that does not back cur_s
+            StriScratchBuf* out = bufs[(cur_buf == 0)?1:0];
+            UErrorCode status = U_ZERO_ERROR;
+            int buf_need;
+            if (it->op == STRI__PIPELINE_TOLOWER) buf_need = ucasemap_utf8ToLower(
+               ucasemap, out->data(), out->size(), cur_s, cur_n, &status);
+            else buf_need = ucasemap_utf8ToUpper(
+               ucasemap, out->data(), out->size(), cur_s, cur_n, &status);
+
+            if (U_FAILURE(status)) { /* retry */
+               out->resize(buf_need, false/*destroy contents*/);
+               status = U_ZERO_ERROR;
+               if (it->op == STRI__PIPELINE_TOLOWER) buf_need = ucasemap_utf8ToLower(
+                  ucasemap, out->data(), out->size(), cur_s, cur_n, &status);
+               else buf_need = ucasemap_utf8ToUpper(
+                  ucasemap, out->data(), out->size(), cur_s, cur_n, &status);
+               STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+            }
+
+            cur_s = out->data();
+            cur_n = buf_need;
+            cur_buf = (cur_buf == 0)?1:0;
+            break;
+         }
+
+         case STRI__PIPELINE_REPLACE_ALL_FIXED: {
+            const char* pat_s = it->pattern->c_str();
+            R_len_t     pat_n = it->pattern->length();
+            occurrences.clear();
+            R_len_t j = 0;
+            while (j+pat_n <= cur_n) {
+               if (cur_s[j] == pat_s[0] && !memcmp(cur_s+j, pat_s, pat_n)) {
+                  occurrences.push_back(std::pair<R_len_t, R_len_t>(j, j+pat_n));
+                  j += pat_n;
+               }
+               else ++j;
+            }
+            if (occurrences.empty())
+               break; // nothing matched - cur passes through unchanged
+
+            R_len_t rep_n = it->replacement->length();
+            R_len_t buf_need = cur_n +
+               (R_len_t)occurrences.size()*(rep_n-pat_n);
+            StriScratchBuf* out = bufs[(cur_buf == 0)?1:0];
+            if (out->size() < buf_need)
+               out->resize(buf_need, false/*destroy contents*/);
+            buf_need = out->replaceAllAtPos(cur_s, cur_n,
+               it->replacement->c_str(), rep_n, occurrences);
+
+            cur_s = out->data();
+            cur_n = buf_need;
+            cur_buf = (cur_buf == 0)?1:0;
+            break;
+         }
+
+         default:
+            throw StriException(MSG__INTERNAL_ERROR);
+         }
+      }
+
+      SET_STRING_ELT(ret, i, Rf_mkCharLenCE(cur_s, cur_n, CE_UTF8));
+   }
+
+   if (ucasemap) { ucasemap_close(ucasemap); ucasemap = NULL; }
+   STRI__UNPROTECT_ALL
+   return ret;
+
+   STRI__ERROR_HANDLER_END({
+      if (ucasemap) { ucasemap_close(ucasemap); ucasemap = NULL; }
+   })
+}
@@ -31,8 +31,35 @@
 
 
 #include "stri_stringi.h"
+#include "stri_perfstats.h"
+#include <cstring>
 #include <unicode/uloc.h>
 
+
+/** [internal] fail fast (and clearly) on long vectors
+ *
+ * Everything downstream - the containers, the vectorized loops, and
+ * ICU itself (int32_t offsets everywhere) - indexes with 32-bit
+ * R_len_t; a 2^31-element vector cannot be processed in one call and
+ * must be chunked by the caller. Without this check such input would
+ * die later with an inscrutable internal length error.
+ *
+ * WARNING: this function is allowed to call the error() function.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+#ifdef LONG_VECTOR_SUPPORT
+#define STRI__IS_LONG_VEC(x) (Rf_isVector(x) && IS_LONG_VEC(x))
+#else
+#define STRI__IS_LONG_VEC(x) 0
+#endif
+
+static inline void stri__check_length(SEXP x, const char* argname)
+{
+   if (STRI__IS_LONG_VEC(x))
+      Rf_error(MSG__LONG_VECTORS_NOT_SUPPORTED, argname); // allowed here
+}
+
 /**
  * Prepare list argument
  *
@@ -229,14 +256,51 @@ SEXP stri_prepare_arg_list_string(SEXP x, const char* argname)
  *
  * @version 1.2.1 (Marek Gagolewski, 2018-04-21)
  *    #285: warn if coercing from a non-trivial list
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    early return for plain character vectors;
+ *    plain factors index their levels directly, with no R-level eval
  */
 SEXP stri_prepare_arg_string(SEXP x, const char* argname)
 {
+   STRI__PERFSTATS_SCOPE(prepare)
+
+   // the overwhelmingly common case: already a plain character vector;
+   // class-less strings are returned as-is below anyway, so no further
+   // inspection (and no allocation whatsoever) is needed
+   if (TYPEOF(x) == STRSXP && !isObject(x) && !STRI__IS_LONG_VEC(x))
+      return x;
+
    if ((SEXP*)argname == (SEXP*)R_NilValue)
       argname = "<noname>";
+   stri__check_length(x, argname);
 
    if (Rf_isFactor(x))
    {
+      SEXP cls = Rf_getAttrib(x, R_ClassSymbol);
+      SEXP levels = Rf_getAttrib(x, R_LevelsSymbol);
+      if (TYPEOF(cls) == STRSXP && LENGTH(cls) == 1 &&
+            strcmp(CHAR(STRING_ELT(cls, 0)), "factor") == 0 &&
+            TYPEOF(levels) == STRSXP)
+      {
+         // exactly a factor (a subclass could override as.character):
+         // index the levels directly - the CHARSXPs (with their
+         // encoding marks) are shared, only the n pointers are allocated
+         R_len_t n = LENGTH(x);
+         R_len_t nlevels = LENGTH(levels);
+         SEXP ret;
+         PROTECT(ret = Rf_allocVector(STRSXP, n));
+         const int* codes = INTEGER(x);
+         for (R_len_t i=0; i<n; ++i) {
+            if (codes[i] == NA_INTEGER || codes[i] < 1 || codes[i] > nlevels)
+               SET_STRING_ELT(ret, i, NA_STRING);
+            else
+               SET_STRING_ELT(ret, i, STRING_ELT(levels, codes[i]-1));
+         }
+         UNPROTECT(1);
+         return ret;
+      }
+
       SEXP call;
       PROTECT(call = Rf_lang2(Rf_install("as.character"), x));
       PROTECT(x = Rf_eval(call, R_GlobalEnv)); // this will mark its encoding manually
@@ -307,6 +371,7 @@ SEXP stri_prepare_arg_double(SEXP x, const char* argname)
 {
    if ((SEXP*)argname == (SEXP*)R_NilValue)
       argname = "<noname>";
+   stri__check_length(x, argname);
 
    if (Rf_isFactor(x))
    {
@@ -423,6 +488,7 @@ SEXP stri_prepare_arg_integer(SEXP x, const char* argname)
 {
    if ((SEXP*)argname == (SEXP*)R_NilValue)
       argname = "<noname>";
+   stri__check_length(x, argname);
 
    if (Rf_isFactor(x)) // factors must be checked first (as they are currently represented as integer vectors)
    {
@@ -495,6 +561,7 @@ SEXP stri_prepare_arg_logical(SEXP x, const char* argname)
 {
    if ((SEXP*)argname == (SEXP*)R_NilValue)
       argname = "<noname>";
+   stri__check_length(x, argname);
 
    if (Rf_isFactor(x))
    {
@@ -564,6 +631,7 @@ SEXP stri_prepare_arg_raw(SEXP x, const char* argname)
 {
    if ((SEXP*)argname == (SEXP*)R_NilValue)
       argname = "<noname>";
+   stri__check_length(x, argname);
 
    if (Rf_isFactor(x))
    {
@@ -1108,6 +1176,32 @@ const char* stri__prepare_arg_string_1_notNA(SEXP x, const char* argname)
 }
 
 
+// see stri__prepare_arg_locale below
+struct StriCachedLocale {
+   char query[ULOC_FULLNAME_CAPACITY];
+   char def[ULOC_FULLNAME_CAPACITY];     // default locale at caching time
+   char result[2*ULOC_FULLNAME_CAPACITY];
+   bool used_default;
+   bool valid;
+};
+static StriCachedLocale stri__locale_cache[4]; // zeroed
+// keep the array size in sync with STRI__LOCALE_CACHE_SIZE
+
+
+/** Drop all memoized locale resolutions
+ *
+ * Called by stri_locale_set - uloc_setDefault may free the string that
+ * previous defaults pointed at, so everything derived from it goes.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void stri__locale_cache_invalidate()
+{
+   for (int k=0; k<4; ++k)
+      stri__locale_cache[k].valid = false;
+}
+
+
 /**
  * Prepare character vector argument that will be used to choose a locale
  *
@@ -1140,12 +1234,44 @@ const char* stri__prepare_arg_string_1_notNA(SEXP x, const char* argname)
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-01-01)
  *    "@keyword=value" may use default locale from now; also, loc is trimmed
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    canonicalization results are memoized - tight multi-call
+ *    workloads pass the same locale string over and over
  */
 const char* stri__prepare_arg_locale(SEXP loc, const char* argname, bool allowdefault, bool allowna)
 {
    if (allowdefault && isNull(loc))
-      return uloc_getDefault();
-   else {
+      return uloc_getDefault(); // ICU keeps this resolved already
+
+   // Canonicalizing and trimming the same explicit locale string on
+   // every call adds up in tight loops, so recent results are kept in
+   // a small query -> canonical-form cache. Entries that pulled in the
+   // default locale ("@keyword=value" queries) record which default
+   // they used; stri_locale_set additionally drops everything (see
+   // stri__locale_cache_invalidate). Main R thread only.
+#define STRI__LOCALE_CACHE_SIZE 4
+   static int cache_next = 0;
+
+   if (Rf_isString(loc) && LENGTH(loc) == 1 && STRING_ELT(loc, 0) != NA_STRING) {
+      const char* q = CHAR(STRING_ELT(loc, 0));
+      if (strlen(q) < ULOC_FULLNAME_CAPACITY) {
+         const char* def = uloc_getDefault();
+         for (int k=0; k<STRI__LOCALE_CACHE_SIZE; ++k) {
+            if (stri__locale_cache[k].valid
+                  && !strcmp(stri__locale_cache[k].query, q)
+                  && (!stri__locale_cache[k].used_default
+                     || !strcmp(stri__locale_cache[k].def, def))) {
+               R_len_t ret_n = strlen(stri__locale_cache[k].result);
+               char* ret = R_alloc(ret_n+1, (int)sizeof(char));
+               memcpy(ret, stri__locale_cache[k].result, ret_n+1);
+               return ret;
+            }
+         }
+      }
+   }
+
+   {
       PROTECT(loc = stri_prepare_arg_string_1(loc, argname));
       if (STRING_ELT(loc, 0) == NA_STRING) {
          UNPROTECT(1);
@@ -1178,6 +1304,7 @@ const char* stri__prepare_arg_locale(SEXP loc, const char* argname, bool allowde
          else Rf_error(MSG__LOCALE_INCORRECT_ID); // Rf_error allowed here
       }
 
+      bool used_default = false;
       if (ret[0] == ULOC_KEYWORD_SEPARATOR) { // length is > 0
          // no locale specifier, just keywords
          if (!allowdefault) { UNPROTECT(1); Rf_error(MSG__LOCALE_INCORRECT_ID); }
@@ -1187,6 +1314,19 @@ const char* stri__prepare_arg_locale(SEXP loc, const char* argname, bool allowde
          ret = R_alloc(ret_detault_n+ret_n+1, (int)sizeof(char));
          memcpy(ret, ret_default, ret_detault_n);
          memcpy(ret+ret_detault_n, ret_tmp2, ret_n+1);
+         used_default = true;
+      }
+
+      const char* q = CHAR(STRING_ELT(loc, 0));
+      if (strlen(q) < ULOC_FULLNAME_CAPACITY
+            && strlen(ret) < 2*ULOC_FULLNAME_CAPACITY) {
+         StriCachedLocale* e = &stri__locale_cache[cache_next];
+         strcpy(e->query, q);
+         strcpy(e->result, ret);
+         strcpy(e->def, uloc_getDefault());
+         e->used_default = used_default;
+         e->valid = true;
+         cache_next = (cache_next+1) % STRI__LOCALE_CACHE_SIZE;
       }
 
       UNPROTECT(1);
@@ -0,0 +1,209 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stri_stringi.h"
+#include "stri_container_utf8.h"
+
+
+/** [internal] externalptr finalizer */
+static void stri__prepared_finalizer(SEXP ptr)
+{
+   StriContainerUTF8* cont = (StriContainerUTF8*)R_ExternalPtrAddr(ptr);
+   if (cont) {
+      delete cont;
+      R_ClearExternalPtr(ptr);
+   }
+}
+
+
+/** [internal] fetch and validate the prepared container attached to a vector
+ *
+ * @param str character vector (before any re-preparation)
+ * @return the container, or NULL if absent, of the wrong type, or
+ *    built for different strings (every CHARSXP pointer is compared -
+ *    an O(n) pointer scan, negligible next to a re-encoding pass)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+const StriContainerUTF8* stri__prepared_from_attrib(SEXP str)
+{
+   if (!isString(str)) return NULL;
+   SEXP ptr = Rf_getAttrib(str, Rf_install("stri_prepared"));
+   if (TYPEOF(ptr) != EXTPTRSXP) return NULL;
+   if (R_ExternalPtrTag(ptr) != Rf_install("stri_prepared")) return NULL;
+   const StriContainerUTF8* cont =
+      (const StriContainerUTF8*)R_ExternalPtrAddr(ptr);
+   if (!cont) return NULL;
+   SEXP orig = R_ExternalPtrProtected(ptr);
+   if (!isString(orig) || LENGTH(orig) != LENGTH(str)) return NULL;
+   R_len_t n = LENGTH(str);
+   for (R_len_t k=0; k<n; ++k)
+      if (STRING_ELT(orig, k) != STRING_ELT(str, k))
+         return NULL; // the vector has been modified since preparation
+   return cont;
+}
+
+
+/** [internal] externalptr finalizer for the corpus-stats record */
+static void stri__corpus_stats_finalizer(SEXP ptr)
+{
+   unsigned* rec = (unsigned*)R_ExternalPtrAddr(ptr);
+   if (rec) {
+      delete rec;
+      R_ClearExternalPtr(ptr);
+   }
+}
+
+
+/** [internal] establish the corpus-level facts for a character vector
+ *
+ * One pass over the CHARSXP headers - R's declared-encoding flags are
+ * authoritative, so not a single string byte is touched. Facts are
+ * claimed conservatively: a "bytes"-encoded element falsifies both
+ * encoding claims, native-encoded content falsifies them even when
+ * the native charset happens to be UTF-8 (the record must not depend
+ * on the session locale).
+ *
+ * @param str character vector
+ * @return STRI__CORPUS_* bitmask, always incl. STRI__CORPUS_STATS_KNOWN
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+unsigned stri__corpus_stats_scan(SEXP str)
+{
+   unsigned flags = STRI__CORPUS_STATS_KNOWN | STRI__CORPUS_ALL_ASCII |
+      STRI__CORPUS_ALL_UTF8 | STRI__CORPUS_NO_NA;
+   R_len_t n = LENGTH(str);
+   for (R_len_t i=0; i<n; ++i) {
+      SEXP curs = STRING_ELT(str, i);
+      if (curs == NA_STRING)
+         flags &= ~STRI__CORPUS_NO_NA;
+      else if (!IS_ASCII(curs)) {
+         flags &= ~STRI__CORPUS_ALL_ASCII;
+         if (!IS_UTF8(curs))
+            flags &= ~STRI__CORPUS_ALL_UTF8;
+      }
+      if (flags == STRI__CORPUS_STATS_KNOWN)
+         break; // nothing left to falsify
+   }
+   return flags;
+}
+
+
+/** [internal] fetch and validate the corpus-stats record attached to a vector
+ *
+ * The same staleness guard as stri__prepared_from_attrib: every
+ * CHARSXP pointer is compared, so a record copied along to a modified
+ * vector is silently ignored.
+ *
+ * @param str character vector (before any re-preparation)
+ * @return STRI__CORPUS_* bitmask, or 0 if absent, of the wrong type,
+ *    or built for different strings
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+unsigned stri__corpus_stats_from_attrib(SEXP str)
+{
+   if (!isString(str)) return 0;
+   SEXP ptr = Rf_getAttrib(str, Rf_install("stri_prepared"));
+   if (TYPEOF(ptr) != EXTPTRSXP) return 0;
+   if (R_ExternalPtrTag(ptr) != Rf_install("stri_corpus_stats")) return 0;
+   const unsigned* rec = (const unsigned*)R_ExternalPtrAddr(ptr);
+   if (!rec) return 0;
+   SEXP orig = R_ExternalPtrProtected(ptr);
+   if (!isString(orig) || LENGTH(orig) != LENGTH(str)) return 0;
+   R_len_t n = LENGTH(str);
+   for (R_len_t k=0; k<n; ++k)
+      if (STRING_ELT(orig, k) != STRING_ELT(str, k))
+         return 0; // the vector has been modified since preparation
+   return *rec;
+}
+
+
+/**
+ * Build a persistent, pre-validated UTF-8 container for a character vector
+ *
+ * See stri_prepared in R. With deep=TRUE the returned handle owns a
+ * read-only StriContainerUTF8 whose payload (validated, re-encoded
+ * content) is shared - via the container's copy-on-write reference
+ * counting - by every later vectorized call on the same vector,
+ * instead of being rebuilt from the SEXP each time.
+ *
+ * With deep=FALSE only the compact corpus-stats record is attached
+ * (see stri__corpus_stats_scan): a few bytes instead of a full copy
+ * of the corpus, and the container construction still skips the
+ * per-element encoding dispatch and the NA-bitmask pass.
+ *
+ * @param str character vector
+ * @param deep single logical value
+ * @return externalptr (finalized on gc), with the input kept alive
+ *    through the protected slot
+ *
+ * @version 1.4.6 (2020-01-24)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    new arg: deep
+ */
+SEXP stri_prepared(SEXP str, SEXP deep)
+{
+   bool deep_val = stri__prepare_arg_logical_1_notNA(deep, "deep");
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+   R_len_t str_len = LENGTH(str);
+
+   if (!deep_val) {
+      unsigned* rec = new unsigned(stri__corpus_stats_scan(str));
+      if (!rec) { UNPROTECT(1); Rf_error(MSG__MEM_ALLOC_ERROR); }
+      SEXP ret;
+      PROTECT(ret = R_MakeExternalPtr(rec,
+         Rf_install("stri_corpus_stats"), str));
+      R_RegisterCFinalizerEx(ret, stri__corpus_stats_finalizer, TRUE);
+      UNPROTECT(2);
+      return ret;
+   }
+
+   StriContainerUTF8* cont = NULL;
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   cont = new StriContainerUTF8(str, str_len, true/*read only*/);
+   if (!cont) throw StriException(MSG__MEM_ALLOC_ERROR);
+
+   SEXP ret;
+   STRI__PROTECT(ret = R_MakeExternalPtr(cont, Rf_install("stri_prepared"), str));
+   R_RegisterCFinalizerEx(ret, stri__prepared_finalizer, TRUE);
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({
+      // the finalizer has not been registered yet
+      if (cont) delete cont;
+   })
+}
@@ -35,6 +35,7 @@
 #include "stri_container_integer.h"
 #include "stri_string8buf.h"
 #include <vector>
+#include <cstring>
 #include "stri_container_charclass.h"
 
 
@@ -50,6 +51,10 @@
  *
  * @version 1.2.5 (Marek Gagolewski, 2019-07-23)
  *    #319: Fixed overflow in `stri_rand_shuffle()`.
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    shuffle UTF-8 spans in place of decoded code points -
+ *    no decode/re-encode per element
  */
 SEXP stri_rand_shuffle(SEXP str)
 {
@@ -66,7 +71,8 @@ SEXP stri_rand_shuffle(SEXP str)
       R_len_t ni = str_cont.get(i).length();
       if (ni > bufsize) bufsize = ni;
    }
-   std::vector<UChar32> buf1(bufsize); // at most bufsize UChars32 (bufsize/4 min.)
+   std::vector<R_len_t> starts(bufsize+1); // code point start offsets + sentinel
+   std::vector<R_len_t> perm(bufsize);     // permutation of code point indices
    String8buf buf2(bufsize);
 
    SEXP ret;
@@ -79,16 +85,20 @@ SEXP stri_rand_shuffle(SEXP str)
          continue;
       }
 
-      // fill buf1
+      // index the code point starts; nothing is decoded - shuffling
+      // just rearranges whole UTF-8 spans
       UChar32 c = (UChar32)0;
       const char* s = str_cont.get(i).c_str();
       R_len_t sn = str_cont.get(i).length();
       R_len_t j = 0;
       R_len_t k = 0;
       while (c >= 0 && j < sn) {
+         starts[k] = j;
+         perm[k] = k;
+         ++k;
          U8_NEXT(s, j, sn, c);
-         buf1[k++] = (int)c;
       }
+      starts[k] = sn;
 
       if (c < 0) {
          Rf_warning(MSG__INVALID_UTF8);
@@ -96,29 +106,27 @@ SEXP stri_rand_shuffle(SEXP str)
          continue;
       }
 
-      // do shuffle buf1 at pos 0..k-1: (Fisher-Yates shuffle)
+      // do shuffle perm at pos 0..k-1: (Fisher-Yates shuffle;
+      // same unif_rand draws as before, so seeded results are stable)
       R_len_t cur_n = k;
       for (j=0; j<cur_n-1; ++j) {
          // rand from i to cur_n-1
          R_len_t r = (R_len_t)floor(unif_rand()*(double)(cur_n-j)+(double)j);
-         UChar32 tmp = buf1[r];
-         buf1[r] = buf1[j];
-         buf1[j] = tmp;
+         R_len_t tmp = perm[r];
+         perm[r] = perm[j];
+         perm[j] = tmp;
       }
 
-      // create string:
+      // create string: copy the spans in permuted order
       char* buf2data = buf2.data();
-      c = (UChar32)0;
       j = 0;
-      k = 0;
-      UBool err = FALSE;
-      while (!err && k < cur_n) {
-         c = buf1[k++];
-         U8_APPEND((uint8_t*)buf2data, j, bufsize, c, err);
+      for (k=0; k<cur_n; ++k) {
+         R_len_t w  = perm[k];
+         R_len_t wn = starts[w+1]-starts[w];
+         memcpy(buf2data+j, s+starts[w], wn);
+         j += wn;
       }
 
-      if (err) throw StriException(MSG__INTERNAL_ERROR);
-
       SET_STRING_ELT(ret, i, Rf_mkCharLenCE(buf2data, j, CE_UTF8));
    }
 
@@ -146,6 +154,10 @@ SEXP stri_rand_shuffle(SEXP str)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    index -> UTF-8 lookup table built once per distinct pattern;
+ *    UnicodeSet::charAt walked the range list for every character drawn
  */
 SEXP stri_rand_strings(SEXP n, SEXP length, SEXP pattern)
 {
@@ -191,6 +203,18 @@ SEXP stri_rand_strings(SEXP n, SEXP length, SEXP pattern)
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, n_val));
 
+   // index -> pre-encoded UTF-8 lookup table for the current pattern;
+   // UnicodeSet::charAt walks the whole range list on every call, which
+   // dominated the per-character cost. Entries are fixed four-byte
+   // slots so a draw is one multiply and one unconditional 4-byte copy.
+   // The drawing itself is unchanged (one unif_rand per character,
+   // mapped to the k-th code point in sorted order), so seeded results
+   // stay identical.
+   const UnicodeSet* tab_set = NULL;
+   std::vector<uint8_t> tab_enc;    // 4 bytes per code point
+   std::vector<uint8_t> tab_enclen; // of which this many are used
+   bool tab_usable = false;
+
    for (R_len_t i=0; i<n_val; ++i) {
       if (length_cont.isNA(i) || pattern_cont.isNA(i)) {
          SET_STRING_ELT(ret, i, NA_STRING);
@@ -203,11 +227,46 @@ SEXP stri_rand_strings(SEXP n, SEXP length, SEXP pattern)
       const UnicodeSet* uset = &(pattern_cont.get(i));
       int32_t uset_size = uset->size();
 
+      if (uset != tab_set) { // at most once per distinct pattern
+         tab_set = uset;
+         // sets with multi-character strings have size() > the number
+         // of code points; leave those to the charAt path below (it
+         // reports them just like before)
+         int64_t span = 0;
+         int32_t range_count = uset->getRangeCount();
+         for (int32_t r=0; r<range_count; ++r)
+            span += (int64_t)uset->getRangeEnd(r)-(int64_t)uset->getRangeStart(r)+1;
+         tab_usable = (span == (int64_t)uset_size);
+         if (tab_usable) {
+            tab_enc.resize((size_t)uset_size*4);
+            tab_enclen.resize((size_t)uset_size);
+            int32_t t = 0;
+            for (int32_t r=0; r<range_count; ++r) {
+               UChar32 c_end = uset->getRangeEnd(r);
+               for (UChar32 c=uset->getRangeStart(r); c<=c_end; ++c, ++t) {
+                  uint8_t e[4] = {0, 0, 0, 0};
+                  R_len_t en = 0;
+                  UBool err = FALSE;
+                  U8_APPEND(e, en, 4, c, err);
+                  if (err) throw StriException(MSG__INTERNAL_ERROR);
+                  memcpy(&tab_enc[(size_t)t*4], e, 4);
+                  tab_enclen[t] = (uint8_t)en;
+               }
+            }
+         }
+      }
+
       // generate string:
       R_len_t j = 0;
       UBool err = FALSE;
       for (R_len_t k=0; k<length_cur; ++k) {
          int32_t idx = (int32_t)floor(unif_rand()*(double)uset_size); /* 0..uset_size-1 */
+         if (tab_usable && idx >= 0 && idx < uset_size) {
+            // j <= 4*k, so a fixed-size 4-byte copy never overruns buf
+            memcpy(bufdata+j, &tab_enc[(size_t)idx*4], 4);
+            j += tab_enclen[idx];
+            continue;
+         }
          UChar32 c = uset->charAt(idx);
          if (c < 0) throw StriException(MSG__INTERNAL_ERROR);
 
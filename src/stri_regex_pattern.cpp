@@ -0,0 +1,158 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_container_utf16.h"
+#include "stri_container_regex.h"
+
+
+/** the payload of a stri_regex_pattern externalptr
+ *
+ * Unlike the entries of StriRegexPatternCache, the compiled pattern is
+ * owned by the handle itself - cache eviction (or a budget of 0) can
+ * never force a recompilation of a precompiled pattern.
+ */
+struct StriRegexPatternPrepared {
+   RegexPattern* compiled; ///< owned by the handle
+   uint32_t flags;         ///< RegexMatcher flags fixed at compile time
+
+   StriRegexPatternPrepared(const UnicodeString& pattern, uint32_t _flags) {
+      flags = _flags;
+      UParseError pe;
+      UErrorCode status = U_ZERO_ERROR;
+      compiled = RegexPattern::compile(pattern, flags, pe, status);
+      if (U_FAILURE(status)) {
+         if (compiled) { delete compiled; compiled = NULL; }
+         throw StriException(status);
+      }
+      if (!compiled) throw StriException(MSG__MEM_ALLOC_ERROR);
+   }
+
+   ~StriRegexPatternPrepared() {
+      if (compiled) delete compiled;
+   }
+};
+
+
+static void stri__regex_pattern_finalizer(SEXP ptr)
+{
+   StriRegexPatternPrepared* p = (StriRegexPatternPrepared*)R_ExternalPtrAddr(ptr);
+   if (p) {
+      delete p;
+      R_ClearExternalPtr(ptr);
+   }
+}
+
+
+/** is this a stri_regex_pattern externalptr? */
+bool stri__is_regex_pattern(SEXP pattern)
+{
+   return (TYPEOF(pattern) == EXTPTRSXP
+      && R_ExternalPtrTag(pattern) == Rf_install("stri_regex_pattern"));
+}
+
+
+/** accept a stri_regex_pattern handle wherever a regex pattern goes
+ *
+ * For an ordinary argument this is equivalent to
+ * stri_prepare_arg_string(pattern, "pattern"). For a handle it returns the
+ * handle's own 1-element pattern vector and overrides pattern_flags and
+ * prepared with the precompiled state - opts_regex passed alongside a
+ * handle are thus ignored (they were fixed at stri_regex_pattern() time).
+ *
+ * @param pattern character vector or a stri_regex_pattern externalptr
+ * @param pattern_flags [in/out] RegexMatcher flags
+ * @param prepared [out] precompiled pattern (owned by the handle) or NULL
+ * @return character vector, ready to PROTECT
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri__regex_pattern_unwrap(SEXP pattern, uint32_t& pattern_flags,
+   const RegexPattern*& prepared)
+{
+   if (!stri__is_regex_pattern(pattern))
+      return stri_prepare_arg_string(pattern, "pattern");
+
+   StriRegexPatternPrepared* p =
+      (StriRegexPatternPrepared*)R_ExternalPtrAddr(pattern);
+   if (!p)
+      Rf_error(MSG__REGEX_PATTERN_INVALIDATED); // error() call allowed here
+
+   pattern_flags = p->flags;
+   prepared = p->compiled;
+   return R_ExternalPtrProtected(pattern);
+}
+
+
+/**
+ * Precompile a regex search pattern
+ *
+ * The returned externalptr may be passed as `pattern` to the
+ * stri_*_regex functions; the pattern is then compiled once here and
+ * never again - in particular it does not occupy (nor can it be evicted
+ * from) StriRegexPatternCache.
+ *
+ * @param pattern single string
+ * @param opts_regex list
+ * @return externalptr of class `stri_regex_pattern`
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_regex_pattern(SEXP pattern, SEXP opts_regex)
+{
+   uint32_t pattern_flags =
+      StriContainerRegexPattern::getRegexFlags(opts_regex);
+   PROTECT(pattern = stri_prepare_arg_string_1(pattern, "pattern"));
+
+   if (STRING_ELT(pattern, 0) == NA_STRING) {
+      UNPROTECT(1);
+      Rf_error(MSG__ARG_EXPECTED_NOT_NA, "pattern"); // error() call allowed here
+   }
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriContainerUTF16 pattern_cont(pattern, 1);
+   if (pattern_cont.get(0).length() <= 0)
+      throw StriException(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+
+   StriRegexPatternPrepared* p = new StriRegexPatternPrepared(
+      pattern_cont.get(0), pattern_flags);
+
+   SEXP ret;
+   STRI__PROTECT(ret = R_MakeExternalPtr(p,
+      Rf_install("stri_regex_pattern"), pattern));
+   R_RegisterCFinalizerEx(ret, stri__regex_pattern_finalizer, TRUE);
+   Rf_setAttrib(ret, R_ClassSymbol, Rf_mkString("stri_regex_pattern"));
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
+}
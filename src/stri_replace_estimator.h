@@ -0,0 +1,81 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_replace_estimator_h
+#define __stri_replace_estimator_h
+
+
+/**
+ * Exponentially-weighted estimator of replace output sizes
+ *
+ * Some replace paths cannot know the exact output length upfront
+ * (e.g., regex replacements with capture group references, whose
+ * expansion is match-dependent). They start from a per-element base
+ * heuristic; this class tracks the ratio between the actual output
+ * lengths and those heuristics over the elements of one call and
+ * pre-sizes the next element's buffer accordingly, so that on
+ * match-dense inputs the buffer stops reallocating after the first
+ * few elements. Deliberately call-local: input mixes differ too much
+ * between calls for a process-global ratio to be meaningful.
+ *
+ * Correctness never depends on the estimate - an undersized buffer
+ * merely grows as usual.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+class StriReplaceSizeEstimator {
+
+   private:
+
+      double ratio; ///< EW mean of observed actual/estimated ratios
+
+   public:
+
+      StriReplaceSizeEstimator() : ratio(1.0) { }
+
+      /** suggested allocation for an element whose base heuristic
+       *  says `base` bytes/code units */
+      inline R_len_t presize(R_len_t base) const {
+         double s = (double)base*ratio*1.0625+16.0; // slack against jitter
+         if (s > 2147483000.0) return base;
+         return (s > (double)base) ? (R_len_t)s : base;
+      }
+
+      /** record the actual output length of a finished element */
+      inline void observe(R_len_t estimated, R_len_t actual) {
+         if (estimated <= 0) return;
+         // quarter weight on the newest observation
+         ratio = 0.75*ratio+0.25*((double)actual/(double)estimated);
+      }
+};
+
+#endif
@@ -33,6 +33,7 @@
 #include "stri_stringi.h"
 #include "stri_container_utf8.h"
 #include "stri_string8buf.h"
+#include <cstring>
 
 
 /**
@@ -54,6 +55,12 @@
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    byte-reverse ASCII strings and ASCII runs in bulk
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    process the input in NA runs, see StriContainerUTF8::nextNA()
  */
 SEXP stri_reverse(SEXP str)
 {
@@ -65,15 +72,7 @@ SEXP stri_reverse(SEXP str)
 
    // STEP 1.
    // Calculate the required buffer length
-   R_len_t bufsize = 0;
-   for (R_len_t i=0; i<str_len; ++i) {
-      if (str_cont.isNA(i))
-         continue;
-
-      R_len_t cursize = str_cont.get(i).length();
-      if (cursize > bufsize)
-         bufsize = cursize;
-   }
+   R_len_t bufsize = str_cont.getMaxNumBytes();
 
    // STEP 2.
    // Alloc buffer & result vector
@@ -81,34 +80,58 @@ SEXP stri_reverse(SEXP str)
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, str_len));
 
-   for (R_len_t i = str_cont.vectorize_init();
-         i != str_cont.vectorize_end();
-         i = str_cont.vectorize_next(i))
+   // iterate in NA runs: within [i, run) no per-element NA test is
+   // needed at all, and all-NA stretches are blasted with NA_STRING
+   // without entering the work code (the run boundaries themselves
+   // are found one 64-element mask word at a time)
+   R_len_t i = 0;
+   while (i < str_len)
    {
-      if (str_cont.isNA(i)) {
-         SET_STRING_ELT(ret, i, NA_STRING);
-         continue;
-      }
+      R_len_t run = str_cont.nextNA(i, str_len);
+      for (; i < run; ++i)
+      {
+         R_len_t str_cur_n = str_cont.get(i).length();
+         const char* str_cur_s = str_cont.get(i).c_str();
+         char* bufdata = buf.data();
 
-      R_len_t str_cur_n = str_cont.get(i).length();
-      const char* str_cur_s = str_cont.get(i).c_str();
+         R_len_t j, k;
 
-      R_len_t j, k;
-      UChar32 chr;
-      UBool isError = FALSE;
+         if (str_cont.get(i).isASCII()) {
+            // plain byte reverse (a loop the compiler can vectorize)
+            for (j=0; j<str_cur_n; ++j)
+               bufdata[j] = str_cur_s[str_cur_n-1-j];
+            SET_STRING_ELT(ret, i, Rf_mkCharLenCE(bufdata, str_cur_n, CE_UTF8));
+            continue;
+         }
 
-      for (j=str_cur_n, k=0; !isError && j>0; ) {
-         U8_PREV(str_cur_s, 0, j, chr); // go backwards
-         if (chr < 0) {
-            throw StriException(MSG__INVALID_UTF8);
+         UChar32 chr;
+         for (j=str_cur_n, k=0; j>0; ) {
+            if ((uint8_t)str_cur_s[j-1] < 0x80) {
+               // bulk-reverse a whole ASCII run; stray continuation bytes
+               // cannot start here (they have the high bit set)
+               R_len_t r = j;
+               while (r > 0 && (uint8_t)str_cur_s[r-1] < 0x80) --r;
+               for (R_len_t z=j-1; z>=r; --z)
+                  bufdata[k++] = str_cur_s[z];
+               j = r;
+            }
+            else {
+               R_len_t jold = j;
+               U8_PREV(str_cur_s, 0, j, chr); // go backwards
+               if (chr < 0)
+                  throw StriException(MSG__INVALID_UTF8);
+               // bytes within a single code point keep their order
+               memcpy(bufdata+k, str_cur_s+j, (size_t)(jold-j));
+               k += jold-j;
+            }
          }
-         U8_APPEND((uint8_t*)buf.data(), k, str_cur_n, chr, isError);
-      }
 
-      if (isError)
-         throw StriException(MSG__INTERNAL_ERROR);
+         SET_STRING_ELT(ret, i, Rf_mkCharLenCE(bufdata, str_cur_n, CE_UTF8));
+      }
 
-      SET_STRING_ELT(ret, i, Rf_mkCharLenCE(buf.data(), str_cur_n, CE_UTF8));
+      run = str_cont.nextNonNA(i, str_len);
+      for (; i < run; ++i)
+         SET_STRING_ELT(ret, i, NA_STRING);
    }
 
    STRI__UNPROTECT_ALL
@@ -34,6 +34,128 @@
 #include "stri_container_utf8_indexable.h"
 #include "stri_container_integer.h"
 #include "stri_brkiter.h"
+#include "stri_threads.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <unicode/uloc.h>
+
+
+// Word_Break property classes of the ASCII range, see the fast path below
+#define STRI__WB_OTHER      0
+#define STRI__WB_LETTER     1
+#define STRI__WB_NUMERIC    2
+#define STRI__WB_WSEGSPACE  3
+#define STRI__WB_CR         4
+#define STRI__WB_LF         5
+#define STRI__WB_NEWLINE    6
+#define STRI__WB_SQUOTE     7
+#define STRI__WB_MIDLETTER  8
+#define STRI__WB_MIDNUM     9
+#define STRI__WB_MIDNUMLET 10
+#define STRI__WB_EXTNUMLET 11
+
+
+/** the Word_Break class of an ASCII byte */
+static inline int stri__wb_class_ascii(unsigned char c)
+{
+   if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+      return STRI__WB_LETTER;
+   if (c >= '0' && c <= '9') return STRI__WB_NUMERIC;
+   switch (c) {
+      case ' ':  return STRI__WB_WSEGSPACE;
+      case '\r': return STRI__WB_CR;
+      case '\n': return STRI__WB_LF;
+      case 0x0b: case 0x0c: return STRI__WB_NEWLINE;
+      case '\'': return STRI__WB_SQUOTE;
+      case ':':  return STRI__WB_MIDLETTER;
+      case ',': case ';': return STRI__WB_MIDNUM;
+      case '.':  return STRI__WB_MIDNUMLET;
+      case '_':  return STRI__WB_EXTNUMLET;
+      default:   return STRI__WB_OTHER;
+   }
+}
+
+
+/** Count the default word-break boundaries in pure-ASCII text
+ *
+ * A direct rendition of the UAX #29 word boundary rules restricted to
+ * the ASCII range (where there are no Extend/Format characters, no
+ * Hebrew letters, and no dictionary words, so WB3-WB13b reduce to a
+ * scan with one code point of look-behind/look-ahead). Gives the same
+ * answer as an untailored UBRK_WORD iterator, at memory bandwidth.
+ *
+ * Before Unicode 11 (ICU 62), U+0020 had Word_Break=Other and every
+ * space was its own segment; WB3d (WSegSpace x WSegSpace) now glues
+ * space runs together. We follow whatever the ICU we link against does.
+ *
+ * @param s ASCII string
+ * @param n length of s, in bytes
+ * @return number of boundary-delimited segments
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static int stri__count_boundaries_word_ascii(const char* s, R_len_t n)
+{
+   if (n <= 0) return 0;
+
+   int count = 1; // segments == inner breaks + 1
+   int c0 = STRI__WB_OTHER;                   // class of s[p-2]
+   int c1 = stri__wb_class_ascii((unsigned char)s[0]);
+   for (R_len_t p = 1; p < n; ++p) {
+      int c2 = stri__wb_class_ascii((unsigned char)s[p]);
+      int c3 = (p+1 < n)?stri__wb_class_ascii((unsigned char)s[p+1])
+                        :STRI__WB_OTHER;
+
+      bool brk;
+      if (c1 == STRI__WB_CR && c2 == STRI__WB_LF)
+         brk = false;                                            // WB3
+      else if (c1 == STRI__WB_CR || c1 == STRI__WB_LF || c1 == STRI__WB_NEWLINE
+            || c2 == STRI__WB_CR || c2 == STRI__WB_LF || c2 == STRI__WB_NEWLINE)
+         brk = true;                                             // WB3a/WB3b
+#if U_ICU_VERSION_MAJOR_NUM >= 62
+      else if (c1 == STRI__WB_WSEGSPACE && c2 == STRI__WB_WSEGSPACE)
+         brk = false;                                            // WB3d
+#endif
+      else if (c1 == STRI__WB_LETTER && c2 == STRI__WB_LETTER)
+         brk = false;                                            // WB5
+      else if (c1 == STRI__WB_LETTER && c3 == STRI__WB_LETTER
+            && (c2 == STRI__WB_MIDLETTER || c2 == STRI__WB_MIDNUMLET
+               || c2 == STRI__WB_SQUOTE))
+         brk = false;                                            // WB6
+      else if (c2 == STRI__WB_LETTER && c0 == STRI__WB_LETTER
+            && (c1 == STRI__WB_MIDLETTER || c1 == STRI__WB_MIDNUMLET
+               || c1 == STRI__WB_SQUOTE))
+         brk = false;                                            // WB7
+      else if (c1 == STRI__WB_NUMERIC && c2 == STRI__WB_NUMERIC)
+         brk = false;                                            // WB8
+      else if (c1 == STRI__WB_LETTER && c2 == STRI__WB_NUMERIC)
+         brk = false;                                            // WB9
+      else if (c1 == STRI__WB_NUMERIC && c2 == STRI__WB_LETTER)
+         brk = false;                                            // WB10
+      else if (c2 == STRI__WB_NUMERIC && c0 == STRI__WB_NUMERIC
+            && (c1 == STRI__WB_MIDNUM || c1 == STRI__WB_MIDNUMLET
+               || c1 == STRI__WB_SQUOTE))
+         brk = false;                                            // WB11
+      else if (c1 == STRI__WB_NUMERIC && c3 == STRI__WB_NUMERIC
+            && (c2 == STRI__WB_MIDNUM || c2 == STRI__WB_MIDNUMLET
+               || c2 == STRI__WB_SQUOTE))
+         brk = false;                                            // WB12
+      else if (c2 == STRI__WB_EXTNUMLET
+            && (c1 == STRI__WB_LETTER || c1 == STRI__WB_NUMERIC
+               || c1 == STRI__WB_EXTNUMLET))
+         brk = false;                                            // WB13a
+      else if (c1 == STRI__WB_EXTNUMLET
+            && (c2 == STRI__WB_LETTER || c2 == STRI__WB_NUMERIC))
+         brk = false;                                            // WB13b
+      else
+         brk = true;                                             // WB999
+
+      if (brk) ++count;
+      c0 = c1; c1 = c2;
+   }
+   return count;
+}
 
 
 /** Count the number of BreakIterator boundaries
@@ -49,6 +171,9 @@
  *
  * @version 0.4-1 (Marek Gagolewski, 2014-12-02)
  *          use StriRuleBasedBreakIterator
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    ASCII fast path for the default word iterator
  */
 SEXP stri_count_boundaries(SEXP str, SEXP opts_brkiter)
 {
@@ -62,6 +187,7 @@ SEXP stri_count_boundaries(SEXP str, SEXP opts_brkiter)
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(INTSXP, str_length));
    StriRuleBasedBreakIterator brkiter(opts_brkiter2);
+   bool word_ascii_fast = opts_brkiter2.isDefaultWord();
 
    for (R_len_t i = 0; i < str_length; ++i)
    {
@@ -70,6 +196,12 @@ SEXP stri_count_boundaries(SEXP str, SEXP opts_brkiter)
          continue;
       }
 
+      if (word_ascii_fast && str_cont.get(i).isASCII()) {
+         INTEGER(ret)[i] = stri__count_boundaries_word_ascii(
+            str_cont.get(i).c_str(), str_cont.get(i).length());
+         continue;
+      }
+
       brkiter.setupMatcher(str_cont.get(i).c_str(), str_cont.get(i).length());
       brkiter.first();
 
@@ -84,3 +216,129 @@ SEXP stri_count_boundaries(SEXP str, SEXP opts_brkiter)
    return ret;
    STRI__ERROR_HANDLER_END({ /* no action */  })
 }
+
+
+/** Count text boundaries, with a per-element locale
+ *
+ * The elements are grouped by their requested locale; each group is
+ * processed with its own (cloned, cached) break iterator, so a
+ * multilingual corpus needs one call instead of one call per locale.
+ * With options(stringi.num_threads=) greater than one the groups are
+ * distributed over worker threads; results are scattered back into the
+ * input order either way.
+ *
+ * @param str character vector
+ * @param locale character vector of locale identifiers,
+ *    "" for the default locale, recycled to the length of str
+ * @param opts_brkiter named list, the default type is "word"
+ * @return integer vector
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_count_boundaries_locales(SEXP str, SEXP locale, SEXP opts_brkiter)
+{
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+   PROTECT(locale = stri_prepare_arg_string(locale, "locale"));
+   StriBrkIterOptions opts_brkiter2(opts_brkiter, "word");
+
+   STRI__ERROR_HANDLER_BEGIN(2)
+   R_len_t vectorize_length = stri__recycling_rule(true, 2,
+      LENGTH(str), LENGTH(locale));
+   StriContainerUTF8_indexable str_cont(str, vectorize_length);
+   StriContainerUTF8 locale_cont(locale, vectorize_length);
+   bool word_ascii_fast = opts_brkiter2.isDefaultWord();
+
+   // group the element indices by locale; the map also keeps the
+   // locale strings alive for the per-group iterator options
+   std::map< std::string, std::vector<R_len_t> > groups;
+   for (R_len_t i = 0; i < vectorize_length; ++i) {
+      if (str_cont.isNA(i) || locale_cont.isNA(i))
+         continue; // stays NA
+      const char* qloc = locale_cont.get(i).c_str();
+      if (!*qloc) qloc = uloc_getDefault();
+      groups[std::string(qloc)].push_back(i);
+   }
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(INTSXP, vectorize_length));
+   int* ret_tab = INTEGER(ret);
+   for (R_len_t i = 0; i < vectorize_length; ++i)
+      ret_tab[i] = NA_INTEGER;
+
+   R_len_t ngroups = (R_len_t)groups.size();
+   // group iterators are all opened here, on the main thread -
+   // the compiled-master cache is not thread-safe
+   std::vector<StriRuleBasedBreakIterator> gbrk((size_t)ngroups);
+   std::vector< const std::vector<R_len_t>* > gidx((size_t)ngroups);
+   std::map< std::string, std::vector<R_len_t> >::const_iterator git = groups.begin();
+   for (R_len_t g = 0; git != groups.end(); ++git, ++g) {
+      gbrk[g] = opts_brkiter2;
+      gbrk[g].setLocaleValue(git->first.c_str());
+      gbrk[g].setupMatcher("", 0); // forces open()
+      gidx[g] = &git->second;
+   }
+
+#ifdef STRI_HAVE_THREADS
+   int num_threads = stri__threads_requested(ngroups);
+   if (num_threads > 1) {
+      // no R API, no exceptions may leave a worker
+      std::vector<std::string> errmsg(num_threads);
+      std::vector<std::thread> workers;
+      for (int t=0; t<num_threads; ++t) {
+         workers.push_back(std::thread([t, num_threads, ngroups,
+               word_ascii_fast, ret_tab, &gbrk, &gidx, &str_cont, &errmsg]() {
+            try {
+               for (R_len_t g=t; g<ngroups; g+=num_threads) {
+                  StriRuleBasedBreakIterator* brk = &gbrk[g];
+                  const std::vector<R_len_t>& idx = *gidx[g];
+                  for (size_t k=0; k<idx.size(); ++k) {
+                     R_len_t i = idx[k];
+                     if (word_ascii_fast && str_cont.get(i).isASCII()) {
+                        ret_tab[i] = stri__count_boundaries_word_ascii(
+                           str_cont.get(i).c_str(), str_cont.get(i).length());
+                        continue;
+                     }
+                     brk->setupMatcher(str_cont.get(i).c_str(),
+                        str_cont.get(i).length());
+                     brk->first();
+                     R_len_t cur_count = 0;
+                     while (brk->next())
+                        ++cur_count;
+                     ret_tab[i] = cur_count;
+                  }
+               }
+            }
+            catch (StriException& e) { errmsg[t] = e.getMessage();     }
+            catch (...)              { errmsg[t] = MSG__INTERNAL_ERROR; }
+         }));
+      }
+      for (size_t t=0; t<workers.size(); ++t) workers[t].join();
+      for (int t=0; t<num_threads; ++t)
+         if (!errmsg[t].empty())
+            throw StriException("%s", errmsg[t].c_str());
+   }
+   else
+#endif
+   for (R_len_t g=0; g<ngroups; ++g) {
+      StriRuleBasedBreakIterator* brk = &gbrk[g];
+      const std::vector<R_len_t>& idx = *gidx[g];
+      for (size_t k=0; k<idx.size(); ++k) {
+         R_len_t i = idx[k];
+         if (word_ascii_fast && str_cont.get(i).isASCII()) {
+            ret_tab[i] = stri__count_boundaries_word_ascii(
+               str_cont.get(i).c_str(), str_cont.get(i).length());
+            continue;
+         }
+         brk->setupMatcher(str_cont.get(i).c_str(), str_cont.get(i).length());
+         brk->first();
+         R_len_t cur_count = 0;
+         while (brk->next())
+            ++cur_count;
+         ret_tab[i] = cur_count;
+      }
+   }
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({ /* no action */  })
+}
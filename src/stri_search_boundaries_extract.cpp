@@ -34,6 +34,8 @@
 #include "stri_container_utf8_indexable.h"
 #include "stri_container_integer.h"
 #include "stri_brkiter.h"
+#include "stri_extents.h"
+#include "stri_index.h"
 
 
 /**
@@ -125,6 +127,10 @@ SEXP stri_extract_last_boundaries(SEXP str, SEXP opts_brkiter)
  * @return list or matrix
  *
  * @version 0.5-1 (Marek Gagolewski, 2014-12-19)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    collect extents in a C++ arena, materialize the R structure in one pass;
+ *    honor a persistent grapheme index attached via stri_boundaries_index()
  */
 SEXP stri_extract_all_boundaries(SEXP str, SEXP simplify, SEXP omit_no_match, SEXP opts_brkiter)
 {
@@ -138,43 +144,40 @@ SEXP stri_extract_all_boundaries(SEXP str, SEXP simplify, SEXP omit_no_match, SE
    StriContainerUTF8_indexable str_cont(str, str_length);
    StriRuleBasedBreakIterator brkiter(opts_brkiter2);
 
-   SEXP ret;
-   STRI__PROTECT(ret = Rf_allocVector(VECSXP, str_length));
+   // a stale or foreign index is rejected by stri__gcindex_from_attrib,
+   // never trusted
+   const StriGcIndex* gcindex = (opts_brkiter2.isDefaultCharacter())?
+      stri__gcindex_from_attrib(str):NULL;
 
+   // phase 1: pure scanning - no R allocation may interleave here
+   StriExtractExtents extents(str_length);
    for (R_len_t i = 0; i < str_length; ++i)
    {
       if (str_cont.isNA(i)) {
-         SET_VECTOR_ELT(ret, i, stri__vector_NA_strings(1));
+         extents.markNA(i);
+         continue;
+      }
+
+      if (stri__gcindex_available(gcindex, i)) {
+         // pre-computed cluster starts - skip the break iterator
+         const R_len_t* starts = gcindex->starts[i];
+         for (R_len_t j = 0; j+1 < gcindex->nstarts[i]; ++j)
+            extents.push(i, starts[j], starts[j+1]);
          continue;
       }
 
       brkiter.setupMatcher(str_cont.get(i).c_str(), str_cont.get(i).length());
       brkiter.first();
 
-      deque< pair<R_len_t,R_len_t> > occurrences;
       pair<R_len_t,R_len_t> curpair;
       while (brkiter.next(curpair))
-         occurrences.push_back(curpair);
-
-      R_len_t noccurrences = (R_len_t)occurrences.size();
-      if (noccurrences <= 0) {
-         SET_VECTOR_ELT(ret, i, stri__vector_NA_strings(omit_no_match1?0:1));
-         continue;
-      }
-
-      const char* str_cur_s = str_cont.get(i).c_str();
-      SEXP cur_res;
-      STRI__PROTECT(cur_res = Rf_allocVector(STRSXP, noccurrences));
-      deque< pair<R_len_t, R_len_t> >::iterator iter = occurrences.begin();
-      for (R_len_t j = 0; iter != occurrences.end(); ++iter, ++j) {
-         pair<R_len_t, R_len_t> curo = *iter;
-         SET_STRING_ELT(cur_res, j,
-                        Rf_mkCharLenCE(str_cur_s+curo.first, curo.second-curo.first, CE_UTF8));
-      }
-      SET_VECTOR_ELT(ret, i, cur_res);
-      STRI__UNPROTECT(1);
+         extents.push(i, curpair.first, curpair.second);
    }
 
+   // phase 2: one batched pass of R allocations
+   SEXP ret;
+   STRI__PROTECT(ret = extents.toR(str_cont, omit_no_match1));
+
    if (LOGICAL(simplify)[0] == NA_LOGICAL || LOGICAL(simplify)[0]) {
       SEXP robj_TRUE, robj_zero, robj_na_strings, robj_empty_strings;
       STRI__PROTECT(robj_TRUE = Rf_ScalarLogical(TRUE));
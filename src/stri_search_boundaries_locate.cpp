@@ -34,6 +34,7 @@
 #include "stri_container_utf8_indexable.h"
 #include "stri_container_integer.h"
 #include "stri_brkiter.h"
+#include "stri_index.h"
 
 
 /**
@@ -151,6 +152,9 @@ SEXP stri_locate_last_boundaries(SEXP str, SEXP opts_brkiter)
  *
  * @version 0.4-1 (Marek Gagolewski, 2014-12-02)
  *          use StriRuleBasedBreakIterator
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    honor a persistent grapheme index attached via stri_boundaries_index()
  */
 SEXP stri_locate_all_boundaries(SEXP str, SEXP omit_no_match, SEXP opts_brkiter)
 {
@@ -163,6 +167,11 @@ SEXP stri_locate_all_boundaries(SEXP str, SEXP omit_no_match, SEXP opts_brkiter)
    StriContainerUTF8_indexable str_cont(str, str_length);
    StriRuleBasedBreakIterator brkiter(opts_brkiter2);
 
+   // a stale or foreign index is rejected by stri__gcindex_from_attrib,
+   // never trusted
+   const StriGcIndex* gcindex = (opts_brkiter2.isDefaultCharacter())?
+      stri__gcindex_from_attrib(str):NULL;
+
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(VECSXP, str_length));
 
@@ -173,6 +182,31 @@ SEXP stri_locate_all_boundaries(SEXP str, SEXP omit_no_match, SEXP opts_brkiter)
          continue;
       }
 
+      if (stri__gcindex_available(gcindex, i)) {
+         // pre-computed cluster starts - skip the break iterator
+         R_len_t noccurrences = gcindex->nstarts[i]-1;
+         if (noccurrences <= 0) {
+            SET_VECTOR_ELT(ret, i, stri__matrix_NA_INTEGER(omit_no_match1?0:1, 2));
+            continue;
+         }
+         SEXP ans;
+         STRI__PROTECT(ans = Rf_allocMatrix(INTSXP, noccurrences, 2));
+         int* ans_tab = INTEGER(ans);
+         const R_len_t* starts = gcindex->starts[i];
+         for (R_len_t j = 0; j < noccurrences; ++j) {
+            ans_tab[j]              = starts[j];
+            ans_tab[j+noccurrences] = starts[j+1];
+         }
+         str_cont.UTF8_to_UChar32_index(i, ans_tab,
+               ans_tab+noccurrences, noccurrences,
+               1, // 0-based index -> 1-based
+               0  // end returns position of next character after match
+         );
+         SET_VECTOR_ELT(ret, i, ans);
+         STRI__UNPROTECT(1);
+         continue;
+      }
+
       brkiter.setupMatcher(str_cont.get(i).c_str(), str_cont.get(i).length());
       brkiter.first();
 
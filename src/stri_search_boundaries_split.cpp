@@ -34,6 +34,9 @@
 #include "stri_container_utf8_indexable.h"
 #include "stri_container_integer.h"
 #include "stri_brkiter.h"
+#include "stri_threads.h"
+#include <string>
+#include <vector>
 
 
 /** Split a string at BreakIterator boundaries
@@ -65,6 +68,9 @@
  *
  * @version 0.4-1 (Marek Gagolewski, 2014-12-04)
  *    allow `simplify=NA`; FR #126: pass n to stri_list2matrix
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    boundary analysis may run in parallel, see options(stringi.num_threads=)
  */
 SEXP stri_split_boundaries(SEXP str, SEXP n, SEXP tokens_only, SEXP simplify, SEXP opts_brkiter)
 {
@@ -84,6 +90,97 @@ SEXP stri_split_boundaries(SEXP str, SEXP n, SEXP tokens_only, SEXP simplify, SE
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(VECSXP, vectorize_length));
 
+#ifdef STRI_HAVE_THREADS
+   int num_threads = stri__threads_requested(vectorize_length);
+   if (num_threads > 1) {
+      // the `n` sanity check must happen before workers start
+      for (R_len_t i = 0; i < vectorize_length; ++i)
+         if (!n_cont.isNA(i) && !str_cont.isNA(i) && n_cont.get(i) >= INT_MAX-1)
+            throw StriException(MSG__EXPECTED_SMALLER, "n");
+
+      // each worker gets its own break iterator; they are all opened here,
+      // on the main thread - the master cache is not thread-safe
+      std::vector<StriRuleBasedBreakIterator> wbrkiter(num_threads);
+      for (int t=0; t<num_threads; ++t) {
+         wbrkiter[t] = opts_brkiter2;
+         wbrkiter[t].setupMatcher("", 0); // forces open()
+      }
+
+      // phase 1 [parallel]: locate the boundaries;
+      // no R API, no exceptions may leave a worker
+      std::vector< deque< pair<R_len_t,R_len_t> > > occ(vectorize_length);
+      std::vector<std::string> errmsg(num_threads);
+      std::vector<std::thread> workers;
+      for (int t=0; t<num_threads; ++t) {
+         R_len_t chunk_from = (R_len_t)((double)vectorize_length*t/num_threads);
+         R_len_t chunk_to   = (R_len_t)((double)vectorize_length*(t+1)/num_threads);
+         StriRuleBasedBreakIterator* brk = &wbrkiter[t];
+         workers.push_back(std::thread([t, chunk_from, chunk_to, brk,
+               &str_cont, &n_cont, &occ, &errmsg]() {
+            try {
+               for (R_len_t i=chunk_from; i<chunk_to; ++i) {
+                  if (n_cont.isNA(i) || str_cont.isNA(i)) continue;
+                  int n_cur = n_cont.get(i);
+                  if (n_cur < 0)       n_cur = INT_MAX;
+                  else if (n_cur == 0) continue;
+
+                  brk->setupMatcher(str_cont.get(i).c_str(),
+                     str_cont.get(i).length());
+                  brk->first();
+
+                  pair<R_len_t,R_len_t> curpair;
+                  R_len_t k = 0;
+                  while (k < n_cur && brk->next(curpair)) {
+                     occ[i].push_back(curpair);
+                     ++k; // another field
+                  }
+               }
+            }
+            catch (StriException& e) { errmsg[t] = e.getMessage();     }
+            catch (...)              { errmsg[t] = MSG__INTERNAL_ERROR; }
+         }));
+      }
+      for (size_t t=0; t<workers.size(); ++t) workers[t].join();
+      for (int t=0; t<num_threads; ++t)
+         if (!errmsg[t].empty())
+            throw StriException("%s", errmsg[t].c_str());
+
+      // phase 2 [serial]: build the R objects
+      for (R_len_t i = 0; i < vectorize_length; ++i)
+      {
+         if (n_cont.isNA(i) || str_cont.isNA(i)) {
+            SET_VECTOR_ELT(ret, i, stri__vector_NA_strings(1));
+            continue;
+         }
+         int n_cur = n_cont.get(i);
+         if (n_cur < 0)       n_cur = INT_MAX;
+         else if (n_cur == 0) {
+            SET_VECTOR_ELT(ret, i, Rf_allocVector(STRSXP, 0));
+            continue;
+         }
+
+         R_len_t noccurrences = (R_len_t)occ[i].size();
+         if (noccurrences <= 0) {
+            SET_VECTOR_ELT(ret, i, stri__vector_empty_strings(0));
+            continue;
+         }
+         if (noccurrences == n_cur && !tokens_only1)
+            occ[i].back().second = str_cont.get(i).length();
+
+         const char* str_cur_s = str_cont.get(i).c_str();
+         SEXP ans;
+         STRI__PROTECT(ans = Rf_allocVector(STRSXP, noccurrences));
+         deque< pair<R_len_t,R_len_t> >::iterator iter = occ[i].begin();
+         for (R_len_t j = 0; iter != occ[i].end(); ++iter, ++j) {
+            SET_STRING_ELT(ans, j, Rf_mkCharLenCE(str_cur_s+(*iter).first,
+               (*iter).second-(*iter).first, CE_UTF8));
+         }
+         SET_VECTOR_ELT(ret, i, ans);
+         STRI__UNPROTECT(1);
+      }
+   }
+   else
+#endif
    for (R_len_t i = 0; i < vectorize_length; ++i)
    {
       if (n_cont.isNA(i)) {
@@ -58,6 +58,11 @@
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    span over the frozen pattern set instead of per-character lookups;
+ *    ill-formed UTF-8 is treated as U+FFFD (the ICU span convention)
+ *    instead of raising an error
  */
 SEXP stri_count_charclass(SEXP str, SEXP pattern)
 {
@@ -87,14 +92,20 @@ SEXP stri_count_charclass(SEXP str, SEXP pattern)
       R_len_t     str_cur_n = str_cont.get(i).length();
       const char* str_cur_s = str_cont.get(i).c_str();
 
-      UChar32 chr   = 0;
+      // leap over unmatched stretches with spans over the frozen set;
+      // only the matched runs are walked, and merely to count their
+      // code points (no per-character set lookups)
       R_len_t count = 0;
       for (R_len_t j=0; j<str_cur_n; ) {
-         U8_NEXT(str_cur_s, j, str_cur_n, chr);
-         if (chr < 0) // invalid utf-8 sequence
-            throw StriException(MSG__INVALID_UTF8);
-         if (pattern_cur->contains(chr))
+         j += pattern_cur->spanUTF8(str_cur_s+j, str_cur_n-j,
+            USET_SPAN_NOT_CONTAINED);
+         if (j >= str_cur_n) break;
+         R_len_t j2 = j + pattern_cur->spanUTF8(str_cur_s+j, str_cur_n-j,
+            USET_SPAN_CONTAINED);
+         while (j < j2) {
+            U8_FWD_1(str_cur_s, j, j2);
             ++count;
+         }
       }
       ret_tab[i] = count;
    }
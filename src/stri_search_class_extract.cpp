@@ -84,7 +84,7 @@ SEXP stri__extract_firstlast_charclass(SEXP str, SEXP pattern, bool first)
       if (str_cont.isNA(i) || pattern_cont.isNA(i))
          continue;
 
-      const UnicodeSet* pattern_cur = &pattern_cont.get(i);
+      const StriCharClass* pattern_cur = &pattern_cont.getView(i);
       R_len_t     str_cur_n = str_cont.get(i).length();
       const char* str_cur_s = str_cont.get(i).c_str();
       R_len_t j, jlast;
@@ -223,7 +223,7 @@ SEXP stri_extract_all_charclass(SEXP str, SEXP pattern, SEXP merge, SEXP simplif
       const char* str_cur_s = str_cont.get(i).c_str();
       deque< pair<R_len_t, R_len_t> > occurrences;
       StriContainerCharClass::locateAll(
-         occurrences, &pattern_cont.get(i),
+         occurrences, &pattern_cont.getView(i),
          str_cur_s, str_cur_n, merge_cur,
          false /* byte-based indexes */
       );
@@ -34,6 +34,7 @@
 #include "stri_container_utf8.h"
 #include "stri_container_charclass.h"
 #include "stri_container_logical.h"
+#include "stri_utf8dfa.h"
 #include <deque>
 #include <utility>
 using namespace std;
@@ -62,6 +63,10 @@ using namespace std;
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    ASCII runs are swept without decoding (see stri__ascii_run_end);
+ *    multi-byte sequences go through the table-driven decoder
  */
 SEXP stri__locate_firstlast_charclass(SEXP str, SEXP pattern, bool first)
 {
@@ -89,17 +94,26 @@ SEXP stri__locate_firstlast_charclass(SEXP str, SEXP pattern, bool first)
       if (str_cont.isNA(i) || pattern_cont.isNA(i))
          continue;
 
-      const UnicodeSet* pattern_cur = &pattern_cont.get(i);
+      const StriCharClass* pattern_cur = &pattern_cont.getView(i);
       R_len_t     str_cur_n = str_cont.get(i).length();
       const char* str_cur_s = str_cont.get(i).c_str();
       R_len_t j;
       R_len_t k = 0;
+      R_len_t run = 0; // end of the current ASCII run, see stri__ascii_run_end
       UChar32 chr;
 
       for (j=0; j<str_cur_n; ) {
-         U8_NEXT(str_cur_s, j, str_cur_n, chr);
-         if (chr < 0) // invalid utf-8 sequence
-            throw StriException(MSG__INVALID_UTF8);
+         if (j < run) // within an ASCII run: the byte is the code point
+            chr = (UChar32)(uint8_t)str_cur_s[j++];
+         else if ((uint8_t)str_cur_s[j] < 0x80) {
+            run = stri__ascii_run_end(str_cur_s, j, str_cur_n);
+            chr = (UChar32)(uint8_t)str_cur_s[j++];
+         }
+         else {
+            chr = stri__utf8dfa_next(str_cur_s, j, str_cur_n);
+            if (chr < 0) // invalid utf-8 sequence
+               throw StriException(MSG__INVALID_UTF8);
+         }
          k++; // 1-based index
          if (pattern_cur->contains(chr)) {
             ret_tab[i]      = k;
@@ -208,7 +222,7 @@ SEXP stri_locate_all_charclass(SEXP str, SEXP pattern, SEXP merge, SEXP omit_no_
 
       deque< pair<R_len_t, R_len_t> > occurrences;
       StriContainerCharClass::locateAll(
-         occurrences, &pattern_cont.get(i),
+         occurrences, &pattern_cont.getView(i),
          str_cont.get(i).c_str(), str_cont.get(i).length(), merge_cur,
          true /* code point-based indexes */
       );
@@ -35,6 +35,7 @@
 #include "stri_container_charclass.h"
 #include "stri_container_logical.h"
 #include "stri_string8buf.h"
+#include "stri_bufpool.h"
 #include <deque>
 #include <utility>
 using namespace std;
@@ -92,7 +93,7 @@ SEXP stri__replace_all_charclass_yes_vectorize_all(SEXP str, SEXP pattern, SEXP
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
 
-   String8buf buf(0); // @TODO: calculate buf len a priori?
+   StriScratchBuf buf(0); // pooled scratch, grow-only
 
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
@@ -107,7 +108,7 @@ SEXP stri__replace_all_charclass_yes_vectorize_all(SEXP str, SEXP pattern, SEXP
       const char* str_cur_s = str_cont.get(i).c_str();
       deque< pair<R_len_t, R_len_t> > occurrences;
       R_len_t sumbytes = StriContainerCharClass::locateAll(
-         occurrences, &pattern_cont.get(i),
+         occurrences, &pattern_cont.getView(i),
          str_cur_s, str_cur_n, merge_cur,
          false /* byte-based indices */
       );
@@ -135,7 +136,7 @@ SEXP stri__replace_all_charclass_yes_vectorize_all(SEXP str, SEXP pattern, SEXP
          throw StriException("!NDEBUG: stri__replace_allfirstlast_fixed: (buf_need != buf_used)");
 #endif
 
-      SET_STRING_ELT(ret, i, Rf_mkCharLenCE(buf.data(), buf_used, CE_UTF8));
+      SET_STRING_ELT(ret, i, str_cont.toR(i, buf.data(), buf_used));
    }
 
    STRI__UNPROTECT_ALL
@@ -198,7 +199,7 @@ SEXP stri__replace_all_charclass_no_vectorize_all(SEXP str, SEXP pattern, SEXP r
    StriContainerUTF8 replacement_cont(replacement, pattern_n);
    StriContainerCharClass pattern_cont(pattern, pattern_n);
 
-   String8buf buf(0); // @TODO: calculate buf len a priori?
+   StriScratchBuf buf(0); // pooled scratch, grow-only
 
    for (R_len_t i = 0; i<pattern_n; ++i)
    {
@@ -214,7 +215,7 @@ SEXP stri__replace_all_charclass_no_vectorize_all(SEXP str, SEXP pattern, SEXP r
          const char* str_cur_s = str_cont.get(j).c_str();
          deque< pair<R_len_t, R_len_t> > occurrences;
          R_len_t sumbytes = StriContainerCharClass::locateAll(
-            occurrences, &pattern_cont.get(i),
+            occurrences, &pattern_cont.getView(i),
             str_cur_s, str_cur_n, merge_cur,
             false /* byte-based indices */
          );
@@ -309,7 +310,7 @@ SEXP stri__replace_firstlast_charclass(SEXP str, SEXP pattern, SEXP replacement,
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
 
-   String8buf buf(0); // @TODO: consider calculating buflen a priori
+   StriScratchBuf buf(0); // pooled scratch, grow-only
 
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
@@ -320,7 +321,7 @@ SEXP stri__replace_firstlast_charclass(SEXP str, SEXP pattern, SEXP replacement,
          continue;
       }
 
-      const UnicodeSet* pattern_cur = &pattern_cont.get(i);
+      const StriCharClass* pattern_cur = &pattern_cont.getView(i);
       R_len_t str_cur_n     = str_cont.get(i).length();
       const char* str_cur_s = str_cont.get(i).c_str();
       R_len_t j, jlast;
@@ -368,7 +369,7 @@ SEXP stri__replace_firstlast_charclass(SEXP str, SEXP pattern, SEXP replacement,
       memcpy(buf.data(), str_cur_s, (size_t)jlast);
       memcpy(buf.data()+jlast, replacement_cur_s, (size_t)replacement_cur_n);
       memcpy(buf.data()+jlast+replacement_cur_n, str_cur_s+j, (size_t)str_cur_n-j);
-      SET_STRING_ELT(ret, i, Rf_mkCharLenCE(buf.data(), buf_need, CE_UTF8));
+      SET_STRING_ELT(ret, i, str_cont.toR(i, buf.data(), buf_need));
    }
 
    STRI__UNPROTECT_ALL
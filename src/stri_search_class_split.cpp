@@ -81,6 +81,11 @@ using namespace std;
  *
  * @version 0.4-1 (Marek Gagolewski, 2014-12-04)
  *    allow `simplify=NA`; FR #126: pass n to stri_list2matrix
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    leap between separators with spans over the frozen pattern set;
+ *    ill-formed UTF-8 inside a field no longer raises an error (it is
+ *    never a separator, as per the ICU span convention for U+FFFD)
  */
 SEXP stri_split_charclass(SEXP str, SEXP pattern, SEXP n,
                           SEXP omit_empty, SEXP tokens_only, SEXP simplify)
@@ -135,19 +140,20 @@ SEXP stri_split_charclass(SEXP str, SEXP pattern, SEXP n,
       fields.push_back(pair<R_len_t, R_len_t>(0,0));
 
       for (j=0, k=1; j<str_cur_n && k < n_cur; ) {
+         // leap to the next separator with a span over the frozen set
+         j += pattern_cur->spanUTF8(str_cur_s+j, str_cur_n-j,
+            USET_SPAN_NOT_CONTAINED);
+         fields.back().second = j;
+         if (j >= str_cur_n) break;
+
          U8_NEXT(str_cur_s, j, str_cur_n, chr);
-         if (chr < 0) // invalid utf-8 sequence
+         if (chr < 0) // invalid utf-8 sequence (\ufffd is in the set)
             throw StriException(MSG__INVALID_UTF8);
-         if (pattern_cur->contains(chr)) {
-            if (omit_empty_cur && fields.back().second == fields.back().first)
-               fields.back().first = fields.back().second = j; // don't start any new field
-            else {
-               fields.push_back(pair<R_len_t, R_len_t>(j, j)); // start a new field here
-               ++k; // another field
-            }
-         }
+         if (omit_empty_cur && fields.back().second == fields.back().first)
+            fields.back().first = fields.back().second = j; // don't start any new field
          else {
-            fields.back().second = j;
+            fields.push_back(pair<R_len_t, R_len_t>(j, j)); // start a new field here
+            ++k; // another field
          }
       }
       if (k == n_cur)
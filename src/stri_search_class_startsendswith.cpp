@@ -86,7 +86,7 @@ SEXP stri_startswith_charclass(SEXP str, SEXP pattern, SEXP from)
 
       const char* str_cur_s = str_cont.get(i).c_str();
       R_len_t     str_cur_n = str_cont.get(i).length();
-      const UnicodeSet* pattern_cur = &pattern_cont.get(i);
+      const StriCharClass* pattern_cur = &pattern_cont.getView(i);
 
       if (from_cur > str_cur_n)
          ret_tab[i] = FALSE;
@@ -146,7 +146,7 @@ SEXP stri_endswith_charclass(SEXP str, SEXP pattern, SEXP to)
 
       const char* str_cur_s = str_cont.get(i).c_str();
       R_len_t     str_cur_n = str_cont.get(i).length();
-      const UnicodeSet* pattern_cur = &pattern_cont.get(i);
+      const StriCharClass* pattern_cur = &pattern_cont.getView(i);
 
       R_len_t to_cur = to_cont.get(i);
       if (to_cur == -1)
@@ -60,6 +60,15 @@
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    use UnicodeSet::spanUTF8/spanBackUTF8 over the frozen pattern set;
+ *    note that ill-formed UTF-8 is now treated as U+FFFD (the ICU span
+ *    convention) instead of raising an error
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    bytewise margin scan via a per-pattern ASCII table; strings that
+ *    need no trimming share the input CHARSXP
 */
 SEXP stri__trim_leftright(SEXP str, SEXP pattern, bool left, bool right)
 {
@@ -75,6 +84,12 @@ SEXP stri__trim_leftright(SEXP str, SEXP pattern, bool left, bool right)
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
 
+   // ASCII membership table for the current pattern element; margins are
+   // almost always plain spaces/tabs, so a bytewise scan handles them
+   // without entering the span machinery at all
+   const UnicodeSet* tab_set = NULL;
+   bool ascii_keep[128];
+
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
@@ -90,35 +105,39 @@ SEXP stri__trim_leftright(SEXP str, SEXP pattern, bool left, bool right)
       R_len_t jlast1 = 0;
       R_len_t jlast2 = str_cur_n;
 
+      if (pattern_cur != tab_set) { // at most once per distinct pattern
+         for (int c=0; c<128; ++c)
+            ascii_keep[c] = (bool)pattern_cur->contains((UChar32)c);
+         tab_set = pattern_cur;
+      }
+
+      // the pattern sets are frozen, so the spans run on optimized tables
       if (left) {
-         UChar32 chr;
-         for (R_len_t j=0; j<str_cur_n; ) {
-            U8_NEXT(str_cur_s, j, str_cur_n, chr); // "look ahead"
-            if (chr < 0) // invalid utf-8 sequence
-               throw StriException(MSG__INVALID_UTF8);
-            if (pattern_cur->contains(chr)) {
-               break; // break at first occurrence
-            }
-            jlast1 = j;
-         }
+         R_len_t j = 0;
+         while (j < str_cur_n && (uint8_t)str_cur_s[j] < 0x80
+               && !ascii_keep[(uint8_t)str_cur_s[j]])
+            ++j;
+         if (j < str_cur_n && (uint8_t)str_cur_s[j] >= 0x80)
+            j += pattern_cur->spanUTF8(str_cur_s+j, str_cur_n-j,
+               USET_SPAN_NOT_CONTAINED);
+         jlast1 = j;
       }
 
       if (right && jlast1 < str_cur_n) {
-         UChar32 chr;
-         for (R_len_t j=str_cur_n; j>0; ) {
-            U8_PREV(str_cur_s, 0, j, chr); // "look behind"
-            if (chr < 0) // invalid utf-8 sequence
-               throw StriException(MSG__INVALID_UTF8);
-            if (pattern_cur->contains(chr)) {
-               break; // break at first occurrence
-            }
-            jlast2 = j;
-         }
+         R_len_t j = str_cur_n;
+         while (j > jlast1 && (uint8_t)str_cur_s[j-1] < 0x80
+               && !ascii_keep[(uint8_t)str_cur_s[j-1]])
+            --j;
+         if (j > jlast1 && (uint8_t)str_cur_s[j-1] >= 0x80)
+            j = pattern_cur->spanBackUTF8(str_cur_s, j,
+               USET_SPAN_NOT_CONTAINED);
+         jlast2 = j;
       }
 
-      // now jlast is the index, from which we start copying
+      // now jlast is the index, from which we start copying;
+      // with nothing trimmed, the input CHARSXP is shared (see toR)
       SET_STRING_ELT(ret, i,
-         Rf_mkCharLenCE(str_cur_s+jlast1, (jlast2-jlast1), CE_UTF8));
+         str_cont.toR(i, str_cur_s+jlast1, jlast2-jlast1));
    }
 
    STRI__UNPROTECT_ALL
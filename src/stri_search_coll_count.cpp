@@ -58,9 +58,14 @@
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    `max_count` arg added - threshold queries stop enumerating
+ *    an element's matches once the cap is reached
  */
-SEXP stri_count_coll(SEXP str, SEXP pattern, SEXP opts_collator)
+SEXP stri_count_coll(SEXP str, SEXP pattern, SEXP max_count, SEXP opts_collator)
 {
+   int max_count1 = stri__prepare_arg_integer_1_notNA(max_count, "max_count");
    PROTECT(str = stri_prepare_arg_string(str, "str"));
    PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
 
@@ -90,7 +95,8 @@ SEXP stri_count_coll(SEXP str, SEXP pattern, SEXP opts_collator)
       usearch_reset(matcher);
       UErrorCode status = U_ZERO_ERROR;
       R_len_t found = 0;
-      while (!U_FAILURE(status) && ((int)usearch_next(matcher, &status) != USEARCH_DONE))
+      while (!U_FAILURE(status) && (max_count1 < 0 || found < max_count1)
+            && ((int)usearch_next(matcher, &status) != USEARCH_DONE))
          ++found;
       STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
       ret_tab[i] = found;
@@ -36,6 +36,60 @@
 #include <unicode/uregex.h>
 
 
+/** pick the prescan characters for a collated detect loop [internal]
+ *
+ * At tertiary strength or above, a region matching a pattern whose
+ * first code unit is an ASCII letter or digit must contain that very
+ * code unit (either case, to stay on the safe side of case-related
+ * collator options) - tailorings and normalization only introduce
+ * equivalences below the tertiary level for these characters. A single
+ * pass over the haystack looking for the two candidates is then a sound
+ * reject test, and much cheaper than usearch_first.
+ *
+ * With numeric collation, e.g. U+0662 (ARABIC-INDIC DIGIT TWO) is
+ * primary-equal to "2", so digits do not qualify there; at strength
+ * below tertiary, e.g. fullwidth letters become equal to ASCII ones,
+ * so no prescan is attempted at all.
+ *
+ * @param col the collator the search will run under
+ * @param pattern non-empty search pattern
+ * @param c1, c2 [out] code units, at least one of which every matching
+ *    haystack must contain (possibly c1 == c2)
+ * @return is the prescan applicable?
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static bool stri__detect_coll_prescan_chars(const UCollator* col,
+   const UnicodeString& pattern, UChar& c1, UChar& c2)
+{
+   UErrorCode status = U_ZERO_ERROR;
+   UColAttributeValue strength = ucol_getAttribute(col, UCOL_STRENGTH, &status);
+   if (U_FAILURE(status) || (strength != UCOL_TERTIARY
+         && strength != UCOL_QUATERNARY && strength != UCOL_IDENTICAL))
+      return false;
+
+   if (pattern.length() <= 0) return false;
+   UChar c = pattern.charAt(0);
+   if (c >= 0x0041 && c <= 0x005A) { // A-Z
+      c1 = c; c2 = (UChar)(c+0x20);
+      return true;
+   }
+   if (c >= 0x0061 && c <= 0x007A) { // a-z
+      c1 = c; c2 = (UChar)(c-0x20);
+      return true;
+   }
+   if (c >= 0x0030 && c <= 0x0039) { // 0-9
+      status = U_ZERO_ERROR;
+      if (U_FAILURE(status) ||
+            UCOL_ON == ucol_getAttribute(col, UCOL_NUMERIC_COLLATION, &status))
+         return false;
+      c1 = c2 = c;
+      return true;
+   }
+   return false;
+}
+
+
 /**
  * Detect if a pattern occurs in a string [with collation]
  *
@@ -66,6 +120,10 @@
  *
  * @version 1.3.1 (Marek Gagolewski, 2019-02-08)
  *    #232: `max_count` arg added
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    non-matching elements may be rejected by a cheap single-pass
+ *    prescan, see stri__detect_coll_prescan_chars()
  */
 SEXP stri_detect_coll(SEXP str, SEXP pattern, SEXP negate,
     SEXP max_count, SEXP opts_collator)
@@ -89,6 +147,10 @@ SEXP stri_detect_coll(SEXP str, SEXP pattern, SEXP negate,
    STRI__PROTECT(ret = Rf_allocVector(LGLSXP, vectorize_length));
    int* ret_tab = LOGICAL(ret);
 
+   const UnicodeString* prescan_pattern = NULL;
+   bool prescan_ok = false;
+   UChar prescan_c1 = 0, prescan_c2 = 0;
+
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
@@ -103,6 +165,20 @@ SEXP stri_detect_coll(SEXP str, SEXP pattern, SEXP negate,
          {ret_tab[i] = negate_1;
           if (max_count_1 > 0 && ret_tab[i]) --max_count_1;})
 
+      const UnicodeString* pat_cur = &(pattern_cont.get(i));
+      if (pat_cur != prescan_pattern) {
+         prescan_pattern = pat_cur;
+         prescan_ok = stri__detect_coll_prescan_chars(collator, *pat_cur,
+            prescan_c1, prescan_c2);
+      }
+      if (prescan_ok && str_cont.get(i).indexOf(prescan_c1) < 0
+            && (prescan_c1 == prescan_c2
+                || str_cont.get(i).indexOf(prescan_c2) < 0)) {
+         ret_tab[i] = negate_1;
+         if (max_count_1 > 0 && ret_tab[i]) --max_count_1;
+         continue;
+      }
+
       UStringSearch *matcher = pattern_cont.getMatcher(i, str_cont.get(i));
       usearch_reset(matcher);
       UErrorCode status = U_ZERO_ERROR;
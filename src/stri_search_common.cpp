@@ -36,6 +36,8 @@
 #include <unicode/uregex.h>
 #include "stri_string8buf.h"
 #include <deque>
+#include <vector>
+#include <algorithm>
 using namespace std;
 
 
@@ -133,3 +135,52 @@ SEXP stri__subset_by_logical(const StriContainerUTF16& str_cont,
 {
    stri__subset_by_logical__MACRO
 }
+
+
+/** original position encoded in a subset index:
+ *  i itself for a kept element, -(i+1) for one that shall become NA */
+static inline R_len_t stri__subset_index_pos(int x)
+{
+   return (x >= 0) ? x : (-x-1);
+}
+
+
+static bool stri__subset_index_cmp(int a, int b)
+{
+   return stri__subset_index_pos(a) < stri__subset_index_pos(b);
+}
+
+
+/**
+ * Subset str_cont to SEXP by a list of qualifying indices
+ *
+ * The growth-amortized companion of stri__subset_by_logical: callers
+ * append the (few) qualifying indices as they are found instead of
+ * filling a full-length logical mask and walking it again - on
+ * low-selectivity filters this touches only the matches.
+ *
+ * @param str_cont
+ * @param indices qualifying element indices; -(i+1) denotes that
+ *    position i shall yield NA; reordered in place
+ * @return character vector
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri__subset_by_indices(const StriContainerUTF8& str_cont,
+   std::vector<int>& indices)
+{
+   // the vectorized loops do not visit the elements in input order
+   // when the pattern is recycled - restore it before materializing
+   std::sort(indices.begin(), indices.end(), stri__subset_index_cmp);
+   R_len_t result_counter = (R_len_t)indices.size();
+   SEXP ret;
+   PROTECT(ret = Rf_allocVector(STRSXP, result_counter));
+   for (R_len_t i=0; i<result_counter; ++i) {
+      if (indices[i] < 0)
+         SET_STRING_ELT(ret, i, NA_STRING);
+      else
+         SET_STRING_ELT(ret, i, str_cont.toR(indices[i]));
+   }
+   UNPROTECT(1);
+   return ret;
+}
@@ -34,6 +34,69 @@
 #include "stri_container_base.h"
 #include "stri_container_utf8.h"
 #include "stri_container_bytesearch.h"
+#include "stri_threads.h"
+
+
+#ifdef STRI_HAVE_THREADS
+/** count the pattern's occurrences in one very long string with
+ * several threads
+ *
+ * The haystack is cut into nth slices; each worker scans its slice
+ * plus patternLen-1 bytes of look-ahead and counts the matches that
+ * START inside the slice. This is exact iff the match set does not
+ * depend on the enumeration origin, i.e. with `overlap` enabled or
+ * when occurrences cannot overlap at all (borderless pattern) -
+ * the caller checks that.
+ *
+ * Each worker gets its own matcher; workers never touch the R API.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static R_len_t stri__count_fixed_parallel(const char* s, R_len_t n,
+   const char* p, R_len_t m, uint32_t flags, int nth, bool& failed)
+{
+   std::vector<StriByteSearchMatcher*> matchers(nth, (StriByteSearchMatcher*)NULL);
+   for (int t=0; t<nth; ++t) // on the main thread - this may throw
+      matchers[t] = StriContainerByteSearch::createMatcher(p, m, flags);
+
+   std::vector<R_len_t> counts(nth, 0);
+   std::vector<char> errors(nth, 0);
+   std::vector<std::thread> workers;
+   R_len_t slice = n/nth;
+   for (int t=0; t<nth; ++t) {
+      R_len_t begin = t*slice;
+      R_len_t own_end = (t == nth-1) ? n : (t+1)*slice;
+      R_len_t scan_end = ((own_end > n-m+1) ? n : own_end+m-1);
+      StriByteSearchMatcher* matcher = matchers[t];
+      workers.push_back(std::thread(
+         [s, begin, own_end, scan_end, matcher, t, &counts, &errors]() {
+            try {
+               matcher->reset(s+begin, scan_end-begin);
+               R_len_t limit = own_end-begin; // matches must start before this
+               R_len_t found = 0;
+               R_len_t pos;
+               while (USEARCH_DONE != (pos = matcher->findNext()) && pos < limit)
+                  ++found;
+               counts[t] = found;
+            }
+            catch (...) {
+               errors[t] = 1;
+            }
+         }));
+   }
+
+   R_len_t total = 0;
+   failed = false;
+   for (int t=0; t<nth; ++t) {
+      workers[t].join();
+      total += counts[t];
+      if (errors[t]) failed = true;
+   }
+   for (int t=0; t<nth; ++t)
+      delete matchers[t];
+   return total;
+}
+#endif
 
 
 /**
@@ -67,17 +130,27 @@
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-02-14)
  *    use StriByteSearchMatcher
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    multi-megabyte haystacks may be scanned by several threads
+ *    (opt-in, see options(stringi.num_threads=...))
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    `max_count` arg added - threshold queries stop enumerating
+ *    an element's matches once the cap is reached
  */
-SEXP stri_count_fixed(SEXP str, SEXP pattern, SEXP opts_fixed)
+SEXP stri_count_fixed(SEXP str, SEXP pattern, SEXP max_count, SEXP opts_fixed)
 {
+   int max_count1 = stri__prepare_arg_integer_1_notNA(max_count, "max_count");
    uint32_t pattern_flags = StriContainerByteSearch::getByteSearchFlags(opts_fixed, /*allow_overlap*/true);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   StriByteSearchMatcher* pattern_prepared = NULL;
+   PROTECT(pattern = stri__fixed_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
 
    STRI__ERROR_HANDLER_BEGIN(2)
    R_len_t vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
    StriContainerUTF8 str_cont(str, vectorize_length);
-   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(INTSXP, vectorize_length));
@@ -90,10 +163,32 @@ SEXP stri_count_fixed(SEXP str, SEXP pattern, SEXP opts_fixed)
       STRI__CONTINUE_ON_EMPTY_OR_NA_STR_PATTERN(str_cont, pattern_cont,
       ret_tab[i] = NA_INTEGER, ret_tab[i] = 0)
 
+#ifdef STRI_HAVE_THREADS
+      R_len_t str_cur_n = str_cont.get(i).length();
+      // with a cap in force the serial loop exits after max_count
+      // matches - a full parallel sweep would only waste the savings
+      if (max_count1 < 0 && str_cur_n >= 2*STRI__BYTESEARCH_PARALLEL_MIN_CHUNK) {
+         int nth = stri__threads_requested(
+            str_cur_n/STRI__BYTESEARCH_PARALLEL_MIN_CHUNK);
+         if (nth >= 2 && !pattern_cont.isCaseInsensitive()
+               && (pattern_cont.isOverlap() || !stri__bytesearch_pattern_self_overlaps(
+                     pattern_cont.get(i).c_str(), pattern_cont.get(i).length()))) {
+            bool failed = false;
+            ret_tab[i] = stri__count_fixed_parallel(
+               str_cont.get(i).c_str(), str_cur_n,
+               pattern_cont.get(i).c_str(), pattern_cont.get(i).length(),
+               pattern_cont.getFlags(), nth, failed);
+            if (failed) throw StriException(MSG__STRSEARCH_FAILED);
+            continue;
+         }
+      }
+#endif
+
       StriByteSearchMatcher* matcher = pattern_cont.getMatcher(i);
       matcher->reset(str_cont.get(i).c_str(), str_cont.get(i).length());
       R_len_t found = 0;
-      while (USEARCH_DONE != matcher->findNext())
+      while ((max_count1 < 0 || found < max_count1)
+            && USEARCH_DONE != matcher->findNext())
          ++found;
       ret_tab[i] = found;
    }
@@ -33,6 +33,11 @@
 #include "stri_stringi.h"
 #include "stri_container_utf8.h"
 #include "stri_container_bytesearch.h"
+#include "stri_ahocorasick.h"
+#include "stri_interrupt.h"
+#include "stri_perfstats.h"
+#include "stri_engine_sample.h"
+#include <vector>
 
 
 /**
@@ -72,6 +77,15 @@
  *
  * @version 1.3.1 (Marek Gagolewski, 2019-02-08)
  *    #232: `max_count` arg added
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    many patterns vs few haystacks: one Aho-Corasick pass per haystack
+ *    instead of one KMP scan per pattern
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    the automaton-vs-KMP choice is settled by racing both engines
+ *    over the first few haystacks (see stri_engine_sample.h) instead
+ *    of trusting the pattern count alone
  */
 SEXP stri_detect_fixed(SEXP str, SEXP pattern, SEXP negate,
     SEXP max_count, SEXP opts_fixed)
@@ -80,17 +94,84 @@ SEXP stri_detect_fixed(SEXP str, SEXP pattern, SEXP negate,
    int max_count_1 = stri__prepare_arg_integer_1_notNA(max_count, "max_count");
    uint32_t pattern_flags = StriContainerByteSearch::getByteSearchFlags(opts_fixed);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   StriByteSearchMatcher* pattern_prepared = NULL;
+   PROTECT(pattern = stri__fixed_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
 
    STRI__ERROR_HANDLER_BEGIN(2)
    int vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
    StriContainerUTF8 str_cont(str, vectorize_length);
-   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(LGLSXP, vectorize_length));
    int* ret_tab = LOGICAL(ret);
 
+   STRI__PERFSTATS_SCOPE(engine) // the matching itself, both paths below
+
+   R_len_t str_n = str_cont.get_n();
+   if (!pattern_cont.isCaseInsensitive() && max_count_1 < 0
+         && pattern_cont.get_n() == vectorize_length
+         && str_n < vectorize_length
+         && vectorize_length >= STRI_AHOCORASICK_MIN_PATTERNS) {
+      // many patterns against few (recycled) haystacks: a single
+      // automaton over all the patterns answers each haystack in one
+      // pass - a batch of independent KMP scans is O(patterns x text)
+      StriAhoCorasick automaton;
+      bool any_pattern = false;
+      for (R_len_t i=0; i<vectorize_length; ++i) {
+         if (pattern_cont.isNA(i) || pattern_cont.get(i).length() <= 0)
+            continue; // yields NA below, like the generic loop
+         automaton.addPattern(pattern_cont.get(i).c_str(),
+            pattern_cont.get(i).length(), i);
+         any_pattern = true;
+      }
+      automaton.build();
+
+      std::vector<char> found(vectorize_length);
+      // both engines provably agree on every row, so the choice is a
+      // pure performance question - race them over the first rows and
+      // lock in the cheaper one (the automaton is the static default;
+      // a row of KMP scans wins e.g. when most patterns share prefixes
+      // that make the automaton's failure links expensive to follow)
+      StriEngineSampler row_sampler(2, 0);
+      for (R_len_t r=0; r<str_n; ++r) {
+         bool cur_na    = str_cont.isNA(r);
+         bool cur_empty = !cur_na && str_cont.get(r).length() <= 0;
+         bool engaged   = !cur_na && !cur_empty && any_pattern;
+         int engine = 0;
+         if (engaged) {
+            engine = row_sampler.choose();
+            row_sampler.begin();
+            if (engine == 0) {
+               for (R_len_t i=0; i<vectorize_length; ++i) found[i] = 0;
+               automaton.scan(str_cont.get(r).c_str(),
+                  str_cont.get(r).length(), found);
+            }
+         }
+         for (R_len_t i=r; i<vectorize_length; i+=str_n) {
+            if (cur_na || pattern_cont.isNA(i)
+                  || pattern_cont.get(i).length() <= 0)
+               ret_tab[i] = NA_LOGICAL;
+            else if (cur_empty)
+               ret_tab[i] = negate_1;
+            else if (engine == 0)
+               ret_tab[i] = negate_1?(!found[i]):((int)found[i]);
+            else {
+               StriByteSearchMatcher* matcher = pattern_cont.getMatcher(i);
+               matcher->reset(str_cont.get(r).c_str(),
+                  str_cont.get(r).length());
+               int f = (int)(matcher->findFirst() != USEARCH_DONE);
+               ret_tab[i] = negate_1?(!f):f;
+            }
+         }
+         if (engaged)
+            row_sampler.end(engine, (double)str_cont.get(r).length());
+      }
+
+      STRI__UNPROTECT_ALL
+      return ret;
+   }
+
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
@@ -179,3 +260,222 @@ SEXP stri_detect_fixed(SEXP str, SEXP pattern, SEXP negate,
 //      if (utp) { utext_close(utp); utp=NULL; }
 //   })
 }
+
+
+/**
+ * Detect if any of a set of patterns occurs in each string
+ *
+ * Unlike stri_detect_fixed, `pattern` is not recycled against `str`:
+ * it is the whole set to test for, and one logical per string is
+ * returned. A single Aho-Corasick pass per string answers the question
+ * for the entire set, leaving the scan at the first hit; equivalent to
+ * Reduce(`|`, lapply(pattern, stri_detect_fixed, str=str)) without the
+ * `patterns x text` cost.
+ *
+ * @param str character vector
+ * @param pattern character vector - the set of patterns
+ * @param negate single bool
+ * @param opts_fixed a named list
+ * @return logical vector of length equal to length(str)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_detect_any_fixed(SEXP str, SEXP pattern, SEXP negate,
+    SEXP opts_fixed)
+{
+   bool negate_1 = stri__prepare_arg_logical_1_notNA(negate, "negate");
+   uint32_t pattern_flags = StriContainerByteSearch::getByteSearchFlags(opts_fixed);
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+
+   STRI__ERROR_HANDLER_BEGIN(2)
+   R_len_t str_n = LENGTH(str);
+   R_len_t pattern_n = LENGTH(pattern);
+   StriContainerUTF8 str_cont(str, str_n);
+   StriContainerByteSearch pattern_cont(pattern, pattern_n, pattern_flags);
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(LGLSXP, str_n));
+   int* ret_tab = LOGICAL(ret);
+
+   // an NA (or empty, hence unsupported) pattern makes a no-hit result
+   // unknown rather than FALSE - like any(c(FALSE, NA)); a hit still
+   // wins, like any(c(TRUE, NA))
+   bool has_na_pattern = false;
+   R_len_t npatterns_ok = 0;
+   for (R_len_t j=0; j<pattern_n; ++j) {
+      if (pattern_cont.isNA(j))
+         has_na_pattern = true;
+      else if (pattern_cont.get(j).length() <= 0) {
+         Rf_warning(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+         has_na_pattern = true;
+      }
+      else
+         ++npatterns_ok;
+   }
+
+   std::vector<char> hit((size_t)(str_n>0?str_n:1), (char)0);
+
+   STRI__PERFSTATS_SCOPE(engine)
+
+   StriInterruptCheckpoint checkpoint;
+   if (!pattern_cont.isCaseInsensitive()
+         && npatterns_ok >= STRI_AHOCORASICK_MIN_PATTERNS) {
+      // one automaton pass per string, abandoned at the first hit
+      StriAhoCorasick automaton;
+      for (R_len_t j=0; j<pattern_n; ++j) {
+         if (pattern_cont.isNA(j) || pattern_cont.get(j).length() <= 0)
+            continue;
+         automaton.addPattern(pattern_cont.get(j).c_str(),
+            pattern_cont.get(j).length(), j);
+      }
+      automaton.build();
+
+      for (R_len_t i=0; i<str_n; ++i) {
+         checkpoint.touch();
+         if (str_cont.isNA(i) || str_cont.get(i).length() <= 0)
+            continue;
+         hit[i] = (char)automaton.scanAny(str_cont.get(i).c_str(),
+            str_cont.get(i).length());
+      }
+   }
+   else if (npatterns_ok > 0) {
+      // few patterns (or case-insensitive search, which the automaton
+      // does not support): one matcher per pattern, each scanning only
+      // the strings still undecided
+      R_len_t remaining = 0;
+      for (R_len_t i=0; i<str_n; ++i)
+         if (!str_cont.isNA(i) && str_cont.get(i).length() > 0)
+            ++remaining;
+      for (R_len_t j=0; j<pattern_n && remaining>0; ++j) {
+         if (pattern_cont.isNA(j) || pattern_cont.get(j).length() <= 0)
+            continue;
+         StriByteSearchMatcher* matcher = pattern_cont.getMatcher(j);
+         for (R_len_t i=0; i<str_n; ++i) {
+            if (hit[i] || str_cont.isNA(i) || str_cont.get(i).length() <= 0)
+               continue;
+            checkpoint.touch();
+            matcher->reset(str_cont.get(i).c_str(), str_cont.get(i).length());
+            if (matcher->findFirst() != USEARCH_DONE) {
+               hit[i] = 1;
+               --remaining;
+            }
+         }
+      }
+   }
+
+   for (R_len_t i=0; i<str_n; ++i) {
+      if (str_cont.isNA(i))
+         ret_tab[i] = NA_LOGICAL;
+      else if (hit[i])
+         ret_tab[i] = negate_1?FALSE:TRUE;
+      else if (has_na_pattern)
+         ret_tab[i] = NA_LOGICAL;
+      else
+         ret_tab[i] = negate_1?TRUE:FALSE;
+   }
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END( ;/* do nothing special on error */ )
+}
+
+
+/**
+ * Which of the patterns occur in a single document?
+ *
+ * The transpose of stri_detect_any_fixed: one haystack, the whole
+ * rule set, one logical per pattern. The document is preprocessed
+ * (the automaton walks it) exactly once per call, however many
+ * patterns there are.
+ *
+ * @param str single string
+ * @param pattern character vector
+ * @param negate single logical value
+ * @param opts_fixed list
+ * @return logical vector of length LENGTH(pattern)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_detect_each_fixed(SEXP str, SEXP pattern, SEXP negate,
+    SEXP opts_fixed)
+{
+   bool negate_1 = stri__prepare_arg_logical_1_notNA(negate, "negate");
+   uint32_t pattern_flags = StriContainerByteSearch::getByteSearchFlags(opts_fixed);
+   PROTECT(str = stri_prepare_arg_string_1(str, "str"));
+   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+
+   STRI__ERROR_HANDLER_BEGIN(2)
+   R_len_t pattern_n = LENGTH(pattern);
+   StriContainerUTF8 str_cont(str, 1);
+   StriContainerByteSearch pattern_cont(pattern, pattern_n, pattern_flags);
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(LGLSXP, pattern_n));
+   int* ret_tab = LOGICAL(ret);
+
+   if (str_cont.isNA(0)) {
+      for (R_len_t j=0; j<pattern_n; ++j)
+         ret_tab[j] = NA_LOGICAL;
+      STRI__UNPROTECT_ALL
+      return ret;
+   }
+
+   const char* str_cur_s = str_cont.get(0).c_str();
+   R_len_t str_cur_n = str_cont.get(0).length();
+
+   R_len_t npatterns_ok = 0;
+   bool warned_empty = false;
+   for (R_len_t j=0; j<pattern_n; ++j) {
+      if (pattern_cont.isNA(j))
+         ;
+      else if (pattern_cont.get(j).length() <= 0) {
+         if (!warned_empty) Rf_warning(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+         warned_empty = true;
+      }
+      else
+         ++npatterns_ok;
+   }
+
+   std::vector<char> found((size_t)(pattern_n>0?pattern_n:1), (char)0);
+
+   STRI__PERFSTATS_SCOPE(engine)
+
+   if (!pattern_cont.isCaseInsensitive()
+         && npatterns_ok >= STRI_AHOCORASICK_MIN_PATTERNS) {
+      // one automaton pass over the document answers all the patterns
+      StriAhoCorasick automaton;
+      for (R_len_t j=0; j<pattern_n; ++j) {
+         if (pattern_cont.isNA(j) || pattern_cont.get(j).length() <= 0)
+            continue;
+         automaton.addPattern(pattern_cont.get(j).c_str(),
+            pattern_cont.get(j).length(), j);
+      }
+      automaton.build();
+      automaton.scan(str_cur_s, str_cur_n, found);
+   }
+   else if (npatterns_ok > 0 && str_cur_n > 0) {
+      // few patterns (or case-insensitive search, which the automaton
+      // does not support): one matcher per pattern
+      StriInterruptCheckpoint checkpoint;
+      for (R_len_t j=0; j<pattern_n; ++j) {
+         if (pattern_cont.isNA(j) || pattern_cont.get(j).length() <= 0)
+            continue;
+         checkpoint.touch();
+         StriByteSearchMatcher* matcher = pattern_cont.getMatcher(j);
+         matcher->reset(str_cur_s, str_cur_n);
+         found[j] = (char)(matcher->findFirst() != USEARCH_DONE);
+      }
+   }
+
+   for (R_len_t j=0; j<pattern_n; ++j) {
+      if (pattern_cont.isNA(j) || pattern_cont.get(j).length() <= 0)
+         ret_tab[j] = NA_LOGICAL;
+      else
+         ret_tab[j] = (found[j]?!negate_1:negate_1)?TRUE:FALSE;
+   }
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END( ;/* do nothing special on error */ )
+}
@@ -33,11 +33,70 @@
 #include "stri_stringi.h"
 #include "stri_container_utf8_indexable.h"
 #include "stri_container_bytesearch.h"
-#include <deque>
-#include <utility>
+#include "stri_threads.h"
+#include <vector>
 using namespace std;
 
 
+#ifdef STRI_HAVE_THREADS
+/** gather all the pattern's occurrences in one very long string with
+ * several threads
+ *
+ * Slicing and exactness conditions as in stri__count_fixed_parallel
+ * (stri_search_fixed_count.cpp): each worker scans its slice plus
+ * patternLen-1 bytes of look-ahead and keeps the matches starting
+ * inside the slice; the caller guarantees that the match set does not
+ * depend on where the enumeration starts. Per-worker arenas are
+ * spliced in slice order, so the result comes out sorted.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__locate_all_fixed_parallel(const char* s, R_len_t n,
+   const char* p, R_len_t m, uint32_t flags, int nth,
+   std::vector<int>& arena, bool& failed)
+{
+   std::vector<StriByteSearchMatcher*> matchers(nth, (StriByteSearchMatcher*)NULL);
+   for (int t=0; t<nth; ++t) // on the main thread - this may throw
+      matchers[t] = StriContainerByteSearch::createMatcher(p, m, flags);
+
+   std::vector< std::vector<int> > found(nth);
+   std::vector<char> errors(nth, 0);
+   std::vector<std::thread> workers;
+   R_len_t slice = n/nth;
+   for (int t=0; t<nth; ++t) {
+      R_len_t begin = t*slice;
+      R_len_t own_end = (t == nth-1) ? n : (t+1)*slice;
+      R_len_t scan_end = ((own_end > n-m+1) ? n : own_end+m-1);
+      StriByteSearchMatcher* matcher = matchers[t];
+      workers.push_back(std::thread(
+         [s, begin, own_end, scan_end, matcher, t, &found, &errors]() {
+            try {
+               matcher->reset(s+begin, scan_end-begin);
+               R_len_t limit = own_end-begin; // matches must start before this
+               R_len_t pos;
+               while (USEARCH_DONE != (pos = matcher->findNext()) && pos < limit) {
+                  found[t].push_back((int)(begin+pos));
+                  found[t].push_back((int)(begin+pos+matcher->getMatchedLength()));
+               }
+            }
+            catch (...) {
+               errors[t] = 1;
+            }
+         }));
+   }
+
+   failed = false;
+   for (int t=0; t<nth; ++t) {
+      workers[t].join();
+      if (errors[t]) failed = true;
+      arena.insert(arena.end(), found[t].begin(), found[t].end());
+   }
+   for (int t=0; t<nth; ++t)
+      delete matchers[t];
+}
+#endif
+
+
 /**
  * Locate first or last occurrences of a pattern in a string
  *
@@ -70,12 +129,13 @@ SEXP stri__locate_firstlast_fixed(SEXP str, SEXP pattern, SEXP opts_fixed, bool
 {
    uint32_t pattern_flags = StriContainerByteSearch::getByteSearchFlags(opts_fixed);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   StriByteSearchMatcher* pattern_prepared = NULL;
+   PROTECT(pattern = stri__fixed_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
 
    STRI__ERROR_HANDLER_BEGIN(2)
    int vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
    StriContainerUTF8_indexable str_cont(str, vectorize_length);
-   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocMatrix(INTSXP, vectorize_length, 2));
@@ -201,22 +261,37 @@ SEXP stri_locate_last_fixed(SEXP str, SEXP pattern, SEXP opts_fixed)
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-02-14)
  *    use StriByteSearchMatcher
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    multi-megabyte haystacks may be scanned by several threads
+ *    (opt-in, see options(stringi.num_threads=...));
+ *    matches recorded into a reusable offset arena in a single scan,
+ *    the result matrix is filled straight from it
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    `invert` arg added: the unmatched stretches are emitted straight
+ *    into the arena during the very same scan that finds the matches
  */
-SEXP stri_locate_all_fixed(SEXP str, SEXP pattern, SEXP omit_no_match, SEXP opts_fixed)
+SEXP stri_locate_all_fixed(SEXP str, SEXP pattern, SEXP omit_no_match,
+   SEXP invert, SEXP opts_fixed)
 {
    uint32_t pattern_flags = StriContainerByteSearch::getByteSearchFlags(opts_fixed, /*allow_overlap*/true);
    bool omit_no_match1 = stri__prepare_arg_logical_1_notNA(omit_no_match, "omit_no_match");
+   bool invert1 = stri__prepare_arg_logical_1_notNA(invert, "invert");
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   StriByteSearchMatcher* pattern_prepared = NULL;
+   PROTECT(pattern = stri__fixed_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
 
    STRI__ERROR_HANDLER_BEGIN(2)
    int vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
    StriContainerUTF8_indexable str_cont(str, vectorize_length);
-   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(VECSXP, vectorize_length));
 
+   std::vector<int> arena; // (start, end) byte offsets, reused between elements
+
    for (R_len_t i = pattern_cont.vectorize_init();
       i != pattern_cont.vectorize_end();
       i = pattern_cont.vectorize_next(i))
@@ -225,30 +300,94 @@ SEXP stri_locate_all_fixed(SEXP str, SEXP pattern, SEXP omit_no_match, SEXP opts
          SET_VECTOR_ELT(ret, i, stri__matrix_NA_INTEGER(1, 2));,
          SET_VECTOR_ELT(ret, i, stri__matrix_NA_INTEGER(omit_no_match1?0:1, 2));)
 
+      arena.clear(); // keeps the capacity from the previous element
+
+      if (invert1) {
+         // gap emission is fused into the match scan: each unmatched
+         // stretch goes straight into the arena the moment the next
+         // match (or the end of input) delimits it - one pass, no
+         // intermediate match list to walk again
+         StriByteSearchMatcher* matcher = pattern_cont.getMatcher(i);
+         R_len_t str_cur_n = str_cont.get(i).length();
+         matcher->reset(str_cont.get(i).c_str(), str_cur_n);
+         R_len_t last = 0;
+         int start = matcher->findFirst();
+         while (start != USEARCH_DONE) {
+            R_len_t m_end = (R_len_t)start + matcher->getMatchedLength();
+            if ((R_len_t)start > last) {
+               arena.push_back(last);
+               arena.push_back(start);
+            }
+            if (m_end > last) last = m_end; // overlapping matches fuse
+            start = matcher->findNext();
+         }
+         if (last < str_cur_n) {
+            arena.push_back(last);
+            arena.push_back(str_cur_n);
+         }
+
+         if (arena.empty()) { // the matches cover the whole input
+            SET_VECTOR_ELT(ret, i, stri__matrix_NA_INTEGER(omit_no_match1?0:1, 2));
+            continue;
+         }
+
+         R_len_t ngaps = (R_len_t)arena.size()/2;
+         SEXP ans;
+         STRI__PROTECT(ans = Rf_allocMatrix(INTSXP, ngaps, 2));
+         int* ans_tab = INTEGER(ans);
+         for (R_len_t j = 0; j < ngaps; ++j) {
+            ans_tab[j]       = arena[2*j];
+            ans_tab[j+ngaps] = arena[2*j+1];
+         }
+         str_cont.UTF8_to_UChar32_index(i, ans_tab,
+               ans_tab+ngaps, ngaps,
+               1, // 0-based index -> 1-based
+               0  // end returns position of next character after gap
+         );
+         SET_VECTOR_ELT(ret, i, ans);
+         STRI__UNPROTECT(1);
+         continue;
+      }
+
+#ifdef STRI_HAVE_THREADS
+      R_len_t str_cur_n = str_cont.get(i).length();
+      bool done_parallel = false;
+      if (str_cur_n >= 2*STRI__BYTESEARCH_PARALLEL_MIN_CHUNK) {
+         int nth = stri__threads_requested(
+            str_cur_n/STRI__BYTESEARCH_PARALLEL_MIN_CHUNK);
+         if (nth >= 2 && !pattern_cont.isCaseInsensitive()
+               && (pattern_cont.isOverlap() || !stri__bytesearch_pattern_self_overlaps(
+                     pattern_cont.get(i).c_str(), pattern_cont.get(i).length()))) {
+            bool failed = false;
+            stri__locate_all_fixed_parallel(
+               str_cont.get(i).c_str(), str_cur_n,
+               pattern_cont.get(i).c_str(), pattern_cont.get(i).length(),
+               pattern_cont.getFlags(), nth, arena, failed);
+            if (failed) throw StriException(MSG__STRSEARCH_FAILED);
+            done_parallel = true;
+         }
+      }
+      if (!done_parallel) {
+#endif
       StriByteSearchMatcher* matcher = pattern_cont.getMatcher(i);
       matcher->reset(str_cont.get(i).c_str(), str_cont.get(i).length());
+      matcher->recordAll(arena);
+#ifdef STRI_HAVE_THREADS
+      }
+#endif
 
-      int start = matcher->findFirst();
-      if (start == USEARCH_DONE) { // no matches at all
+      if (arena.empty()) { // no matches at all
          SET_VECTOR_ELT(ret, i, stri__matrix_NA_INTEGER(omit_no_match1?0:1, 2));
          continue;
       }
 
-      deque< pair<R_len_t, R_len_t> > occurrences;
-      while (start != USEARCH_DONE) {
-         occurrences.push_back(pair<R_len_t, R_len_t>(start, start+matcher->getMatchedLength()));
-         start = matcher->findNext();
-      }
-
-      R_len_t noccurrences = (R_len_t)occurrences.size();
+      R_len_t noccurrences = (R_len_t)arena.size()/2;
       SEXP ans;
       STRI__PROTECT(ans = Rf_allocMatrix(INTSXP, noccurrences, 2));
       int* ans_tab = INTEGER(ans);
-      deque< pair<R_len_t, R_len_t> >::iterator iter = occurrences.begin();
-      for (R_len_t j = 0; iter != occurrences.end(); ++iter, ++j) {
-         pair<R_len_t, R_len_t> match = *iter;
-         ans_tab[j]              = match.first;
-         ans_tab[j+noccurrences] = match.second;
+      for (R_len_t j = 0; j < noccurrences; ++j) {
+         ans_tab[j]              = arena[2*j];
+         ans_tab[j+noccurrences] = arena[2*j+1];
       }
 
       // Adjust UChar index -> UChar32 index (1-2 byte UTF16 to 1 byte UTF32-code points)
@@ -34,8 +34,15 @@
 #include "stri_container_utf8.h"
 #include "stri_container_bytesearch.h"
 #include "stri_string8buf.h"
+#include "stri_bufpool.h"
+#include "stri_ahocorasick.h"
+#include "stri_interrupt.h"
 //#include "stri_interval.h"
 #include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <utility>
 //#include <queue>
 //#include <algorithm>
 using namespace std;
@@ -71,29 +78,39 @@ using namespace std;
  *
  * @version 1.0-2 (Marek Gagolewski, 2016-01-30)
  *    Issue #210: Allow NA replacement
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    when each match is exactly as long as the replacement, patch the
+ *    replacement over a single copy of the input
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    STRI_ALLOCTRACE hooks (see stri_alloctrace.h)
  */
 SEXP stri__replace_allfirstlast_fixed(SEXP str, SEXP pattern, SEXP replacement, SEXP opts_fixed, int type)
 {
    uint32_t pattern_flags = StriContainerByteSearch::getByteSearchFlags(opts_fixed);
    PROTECT(str          = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern      = stri_prepare_arg_string(pattern, "pattern"));
+   StriByteSearchMatcher* pattern_prepared = NULL;
+   PROTECT(pattern      = stri__fixed_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    PROTECT(replacement  = stri_prepare_arg_string(replacement, "replacement"));
    R_len_t vectorize_length = stri__recycling_rule(true, 3, LENGTH(str), LENGTH(pattern), LENGTH(replacement));
 
    STRI__ERROR_HANDLER_BEGIN(3)
    StriContainerUTF8 str_cont(str, vectorize_length);
    StriContainerUTF8 replacement_cont(replacement, vectorize_length);
-   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
 
-   String8buf buf(0);
+   StriScratchBuf buf(0); // pooled scratch, grow-only
+   STRI__ALLOCTRACE_SITE("stri__replace_allfirstlast_fixed")
 
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
    {
+      STRI__ALLOCTRACE_ELEM(i)
       STRI__CONTINUE_ON_EMPTY_OR_NA_STR_PATTERN(str_cont, pattern_cont,
          SET_STRING_ELT(ret, i, NA_STRING);,
          SET_STRING_ELT(ret, i, Rf_mkCharLenCE(NULL, 0, CE_UTF8));)
@@ -117,8 +134,11 @@ SEXP stri__replace_allfirstlast_fixed(SEXP str, SEXP pattern, SEXP replacement,
          continue;
       }
 
+      R_len_t replacement_cur_n = replacement_cont.get(i).length();
+
       R_len_t len = matcher->getMatchedLength();
       R_len_t sumbytes = len;
+      bool equal_len = (len == replacement_cur_n); // every match same size as the replacement?
       deque< pair<R_len_t, R_len_t> > occurrences;
       occurrences.push_back(pair<R_len_t, R_len_t>(start, start+len));
 
@@ -126,13 +146,29 @@ SEXP stri__replace_allfirstlast_fixed(SEXP str, SEXP pattern, SEXP replacement,
          while (USEARCH_DONE != matcher->findNext()) { // all
             start = matcher->getMatchedStart();
             len = matcher->getMatchedLength();
+            if (len != replacement_cur_n) equal_len = false;
             occurrences.push_back(pair<R_len_t, R_len_t>(start, start+len));
             sumbytes += len;
          }
       }
 
       R_len_t str_cur_n         = str_cont.get(i).length();
-      R_len_t replacement_cur_n = replacement_cont.get(i).length();
+
+      if (equal_len) {
+         // the output has exactly the shape of the input - one bulk copy
+         // with the replacement patched over each match, no gap shuffling
+         buf.resize(str_cur_n, false/*destroy contents*/);
+         memcpy(buf.data(), str_cont.get(i).c_str(), (size_t)str_cur_n);
+         const char* replacement_cur_s = replacement_cont.get(i).c_str();
+         for (deque< pair<R_len_t, R_len_t> >::iterator it = occurrences.begin();
+               it != occurrences.end(); ++it)
+            memcpy(buf.data()+(*it).first, replacement_cur_s, (size_t)replacement_cur_n);
+         // replacing a pattern with itself is a no-op - share the
+         // input CHARSXP then (see toR)
+         SET_STRING_ELT(ret, i, str_cont.toR(i, buf.data(), str_cur_n));
+         continue;
+      }
+
       R_len_t buf_need =
          str_cur_n+replacement_cur_n*(R_len_t)occurrences.size()-sumbytes;
       buf.resize(buf_need, false/*destroy contents*/);
@@ -146,7 +182,7 @@ SEXP stri__replace_allfirstlast_fixed(SEXP str, SEXP pattern, SEXP replacement,
          throw StriException("!NDEBUG: stri__replace_allfirstlast_fixed: (buf_need != buf_used)");
 #endif
 
-      SET_STRING_ELT(ret, i, Rf_mkCharLenCE(buf.data(), buf_used, CE_UTF8));
+      SET_STRING_ELT(ret, i, str_cont.toR(i, buf.data(), buf_used));
    }
 
    STRI__UNPROTECT_ALL
@@ -249,6 +285,11 @@ SEXP stri__replace_allfirstlast_fixed(SEXP str, SEXP pattern, SEXP replacement,
  */
 SEXP stri__replace_all_fixed_no_vectorize_all(SEXP str, SEXP pattern, SEXP replacement, SEXP opts_fixed)
 { // version gamma:
+   if (stri__is_fixed_pattern(pattern)) {
+      // a single precompiled pattern - the vectorized path handles it
+      return stri__replace_allfirstlast_fixed(str, pattern, replacement, opts_fixed, 0);
+   }
+
    PROTECT(str          = stri_prepare_arg_string(str, "str"));
 
    // if str_n is 0, then return an empty vector
@@ -297,8 +338,10 @@ SEXP stri__replace_all_fixed_no_vectorize_all(SEXP str, SEXP pattern, SEXP repla
       }
 
       StriByteSearchMatcher* matcher = pattern_cont.getMatcher(i);
+      STRI__ALLOCTRACE_SITE("stri__replace_all_fixed_no_vectorize_all")
       for (R_len_t j = 0; j<str_n; ++j) {
          if (str_cont.isNA(j)) continue;
+         STRI__ALLOCTRACE_ELEM(j)
          matcher->reset(str_cont.get(j).c_str(), str_cont.get(j).length());
          R_len_t start = matcher->findFirst();
          if (start == USEARCH_DONE)  continue;  // nothing to do now
@@ -591,3 +634,150 @@ SEXP stri_replace_first_fixed(SEXP str, SEXP pattern, SEXP replacement, SEXP opt
 {
    return stri__replace_allfirstlast_fixed(str, pattern, replacement, opts_fixed, 1);
 }
+
+
+/** a single candidate occurrence in the map-replace scan */
+struct StriMapMatch {
+   int start;  ///< byte offset of the first matched byte
+   int len;    ///< pattern length, in bytes
+   int id;     ///< pattern index
+
+   StriMapMatch(int _start, int _len, int _id)
+      : start(_start), len(_len), id(_id) { }
+};
+
+
+/** leftmost first; ties: longest, then first-listed pattern */
+static bool stri__map_match_cmp(const StriMapMatch& a, const StriMapMatch& b)
+{
+   if (a.start != b.start) return a.start < b.start;
+   if (a.len != b.len) return a.len > b.len;
+   return a.id < b.id;
+}
+
+
+/**
+ * Replace occurrences of many fixed patterns in a single pass
+ *
+ * The whole pattern/replacement dictionary is applied at once: one
+ * Aho-Corasick scan per string finds every key occurrence, the
+ * leftmost-longest nonoverlapping ones are selected (ties between
+ * equally long duplicated keys go to the first-listed one), and the
+ * output is written through once. Unlike with vectorize_all=FALSE,
+ * earlier replacements never disturb later keys and the cost does not
+ * grow with the dictionary size - sequential application is
+ * O(patterns x text) and order-dependent.
+ *
+ * Matching is exact and case sensitive (bytewise over UTF-8, like
+ * stri_detect_any_fixed).
+ *
+ * @param str character vector
+ * @param pattern character vector - the dictionary keys
+ * @param replacement character vector - the corresponding values
+ * @return character vector
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_replace_map_fixed(SEXP str, SEXP pattern, SEXP replacement)
+{
+   PROTECT(str          = stri_prepare_arg_string(str, "str"));
+   PROTECT(pattern      = stri_prepare_arg_string(pattern, "pattern"));
+   PROTECT(replacement  = stri_prepare_arg_string(replacement, "replacement"));
+
+   R_len_t str_n = LENGTH(str);
+   R_len_t pattern_n = LENGTH(pattern);
+   R_len_t replacement_n = LENGTH(replacement);
+   if (pattern_n < replacement_n || pattern_n <= 0 || replacement_n <= 0) {
+      UNPROTECT(3);
+      Rf_error(MSG__WARN_RECYCLING_RULE2);
+   }
+   if (pattern_n % replacement_n != 0)
+      Rf_warning(MSG__WARN_RECYCLING_RULE);
+
+   STRI__ERROR_HANDLER_BEGIN(3)
+   StriContainerUTF8 str_cont(str, str_n);
+   StriContainerUTF8 pattern_cont(pattern, pattern_n);
+   StriContainerUTF8 replacement_cont(replacement, pattern_n);
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(STRSXP, str_n));
+
+   // an NA or empty key poisons the whole dictionary,
+   // like in the sequential (vectorize_all=FALSE) mode
+   for (R_len_t j=0; j<pattern_n; ++j) {
+      if (pattern_cont.isNA(j)) {
+         STRI__UNPROTECT_ALL
+         return stri__vector_NA_strings(str_n);
+      }
+      else if (pattern_cont.get(j).length() <= 0) {
+         Rf_warning(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+         STRI__UNPROTECT_ALL
+         return stri__vector_NA_strings(str_n);
+      }
+   }
+
+   StriAhoCorasick automaton;
+   for (R_len_t j=0; j<pattern_n; ++j)
+      automaton.addPattern(pattern_cont.get(j).c_str(),
+         pattern_cont.get(j).length(), j);
+   automaton.build();
+
+   std::vector< std::pair<int,int> > hits; // (end byte, key id), reused
+   std::vector<StriMapMatch> cand;         // reused between elements
+   std::string out;                        // reused output buffer
+   StriInterruptCheckpoint checkpoint;
+   for (R_len_t i=0; i<str_n; ++i)
+   {
+      checkpoint.touch();
+      if (str_cont.isNA(i)) {
+         SET_STRING_ELT(ret, i, NA_STRING);
+         continue;
+      }
+
+      const char* str_cur_s = str_cont.get(i).c_str();
+      R_len_t str_cur_n = str_cont.get(i).length();
+
+      hits.clear();
+      automaton.scanAll(str_cur_s, str_cur_n, hits);
+      if (hits.empty()) { // no key occurs - pass the input through
+         SET_STRING_ELT(ret, i, str_cont.toR(i));
+         continue;
+      }
+
+      cand.clear();
+      cand.reserve(hits.size());
+      for (size_t h=0; h<hits.size(); ++h) {
+         int len = pattern_cont.get(hits[h].second).length();
+         cand.push_back(StriMapMatch(
+            hits[h].first+1-len, len, hits[h].second));
+      }
+      std::sort(cand.begin(), cand.end(), stri__map_match_cmp);
+
+      out.clear();
+      R_len_t pos = 0;
+      bool na_out = false;
+      for (size_t c=0; c<cand.size(); ++c) {
+         if (cand[c].start < pos)
+            continue; // inside or overlapping an already replaced key
+         if (replacement_cont.isNA(cand[c].id)) {
+            na_out = true; // an NA value poisons the element, like
+            break;         // an NA replacement in the sequential mode
+         }
+         out.append(str_cur_s+pos, cand[c].start-pos);
+         out.append(replacement_cont.get(cand[c].id).c_str(),
+            replacement_cont.get(cand[c].id).length());
+         pos = cand[c].start + cand[c].len;
+      }
+      if (na_out) {
+         SET_STRING_ELT(ret, i, NA_STRING);
+         continue;
+      }
+      out.append(str_cur_s+pos, str_cur_n-pos);
+      SET_STRING_ELT(ret, i,
+         Rf_mkCharLenCE(out.data(), (int)out.size(), CE_UTF8));
+   }
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
+}
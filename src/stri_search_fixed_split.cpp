@@ -86,6 +86,9 @@ using namespace std;
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-02-14)
  *    use StriByteSearchMatcher
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    delimiter-free inputs share the input CHARSXP instead of copying
  */
 SEXP stri_split_fixed(SEXP str, SEXP pattern, SEXP n,
                       SEXP omit_empty, SEXP tokens_only, SEXP simplify, SEXP opts_fixed)
@@ -94,7 +97,8 @@ SEXP stri_split_fixed(SEXP str, SEXP pattern, SEXP n,
    bool tokens_only1 = stri__prepare_arg_logical_1_notNA(tokens_only, "tokens_only");
    PROTECT(simplify = stri_prepare_arg_logical_1(simplify, "simplify"));
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   StriByteSearchMatcher* pattern_prepared = NULL;
+   PROTECT(pattern = stri__fixed_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    PROTECT(n = stri_prepare_arg_integer(n, "n"));
    PROTECT(omit_empty = stri_prepare_arg_logical(omit_empty, "omit_empty"));
 
@@ -102,7 +106,7 @@ SEXP stri_split_fixed(SEXP str, SEXP pattern, SEXP n,
    R_len_t vectorize_length = stri__recycling_rule(true, 4,
       LENGTH(str), LENGTH(pattern), LENGTH(n), LENGTH(omit_empty));
    StriContainerUTF8 str_cont(str, vectorize_length);
-   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
    StriContainerInteger n_cont(n, vectorize_length);
    StriContainerLogical omit_empty_cont(omit_empty, vectorize_length);
 
@@ -146,6 +150,10 @@ SEXP stri_split_fixed(SEXP str, SEXP pattern, SEXP n,
       deque< pair<R_len_t, R_len_t> > fields; // byte based-indices
       fields.push_back(pair<R_len_t, R_len_t>(0,0));
 
+      // k < n_cur is checked first: once n-1 fields are delimited the
+      // remainder becomes the last piece and the haystack is not
+      // scanned any further - splitting a huge record with a small n
+      // costs only as much as those first few matches
       for (k=1; k < n_cur && USEARCH_DONE != matcher->findNext(); ) {
          R_len_t s1 = (R_len_t)matcher->getMatchedStart();
          R_len_t s2 = (R_len_t)matcher->getMatchedLength() + s1;
@@ -171,6 +179,20 @@ SEXP stri_split_fixed(SEXP str, SEXP pattern, SEXP n,
       SEXP ans;
       STRI__PROTECT(ans = Rf_allocVector(STRSXP, fields.size()));
 
+      if (fields.size() == 1 && fields.front().first == 0
+            && fields.front().second == str_cur_n && str_cur_n > 0) {
+         // no delimiter in here - the single token is the whole input;
+         // CHARSXPs are immutable, so the original one may be reused as-is
+         // (as long as its declared encoding matches our UTF-8 output)
+         SEXP str_cur = STRING_ELT(str, i % LENGTH(str));
+         if (IS_ASCII(str_cur) || IS_UTF8(str_cur)) {
+            SET_STRING_ELT(ans, 0, str_cur);
+            SET_VECTOR_ELT(ret, i, ans);
+            STRI__UNPROTECT(1);
+            continue;
+         }
+      }
+
       deque< pair<R_len_t, R_len_t> >::iterator iter = fields.begin();
       for (k = 0; iter != fields.end(); ++iter, ++k) {
          pair<R_len_t, R_len_t> curoccur = *iter;
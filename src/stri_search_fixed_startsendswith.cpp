@@ -34,6 +34,8 @@
 #include "stri_container_utf8_indexable.h"
 #include "stri_container_bytesearch.h"
 #include "stri_container_integer.h"
+#include "stri_ahocorasick.h"
+#include <vector>
 
 
 /**
@@ -55,25 +57,68 @@
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-02-14)
  *    use String8::startsWith() and endsWith()
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    trie-backed batch mode for many patterns vs few strings
  */
 SEXP stri_startswith_fixed(SEXP str, SEXP pattern, SEXP from, SEXP opts_fixed)
 {
    uint32_t pattern_flags = StriContainerByteSearch::getByteSearchFlags(opts_fixed);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   StriByteSearchMatcher* pattern_prepared = NULL;
+   PROTECT(pattern = stri__fixed_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    PROTECT(from = stri_prepare_arg_integer(from, "from"));
 
    STRI__ERROR_HANDLER_BEGIN(3)
    int vectorize_length = stri__recycling_rule(true, 3,
       LENGTH(str), LENGTH(pattern), LENGTH(from));
    StriContainerUTF8_indexable str_cont(str, vectorize_length);
-   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
    StriContainerInteger from_cont(from, vectorize_length);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(LGLSXP, vectorize_length));
    int* ret_tab = LOGICAL(ret);
 
+   R_len_t str_n = str_cont.get_n();
+   if (!pattern_cont.isCaseInsensitive()
+         && pattern_cont.get_n() == vectorize_length
+         && str_n < vectorize_length
+         && vectorize_length >= STRI_AHOCORASICK_MIN_PATTERNS
+         && from_cont.get_n() == 1 && !from_cont.isNA(0)
+         && from_cont.get(0) == 1) {
+      // many prefixes against few (recycled) haystacks, e.g. classifying
+      // URLs against hundreds of known prefixes: a trie over all the
+      // patterns answers each haystack in a single walk from the root
+      StriAhoCorasick trie;
+      for (R_len_t i=0; i<vectorize_length; ++i) {
+         if (pattern_cont.isNA(i) || pattern_cont.get(i).length() <= 0)
+            continue; // yields NA below, like the generic loop
+         trie.addPattern(pattern_cont.get(i).c_str(),
+            pattern_cont.get(i).length(), i);
+      }
+
+      std::vector<char> found(vectorize_length);
+      for (R_len_t r=0; r<str_n; ++r) {
+         bool cur_na = str_cont.isNA(r);
+         if (!cur_na) {
+            for (R_len_t i=0; i<vectorize_length; ++i) found[i] = 0;
+            trie.scanPrefix(str_cont.get(r).c_str(),
+               str_cont.get(r).length(), found);
+         }
+         for (R_len_t i=r; i<vectorize_length; i+=str_n) {
+            if (cur_na || pattern_cont.isNA(i)
+                  || pattern_cont.get(i).length() <= 0)
+               ret_tab[i] = NA_LOGICAL;
+            else
+               ret_tab[i] = (int)found[i];
+         }
+      }
+
+      STRI__UNPROTECT_ALL
+      return ret;
+   }
+
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
@@ -125,25 +170,67 @@ SEXP stri_startswith_fixed(SEXP str, SEXP pattern, SEXP from, SEXP opts_fixed)
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-02-14)
  *    use String8::startsWith() and endsWith()
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    trie-backed batch mode for many patterns vs few strings
  */
 SEXP stri_endswith_fixed(SEXP str, SEXP pattern, SEXP to, SEXP opts_fixed)
 {
    uint32_t pattern_flags = StriContainerByteSearch::getByteSearchFlags(opts_fixed);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   StriByteSearchMatcher* pattern_prepared = NULL;
+   PROTECT(pattern = stri__fixed_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    PROTECT(to = stri_prepare_arg_integer(to, "to"));
 
    STRI__ERROR_HANDLER_BEGIN(3)
    int vectorize_length = stri__recycling_rule(true, 3,
       LENGTH(str), LENGTH(pattern), LENGTH(to));
    StriContainerUTF8_indexable str_cont(str, vectorize_length);
-   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
    StriContainerInteger to_cont(to, vectorize_length);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(LGLSXP, vectorize_length));
    int* ret_tab = LOGICAL(ret);
 
+   R_len_t str_n = str_cont.get_n();
+   if (!pattern_cont.isCaseInsensitive()
+         && pattern_cont.get_n() == vectorize_length
+         && str_n < vectorize_length
+         && vectorize_length >= STRI_AHOCORASICK_MIN_PATTERNS
+         && to_cont.get_n() == 1 && !to_cont.isNA(0)
+         && to_cont.get(0) == -1) {
+      // the suffix counterpart of the stri_startswith_fixed batch mode:
+      // patterns go into the trie byte-reversed, the walk runs backwards
+      StriAhoCorasick trie;
+      for (R_len_t i=0; i<vectorize_length; ++i) {
+         if (pattern_cont.isNA(i) || pattern_cont.get(i).length() <= 0)
+            continue; // yields NA below, like the generic loop
+         trie.addPatternReversed(pattern_cont.get(i).c_str(),
+            pattern_cont.get(i).length(), i);
+      }
+
+      std::vector<char> found(vectorize_length);
+      for (R_len_t r=0; r<str_n; ++r) {
+         bool cur_na = str_cont.isNA(r);
+         if (!cur_na) {
+            for (R_len_t i=0; i<vectorize_length; ++i) found[i] = 0;
+            trie.scanSuffix(str_cont.get(r).c_str(),
+               str_cont.get(r).length(), found);
+         }
+         for (R_len_t i=r; i<vectorize_length; i+=str_n) {
+            if (cur_na || pattern_cont.isNA(i)
+                  || pattern_cont.get(i).length() <= 0)
+               ret_tab[i] = NA_LOGICAL;
+            else
+               ret_tab[i] = (int)found[i];
+         }
+      }
+
+      STRI__UNPROTECT_ALL
+      return ret;
+   }
+
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
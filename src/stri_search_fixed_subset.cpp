@@ -65,6 +65,11 @@
  *
  * @version 1.0-3 (Marek Gagolewski, 2016-02-03)
  *    FR #216: `negate` arg added
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    qualifying indices are appended to a growing buffer as they are
+ *    found and the result is materialized from it directly - no
+ *    full-length logical mask, no second walk over the non-matches
  */
 SEXP stri_subset_fixed(SEXP str, SEXP pattern, SEXP omit_na, SEXP negate, SEXP opts_fixed)
 {
@@ -72,36 +77,38 @@ SEXP stri_subset_fixed(SEXP str, SEXP pattern, SEXP omit_na, SEXP negate, SEXP o
    uint32_t pattern_flags = StriContainerByteSearch::getByteSearchFlags(opts_fixed);
    bool omit_na1 = stri__prepare_arg_logical_1_notNA(omit_na, "omit_na");
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   StriByteSearchMatcher* pattern_prepared = NULL;
+   PROTECT(pattern = stri__fixed_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
 
    STRI__ERROR_HANDLER_BEGIN(2)
    int vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
    StriContainerUTF8 str_cont(str, vectorize_length);
-   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
-   // BT: this cannot be done with deque, because pattern is reused so i does not
-   // go like 0,1,2...n but 0,pat_len,2*pat_len,1,pat_len+1 and so on
-   // MG: agreed
-   std::vector<int> which(vectorize_length);
-   int result_counter = 0;
+   // only the qualifying indices are kept (push_back grows the buffer
+   // by doubling, amortized O(1)) - on a low-selectivity filter this
+   // touches nothing but the matches; -(i+1) marks a position that
+   // shall yield NA, and stri__subset_by_indices restores the input
+   // order disturbed by pattern recycling
+   std::vector<int> which;
 
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
    {
       STRI__CONTINUE_ON_EMPTY_OR_NA_STR_PATTERN(str_cont, pattern_cont,
-         {if (omit_na1) which[i] = FALSE; else {which[i] = NA_LOGICAL; result_counter++;} },
-         {which[i] = negate_1; if (which[i]) result_counter++;})
+         {if (!omit_na1) which.push_back(-(i+1));},
+         {if (negate_1) which.push_back(i);})
 
       StriByteSearchMatcher* matcher = pattern_cont.getMatcher(i);
       matcher->reset(str_cont.get(i).c_str(), str_cont.get(i).length());
-      which[i] = (int)(matcher->findFirst() != USEARCH_DONE);
-      if (negate_1) which[i] = !which[i];
-      if (which[i]) result_counter++;
+      int found = (int)(matcher->findFirst() != USEARCH_DONE);
+      if (negate_1) found = !found;
+      if (found) which.push_back(i);
    }
 
    SEXP ret;
-   STRI__PROTECT(ret = stri__subset_by_logical(str_cont, which, result_counter));
+   STRI__PROTECT(ret = stri__subset_by_indices(str_cont, which));
    STRI__UNPROTECT_ALL
    return ret;
    STRI__ERROR_HANDLER_END( ;/* do nothing special on error */ )
@@ -128,7 +135,11 @@ SEXP stri_subset_fixed_replacement(SEXP str, SEXP pattern, SEXP negate, SEXP opt
    bool negate_1 = stri__prepare_arg_logical_1_notNA(negate, "negate");
    uint32_t pattern_flags = StriContainerByteSearch::getByteSearchFlags(opts_fixed);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string_1(pattern, "pattern"));
+   StriByteSearchMatcher* pattern_prepared = NULL;
+   if (stri__is_fixed_pattern(pattern))
+      PROTECT(pattern = stri__fixed_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
+   else
+      PROTECT(pattern = stri_prepare_arg_string_1(pattern, "pattern"));
    PROTECT(value = stri_prepare_arg_string(value, "value"));
 
    int vectorize_length = LENGTH(str);
@@ -139,7 +150,7 @@ SEXP stri_subset_fixed_replacement(SEXP str, SEXP pattern, SEXP negate, SEXP opt
    STRI__ERROR_HANDLER_BEGIN(3)
    StriContainerUTF8 str_cont(str, vectorize_length);
    StriContainerUTF8 value_cont(value, value_length);
-   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerByteSearch pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
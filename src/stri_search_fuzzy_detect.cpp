@@ -0,0 +1,97 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_container_utf8.h"
+#include "stri_fuzzy_matcher.h"
+
+
+/**
+ * Detect an approximate occurrence of a pattern
+ * (edit distance <= max_distance)
+ *
+ * @param str character vector
+ * @param pattern character vector
+ * @param negate single bool
+ * @param max_distance single integer
+ * @return logical vector
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    first version
+ */
+SEXP stri_detect_fuzzy(SEXP str, SEXP pattern, SEXP negate,
+   SEXP max_distance)
+{
+   bool negate_1 = stri__prepare_arg_logical_1_notNA(negate, "negate");
+   int max_distance_1 = stri__prepare_arg_integer_1_notNA(max_distance, "max_distance");
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+
+   StriFuzzyMatcher* matcher = NULL;
+   STRI__ERROR_HANDLER_BEGIN(2)
+   int vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
+   StriContainerUTF8 str_cont(str, vectorize_length);
+   StriContainerUTF8 pattern_cont(pattern, vectorize_length);
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(LGLSXP, vectorize_length));
+   int* ret_tab = LOGICAL(ret);
+
+   const char* last_pattern = NULL;
+   for (R_len_t i = pattern_cont.vectorize_init();
+         i != pattern_cont.vectorize_end();
+         i = pattern_cont.vectorize_next(i))
+   {
+      STRI__CONTINUE_ON_EMPTY_OR_NA_STR_PATTERN(str_cont, pattern_cont,
+         {if (!pattern_cont.isNA(i) && pattern_cont.get(i).length() <= 0)
+             Rf_warning(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+          ret_tab[i] = NA_LOGICAL;}, ret_tab[i] = negate_1)
+
+      if (last_pattern != pattern_cont.get(i).c_str()) {
+         if (matcher) { delete matcher; matcher = NULL; }
+         matcher = new StriFuzzyMatcher(pattern_cont.get(i).c_str(),
+            pattern_cont.get(i).length(), max_distance_1);
+         last_pattern = pattern_cont.get(i).c_str();
+      }
+
+      matcher->reset(str_cont.get(i).c_str(), str_cont.get(i).length());
+      ret_tab[i] = (int)(matcher->findNext() != USEARCH_DONE);
+      if (negate_1) ret_tab[i] = !ret_tab[i];
+   }
+
+   if (matcher) { delete matcher; matcher = NULL; }
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(
+      if (matcher) { delete matcher; matcher = NULL; }
+   )
+}
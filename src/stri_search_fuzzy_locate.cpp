@@ -0,0 +1,244 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_container_utf8_indexable.h"
+#include "stri_fuzzy_matcher.h"
+#include <vector>
+using namespace std;
+
+
+/**
+ * Locate the first or the last approximate occurrence of a pattern
+ * (edit distance <= max_distance)
+ *
+ * @param str character vector
+ * @param pattern character vector
+ * @param max_distance single integer
+ * @param first looking for the first or the last occurrence?
+ * @return integer matrix (2 columns)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    first version
+ */
+SEXP stri__locate_firstlast_fuzzy(SEXP str, SEXP pattern, SEXP max_distance,
+   bool first)
+{
+   int max_distance_1 = stri__prepare_arg_integer_1_notNA(max_distance, "max_distance");
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+
+   StriFuzzyMatcher* matcher = NULL;
+   STRI__ERROR_HANDLER_BEGIN(2)
+   int vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
+   StriContainerUTF8_indexable str_cont(str, vectorize_length);
+   StriContainerUTF8 pattern_cont(pattern, vectorize_length);
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocMatrix(INTSXP, vectorize_length, 2));
+   stri__locate_set_dimnames_matrix(ret);
+   int* ret_tab = INTEGER(ret);
+
+   const char* last_pattern = NULL;
+   for (R_len_t i = pattern_cont.vectorize_init();
+      i != pattern_cont.vectorize_end();
+      i = pattern_cont.vectorize_next(i))
+   {
+      ret_tab[i]                  = NA_INTEGER;
+      ret_tab[i+vectorize_length] = NA_INTEGER;
+      STRI__CONTINUE_ON_EMPTY_OR_NA_STR_PATTERN(str_cont, pattern_cont,
+         {if (!pattern_cont.isNA(i) && pattern_cont.get(i).length() <= 0)
+             Rf_warning(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);},
+         ;/*nothing*/)
+
+      if (last_pattern != pattern_cont.get(i).c_str()) {
+         if (matcher) { delete matcher; matcher = NULL; }
+         matcher = new StriFuzzyMatcher(pattern_cont.get(i).c_str(),
+            pattern_cont.get(i).length(), max_distance_1);
+         last_pattern = pattern_cont.get(i).c_str();
+      }
+
+      matcher->reset(str_cont.get(i).c_str(), str_cont.get(i).length());
+      // the matcher enumerates forward only; for `last` we scan through
+      // all the (non-overlapping) occurrences and keep the final one
+      int start = USEARCH_DONE, len = 0;
+      while (USEARCH_DONE != matcher->findNext()) {
+         start = matcher->getMatchedStart();
+         len   = matcher->getMatchedLength();
+         if (first) break;
+      }
+
+      if (start != USEARCH_DONE) {
+         ret_tab[i]                  = start;
+         ret_tab[i+vectorize_length] = start+len;
+
+         // Adjust UTF8 byte index -> UChar32 index
+         str_cont.UTF8_to_UChar32_index(i,
+               ret_tab+i, ret_tab+i+vectorize_length, 1,
+               1, // 0-based index -> 1-based
+               0  // end returns position of next character after match
+         );
+      }
+   }
+
+   if (matcher) { delete matcher; matcher = NULL; }
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(
+      if (matcher) { delete matcher; matcher = NULL; }
+   )
+}
+
+
+/**
+ * Locate the first approximate occurrence of a pattern
+ *
+ * @param str character vector
+ * @param pattern character vector
+ * @param max_distance single integer
+ * @return integer matrix (2 columns)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    first version
+ */
+SEXP stri_locate_first_fuzzy(SEXP str, SEXP pattern, SEXP max_distance)
+{
+   return stri__locate_firstlast_fuzzy(str, pattern, max_distance, true);
+}
+
+
+/**
+ * Locate the last approximate occurrence of a pattern
+ *
+ * @param str character vector
+ * @param pattern character vector
+ * @param max_distance single integer
+ * @return integer matrix (2 columns)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    first version
+ */
+SEXP stri_locate_last_fuzzy(SEXP str, SEXP pattern, SEXP max_distance)
+{
+   return stri__locate_firstlast_fuzzy(str, pattern, max_distance, false);
+}
+
+
+/**
+ * Locate all approximate occurrences of a pattern
+ * (non-overlapping, edit distance <= max_distance)
+ *
+ * @param str character vector
+ * @param pattern character vector
+ * @param omit_no_match single bool
+ * @param max_distance single integer
+ * @return list of integer matrices (2 columns)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    first version
+ */
+SEXP stri_locate_all_fuzzy(SEXP str, SEXP pattern, SEXP omit_no_match,
+   SEXP max_distance)
+{
+   bool omit_no_match1 = stri__prepare_arg_logical_1_notNA(omit_no_match, "omit_no_match");
+   int max_distance_1 = stri__prepare_arg_integer_1_notNA(max_distance, "max_distance");
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+
+   StriFuzzyMatcher* matcher = NULL;
+   STRI__ERROR_HANDLER_BEGIN(2)
+   int vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
+   StriContainerUTF8_indexable str_cont(str, vectorize_length);
+   StriContainerUTF8 pattern_cont(pattern, vectorize_length);
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(VECSXP, vectorize_length));
+
+   std::vector<int> arena; // (start, end) byte offsets, reused between elements
+
+   const char* last_pattern = NULL;
+   for (R_len_t i = pattern_cont.vectorize_init();
+      i != pattern_cont.vectorize_end();
+      i = pattern_cont.vectorize_next(i))
+   {
+      STRI__CONTINUE_ON_EMPTY_OR_NA_STR_PATTERN(str_cont, pattern_cont,
+         {if (!pattern_cont.isNA(i) && pattern_cont.get(i).length() <= 0)
+             Rf_warning(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+          SET_VECTOR_ELT(ret, i, stri__matrix_NA_INTEGER(1, 2));},
+         SET_VECTOR_ELT(ret, i, stri__matrix_NA_INTEGER(omit_no_match1?0:1, 2));)
+
+      if (last_pattern != pattern_cont.get(i).c_str()) {
+         if (matcher) { delete matcher; matcher = NULL; }
+         matcher = new StriFuzzyMatcher(pattern_cont.get(i).c_str(),
+            pattern_cont.get(i).length(), max_distance_1);
+         last_pattern = pattern_cont.get(i).c_str();
+      }
+
+      arena.clear(); // keeps the capacity from the previous element
+      matcher->reset(str_cont.get(i).c_str(), str_cont.get(i).length());
+      while (USEARCH_DONE != matcher->findNext()) {
+         arena.push_back(matcher->getMatchedStart());
+         arena.push_back(matcher->getMatchedStart()+matcher->getMatchedLength());
+      }
+
+      if (arena.empty()) { // no matches at all
+         SET_VECTOR_ELT(ret, i, stri__matrix_NA_INTEGER(omit_no_match1?0:1, 2));
+         continue;
+      }
+
+      R_len_t noccurrences = (R_len_t)arena.size()/2;
+      SEXP ans;
+      STRI__PROTECT(ans = Rf_allocMatrix(INTSXP, noccurrences, 2));
+      int* ans_tab = INTEGER(ans);
+      for (R_len_t j = 0; j < noccurrences; ++j) {
+         ans_tab[j]              = arena[2*j];
+         ans_tab[j+noccurrences] = arena[2*j+1];
+      }
+
+      // Adjust UTF8 byte index -> UChar32 index
+      str_cont.UTF8_to_UChar32_index(i, ans_tab,
+            ans_tab+noccurrences, noccurrences,
+            1, // 0-based index -> 1-based
+            0  // end returns position of next character after match
+      );
+      SET_VECTOR_ELT(ret, i, ans);
+      STRI__UNPROTECT(1);
+   }
+
+   stri__locate_set_dimnames_list(ret);
+   if (matcher) { delete matcher; matcher = NULL; }
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(
+      if (matcher) { delete matcher; matcher = NULL; }
+   )
+}
@@ -39,11 +39,30 @@
 #include "stri_container_logical.h"
 #include <deque>
 #include <utility>
+#include <cstring>
 #include <unicode/brkiter.h>
 #include <unicode/rbbi.h>
 using namespace std;
 
 
+/** May a string be line-split by looking at CR/LF bytes only?
+ *
+ * True if none of the rarer newline characters can occur: VT, FF,
+ * NEL (UTF-8 lead byte 0xc2), LS/PS (lead byte 0xe2). memchr is
+ * typically a vectorized library routine, so this pre-pass is much
+ * cheaper than decoding every code point.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static bool stri__split_lines_crlf_only(const char* s, R_len_t n)
+{
+   return !memchr(s, ASCII_VT, (size_t)n)
+       && !memchr(s, ASCII_FF, (size_t)n)
+       && !memchr(s, 0xc2,     (size_t)n)
+       && !memchr(s, 0xe2,     (size_t)n);
+}
+
+
 /**
  * Split a single string into text lines
  *
@@ -147,6 +166,9 @@ SEXP stri_split_lines1(SEXP str)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-05)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    memchr-driven scan when only CR/LF newlines can occur
  */
 SEXP stri_split_lines(SEXP str, SEXP omit_empty)
 {
@@ -202,6 +224,39 @@ SEXP stri_split_lines(SEXP str, SEXP omit_empty)
       R_len_t jlast, k=1;
       deque< pair<R_len_t, R_len_t> > occurrences;
       occurrences.push_back(pair<R_len_t, R_len_t>(0, 0));
+
+      if (stri__split_lines_crlf_only(str_cur_s, str_cur_n)) {
+         // leap from newline to newline; the cached hits stay valid
+         // until consumed, so each byte is searched at most once
+         const char* p_cr = (const char*)memchr(str_cur_s, ASCII_CR, (size_t)str_cur_n);
+         const char* p_lf = (const char*)memchr(str_cur_s, ASCII_LF, (size_t)str_cur_n);
+         R_len_t j = 0;
+         for (;;) {
+            if (p_cr && p_cr < str_cur_s+j)
+               p_cr = (const char*)memchr(str_cur_s+j, ASCII_CR, (size_t)(str_cur_n-j));
+            if (p_lf && p_lf < str_cur_s+j)
+               p_lf = (const char*)memchr(str_cur_s+j, ASCII_LF, (size_t)(str_cur_n-j));
+            const char* hit =
+               (!p_cr)?p_lf:((!p_lf)?p_cr:((p_cr < p_lf)?p_cr:p_lf));
+            if (!hit) {
+               occurrences.back().second = str_cur_n;
+               break;
+            }
+
+            jlast = (R_len_t)(hit-str_cur_s);
+            j = jlast+1;
+            if (*hit == ASCII_CR && j < str_cur_n && str_cur_s[j] == ASCII_LF)
+               j++; // CRLF
+            if (omit_empty_cur && occurrences.back().first == jlast)
+               occurrences.back().first = occurrences.back().second = j;
+            else {
+               occurrences.back().second = jlast;
+               occurrences.push_back(pair<R_len_t, R_len_t>(j, j));
+               ++k; // another field
+            }
+         }
+      }
+      else
       for (R_len_t j=0; j < str_cur_n /*&& k < n_max_cur*/; /* null */) {
          jlast = j;
          U8_NEXT(str_cur_s, j, str_cur_n, c);
@@ -59,23 +59,37 @@
  *
  * @version 1.0-2 (Marek Gagolewski, 2016-01-29)
  *    Issue #214: allow a regex pattern like `.*`  to match an empty string
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    patterns with a mandatory literal prefix jump between candidate
+ *    positions via indexOf() instead of letting the backtracker probe
+ *    every failure position
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    `max_count` arg added - threshold queries stop enumerating
+ *    an element's matches once the cap is reached
  */
-SEXP stri_count_regex(SEXP str, SEXP pattern, SEXP opts_regex)
+SEXP stri_count_regex(SEXP str, SEXP pattern, SEXP max_count, SEXP opts_regex)
 {
+   int max_count1 = stri__prepare_arg_integer_1_notNA(max_count, "max_count");
+   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   const RegexPattern* pattern_prepared = NULL;
+   PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    R_len_t vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
 
-   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
-
    STRI__ERROR_HANDLER_BEGIN(2)
    StriContainerUTF16 str_cont(str, vectorize_length);
-   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(INTSXP, vectorize_length));
    int* ret_tab = INTEGER(ret);
 
+   UnicodeString prefix; // mandatory literal prefix of the current pattern
+   bool prefix_anchored = false;
+   R_len_t prefix_index = -1;
+
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
@@ -83,12 +97,48 @@ SEXP stri_count_regex(SEXP str, SEXP pattern, SEXP opts_regex)
       STRI__CONTINUE_ON_EMPTY_OR_NA_PATTERN(str_cont, pattern_cont,
          ret_tab[i] = NA_INTEGER)
 
-      // see search_regex_detect for UText implementation (often slower)
-      RegexMatcher *matcher = pattern_cont.getMatcher(i); // will be deleted automatically
-      matcher->reset(str_cont.get(i));
+      if (prefix_index != (i % pattern_cont.get_n())) {
+         prefix_index = (i % pattern_cont.get_n());
+         prefix = StriContainerRegexPattern::getLiteralPrefix(
+            pattern_cont.get(i), pattern_flags, prefix_anchored);
+      }
+
+      const UnicodeString& cur_str = str_cont.get(i);
       UErrorCode status = U_ZERO_ERROR;
       int count = 0;
-      while (1) {
+
+      if (prefix_anchored && !cur_str.startsWith(prefix)) {
+         ret_tab[i] = 0; // all matches must start at position 0
+         continue;
+      }
+
+      // see search_regex_detect for UText implementation (often slower)
+      RegexMatcher *matcher = pattern_cont.getMatcher(i); // will be deleted automatically
+
+      if (!prefix.isEmpty() && !prefix_anchored) {
+         // every match starts with `prefix` and is at least as long;
+         // hop between the prefix occurrences (a plain text scan) and
+         // engage the engine only there - matches cannot be of zero
+         // length here, so no special advance logic is needed
+         matcher->reset(cur_str);
+         R_len_t pos = 0;
+         R_len_t last_start = cur_str.length()-prefix.length();
+         while (pos <= last_start && (max_count1 < 0 || count < max_count1)) {
+            R_len_t candidate = cur_str.indexOf(prefix, pos);
+            if (candidate < 0) break;
+            int m_res = (int)matcher->find(candidate, status);
+            STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+            if (!m_res) break;
+            ++count;
+            pos = (R_len_t)matcher->end(status);
+            STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+         }
+         ret_tab[i] = count;
+         continue;
+      }
+
+      matcher->reset(cur_str);
+      while (max_count1 < 0 || count < max_count1) {
          int m_res = (bool)matcher->find(status);
          STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
          if (!m_res) break;
@@ -34,6 +34,99 @@
 #include "stri_container_utf16.h"
 #include "stri_container_utf8.h"
 #include "stri_container_regex.h"
+#include "stri_utext.h"
+#include "stri_threads.h"
+#include "stri_interrupt.h"
+#include "stri_perfstats.h"
+#include "stri_engine_sample.h"
+
+/** Where does the `$` anchor (no `multiline`) consider the input to end?
+ *
+ * Like in Java, ICU's `$` also matches just before a final line
+ * terminator (\\n, \\r, \\r\\n, U+0085, U+2028, U+2029; only \\n under
+ * `unix_lines`). Literal-routing of `lit$` patterns must mimic that.
+ *
+ * @param s the string
+ * @param flags RegexMatcher flags
+ * @return the effective end position for suffix comparisons
+ */
+static R_len_t stri__regex_effective_end(const UnicodeString& s, uint32_t flags)
+{
+   R_len_t n = s.length();
+   if (n <= 0) return n;
+   UChar c = s.charAt(n-1);
+   if (c == (UChar)'\n') {
+      if (!(flags&UREGEX_UNIX_LINES) && n > 1 && s.charAt(n-2) == (UChar)'\r')
+         return n-2;
+      return n-1;
+   }
+   if (flags&UREGEX_UNIX_LINES) return n;
+   if (c == (UChar)'\r' || c == (UChar)0x0085 ||
+       c == (UChar)0x2028 || c == (UChar)0x2029) return n-1;
+   return n;
+}
+
+
+/**
+ * Detect if a pattern occurs in a string - UText/UTF-8 path
+ *
+ * Runs the matcher directly over the UTF-8 payloads kept in
+ * a StriContainerUTF8, each element wrapped in a (reused) UText.
+ * This trades the per-element UTF-8 -> UTF-16 conversion for somewhat
+ * slower UText character access - a net win on large, rarely-matching
+ * inputs, hence opt-in via \code{options(stringi.regex_use_utext=TRUE)}.
+ *
+ * Arguments are assumed to have been prepared by the caller,
+ * see \code{stri_detect_regex()}.
+ */
+static SEXP stri__detect_regex_utext(SEXP str, SEXP pattern, bool negate_1,
+    int max_count_1, uint32_t pattern_flags,
+    const RegexPattern* pattern_prepared, R_len_t vectorize_length)
+{
+   STRI__ERROR_HANDLER_BEGIN(0)
+   StriContainerUTF8 str_cont(str, vectorize_length);
+   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(LGLSXP, vectorize_length));
+   int* ret_tab = LOGICAL(ret);
+
+   STRI__PERFSTATS_SCOPE(engine)
+
+   StriUText str_text; // UTF-8 UText: may be slower, but definitely more convenient!
+   UErrorCode status = U_ZERO_ERROR;
+   StriInterruptCheckpoint checkpoint;
+
+   for (R_len_t i = pattern_cont.vectorize_init();
+         i != pattern_cont.vectorize_end();
+         i = pattern_cont.vectorize_next(i))
+   {
+      checkpoint.touch();
+
+      if (max_count_1 == 0) {
+          ret_tab[i] = NA_LOGICAL;
+          continue;
+      }
+
+      STRI__CONTINUE_ON_EMPTY_OR_NA_PATTERN(str_cont,
+         pattern_cont, ret_tab[i] = NA_LOGICAL)
+
+      RegexMatcher *matcher = pattern_cont.getMatcher(i); // will be deleted automatically
+      str_text.wrap(str_cont.get(i));
+
+      matcher->reset(str_text.get());
+      ret_tab[i] = (int)matcher->find(status); // returns UBool
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+
+      if (negate_1) ret_tab[i] = !ret_tab[i];
+      if (max_count_1 > 0 && ret_tab[i]) --max_count_1;
+   }
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
+}
+
 
 /**
  * Detect if a pattern occurs in a string
@@ -66,32 +159,133 @@
  *
  * @version 1.3.1 (Marek Gagolewski, 2019-02-08)
  *    #232: `max_count` arg added
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    literal-prefix prescan: reject non-candidates without engaging
+ *    the backtracking matcher
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    adaptive user-interrupt checkpoints, see stri_interrupt.h
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    literal substring patterns race the plain text scan against the
+ *    compiled pattern over the first elements and lock in the faster
+ *    engine, see stri_engine_sample.h
  */
 SEXP stri_detect_regex(SEXP str, SEXP pattern, SEXP negate,
     SEXP max_count, SEXP opts_regex)
 {
    bool negate_1 = stri__prepare_arg_logical_1_notNA(negate, "negate");
    int max_count_1 = stri__prepare_arg_integer_1_notNA(max_count, "max_count");
+   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   const RegexPattern* pattern_prepared = NULL;
+   PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    R_len_t vectorize_length =
       stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
 
-   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
+   if (stri__regex_use_utext()) {
+      SEXP ret = stri__detect_regex_utext(str, pattern, negate_1,
+         max_count_1, pattern_flags, pattern_prepared, vectorize_length);
+      UNPROTECT(2);
+      return ret;
+   }
 
    STRI__ERROR_HANDLER_BEGIN(2)
    StriContainerUTF16 str_cont(str, vectorize_length);
 //   StriContainerUTF8 str_cont(str, vectorize_length); // utext_openUTF8, see below
-   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(LGLSXP, vectorize_length));
    int* ret_tab = LOGICAL(ret);
 
+   STRI__PERFSTATS_SCOPE(engine)
+
+   UnicodeString prefix; // literal prefix of the current pattern, see below
+   bool prefix_anchored = false;
+   R_len_t prefix_index = -1;
+   UnicodeString literal; // for degenerate (metacharacter-free) patterns
+   StriRegexLiteralType literal_type = STRI_REGEX_LITERAL_NO;
+   std::vector<UnicodeString> alt_branches; // for `foo|bar|baz` patterns
+   bool is_alternation = false;
+   StriEngineSampler substr_sampler(4, 0); // text scan vs compiled pattern
+
+#ifdef STRI_HAVE_THREADS
+   int num_threads = stri__threads_requested(vectorize_length);
+   if (num_threads > 1 && pattern_cont.get_n() == 1 && max_count_1 < 0
+         && !pattern_cont.isNA(0) && pattern_cont.get(0).length() > 0) {
+      // single pattern, no max_count bookkeeping - partition the element
+      // range; one independent matcher per worker (clones must be created
+      // here, on the main R thread)
+      std::vector<RegexMatcher*> matchers(num_threads, (RegexMatcher*)NULL);
+      try {
+         for (int t=0; t<num_threads; ++t)
+            matchers[t] = pattern_cont.cloneMatcher(0);
+      }
+      catch (...) {
+         for (int t=0; t<num_threads; ++t)
+            if (matchers[t]) delete matchers[t];
+         throw;
+      }
+
+      prefix = StriContainerRegexPattern::getLiteralPrefix(
+         pattern_cont.get(0), pattern_flags, prefix_anchored);
+
+      str_cont.materializeAll(); // lazy conversion is not thread-safe
+
+      // workers shall not touch R nor throw; errors are collected
+      // here and rethrown on the main thread, post join
+      std::vector<UErrorCode> statuses(num_threads, U_ZERO_ERROR);
+      std::vector<std::thread> workers;
+      for (int t=0; t<num_threads; ++t) {
+         R_len_t chunk_from = (R_len_t)((double)vectorize_length*t/num_threads);
+         R_len_t chunk_to   = (R_len_t)((double)vectorize_length*(t+1)/num_threads);
+         RegexMatcher* matcher = matchers[t];
+         UErrorCode* cur_status = &(statuses[t]);
+         workers.push_back(std::thread(
+            [&str_cont, &prefix, prefix_anchored, negate_1, ret_tab,
+                  chunk_from, chunk_to, matcher, cur_status]() {
+               for (R_len_t i=chunk_from; i<chunk_to; ++i) {
+                  if (str_cont.isNA(i)) {
+                     ret_tab[i] = NA_LOGICAL;
+                     continue;
+                  }
+                  const UnicodeString& cur_str = str_cont.get(i);
+                  if (!prefix.isEmpty()) {
+                     bool candidate = prefix_anchored ?
+                        (bool)cur_str.startsWith(prefix)
+                        : (cur_str.indexOf(prefix) >= 0);
+                     if (!candidate) {
+                        ret_tab[i] = negate_1 ? TRUE : FALSE;
+                        continue;
+                     }
+                  }
+                  matcher->reset(cur_str);
+                  ret_tab[i] = (int)matcher->find(*cur_status);
+                  if (U_FAILURE(*cur_status)) return;
+                  if (negate_1) ret_tab[i] = !ret_tab[i];
+               }
+            }));
+      }
+
+      for (int t=0; t<num_threads; ++t) workers[t].join();
+      for (int t=0; t<num_threads; ++t) delete matchers[t];
+      for (int t=0; t<num_threads; ++t)
+         STRI__CHECKICUSTATUS_THROW(statuses[t], {/* nothing on err */})
+
+      STRI__UNPROTECT_ALL
+      return ret;
+   }
+#endif
+
+   StriInterruptCheckpoint checkpoint;
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
    {
+      checkpoint.touch();
+
       if (max_count_1 == 0) {
           ret_tab[i] = NA_LOGICAL;
           continue;
@@ -100,6 +294,88 @@ SEXP stri_detect_regex(SEXP str, SEXP pattern, SEXP negate,
       STRI__CONTINUE_ON_EMPTY_OR_NA_PATTERN(str_cont,
          pattern_cont, ret_tab[i] = NA_LOGICAL)
 
+      if (prefix_index != (i % pattern_cont.get_n())) {
+         prefix_index = (i % pattern_cont.get_n());
+         literal_type = StriContainerRegexPattern::getLiteralPattern(
+            pattern_cont.get(i), pattern_flags, literal);
+         is_alternation = (literal_type == STRI_REGEX_LITERAL_NO) &&
+            StriContainerRegexPattern::getLiteralAlternation(
+               pattern_cont.get(i), pattern_flags, alt_branches);
+         if (literal_type == STRI_REGEX_LITERAL_NO && !is_alternation)
+            prefix = StriContainerRegexPattern::getLiteralPrefix(
+               pattern_cont.get(i), pattern_flags, prefix_anchored);
+         substr_sampler = StriEngineSampler(4, 0); // new pattern, new race
+      }
+
+      if (is_alternation) {
+         // alternation of literals: any branch occurring anywhere
+         const UnicodeString& cur_str = str_cont.get(i);
+         bool found = false;
+         for (size_t b=0; !found && b<alt_branches.size(); ++b)
+            found = (cur_str.indexOf(alt_branches[b]) >= 0);
+         ret_tab[i] = negate_1?(!found):(found);
+         if (max_count_1 > 0 && ret_tab[i]) --max_count_1;
+         continue;
+      }
+
+      if (literal_type != STRI_REGEX_LITERAL_NO) {
+         // a fixed-text search in disguise - no regex engine needed
+         const UnicodeString& cur_str = str_cont.get(i);
+         bool found;
+         R_len_t eff_end;
+         switch (literal_type) {
+            case STRI_REGEX_LITERAL_PREFIX:
+               found = (bool)cur_str.startsWith(literal);
+               break;
+            case STRI_REGEX_LITERAL_SUFFIX:
+               eff_end = stri__regex_effective_end(cur_str, pattern_flags);
+               found = (eff_end >= literal.length() && cur_str.compare(
+                  eff_end-literal.length(), literal.length(), literal) == 0);
+               break;
+            case STRI_REGEX_LITERAL_EXACT:
+               eff_end = stri__regex_effective_end(cur_str, pattern_flags);
+               found = (eff_end == literal.length()
+                  && cur_str.compare(0, eff_end, literal) == 0);
+               break;
+            default: /* STRI_REGEX_LITERAL_SUBSTR */
+               // both engines provably agree here, so race the text
+               // scan against the compiled pattern over the first few
+               // elements and lock in the cheaper one
+               {
+                  int engine = substr_sampler.choose();
+                  substr_sampler.begin();
+                  if (engine == 0)
+                     found = (cur_str.indexOf(literal) >= 0);
+                  else {
+                     RegexMatcher *matcher = pattern_cont.getMatcher(i);
+                     matcher->reset(cur_str);
+                     UErrorCode status = U_ZERO_ERROR;
+                     found = (bool)matcher->find(status);
+                     STRI__CHECKICUSTATUS_THROW(status,
+                        {/* do nothing special on err */})
+                  }
+                  substr_sampler.end(engine, (double)cur_str.length());
+               }
+               break;
+         }
+         ret_tab[i] = negate_1?(!found):(found);
+         if (max_count_1 > 0 && ret_tab[i]) --max_count_1;
+         continue;
+      }
+
+      if (!prefix.isEmpty()) {
+         // any match must contain (or, if anchored, start with) `prefix`;
+         // a cheap scan rejects most non-matching strings outright
+         const UnicodeString& cur_str = str_cont.get(i);
+         bool candidate = prefix_anchored ? (bool)cur_str.startsWith(prefix)
+            : (cur_str.indexOf(prefix) >= 0);
+         if (!candidate) {
+            ret_tab[i] = negate_1 ? TRUE : FALSE;
+            if (max_count_1 > 0 && ret_tab[i]) --max_count_1;
+            continue;
+         }
+      }
+
       RegexMatcher *matcher = pattern_cont.getMatcher(i); // will be deleted automatically
       matcher->reset(str_cont.get(i));
 
@@ -33,6 +33,8 @@
 #include "stri_stringi.h"
 #include "stri_container_utf8.h"
 #include "stri_container_regex.h"
+#include "stri_utext.h"
+#include "stri_extents.h"
 #include <deque>
 #include <utility>
 using namespace std;
@@ -54,19 +56,23 @@ using namespace std;
  *
  * @version 1.0-2 (Marek Gagolewski, 2016-01-29)
  *    Issue #214: allow a regex pattern like `.*`  to match an empty string
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    first-match searches over long inputs start in an adaptively
+ *    growing prefix region, see stri__regex_find_first_adaptive
  */
 SEXP stri__extract_firstlast_regex(SEXP str, SEXP pattern, SEXP opts_regex, bool first)
 {
+   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
    PROTECT(str = stri_prepare_arg_string(str, "str")); // prepare string argument
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern")); // prepare string argument
+   const RegexPattern* pattern_prepared = NULL;
+   PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    R_len_t vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
 
-   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
-
-   UText* str_text = NULL; // may potentially be slower, but definitely is more convenient!
    STRI__ERROR_HANDLER_BEGIN(2)
+   StriUText str_text; // UTF-8 UText: may be slower, but definitely more convenient!
    StriContainerUTF8 str_cont(str, vectorize_length);
-   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
@@ -80,14 +86,19 @@ SEXP stri__extract_firstlast_regex(SEXP str, SEXP pattern, SEXP opts_regex, bool
 
       UErrorCode status = U_ZERO_ERROR;
       RegexMatcher *matcher = pattern_cont.getMatcher(i); // will be deleted automatically
-      str_text = utext_openUTF8(str_text, str_cont.get(i).c_str(), str_cont.get(i).length(), &status);
-      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      str_text.wrap(str_cont.get(i));
 
       int m_start = -1;
       int m_end = -1;
       int m_res;
-      matcher->reset(str_text);
-      m_res = (int)matcher->find(status);
+      if (first) {
+         m_res = (int)stri__regex_find_first_adaptive(matcher, str_text.get(),
+            str_cont.get(i).length(), status);
+      }
+      else {
+         matcher->reset(str_text.get());
+         m_res = (int)matcher->find(status);
+      }
       STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
       if (m_res) { // find first match
          m_start = (int)matcher->start(status); // The **native** position in the input string :-)
@@ -114,13 +125,9 @@ SEXP stri__extract_firstlast_regex(SEXP str, SEXP pattern, SEXP opts_regex, bool
       SET_STRING_ELT(ret, i, Rf_mkCharLenCE(str_cont.get(i).c_str()+m_start, m_end-m_start, CE_UTF8));
    }
 
-   if (str_text) {
-      utext_close(str_text);
-      str_text = NULL;
-   }
    STRI__UNPROTECT_ALL
    return ret;
-   STRI__ERROR_HANDLER_END(if (str_text) utext_close(str_text);)
+   STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
 }
 
 
@@ -182,6 +189,9 @@ SEXP stri_extract_last_regex(SEXP str, SEXP pattern, SEXP opts_regex)
  *
  * @version 1.0-2 (Marek Gagolewski, 2016-01-29)
  *    Issue #214: allow a regex pattern like `.*`  to match an empty string
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    collect extents in a C++ arena, materialize the R structure in one pass
  */
 SEXP stri_extract_all_regex(SEXP str, SEXP pattern, SEXP simplify, SEXP omit_no_match, SEXP opts_regex)
 {
@@ -189,67 +199,44 @@ SEXP stri_extract_all_regex(SEXP str, SEXP pattern, SEXP simplify, SEXP omit_no_
    bool omit_no_match1 = stri__prepare_arg_logical_1_notNA(omit_no_match, "omit_no_match");
    PROTECT(simplify = stri_prepare_arg_logical_1(simplify, "simplify"));
    PROTECT(str = stri_prepare_arg_string(str, "str")); // prepare string argument
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern")); // prepare string argument
+   const RegexPattern* pattern_prepared = NULL;
+   PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    R_len_t vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
 
-   UText* str_text = NULL; // may potentially be slower, but definitely is more convenient!
    STRI__ERROR_HANDLER_BEGIN(3)
+   StriUText str_text; // UTF-8 UText: may be slower, but definitely more convenient!
    StriContainerUTF8 str_cont(str, vectorize_length);
-   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags);
-
-   SEXP ret;
-   STRI__PROTECT(ret = Rf_allocVector(VECSXP, vectorize_length));
+   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
+   // phase 1: pure scanning - no R allocation may interleave here
+   StriExtractExtents extents(vectorize_length);
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
    {
       STRI__CONTINUE_ON_EMPTY_OR_NA_PATTERN(str_cont, pattern_cont,
-         SET_VECTOR_ELT(ret, i, stri__vector_NA_strings(1));)
+         extents.markNA(i);)
 
       UErrorCode status = U_ZERO_ERROR;
       RegexMatcher *matcher = pattern_cont.getMatcher(i); // will be deleted automatically
-      str_text = utext_openUTF8(str_text, str_cont.get(i).c_str(), str_cont.get(i).length(), &status);
-      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      str_text.wrap(str_cont.get(i));
 
-      matcher->reset(str_text);
+      matcher->reset(str_text.get());
 
-      deque< pair<R_len_t, R_len_t> > occurrences;
       int m_res;
       while (1) {
          m_res = (int)matcher->find(status);
          STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
          if (!m_res) break;
 
-         occurrences.push_back(pair<R_len_t, R_len_t>(
-            (R_len_t)matcher->start(status), (R_len_t)matcher->end(status)
-         ));
+         extents.push(i, (R_len_t)matcher->start(status), (R_len_t)matcher->end(status));
          STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
       }
-
-      R_len_t noccurrences = (R_len_t)occurrences.size();
-      if (noccurrences <= 0) {
-         SET_VECTOR_ELT(ret, i, stri__vector_NA_strings(omit_no_match1?0:1));
-         continue;
-      }
-
-      const char* str_cur_s = str_cont.get(i).c_str();
-      SEXP cur_res;
-      STRI__PROTECT(cur_res = Rf_allocVector(STRSXP, noccurrences));
-      deque< pair<R_len_t, R_len_t> >::iterator iter = occurrences.begin();
-      for (R_len_t j = 0; iter != occurrences.end(); ++iter, ++j) {
-         pair<R_len_t, R_len_t> curo = *iter;
-         SET_STRING_ELT(cur_res, j,
-            Rf_mkCharLenCE(str_cur_s+curo.first, curo.second-curo.first, CE_UTF8));
-      }
-      SET_VECTOR_ELT(ret, i, cur_res);
-      STRI__UNPROTECT(1);
    }
 
-   if (str_text) {
-      utext_close(str_text);
-      str_text = NULL;
-   }
+   // phase 2: one batched pass of R allocations
+   SEXP ret;
+   STRI__PROTECT(ret = extents.toR(str_cont, omit_no_match1));
 
    if (LOGICAL(simplify)[0] == NA_LOGICAL || LOGICAL(simplify)[0]) {
       SEXP robj_TRUE, robj_zero, robj_na_strings, robj_empty_strings;
@@ -265,5 +252,5 @@ SEXP stri_extract_all_regex(SEXP str, SEXP pattern, SEXP simplify, SEXP omit_no_
 
    STRI__UNPROTECT_ALL
    return ret;
-   STRI__ERROR_HANDLER_END(if (str_text) utext_close(str_text);)
+   STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
 }
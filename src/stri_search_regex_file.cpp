@@ -0,0 +1,261 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_container_regex.h"
+#include "stri_utext.h"
+#include "stri_files.h"
+#include "stri_interrupt.h"
+#include <vector>
+
+/* The streaming scan walks the mapped file in windows of this many
+ * bytes (grown if max_match_bytes demands it). Within a window the
+ * matcher runs on a UTF-8 UText, so start()/end() are native byte
+ * offsets and adding the window base yields global ones.
+ *
+ * Matches starting in the tail of a non-final window (at least the
+ * last max_match_bytes of it) are withheld - they could extend past
+ * the window - and the next window begins right at the first withheld
+ * position, so every match no longer than max_match_bytes is seen
+ * exactly once, in full. */
+#define STRI__REGEX_FILE_WINDOW 16777216
+
+
+/** one window step of the streaming regex scan
+ *
+ * @param file the mapped file
+ * @param from [in/out] global offset of the window; advanced to the
+ *    first uncommitted position (file.size when done)
+ * @param max_match_1 carry-over size [bytes]
+ * @param str_text reused UText bridge over the mapped bytes
+ * @param matcher the pattern's matcher, reset here
+ * @param commit_limit [out] window-local offset before which matches
+ *    are to be committed
+ * @return window-local length; the window starts at the (old) *from
+ */
+static R_len_t stri__regex_file_window(const StriMappedFile& file,
+   size_t& from, int max_match_1, StriUText& str_text, RegexMatcher* matcher,
+   R_len_t& commit_limit)
+{
+   size_t wsize = (size_t)STRI__REGEX_FILE_WINDOW;
+   if (wsize < 4*(size_t)max_match_1) wsize = 4*(size_t)max_match_1;
+   size_t wlen = file.size-from;
+   bool final_window = (wlen <= wsize);
+   if (!final_window) {
+      wlen = wsize;
+      // cut at a code point boundary
+      while (wlen > 0 && ((unsigned char)file.data[from+wlen] & 0xc0) == 0x80)
+         --wlen;
+   }
+
+   if (stri__enc_check_utf8(file.data+from, (R_len_t)wlen, false) < 1.0)
+      throw StriException(MSG__INVALID_UTF8);
+
+   str_text.wrap(file.data+from, (R_len_t)wlen);
+   matcher->reset(str_text.get());
+
+   if (final_window)
+      commit_limit = (R_len_t)wlen;
+   else {
+      commit_limit = (R_len_t)(wlen-(size_t)max_match_1);
+      // prefer a seam just after a line break (looking back at most
+      // another max_match_bytes), so that multiline anchors keep their
+      // meaning at window boundaries
+      for (R_len_t j=commit_limit; j>0 && j+max_match_1>commit_limit; --j)
+         if (file.data[from+(size_t)j-1] == '\n') { commit_limit = j; break; }
+   }
+   from = final_window?file.size:(from+(size_t)commit_limit);
+   return (R_len_t)wlen;
+}
+
+
+/**
+ * Count regex pattern matches in a text file, without loading it
+ *
+ * See stri_count_regex_file in R. The file is mapped and scanned in
+ * bounded windows (one step per stri__regex_file_window call); only
+ * the window being scanned is resident, so file size is limited by
+ * the address space, not by R's heap or vector limits.
+ *
+ * @param fname single string, file path
+ * @param pattern single string, the regex
+ * @param max_match_bytes single integer, upper bound on the byte
+ *    length of a match (the carry-over between windows)
+ * @param opts_regex list
+ * @return single numeric value (counts may exceed INT_MAX)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_count_regex_file(SEXP fname, SEXP pattern, SEXP max_match_bytes,
+   SEXP opts_regex)
+{
+   const char* fname_s = stri__prepare_arg_string_1_notNA(fname, "fname");
+   int max_match_1 = stri__prepare_arg_integer_1_notNA(max_match_bytes,
+      "max_match_bytes");
+   if (max_match_1 <= 0)
+      Rf_error(MSG__EXPECTED_POSITIVE, "max_match_bytes"); // error() call allowed here
+   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
+   const RegexPattern* pattern_prepared = NULL;
+   if (stri__is_regex_pattern(pattern))
+      PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
+   else
+      PROTECT(pattern = stri_prepare_arg_string_1(pattern, "pattern"));
+
+   StriMappedFile file;
+   if (!file.open(fname_s))
+      Rf_error(MSG__FILE_READ_ERROR, fname_s); // error() call allowed here
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriUText str_text; // UTF-8 UText over the mapped bytes - no copy
+   StriContainerRegexPattern pattern_cont(pattern, 1, pattern_flags, pattern_prepared);
+   if (pattern_cont.isNA(0) || pattern_cont.get(0).length() <= 0)
+      throw StriException(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+   RegexMatcher* matcher = pattern_cont.getMatcher(0); // deleted automatically
+
+   double count = 0.0;
+   size_t from = 0;
+   StriInterruptCheckpoint checkpoint;
+   while (from < file.size) {
+      checkpoint.touch();
+      R_len_t commit_limit;
+      stri__regex_file_window(file, from, max_match_1, str_text, matcher,
+         commit_limit);
+      bool final_window = (from >= file.size);
+
+      UErrorCode status = U_ZERO_ERROR;
+      while (matcher->find(status)) {
+         R_len_t m_start = (R_len_t)matcher->start(status);
+         STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+         if (!final_window && m_start >= commit_limit)
+            break; // re-examined, in full, in the next window
+         count += 1.0;
+      }
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+   }
+
+   file.close();
+   STRI__UNPROTECT_ALL
+   return Rf_ScalarReal(count);
+   STRI__ERROR_HANDLER_END({
+      file.close();
+   })
+}
+
+
+/**
+ * Locate regex pattern matches in a text file, as global byte offsets
+ *
+ * See stri_locate_all_regex_file in R. Same windowed walk as
+ * stri_count_regex_file; every committed match contributes its global
+ * 1-based byte range. Offsets are doubles, as files routinely outgrow
+ * INT_MAX bytes; the match count itself still has to fit in an R
+ * vector.
+ *
+ * @param fname single string, file path
+ * @param pattern single string, the regex
+ * @param max_match_bytes single integer, upper bound on the byte
+ *    length of a match (the carry-over between windows)
+ * @param opts_regex list
+ * @return numeric matrix with two columns (start, end)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_locate_all_regex_file(SEXP fname, SEXP pattern, SEXP max_match_bytes,
+   SEXP opts_regex)
+{
+   const char* fname_s = stri__prepare_arg_string_1_notNA(fname, "fname");
+   int max_match_1 = stri__prepare_arg_integer_1_notNA(max_match_bytes,
+      "max_match_bytes");
+   if (max_match_1 <= 0)
+      Rf_error(MSG__EXPECTED_POSITIVE, "max_match_bytes"); // error() call allowed here
+   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
+   const RegexPattern* pattern_prepared = NULL;
+   if (stri__is_regex_pattern(pattern))
+      PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
+   else
+      PROTECT(pattern = stri_prepare_arg_string_1(pattern, "pattern"));
+
+   StriMappedFile file;
+   if (!file.open(fname_s))
+      Rf_error(MSG__FILE_READ_ERROR, fname_s); // error() call allowed here
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriUText str_text; // UTF-8 UText over the mapped bytes - no copy
+   StriContainerRegexPattern pattern_cont(pattern, 1, pattern_flags, pattern_prepared);
+   if (pattern_cont.isNA(0) || pattern_cont.get(0).length() <= 0)
+      throw StriException(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+   RegexMatcher* matcher = pattern_cont.getMatcher(0); // deleted automatically
+
+   std::vector<double> starts, ends;
+   size_t from = 0;
+   StriInterruptCheckpoint checkpoint;
+   while (from < file.size) {
+      checkpoint.touch();
+      size_t window_base = from;
+      R_len_t commit_limit;
+      stri__regex_file_window(file, from, max_match_1, str_text, matcher,
+         commit_limit);
+      bool final_window = (from >= file.size);
+
+      UErrorCode status = U_ZERO_ERROR;
+      while (matcher->find(status)) {
+         R_len_t m_start = (R_len_t)matcher->start(status);
+         R_len_t m_end = (R_len_t)matcher->end(status);
+         STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+         if (!final_window && m_start >= commit_limit)
+            break; // re-examined, in full, in the next window
+         if (starts.size() >= (size_t)INT_MAX)
+            throw StriException(MSG__EXPECTED_SMALLER, "max matches");
+         // 1-based inclusive global byte range (empty match: end<start)
+         starts.push_back((double)window_base+(double)m_start+1.0);
+         ends.push_back((double)window_base+(double)m_end);
+      }
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+   }
+
+   R_len_t noccurrences = (R_len_t)starts.size();
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocMatrix(REALSXP, noccurrences, 2));
+   double* ret_tab = REAL(ret);
+   for (R_len_t j=0; j<noccurrences; ++j) {
+      ret_tab[j] = starts[j];
+      ret_tab[j+noccurrences] = ends[j];
+   }
+   stri__locate_set_dimnames_matrix(ret);
+
+   file.close();
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({
+      file.close();
+   })
+}
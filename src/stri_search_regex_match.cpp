@@ -33,6 +33,7 @@
 #include "stri_stringi.h"
 #include "stri_container_utf8.h"
 #include "stri_container_regex.h"
+#include "stri_utext.h"
 #include <vector>
 #include <deque>
 #include <utility>
@@ -64,19 +65,23 @@ using namespace std;
  * @version 1.1.8 (Marek Gagolewski, 2018-04-09)
  *    #288: stri_match did not return correct number of columns
  *    when input was empty
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    first-match searches over long inputs start in an adaptively
+ *    growing prefix region, see stri__regex_find_first_adaptive
  */
 SEXP stri__match_firstlast_regex(SEXP str, SEXP pattern, SEXP cg_missing, SEXP opts_regex, bool first)
 {
    // @TODO: capture_groups arg (integer vector/set - which capture groups to extract)
+   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
    PROTECT(str = stri_prepare_arg_string(str, "str")); // prepare string argument
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern")); // prepare string argument
+   const RegexPattern* pattern_prepared = NULL;
+   PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    PROTECT(cg_missing = stri_prepare_arg_string_1(cg_missing, "cg_missing"));
    R_len_t vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
 
-   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
-
-   UText* str_text = NULL; // may potentially be slower, but definitely is more convenient!
    STRI__ERROR_HANDLER_BEGIN(3)
+   StriUText str_text; // UTF-8 UText: may be slower, but definitely more convenient!
    StriContainerUTF8 str_cont(str, vectorize_length);
    StriContainerUTF8 cg_missing_cont(cg_missing, 1);
    STRI__PROTECT(cg_missing = STRING_ELT(cg_missing, 0));
@@ -87,7 +92,7 @@ SEXP stri__match_firstlast_regex(SEXP str, SEXP pattern, SEXP cg_missing, SEXP o
 
    if (LENGTH(str) == 0 && LENGTH(pattern) > 0) {
       // we need to determine the number of capture groups anyway
-      StriContainerRegexPattern pattern_cont(pattern, LENGTH(pattern), pattern_flags);
+      StriContainerRegexPattern pattern_cont(pattern, LENGTH(pattern), pattern_flags, pattern_prepared);
       for (R_len_t i = pattern_cont.vectorize_init();
            i != pattern_cont.vectorize_end();
            i = pattern_cont.vectorize_next(i))
@@ -105,7 +110,7 @@ SEXP stri__match_firstlast_regex(SEXP str, SEXP pattern, SEXP cg_missing, SEXP o
    }
    else
    {
-      StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags);
+      StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
       for (R_len_t i = pattern_cont.vectorize_init();
             i != pattern_cont.vectorize_end();
             i = pattern_cont.vectorize_next(i))
@@ -125,16 +130,25 @@ SEXP stri__match_firstlast_regex(SEXP str, SEXP pattern, SEXP cg_missing, SEXP o
             continue;
          }
 
-         str_text = utext_openUTF8(str_text, str_cont.get(i).c_str(), str_cont.get(i).length(), &status);
-         STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+         str_text.wrap(str_cont.get(i));
          const char* str_cur_s = str_cont.get(i).c_str();
 
          occurrences[i] = vector< pair<const char*, const char*> >(pattern_cur_groups+1);
-         matcher->reset(str_text);
-         while (1) {
-            int m_res = (int)matcher->find(status);
-            STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
-            if (!m_res) break;
+         int m_res;
+         if (first) {
+            m_res = (int)stri__regex_find_first_adaptive(matcher, str_text.get(),
+               str_cont.get(i).length(), status);
+         }
+         else {
+            matcher->reset(str_text.get());
+            m_res = (int)matcher->find(status);
+         }
+         STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+         // the matcher runs on a UTF-8 UText, so start()/end() are native
+         // byte offsets - group extents become pointers into str_cont's
+         // own payload and the CHARSXPs below are carved straight out of
+         // the original bytes, with no per-group UTF-16 round trip
+         while (m_res) {
             occurrences[i][0].first  = str_cur_s+(int)matcher->start(status);
             occurrences[i][0].second = str_cur_s+(int)matcher->end(status);
             for (R_len_t j=1; j<=pattern_cur_groups; ++j) {
@@ -152,15 +166,12 @@ SEXP stri__match_firstlast_regex(SEXP str, SEXP pattern, SEXP cg_missing, SEXP o
                }
             }
             if (first) break;
+            m_res = (int)matcher->find(status);
+            STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
          }
       }
    }
 
-   if (str_text) {
-      utext_close(str_text);
-      str_text = NULL;
-   }
-
    SEXP ret;
    STRI__PROTECT(ret = stri__matrix_NA_STRING(vectorize_length, occurrences_max));
    for (R_len_t i=0; i<vectorize_length; ++i) {
@@ -176,7 +187,7 @@ SEXP stri__match_firstlast_regex(SEXP str, SEXP pattern, SEXP cg_missing, SEXP o
    }
    STRI__UNPROTECT_ALL
    return ret;
-   STRI__ERROR_HANDLER_END(if (str_text) utext_close(str_text);)
+   STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
 }
 
 
@@ -242,27 +253,43 @@ SEXP stri_match_last_regex(SEXP str, SEXP pattern, SEXP cg_missing, SEXP opts_re
  *
  * @version 1.0-2 (Marek Gagolewski, 2016-01-29)
  *    Issue #214: allow a regex pattern like `.*`  to match an empty string
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    match extents for the whole call are accumulated in one arena
+ *    (a flat offset table over the UTF-8 payloads) and the R objects
+ *    are materialized in a single batched pass - this removes the
+ *    per-element deque churn and unclusters GC work
  */
 SEXP stri_match_all_regex(SEXP str, SEXP pattern, SEXP omit_no_match, SEXP cg_missing, SEXP opts_regex)
 {
    bool omit_no_match1 = stri__prepare_arg_logical_1_notNA(omit_no_match, "omit_no_match");
+   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
    PROTECT(str = stri_prepare_arg_string(str, "str")); // prepare string argument
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern")); // prepare string argument
+   const RegexPattern* pattern_prepared = NULL;
+   PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    PROTECT(cg_missing = stri_prepare_arg_string_1(cg_missing, "cg_missing"));
    R_len_t vectorize_length = stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
 
-   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
-
-   UText* str_text = NULL; // may potentially be slower, but definitely is more convenient!
    STRI__ERROR_HANDLER_BEGIN(3)
+   StriUText str_text; // UTF-8 UText: may be slower, but definitely more convenient!
    StriContainerUTF8 str_cont(str, vectorize_length);
-   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
    StriContainerUTF8 cg_missing_cont(cg_missing, 1);
    STRI__PROTECT(cg_missing = STRING_ELT(cg_missing, 0));
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(VECSXP, vectorize_length));
 
+   // pass 1 [matching only]: all the (start, end) byte extents for this
+   // call go to a single amortized-growth arena; the substrings
+   // themselves stay within the UTF-8 payloads owned by str_cont
+   vector<R_len_t> arena_bnd;           // 2*(groups+1) entries per match
+   vector<R_len_t> elem_noccurrences(vectorize_length, 0); // -1 == NA result
+   vector<R_len_t> elem_groups(vectorize_length, 0);
+   vector<size_t>  elem_offset(vectorize_length, 0); // into arena_bnd
+   // [the vectorized loop visits the elements in a pattern-major order,
+   // so each element must remember where its extents start]
+
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
@@ -270,39 +297,52 @@ SEXP stri_match_all_regex(SEXP str, SEXP pattern, SEXP omit_no_match, SEXP cg_mi
       if ((pattern_cont).isNA(i) || (pattern_cont).get(i).length() <= 0) {
          if (!(pattern_cont).isNA(i))
             Rf_warning(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
-         SET_VECTOR_ELT(ret, i, stri__matrix_NA_STRING(1, 1));
+         elem_noccurrences[i] = -1; // 1x1 NA matrix
          continue;
       }
 
       UErrorCode status = U_ZERO_ERROR;
       RegexMatcher *matcher = pattern_cont.getMatcher(i); // will be deleted automatically
       int pattern_cur_groups = matcher->groupCount();
+      elem_groups[i] = pattern_cur_groups;
 
       if ((str_cont).isNA(i)) {
-         SET_VECTOR_ELT(ret, i, stri__matrix_NA_STRING(1, pattern_cur_groups+1));
+         elem_noccurrences[i] = -1; // 1x(groups+1) NA matrix
          continue;
       }
 
-      str_text = utext_openUTF8(str_text, str_cont.get(i).c_str(), str_cont.get(i).length(), &status);
-      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      str_text.wrap(str_cont.get(i));
 
-      matcher->reset(str_text);
+      matcher->reset(str_text.get());
 
-      deque< pair<R_len_t, R_len_t> > occurrences;
+      elem_offset[i] = arena_bnd.size();
       while (1) {
          int m_res = (int)matcher->find(status);
          STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
          if (!m_res) break;
 
-         occurrences.push_back(pair<R_len_t, R_len_t>((R_len_t)matcher->start(status), (R_len_t)matcher->end(status)));
+         arena_bnd.push_back((R_len_t)matcher->start(status));
+         arena_bnd.push_back((R_len_t)matcher->end(status));
          STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
-         for (R_len_t j=0; j<pattern_cur_groups; ++j)
-            occurrences.push_back(pair<R_len_t, R_len_t>((R_len_t)matcher->start(j+1, status), (R_len_t)matcher->end(j+1, status)));
+         for (R_len_t j=0; j<pattern_cur_groups; ++j) {
+            arena_bnd.push_back((R_len_t)matcher->start(j+1, status));
+            arena_bnd.push_back((R_len_t)matcher->end(j+1, status));
+         }
          STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+         elem_noccurrences[i]++;
       }
+   }
 
-      R_len_t noccurrences = (R_len_t)occurrences.size()/(pattern_cur_groups+1);
-      if (noccurrences <= 0) {
+   // pass 2 [R allocation only]: materialize the matrices and CHARSXPs
+   // from the offset table in one batch
+   for (R_len_t i=0; i<vectorize_length; ++i) {
+      R_len_t noccurrences = elem_noccurrences[i];
+      R_len_t pattern_cur_groups = elem_groups[i];
+      if (noccurrences < 0) {
+         SET_VECTOR_ELT(ret, i, stri__matrix_NA_STRING(1, pattern_cur_groups+1));
+         continue;
+      }
+      else if (noccurrences == 0) {
          SET_VECTOR_ELT(ret, i, stri__matrix_NA_STRING(omit_no_match1?0:1, pattern_cur_groups+1));
          continue;
       }
@@ -310,29 +350,23 @@ SEXP stri_match_all_regex(SEXP str, SEXP pattern, SEXP omit_no_match, SEXP cg_mi
       const char* str_cur_s = str_cont.get(i).c_str();
       SEXP cur_res;
       STRI__PROTECT(cur_res = Rf_allocMatrix(STRSXP, noccurrences, pattern_cur_groups+1));
-      deque< pair<R_len_t, R_len_t> >::iterator iter = occurrences.begin();
-      for (R_len_t j = 0; iter != occurrences.end(); ++j) {
-         pair<R_len_t, R_len_t> curo = *iter;
-         SET_STRING_ELT(cur_res, j, Rf_mkCharLenCE(str_cur_s+curo.first, curo.second-curo.first, CE_UTF8));
-         ++iter;
-         for (R_len_t k = 0; iter != occurrences.end() && k < pattern_cur_groups; ++iter, ++k) {
-            curo = *iter;
-            if (curo.first < 0 || curo.second < 0)
-               SET_STRING_ELT(cur_res, j+(k+1)*noccurrences, cg_missing);
+      size_t arena_cur = elem_offset[i];
+      for (R_len_t j=0; j<noccurrences; ++j) {
+         for (R_len_t k=0; k<=pattern_cur_groups; ++k) {
+            R_len_t cur_start = arena_bnd[arena_cur++];
+            R_len_t cur_end   = arena_bnd[arena_cur++];
+            if (cur_start < 0 || cur_end < 0)
+               SET_STRING_ELT(cur_res, j+k*noccurrences, cg_missing);
             else
-               SET_STRING_ELT(cur_res, j+(k+1)*noccurrences,
-                  Rf_mkCharLenCE(str_cur_s+curo.first, curo.second-curo.first, CE_UTF8));
+               SET_STRING_ELT(cur_res, j+k*noccurrences,
+                  Rf_mkCharLenCE(str_cur_s+cur_start, cur_end-cur_start, CE_UTF8));
          }
       }
       SET_VECTOR_ELT(ret, i, cur_res);
       STRI__UNPROTECT(1);
    }
 
-   if (str_text) {
-      utext_close(str_text);
-      str_text = NULL;
-   }
    STRI__UNPROTECT_ALL
    return ret;
-   STRI__ERROR_HANDLER_END(if (str_text) utext_close(str_text);)
+   STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
 }
@@ -33,6 +33,10 @@
 #include "stri_stringi.h"
 #include "stri_container_utf16.h"
 #include "stri_container_regex.h"
+#include "stri_threads.h"
+#include "stri_interrupt.h"
+#include "stri_replace_estimator.h"
+#include <vector>
 
 
 /**
@@ -63,27 +67,203 @@
  *
  * @version 1.0-2 (Marek Gagolewski, 2016-01-30)
  *    Issue #210: Allow NA replacement
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    replace-all: record match extents first, then write the result
+ *    into a single preallocated buffer (no append-and-regrow)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    adaptive user-interrupt checkpoints, see stri_interrupt.h
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    replace-all runs in parallel for a single pattern when
+ *    options(stringi.num_threads=) asks for it; workers fill per-element
+ *    buffers, the main thread assembles the result in order
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    capture-group replacements pre-size their buffers from the
+ *    expansion ratios observed so far (StriReplaceSizeEstimator);
+ *    one output buffer is reused across the elements
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    the parallel path schedules weight-balanced chunks with work
+ *    stealing (stri__parallel_for_weighted), so a few very long
+ *    elements no longer serialize the whole call
  */
 SEXP stri__replace_allfirstlast_regex(SEXP str, SEXP pattern, SEXP replacement, SEXP opts_regex, int type)
 {
+   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
    PROTECT(replacement = stri_prepare_arg_string(replacement, "replacement"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
-   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
+   const RegexPattern* pattern_prepared = NULL;
+   PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
 
    STRI__ERROR_HANDLER_BEGIN(3)
    R_len_t vectorize_length = stri__recycling_rule(true, 3, LENGTH(str), LENGTH(pattern), LENGTH(replacement));
    StriContainerUTF16 str_cont(str, vectorize_length, false); // writable
-   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
    StriContainerUTF16 replacement_cont(replacement, vectorize_length);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
 
+#ifdef STRI_HAVE_THREADS
+   int num_threads = stri__threads_requested(vectorize_length);
+   if (type == 0 && num_threads > 1 && pattern_cont.get_n() == 1
+         && !pattern_cont.isNA(0) && pattern_cont.get(0).length() > 0) {
+      // single pattern - partition the element range; replacement is
+      // per-element independent, so workers may compute the replaced
+      // strings concurrently (one matcher clone each; clones must be
+      // created here, on the main R thread) into per-element buffers,
+      // and the STRSXP is then assembled in order, serially, below
+      std::vector<RegexMatcher*> matchers(num_threads, (RegexMatcher*)NULL);
+      try {
+         for (int t=0; t<num_threads; ++t)
+            matchers[t] = pattern_cont.cloneMatcher(0);
+      }
+      catch (...) {
+         for (int t=0; t<num_threads; ++t)
+            if (matchers[t]) delete matchers[t];
+         throw;
+      }
+
+      str_cont.materializeAll();         // lazy conversion is not
+      replacement_cont.materializeAll(); // thread-safe
+
+      std::vector<UnicodeString> out_buf((size_t)vectorize_length);
+      // 0 - replaced, in out_buf; 1 - NA; 2 - input passes through
+      std::vector<signed char> out_state((size_t)vectorize_length, (signed char)0);
+
+      // element lengths drive the chunking: one giant document must
+      // not serialize the call, so the scheduler isolates it in its
+      // own chunk and the other threads steal the remaining ranges
+      std::vector<R_len_t> sizes((size_t)vectorize_length);
+      for (R_len_t i=0; i<vectorize_length; ++i)
+         sizes[i] = str_cont.isNA(i) ? 0 : str_cont.get(i).length();
+
+      // workers shall not touch R nor throw; errors are collected
+      // here and rethrown on the main thread, post join
+      std::vector<UErrorCode> statuses(num_threads, U_ZERO_ERROR);
+      std::vector< std::vector<int32_t> > match_bnds(num_threads); // per-thread scratch
+      try {
+      stri__parallel_for_weighted(vectorize_length, num_threads, sizes.data(),
+         [&str_cont, &replacement_cont, &out_buf, &out_state,
+               &matchers, &statuses, &match_bnds]
+               (R_len_t chunk_from, R_len_t chunk_to, int t) {
+               RegexMatcher* matcher = matchers[t];
+               UErrorCode* cur_status = &(statuses[t]);
+               if (U_FAILURE(*cur_status)) return; // failed earlier - bail out
+               std::vector<int32_t>& match_bnd = match_bnds[t]; // reused between chunks
+               for (R_len_t i=chunk_from; i<chunk_to; ++i) {
+                  if (str_cont.isNA(i)) {
+                     out_state[i] = 1;
+                     continue;
+                  }
+                  const UnicodeString& cur_str = str_cont.get(i);
+                  matcher->reset(cur_str);
+                  if (replacement_cont.isNA(i)) {
+                     // NA replacement: any match poisons the element
+                     out_state[i] = matcher->find(*cur_status) ? 1 : 2;
+                     if (U_FAILURE(*cur_status)) return;
+                     continue;
+                  }
+
+                  // pass 1: record the extents of all the matches,
+                  // exactly like in the serial loop below
+                  match_bnd.clear();
+                  R_len_t matched_length = 0;
+                  while (1) {
+                     if (!matcher->find(*cur_status)) break;
+                     int m_start = matcher->start(*cur_status);
+                     int m_end = matcher->end(*cur_status);
+                     if (U_FAILURE(*cur_status)) return;
+                     match_bnd.push_back(m_start);
+                     match_bnd.push_back(m_end);
+                     matched_length += m_end-m_start;
+                  }
+                  if (U_FAILURE(*cur_status)) return;
+
+                  R_len_t match_count = (R_len_t)(match_bnd.size()/2);
+                  if (match_count == 0) {
+                     out_state[i] = 2; // pass the input through unchanged
+                     continue;
+                  }
+
+                  const UnicodeString& cur_replacement = replacement_cont.get(i);
+                  bool replacement_literal = true;
+                  for (R_len_t j=0; j<cur_replacement.length(); ++j) {
+                     UChar c = cur_replacement.charAt(j);
+                     if (c == (UChar)'$' || c == (UChar)'\\') {
+                        replacement_literal = false;
+                        break;
+                     }
+                  }
+
+                  UnicodeString& out = out_buf[i];
+                  out.getBuffer(cur_str.length() - matched_length
+                     + match_count*cur_replacement.length());
+                  out.releaseBuffer(0); // preallocate
+                  if (replacement_literal) {
+                     R_len_t last = 0;
+                     for (R_len_t k=0; k<match_count; ++k) {
+                        out.append(cur_str, last, match_bnd[2*k]-last);
+                        out.append(cur_replacement);
+                        last = match_bnd[2*k+1];
+                     }
+                     out.append(cur_str, last, cur_str.length()-last);
+                  }
+                  else {
+                     // capture group references: re-run the matcher
+                     // for appendReplacement's expansion
+                     matcher->reset();
+                     while (1) {
+                        if (!matcher->find(*cur_status)) break;
+                        matcher->appendReplacement(out, cur_replacement, *cur_status);
+                        if (U_FAILURE(*cur_status)) return;
+                     }
+                     if (U_FAILURE(*cur_status)) return;
+                     matcher->appendTail(out);
+                  }
+               }
+            });
+      }
+      catch (...) {
+         for (int t=0; t<num_threads; ++t) delete matchers[t];
+         throw;
+      }
+
+      for (int t=0; t<num_threads; ++t) delete matchers[t];
+      for (int t=0; t<num_threads; ++t)
+         STRI__CHECKICUSTATUS_THROW(statuses[t], {/* nothing on err */})
+
+      // ordered assembly - the only part that touches the R API
+      for (R_len_t i=0; i<vectorize_length; ++i) {
+         if (out_state[i] == 1)
+            SET_STRING_ELT(ret, i, NA_STRING);
+         else if (out_state[i] == 2)
+            SET_STRING_ELT(ret, i, str_cont.toR(i));
+         else {
+            str_cont.set(i, out_buf[i]);
+            SET_STRING_ELT(ret, i, str_cont.toR(i));
+         }
+      }
+
+      STRI__UNPROTECT_ALL
+      return ret;
+   }
+#endif
+
+   std::vector<int32_t> match_bnd; // (start, end) extents, reused between iterations
+   UnicodeString out; // output buffer, reused between iterations (grow-only)
+   StriReplaceSizeEstimator estimator; // sizes `out` for the expansion paths
+
+   StriInterruptCheckpoint checkpoint;
    for (R_len_t i = pattern_cont.vectorize_init();
          i != pattern_cont.vectorize_end();
          i = pattern_cont.vectorize_next(i))
    {
+      checkpoint.touch();
+
       STRI__CONTINUE_ON_EMPTY_OR_NA_PATTERN(str_cont, pattern_cont,
          SET_STRING_ELT(ret, i, NA_STRING);)
 
@@ -101,8 +281,83 @@ SEXP stri__replace_allfirstlast_regex(SEXP str, SEXP pattern, SEXP replacement,
       }
 
       if (type == 0) { // all
-         str_cont.set(i, matcher->replaceAll(replacement_cont.get(i), status));
-         STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+         // pass 1: record the extents of all the matches;
+         // this gives us the exact (or, with capture-group references,
+         // a tight) output length, so that pass 2 writes into a buffer
+         // allocated exactly once
+         match_bnd.clear();
+         R_len_t matched_length = 0;
+         while (1) {
+            int m_res = matcher->find(status);
+            STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+            if (!m_res) break;
+            int m_start = matcher->start(status);
+            STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+            int m_end = matcher->end(status);
+            STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+            match_bnd.push_back(m_start);
+            match_bnd.push_back(m_end);
+            matched_length += m_end-m_start;
+         }
+
+         R_len_t match_count = (R_len_t)(match_bnd.size()/2);
+         if (match_count == 0) {
+            // nothing to replace - pass the input through unchanged
+            SET_STRING_ELT(ret, i, str_cont.toR(i));
+            continue;
+         }
+
+         const UnicodeString& cur_str = str_cont.get(i);
+         const UnicodeString& cur_replacement = replacement_cont.get(i);
+
+         // `$` (capture group reference) and `\` (escape) make the
+         // expanded length of a single replacement match-dependent
+         bool replacement_literal = true;
+         for (R_len_t j=0; j<cur_replacement.length(); ++j) {
+            UChar c = cur_replacement.charAt(j);
+            if (c == (UChar)'$' || c == (UChar)'\\') {
+               replacement_literal = false;
+               break;
+            }
+         }
+
+         if (replacement_literal) {
+            // exact output length known upfront
+            R_len_t out_length = cur_str.length() - matched_length
+               + match_count*cur_replacement.length();
+            out.remove();
+            out.getBuffer(out_length); out.releaseBuffer(0); // preallocate
+            R_len_t last = 0;
+            for (R_len_t k=0; k<match_count; ++k) {
+               out.append(cur_str, last, match_bnd[2*k]-last);
+               out.append(cur_replacement);
+               last = match_bnd[2*k+1];
+            }
+            out.append(cur_str, last, cur_str.length()-last);
+            str_cont.set(i, out);
+         }
+         else {
+            // capture group references: re-run the matcher for
+            // appendReplacement's expansion; the base heuristic from
+            // the pass-1 match count cannot see how far the groups
+            // expand, so scale it by the ratios observed so far
+            R_len_t out_estimate = cur_str.length() - matched_length
+               + match_count*cur_replacement.length();
+            out.remove();
+            out.getBuffer(estimator.presize(out_estimate));
+            out.releaseBuffer(0); // preallocate
+            matcher->reset();
+            while (1) {
+               int m_res = matcher->find(status);
+               STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+               if (!m_res) break;
+               matcher->appendReplacement(out, cur_replacement, status);
+               STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+            }
+            matcher->appendTail(out);
+            estimator.observe(out_estimate, out.length());
+            str_cont.set(i, out);
+         }
       }
       else if (type == 1) { // first
          str_cont.set(i, matcher->replaceFirst(replacement_cont.get(i), status));
@@ -123,7 +378,7 @@ SEXP stri__replace_allfirstlast_regex(SEXP str, SEXP pattern, SEXP replacement,
          if (start >= 0) {
             matcher->find(start, status); // go back
             STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
-            UnicodeString out;
+            out.remove();
             matcher->appendReplacement(out, replacement_cont.get(i), status);
             STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
             out.append(str_cont.get(i), end, str_cont.get(i).length()-end);
@@ -165,6 +420,12 @@ SEXP stri__replace_allfirstlast_regex(SEXP str, SEXP pattern, SEXP replacement,
  */
 SEXP stri__replace_all_regex_no_vectorize_all(SEXP str, SEXP pattern, SEXP replacement, SEXP opts_regex)
 { // version beta
+   if (stri__is_regex_pattern(pattern)) {
+      // a precompiled handle holds a single pattern - the vectorized
+      // path handles it directly
+      return stri__replace_allfirstlast_regex(str, pattern, replacement, opts_regex, 0);
+   }
+
    PROTECT(str          = stri_prepare_arg_string(str, "str"));
 
    // if str_n is 0, then return an empty vector
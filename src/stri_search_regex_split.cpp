@@ -35,6 +35,7 @@
 #include "stri_container_integer.h"
 #include "stri_container_logical.h"
 #include "stri_container_regex.h"
+#include "stri_utext.h"
 #include <deque>
 #include <utility>
 using namespace std;
@@ -82,22 +83,22 @@ SEXP stri_split_regex(SEXP str, SEXP pattern, SEXP n, SEXP omit_empty,
                       SEXP tokens_only, SEXP simplify, SEXP opts_regex)
 {
    bool tokens_only1 = stri__prepare_arg_logical_1_notNA(tokens_only, "tokens_only");
+   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   const RegexPattern* pattern_prepared = NULL;
+   PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    PROTECT(n = stri_prepare_arg_integer(n, "n"));
    PROTECT(omit_empty = stri_prepare_arg_logical(omit_empty, "omit_empty"));
    PROTECT(simplify = stri_prepare_arg_logical_1(simplify, "simplify"));
    R_len_t vectorize_length = stri__recycling_rule(true, 4,
       LENGTH(str), LENGTH(pattern), LENGTH(n), LENGTH(omit_empty));
 
-   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
-
-   UText* str_text = NULL; // may potentially be slower, but definitely is more convenient!
    STRI__ERROR_HANDLER_BEGIN(5)
+   StriUText str_text; // UTF-8 UText: may be slower, but definitely more convenient!
    StriContainerUTF8      str_cont(str, vectorize_length);
    StriContainerInteger   n_cont(n, vectorize_length);
    StriContainerLogical   omit_empty_cont(omit_empty, vectorize_length);
-   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(VECSXP, vectorize_length));
@@ -136,16 +137,18 @@ SEXP stri_split_regex(SEXP str, SEXP pattern, SEXP n, SEXP omit_empty,
 
       UErrorCode status = U_ZERO_ERROR;
       RegexMatcher *matcher = pattern_cont.getMatcher(i); // will be deleted automatically
-      str_text = utext_openUTF8(str_text, str_cont.get(i).c_str(), str_cont.get(i).length(), &status);
-      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      str_text.wrap(str_cont.get(i));
 
-      matcher->reset(str_text);
+      matcher->reset(str_text.get());
 
 
       R_len_t k;
       deque< pair<R_len_t, R_len_t> > fields; // byte based-indices
       fields.push_back(pair<R_len_t, R_len_t>(0,0));
 
+      // the loop condition guarantees a hard early exit: once n-1
+      // fields are delimited the remainder becomes the last piece and
+      // the matcher never touches the rest of the haystack
       for (k=1; k < n_cur; ) {
          int m_res = (int)matcher->find(status);
          STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
@@ -191,11 +194,6 @@ SEXP stri_split_regex(SEXP str, SEXP pattern, SEXP n, SEXP omit_empty,
       STRI__UNPROTECT(1);
    }
 
-   if (str_text) {
-      utext_close(str_text);
-      str_text = NULL;
-   }
-
    if (LOGICAL(simplify)[0] == NA_LOGICAL || LOGICAL(simplify)[0]) {
       R_len_t n_min = 0;
       R_len_t n_length = LENGTH(n);
@@ -217,10 +215,5 @@ SEXP stri_split_regex(SEXP str, SEXP pattern, SEXP n, SEXP omit_empty,
 
    STRI__UNPROTECT_ALL
    return ret;
-   STRI__ERROR_HANDLER_END({
-      if (str_text) {
-         utext_close(str_text);
-         str_text = NULL;
-      }
-   })
+   STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
 }
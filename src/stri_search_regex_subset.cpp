@@ -33,6 +33,7 @@
 #include "stri_container_utf16.h"
 #include "stri_container_utf8.h"
 #include "stri_container_regex.h"
+#include "stri_utext.h"
 
 
 /**
@@ -60,21 +61,71 @@
  *
  * @version 1.0-3 (Marek Gagolewski, 2016-02-03)
  *    FR #216: `negate` arg added
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    single pattern: one-pass subsetting via an amortized-growth index
+ *    vector, no full logical buffer over the input
  */
 SEXP stri_subset_regex(SEXP str, SEXP pattern, SEXP omit_na, SEXP negate, SEXP opts_regex)
 {
    bool negate_1 = stri__prepare_arg_logical_1_notNA(negate, "negate");
    bool omit_na1 = stri__prepare_arg_logical_1_notNA(omit_na, "omit_na");
+   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string(pattern, "pattern"));
+   const RegexPattern* pattern_prepared = NULL;
+   PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
    R_len_t vectorize_length =
       stri__recycling_rule(true, 2, LENGTH(str), LENGTH(pattern));
 
-   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
-
    STRI__ERROR_HANDLER_BEGIN(2)
    StriContainerUTF16 str_cont(str, vectorize_length);
-   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
+
+   if (pattern_cont.get_n() == 1) {
+      // with a single pattern the vectorized loop visits the elements
+      // in their natural order, so the kept indices can be gathered
+      // in one pass into a grow-as-needed vector - each element is
+      // matched exactly once and no length-of-input buffer is needed
+      std::vector<R_len_t> which_idx;
+      std::vector<char> which_na; // parallel to which_idx
+
+      for (R_len_t i = pattern_cont.vectorize_init();
+            i != pattern_cont.vectorize_end();
+            i = pattern_cont.vectorize_next(i))
+      {
+         if (str_cont.isNA(i) || pattern_cont.isNA(i)
+               || pattern_cont.get(i).length() <= 0) {
+            if (!omit_na1) {
+               which_idx.push_back(i);
+               which_na.push_back(1);
+            }
+            continue;
+         }
+
+         RegexMatcher *matcher = pattern_cont.getMatcher(i); // will be deleted automatically
+         matcher->reset(str_cont.get(i));
+         UErrorCode status = U_ZERO_ERROR;
+         int found = (int)matcher->find(status);
+         STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+         if (negate_1) found = !found;
+         if (found) {
+            which_idx.push_back(i);
+            which_na.push_back(0);
+         }
+      }
+
+      SEXP ret;
+      R_len_t result_length = (R_len_t)which_idx.size();
+      STRI__PROTECT(ret = Rf_allocVector(STRSXP, result_length));
+      for (R_len_t j=0; j<result_length; ++j) {
+         if (which_na[j])
+            SET_STRING_ELT(ret, j, NA_STRING);
+         else
+            SET_STRING_ELT(ret, j, str_cont.toR(which_idx[j]));
+      }
+      STRI__UNPROTECT_ALL
+      return ret;
+   }
 
    // BT: this cannot be done with deque, because pattern is reused so i does not
    // go like 0,1,2...n but 0,pat_len,2*pat_len,1,pat_len+1 and so on
@@ -124,8 +175,13 @@ SEXP stri_subset_regex(SEXP str, SEXP pattern, SEXP omit_na, SEXP negate, SEXP o
 SEXP stri_subset_regex_replacement(SEXP str, SEXP pattern, SEXP negate, SEXP opts_regex, SEXP value)
 {
    bool negate_1 = stri__prepare_arg_logical_1_notNA(negate, "negate");
+   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
    PROTECT(str = stri_prepare_arg_string(str, "str"));
-   PROTECT(pattern = stri_prepare_arg_string_1(pattern, "pattern"));
+   const RegexPattern* pattern_prepared = NULL;
+   if (stri__is_regex_pattern(pattern))
+      PROTECT(pattern = stri__regex_pattern_unwrap(pattern, pattern_flags, pattern_prepared));
+   else
+      PROTECT(pattern = stri_prepare_arg_string_1(pattern, "pattern"));
    PROTECT(value = stri_prepare_arg_string(value, "value"));
 
    int vectorize_length = LENGTH(str);
@@ -133,13 +189,11 @@ SEXP stri_subset_regex_replacement(SEXP str, SEXP pattern, SEXP negate, SEXP opt
    if (value_length == 0)
       Rf_error(MSG__REPLACEMENT_ZERO);
 
-   uint32_t pattern_flags = StriContainerRegexPattern::getRegexFlags(opts_regex);
-   UText* str_text = NULL; // may potentially be slower, but definitely is more convenient!
-
    STRI__ERROR_HANDLER_BEGIN(3)
+   StriUText str_text; // UTF-8 UText: may be slower, but definitely more convenient!
    StriContainerUTF8 str_cont(str, vectorize_length);
    StriContainerUTF8 value_cont(value, value_length);
-   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags);
+   StriContainerRegexPattern pattern_cont(pattern, vectorize_length, pattern_flags, pattern_prepared);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
@@ -154,9 +208,8 @@ SEXP stri_subset_regex_replacement(SEXP str, SEXP pattern, SEXP negate, SEXP opt
 
       UErrorCode status = U_ZERO_ERROR;
       RegexMatcher *matcher = pattern_cont.getMatcher(i); // will be deleted automatically
-      str_text = utext_openUTF8(str_text, str_cont.get(i).c_str(), str_cont.get(i).length(), &status);
-      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
-      matcher->reset(str_text);
+      str_text.wrap(str_cont.get(i));
+      matcher->reset(str_text.get());
 
       bool found = matcher->find(status);
       STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
@@ -166,17 +219,7 @@ SEXP stri_subset_regex_replacement(SEXP str, SEXP pattern, SEXP negate, SEXP opt
          SET_STRING_ELT(ret, i, str_cont.toR(i));
    }
 
-   if (str_text) {
-      utext_close(str_text);
-      str_text = NULL;
-   }
-
    STRI__UNPROTECT_ALL
    return ret;
-   STRI__ERROR_HANDLER_END({
-      if (str_text) {
-         utext_close(str_text);
-         str_text = NULL;
-      }
-   })
+   STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
 }
@@ -0,0 +1,190 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_files.h"
+#include "stri_interrupt.h"
+#include <cstdio>
+#include <climits>
+#include <stdint.h>
+
+/* The stringi string dump, version 1:
+ *
+ *    bytes  0.. 7   magic "STRIBIN1"
+ *    bytes  8..15   uint64, number of elements
+ *    bytes 16..23   uint64, payload size [bytes]
+ *    then           int32 per element: byte length, or -1 for NA
+ *    then           the non-NA elements' UTF-8 bytes, concatenated
+ *
+ * Integers are native-endian: the dump is a same-machine cache format,
+ * not an interchange one (R's own serialization covers that case).
+ * The length table doubles as the offset table - offsets are its
+ * prefix sums, so the payload needs no per-element framing at all.
+ */
+#define STRI__DUMP_MAGIC "STRIBIN1"
+#define STRI__DUMP_HEADER_SIZE 24
+
+
+/**
+ * Dump a character vector to a stringi-native binary file
+ *
+ * See stri_save_strings in R. The elements are validated and
+ * re-encoded to UTF-8 once (via the usual container) and streamed out
+ * through a 1 MiB stdio buffer: header, length table, then the raw
+ * payload with no escaping or per-element framing.
+ *
+ * @param str character vector
+ * @param fname single string, file path
+ * @return R_NilValue
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_save_strings(SEXP str, SEXP fname)
+{
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+   const char* fname_s = stri__prepare_arg_string_1_notNA(fname, "fname");
+   R_len_t n = LENGTH(str);
+
+   FILE* out = NULL;
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriContainerUTF8 str_cont(str, n);
+
+   uint64_t payload = 0;
+   for (R_len_t i=0; i<n; ++i)
+      if (!str_cont.isNA(i))
+         payload += (uint64_t)str_cont.get(i).length();
+
+   out = fopen(fname_s, "wb");
+   if (!out) throw StriException(MSG__FILE_WRITE_ERROR, fname_s);
+   setvbuf(out, NULL, _IOFBF, 1<<20); // gather the small strings into 1 MiB writes
+
+   uint64_t n64 = (uint64_t)n;
+   if (fwrite(STRI__DUMP_MAGIC, 1, 8, out) != 8
+         || fwrite(&n64, 1, 8, out) != 8
+         || fwrite(&payload, 1, 8, out) != 8)
+      throw StriException(MSG__FILE_WRITE_ERROR, fname_s);
+
+   StriInterruptCheckpoint checkpoint;
+   for (R_len_t i=0; i<n; ++i) {
+      checkpoint.touch();
+      int32_t len = str_cont.isNA(i)?-1:(int32_t)str_cont.get(i).length();
+      if (fwrite(&len, 1, 4, out) != 4)
+         throw StriException(MSG__FILE_WRITE_ERROR, fname_s);
+   }
+   for (R_len_t i=0; i<n; ++i) {
+      checkpoint.touch();
+      if (str_cont.isNA(i)) continue;
+      size_t len = (size_t)str_cont.get(i).length();
+      if (len > 0 && fwrite(str_cont.get(i).c_str(), 1, len, out) != len)
+         throw StriException(MSG__FILE_WRITE_ERROR, fname_s);
+   }
+
+   if (fclose(out) != 0) {
+      out = NULL;
+      throw StriException(MSG__FILE_WRITE_ERROR, fname_s);
+   }
+   out = NULL;
+
+   STRI__UNPROTECT_ALL
+   return R_NilValue;
+   STRI__ERROR_HANDLER_END({
+      if (out) fclose(out);
+   })
+}
+
+
+/**
+ * Reconstruct a character vector from a stringi string dump
+ *
+ * See stri_load_strings in R. The file is mapped (one "read"), the
+ * header and length table are checked against the file size, and the
+ * elements are materialized straight from the mapped payload - the
+ * only per-element work is a UTF-8 validity sweep and the CHARSXP
+ * intern itself.
+ *
+ * @param fname single string, file path
+ * @return character vector (UTF-8)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_load_strings(SEXP fname)
+{
+   const char* fname_s = stri__prepare_arg_string_1_notNA(fname, "fname");
+
+   StriMappedFile file;
+   if (!file.open(fname_s))
+      Rf_error(MSG__FILE_READ_ERROR, fname_s);
+
+   STRI__ERROR_HANDLER_BEGIN(0)
+   if (file.size < STRI__DUMP_HEADER_SIZE
+         || memcmp(file.data, STRI__DUMP_MAGIC, 8) != 0)
+      throw StriException(MSG__SERIALIZED_FORMAT_ERROR, fname_s);
+
+   uint64_t n64, payload;
+   memcpy(&n64, file.data+8, 8);
+   memcpy(&payload, file.data+16, 8);
+   if (n64 > (uint64_t)INT_MAX)
+      throw StriException(MSG__SERIALIZED_FORMAT_ERROR, fname_s);
+   R_len_t n = (R_len_t)n64;
+   if ((uint64_t)file.size != STRI__DUMP_HEADER_SIZE+4*n64+payload)
+      throw StriException(MSG__SERIALIZED_FORMAT_ERROR, fname_s);
+
+   // the table starts 24 bytes into a page-aligned mapping - aligned
+   const int32_t* lengths = (const int32_t*)(file.data+STRI__DUMP_HEADER_SIZE);
+   const char* base = file.data+STRI__DUMP_HEADER_SIZE+4*n64;
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(STRSXP, n));
+   uint64_t off = 0;
+   StriInterruptCheckpoint checkpoint;
+   for (R_len_t i=0; i<n; ++i) {
+      checkpoint.touch();
+      int32_t len = lengths[i];
+      if (len < 0) {
+         SET_STRING_ELT(ret, i, NA_STRING);
+         continue;
+      }
+      if ((uint64_t)len > payload-off)
+         throw StriException(MSG__SERIALIZED_FORMAT_ERROR, fname_s);
+      if (len > 0 && stri__enc_check_utf8(base+off, (R_len_t)len, false) < 1.0)
+         throw StriException(MSG__INVALID_UTF8);
+      SET_STRING_ELT(ret, i, Rf_mkCharLenCE(base+off, (R_len_t)len, CE_UTF8));
+      off += (uint64_t)len;
+   }
+   if (off != payload) // trailing bytes no element claims
+      throw StriException(MSG__SERIALIZED_FORMAT_ERROR, fname_s);
+
+   file.close();
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({ file.close(); })
+}
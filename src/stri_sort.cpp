@@ -33,11 +33,40 @@
 #include "stri_stringi.h"
 #include "stri_container_utf8.h"
 #include "stri_container_utf16.h"
+#include "stri_threads.h"
+#include "stri_hashset.h"
 #include <unicode/ucol.h>
+#include <unicode/uiter.h>
+#include <unicode/uset.h>
+#include <unicode/uniset.h>
 #include <vector>
 #include <deque>
+#include <queue>
 #include <algorithm>
-#include <set>
+#include <cstring>
+#include <cstdio>
+
+
+// vectors at least this long are ordered via precomputed sort keys;
+// below, pairwise ucol_strcollUTF8 wins (no key materialization cost)
+#define STRI__SORT_SORTKEY_THRESHOLD 128
+
+// MSD radix sort switches to comparison sort on ranges this small
+#define STRI__SORT_RADIX_CUTOFF 32
+
+// minimal per-thread partition when ordering a long vector with several
+// threads; see options(stringi.num_threads=...)
+#define STRI__SORT_PARALLEL_MIN_CHUNK 65536
+
+// how many collation key bytes are materialized eagerly per element when
+// sorting; most comparisons are decided well within this prefix, and the
+// rare elements that remain tied fall back to their full keys
+#define STRI__SORT_KEY_PREFIX 32
+
+// numeric collation over all-ASCII vectors at least this long goes
+// through the specialized natural-order comparator; below, building its
+// per-character weight tables costs more than the collations it saves
+#define STRI__SORT_NATURAL_THRESHOLD 64
 
 
 /** help struct for stri_order **/
@@ -70,6 +99,729 @@ struct StriSortComparer {
 };
 
 
+/** per-ASCII-character collation weights for the natural-order fast
+ *  path; digit runs are special-cased by the comparator and never use
+ *  prim[] of the individual digits */
+struct StriNaturalWeights {
+   uint16_t prim[128];  ///< rank of the primary-level key
+   uint16_t full[128];  ///< rank of the complete key (case etc. included)
+   bool ign[128];       ///< completely ignorable, e.g. most controls
+};
+
+
+/** Can `col` be replaced by the ASCII natural-order comparator? [internal]
+ *
+ * True only when numeric collation was requested, punctuation stays on
+ * the primary level (alternate_shifted=FALSE, the default), the strength
+ * involves no identical-level tie-breaking, the locale tailors nothing
+ * below U+0080, and every non-NA element is pure ASCII. Under these
+ * conditions each ASCII character maps to exactly one collation element
+ * (the root rules have no ASCII contractions or expansions), so
+ * per-character weights plus numeric digit runs reproduce ucol_strcoll
+ * exactly -- see stri__natural_cmp().
+ *
+ * @param col collator, may be NULL
+ * @param str_cont input strings
+ * @param order indices of the non-NA elements
+ * @return true if the fast path gives the same ordering as `col`
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static bool stri__natural_sort_eligible(UCollator* col,
+   StriContainerUTF8& str_cont, const std::vector<int>& order)
+{
+   if (!col) return false;
+
+   UErrorCode status = U_ZERO_ERROR;
+   if (ucol_getAttribute(col, UCOL_NUMERIC_COLLATION, &status) != UCOL_ON)
+      return false;
+   if (ucol_getAttribute(col, UCOL_ALTERNATE_HANDLING, &status) != UCOL_NON_IGNORABLE)
+      return false;
+   if (ucol_getAttribute(col, UCOL_STRENGTH, &status) > UCOL_TERTIARY)
+      return false;
+   if (U_FAILURE(status)) return false;
+
+   USet* tailored = ucol_getTailoredSet(col, &status);
+   if (U_FAILURE(status) || !tailored) {
+      if (tailored) uset_close(tailored);
+      return false;
+   }
+   bool ascii_tailored =
+      UnicodeSet::fromUSet(tailored)->containsSome((UChar32)0x0000, (UChar32)0x007f);
+   uset_close(tailored);
+   if (ascii_tailored) return false;
+
+   for (size_t j=0; j<order.size(); ++j)
+      if (!str_cont.get(order[j]).isASCII()) return false;
+
+   return true;
+}
+
+
+/** Derive the per-ASCII-character weight tables from a collator [internal]
+ *
+ * Each character's sort key is fetched once; its primary level (the
+ * bytes before the first 0x01 level separator) and the complete key are
+ * ranked separately. This way non-default settings the fast path does
+ * admit (strength, uppercase_first, ...) are baked into the tables
+ * instead of being hard-coded.
+ *
+ * @param col collator accepted by stri__natural_sort_eligible()
+ * @param w [out] weight tables
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__natural_sort_weights(UCollator* col, StriNaturalWeights& w)
+{
+   std::string prim_key[128];
+   std::string full_key[128];
+   uint8_t buf[256];
+
+   for (int c=1; c<128; ++c) {
+      UChar u = (UChar)c;
+      int32_t n = ucol_getSortKey(col, &u, 1, buf, 256);
+      if (n <= 0 || n > 256)
+         throw StriException(MSG__INTERNAL_ERROR);
+      int32_t p = 0;
+      while (p < n && buf[p] != 0x01 && buf[p] != 0x00) ++p;
+      prim_key[c].assign((const char*)buf, (size_t)p);
+      full_key[c].assign((const char*)buf, (size_t)n);
+      w.ign[c] = (p == 0);
+   }
+   w.ign[0] = true; // NUL never occurs in R strings
+
+   std::vector<std::string> uniq(prim_key+1, prim_key+128);
+   std::sort(uniq.begin(), uniq.end());
+   uniq.erase(std::unique(uniq.begin(), uniq.end()), uniq.end());
+   w.prim[0] = 0;
+   for (int c=1; c<128; ++c)
+      w.prim[c] = (uint16_t)(std::lower_bound(uniq.begin(), uniq.end(),
+         prim_key[c]) - uniq.begin());
+
+   uniq.assign(full_key+1, full_key+128);
+   std::sort(uniq.begin(), uniq.end());
+   uniq.erase(std::unique(uniq.begin(), uniq.end()), uniq.end());
+   w.full[0] = 0;
+   for (int c=1; c<128; ++c)
+      w.full[c] = (uint16_t)(std::lower_bound(uniq.begin(), uniq.end(),
+         full_key[c]) - uniq.begin());
+}
+
+
+/** Natural-order ("version sort") comparison of two ASCII strings [internal]
+ *
+ * The primary level compares maximal digit runs by numeric value
+ * (leading zeros carry no weight, exactly as under UCOL_NUMERIC_COLLATION)
+ * and everything else by its primary weight. Only when the primary
+ * levels tie -- at which point the non-digit characters of both strings
+ * align pairwise -- are case and other sub-primary differences settled,
+ * per character; ASCII has no secondary weights that could reorder this.
+ *
+ * @return negative, zero or positive, like ucol_strcoll
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static int stri__natural_cmp(const char* s1, R_len_t n1,
+   const char* s2, R_len_t n2, const StriNaturalWeights& w)
+{
+   R_len_t i1 = 0, i2 = 0;
+   while (true) {
+      while (i1 < n1 && w.ign[(uint8_t)s1[i1]]) ++i1;
+      while (i2 < n2 && w.ign[(uint8_t)s2[i2]]) ++i2;
+      if (i1 >= n1 || i2 >= n2) break;
+
+      uint8_t c1 = (uint8_t)s1[i1], c2 = (uint8_t)s2[i2];
+      bool d1 = (c1 >= '0' && c1 <= '9');
+      bool d2 = (c2 >= '0' && c2 <= '9');
+      if (d1 && d2) {
+         while (i1 < n1 && s1[i1] == '0') ++i1;
+         while (i2 < n2 && s2[i2] == '0') ++i2;
+         R_len_t b1 = i1, b2 = i2;
+         while (i1 < n1 && s1[i1] >= '0' && s1[i1] <= '9') ++i1;
+         while (i2 < n2 && s2[i2] >= '0' && s2[i2] <= '9') ++i2;
+         if (i1-b1 != i2-b2) return (i1-b1 < i2-b2)?-1:1;
+         int r = std::memcmp(s1+b1, s2+b2, (size_t)(i1-b1));
+         if (r) return (r < 0)?-1:1;
+         // equal values ("007" vs "7") remain tied, like the collator
+      }
+      else {
+         // a digit run weighs in where its digits would
+         uint16_t w1 = d1 ? w.prim[(uint8_t)'0'] : w.prim[c1];
+         uint16_t w2 = d2 ? w.prim[(uint8_t)'0'] : w.prim[c2];
+         if (w1 != w2) return (w1 < w2)?-1:1;
+         ++i1; ++i2;
+      }
+   }
+   if (i1 < n1) return  1; // s2 is a proper prefix of s1 (primary-wise)
+   if (i2 < n2) return -1;
+
+   i1 = 0; i2 = 0;
+   while (true) {
+      while (i1 < n1 && (w.ign[(uint8_t)s1[i1]]
+            || (s1[i1] >= '0' && s1[i1] <= '9'))) ++i1;
+      while (i2 < n2 && (w.ign[(uint8_t)s2[i2]]
+            || (s2[i2] >= '0' && s2[i2] <= '9'))) ++i2;
+      if (i1 >= n1 || i2 >= n2) break;
+      uint16_t w1 = w.full[(uint8_t)s1[i1]];
+      uint16_t w2 = w.full[(uint8_t)s2[i2]];
+      if (w1 != w2) return (w1 < w2)?-1:1;
+      ++i1; ++i2;
+   }
+   return 0;
+}
+
+
+/** help struct for stri_order - the ASCII natural-order fast path **/
+struct StriNaturalComparer {
+   const StriContainerUTF8* cont;
+   const StriNaturalWeights* weights;
+   bool decreasing;
+
+   StriNaturalComparer(const StriContainerUTF8* _cont,
+      const StriNaturalWeights* _weights, bool _decreasing)
+   { this->cont = _cont; this->weights = _weights;
+     this->decreasing = _decreasing; }
+
+   bool operator() (int a, int b) const
+   {
+      int ret = stri__natural_cmp(
+         cont->get(a).c_str(), cont->get(a).length(),
+         cont->get(b).c_str(), cont->get(b).length(), *weights);
+      return (decreasing)?(ret > 0):(ret < 0);
+   }
+};
+
+
+/** compares precomputed, NUL-terminated collation keys from `depth` on;
+ *  used on small radix sort ranges (all of which share a depth-byte prefix) */
+struct StriSortKeyComparer {
+   const uint8_t* keys;
+   const size_t* key_begin;
+   R_len_t depth;
+   bool decreasing;
+
+   StriSortKeyComparer(const uint8_t* _keys, const size_t* _key_begin,
+      R_len_t _depth, bool _decreasing)
+   { this->keys = _keys; this->key_begin = _key_begin;
+     this->depth = _depth; this->decreasing = _decreasing; }
+
+   bool operator() (int a, int b) const
+   {
+      int ret = strcmp((const char*)keys+key_begin[a]+depth,
+                       (const char*)keys+key_begin[b]+depth);
+      return (decreasing)?(ret > 0):(ret < 0);
+   }
+};
+
+
+/** MSD radix sort over NUL-terminated collation keys [internal]
+ *
+ * Collation keys contain no 0x00 except the terminator, so byte value 0
+ * marks "key exhausted" (shorter keys order first). Buckets are filled
+ * stably (counting sort), hence ties keep their original order, like
+ * std::stable_sort in the pairwise branch. With `decreasing`, buckets
+ * are visited in reverse byte order - the terminator bucket then comes
+ * last and ties still keep their original order.
+ *
+ * @param order indices to sort, in place
+ * @param tmp scratch buffer, at least n elements
+ * @param n number of indices
+ * @param keys the key arena
+ * @param key_begin keys+key_begin[order[j]] is order[j]'s key
+ * @param depth byte position to partition on
+ * @param decreasing sort direction
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__sortkey_msd_radix(int* order, int* tmp, R_len_t n,
+   const uint8_t* keys, const size_t* key_begin, R_len_t depth, bool decreasing)
+{
+   while (true) {
+      if (n < STRI__SORT_RADIX_CUTOFF) {
+         StriSortKeyComparer comp(keys, key_begin, depth, decreasing);
+         std::stable_sort(order, order+n, comp);
+         return;
+      }
+
+      R_len_t count[256];
+      std::memset(count, 0, 256*sizeof(R_len_t));
+      for (R_len_t j=0; j<n; ++j)
+         ++count[keys[key_begin[order[j]]+depth]];
+
+      // all keys agree on this byte: descend without bucketing
+      uint8_t first = keys[key_begin[order[0]]+depth];
+      if (count[first] == n) {
+         if (first == 0) return; // all keys exhausted - ties, done
+         ++depth;
+         continue;
+      }
+
+      size_t start[256];
+      size_t acc = 0;
+      if (!decreasing)
+         for (int c=0; c<256; ++c)   { start[c] = acc; acc += count[c]; }
+      else
+         for (int c=255; c>=0; --c)  { start[c] = acc; acc += count[c]; }
+
+      size_t fill[256];
+      std::memcpy(fill, start, 256*sizeof(size_t));
+      for (R_len_t j=0; j<n; ++j)
+         tmp[fill[keys[key_begin[order[j]]+depth]]++] = order[j];
+      std::memcpy(order, tmp, n*sizeof(int));
+
+      for (int c=1; c<256; ++c) // bucket 0 holds exhausted keys - ties
+         if (count[c] >= 2)
+            stri__sortkey_msd_radix(order+start[c], tmp, count[c],
+               keys, key_begin, depth+1, decreasing);
+      return;
+   }
+}
+
+
+/** materialize the collation key of the i-th element into buf [internal]
+ *
+ * @return key length, including the terminating zero byte
+ */
+static R_len_t stri__sortkey_get(UCollator* col, StriContainerUTF16& cont,
+   R_len_t i, std::vector<uint8_t>& buf)
+{
+   const UnicodeString* cur = &(cont.get(i));
+   int32_t keylen = ucol_getSortKey(col, cur->getBuffer(), cur->length(),
+      &buf[0], (int32_t)buf.size());
+   if (keylen > (int32_t)buf.size()) {
+      buf.resize(keylen);
+      keylen = ucol_getSortKey(col, cur->getBuffer(), cur->length(),
+         &buf[0], (int32_t)buf.size());
+   }
+   if (keylen <= 0)
+      throw StriException(MSG__INTERNAL_ERROR);
+   return keylen;
+}
+
+
+/** materialize a bounded prefix of the i-th element's collation key
+ *  [internal]
+ *
+ * ucol_nextSortKeyPart stops after STRI__SORT_KEY_PREFIX meaningful
+ * bytes instead of producing the whole key - for long strings that do
+ * not stay tied this skips most of the key generation work and memory.
+ * A zero sentinel is appended, so prefix comparisons behave exactly
+ * like full-key comparisons up to possible ties.
+ *
+ * @param truncated [out] may the key continue past the prefix?
+ * @return prefix length, including the sentinel byte
+ */
+static R_len_t stri__sortkey_get_prefix(UCollator* col,
+   StriContainerUTF16& cont, R_len_t i, std::vector<uint8_t>& buf,
+   bool& truncated)
+{
+   const UnicodeString* cur = &(cont.get(i));
+   UCharIterator iter;
+   uiter_setString(&iter, cur->getBuffer(), cur->length());
+   uint32_t state[2] = { 0, 0 };
+   UErrorCode status = U_ZERO_ERROR;
+   int32_t got = ucol_nextSortKeyPart(col, &iter, state, &buf[0],
+      STRI__SORT_KEY_PREFIX, &status);
+   if (U_FAILURE(status))
+      throw StriException(MSG__INTERNAL_ERROR);
+   truncated = (got == STRI__SORT_KEY_PREFIX);
+   buf[got] = 0; // sentinel - the radix sort treats equal prefixes as ties
+   return got+1;
+}
+
+
+/** resolve orderings left undecided by bounded key prefixes [internal]
+ *
+ * After sorting on STRI__SORT_KEY_PREFIX-byte key prefixes, elements
+ * whose prefixes compare equal sit next to each other; if any of them
+ * was truncated, the group's order is settled here with full
+ * ucol_getSortKey keys, generated for the group members only. Groups
+ * are re-sorted stably, so fully tied elements keep their original
+ * relative order.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__sortkey_resolve_ties(std::vector<int>& order,
+   const std::vector<uint8_t>& keys, const std::vector<size_t>& key_begin,
+   const std::vector<char>& truncated, UCollator* col,
+   StriContainerUTF16& cont, bool decreasing)
+{
+   R_len_t k = (R_len_t)order.size();
+   std::vector<uint8_t> buf(256);
+   R_len_t g = 0;
+   while (g < k) {
+      R_len_t h = g+1;
+      bool any_truncated = (bool)truncated[order[g]];
+      while (h < k && 0 == strcmp(
+            (const char*)&keys[0]+key_begin[order[g]],
+            (const char*)&keys[0]+key_begin[order[h]])) {
+         any_truncated = any_truncated || (bool)truncated[order[h]];
+         ++h;
+      }
+
+      R_len_t m = h-g;
+      if (any_truncated && m >= 2) {
+         std::vector<uint8_t> group_keys;
+         group_keys.reserve((size_t)m*32);
+         std::vector<size_t> group_begin(m);
+         for (R_len_t j=0; j<m; ++j) {
+            R_len_t keylen = stri__sortkey_get(col, cont, order[g+j], buf);
+            group_begin[j] = group_keys.size();
+            group_keys.insert(group_keys.end(), buf.begin(), buf.begin()+keylen);
+         }
+
+         std::vector<int> idx(m);
+         for (R_len_t j=0; j<m; ++j) idx[j] = j;
+         StriSortKeyComparer comp(&group_keys[0], &group_begin[0], 0, decreasing);
+         std::stable_sort(idx.begin(), idx.end(), comp);
+
+         std::vector<int> reordered(m);
+         for (R_len_t j=0; j<m; ++j) reordered[j] = order[g+idx[j]];
+         for (R_len_t j=0; j<m; ++j) order[g+j] = reordered[j];
+      }
+      g = h;
+   }
+}
+
+
+#ifdef STRI_HAVE_THREADS
+/** stable merge of two sorted runs of key indices [internal]
+ *
+ * On ties the left run wins, so merging adjacent partitions preserves
+ * the overall stable order.
+ */
+static void stri__sortkey_merge(const int* a, R_len_t na,
+   const int* b, R_len_t nb, int* out,
+   const uint8_t* keys, const size_t* key_begin, bool decreasing)
+{
+   R_len_t i=0, j=0, o=0;
+   while (i<na && j<nb) {
+      int ret = strcmp((const char*)keys+key_begin[a[i]],
+                       (const char*)keys+key_begin[b[j]]);
+      bool b_first = (decreasing)?(ret < 0):(ret > 0); // strictly precedes
+      out[o++] = (b_first)?(b[j++]):(a[i++]);
+   }
+   while (i<na) out[o++] = a[i++];
+   while (j<nb) out[o++] = b[j++];
+}
+
+
+/** the multi-threaded branch of the sort-key path [internal]
+ *
+ * The vector is cut into nth contiguous partitions. Each worker gets a
+ * private ucol_safeClone of the collator (clones are cheap, see
+ * stri_collator.cpp), computes the sort keys for its partition, and
+ * radix-sorts it; the sorted runs are then merged pairwise, also
+ * concurrently, until one run remains. Key comparisons are pure
+ * functions of the key bytes, and workers never touch the R API.
+ *
+ * @param order non-NA element indices, in original order; sorted in place
+ * @param str_cont16 the elements (read-only here)
+ * @param col configured collator (cloned per worker)
+ * @param decreasing sort direction
+ * @param nth number of workers, >= 2
+ * @param keys [out] the key arena
+ * @param key_begin [out] per-element key offsets
+ * @param truncated [out] bounded mode: per-element "key may continue"
+ *    flags (see stri__sortkey_get_prefix); NULL requests full keys
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__order_sortkeys_parallel(std::vector<int>& order,
+   StriContainerUTF16& str_cont16, UCollator* col, bool decreasing, int nth,
+   std::vector<uint8_t>& keys, std::vector<size_t>& key_begin,
+   std::vector<char>* truncated)
+{
+   str_cont16.materializeAll(); // lazy conversion is not thread-safe
+
+   R_len_t k = (R_len_t)order.size();
+   std::vector<R_len_t> bounds(nth+1);
+   for (int t=0; t<=nth; ++t)
+      bounds[t] = (R_len_t)(((int64_t)k*t)/nth);
+
+   std::vector<UCollator*> cols(nth, (UCollator*)NULL);
+   for (int t=0; t<nth; ++t) { // on the main thread
+      UErrorCode status = U_ZERO_ERROR;
+      cols[t] = ucol_safeClone(col, NULL, NULL, &status);
+      if (U_FAILURE(status)) {
+         for (int u=0; u<t; ++u) ucol_close(cols[u]);
+         throw StriException(MSG__INTERNAL_ERROR);
+      }
+   }
+
+   // phase 1: each worker collates its partition into a local arena
+   std::vector< std::vector<uint8_t> > local_keys(nth);
+   std::vector<char> errors(nth, 0);
+   std::vector<std::thread> workers;
+   for (int t=0; t<nth; ++t) {
+      UCollator* mycol = cols[t];
+      R_len_t begin = bounds[t], end = bounds[t+1];
+      std::vector<uint8_t>* mykeys = &local_keys[t];
+      workers.push_back(std::thread(
+         [mycol, begin, end, mykeys, t, truncated,
+               &order, &str_cont16, &key_begin, &errors]() {
+            try {
+               std::vector<uint8_t> buf(256);
+               for (R_len_t j=begin; j<end; ++j) {
+                  R_len_t i = order[j];
+                  R_len_t keylen;
+                  if (truncated) {
+                     bool trunc = false;
+                     keylen = stri__sortkey_get_prefix(mycol, str_cont16,
+                        i, buf, trunc);
+                     (*truncated)[i] = trunc;
+                  }
+                  else
+                     keylen = stri__sortkey_get(mycol, str_cont16, i, buf);
+                  key_begin[i] = mykeys->size(); // local offset, fixed up below
+                  mykeys->insert(mykeys->end(), buf.begin(), buf.begin()+keylen);
+               }
+            }
+            catch (...) {
+               errors[t] = 1;
+            }
+         }));
+   }
+   for (int t=0; t<nth; ++t) workers[t].join();
+   workers.clear();
+   for (int t=0; t<nth; ++t) ucol_close(cols[t]);
+   for (int t=0; t<nth; ++t)
+      if (errors[t]) throw StriException(MSG__INTERNAL_ERROR);
+
+   // splice the local arenas; make the offsets global
+   size_t total = 0;
+   for (int t=0; t<nth; ++t) total += local_keys[t].size();
+   keys.resize(total);
+   size_t off = 0;
+   for (int t=0; t<nth; ++t) {
+      if (!local_keys[t].empty())
+         std::memcpy(&keys[off], &local_keys[t][0], local_keys[t].size());
+      for (R_len_t j=bounds[t]; j<bounds[t+1]; ++j)
+         key_begin[order[j]] += off;
+      off += local_keys[t].size();
+      std::vector<uint8_t>().swap(local_keys[t]); // free eagerly
+   }
+
+   // phase 2: radix-sort the partitions concurrently
+   std::vector<int> tmp(k);
+   for (int t=0; t<nth; ++t) {
+      R_len_t len = bounds[t+1]-bounds[t];
+      int* order_t = &order[0]+bounds[t];
+      int* tmp_t = &tmp[0]+bounds[t];
+      const uint8_t* keys_p = &keys[0];
+      const size_t* key_begin_p = &key_begin[0];
+      workers.push_back(std::thread(
+         [order_t, tmp_t, len, keys_p, key_begin_p, decreasing, t, &errors]() {
+            try {
+               stri__sortkey_msd_radix(order_t, tmp_t, len,
+                  keys_p, key_begin_p, 0, decreasing);
+            }
+            catch (...) {
+               errors[t] = 1;
+            }
+         }));
+   }
+   for (int t=0; t<nth; ++t) workers[t].join();
+   workers.clear();
+   for (int t=0; t<nth; ++t)
+      if (errors[t]) throw StriException(MSG__INTERNAL_ERROR);
+
+   // phase 3: merge adjacent runs pairwise until one remains
+   int* src = &order[0];
+   int* dst = &tmp[0];
+   const uint8_t* keys_p = &keys[0];
+   const size_t* key_begin_p = &key_begin[0];
+   std::vector<R_len_t> runs(bounds);
+   while ((int)runs.size() > 2) {
+      std::vector<R_len_t> next_runs;
+      for (size_t p=0; p+1<runs.size(); p+=2) {
+         next_runs.push_back(runs[p]);
+         if (p+2 < runs.size()) {
+            R_len_t b0 = runs[p], b1 = runs[p+1], b2 = runs[p+2];
+            workers.push_back(std::thread(
+               [src, dst, b0, b1, b2, keys_p, key_begin_p, decreasing]() {
+                  stri__sortkey_merge(src+b0, b1-b0, src+b1, b2-b1,
+                     dst+b0, keys_p, key_begin_p, decreasing);
+               }));
+         }
+         else // unpaired trailing run
+            std::memcpy(dst+runs[p], src+runs[p],
+               (runs[p+1]-runs[p])*sizeof(int));
+      }
+      next_runs.push_back(runs.back());
+      for (size_t w=0; w<workers.size(); ++w) workers[w].join();
+      workers.clear();
+      std::swap(src, dst);
+      runs.swap(next_runs);
+   }
+   if (src != &order[0])
+      std::memcpy(&order[0], src, k*sizeof(int));
+}
+#endif
+
+
+/** how many bytes of sort keys stri_order/stri_sort may keep in RAM
+ *
+ * Reads \code{getOption("stringi.sort_spill_mb")}; anything missing,
+ * non-numeric, or non-positive disables spilling (0 is returned),
+ * which is the default - the external-memory mode is strictly opt-in.
+ */
+static size_t stri__sort_spill_budget()
+{
+   SEXP val = Rf_GetOption1(Rf_install("stringi.sort_spill_mb"));
+   if (Rf_isNull(val))
+      return 0;
+   double mb = Rf_asReal(val);
+   if (ISNAN(mb) || !(mb > 0.0))
+      return 0;
+   size_t budget = (size_t)(mb*1048576.0);
+   return (budget > 0)?budget:1;
+}
+
+
+/** the spilled runs; closes (and thereby deletes) the unnamed
+ *  temporary files on destruction, also when a StriException unwinds */
+struct StriSpillRuns {
+   std::vector<FILE*> files;
+
+   ~StriSpillRuns() {
+      for (size_t r=0; r<files.size(); ++r)
+         if (files[r]) fclose(files[r]);
+   }
+};
+
+
+/** read the next (element, key) record of a spilled run [internal]
+ *
+ * @return false at the end of the run
+ */
+static bool stri__spill_run_next(FILE* f, int& elem, std::vector<uint8_t>& key)
+{
+   uint32_t head[2];
+   if (fread(head, sizeof(uint32_t), 2, f) != 2)
+      return false; // end of run
+   elem = (int)head[0];
+   key.resize((size_t)head[1]);
+   if (fread(&key[0], 1, (size_t)head[1], f) != (size_t)head[1])
+      throw StriException(MSG__TEMPFILE_ERROR);
+   return true;
+}
+
+
+/** orders the heads of the spilled runs during the k-way merge;
+ *  ties go to the run spilled first, which keeps the sort stable */
+struct StriSpillMergeComparer {
+   const std::vector< std::vector<uint8_t> >* keys;
+   bool decreasing;
+
+   bool operator() (int a, int b) const
+   {
+      // a priority_queue pops its "largest" element - report the run
+      // whose head must be emitted first as the larger one
+      int ret = strcmp((const char*)&(*keys)[a][0],
+                       (const char*)&(*keys)[b][0]);
+      if (ret != 0) return (decreasing)?(ret < 0):(ret > 0);
+      return a > b;
+   }
+};
+
+
+/** external-memory branch of the sort-key path [internal]
+ *
+ * For vectors whose key arena would not fit in RAM: full collation
+ * keys are generated streaming, collected into an arena of at most
+ * `budget` bytes, each filled arena is sorted and spilled to an
+ * unnamed temporary file as a run of (element, key) records, and the
+ * sorted runs are k-way merged back into `order` via a heap of run
+ * heads. Every element is collated exactly once, keys never all
+ * coexist in memory, and ties keep their original relative order
+ * (runs are formed in input order and the merge prefers earlier
+ * runs), so the result is identical to the in-memory path's.
+ *
+ * @param order non-NA element indices, in original order; sorted in place
+ * @param cont the elements (read-only here)
+ * @param col configured collator
+ * @param decreasing sort direction
+ * @param budget arena size [bytes], >= 1; each run holds at least
+ *    one element, however long its key
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__order_sortkeys_external(std::vector<int>& order,
+   StriContainerUTF16& cont, UCollator* col, bool decreasing, size_t budget)
+{
+   R_len_t k = (R_len_t)order.size();
+   StriSpillRuns runs;
+   std::vector<uint8_t> buf(256);
+
+   std::vector<uint8_t> arena;
+   std::vector<int> run_elem;     // element index per record
+   std::vector<size_t> run_begin; // key offset per record
+
+   R_len_t j = 0;
+   while (j < k) {
+      arena.clear(); run_elem.clear(); run_begin.clear();
+      while (j < k) {
+         R_len_t keylen = stri__sortkey_get(col, cont, order[j], buf);
+         if (!run_elem.empty() && arena.size()+(size_t)keylen > budget)
+            break; // spill what we have; this element opens the next run
+         run_begin.push_back(arena.size());
+         run_elem.push_back(order[j]);
+         arena.insert(arena.end(), buf.begin(), buf.begin()+keylen);
+         ++j;
+      }
+
+      R_len_t m = (R_len_t)run_elem.size();
+      std::vector<int> idx(m);
+      for (R_len_t t=0; t<m; ++t) idx[t] = t;
+      StriSortKeyComparer comp(&arena[0], &run_begin[0], 0, decreasing);
+      std::stable_sort(idx.begin(), idx.end(), comp);
+
+      FILE* f = tmpfile();
+      if (!f)
+         throw StriException(MSG__TEMPFILE_ERROR);
+      runs.files.push_back(f);
+      for (R_len_t t=0; t<m; ++t) {
+         size_t beg = run_begin[idx[t]];
+         size_t end = ((size_t)(idx[t]+1) < run_begin.size()) ?
+            run_begin[idx[t]+1] : arena.size();
+         uint32_t head[2] = { (uint32_t)run_elem[idx[t]], (uint32_t)(end-beg) };
+         if (fwrite(head, sizeof(uint32_t), 2, f) != 2 ||
+               fwrite(&arena[beg], 1, end-beg, f) != end-beg)
+            throw StriException(MSG__TEMPFILE_ERROR);
+      }
+      if (fflush(f) != 0)
+         throw StriException(MSG__TEMPFILE_ERROR);
+      rewind(f);
+   }
+
+   int nruns = (int)runs.files.size();
+   std::vector< std::vector<uint8_t> > head_key((size_t)nruns);
+   std::vector<int> head_elem((size_t)nruns);
+   StriSpillMergeComparer comp;
+   comp.keys = &head_key;
+   comp.decreasing = decreasing;
+   std::priority_queue<int, std::vector<int>, StriSpillMergeComparer> heap(comp);
+   for (int r=0; r<nruns; ++r)
+      if (stri__spill_run_next(runs.files[r], head_elem[r], head_key[r]))
+         heap.push(r);
+
+   R_len_t o = 0;
+   while (!heap.empty()) {
+      int r = heap.top();
+      heap.pop();
+      order[o++] = head_elem[r];
+      if (stri__spill_run_next(runs.files[r], head_elem[r], head_key[r]))
+         heap.push(r);
+   }
+   if (o != k)
+      throw StriException(MSG__INTERNAL_ERROR);
+}
+
+
+// the hash set for single-pass deduplication now lives in stri_hashset.h
+// (it is shared with the fused case-fold-and-deduplicate operation)
+
 /** Generate the ordering permutation, possibly with collation [internal]
  *
  * @param str character vector
@@ -102,6 +854,28 @@ struct StriSortComparer {
  *
  * @version 0.6-1 (Marek Gagolewski, 2015-07-05)
  *    use stri_order, stri_sort
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    long vectors: precompute ucol_getSortKey per element, then
+ *    MSD radix sort on the binary keys (O(n log n) collations -> n)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    very long vectors may be keyed, sorted, and merged by several
+ *    threads (opt-in, see options(stringi.num_threads=...))
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    only a bounded key prefix is generated per element; full keys are
+ *    produced lazily, for elements that remain tied
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    opt-in external-memory mode: with
+ *    options(stringi.sort_spill_mb=), sorted key runs are spilled to
+ *    temporary files and k-way merged, bounding the memory held in
+ *    sort keys
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    numeric collation over all-ASCII input (version strings, file
+ *    names) is handled by a specialized natural-order comparator
  */
 SEXP stri_order_or_sort(SEXP str, SEXP decreasing, SEXP na_last,
    SEXP opts_collator, int _type)
@@ -140,11 +914,67 @@ SEXP stri_order_or_sort(SEXP str, SEXP decreasing, SEXP na_last,
    order.resize(k); // this should be faster than creating a separate deque (not tested)
 
 
-   // TO DO: collation-based cmp: think of using sort keys...
-   // however,  it's  very fast already now.
+   if (k >= STRI__SORT_NATURAL_THRESHOLD
+         && stri__natural_sort_eligible(col, str_cont, order)) {
+      // all-ASCII input under numeric collation: digit-run parsing plus
+      // per-character weights replace the UCA machinery entirely
+      StriNaturalWeights weights;
+      stri__natural_sort_weights(col, weights);
+      StriNaturalComparer comp(&str_cont, &weights, decr);
+      std::stable_sort(order.begin(), order.end(), comp);
+   }
+   else if (k >= STRI__SORT_SORTKEY_THRESHOLD) {
+      // collate each element exactly once: materialize its binary sort
+      // key into a contiguous arena, then order by plain byte compares
+      StriContainerUTF16 str_cont16(str, vectorize_length);
+
+      size_t spill_budget = stri__sort_spill_budget();
+      if (spill_budget > 0) {
+         // opt-in external-memory mode: stream full keys, spill
+         // sorted runs to temp files, k-way merge
+         stri__order_sortkeys_external(order, str_cont16, col, decr,
+            spill_budget);
+      }
+      else {
+         std::vector<uint8_t> keys;
+         std::vector<size_t> key_begin((size_t)vectorize_length, 0);
+         std::vector<char> truncated((size_t)vectorize_length, 0);
+
+#ifdef STRI_HAVE_THREADS
+         int nth = (k >= 2*STRI__SORT_PARALLEL_MIN_CHUNK) ?
+            stri__threads_requested(k/STRI__SORT_PARALLEL_MIN_CHUNK) : 1;
+         if (nth >= 2) {
+            stri__order_sortkeys_parallel(order, str_cont16, col, decr, nth,
+               keys, key_begin, &truncated);
+         }
+         else
+#endif
+         {
+            keys.reserve((size_t)k*16);
+            std::vector<uint8_t> buf(256);
+            for (R_len_t j=0; j<k; ++j) {
+               R_len_t i = order[j];
+               bool trunc = false;
+               R_len_t keylen = stri__sortkey_get_prefix(col, str_cont16, i,
+                  buf, trunc);
+               truncated[i] = trunc;
+               key_begin[i] = keys.size();
+               keys.insert(keys.end(), buf.begin(), buf.begin()+keylen);
+            }
 
-   StriSortComparer comp(&str_cont, col, decr);
-   std::stable_sort(order.begin(), order.end(), comp);
+            std::vector<int> tmp(k);
+            stri__sortkey_msd_radix(&order[0], &tmp[0], k,
+               &keys[0], &key_begin[0], 0, decr);
+         }
+
+         stri__sortkey_resolve_ties(order, keys, key_begin, truncated,
+            col, str_cont16, decr);
+   }
+   }
+   else {
+      StriSortComparer comp(&str_cont, col, decr);
+      std::stable_sort(order.begin(), order.end(), comp);
+   }
 
 
    SEXP ret;
@@ -237,6 +1067,113 @@ SEXP stri_sort(SEXP str, SEXP decreasing, SEXP na_last, SEXP opts_collator)
 }
 
 
+/** Rank strings in a character vector [with collation]
+ *
+ * Missing values are assigned a missing rank; ties (elements that
+ * collate as equal) all receive the rank of their first member.
+ *
+ * @param str character vector
+ * @param opts_collator passed to stri__ucol_open()
+ * @return integer vector
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    reuses the sort-key arena and the (optionally multi-threaded)
+ *    radix sort of stri_order; ranks are then scattered in one pass
+ */
+SEXP stri_rank(SEXP str, SEXP opts_collator)
+{
+   PROTECT(str = stri_prepare_arg_string(str, "str")); // prepare string argument
+
+   // call stri__ucol_open after prepare_arg:
+   // if prepare_arg had failed, we would have a mem leak
+   UCollator* col = NULL;
+   col = stri__ucol_open(opts_collator);
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+
+   R_len_t vectorize_length = LENGTH(str);
+   StriContainerUTF8 str_cont(str, vectorize_length);
+
+   vector<int> order(vectorize_length);
+   R_len_t k = 0;
+   for (R_len_t i=0; i<vectorize_length; ++i) {
+      if (!str_cont.isNA(i))
+         order[k++] = i;
+   }
+   order.resize(k);
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(INTSXP, vectorize_length));
+   int* ret_tab = INTEGER(ret);
+   for (R_len_t i=0; i<vectorize_length; ++i)
+      ret_tab[i] = NA_INTEGER;
+
+   if (k >= STRI__SORT_SORTKEY_THRESHOLD) {
+      StriContainerUTF16 str_cont16(str, vectorize_length);
+      std::vector<uint8_t> keys;
+      std::vector<size_t> key_begin((size_t)vectorize_length, 0);
+
+#ifdef STRI_HAVE_THREADS
+      int nth = (k >= 2*STRI__SORT_PARALLEL_MIN_CHUNK) ?
+         stri__threads_requested(k/STRI__SORT_PARALLEL_MIN_CHUNK) : 1;
+      if (nth >= 2) {
+         stri__order_sortkeys_parallel(order, str_cont16, col, false, nth,
+            keys, key_begin, NULL); // ranks need full keys (tie classes)
+      }
+      else
+#endif
+      {
+         keys.reserve((size_t)k*16);
+         std::vector<uint8_t> buf(256);
+         for (R_len_t j=0; j<k; ++j) {
+            R_len_t i = order[j];
+            R_len_t keylen = stri__sortkey_get(col, str_cont16, i, buf);
+            key_begin[i] = keys.size();
+            keys.insert(keys.end(), buf.begin(), buf.begin()+keylen);
+         }
+
+         std::vector<int> tmp(k);
+         stri__sortkey_msd_radix(&order[0], &tmp[0], k,
+            &keys[0], &key_begin[0], 0, false);
+      }
+
+      // scatter: equal keys <=> collation-equal elements
+      R_len_t rank = 1;
+      for (R_len_t j=0; j<k; ++j) {
+         if (j > 0 && 0 != strcmp(
+               (const char*)&keys[0]+key_begin[order[j]],
+               (const char*)&keys[0]+key_begin[order[j-1]]))
+            rank = j+1;
+         ret_tab[order[j]] = rank;
+      }
+   }
+   else {
+      StriSortComparer comp(&str_cont, col, false);
+      std::stable_sort(order.begin(), order.end(), comp);
+
+      R_len_t rank = 1;
+      for (R_len_t j=0; j<k; ++j) {
+         // adjacent elements are equal iff neither precedes the other
+         if (j > 0 && comp(order[j-1], order[j]))
+            rank = j+1;
+         ret_tab[order[j]] = rank;
+      }
+   }
+
+   if (col) {
+      ucol_close(col);
+      col = NULL;
+   }
+
+   STRI__UNPROTECT_ALL
+   return ret;
+
+   STRI__ERROR_HANDLER_END({
+      if (col) { ucol_close(col); col = NULL; }
+   })
+}
+
+
 /** Get unique elements from a character vector
  *
  * @param str character vector
@@ -253,6 +1190,10 @@ SEXP stri_sort(SEXP str, SEXP decreasing, SEXP na_last, SEXP opts_collator)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    single pass over a hash table of collation keys instead of
+ *    O(n log n) pairwise collator comparisons
  */
 SEXP stri_unique(SEXP str, SEXP opts_collator)
 {
@@ -267,9 +1208,10 @@ SEXP stri_unique(SEXP str, SEXP opts_collator)
 
    R_len_t vectorize_length = LENGTH(str);
    StriContainerUTF8 str_cont(str, vectorize_length);
+   StriContainerUTF16 str_cont16(str, vectorize_length);
 
-   StriSortComparer comp(&str_cont, col, true);
-   set<int,StriSortComparer> uniqueset(comp);
+   StriByteKeyHashSet seen(vectorize_length);
+   std::vector<uint8_t> buf(256);
 
    bool was_na = false;
    deque<SEXP> temp;
@@ -281,8 +1223,8 @@ SEXP stri_unique(SEXP str, SEXP opts_collator)
          }
       }
       else {
-         pair<set<int,StriSortComparer>::iterator,bool> result = uniqueset.insert(i);
-         if (result.second) {
+         R_len_t keylen = stri__sortkey_get(col, str_cont16, i, buf);
+         if (seen.insert(&buf[0], keylen)) {
             temp.push_back(str_cont.toR(i));
          }
       }
@@ -323,6 +1265,9 @@ SEXP stri_unique(SEXP str, SEXP opts_collator)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    single pass over a hash table of collation keys
  */
 SEXP stri_duplicated(SEXP str, SEXP fromLast, SEXP opts_collator)
 {
@@ -337,10 +1282,10 @@ SEXP stri_duplicated(SEXP str, SEXP fromLast, SEXP opts_collator)
    STRI__ERROR_HANDLER_BEGIN(1)
 
    R_len_t vectorize_length = LENGTH(str);
-   StriContainerUTF8 str_cont(str, vectorize_length);
+   StriContainerUTF16 str_cont(str, vectorize_length);
 
-   StriSortComparer comp(&str_cont, col, true);
-   set<int,StriSortComparer> uniqueset(comp);
+   StriByteKeyHashSet seen(vectorize_length);
+   std::vector<uint8_t> buf(256);
 
    bool was_na = false;
    SEXP ret;
@@ -355,8 +1300,8 @@ SEXP stri_duplicated(SEXP str, SEXP fromLast, SEXP opts_collator)
                was_na = true;
          }
          else {
-            pair<set<int,StriSortComparer>::iterator,bool> result = uniqueset.insert(i);
-            ret_tab[i] = !result.second;
+            R_len_t keylen = stri__sortkey_get(col, str_cont, i, buf);
+            ret_tab[i] = !seen.insert(&buf[0], keylen);
          }
       }
    }
@@ -368,8 +1313,8 @@ SEXP stri_duplicated(SEXP str, SEXP fromLast, SEXP opts_collator)
                was_na = true;
          }
          else {
-            pair<set<int,StriSortComparer>::iterator,bool> result = uniqueset.insert(i);
-            ret_tab[i] = !result.second;
+            R_len_t keylen = stri__sortkey_get(col, str_cont, i, buf);
+            ret_tab[i] = !seen.insert(&buf[0], keylen);
          }
       }
    }
@@ -403,6 +1348,9 @@ SEXP stri_duplicated(SEXP str, SEXP fromLast, SEXP opts_collator)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    single pass over a hash table of collation keys
  */
 SEXP stri_duplicated_any(SEXP str, SEXP fromLast, SEXP opts_collator)
 {
@@ -417,10 +1365,10 @@ SEXP stri_duplicated_any(SEXP str, SEXP fromLast, SEXP opts_collator)
    STRI__ERROR_HANDLER_BEGIN(1)
 
    R_len_t vectorize_length = LENGTH(str);
-   StriContainerUTF8 str_cont(str, vectorize_length);
+   StriContainerUTF16 str_cont(str, vectorize_length);
 
-   StriSortComparer comp(&str_cont, col, true);
-   set<int,StriSortComparer> uniqueset(comp);
+   StriByteKeyHashSet seen(vectorize_length);
+   std::vector<uint8_t> buf(256);
 
    bool was_na = false;
    SEXP ret;
@@ -439,8 +1387,8 @@ SEXP stri_duplicated_any(SEXP str, SEXP fromLast, SEXP opts_collator)
             }
          }
          else {
-            pair<set<int,StriSortComparer>::iterator,bool> result = uniqueset.insert(i);
-            if (!result.second) {
+            R_len_t keylen = stri__sortkey_get(col, str_cont, i, buf);
+            if (!seen.insert(&buf[0], keylen)) {
                ret_tab[0] = i+1;
                break;
             }
@@ -458,8 +1406,8 @@ SEXP stri_duplicated_any(SEXP str, SEXP fromLast, SEXP opts_collator)
             }
          }
          else {
-            pair<set<int,StriSortComparer>::iterator,bool> result = uniqueset.insert(i);
-            if (!result.second) {
+            R_len_t keylen = stri__sortkey_get(col, str_cont, i, buf);
+            if (!seen.insert(&buf[0], keylen)) {
                ret_tab[0] = i+1;
                break;
             }
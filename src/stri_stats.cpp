@@ -32,6 +32,8 @@
 
 #include "stri_stringi.h"
 #include "stri_container_utf8.h"
+#include <cstring>
+
 
 /**
  * General statistics for a character vector
@@ -52,6 +54,12 @@
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    ASCII spans are classified eight bytes at a time (SWAR masks for
+ *    newlines and white space; ASCII White_Space is 09-0D and 20), so
+ *    the counting, newline detection, and classification fuse into a
+ *    single pass; only non-ASCII sequences go through U8_NEXT/ICU
  */
 SEXP stri_stats_general(SEXP str)
 {
@@ -75,6 +83,9 @@ SEXP stri_stats_general(SEXP str)
    for (int i=0; i<gsAll; ++i)
       stats[i] = 0;
 
+   const uint64_t ones = UINT64_C(0x0101010101010101);
+   const uint64_t high = ones*UINT64_C(0x80);
+
    for (R_len_t i=0; i<str_length; ++i) {
       if (str_cont.isNA(i)) continue; // ignore
 
@@ -82,25 +93,51 @@ SEXP stri_stats_general(SEXP str)
       R_len_t     cn = str_cont.get(i).length();
       const char* cs = str_cont.get(i).c_str();
       UChar32 c;
-      bool AnyNonWhite = false;
+      int chars = 0, nonwhite = 0;
 
-      for (int j=0; j<cn; ) {
-         U8_NEXT(cs, j, cn, c);
-         if (c < 0)
-            throw StriException(MSG__INVALID_UTF8);
-         // @TODO: follow Unicode Newline Guidelines - Unicode Technical Report #13
-         else if (c == (UChar32)'\n' || c == (UChar32)'\r') {
-            throw StriException(MSG__NEWLINE_FOUND);
+      R_len_t j = 0;
+      while (j < cn) {
+         if ((uint8_t)cs[j] < 0x80) {
+            // all-ASCII words, eight bytes per step
+            while (j+8 <= cn) {
+               uint64_t w;
+               memcpy(&w, cs+j, sizeof(uint64_t));
+               if (w & high) break; // a multi-byte sequence starts here
+               if (stri__swar_eq(w, 0x0A) | stri__swar_eq(w, 0x0D))
+                  throw StriException(MSG__NEWLINE_FOUND);
+               // ASCII White_Space, newlines already excluded above
+               uint64_t ws = stri__swar_eq(w, 0x20) | stri__swar_eq(w, 0x09)
+                  | stri__swar_eq(w, 0x0B) | stri__swar_eq(w, 0x0C);
+               int nws = (int)(((ws >> 7)*ones) >> 56); // white bytes in w
+               chars += 8;
+               nonwhite += 8-nws;
+               j += 8;
+            }
+            // ASCII margin (end of string or before a multi-byte char)
+            while (j < cn && (uint8_t)cs[j] < 0x80) {
+               char b = cs[j++];
+               if (b == '\n' || b == '\r')
+                  throw StriException(MSG__NEWLINE_FOUND);
+               ++chars;
+               if (!(b == ' ' || (b >= 0x09 && b <= 0x0C)))
+                  ++nonwhite;
+            }
          }
-         ++stats[gsNumChars]; // another character [code point]
-         // we test for UCHAR_WHITE_SPACE binary property
-         if (!u_hasBinaryProperty(c, UCHAR_WHITE_SPACE)) {
-            AnyNonWhite = true;
-            ++stats[gsNumCharsNonWhite];
+         else {
+            U8_NEXT(cs, j, cn, c);
+            if (c < 0)
+               throw StriException(MSG__INVALID_UTF8);
+            // @TODO: follow Unicode Newline Guidelines - Unicode Technical Report #13
+            ++chars; // another character [code point]
+            // we test for UCHAR_WHITE_SPACE binary property
+            if (!u_hasBinaryProperty(c, UCHAR_WHITE_SPACE))
+               ++nonwhite;
          }
       }
 
-      if (AnyNonWhite)
+      stats[gsNumChars] += chars;
+      stats[gsNumCharsNonWhite] += nonwhite;
+      if (nonwhite > 0)
          ++stats[gsNumLinesNonEmpty]; // we have a non-empty line here
    }
 
@@ -111,6 +148,15 @@ SEXP stri_stats_general(SEXP str)
 }
 
 
+// ASCII character classes for the LaTeX scanner below, built once
+// from the very ICU predicates the multibyte path uses
+#define STRI__LATEX_LETTER 0x01
+#define STRI__LATEX_DIGIT  0x02
+#define STRI__LATEX_PUNCT  0x04
+static uint8_t stri__latex_class[128];
+static bool stri__latex_class_ready = false;
+
+
 /**
  * LaTeX, Kile-like statistics for a character vector
  *
@@ -137,12 +183,25 @@ SEXP stri_stats_general(SEXP str)
  *
  * @version 0.3-1 (Marek Gagolewski, 2014-11-04)
  *    Issue #112: str_prepare_arg* retvals were not PROTECTed from gc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    ASCII character classes come from a table built once from the
+ *    same ICU predicates; ICU is consulted only for multibyte chars
  */
 SEXP stri_stats_latex(SEXP str)
 {
    PROTECT(str = stri_prepare_arg_string(str, "str"));
    R_len_t str_length = LENGTH(str);
 
+   if (!stri__latex_class_ready) { // main R thread only - no race
+      for (UChar32 a=0; a<128; ++a)
+         stri__latex_class[a] =
+            (u_isUAlphabetic(a) ? STRI__LATEX_LETTER : 0) |
+            (u_isdigit(a)       ? STRI__LATEX_DIGIT  : 0) |
+            (u_ispunct(a)       ? STRI__LATEX_PUNCT  : 0);
+      stri__latex_class_ready = true;
+   }
+
    STRI__ERROR_HANDLER_BEGIN(1)
    StriContainerUTF8 str_cont(str, str_length);
 
@@ -191,8 +250,15 @@ SEXP stri_stats_latex(SEXP str)
             throw StriException(MSG__NEWLINE_FOUND);
          }
 
-         UBool isLetter = u_isUAlphabetic(c); // u_hasBinaryProperty(c, UCHAR_ALPHABETIC)
-         UBool isNumber = u_isdigit(c); // U_DECIMAL_DIGIT_NUMBER    Nd
+         UBool isLetter, isNumber;
+         if (c < 128) { // table-driven - the typical case
+            isLetter = (stri__latex_class[c] & STRI__LATEX_LETTER) != 0;
+            isNumber = (stri__latex_class[c] & STRI__LATEX_DIGIT)  != 0;
+         }
+         else {
+            isLetter = u_isUAlphabetic(c); // u_hasBinaryProperty(c, UCHAR_ALPHABETIC)
+            isNumber = u_isdigit(c); // U_DECIMAL_DIGIT_NUMBER    Nd
+         }
 
          switch(state) {
             case stStandard:
@@ -205,7 +271,9 @@ SEXP stri_stats_latex(SEXP str)
                      UChar32 cnext;
                      int jnext = j;
                      U8_NEXT(cs, jnext, cn, cnext);
-                     UBool isPunctNext = u_ispunct(cnext);
+                     UBool isPunctNext = (cnext >= 0 && cnext < 128)
+                        ? ((stri__latex_class[cnext] & STRI__LATEX_PUNCT) != 0)
+                        : u_ispunct(cnext);
 
                      if (!isPunctNext || cnext == (UChar32)'~' || cnext == (UChar32)'^') {
                         // this is to avoid counting words like K\"ahler as two words
@@ -33,6 +33,16 @@
 #ifndef __stri_string8_h
 #define __stri_string8_h
 
+#include "stri_memstats.h"
+#include "stri_alloctrace.h"
+
+#include <algorithm> // std::swap
+
+
+// payloads of up to this many bytes (incl. the NUL) are stored inline,
+// with no heap allocation at all
+#define STRI__STRING8_SSO_SIZE 24
+
 
 /**
  * A class to represent an UTF-8 string
@@ -63,6 +73,20 @@
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-02-14)
  *          new field: m_isASCII
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          short owned payloads are kept in an inline buffer
+ *          (small-string optimization) - re-encoded tokens, codes
+ *          and other short strings never touch the allocator
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          move constructor/assignment (C++11 builds) and swap() -
+ *          freshly built buffers change hands without a memcpy
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          new field: m_fromSexp - borrowed memory that belongs to an
+ *          R object may be shared freely, any other borrowed buffer
+ *          (e.g., a container's arena) is deep-copied on copy
  */
 class String8  {
 
@@ -72,6 +96,30 @@ class String8  {
       R_len_t m_n;      ///< string length (in bytes), not including NUL
       bool m_memalloc;  ///< should the memory be freed at the end
       bool m_isASCII;   ///< ASCII or UTF-8?
+      bool m_fromSexp;  ///< is the borrowed buffer owned by an R object?
+      char m_sso[STRI__STRING8_SSO_SIZE]; ///< inline storage for short owned payloads
+
+
+      /** is the payload stored in the inline buffer? */
+      inline bool isInline() const {
+         return this->m_str == this->m_sso;
+      }
+
+
+      /** point m_str at storage for an owned payload of n bytes + NUL:
+       * the inline buffer when it fits, fresh heap memory otherwise;
+       * also sets m_memalloc accordingly */
+      inline char* allocate(R_len_t n) {
+         if (n+1 <= (R_len_t)STRI__STRING8_SSO_SIZE) {
+            this->m_memalloc = false; // nothing will have to be freed
+            return (this->m_str = this->m_sso);
+         }
+         this->m_memalloc = true;
+         this->m_str = new char[n+1];
+         if (!this->m_str) throw StriException(MSG__MEM_ALLOC_ERROR);
+         STRI__MEMSTATS_ADD(string8, n+1)
+         return this->m_str;
+      }
 
 
    public:
@@ -84,6 +132,7 @@ class String8  {
          this->m_n = 0;
          this->m_memalloc = false;
          this->m_isASCII = false;
+         this->m_fromSexp = false;
       }
 
 
@@ -95,8 +144,12 @@ class String8  {
        * @param memalloc should a deep copy of the buffer be done?
        * @param killbom whether to detect and delete UTF-8 BOMs
        * @param isASCII
+       * @param fromSexp for \code{memalloc == false}: does the buffer
+       *    belong to an R object (and hence outlive any copy of this
+       *    string)? pass false when borrowing from, e.g., an arena
        */
-      void initialize(const char* str, R_len_t n, bool memalloc, bool killbom, bool isASCII)
+      void initialize(const char* str, R_len_t n, bool memalloc, bool killbom, bool isASCII,
+         bool fromSexp=true)
       {
 #ifndef NDEBUG
          if (!isNA())
@@ -106,27 +159,26 @@ class String8  {
             (uint8_t)(str[0]) == UTF8_BOM_BYTE1 &&
             (uint8_t)(str[1]) == UTF8_BOM_BYTE2 &&
             (uint8_t)(str[2]) == UTF8_BOM_BYTE3) {
-            // has BOM - get rid of it
-            this->m_memalloc = true; // ignore memalloc val
+            // has BOM - get rid of it; an own copy is needed (ignore memalloc val)
+            this->m_fromSexp = false;
             this->m_n = n-3;
             this->m_isASCII = isASCII;
-            this->m_str = new char[this->m_n+1];
-            if (!this->m_str) throw StriException(MSG__MEM_ALLOC_ERROR);
-            memcpy(this->m_str, str+3, (size_t)this->m_n);
-            this->m_str[this->m_n] = '\0';
+            char* buf = this->allocate(this->m_n);
+            memcpy(buf, str+3, (size_t)this->m_n);
+            buf[this->m_n] = '\0';
          }
          else {
-            this->m_memalloc = memalloc;
+            this->m_fromSexp = (!memalloc && fromSexp);
             this->m_n = n;
             this->m_isASCII = isASCII;
             if (memalloc) {
-               this->m_str = new char[this->m_n+1];
-               if (!this->m_str) throw StriException(MSG__MEM_ALLOC_ERROR);
+               char* buf = this->allocate(this->m_n);
                // memcpy may be very fast in some libc implementations
-               memcpy(this->m_str, str, (size_t)this->m_n);
-               this->m_str[this->m_n] = '\0';
+               memcpy(buf, str, (size_t)this->m_n);
+               buf[this->m_n] = '\0';
             }
             else {
+               this->m_memalloc = false;
                this->m_str = (char*)(str); // we know what we're doing
                // str is zero-terminated
             }
@@ -170,19 +222,95 @@ class String8  {
       }
 
 
+#if defined(__cplusplus) && __cplusplus >= 201103L
+      /** move constructor - steals the buffer, the source becomes NA
+       *
+       * @version 1.4.6 (2020-01-24)
+       */
+      String8(String8&& s)
+      {
+         if (s.isInline()) { // the inline buffer cannot be stolen
+            this->m_str = this->m_sso;
+            memcpy(this->m_sso, s.m_sso, (size_t)s.m_n+1);
+         }
+         else
+            this->m_str = s.m_str;
+         this->m_n = s.m_n;
+         this->m_memalloc = s.m_memalloc;
+         this->m_isASCII = s.m_isASCII;
+         this->m_fromSexp = s.m_fromSexp;
+         s.m_str = NULL; // now an NA, nothing will be freed
+         s.m_memalloc = false;
+      }
+
+
+      /** move - steals the buffer, the source becomes NA
+       *
+       * @version 1.4.6 (2020-01-24)
+       */
+      String8& operator=(String8&& s)
+      {
+         if (this == &s) return *this;
+         if (this->m_str && this->m_memalloc)
+            delete [] this->m_str;
+         if (s.isInline()) { // the inline buffer cannot be stolen
+            this->m_str = this->m_sso;
+            memcpy(this->m_sso, s.m_sso, (size_t)s.m_n+1);
+         }
+         else
+            this->m_str = s.m_str;
+         this->m_n = s.m_n;
+         this->m_memalloc = s.m_memalloc;
+         this->m_isASCII = s.m_isASCII;
+         this->m_fromSexp = s.m_fromSexp;
+         s.m_str = NULL; // now an NA, nothing will be freed
+         s.m_memalloc = false;
+         return *this;
+      }
+#endif
+
+
+      /** exchange the contents with another instance; never copies
+       *
+       * @version 1.4.6 (2020-01-24)
+       */
+      inline void swap(String8& s)
+      {
+         // the inline buffers travel with their objects: swap their
+         // bytes, then re-point m_str wherever it referred to them
+         bool this_inline = this->isInline();
+         bool s_inline = s.isInline();
+         char tmp[STRI__STRING8_SSO_SIZE];
+         memcpy(tmp, this->m_sso, STRI__STRING8_SSO_SIZE);
+         memcpy(this->m_sso, s.m_sso, STRI__STRING8_SSO_SIZE);
+         memcpy(s.m_sso, tmp, STRI__STRING8_SSO_SIZE);
+         char* p1 = this->m_str;
+         char* p2 = s.m_str;
+         this->m_str = (s_inline)?this->m_sso:p2;
+         s.m_str = (this_inline)?s.m_sso:p1;
+         std::swap(this->m_n, s.m_n);
+         std::swap(this->m_memalloc, s.m_memalloc);
+         std::swap(this->m_isASCII, s.m_isASCII);
+         std::swap(this->m_fromSexp, s.m_fromSexp);
+      }
+
+
       /** copy constructor */
       String8(const String8& s)
       {
-         this->m_memalloc = s.m_memalloc;
+         // owned buffers and borrowed non-R buffers (arena-backed
+         // strings) are deep-copied; R-owned memory is shared
+         bool deep = (s.m_memalloc || (s.m_str && !s.m_fromSexp));
+         this->m_fromSexp = s.m_fromSexp;
          this->m_n = s.m_n;
          this->m_isASCII = s.m_isASCII;
-         if (s.m_memalloc) {
-            this->m_str = new char[this->m_n+1];
-            if (!this->m_str) throw StriException(MSG__MEM_ALLOC_ERROR);
-            memcpy(this->m_str, s.m_str, (size_t)this->m_n);
-            this->m_str[this->m_n] = '\0';
+         if (deep) {
+            char* buf = this->allocate(this->m_n);
+            memcpy(buf, s.m_str, (size_t)this->m_n);
+            buf[this->m_n] = '\0';
          }
          else {
+            this->m_memalloc = false;
             this->m_str = s.m_str;
          }
       }
@@ -193,16 +321,18 @@ class String8  {
          if (this->m_str && this->m_memalloc)
             delete [] this->m_str;
 
-         this->m_memalloc = s.m_memalloc;
+         // see the copy constructor
+         bool deep = (s.m_memalloc || (s.m_str && !s.m_fromSexp));
+         this->m_fromSexp = s.m_fromSexp;
          this->m_n = s.m_n;
          this->m_isASCII = s.m_isASCII;
-         if (s.m_memalloc) {
-            this->m_str = new char[this->m_n+1];
-            if (!this->m_str) throw StriException(MSG__MEM_ALLOC_ERROR);
-            memcpy(this->m_str, s.m_str, (size_t)this->m_n);
-            this->m_str[this->m_n] = '\0';
+         if (deep) {
+            char* buf = this->allocate(this->m_n);
+            memcpy(buf, s.m_str, (size_t)this->m_n);
+            buf[this->m_n] = '\0';
          }
          else {
+            this->m_memalloc = false;
             this->m_str = s.m_str;
          }
 
@@ -231,6 +361,11 @@ class String8  {
          return !this->m_memalloc;
       }
 
+      /** is this string a shallow copy of an R object's memory? */
+      inline bool isFromSexp() const {
+         return this->m_fromSexp;
+      }
+
       /** return the char buffer */
       inline const char* c_str() const
       {
@@ -364,6 +499,9 @@ class String8  {
          this->m_str = new char[buf_size+1];
          this->m_n = buf_size;
          this->m_memalloc = true;
+         STRI__MEMSTATS_ADD(string8, buf_size+1)
+         STRI__ALLOCTRACE_EVENT(old_n+1, buf_size+1)
+         this->m_fromSexp = false;
          this->m_isASCII = true; /* TO DO */
 
          R_len_t buf_used = 0;
@@ -33,6 +33,9 @@
 #ifndef __stri_string8buf_h
 #define __stri_string8buf_h
 
+#include "stri_memstats.h"
+#include "stri_alloctrace.h"
+
 
 /**
  * A class to represent a temporary string buffer
@@ -44,6 +47,9 @@
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-02-14)
  *          Use malloc+realloc
+ *
+ * @version 1.4.6 (2020-01-24)
+ *          move constructor/assignment (C++11 builds)
  */
 class String8buf  {
 
@@ -64,6 +70,7 @@ class String8buf  {
          this->m_size = size+1;
          this->m_str = (char*)malloc(sizeof(char)*this->m_size);
          if (!this->m_str) throw StriException(MSG__MEM_ALLOC_ERROR);
+         STRI__MEMSTATS_ADD(string8buf, this->m_size)
          this->m_str[0] = '\0';
       }
 
@@ -77,12 +84,45 @@ class String8buf  {
          }
       }
 
+#if defined(__cplusplus) && __cplusplus >= 201103L
+      /** move constructor - steals the buffer
+       *
+       * @version 1.4.6 (2020-01-24)
+       */
+      String8buf(String8buf&& s)
+      {
+         this->m_str = s.m_str;
+         this->m_size = s.m_size;
+         s.m_str = NULL;
+         s.m_size = 0;
+      }
+
+
+      /** move - steals the buffer
+       *
+       * @version 1.4.6 (2020-01-24)
+       */
+      String8buf& operator=(String8buf&& s)
+      {
+         if (this == &s) return *this;
+         if (this->m_str)
+            free(this->m_str);
+         this->m_str = s.m_str;
+         this->m_size = s.m_size;
+         s.m_str = NULL;
+         s.m_size = 0;
+         return *this;
+      }
+#endif
+
+
       /** copy constructor */
       String8buf(const String8buf& s)
       {
          this->m_size = s.m_size;
          this->m_str = (char*)malloc(sizeof(char)*this->m_size);
          if (!this->m_str) throw StriException(MSG__MEM_ALLOC_ERROR);
+         STRI__MEMSTATS_ADD(string8buf, this->m_size)
          memcpy(this->m_str, s.m_str, (size_t)this->m_size);
       }
 
@@ -95,6 +135,7 @@ class String8buf  {
          this->m_size = s.m_size;
          this->m_str = (char*)malloc(sizeof(char)*this->m_size);
          if (!this->m_str) throw StriException(MSG__MEM_ALLOC_ERROR);
+         STRI__MEMSTATS_ADD(string8buf, this->m_size)
          memcpy(this->m_str, s.m_str, (size_t)this->m_size);
 
          return *this;
@@ -126,9 +167,14 @@ class String8buf  {
             return; // do nothing (the requested buffer size is available)
 
          char* old_str = this->m_str;
+         R_len_t old_size = this->m_size;
+         (void)old_size; // used by the opt-in trace hook only
          this->m_size = size+1;
          this->m_str = (char*)realloc(this->m_str, sizeof(char)*this->m_size);
          if (!this->m_str) throw StriException(MSG__MEM_ALLOC_ERROR);
+         STRI__MEMSTATS_COUNT(string8buf_resizes)
+         STRI__MEMSTATS_ADD(string8buf, this->m_size)
+         STRI__ALLOCTRACE_EVENT(old_size, this->m_size)
          if (!old_str || !copy) {
             this->m_str[0] = 0;
          }
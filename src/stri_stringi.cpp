@@ -56,6 +56,9 @@ const R_CallMethodDef cCallMethods[] = {
 //   STRI__MK_CALL("C_stri_charcategories",             stri_charcategories,             0),  // TO BE >= 0.6
 //   STRI__MK_CALL("C_stri_chartype",                   stri_chartype,                   1),  // TO BE >= 0.6
 // STRI__MK_CALL("C_stri_c_posixst",                    stri_c_posixst,                  1),  // internal
+   STRI__MK_CALL("C_stri_alloc_trace",                  stri_alloc_trace,                0),
+   STRI__MK_CALL("C_stri_cache_clear",                  stri_cache_clear,                1),
+   STRI__MK_CALL("C_stri_cache_info",                   stri_cache_info,                 0),
    STRI__MK_CALL("C_stri_cmp_eq",                       stri_cmp_eq,                     2),
    STRI__MK_CALL("C_stri_cmp_neq",                      stri_cmp_neq,                    2),
    STRI__MK_CALL("C_stri_cmp",                          stri_cmp,                        3),
@@ -66,10 +69,15 @@ const R_CallMethodDef cCallMethods[] = {
    STRI__MK_CALL("C_stri_cmp_equiv",                    stri_cmp_equiv,                  3),
    STRI__MK_CALL("C_stri_cmp_nequiv",                   stri_cmp_nequiv,                 3),
    STRI__MK_CALL("C_stri_count_boundaries",             stri_count_boundaries,           2),
+   STRI__MK_CALL("C_stri_count_boundaries_locales",     stri_count_boundaries_locales,   3),
    STRI__MK_CALL("C_stri_count_charclass",              stri_count_charclass,            2),
-   STRI__MK_CALL("C_stri_count_fixed",                  stri_count_fixed,                3),
-   STRI__MK_CALL("C_stri_count_coll",                   stri_count_coll,                 3),
-   STRI__MK_CALL("C_stri_count_regex",                  stri_count_regex,                3),
+   STRI__MK_CALL("C_stri_count_fixed",                  stri_count_fixed,                4),
+   STRI__MK_CALL("C_stri_count_fuzzy",                  stri_count_fuzzy,                3),
+   STRI__MK_CALL("C_stri_count_fixed_indexed",          stri_count_fixed_indexed,        2),
+   STRI__MK_CALL("C_stri_count_fixed_mapped",           stri_count_fixed_mapped,         2),
+   STRI__MK_CALL("C_stri_count_coll",                   stri_count_coll,                 4),
+   STRI__MK_CALL("C_stri_count_regex",                  stri_count_regex,                4),
+   STRI__MK_CALL("C_stri_count_regex_file",             stri_count_regex_file,           4),
    STRI__MK_CALL("C_stri_datetime_symbols",             stri_datetime_symbols,           3),
    STRI__MK_CALL("C_stri_datetime_fields",              stri_datetime_fields,            3),
    STRI__MK_CALL("C_stri_datetime_now",                 stri_datetime_now,               0),
@@ -77,9 +85,14 @@ const R_CallMethodDef cCallMethods[] = {
    STRI__MK_CALL("C_stri_datetime_format",              stri_datetime_format,            4),
    STRI__MK_CALL("C_stri_datetime_parse",               stri_datetime_parse,             5),
    STRI__MK_CALL("C_stri_datetime_add",                 stri_datetime_add,               5),
+   STRI__MK_CALL("C_stri_detect_any_fixed",             stri_detect_any_fixed,           4),
    STRI__MK_CALL("C_stri_detect_charclass",             stri_detect_charclass,           4),
    STRI__MK_CALL("C_stri_detect_coll",                  stri_detect_coll,                5),
+   STRI__MK_CALL("C_stri_detect_each_fixed",            stri_detect_each_fixed,          4),
    STRI__MK_CALL("C_stri_detect_fixed",                 stri_detect_fixed,               5),
+   STRI__MK_CALL("C_stri_detect_fuzzy",                 stri_detect_fuzzy,               4),
+   STRI__MK_CALL("C_stri_detect_fixed_indexed",         stri_detect_fixed_indexed,       3),
+   STRI__MK_CALL("C_stri_detect_fixed_mapped",          stri_detect_fixed_mapped,        3),
    STRI__MK_CALL("C_stri_detect_regex",                 stri_detect_regex,               5),
    STRI__MK_CALL("C_stri_dup",                          stri_dup,                        2),
    STRI__MK_CALL("C_stri_duplicated",                   stri_duplicated,                 3),
@@ -121,6 +134,11 @@ const R_CallMethodDef cCallMethods[] = {
    STRI__MK_CALL("C_stri_extract_first_regex",          stri_extract_first_regex,        3),
    STRI__MK_CALL("C_stri_extract_last_regex",           stri_extract_last_regex,         3),
    STRI__MK_CALL("C_stri_extract_all_regex",            stri_extract_all_regex,          5),
+   STRI__MK_CALL("C_stri_fixed_pattern",                stri_fixed_pattern,              2),
+   STRI__MK_CALL("C_stri_regex_pattern",                stri_regex_pattern,              2),
+   STRI__MK_CALL("C_stri_trigram_index",                stri_trigram_index,              1),
+   STRI__MK_CALL("C_stri_suffix_index",                 stri_suffix_index,               1),
+   STRI__MK_CALL("C_stri_locate_all_suffix",            stri_locate_all_suffix,          4),
    STRI__MK_CALL("C_stri_flatten",                      stri_flatten,                    4),
 //   STRI__MK_CALL("C_stri_in_fixed",                   stri_in_fixed,                   3),  // TODO: version >= 0.6
    STRI__MK_CALL("C_stri_info",                         stri_info,                       0),
@@ -130,7 +148,9 @@ const R_CallMethodDef cCallMethods[] = {
    STRI__MK_CALL("C_stri_join2",                        stri_join2,                      2),
 //   STRI__MK_CALL("C_stri_justify",                    stri_justify,                    2),  // TODO: version >= 0.6
    STRI__MK_CALL("C_stri_length",                       stri_length,                     1),
+   STRI__MK_CALL("C_stri_length_mapped",                stri_length_mapped,              1),
    STRI__MK_CALL("C_stri_list2matrix",                  stri_list2matrix,                4),
+   STRI__MK_CALL("C_stri_load_strings",                 stri_load_strings,               1),
    STRI__MK_CALL("C_stri_locale_info",                  stri_locale_info,                1),
    STRI__MK_CALL("C_stri_locale_list",                  stri_locale_list,                0),
    STRI__MK_CALL("C_stri_locale_set",                   stri_locale_set,                 1),
@@ -142,16 +162,25 @@ const R_CallMethodDef cCallMethods[] = {
    STRI__MK_CALL("C_stri_locate_all_charclass",         stri_locate_all_charclass,       4),
    STRI__MK_CALL("C_stri_locate_last_fixed",            stri_locate_last_fixed,          3),
    STRI__MK_CALL("C_stri_locate_first_fixed",           stri_locate_first_fixed,         3),
-   STRI__MK_CALL("C_stri_locate_all_fixed",             stri_locate_all_fixed,           4),
+   STRI__MK_CALL("C_stri_locate_all_fixed",             stri_locate_all_fixed,           5),
+   STRI__MK_CALL("C_stri_locate_last_fuzzy",            stri_locate_last_fuzzy,          3),
+   STRI__MK_CALL("C_stri_locate_first_fuzzy",           stri_locate_first_fuzzy,         3),
+   STRI__MK_CALL("C_stri_locate_all_fuzzy",             stri_locate_all_fuzzy,           4),
    STRI__MK_CALL("C_stri_locate_last_coll",             stri_locate_last_coll,           3),
    STRI__MK_CALL("C_stri_locate_first_coll",            stri_locate_first_coll,          3),
    STRI__MK_CALL("C_stri_locate_all_coll",              stri_locate_all_coll,            4),
    STRI__MK_CALL("C_stri_locate_all_regex",             stri_locate_all_regex,           4),
+   STRI__MK_CALL("C_stri_locate_all_regex_file",        stri_locate_all_regex_file,      4),
    STRI__MK_CALL("C_stri_locate_first_regex",           stri_locate_first_regex,         3),
    STRI__MK_CALL("C_stri_locate_last_regex",            stri_locate_last_regex,          3),
    STRI__MK_CALL("C_stri_match_first_regex",            stri_match_first_regex,          4),
    STRI__MK_CALL("C_stri_match_last_regex",             stri_match_last_regex,           4),
+   STRI__MK_CALL("C_stri_mem_stats",                    stri_mem_stats,                  0),
+   STRI__MK_CALL("C_stri_perf_stats",                   stri_perf_stats,                 0),
    STRI__MK_CALL("C_stri_match_all_regex",              stri_match_all_regex,            5),
+   STRI__MK_CALL("C_stri_mmap_lines",                   stri_mmap_lines,                 1),
+   STRI__MK_CALL("C_stri_mmap_lines_count",             stri_mmap_lines_count,           1),
+   STRI__MK_CALL("C_stri_na2empty",                     stri_na2empty,                   1),
    STRI__MK_CALL("C_stri_numbytes",                     stri_numbytes,                   1),
    STRI__MK_CALL("C_stri_order",                        stri_order,                      4),
    STRI__MK_CALL("C_stri_sort",                         stri_sort,                       4),
@@ -167,7 +196,14 @@ const R_CallMethodDef cCallMethods[] = {
    STRI__MK_CALL("C_stri_prepare_arg_integer_1",        stri_prepare_arg_integer_1,      2),
    STRI__MK_CALL("C_stri_prepare_arg_logical_1",        stri_prepare_arg_logical_1,      2),
    STRI__MK_CALL("C_stri_rand_shuffle",                 stri_rand_shuffle,               1),
+   STRI__MK_CALL("C_stri_remove_empty",                 stri_remove_empty,               2),
+   STRI__MK_CALL("C_stri_remove_na",                    stri_remove_na,                  1),
    STRI__MK_CALL("C_stri_rand_strings",                 stri_rand_strings,               3),
+   STRI__MK_CALL("C_stri_rank",                         stri_rank,                       2),
+   STRI__MK_CALL("C_stri_read_lines_conv",              stri_read_lines_conv,            2),
+   STRI__MK_CALL("C_stri_read_lines_utf8",              stri_read_lines_utf8,            1),
+   STRI__MK_CALL("C_stri_read_segments_utf8",           stri_read_segments_utf8,         4),
+   STRI__MK_CALL("C_stri_replace_map_fixed",            stri_replace_map_fixed,          3),
    STRI__MK_CALL("C_stri_replace_na",                   stri_replace_na,                 2),
    STRI__MK_CALL("C_stri_replace_all_fixed",            stri_replace_all_fixed,          5),
    STRI__MK_CALL("C_stri_replace_first_fixed",          stri_replace_first_fixed,        4),
@@ -182,6 +218,7 @@ const R_CallMethodDef cCallMethods[] = {
    STRI__MK_CALL("C_stri_replace_first_charclass",      stri_replace_first_charclass,    3),
    STRI__MK_CALL("C_stri_replace_last_charclass",       stri_replace_last_charclass,     3),
    STRI__MK_CALL("C_stri_reverse",                      stri_reverse,                    1),
+   STRI__MK_CALL("C_stri_save_strings",                 stri_save_strings,               2),
    STRI__MK_CALL("C_stri_split_boundaries",             stri_split_boundaries,           5),
    STRI__MK_CALL("C_stri_split_charclass",              stri_split_charclass,            6),
    STRI__MK_CALL("C_stri_split_coll",                   stri_split_coll,                 7),
@@ -196,11 +233,17 @@ const R_CallMethodDef cCallMethods[] = {
    STRI__MK_CALL("C_stri_stats_latex",                  stri_stats_latex,                1),
    STRI__MK_CALL("C_stri_sub",                          stri_sub,                        4),
    STRI__MK_CALL("C_stri_sub_all",                      stri_sub_all,                    4),
+   STRI__MK_CALL("C_stri_sub_index",                    stri_sub_index,                  1),
+   STRI__MK_CALL("C_stri_boundaries_index",             stri_boundaries_index,           1),
+   STRI__MK_CALL("C_stri_deferred_string",              stri_deferred_string,            2),
+   STRI__MK_CALL("C_stri_prepared",                     stri_prepared,                   2),
+   STRI__MK_CALL("C_stri_pipeline",                     stri_pipeline,                   3),
    STRI__MK_CALL("C_stri_sub_replacement",              stri_sub_replacement,            6),
    STRI__MK_CALL("C_stri_sub_replacement_all",          stri_sub_replacement_all,        6),
    STRI__MK_CALL("C_stri_subset_charclass",             stri_subset_charclass,           4),
    STRI__MK_CALL("C_stri_subset_coll",                  stri_subset_coll,                5),
    STRI__MK_CALL("C_stri_subset_fixed",                 stri_subset_fixed,               5),
+   STRI__MK_CALL("C_stri_subset_fixed_indexed",         stri_subset_fixed_indexed,       4),
    STRI__MK_CALL("C_stri_subset_regex",                 stri_subset_regex,               5),
    STRI__MK_CALL("C_stri_subset_charclass_replacement", stri_subset_charclass_replacement, 4),
    STRI__MK_CALL("C_stri_subset_coll_replacement",      stri_subset_coll_replacement,    5),
@@ -235,8 +278,10 @@ const R_CallMethodDef cCallMethods[] = {
    STRI__MK_CALL("C_stri_trim_right",                   stri_trim_right,                 2),
    STRI__MK_CALL("C_stri_unescape_unicode",             stri_unescape_unicode,           1),
    STRI__MK_CALL("C_stri_unique",                       stri_unique,                     2),
+   STRI__MK_CALL("C_stri_unique_casefold",              stri_unique_casefold,            1),
    STRI__MK_CALL("C_stri_width",                        stri_width,                      1),
    STRI__MK_CALL("C_stri_wrap",                         stri_wrap,                      10),
+   STRI__MK_CALL("C_stri_write_lines_native",           stri_write_lines_native,         4),
 //   STRI__MK_CALL("C_stri_trim_double",                stri_trim_double,                3), // TODO: version >= 0.6
 
    // the list must be NULL-terminated:
@@ -282,10 +327,42 @@ void stri_set_icu_data_directory(const char* libpath)
 }
 
 
+bool stri__icu_initialized = false;
+
+/** Deferred ICU warm-up - runs once, on the first .Call into the library
+ *
+ * It is OK to simply use ICU services and functions without first having
+ * initialized ICU by calling u_init(): every service initializes itself
+ * (and loads its data) on first use. u_init() is merely an eager check
+ * for configuration or installation problems that leave the ICU data
+ * inaccessible - and it used to cost a noticeable slice of package load
+ * time, which multiplies badly across fleets of short-lived R processes.
+ * It is therefore deferred until the first stringi call actually made
+ * (via STRI__ERROR_HANDLER_BEGIN, see stri_exception.h); a misconfigured
+ * ICU is then reported by that call instead of by library(stringi).
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void stri__icu_init()
+{
+   UErrorCode status = U_ZERO_ERROR;
+   u_init(&status);
+   if (U_FAILURE(status))
+      Rf_error("ICU init failed: %s", u_errorName(status)); // error() call allowed here
+   stri__icu_initialized = true;
+}
+
+
 /**
  * Library initialization.
  *
  * R calls this automatically on lib load/attach.
+ *
+ * The work left at load time is deliberately minimal and touches no ICU
+ * data: computing the ICU data directory path (a string operation -
+ * u_setDataDirectory only records it), registering the .Call routines
+ * and the ALTREP class, and exporting the C-callable symbols. The ICU
+ * warm-up itself is deferred, see stri__icu_init() above.
  */
 extern "C" void R_init_stringi(DllInfo* dll)
 {
@@ -293,21 +370,9 @@ extern "C" void R_init_stringi(DllInfo* dll)
    stri_set_icu_data_directory((char*)*(char**)(dll) /* dll->path */);
 #endif
 
-/* BTW: u_init: It is OK to simply use ICU services and functions without
-   first having initialized ICU by calling u_init().
-
-   u_init() will attempt to load some part of ICU's data, and is useful
-   as a test for configuration or installation problems that leave
-   the ICU data inaccessible. A successful invocation of u_init() does not,
-   however, guarantee that all ICU data is accessible.
-*/
-   UErrorCode status = U_ZERO_ERROR;
-   u_init(&status);
-   if (U_FAILURE(status))
-      Rf_error("ICU init failed: %s", u_errorName(status));
-
    R_registerRoutines(dll, NULL, cCallMethods, NULL, NULL);
    R_useDynamicSymbols(dll, (Rboolean)FALSE);
+   stri__altrep_init(dll); // deferred result vectors, see stri_altrep.cpp
 #if defined(R_VERSION) && R_VERSION >= R_Version(3, 0, 0)
    R_forceSymbols(dll, (Rboolean)TRUE);
 #endif
@@ -50,6 +50,7 @@ SEXP    stri__make_character_vector_UnicodeString_ptr(R_len_t numnames, ...);
 R_len_t stri__recycling_rule(bool enableWarning, int n, ...);
 SEXP    stri__vector_NA_integers(R_len_t howmany);
 SEXP    stri__vector_NA_strings(R_len_t howmany);
+R_len_t* stri__duplicate_index(SEXP sexp, R_len_t n);
 SEXP    stri__vector_empty_strings(R_len_t howmany);
 SEXP    stri__emptyList();
 SEXP    stri__matrix_NA_INTEGER(R_len_t nrow, R_len_t ncol);
@@ -59,11 +60,14 @@ int     stri__match_arg(const char* option, const char** set);
 // collator.cpp:
 struct UCollator;
 UCollator* stri__ucol_open(SEXP opts_collator);
+const char* stri__ucol_identify(const UCollator* col);
 
 // length.cpp
 R_len_t stri__numbytes_max(SEXP str);
 int     stri__width_char(UChar32 c);
+int     stri__width_char_cached(UChar32 c); // c <= 0xFFFF only
 int     stri__width_string(const char* str_cur_s, int str_cur_n);
+int     stri__width_string_or_negative(const char* str_cur_s, int str_cur_n);
 
 // prepare_arg.cpp:
 const char* stri__copy_string_Ralloc(SEXP, const char* argname);
@@ -76,6 +80,7 @@ const char* stri__prepare_arg_locale(SEXP loc,        const char* argname,
 const char* stri__prepare_arg_enc(SEXP loc,           const char* argname,
                                      bool allowdefault);
 TimeZone* stri__prepare_arg_timezone(SEXP tz, const char* argname, bool allowdefault);
+void stri__locale_cache_invalidate();
 
 // prepare_arg.cpp /* internal, but in namespace: for testing */
 SEXP        stri_prepare_arg_list(SEXP x,             const char* argname);
@@ -101,18 +106,29 @@ SEXP stri_test_UnicodeContainer8(SEXP str);
 SEXP stri_test_returnasis(SEXP x);
 
 // search
+void stri__altrep_init(DllInfo* dll);
 void stri__locate_set_dimnames_list(SEXP list);
 void stri__locate_set_dimnames_matrix(SEXP matrix);
 SEXP stri__subset_by_logical(const StriContainerUTF8& str_cont,
    const std::vector<int>& which, int result_counter);
 SEXP stri__subset_by_logical(const StriContainerUTF16& str_cont,
    const std::vector<int>& which, int result_counter);
+SEXP stri__subset_by_indices(const StriContainerUTF8& str_cont,
+   std::vector<int>& indices);
 
 // date/time
 void stri__set_class_POSIXct(SEXP x);
 
 // encoding_conversion.cpp:
 SEXP stri_encode_from_marked(SEXP str, SEXP to, SEXP to_raw);
+class String8buf;
+R_len_t stri__encode_streamed(const char* src, R_len_t n,
+   UConverter* uconv_from, UConverter* uconv_to, String8buf& buf,
+   UErrorCode& status);
+
+// encoding_detection.cpp:
+double stri__enc_check_utf8(const char* str_cur_s, R_len_t str_cur_n,
+   bool get_confidence);
 
 // date/time:
 SEXP stri_c_posixst(SEXP x);
@@ -32,6 +32,7 @@
 
 #include "stri_stringi.h"
 #include "stri_container_utf8_indexable.h"
+#include "stri_bufpool.h"
 #include "stri_string8buf.h"
 #include <stdexcept>
 
@@ -159,9 +160,17 @@ inline void stri__sub_get_indices(StriContainerUTF8_indexable& str_cont, R_len_t
  *
  * @version 0.5-9003 (Marek Gagolewski, 2015-08-05)
  *    Bugfix #183: floating point exception when to or length is an empty vector
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    honor a persistent code point index attached via stri_sub_index()
  */
 SEXP stri_sub(SEXP str, SEXP from, SEXP to, SEXP length)
 {
+   // look for a persistent code point index before the argument is
+   // re-prepared (preparation may drop attributes); a stale or foreign
+   // index is rejected by stri__cpindex_from_attrib, never trusted
+   const StriCpIndex* cpindex = stri__cpindex_from_attrib(str);
+
    PROTECT(str = stri_prepare_arg_string(str, "str"));
 
    R_len_t str_len       = LENGTH(str);
@@ -186,6 +195,8 @@ SEXP stri_sub(SEXP str, SEXP from, SEXP to, SEXP length)
 
    STRI__ERROR_HANDLER_BEGIN(sub_protected)
    StriContainerUTF8_indexable str_cont(str, vectorize_len);
+   if (cpindex && cpindex->n == str_len)
+      str_cont.setPersistentIndex(cpindex);
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_len));
 
@@ -273,6 +284,9 @@ SEXP stri_sub(SEXP str, SEXP from, SEXP to, SEXP length)
  *
  * @version 1.4.3 (Marek Gagolewski, 2019-03-12)
  *    #346: na_omit for `value`
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    size the scratch buffer up front (no reallocs in the main loop)
  */
 SEXP stri_sub_replacement(SEXP str, SEXP from, SEXP to, SEXP length, SEXP omit_na, SEXP value)
 {
@@ -306,7 +320,14 @@ SEXP stri_sub_replacement(SEXP str, SEXP from, SEXP to, SEXP length, SEXP omit_n
    StriContainerUTF8 value_cont(value, vectorize_len);
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_len));
-   String8buf buf(0); // @TODO: estimate bufsize a priori
+
+   // each result is a substring of str with the whole value spliced in,
+   // so this bound makes every resize below a no-op
+   R_len_t bufsize_max = str_cont.getMaxNumBytes();
+   R_len_t valsize_max = value_cont.getMaxNumBytes();
+   if (bufsize_max < 0) bufsize_max = 0;
+   if (valsize_max > 0) bufsize_max += valsize_max;
+   StriScratchBuf buf(bufsize_max); // pooled scratch, grow-only
 
    for (R_len_t i = str_cont.vectorize_init();
          i != str_cont.vectorize_end();
@@ -0,0 +1,278 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_container_utf8_indexable.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+
+/** the payload of a stri_suffix_index externalptr
+ *
+ * A plain byte-level suffix array over one (validated, UTF-8) string:
+ * sa holds every suffix start offset, ordered lexicographically. All
+ * the suffixes beginning with a given pattern form one contiguous sa
+ * range, found by two binary searches in O(pattern * log n); the range
+ * then lists every occurrence, overlapping ones included, so a locate
+ * query costs O(pattern * log n + occurrences) regardless of how long
+ * the text is.
+ */
+struct StriSuffixIndex {
+   StriContainerUTF8_indexable* cont;  ///< the indexed string [owned]
+   std::vector<int> sa;                ///< lexicographic suffix order
+
+   StriSuffixIndex() : cont(NULL) { }
+   ~StriSuffixIndex() { if (cont) delete cont; }
+};
+
+
+/** sort-by-rank-pairs comparator for the doubling construction */
+struct StriSuffixRankCmp {
+   const std::vector<int>& rank;
+   R_len_t k, n;
+   StriSuffixRankCmp(const std::vector<int>& _rank, R_len_t _k, R_len_t _n)
+      : rank(_rank), k(_k), n(_n) { }
+   bool operator()(int a, int b) const {
+      if (rank[a] != rank[b]) return rank[a] < rank[b];
+      int ra = (a+k < n) ? rank[a+k] : -1;
+      int rb = (b+k < n) ? rank[b+k] : -1;
+      return ra < rb;
+   }
+};
+
+
+/** build the suffix array by prefix doubling, O(n log^2 n)
+ *
+ * Good enough here: construction runs once per corpus and is dominated
+ * by std::sort passes over int arrays; the per-query cost is what the
+ * index exists for.
+ */
+static void stri__suffix_array_build(const char* s, R_len_t n,
+   std::vector<int>& sa)
+{
+   sa.resize((size_t)n);
+   std::vector<int> rank((size_t)n), tmp((size_t)n);
+   for (R_len_t i=0; i<n; ++i) {
+      sa[i] = i;
+      rank[i] = (int)(unsigned char)s[i];
+   }
+   for (R_len_t k=1; k<n; k<<=1) {
+      StriSuffixRankCmp cmp(rank, k, n);
+      std::sort(sa.begin(), sa.end(), cmp);
+      tmp[sa[0]] = 0;
+      for (R_len_t i=1; i<n; ++i)
+         tmp[sa[i]] = tmp[sa[i-1]] + (cmp(sa[i-1], sa[i]) ? 1 : 0);
+      rank.swap(tmp);
+      if (rank[sa[n-1]] == n-1) break; // all ranks distinct - done
+   }
+}
+
+
+/** does the suffix at `suf` sort before/after the pattern?
+ * @return <0, 0, >0; 0 means the pattern is a prefix of the suffix
+ */
+static int stri__suffix_cmp(const char* s, R_len_t n, int suf,
+   const char* p, R_len_t p_len)
+{
+   R_len_t suf_len = n-suf;
+   R_len_t l = (suf_len < p_len) ? suf_len : p_len;
+   int r = memcmp(s+suf, p, (size_t)l);
+   if (r != 0) return (r < 0) ? -1 : 1;
+   // every compared byte agreed; a suffix shorter than the pattern
+   // sorts before it and cannot contain it
+   return (suf_len < p_len) ? -1 : 0;
+}
+
+
+/** [internal] externalptr finalizer */
+static void stri__suffix_index_finalizer(SEXP ptr)
+{
+   StriSuffixIndex* idx = (StriSuffixIndex*)R_ExternalPtrAddr(ptr);
+   if (idx) {
+      delete idx;
+      R_ClearExternalPtr(ptr);
+   }
+}
+
+
+/** fetch and validate a stri_suffix_index handle */
+static StriSuffixIndex* stri__suffix_index_unwrap(SEXP index)
+{
+   if (TYPEOF(index) != EXTPTRSXP
+         || R_ExternalPtrTag(index) != Rf_install("stri_suffix_index"))
+      Rf_error(MSG__ARG_EXPECTED_SUFFIX_INDEX, "index"); // error() call allowed here
+   StriSuffixIndex* idx = (StriSuffixIndex*)R_ExternalPtrAddr(index);
+   if (!idx)
+      Rf_error(MSG__SUFFIX_INDEX_INVALIDATED); // error() call allowed here
+   return idx;
+}
+
+
+/**
+ * Build a suffix array over a single string
+ *
+ * See stri_suffix_index in R. Companion of stri_trigram_index: that
+ * one answers which of many documents contain a pattern, this one
+ * answers where a pattern occurs inside one long text.
+ *
+ * @param str single string, not NA, nonempty
+ * @return externalptr of class `stri_suffix_index` (finalized on gc),
+ *    with the input kept alive through the protected slot
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_suffix_index(SEXP str)
+{
+   PROTECT(str = stri_prepare_arg_string_1(str, "str"));
+   if (STRING_ELT(str, 0) == NA_STRING) {
+      UNPROTECT(1);
+      Rf_error(MSG__ARG_EXPECTED_NOT_NA, "str"); // error() call allowed here
+   }
+   StriSuffixIndex* idx = NULL;
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   idx = new StriSuffixIndex();
+   if (!idx) throw StriException(MSG__MEM_ALLOC_ERROR);
+   idx->cont = new StriContainerUTF8_indexable(str, 1);
+   if (!idx->cont) throw StriException(MSG__MEM_ALLOC_ERROR);
+
+   stri__suffix_array_build(idx->cont->get(0).c_str(),
+      idx->cont->get(0).length(), idx->sa);
+
+   SEXP ret;
+   STRI__PROTECT(ret = R_MakeExternalPtr(idx,
+      Rf_install("stri_suffix_index"), str));
+   R_RegisterCFinalizerEx(ret, stri__suffix_index_finalizer, TRUE);
+   Rf_setAttrib(ret, R_ClassSymbol, Rf_mkString("stri_suffix_index"));
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({
+      // the finalizer has not been registered yet
+      if (idx) delete idx;
+   })
+}
+
+
+/**
+ * Locate all occurrences of a fixed pattern via the suffix array
+ *
+ * @param index a stri_suffix_index externalptr
+ * @param pattern single string
+ * @param omit_no_match single bool
+ * @param overlap single bool
+ * @return integer matrix (2 columns), occurrences in text order
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_locate_all_suffix(SEXP index, SEXP pattern, SEXP omit_no_match,
+   SEXP overlap)
+{
+   StriSuffixIndex* idx = stri__suffix_index_unwrap(index);
+   bool omit_no_match1 = stri__prepare_arg_logical_1_notNA(omit_no_match, "omit_no_match");
+   bool overlap1 = stri__prepare_arg_logical_1_notNA(overlap, "overlap");
+   PROTECT(pattern = stri_prepare_arg_string_1(pattern, "pattern"));
+   if (STRING_ELT(pattern, 0) == NA_STRING) {
+      UNPROTECT(1);
+      Rf_error(MSG__ARG_EXPECTED_NOT_NA, "pattern"); // error() call allowed here
+   }
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriContainerUTF8 pattern_cont(pattern, 1);
+   const char* p = pattern_cont.get(0).c_str();
+   R_len_t p_len = pattern_cont.get(0).length();
+   if (p_len <= 0)
+      throw StriException(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+
+   const char* s = idx->cont->get(0).c_str();
+   R_len_t n = idx->cont->get(0).length();
+
+   // the suffixes with the pattern as a prefix occupy sa[lo..hi)
+   size_t lo = 0, hi = idx->sa.size();
+   while (lo < hi) { // first suffix with cmp >= 0
+      size_t mid = lo+(hi-lo)/2;
+      if (stri__suffix_cmp(s, n, idx->sa[mid], p, p_len) < 0) lo = mid+1;
+      else hi = mid;
+   }
+   size_t lo2 = lo, hi2 = idx->sa.size();
+   while (lo2 < hi2) { // first suffix with cmp > 0
+      size_t mid = lo2+(hi2-lo2)/2;
+      if (stri__suffix_cmp(s, n, idx->sa[mid], p, p_len) <= 0) lo2 = mid+1;
+      else hi2 = mid;
+   }
+
+   std::vector<int> starts(idx->sa.begin()+lo, idx->sa.begin()+lo2);
+   std::sort(starts.begin(), starts.end()); // sa order -> text order
+   if (!overlap1 && !starts.empty()) {
+      // keep the leftmost of each overlapping cluster, like the
+      // default (non-overlapping) byte-search enumeration
+      size_t kept = 0;
+      int prev_end = -1;
+      for (size_t k=0; k<starts.size(); ++k) {
+         if (starts[k] >= prev_end) {
+            starts[kept++] = starts[k];
+            prev_end = starts[k]+p_len;
+         }
+      }
+      starts.resize(kept);
+   }
+
+   if (starts.empty()) {
+      SEXP nores;
+      STRI__PROTECT(nores = stri__matrix_NA_INTEGER(omit_no_match1?0:1, 2));
+      stri__locate_set_dimnames_matrix(nores);
+      STRI__UNPROTECT_ALL
+      return nores;
+   }
+
+   R_len_t noccurrences = (R_len_t)starts.size();
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocMatrix(INTSXP, noccurrences, 2));
+   stri__locate_set_dimnames_matrix(ret);
+   int* ret_tab = INTEGER(ret);
+   for (R_len_t j=0; j<noccurrences; ++j) {
+      ret_tab[j]               = starts[j];
+      ret_tab[j+noccurrences]  = starts[j]+p_len;
+   }
+
+   // Adjust UTF8 byte index -> UChar32 index
+   idx->cont->UTF8_to_UChar32_index(0, ret_tab,
+         ret_tab+noccurrences, noccurrences,
+         1, // 0-based index -> 1-based
+         0  // end returns position of next character after match
+   );
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END( ;/* do nothing special on error */ )
+}
@@ -0,0 +1,447 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_threads.h"
+
+#ifdef STRI_HAVE_THREADS
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstring>
+#include <new>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#ifdef __linux__
+#include <sched.h>     // cpu_set_t (g++/clang++ predefine _GNU_SOURCE)
+#include <unistd.h>    // sysconf
+#endif
+#endif
+
+
+/** How many worker threads a vectorized loop may use
+ *
+ * Reads \code{getOption("stringi.num_threads")}; anything missing,
+ * non-numeric, or < 1 yields 1 (serial execution). A value of 0 asks
+ * for one thread per available hardware core.
+ *
+ * @param vectorize_length number of elements to be processed
+ * @return number of threads, >= 1, <= vectorize_length
+ */
+int stri__threads_requested(R_len_t vectorize_length)
+{
+#ifndef STRI_HAVE_THREADS
+   return 1;
+#else
+   SEXP val = Rf_GetOption1(Rf_install("stringi.num_threads"));
+   if (Rf_isNull(val))
+      return 1;
+
+   int num_threads = Rf_asInteger(val);
+   if (num_threads == NA_INTEGER || num_threads < 0)
+      return 1;
+   if (num_threads == 0) {
+      num_threads = (int)std::thread::hardware_concurrency();
+      if (num_threads < 1) num_threads = 1;
+   }
+
+   if (vectorize_length < num_threads)
+      num_threads = (vectorize_length > 0)?vectorize_length:1;
+   return num_threads;
+#endif
+}
+
+
+/** Should pool workers be pinned to distinct CPUs?
+ *
+ * Reads \code{getOption("stringi.pin_threads")}, see stri_threads.h;
+ * anything missing or not TRUE yields false.
+ *
+ * @return true if pinning is requested
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+bool stri__threads_pinning_requested()
+{
+#ifndef STRI_HAVE_THREADS
+   return false;
+#else
+   SEXP val = Rf_GetOption1(Rf_install("stringi.pin_threads"));
+   if (Rf_isNull(val))
+      return false;
+   return (Rf_asLogical(val) == TRUE);
+#endif
+}
+
+
+#ifdef STRI_HAVE_THREADS
+
+// The worker pool. Workers are spawned lazily (the serial default
+// never starts any), run detached, and live until the process exits;
+// between jobs they block on pool_cv_work. All of the state below is
+// guarded by pool_mut.
+namespace {
+   int pool_size = 0;
+   std::mutex pool_mut;
+   std::condition_variable pool_cv_work;
+   std::condition_variable pool_cv_done;
+   const std::function<void(int)>* pool_job = NULL;
+   unsigned pool_generation = 0;
+   int pool_pending = 0;  // workers that have not finished the current job
+#ifdef __linux__
+   std::vector<pthread_t> pool_tids; // for (re)pinning detached workers
+   bool pool_pinned = false;
+#endif
+}
+
+
+/** Pin every pool worker to its own CPU - or release them all [internal]
+ *
+ * Worker t goes to CPU (t+1) mod #CPUs (the calling thread notionally
+ * keeps CPU 0); releasing restores the full CPU set. The caller must
+ * hold pool_mut. Failures (e.g. a restricted cpuset) are silently
+ * ignored - pinning is a performance hint, not a contract. Linux-only;
+ * elsewhere this compiles to nothing and the option is ignored.
+ *
+ * @param pin pin (true) or release (false)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__pool_apply_pinning(bool pin)
+{
+#ifdef __linux__
+   long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+   if (ncpu < 1) return;
+   for (size_t t=0; t<pool_tids.size(); ++t) {
+      cpu_set_t mask;
+      CPU_ZERO(&mask);
+      if (pin)
+         CPU_SET((int)(((long)t+1) % ncpu), &mask);
+      else
+         for (long c=0; c<ncpu && c<CPU_SETSIZE; ++c)
+            CPU_SET((int)c, &mask);
+      (void)pthread_setaffinity_np(pool_tids[t], sizeof(mask), &mask);
+   }
+#else
+   (void)pin;
+#endif
+}
+
+
+/** A pool worker's main loop [internal]
+ *
+ * @param id this worker's index within the pool
+ * @param seen the job generation at spawn time
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__pool_worker(int id, unsigned seen)
+{
+   for (;;) {
+      const std::function<void(int)>* job;
+      {
+         std::unique_lock<std::mutex> lock(pool_mut);
+         pool_cv_work.wait(lock, [&]{ return pool_generation != seen; });
+         seen = pool_generation;
+         job = pool_job;
+      }
+
+      (*job)(id); // never throws, see the wrapper in stri__parallel_for
+
+      {
+         std::lock_guard<std::mutex> lock(pool_mut);
+         if (--pool_pending == 0)
+            pool_cv_done.notify_one();
+      }
+   }
+}
+
+
+#ifndef _WIN32
+/** Reset the pool bookkeeping in a forked child [internal]
+ *
+ * Worker threads do not survive fork(), so a child that inherited
+ * pool_size > 0 would wait forever for workers that no longer exist.
+ * At fork time the parent's pool is necessarily idle (jobs only run
+ * while the main thread is blocked inside stri__parallel_for, and
+ * fork() is issued from R), so the child may simply start over: the
+ * synchronization primitives are reconstructed in place - their
+ * post-fork state is unspecified - and the pool respawns lazily on
+ * the child's first parallel call.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__pool_atfork_child()
+{
+   new (&pool_mut) std::mutex();
+   new (&pool_cv_work) std::condition_variable();
+   new (&pool_cv_done) std::condition_variable();
+   pool_size = 0;
+   pool_job = NULL;
+   pool_generation = 0;
+   pool_pending = 0;
+#ifdef __linux__
+   pool_tids.clear();
+   pool_pinned = false;
+#endif
+}
+#endif
+
+
+/** Grow the pool to at least nworkers threads [internal]
+ *
+ * The caller must hold pool_mut.
+ *
+ * @param nworkers number of workers needed
+ * @param pin the stri__threads_pinning_requested() result - affinity
+ *    is (re)applied whenever the setting changed or new workers spawned
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__pool_ensure(int nworkers, bool pin)
+{
+#ifndef _WIN32
+   static bool atfork_registered = false;
+   if (!atfork_registered) { // main R thread only - no race
+      pthread_atfork(NULL, NULL, stri__pool_atfork_child);
+      atfork_registered = true;
+   }
+#endif
+   bool grew = false;
+   while (pool_size < nworkers) {
+      std::thread worker(stri__pool_worker, pool_size, pool_generation);
+#ifdef __linux__
+      pool_tids.push_back(worker.native_handle()); // before detach
+#endif
+      worker.detach();
+      ++pool_size;
+      grew = true;
+   }
+#ifdef __linux__
+   if (pin != pool_pinned || (pin && grew)) {
+      stri__pool_apply_pinning(pin);
+      pool_pinned = pin;
+   }
+#else
+   (void)pin; (void)grew;
+#endif
+}
+
+
+/** Run body(chunk_from, chunk_to, thread_id) over a partition of [0, n)
+ *
+ * See stri_threads.h for the contract (the body must not touch R but
+ * may throw StriException - the first exception recorded by any chunk
+ * is rethrown here, on the calling thread, after all chunks joined).
+ *
+ * @param n number of elements to be processed
+ * @param num_threads number of chunks/threads to use
+ * @param body callable taking (chunk_from, chunk_to, thread_id)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void stri__parallel_for(R_len_t n, int num_threads,
+   const std::function<void(R_len_t, R_len_t, int)>& body)
+{
+   if (n <= 0) return;
+   if (num_threads > n) num_threads = n;
+   if (num_threads <= 1) {
+      // inline; exceptions propagate to the caller's error handler
+      body(0, n, 0);
+      return;
+   }
+   bool pin = stri__threads_pinning_requested(); // R API - before the lock
+
+   // the error-capture protocol: workers store the first failure here
+   // (just its message - StriException carries no other state) and the
+   // calling thread converts it back into a throw once everyone is done
+   char errmsg[StriException_BUFSIZE];
+   bool have_err = false;
+   std::mutex err_mut;
+   auto record_err = [&](const char* msg) {
+      std::lock_guard<std::mutex> lock(err_mut);
+      if (!have_err) {
+         have_err = true;
+         strncpy(errmsg, msg, StriException_BUFSIZE-1);
+         errmsg[StriException_BUFSIZE-1] = '\0';
+      }
+   };
+
+   std::function<void(int)> job = [&](int id) {
+      int t = id+1; // the calling thread takes chunk 0
+      if (t >= num_threads) return; // pool may be larger than this job
+      R_len_t chunk_from = (R_len_t)((double)n*t/num_threads);
+      R_len_t chunk_to   = (R_len_t)((double)n*(t+1)/num_threads);
+      try {
+         body(chunk_from, chunk_to, t);
+      }
+      catch (StriException e)     { record_err(e.getMessage()); }
+      catch (std::exception& e)   { record_err(e.what()); }
+      catch (...)                 { record_err(MSG__INTERNAL_ERROR); }
+   };
+
+   {
+      std::lock_guard<std::mutex> lock(pool_mut);
+      stri__pool_ensure(num_threads-1, pin);
+      pool_job = &job;
+      pool_pending = pool_size; // extra workers wake, see t >= num_threads
+      ++pool_generation;
+   }
+   pool_cv_work.notify_all();
+
+   try {
+      body(0, (R_len_t)((double)n/num_threads), 0);
+   }
+   catch (StriException e)     { record_err(e.getMessage()); }
+   catch (std::exception& e)   { record_err(e.what()); }
+   catch (...)                 { record_err(MSG__INTERNAL_ERROR); }
+
+   {
+      std::unique_lock<std::mutex> lock(pool_mut);
+      pool_cv_done.wait(lock, []{ return pool_pending == 0; });
+      pool_job = NULL;
+   }
+
+   if (have_err)
+      throw StriException("%s", errmsg);
+}
+
+
+// how many chunks each thread gets on average; more chunks mean finer
+// stealing granularity at the cost of queue traffic
+#define STRI__STEAL_CHUNKS_PER_THREAD 8
+
+
+/** Run body over weight-balanced chunks of [0, n), stealing from a
+ *  shared queue
+ *
+ * See stri_threads.h for the contract. The chunk boundaries are cut so
+ * that each chunk carries about 1/(num_threads*8) of the total weight;
+ * an element heavier than that gets a chunk of its own, so the rest of
+ * the input stays stealable while one thread chews on it. Claiming a
+ * chunk is a single fetch_add on an atomic cursor.
+ *
+ * @param n number of elements to be processed
+ * @param num_threads number of threads to use
+ * @param sizes per-element weights, length n (negative treated as 0)
+ * @param body callable taking (chunk_from, chunk_to, thread_id)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+void stri__parallel_for_weighted(R_len_t n, int num_threads,
+   const R_len_t* sizes,
+   const std::function<void(R_len_t, R_len_t, int)>& body)
+{
+   if (n <= 0) return;
+   if (num_threads > n) num_threads = n;
+   if (num_threads <= 1) {
+      body(0, n, 0);
+      return;
+   }
+   bool pin = stri__threads_pinning_requested(); // R API - before the lock
+
+   // cut [0, n) into chunks of roughly equal total weight; the +1 per
+   // element bounds the element count of a chunk of empty strings
+   uint64_t total = 0;
+   for (R_len_t i=0; i<n; ++i)
+      total += (uint64_t)((sizes[i] > 0)?sizes[i]:0) + 1;
+   uint64_t target = total/(uint64_t)(num_threads*STRI__STEAL_CHUNKS_PER_THREAD);
+   if (target < 1) target = 1;
+
+   std::vector<R_len_t> bnd; // chunk c covers [bnd[c], bnd[c+1])
+   bnd.push_back(0);
+   uint64_t acc = 0;
+   for (R_len_t i=0; i<n; ++i) {
+      acc += (uint64_t)((sizes[i] > 0)?sizes[i]:0) + 1;
+      if (acc >= target) {
+         bnd.push_back(i+1);
+         acc = 0;
+      }
+   }
+   if (bnd.back() != n) bnd.push_back(n);
+   int num_chunks = (int)bnd.size()-1;
+
+   char errmsg[StriException_BUFSIZE];
+   bool have_err = false;
+   std::mutex err_mut;
+   auto record_err = [&](const char* msg) {
+      std::lock_guard<std::mutex> lock(err_mut);
+      if (!have_err) {
+         have_err = true;
+         strncpy(errmsg, msg, StriException_BUFSIZE-1);
+         errmsg[StriException_BUFSIZE-1] = '\0';
+      }
+   };
+
+   std::atomic<int> next_chunk(0);
+   auto run_chunks = [&](int t) {
+      try {
+         for (;;) {
+            int c = next_chunk.fetch_add(1, std::memory_order_relaxed);
+            if (c >= num_chunks) break;
+            body(bnd[c], bnd[c+1], t);
+         }
+      }
+      catch (StriException e)     { record_err(e.getMessage()); }
+      catch (std::exception& e)   { record_err(e.what()); }
+      catch (...)                 { record_err(MSG__INTERNAL_ERROR); }
+   };
+
+   std::function<void(int)> job = [&](int id) {
+      int t = id+1; // the calling thread takes part as thread 0
+      if (t >= num_threads) return; // pool may be larger than this job
+      run_chunks(t);
+   };
+
+   {
+      std::lock_guard<std::mutex> lock(pool_mut);
+      stri__pool_ensure(num_threads-1, pin);
+      pool_job = &job;
+      pool_pending = pool_size; // extra workers wake, see t >= num_threads
+      ++pool_generation;
+   }
+   pool_cv_work.notify_all();
+
+   run_chunks(0);
+
+   {
+      std::unique_lock<std::mutex> lock(pool_mut);
+      pool_cv_done.wait(lock, []{ return pool_pending == 0; });
+      pool_job = NULL;
+   }
+
+   if (have_err)
+      throw StriException("%s", errmsg);
+}
+
+#endif
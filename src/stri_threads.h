@@ -0,0 +1,161 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2019, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_threads_h
+#define __stri_threads_h
+
+
+// THREADING AND FORK SAFETY
+//
+// Package-global mutable state falls into three classes, and every
+// new cache must pick one:
+//
+//  1. main-R-thread-only: the break iterator / collator / compiled
+//     regex / ucasemap caches and the prepared-argument handles. They
+//     are read and written exclusively between entering and leaving a
+//     .Call, on the thread that runs R; stri__parallel_for bodies must
+//     not touch them (nor anything else from R's API).
+//  2. per-thread: the scratch buffer pool (thread_local, see
+//     stri_bufpool.cpp) - no sharing, no locks.
+//  3. pool bookkeeping below - the only state shared across threads;
+//     mutex-guarded, and reinitialized in a forked child via
+//     pthread_atfork (worker threads do not survive fork(), so e.g.
+//     parallel::mclapply children start over with an empty pool and
+//     respawn workers lazily).
+//
+// Forked R workers therefore need no locking at all: each child gets
+// its own copy of the class-1/2 state, and class 3 resets itself.
+//
+// C++11 is optional in stringi (see configure's --disable-cxx11);
+// without it all parallel execution paths compile down to the serial ones
+#if defined(__cplusplus) && __cplusplus >= 201103L && !defined(STRI_DISABLE_THREADS)
+#define STRI_HAVE_THREADS 1
+#include <thread>
+#include <vector>
+#include <functional>
+#endif
+
+
+/**
+ * How many worker threads a vectorized loop may use
+ *
+ * Parallel execution is strictly opt-in:
+ * \code{options(stringi.num_threads=...)} - the default is 1 (serial).
+ *
+ * Call from the main R thread only (reads R options).
+ *
+ * @param vectorize_length number of elements to be processed
+ * @return number of threads, >= 1, <= vectorize_length
+ */
+int stri__threads_requested(R_len_t vectorize_length);
+
+
+/**
+ * Should pool workers be pinned to distinct CPUs?
+ *
+ * Reads \code{options(stringi.pin_threads=...)}; the default is FALSE
+ * (workers migrate freely). With pinning on, worker t is bound to CPU
+ * (t+1) mod #CPUs, so on a multi-socket machine the workers spread
+ * over the nodes and stay put; together with the per-thread scratch
+ * pool (stri_bufpool.cpp), whose buffers are allocated - and hence
+ * first-touched - by the worker that uses them, this keeps each
+ * worker's hot memory on its own NUMA node. Only effective on Linux;
+ * elsewhere the option is accepted and ignored.
+ *
+ * Call from the main R thread only (reads R options).
+ *
+ * @return true if pinning is requested
+ */
+bool stri__threads_pinning_requested();
+
+
+#ifdef STRI_HAVE_THREADS
+
+/**
+ * Run \code{body(chunk_from, chunk_to, thread_id)} over a contiguous
+ * partition of \code{[0, n)}
+ *
+ * The work is spread over \code{num_threads} chunks (normally the
+ * value of stri__threads_requested); the calling thread processes the
+ * first chunk itself, the rest go to a managed pool of worker threads
+ * that persists between calls, so a vectorized loop pays no thread
+ * start-up cost after the first parallel call. With
+ * \code{num_threads <= 1} the body simply runs inline.
+ *
+ * The body must not touch R (no allocation, no SET_STRING_ELT, no
+ * warnings), but it MAY throw StriException: exceptions are caught
+ * and recorded per worker, and the first one recorded is rethrown on
+ * the calling thread after all chunks have finished - so a call site
+ * wrapped in STRI__ERROR_HANDLER_BEGIN/END handles parallel failures
+ * exactly like serial ones.
+ *
+ * Call from the main R thread only; do not nest.
+ *
+ * @param n number of elements to be processed
+ * @param num_threads number of chunks/threads to use
+ * @param body callable taking (chunk_from, chunk_to, thread_id)
+ */
+void stri__parallel_for(R_len_t n, int num_threads,
+   const std::function<void(R_len_t, R_len_t, int)>& body);
+
+
+/**
+ * Like stri__parallel_for, but with size-aware chunking and work
+ * stealing
+ *
+ * Static range partitioning load-imbalances badly when element sizes
+ * are skewed (one huge document serializes the whole call). Here the
+ * range is cut into many small contiguous chunks of roughly equal
+ * total weight - \code{sizes[i]} is typically the element's byte
+ * count, a la StriContainerUTF8::getMaxNumBytes - and the chunks are
+ * claimed from a shared queue: a thread that finishes early steals the
+ * next unclaimed chunk instead of idling. An element heavier than a
+ * chunk's worth becomes a chunk of its own.
+ *
+ * Chunks are contiguous, disjoint, and cover [0, n), but the order in
+ * which they run - and which thread runs them - is not deterministic;
+ * the body contract is otherwise exactly that of stri__parallel_for.
+ *
+ * Call from the main R thread only; do not nest.
+ *
+ * @param n number of elements to be processed
+ * @param num_threads number of threads to use
+ * @param sizes per-element weights, length n (negative treated as 0)
+ * @param body callable taking (chunk_from, chunk_to, thread_id)
+ */
+void stri__parallel_for_weighted(R_len_t n, int num_threads,
+   const R_len_t* sizes,
+   const std::function<void(R_len_t, R_len_t, int)>& body);
+
+#endif
+
+#endif
@@ -36,6 +36,8 @@
 #include "stri_container_integer.h"
 #include <unicode/calendar.h>
 #include <unicode/gregocal.h>
+#include <unicode/uloc.h>
+#include <cstring>
 
 
 /** Set POSIXct class on a given object
@@ -72,6 +74,80 @@ SEXP stri_datetime_now()
 }
 
 
+/** A Calendar factory with a small cache of master instances
+ *
+ * Calendar::createInstance reloads locale and time zone data on each
+ * call, which dominates short vectorized calls issued in a tight loop.
+ * Master instances are kept per (locale, time zone ID) and handed out
+ * as clones, so the caller may freely mutate (setTime, set, setLenient)
+ * and delete what it gets back; the masters themselves are never
+ * touched after construction. Not thread-safe - called from the main
+ * R thread only, like the other caches in this package.
+ *
+ * On success the time zone is consumed: a new master adopts it, a cache
+ * hit deletes it (the cached master already carries an equal zone). If
+ * status signals failure, tz_val is left with the caller.
+ *
+ * @param locale_val locale identifier
+ * @param tz_val time zone; set to NULL once ownership has been taken
+ * @param status
+ * @return a calendar owned by the caller, or NULL on error
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static Calendar* stri__calendar_obtain(const char* locale_val,
+   TimeZone*& tz_val, UErrorCode& status)
+{
+#define STRI__CALENDAR_CACHE_SIZE 4
+   struct StriCachedCalendar {
+      char locale[ULOC_FULLNAME_CAPACITY];
+      UnicodeString tzid;
+      Calendar* cal;
+      StriCachedCalendar() : tzid(), cal(NULL) { locale[0] = '\0'; }
+   };
+   static StriCachedCalendar cache[STRI__CALENDAR_CACHE_SIZE];
+   static int cache_next = 0;
+
+   if (U_FAILURE(status)) return NULL;
+
+   UnicodeString tzid;
+   tz_val->getID(tzid);
+
+   bool cacheable = (locale_val && strlen(locale_val) < ULOC_FULLNAME_CAPACITY);
+   if (cacheable) {
+      for (int k=0; k<STRI__CALENDAR_CACHE_SIZE; ++k) {
+         if (cache[k].cal && cache[k].tzid == tzid
+               && !strcmp(cache[k].locale, locale_val)) {
+            delete tz_val; // the cached master carries an equal zone
+            tz_val = NULL;
+            return cache[k].cal->clone();
+         }
+      }
+   }
+
+   Calendar* master = Calendar::createInstance(locale_val, status);
+   if (U_FAILURE(status)) {
+      if (master) delete master;
+      return NULL; // tz_val still owned by the caller
+   }
+   master->adoptTimeZone(tz_val);
+   tz_val = NULL; /* The Calendar takes ownership of the TimeZone. */
+
+   Calendar* ret = master->clone();
+   if (!ret || !cacheable) {
+      delete master; // not caching this one
+      return ret;
+   }
+
+   if (cache[cache_next].cal) delete cache[cache_next].cal;
+   strcpy(cache[cache_next].locale, locale_val);
+   cache[cache_next].tzid = tzid;
+   cache[cache_next].cal = master;
+   cache_next = (cache_next+1) % STRI__CALENDAR_CACHE_SIZE;
+   return ret;
+}
+
+
 /** Date-time artithmetic
  *
  * @param time
@@ -84,6 +160,7 @@ SEXP stri_datetime_now()
  *
  * @version 0.5-1 (Marek Gagolewski, 2014-12-30)
  * @version 0.5-1 (Marek Gagolewski, 2015-03-06) tz arg added
+ * @version 1.4.6 (2020-01-24) calendars reused via stri__calendar_obtain
  */
 SEXP stri_datetime_add(SEXP time, SEXP value, SEXP units, SEXP tz, SEXP locale) {
    PROTECT(time = stri_prepare_arg_POSIXct(time, "time"));
@@ -120,11 +197,9 @@ SEXP stri_datetime_add(SEXP time, SEXP value, SEXP units, SEXP tz, SEXP locale)
    }
 
    UErrorCode status = U_ZERO_ERROR;
-   cal = Calendar::createInstance(locale_val, status);
+   cal = stri__calendar_obtain(locale_val, tz_val, status);
    STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
-
-   cal->adoptTimeZone(tz_val);
-   tz_val = NULL; /* The Calendar takes ownership of the TimeZone. */
+   if (!cal) throw StriException(MSG__MEM_ALLOC_ERROR);
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(REALSXP, vectorize_length));
@@ -171,6 +246,7 @@ SEXP stri_datetime_add(SEXP time, SEXP value, SEXP units, SEXP tz, SEXP locale)
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-01-01)
  * @version 0.5-1 (Marek Gagolewski, 2015-03-03) tz arg added
+ * @version 1.4.6 (2020-01-24) calendars reused via stri__calendar_obtain
  */
 SEXP stri_datetime_fields(SEXP time, SEXP tz, SEXP locale) {
    PROTECT(time = stri_prepare_arg_POSIXct(time, "time"));
@@ -185,11 +261,9 @@ SEXP stri_datetime_fields(SEXP time, SEXP tz, SEXP locale) {
    StriContainerDouble time_cont(time, vectorize_length);
 
    UErrorCode status = U_ZERO_ERROR;
-   cal = Calendar::createInstance(locale_val, status);
+   cal = stri__calendar_obtain(locale_val, tz_val, status);
    STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
-
-   cal->adoptTimeZone(tz_val);
-   tz_val = NULL; /* The Calendar takes ownership of the TimeZone. */
+   if (!cal) throw StriException(MSG__MEM_ALLOC_ERROR);
 
    SEXP ret;
 #define STRI__FIELDS_NUM 14
@@ -279,6 +353,7 @@ SEXP stri_datetime_fields(SEXP time, SEXP tz, SEXP locale) {
  * @version 0.5-1 (Marek Gagolewski, 2015-01-11) lenient arg added
  * @version 0.5-1 (Marek Gagolewski, 2015-03-02) tz arg added
  * @version 1.1.2 (Marek Gagolewski, 2016-09-30) round() is not C++98
+ * @version 1.4.6 (2020-01-24) calendars reused via stri__calendar_obtain
  */
 SEXP stri_datetime_create(SEXP year, SEXP month, SEXP day, SEXP hour,
    SEXP minute, SEXP second, SEXP lenient, SEXP tz, SEXP locale)
@@ -309,13 +384,11 @@ SEXP stri_datetime_create(SEXP year, SEXP month, SEXP day, SEXP hour,
    StriContainerDouble second_cont(second, vectorize_length);
 
    UErrorCode status = U_ZERO_ERROR;
-   cal = Calendar::createInstance(locale_val, status);
+   cal = stri__calendar_obtain(locale_val, tz_val, status);
    STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+   if (!cal) throw StriException(MSG__MEM_ALLOC_ERROR);
 
-   cal->setLenient(lenient_val);
-
-   cal->adoptTimeZone(tz_val);
-   tz_val = NULL; /* The Calendar takes ownership of the TimeZone. */
+   cal->setLenient(lenient_val); // on our private copy only
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(REALSXP, vectorize_length));
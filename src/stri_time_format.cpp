@@ -37,48 +37,31 @@
 #include <unicode/calendar.h>
 #include <unicode/gregocal.h>
 #include <unicode/smpdtfmt.h>
+#include "stri_threads.h"
+#include <unicode/uloc.h>
+#include <vector>
+#include <string>
+#include <cstring>
 
 
-/**
- * Format date-time objects
+/** Construct a DateFormat for a given format specifier
  *
- * @param time
- * @param format
- * @param tz
- * @param locale
+ * Factored out of stri_datetime_format and stri_datetime_parse, which
+ * used to build identical objects with duplicated code.
  *
- * @return character vector
- *
- * @version 0.5-1 (Marek Gagolewski, 2015-01-05)
+ * @param format_cur index into the named-style list, or -1
+ * @param format_str pattern (used when format_cur < 0)
+ * @param locale_val locale identifier
+ * @param status
+ * @return a new DateFormat owned by the caller, or NULL on error
  *
- * @version 0.5-1 (Marek Gagolewski, 2015-02-22)
- *    use tz
+ * @version 1.4.6 (2020-01-24)
  */
-SEXP stri_datetime_format(SEXP time, SEXP format, SEXP tz, SEXP locale) {
-   PROTECT(time = stri_prepare_arg_POSIXct(time, "time"));
-   const char* locale_val = stri__prepare_arg_locale(locale, "locale", true);
-   const char* format_val = stri__prepare_arg_string_1_notNA(format, "format");
-
-   // "format" may be one of:
-   const char* format_opts[] = {
-      "date_full", "date_long", "date_medium", "date_short",
-      "date_relative_full", "date_relative_long", "date_relative_medium", "date_relative_short",
-      "time_full", "time_long", "time_medium", "time_short",
-      "time_relative_full", "time_relative_long", "time_relative_medium", "time_relative_short",
-      "datetime_full", "datetime_long", "datetime_medium", "datetime_short",
-      "datetime_relative_full", "datetime_relative_long", "datetime_relative_medium", "datetime_relative_short",
-      NULL};
-   int format_cur = stri__match_arg(format_val, format_opts);
-
-   TimeZone* tz_val = stri__prepare_arg_timezone(tz, "tz", true/*allowdefault*/);
-   Calendar* cal = NULL;
+static DateFormat* stri__dateformat_create(int format_cur,
+   const UnicodeString& format_str, const char* locale_val, UErrorCode& status)
+{
+   if (U_FAILURE(status)) return NULL;
    DateFormat* fmt = NULL;
-   STRI__ERROR_HANDLER_BEGIN(1)
-   R_len_t vectorize_length = LENGTH(time);
-   StriContainerDouble time_cont(time, vectorize_length);
-   UnicodeString format_str(format_val);
-
-   UErrorCode status = U_ZERO_ERROR;
    if (format_cur >= 0) {
       DateFormat::EStyle style = DateFormat::kNone;
       switch (format_cur % 8) {
@@ -120,7 +103,128 @@ SEXP stri_datetime_format(SEXP time, SEXP format, SEXP tz, SEXP locale) {
    }
    else
       fmt = new SimpleDateFormat(format_str, Locale::createFromName(locale_val), status);
+   return fmt;
+}
+
+
+/** A DateFormat factory with a small cache of master instances
+ *
+ * Pattern compilation (and, for the named styles, the locale resource
+ * lookup) is paid once per distinct (format, locale) pair; repeat calls
+ * receive clones of the cached master. The time zone takes no part in
+ * the key on purpose: formatting and parsing here always go through an
+ * explicit Calendar argument, and the Calendar is what carries the zone
+ * (see stri__calendar_obtain in stri_time_calendar.cpp). Masters are
+ * never mutated after construction, so a clone behaves exactly like a
+ * freshly built formatter. Main R thread only, like the other caches.
+ *
+ * @param format_cur index into the named-style list, or -1
+ * @param format_str pattern (used when format_cur < 0)
+ * @param format_val the format argument as given - the cache key
+ * @param locale_val locale identifier
+ * @param status
+ * @return a DateFormat owned by the caller, or NULL on error
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static DateFormat* stri__dateformat_obtain(int format_cur,
+   const UnicodeString& format_str, const char* format_val,
+   const char* locale_val, UErrorCode& status)
+{
+#define STRI__DATEFORMAT_CACHE_SIZE 4
+   struct StriCachedDateFormat {
+      std::string format;
+      char locale[ULOC_FULLNAME_CAPACITY];
+      DateFormat* fmt;
+      StriCachedDateFormat() : format(), fmt(NULL) { locale[0] = '\0'; }
+   };
+   static StriCachedDateFormat cache[STRI__DATEFORMAT_CACHE_SIZE];
+   static int cache_next = 0;
+
+   if (U_FAILURE(status)) return NULL;
+
+   bool cacheable = (format_val && locale_val
+      && strlen(locale_val) < ULOC_FULLNAME_CAPACITY);
+   if (cacheable) {
+      for (int k=0; k<STRI__DATEFORMAT_CACHE_SIZE; ++k) {
+         if (cache[k].fmt && cache[k].format.compare(format_val) == 0
+               && !strcmp(cache[k].locale, locale_val))
+            return (DateFormat*)cache[k].fmt->clone();
+      }
+   }
+
+   DateFormat* master =
+      stri__dateformat_create(format_cur, format_str, locale_val, status);
+   if (U_FAILURE(status) || !master) {
+      if (master) delete master;
+      return NULL;
+   }
+   if (!cacheable) return master;
+
+   DateFormat* ret = (DateFormat*)master->clone();
+   if (!ret) return master; // hand out the master itself, skip caching
+
+   if (cache[cache_next].fmt) delete cache[cache_next].fmt;
+   cache[cache_next].format.assign(format_val);
+   strcpy(cache[cache_next].locale, locale_val);
+   cache[cache_next].fmt = master;
+   cache_next = (cache_next+1) % STRI__DATEFORMAT_CACHE_SIZE;
+   return ret;
+}
+
+
+/**
+ * Format date-time objects
+ *
+ * @param time
+ * @param format
+ * @param tz
+ * @param locale
+ *
+ * @return character vector
+ *
+ * @version 0.5-1 (Marek Gagolewski, 2015-01-05)
+ *
+ * @version 0.5-1 (Marek Gagolewski, 2015-02-22)
+ *    use tz
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    long vectors may be formatted by several threads, each with its
+ *    own DateFormat/Calendar clone (opt-in, see
+ *    options(stringi.num_threads=...))
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    formatters reused via stri__dateformat_obtain
+ */
+SEXP stri_datetime_format(SEXP time, SEXP format, SEXP tz, SEXP locale) {
+   PROTECT(time = stri_prepare_arg_POSIXct(time, "time"));
+   const char* locale_val = stri__prepare_arg_locale(locale, "locale", true);
+   const char* format_val = stri__prepare_arg_string_1_notNA(format, "format");
+
+   // "format" may be one of:
+   const char* format_opts[] = {
+      "date_full", "date_long", "date_medium", "date_short",
+      "date_relative_full", "date_relative_long", "date_relative_medium", "date_relative_short",
+      "time_full", "time_long", "time_medium", "time_short",
+      "time_relative_full", "time_relative_long", "time_relative_medium", "time_relative_short",
+      "datetime_full", "datetime_long", "datetime_medium", "datetime_short",
+      "datetime_relative_full", "datetime_relative_long", "datetime_relative_medium", "datetime_relative_short",
+      NULL};
+   int format_cur = stri__match_arg(format_val, format_opts);
+
+   TimeZone* tz_val = stri__prepare_arg_timezone(tz, "tz", true/*allowdefault*/);
+   Calendar* cal = NULL;
+   DateFormat* fmt = NULL;
+   STRI__ERROR_HANDLER_BEGIN(1)
+   R_len_t vectorize_length = LENGTH(time);
+   StriContainerDouble time_cont(time, vectorize_length);
+   UnicodeString format_str(format_val);
+
+   UErrorCode status = U_ZERO_ERROR;
+   fmt = stri__dateformat_obtain(format_cur, format_str, format_val,
+      locale_val, status);
    STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+   if (!fmt) throw StriException(MSG__MEM_ALLOC_ERROR);
 
    status = U_ZERO_ERROR;
    cal = Calendar::createInstance(locale_val, status);
@@ -131,6 +235,72 @@ SEXP stri_datetime_format(SEXP time, SEXP format, SEXP tz, SEXP locale) {
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
+
+#ifdef STRI_HAVE_THREADS
+   int num_threads = stri__threads_requested(vectorize_length);
+   if (num_threads >= 2) {
+      // per-thread DateFormat/Calendar clones, all created up front on
+      // the main thread; workers format into plain UTF-8 buffers and
+      // the CHARSXPs are interned serially afterwards (workers shall
+      // not touch R)
+      std::vector<Calendar*> cals(num_threads, (Calendar*)NULL);
+      std::vector<DateFormat*> fmts(num_threads, (DateFormat*)NULL);
+      bool clones_ok = true;
+      for (int t=0; t<num_threads && clones_ok; ++t) {
+         cals[t] = cal->clone();
+         fmts[t] = (DateFormat*)fmt->clone();
+         if (!cals[t] || !fmts[t]) clones_ok = false;
+      }
+
+      if (clones_ok) {
+         std::vector<std::string> out((size_t)vectorize_length);
+         try {
+            stri__parallel_for(vectorize_length, num_threads,
+               [&time_cont, &cals, &fmts, &out]
+               (R_len_t chunk_from, R_len_t chunk_to, int tid) {
+                  Calendar* mycal = cals[tid];
+                  DateFormat* myfmt = fmts[tid];
+                  UnicodeString out16;
+                  for (R_len_t i=chunk_from; i<chunk_to; ++i) {
+                     if (time_cont.isNA(i)) continue;
+                     UErrorCode status = U_ZERO_ERROR;
+                     mycal->setTime((UDate)(time_cont.get(i)*1000.0), status);
+                     if (U_FAILURE(status)) throw StriException(status);
+                     FieldPosition pos;
+                     out16.remove();
+                     myfmt->format(*mycal, out16, pos);
+                     out16.toUTF8String(out[i]);
+                  }
+               });
+         }
+         catch (...) {
+            for (int t=0; t<num_threads; ++t) { delete cals[t]; delete fmts[t]; }
+            throw;
+         }
+         for (int t=0; t<num_threads; ++t) { delete cals[t]; delete fmts[t]; }
+
+         for (R_len_t i=0; i<vectorize_length; ++i) {
+            if (time_cont.isNA(i))
+               SET_STRING_ELT(ret, i, NA_STRING);
+            else
+               SET_STRING_ELT(ret, i, Rf_mkCharLenCE(out[i].c_str(),
+                  (int)out[i].size(), (cetype_t)CE_UTF8));
+         }
+
+         if (fmt) { delete fmt; fmt = NULL; }
+         if (cal) { delete cal; cal = NULL; }
+         STRI__UNPROTECT_ALL
+         return ret;
+      }
+
+      for (int t=0; t<num_threads; ++t) {
+         if (cals[t]) delete cals[t];
+         if (fmts[t]) delete fmts[t];
+      }
+      /* clone failed - fall back to the serial loop below */
+   }
+#endif
+
    for (R_len_t i=0; i<vectorize_length; ++i) {
       if (time_cont.isNA(i)) {
          SET_STRING_ELT(ret, i, NA_STRING);
@@ -163,6 +333,130 @@ SEXP stri_datetime_format(SEXP time, SEXP format, SEXP tz, SEXP locale) {
 }
 
 
+/** Compile a positional digit-extraction template for a date pattern
+ *
+ * Homogeneous machine-generated timestamps ("2015-01-02T13:14:15Z"
+ * shapes) do not need the full ICU parser per element. A pattern made
+ * of plain numeric fields (y, M <= 2, d, H, m, s) and literals
+ * compiles into a flat op list: op_field[k] holds the UCAL_* field (or
+ * -1 for a literal), op_arg[k] the field width in digits (or the
+ * literal UChar). Anything else - month names, era, fractional
+ * seconds, zone designators, two-digit years (century pivot) - makes
+ * the pattern ineligible and the caller keeps calling ICU.
+ *
+ * @param pattern date-time pattern
+ * @param op_field, op_arg [out] compiled template
+ * @return true if the whole pattern compiled
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static bool stri__datetime_parse_compile(const UnicodeString& pattern,
+   std::vector<int>& op_field, std::vector<int>& op_arg)
+{
+   int32_t n = pattern.length();
+   bool any_field = false;
+   for (int32_t p=0; p<n; ) {
+      UChar c = pattern.charAt(p);
+      if (c == 0x27) { // quoted literal; '' stands for the quote itself
+         if (p+1 < n && pattern.charAt(p+1) == 0x27) {
+            op_field.push_back(-1); op_arg.push_back(0x27); p += 2; continue;
+         }
+         ++p;
+         bool closed = false;
+         while (p < n) {
+            UChar q = pattern.charAt(p);
+            if (q == 0x27) {
+               if (p+1 < n && pattern.charAt(p+1) == 0x27) {
+                  op_field.push_back(-1); op_arg.push_back(0x27); p += 2; continue;
+               }
+               ++p; closed = true; break;
+            }
+            op_field.push_back(-1); op_arg.push_back((int)q); ++p;
+         }
+         if (!closed) return false;
+      }
+      else if ((c >= 0x61 && c <= 0x7a) || (c >= 0x41 && c <= 0x5a)) {
+         int field;
+         switch ((char)c) {
+            case 'y': field = UCAL_EXTENDED_YEAR; break;
+            case 'M': field = UCAL_MONTH;         break;
+            case 'd': field = UCAL_DAY_OF_MONTH;  break;
+            case 'H': field = UCAL_HOUR_OF_DAY;   break;
+            case 'm': field = UCAL_MINUTE;        break;
+            case 's': field = UCAL_SECOND;        break;
+            default: return false;
+         }
+         int width = 0;
+         while (p < n && pattern.charAt(p) == c) { ++width; ++p; }
+         if (width > 9) return false;            // would overflow int
+         if (c == 0x4d /*M*/ && width > 2) return false; // month names
+         if (c == 0x79 /*y*/ && width == 2) return false; // century pivot
+         op_field.push_back(field); op_arg.push_back(width);
+         any_field = true;
+      }
+      else {
+         op_field.push_back(-1); op_arg.push_back((int)c); ++p;
+      }
+   }
+   return any_field;
+}
+
+
+/** Apply a compiled parse template to one element
+ *
+ * Validates the whole element first and only then touches the
+ * calendar, so a shape mismatch leaves the calendar exactly as the
+ * full parser would find it. A numeric field accepts extra digits
+ * (beyond its pattern width) only when followed by a literal or the
+ * end of input - adjacent fields keep their fixed widths, like in ICU.
+ *
+ * @param cur element text
+ * @param op_field, op_arg compiled template
+ * @param cal [in/out] calendar to fill
+ * @return false on shape mismatch (the caller then parses via ICU)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static bool stri__datetime_parse_apply(const UnicodeString& cur,
+   const std::vector<int>& op_field, const std::vector<int>& op_arg,
+   Calendar* cal)
+{
+   int32_t n = cur.length();
+   int32_t p = 0;
+   size_t nops = op_field.size();
+   int vals[32]; // <= 6 distinct field letters, but literals count too
+   if (nops > 32) return false;
+   for (size_t k=0; k<nops; ++k) {
+      if (op_field[k] < 0) {
+         if (p >= n || cur.charAt(p) != (UChar)op_arg[k]) return false;
+         ++p;
+         continue;
+      }
+      bool greedy = (k+1 == nops || op_field[k+1] < 0);
+      int width = op_arg[k];
+      int got = 0;
+      int v = 0;
+      while (p < n && got < (greedy ? 9 : width)) {
+         UChar c = cur.charAt(p);
+         if (c < 0x30 || c > 0x39) break; // ASCII digits only here
+         v = v*10 + (int)(c - 0x30);
+         ++got; ++p;
+      }
+      if (got < width) return false;
+      vals[k] = v;
+   }
+   if (p != n) return false; // trailing garbage
+
+   for (size_t k=0; k<nops; ++k) {
+      if (op_field[k] < 0) continue;
+      int v = vals[k];
+      if (op_field[k] == UCAL_MONTH) --v;
+      cal->set((UCalendarDateFields)op_field[k], v);
+   }
+   return true;
+}
+
+
 /**
  * Parse date-time objects
  *
@@ -178,6 +472,11 @@ SEXP stri_datetime_format(SEXP time, SEXP format, SEXP tz, SEXP locale) {
  * @version 0.5-1 (Marek Gagolewski, 2015-01-11) lenient arg added
  * @version 0.5-1 (Marek Gagolewski, 2015-02-22) use tz
  * @version 0.5-1 (Marek Gagolewski, 2015-03-01) set tzone attrib on retval
+ * @version 1.4.6 (2020-01-24) formatters reused via stri__dateformat_obtain
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    numeric-only patterns take a positional digit-extraction fast
+ *    path once its answer has been verified against the full parser
  */
 SEXP stri_datetime_parse(SEXP str, SEXP format, SEXP lenient, SEXP tz, SEXP locale) {
    PROTECT(str = stri_prepare_arg_string(str, "str"));
@@ -207,46 +506,10 @@ SEXP stri_datetime_parse(SEXP str, SEXP format, SEXP lenient, SEXP tz, SEXP loca
    UnicodeString format_str(format_val);
 
    UErrorCode status = U_ZERO_ERROR;
-   if (format_cur >= 0) {
-      DateFormat::EStyle style = DateFormat::kNone;
-      switch (format_cur % 8) {
-         case 0:  style = DateFormat::kFull; break;
-         case 1:  style = DateFormat::kLong; break;
-         case 2:  style = DateFormat::kMedium; break;
-         case 3:  style = DateFormat::kShort; break;
-         case 4:  style = DateFormat::kFullRelative; break;
-         case 5:  style = DateFormat::kLongRelative; break;
-         case 6:  style = DateFormat::kMediumRelative; break;
-         case 7:  style = DateFormat::kShortRelative; break;
-         default: style = DateFormat::kNone; break;
-      }
-
-      /* ICU 54.1: Relative time styles are not currently supported.  */
-      switch (format_cur / 8) {
-         case 0:
-            fmt = DateFormat::createDateInstance(style, Locale::createFromName(locale_val));
-            break;
-
-         case 1:
-            fmt = DateFormat::createTimeInstance((DateFormat::EStyle)(style & ~DateFormat::kRelative),
-               Locale::createFromName(locale_val));
-            break;
-
-         case 2:
-            fmt = DateFormat::createDateTimeInstance(style,
-               (DateFormat::EStyle)(style & ~DateFormat::kRelative),
-               Locale::createFromName(locale_val));
-            break;
-
-         default:
-            fmt = NULL;
-            break;
-
-      }
-   }
-   else
-      fmt = new SimpleDateFormat(format_str, Locale::createFromName(locale_val), status);
+   fmt = stri__dateformat_obtain(format_cur, format_str, format_val,
+      locale_val, status);
    STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+   if (!fmt) throw StriException(MSG__MEM_ALLOC_ERROR);
 
    status = U_ZERO_ERROR;
    cal = Calendar::createInstance(locale_val, status);
@@ -257,6 +520,13 @@ SEXP stri_datetime_parse(SEXP str, SEXP format, SEXP lenient, SEXP tz, SEXP loca
 
    cal->setLenient(lenient_val);
 
+   // template fast path for plain numeric patterns; armed only after
+   // the answer for one element has been checked against the full
+   // parser (tmpl_state: -1 verify, 0 off, 1 on)
+   std::vector<int> op_field, op_arg;
+   int tmpl_state = (format_cur < 0
+      && stri__datetime_parse_compile(format_str, op_field, op_arg)) ? -1 : 0;
+
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(REALSXP, vectorize_length));
    for (R_len_t i=0; i<vectorize_length; ++i) {
@@ -265,9 +535,20 @@ SEXP stri_datetime_parse(SEXP str, SEXP format, SEXP lenient, SEXP tz, SEXP loca
          continue;
       }
 
+      const UnicodeString& cur = str_cont.get(i);
+
+      if (tmpl_state == 1
+            && stri__datetime_parse_apply(cur, op_field, op_arg, cal)) {
+         status = U_ZERO_ERROR;
+         REAL(ret)[i] = ((double)cal->getTime(status))/1000.0;
+         if (U_FAILURE(status)) REAL(ret)[i] = NA_REAL;
+         continue;
+      }
+      // shape mismatch or template off/unverified - full ICU parse
+
       status = U_ZERO_ERROR;
       ParsePosition pos;
-      fmt->parse(str_cont.get(i), *cal, pos);
+      fmt->parse(cur, *cal, pos);
 
       if (pos.getErrorIndex() >= 0)
          REAL(ret)[i] = NA_REAL;
@@ -276,6 +557,21 @@ SEXP stri_datetime_parse(SEXP str, SEXP format, SEXP lenient, SEXP tz, SEXP loca
          REAL(ret)[i] = ((double)cal->getTime(status))/1000.0;
          if (U_FAILURE(status)) REAL(ret)[i] = NA_REAL;
       }
+
+      if (tmpl_state == -1) {
+         // one-time check: does the template reproduce ICU's answer
+         // for this element? (re-applying on top of the just-parsed
+         // calendar sets the same fields to the same values)
+         double t_icu = REAL(ret)[i];
+         tmpl_state = 0;
+         if (stri__datetime_parse_apply(cur, op_field, op_arg, cal)) {
+            status = U_ZERO_ERROR;
+            double t_fast = ((double)cal->getTime(status))/1000.0;
+            if (U_FAILURE(status)) t_fast = NA_REAL;
+            if ((ISNA(t_fast) && ISNA(t_icu)) || t_fast == t_icu)
+               tmpl_state = 1;
+         }
+      }
    }
 
 
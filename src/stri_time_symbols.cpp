@@ -38,6 +38,16 @@
 #include <string>
 
 
+// The most recent result is memoized per (locale, context, width);
+// the key holds the locale as resolved by stri__prepare_arg_locale, so
+// passing NULL keys on the *current* default locale and a changed
+// default simply misses. The memo is a private copy kept alive by the
+// package; callers get duplicates (the CHARSXPs are shared). Main R
+// thread only, like the other caches.
+static std::string stri__datetime_symbols_key;
+static SEXP stri__datetime_symbols_memo = NULL;
+
+
 /** List Localizable Date-Time Formatting Data
  *
  * @param locale single string or NULL
@@ -49,6 +59,9 @@
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-01-01)
  *    use calendar keyword in locale
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    repeat calls with the same arguments are served from a memo
  */
 SEXP stri_datetime_symbols(SEXP locale, SEXP context, SEXP width) {
    const char* qloc = stri__prepare_arg_locale(locale, "locale", true); /* this is R_alloc'ed */
@@ -72,6 +85,14 @@ SEXP stri_datetime_symbols(SEXP locale, SEXP context, SEXP width) {
    else if (width_cur == 2)       width_val = DateFormatSymbols::NARROW;
    else Rf_error(MSG__INCORRECT_MATCH_OPTION, "width");
 
+   std::string key(qloc);
+   key.append("\x1f");
+   key.append(1, (char)('0'+context_cur));
+   key.append(1, (char)('0'+width_cur));
+   if (stri__datetime_symbols_memo != NULL
+         && key == stri__datetime_symbols_key)
+      return Rf_duplicate(stri__datetime_symbols_memo);
+
    UErrorCode status = U_ZERO_ERROR;
    String8buf calendar_type(128);
    Locale loc = Locale::createFromName(qloc);
@@ -180,6 +201,12 @@ SEXP stri_datetime_symbols(SEXP locale, SEXP context, SEXP width) {
 
 
    stri__set_names(vals, infosize, "Month", "Weekday", "Quarter", "AmPm", "Era");
+
+   if (stri__datetime_symbols_memo) R_ReleaseObject(stri__datetime_symbols_memo);
+   stri__datetime_symbols_memo = Rf_duplicate(vals); // our private copy
+   R_PreserveObject(stri__datetime_symbols_memo);
+   stri__datetime_symbols_key = key;
+
    UNPROTECT(1);
    return vals;
 }
@@ -36,6 +36,16 @@
 #include <string>
 
 
+// Enumerating the time zone database is surprisingly costly, and the
+// list is fixed for the life of the process, so the most recent result
+// is memoized per (region, offset). The memo holds a private copy that
+// the package keeps alive itself; callers get duplicates (these share
+// the CHARSXPs, so a repeat call is a mere pointer-array copy).
+// Main R thread only, like the other caches.
+static std::string stri__timezone_list_key;
+static SEXP stri__timezone_list_memo = NULL;
+
+
 /** List available time zone IDs
  *
  * @param offset single numeric
@@ -43,6 +53,9 @@
  * @return character vector
  *
  * @version 0.5-1 (Marek Gagolewski, 2014-12-24)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    repeat calls with the same arguments are served from a memo
  */
 SEXP stri_timezone_list(SEXP region, SEXP offset)
 {
@@ -53,6 +66,22 @@ SEXP stri_timezone_list(SEXP region, SEXP offset)
    STRI__ERROR_HANDLER_BEGIN(2)
    StriContainerUTF8 region_cont(region, 1);
 
+   std::string key; // "\x01" stands for NA - no valid value looks like it
+   if (!region_cont.isNA(0)) key.append(region_cont.get(0).c_str());
+   else                      key.append("\x01");
+   key.append("\x1f");
+   if (!ISNA(REAL(offset)[0])) {
+      char tmp[32];
+      sprintf(tmp, "%.17g", REAL(offset)[0]);
+      key.append(tmp);
+   }
+   else key.append("\x01");
+
+   if (stri__timezone_list_memo != NULL && key == stri__timezone_list_key) {
+      STRI__UNPROTECT_ALL
+      return Rf_duplicate(stri__timezone_list_memo);
+   }
+
    UErrorCode status = U_ZERO_ERROR;
 
    int32_t offset_hours = 0;
@@ -105,6 +134,12 @@ SEXP stri_timezone_list(SEXP region, SEXP offset)
 //   Rf_setAttrib(ret, R_NamesSymbol, nam);
 
    if (tz_enum) { delete tz_enum; tz_enum = NULL; }
+
+   if (stri__timezone_list_memo) R_ReleaseObject(stri__timezone_list_memo);
+   stri__timezone_list_memo = Rf_duplicate(ret); // our private copy
+   R_PreserveObject(stri__timezone_list_memo);
+   stri__timezone_list_key = key;
+
    STRI__UNPROTECT_ALL
    return ret;
    STRI__ERROR_HANDLER_END(
@@ -33,8 +33,125 @@
 #include "stri_stringi.h"
 #include "stri_container_utf8.h"
 #include "stri_string8buf.h"
+#include "stri_bufpool.h"
 #include "stri_brkiter.h"
+#include "stri_hashset.h"
 #include <unicode/ucasemap.h>
+#include <cstring>
+#include <deque>
+
+
+/** [internal] is a bytewise ASCII case mapping valid in this locale?
+ *
+ * Turkish and Azeri remap the dotted/dotless i pair and Lithuanian
+ * adds dots above - all three reach plain ASCII letters, so they must
+ * go through ICU even for ASCII-only input.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static bool stri__casemap_ascii_is_safe(const char* loc)
+{
+   if (!loc) return true;
+   if ((loc[0]=='t' && loc[1]=='r') || (loc[0]=='a' && loc[1]=='z')
+         || (loc[0]=='l' && loc[1]=='t'))
+      return (loc[2]!='\0' && loc[2]!='_' && loc[2]!='-');
+   return true;
+}
+
+
+/** [internal] case-map an ASCII-only string, word-at-a-time
+ *
+ * Each 8-byte word gets a SWAR range test for [A-Z] (or [a-z]);
+ * the resulting per-byte mask toggles bit 0x20. Output length always
+ * equals input length.
+ *
+ * @param dest destination, at least n bytes
+ * @param src ASCII-only input
+ * @param n length of src in bytes
+ * @param _type 1 for tolower, 2 for toupper
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static void stri__casemap_ascii(char* dest, const char* src, R_len_t n, int _type)
+{
+   const uint64_t ones = UINT64_C(0x0101010101010101);
+   const uint64_t lo   = ones * (uint64_t)((_type==1)?(0x80-'A'):(0x80-'a'));
+   const uint64_t hi   = ones * (uint64_t)((_type==1)?(0x80-'Z'-1):(0x80-'z'-1));
+   R_len_t i = 0;
+   for (; i+8 <= n; i += 8) {
+      uint64_t w;
+      memcpy(&w, src+i, sizeof(uint64_t));
+      // high bit of each byte set iff the byte lies in the source range
+      // (no inter-byte carries: all bytes are < 0x80 here)
+      uint64_t mask = ((w+lo) & ~(w+hi)) & (ones*0x80);
+      if (_type == 1) w |=  (mask>>2);
+      else            w &= ~(mask>>2);
+      memcpy(dest+i, &w, sizeof(uint64_t));
+   }
+   for (; i < n; ++i) {
+      char c = src[i];
+      if (_type == 1) dest[i] = (c >= 'A' && c <= 'Z')?(c|0x20):c;
+      else            dest[i] = (c >= 'a' && c <= 'z')?(c&~0x20):c;
+   }
+}
+
+
+/** [internal] a ready-to-use UCaseMap for default-options title casing
+ *
+ * Opening the ucasemap and wiring in its word break iterator costs far
+ * more than title-casing a typical short string, so fully set-up
+ * instances are kept per locale. Only the default break iterator
+ * options are cacheable this way (custom types/rules/skips change the
+ * iterator); callers pass NULL opts and get a borrowed pointer they
+ * must not close, or fall back to opening their own.
+ *
+ * @param qloc locale, or NULL for the default one
+ * @return borrowed UCaseMap, or NULL if not cacheable
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static UCaseMap* stri__ucasemap_totitle_cached(const char* qloc)
+{
+#define STRI__UCASEMAP_CACHE_SIZE 4
+   struct StriCachedUCaseMap {
+      char locale[ULOC_FULLNAME_CAPACITY];
+      UCaseMap* map;
+   };
+   static StriCachedUCaseMap cache[STRI__UCASEMAP_CACHE_SIZE]; // zeroed
+   static int cache_next = 0;
+
+   if (!qloc || !qloc[0]) qloc = uloc_getDefault();
+   if (strlen(qloc) >= ULOC_FULLNAME_CAPACITY) return NULL;
+
+   for (int k=0; k<STRI__UCASEMAP_CACHE_SIZE; ++k)
+      if (cache[k].map && !strcmp(cache[k].locale, qloc))
+         return cache[k].map;
+
+   // dictionaries/rules load at most once per locale (user-030's cache)
+   UBreakIterator* wordbrk = stri__ubrk_open_cached(UBRK_WORD, qloc);
+
+   UErrorCode status = U_ZERO_ERROR;
+   UCaseMap* map = ucasemap_open(qloc, U_FOLD_CASE_DEFAULT, &status);
+   if (U_FAILURE(status) || !map) {
+      ubrk_close(wordbrk);
+      if (map) ucasemap_close(map);
+      return NULL;
+   }
+
+   status = U_ZERO_ERROR;
+   ucasemap_setBreakIterator(map, wordbrk, &status); // map owns wordbrk now
+   if (U_FAILURE(status)) {
+      ubrk_close(wordbrk);
+      ucasemap_close(map);
+      return NULL;
+   }
+
+   if (cache[cache_next].map) ucasemap_close(cache[cache_next].map);
+   strcpy(cache[cache_next].locale, qloc);
+   cache[cache_next].map = map;
+   cache_next = (cache_next+1) % STRI__UCASEMAP_CACHE_SIZE;
+   return map;
+}
 
 
 /**
@@ -48,29 +165,40 @@
  * @version 0.4-1 (Marek Gagolewski, 2014-12-03)
  *    separated from stri_trans_casemap;
  *    use StriUBreakIterator
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    reuse a cached, fully set-up ucasemap when opts_brkiter is NULL
  */
 SEXP stri_trans_totitle(SEXP str, SEXP opts_brkiter) {
+   bool default_opts = isNull(opts_brkiter);
    StriBrkIterOptions opts_brkiter2(opts_brkiter, "word");
    PROTECT(str = stri_prepare_arg_string(str, "str")); // prepare string argument
 
 // version 0.2-1 - Does not work with ICU 4.8 (but we require ICU >= 50)
    UCaseMap* ucasemap = NULL;
+   bool ucasemap_owned = false;
 
    STRI__ERROR_HANDLER_BEGIN(1)
    StriUBreakIterator brkiter(opts_brkiter2);
 
-   UErrorCode status = U_ZERO_ERROR;
-   ucasemap = ucasemap_open(brkiter.getLocale(), U_FOLD_CASE_DEFAULT, &status);
-   STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+   if (default_opts)
+      ucasemap = stri__ucasemap_totitle_cached(brkiter.getLocale());
 
-   status = U_ZERO_ERROR;
-   ucasemap_setBreakIterator(ucasemap, brkiter.getIterator(), &status);
-   STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
-   brkiter.free(false);
-   // ucasemap_setOptions(ucasemap, U_TITLECASE_NO_LOWERCASE, &status); // to do?
-   // now briter is owned by ucasemap.
-   // it will be released on ucasemap_close
-   // (checked with ICU man & src code)
+   if (!ucasemap) {
+      ucasemap_owned = true;
+      UErrorCode status = U_ZERO_ERROR;
+      ucasemap = ucasemap_open(brkiter.getLocale(), U_FOLD_CASE_DEFAULT, &status);
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+
+      status = U_ZERO_ERROR;
+      ucasemap_setBreakIterator(ucasemap, brkiter.getIterator(), &status);
+      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      brkiter.free(false);
+      // ucasemap_setOptions(ucasemap, U_TITLECASE_NO_LOWERCASE, &status); // to do?
+      // now briter is owned by ucasemap.
+      // it will be released on ucasemap_close
+      // (checked with ICU man & src code)
+   }
 
    R_len_t str_n = LENGTH(str);
    StriContainerUTF8 str_cont(str, str_n);
@@ -84,7 +212,11 @@ SEXP stri_trans_totitle(SEXP str, SEXP opts_brkiter) {
    // the number before casefolding
    R_len_t bufsize = str_cont.getMaxNumBytes();
    bufsize += 10; // a small margin
-   String8buf buf(bufsize);
+   StriScratchBuf buf(bufsize);
+   STRI__ALLOCTRACE_SITE("stri_trans_totitle")
+
+   // inputs are often categorical-like - compute each unique value once
+   str_cont.buildDuplicateIndex();
 
    // STEP 2.
    // Do case folding
@@ -92,15 +224,23 @@ SEXP stri_trans_totitle(SEXP str, SEXP opts_brkiter) {
          i != str_cont.vectorize_end();
          i = str_cont.vectorize_next(i))
    {
+      STRI__ALLOCTRACE_ELEM(i)
       if (str_cont.isNA(i)) {
          SET_STRING_ELT(ret, i, NA_STRING);
          continue;
       }
 
+      R_len_t fst = str_cont.getDuplicateOf(i);
+      if (fst < i) {
+         // same input as an earlier element - reuse its result
+         SET_STRING_ELT(ret, i, STRING_ELT(ret, fst));
+         continue;
+      }
+
       R_len_t str_cur_n     = str_cont.get(i).length();
       const char* str_cur_s = str_cont.get(i).c_str();
 
-      status = U_ZERO_ERROR;
+      UErrorCode status = U_ZERO_ERROR;
       int buf_need = ucasemap_utf8ToTitle(ucasemap, buf.data(), buf.size(),
                (const char*)str_cur_s, str_cur_n, &status);
 
@@ -114,15 +254,16 @@ SEXP stri_trans_totitle(SEXP str, SEXP opts_brkiter) {
                                              // we do have the buffer size required to complete this op
       }
 
-      SET_STRING_ELT(ret, i, Rf_mkCharLenCE(buf.data(), buf_need, CE_UTF8));
+      // already-titlecased input is a no-op - share its CHARSXP (see toR)
+      SET_STRING_ELT(ret, i, str_cont.toR(i, buf.data(), buf_need));
    }
 
-   if (ucasemap) { ucasemap_close(ucasemap); ucasemap = NULL;}
+   if (ucasemap) { if (ucasemap_owned) ucasemap_close(ucasemap); ucasemap = NULL; }
    STRI__UNPROTECT_ALL
    return ret;
 
    STRI__ERROR_HANDLER_END({
-      if (ucasemap) { ucasemap_close(ucasemap); ucasemap = NULL; }
+      if (ucasemap) { if (ucasemap_owned) ucasemap_close(ucasemap); ucasemap = NULL; }
    })
 }
 
@@ -166,6 +307,9 @@ SEXP stri_trans_totitle(SEXP str, SEXP opts_brkiter) {
  *
  * @version 0.6-1 (Marek Gagolewski, 2015-07-11)
  *    now this is an internal function
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    bytewise fast path for ASCII-only elements (locale permitting)
 */
 SEXP stri_trans_casemap(SEXP str, int _type, SEXP locale)
 {
@@ -193,7 +337,17 @@ SEXP stri_trans_casemap(SEXP str, int _type, SEXP locale)
    // the number before casefolding
    R_len_t bufsize = str_cont.getMaxNumBytes();
    bufsize += 10; // a small margin
-   String8buf buf(bufsize);
+   StriScratchBuf buf(bufsize);
+
+   // inputs are often categorical-like - compute each unique value once
+   str_cont.buildDuplicateIndex();
+
+   // [A-Za-z] maps bytewise except under tr/az/lt language rules;
+   // mixed ASCII/multibyte text stays on ICU as a whole: splitting it
+   // into spans would lose the context its casing may depend on
+   // (e.g. the final sigma)
+   bool ascii_fast = stri__casemap_ascii_is_safe(ucasemap_getLocale(ucasemap));
+   STRI__ALLOCTRACE_SITE("stri_trans_casemap")
 
    // STEP 2.
    // Do case folding
@@ -201,14 +355,28 @@ SEXP stri_trans_casemap(SEXP str, int _type, SEXP locale)
          i != str_cont.vectorize_end();
          i = str_cont.vectorize_next(i))
    {
+      STRI__ALLOCTRACE_ELEM(i)
       if (str_cont.isNA(i)) {
          SET_STRING_ELT(ret, i, NA_STRING);
          continue;
       }
 
+      R_len_t fst = str_cont.getDuplicateOf(i);
+      if (fst < i) {
+         // same input as an earlier element - reuse its result
+         SET_STRING_ELT(ret, i, STRING_ELT(ret, fst));
+         continue;
+      }
+
       R_len_t str_cur_n     = str_cont.get(i).length();
       const char* str_cur_s = str_cont.get(i).c_str();
 
+      if (ascii_fast && str_cont.get(i).isASCII()) {
+         stri__casemap_ascii(buf.data(), str_cur_s, str_cur_n, _type);
+         SET_STRING_ELT(ret, i, str_cont.toR(i, buf.data(), str_cur_n));
+         continue;
+      }
+
       status = U_ZERO_ERROR;
       int buf_need;
       if (_type == 1) buf_need = ucasemap_utf8ToLower(ucasemap,
@@ -228,7 +396,9 @@ SEXP stri_trans_casemap(SEXP str, int _type, SEXP locale)
                                              // we do have the buffer size required to complete this op
       }
 
-      SET_STRING_ELT(ret, i, Rf_mkCharLenCE(buf.data(), buf_need, CE_UTF8));
+      // text already in the target case is a no-op - share its
+      // CHARSXP (see toR)
+      SET_STRING_ELT(ret, i, str_cont.toR(i, buf.data(), buf_need));
    }
 
    if (ucasemap) { ucasemap_close(ucasemap); ucasemap = NULL;}
@@ -335,3 +505,92 @@ SEXP stri_trans_toupper(SEXP str, SEXP locale) {
 //   STRI__ERROR_HANDLER_END(/*noop*/;
 ////       if (briter) delete briter;
 //   )
+
+
+/** Case-fold and deduplicate in one pass
+ *
+ * Equivalent to unique-ing the full case folding of \code{str}
+ * (byte-wise, no collation), but each element is folded into a reused
+ * scratch buffer and hashed there - the folded copy of the whole
+ * vector is never materialized as an R object, and only first
+ * occurrences are.
+ *
+ * @param str character vector
+ * @return character vector (folded first occurrences, in order)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_unique_casefold(SEXP str)
+{
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+
+   UCaseMap* ucasemap = NULL;
+   STRI__ERROR_HANDLER_BEGIN(1)
+   UErrorCode status = U_ZERO_ERROR;
+   // default (locale-independent) full case folding
+   ucasemap = ucasemap_open("", U_FOLD_CASE_DEFAULT, &status);
+   STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+
+   R_len_t str_n = LENGTH(str);
+   StriContainerUTF8 str_cont(str, str_n);
+
+   // folding may expand the text a little (e.g. sharp s -> ss)
+   R_len_t bufsize = str_cont.getMaxNumBytes();
+   bufsize += bufsize/2 + 10;
+   StriScratchBuf buf(bufsize);
+   STRI__ALLOCTRACE_SITE("stri_unique_casefold")
+
+   StriByteKeyHashSet seen(str_n);
+   bool was_na = false;
+   deque<SEXP> temp;
+   for (R_len_t i=0; i<str_n; ++i) {
+      STRI__ALLOCTRACE_ELEM(i)
+      if (str_cont.isNA(i)) {
+         if (!was_na) {
+            was_na = true;
+            temp.push_back(NA_STRING);
+         }
+         continue;
+      }
+
+      R_len_t str_cur_n     = str_cont.get(i).length();
+      const char* str_cur_s = str_cont.get(i).c_str();
+
+      int folded_n;
+      if (str_cont.get(i).isASCII()) {
+         // ASCII folds bytewise to lower case
+         stri__casemap_ascii(buf.data(), str_cur_s, str_cur_n, 1/*tolower*/);
+         folded_n = str_cur_n;
+      }
+      else {
+         status = U_ZERO_ERROR;
+         folded_n = ucasemap_utf8FoldCase(ucasemap, buf.data(), buf.size()-1,
+            str_cur_s, str_cur_n, &status);
+         if (U_FAILURE(status)) { /* retry with the exact size */
+            buf.resize(folded_n+1, false/*destroy contents*/);
+            status = U_ZERO_ERROR;
+            folded_n = ucasemap_utf8FoldCase(ucasemap, buf.data(), buf.size()-1,
+               str_cur_s, str_cur_n, &status);
+            STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+         }
+      }
+
+      buf.data()[folded_n] = 0; // the hash set wants NUL-terminated keys
+      if (seen.insert((const uint8_t*)buf.data(), folded_n+1))
+         temp.push_back(Rf_mkCharLenCE(buf.data(), folded_n, CE_UTF8));
+   }
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(STRSXP, temp.size()));
+   R_len_t j = 0;
+   for (deque<SEXP>::iterator it = temp.begin(); it != temp.end(); it++)
+      SET_STRING_ELT(ret, j++, *it);
+
+   if (ucasemap) { ucasemap_close(ucasemap); ucasemap = NULL; }
+   STRI__UNPROTECT_ALL
+   return ret;
+
+   STRI__ERROR_HANDLER_END({
+      if (ucasemap) { ucasemap_close(ucasemap); ucasemap = NULL; }
+   })
+}
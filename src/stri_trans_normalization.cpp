@@ -31,7 +31,10 @@
 
 #include "stri_stringi.h"
 #include "stri_container_utf16.h"
+#include "stri_threads.h"
 #include <unicode/normalizer2.h>
+#include <vector>
+#include <string>
 
 
 #define STRI_UNINORM_NFC 10
@@ -117,6 +120,13 @@ const Normalizer2* stri__normalizer_get(int _type)
  *
  * @version 0.6-1 (Marek Gagolewski, 2015-07-11)
  *    This is now an internal function
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    quick-check first; already-normalized elements are returned as-is
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    normalize elements in parallel if options(stringi.num_threads=...)
+ *    says so; Normalizer2 singletons are safe for concurrent use
  */
 SEXP stri_trans_nf(SEXP str, int type)
 {
@@ -138,16 +148,102 @@ SEXP stri_trans_nf(SEXP str, int type)
    STRI__ERROR_HANDLER_BEGIN(1)
    StriContainerUTF16 str_cont(str, str_length, false); // writable, no recycle
 
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(STRSXP, str_length));
+
+   // repeated inputs (e.g. expanded factors) are normalized once;
+   // phase 2 shares the first occurrence's result
+   str_cont.buildDuplicateIndex();
+
+   // phase 1: quick-check and (where needed) normalize each element;
+   // pure ICU work, so it may be chunked over worker threads
+   // (states: 0 - NA, 1 - already in NF, 2 - normalized into norm[i],
+   // 3 - duplicate of an earlier element)
+   std::vector<unsigned char> state(str_length, 0);
+   std::vector<UnicodeString> norm(str_length);
+
+#ifdef STRI_HAVE_THREADS
+   int num_threads = stri__threads_requested(str_length);
+   if (num_threads > 1) {
+      str_cont.materializeAll(); // lazy UTF-16 conversion is not thread-safe
+      std::vector<int> errcode(num_threads, (int)U_ZERO_ERROR);
+      std::vector<std::thread> workers;
+      for (int t=0; t<num_threads; ++t) {
+         R_len_t chunk_from = (R_len_t)((double)str_length*t/num_threads);
+         R_len_t chunk_to   = (R_len_t)((double)str_length*(t+1)/num_threads);
+         workers.push_back(std::thread([t, chunk_from, chunk_to, normalizer,
+               &str_cont, &state, &norm, &errcode]() {
+            for (R_len_t i=chunk_from; i<chunk_to; ++i) {
+               if (str_cont.isNA(i)) continue;
+               if (str_cont.getDuplicateOf(i) < i) { state[i] = 3; continue; }
+               UErrorCode status = U_ZERO_ERROR;
+               if (normalizer->quickCheck(str_cont.get(i), status) == UNORM_YES
+                     && U_SUCCESS(status)) {
+                  state[i] = 1;
+                  continue;
+               }
+               status = U_ZERO_ERROR;
+               normalizer->normalize(str_cont.get(i), norm[i], status);
+               if (U_FAILURE(status)) { errcode[t] = (int)status; return; }
+               state[i] = 2;
+            }
+         }));
+      }
+      for (size_t t=0; t<workers.size(); ++t) workers[t].join();
+      for (int t=0; t<num_threads; ++t)
+         if (U_FAILURE((UErrorCode)errcode[t]))
+            throw StriException((UErrorCode)errcode[t]);
+   }
+   else
+#endif
+   {
+      for (R_len_t i=0; i<str_length; ++i) {
+         if (str_cont.isNA(i)) continue;
+         if (str_cont.getDuplicateOf(i) < i) { state[i] = 3; continue; }
+
+         // most data is already in the requested form; the quick check is
+         // a linear scan, a full normalize is a decompose/recompose
+         UErrorCode status = U_ZERO_ERROR;
+         if (normalizer->quickCheck(str_cont.get(i), status) == UNORM_YES
+               && U_SUCCESS(status)) {
+            state[i] = 1;
+            continue;
+         }
+
+         status = U_ZERO_ERROR;
+         normalizer->normalize(str_cont.get(i), norm[i], status);
+         STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+         state[i] = 2;
+      }
+   }
+
+   // phase 2: assemble the result (R API - main thread only)
+   std::string tmp8; // reused between elements (its capacity is retained)
    for (R_len_t i=0; i<str_length; ++i) {
-      if (str_cont.isNA(i)) continue;
-      UErrorCode status = U_ZERO_ERROR;
-      str_cont.set(i, normalizer->normalize(str_cont.get(i), status));
-      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      if (state[i] == 0)
+         SET_STRING_ELT(ret, i, NA_STRING);
+      else if (state[i] == 1) {
+         SEXP elt = STRING_ELT(str, i);
+         if (IS_ASCII(elt) || IS_UTF8(elt))
+            SET_STRING_ELT(ret, i, elt); // share the input CHARSXP
+         else
+            SET_STRING_ELT(ret, i, str_cont.toR(i)); // just recode to UTF-8
+      }
+      else if (state[i] == 3) {
+         // the first identical input's result is already in place
+         SET_STRING_ELT(ret, i, STRING_ELT(ret, str_cont.getDuplicateOf(i)));
+      }
+      else {
+         tmp8.clear();
+         norm[i].toUTF8String(tmp8);
+         SET_STRING_ELT(ret, i,
+            Rf_mkCharLenCE(tmp8.c_str(), (int)tmp8.length(), CE_UTF8));
+      }
    }
 
    // normalizer shall not be deleted at all
    STRI__UNPROTECT_ALL
-   return str_cont.toR();
+   return ret;
    STRI__ERROR_HANDLER_END(;/* nothing special to be done on error */)
 }
 
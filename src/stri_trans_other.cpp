@@ -65,6 +65,9 @@ void stri__split_codepoints(vector<UChar32>& out, const char* s, int n) {
  *
  * @version 1.3.2 (Marek Gagolewski, 2019-02-20)
  *     BUGFIX: overlapping maps (#343)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *     all-ASCII maps compile to a 256-entry byte-translate table
  */
 SEXP stri_trans_char(SEXP str, SEXP pattern, SEXP replacement) {
    PROTECT(str          = stri_prepare_arg_string(str, "str"));
@@ -106,6 +109,51 @@ SEXP stri_trans_char(SEXP str, SEXP pattern, SEXP replacement) {
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(STRSXP, vectorize_length));
 
+   // when every pattern and replacement code point is ASCII, the whole
+   // map compiles to a byte-translate table; bytes of multibyte
+   // sequences (lead and continuation alike) have the high bit set and
+   // map to themselves, so any UTF-8 input can be translated bytewise
+   // and the output length always equals the input length
+   bool bytewise = true;
+   for (R_len_t k=0; k<m; ++k)
+      if (d_pat[k] < 0 || d_pat[k] > 0x7f || d_rep[k] < 0 || d_rep[k] > 0x7f) {
+         bytewise = false;
+         break;
+      }
+
+   if (bytewise) {
+      unsigned char tab[256];
+      for (int b=0; b<256; ++b)
+         tab[b] = (unsigned char)b;
+      for (R_len_t k=0; k<m; ++k) // later entries win, as in the generic path
+         tab[(unsigned char)d_pat[k]] = (unsigned char)d_rep[k];
+
+      R_len_t bufsize = str_cont.getMaxNumBytes();
+      if (bufsize < 0) bufsize = 0;
+      String8buf buf8(bufsize);
+      char* bufdata = buf8.data();
+
+      for (R_len_t i = str_cont.vectorize_init();
+           i != str_cont.vectorize_end();
+           i = str_cont.vectorize_next(i))
+      {
+         if (str_cont.isNA(i)) {
+            SET_STRING_ELT(ret, i, NA_STRING);
+            continue;
+         }
+
+         const char* s = str_cont.get(i).c_str();
+         R_len_t n = str_cont.get(i).length();
+         for (R_len_t j=0; j<n; ++j)
+            bufdata[j] = (char)tab[(unsigned char)s[j]];
+
+         SET_STRING_ELT(ret, i, str_cont.toR(i, bufdata, n));
+      }
+
+      STRI__UNPROTECT_ALL
+      return ret;
+   }
+
    std::vector<char> buf;
    for (R_len_t i = str_cont.vectorize_init();
         i != str_cont.vectorize_end();
@@ -154,7 +202,7 @@ SEXP stri_trans_char(SEXP str, SEXP pattern, SEXP replacement) {
          }
       }
 
-      SET_STRING_ELT(ret, i, Rf_mkCharLenCE(buf.data(), buf.size(), CE_UTF8));
+      SET_STRING_ELT(ret, i, str_cont.toR(i, buf.data(), (R_len_t)buf.size()));
    }
 
    STRI__UNPROTECT_ALL
@@ -86,6 +86,48 @@ SEXP stri_trans_list()
 }
 
 
+/** [internal] create a Transliterator, reusing compiled instances
+ *
+ * Compiling a transform (e.g. Latin-ASCII) is orders of magnitude more
+ * expensive than applying it, and callers tend to request the same few
+ * identifiers over and over. A small round-robin cache keeps a private
+ * copy of each recently compiled transliterator, keyed by the identifier
+ * as requested (not canonicalized); the caller always receives a clone
+ * it owns and must delete.
+ *
+ * @param id transform identifier
+ * @param status ICU error code
+ * @return a new Transliterator (caller-owned), or NULL on failure
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static Transliterator* stri__transliterator(const UnicodeString& id,
+   UErrorCode& status)
+{
+#define STRI__TRANSLIT_CACHE_SIZE 8
+   static Transliterator* cache[STRI__TRANSLIT_CACHE_SIZE] = {NULL};
+   static UnicodeString cache_id[STRI__TRANSLIT_CACHE_SIZE];
+   static int cache_next = 0;
+
+   for (int k=0; k<STRI__TRANSLIT_CACHE_SIZE; ++k)
+      if (cache[k] && cache_id[k] == id)
+         return cache[k]->clone();
+
+   Transliterator* fresh =
+      Transliterator::createInstance(id, UTRANS_FORWARD, status);
+   if (U_FAILURE(status) || !fresh) return fresh;
+
+   Transliterator* copy = fresh->clone();
+   if (copy) { // keep the copy, hand out the freshly created one
+      if (cache[cache_next]) delete cache[cache_next];
+      cache[cache_next] = copy;
+      cache_id[cache_next] = id;
+      cache_next = (cache_next+1) % STRI__TRANSLIT_CACHE_SIZE;
+   }
+   return fresh;
+}
+
+
 /** General text transform with ICU Transliterator
  *
  * @param str character vector
@@ -93,6 +135,9 @@ SEXP stri_trans_list()
  * @return character vector
  *
  * @version 0.2-2 (Marek Gagolewski, 2014-04-19)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    compiled transliterators are cached across calls
  */
 SEXP stri_trans_general(SEXP str, SEXP id)
 {
@@ -109,16 +154,27 @@ SEXP stri_trans_general(SEXP str, SEXP id)
    }
 
    UErrorCode status = U_ZERO_ERROR;
-   trans = Transliterator::createInstance(id_cont.get(0), UTRANS_FORWARD, status);
+   trans = stri__transliterator(id_cont.get(0), status);
    STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
 
    StriContainerUTF16 str_cont(str, str_length, false); // writable, no recycle
 
+   // repeated inputs (e.g. expanded factors) pass through the
+   // transliterator once; their results are copied afterwards
+   str_cont.buildDuplicateIndex();
+
    for (R_len_t i=0; i<str_length; ++i) {
       if (str_cont.isNA(i)) continue;
+      if (str_cont.getDuplicateOf(i) < i) continue; // copied below
       trans->transliterate(str_cont.getWritable(i));
    }
 
+   for (R_len_t i=0; i<str_length; ++i) {
+      R_len_t fst = str_cont.getDuplicateOf(i);
+      if (fst < i && !str_cont.isNA(i))
+         str_cont.getWritable(i).setTo(str_cont.get(fst));
+   }
+
    if (trans) { delete trans; trans = NULL; }
    STRI__UNPROTECT_ALL
    return str_cont.toR();
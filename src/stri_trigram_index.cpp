@@ -0,0 +1,442 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stri_stringi.h"
+#include "stri_container_utf8.h"
+#include "stri_container_bytesearch.h"
+#include "stri_bytesearch_matcher.h"
+#include "stri_interrupt.h"
+#include <vector>
+#include <map>
+#include <algorithm>
+
+
+/** the payload of a stri_trigram_index externalptr
+ *
+ * A classic inverted index over byte trigrams of the (validated,
+ * UTF-8-re-encoded) corpus: for every distinct 3-byte window the sorted
+ * list of documents containing it, stored in CSR form (sorted distinct
+ * keys + offsets + one flat postings array). A document containing a
+ * fixed pattern of >= 3 bytes necessarily contains every trigram of
+ * that pattern, so intersecting the pattern's posting lists yields a
+ * small candidate set that is then verified with an exact matcher;
+ * documents outside the intersection are ruled out without being read.
+ */
+struct StriTrigramIndex {
+   StriContainerUTF8* cont;        ///< validated corpus copies [owned]
+   R_len_t n;                      ///< number of documents
+   std::vector<uint32_t> keys;     ///< sorted distinct trigram keys
+   std::vector<size_t> offsets;    ///< keys.size()+1 offsets into postings
+   std::vector<int> postings;      ///< ascending document ids, per key
+
+   StriTrigramIndex() : cont(NULL), n(0) { }
+   ~StriTrigramIndex() { if (cont) delete cont; }
+
+   /** posting list for one trigram key (NULL+0 if the key is absent) */
+   const int* find(uint32_t key, size_t& len) const {
+      std::vector<uint32_t>::const_iterator it =
+         std::lower_bound(keys.begin(), keys.end(), key);
+      if (it == keys.end() || *it != key) { len = 0; return NULL; }
+      size_t k = (size_t)(it-keys.begin());
+      len = offsets[k+1]-offsets[k];
+      return &postings[offsets[k]];
+   }
+};
+
+
+/** pack 3 consecutive bytes into a trigram key */
+static inline uint32_t stri__trigram_key(const char* s)
+{
+   return (((uint32_t)(unsigned char)s[0]) << 16)
+        | (((uint32_t)(unsigned char)s[1]) <<  8)
+        |  ((uint32_t)(unsigned char)s[2]);
+}
+
+
+/** [internal] externalptr finalizer */
+static void stri__trigram_index_finalizer(SEXP ptr)
+{
+   StriTrigramIndex* idx = (StriTrigramIndex*)R_ExternalPtrAddr(ptr);
+   if (idx) {
+      delete idx;
+      R_ClearExternalPtr(ptr);
+   }
+}
+
+
+/** fetch and validate a stri_trigram_index handle
+ *
+ * Calls Rf_error on anything else, including a handle that has been
+ * serialized and restored (its address slot comes back NULL).
+ */
+static StriTrigramIndex* stri__trigram_index_unwrap(SEXP index)
+{
+   if (TYPEOF(index) != EXTPTRSXP
+         || R_ExternalPtrTag(index) != Rf_install("stri_trigram_index"))
+      Rf_error(MSG__ARG_EXPECTED_TRIGRAM_INDEX, "index"); // error() call allowed here
+   StriTrigramIndex* idx = (StriTrigramIndex*)R_ExternalPtrAddr(index);
+   if (!idx)
+      Rf_error(MSG__TRIGRAM_INDEX_INVALIDATED); // error() call allowed here
+   return idx;
+}
+
+
+/** gather the candidate documents for a pattern via the posting lists
+ *
+ * @param idx the index
+ * @param p pattern (UTF-8), at least 3 bytes
+ * @param p_len pattern length [bytes]
+ * @param candidates [out] ascending document ids containing every
+ *    trigram of the pattern (a superset of the true matches)
+ */
+static void stri__trigram_candidates(const StriTrigramIndex* idx,
+   const char* p, R_len_t p_len, std::vector<int>& candidates)
+{
+   // distinct trigram keys of the pattern, rare-first not needed:
+   // the running intersection only shrinks, so order barely matters
+   std::vector<uint32_t> pkeys;
+   for (R_len_t j=0; j+3 <= p_len; ++j)
+      pkeys.push_back(stri__trigram_key(p+j));
+   std::sort(pkeys.begin(), pkeys.end());
+   pkeys.erase(std::unique(pkeys.begin(), pkeys.end()), pkeys.end());
+
+   candidates.clear();
+   std::vector<int> tmp;
+   for (size_t k=0; k<pkeys.size(); ++k) {
+      size_t plen;
+      const int* plist = idx->find(pkeys[k], plen);
+      if (!plist) { candidates.clear(); return; } // some trigram occurs nowhere
+      if (k == 0) {
+         candidates.assign(plist, plist+plen);
+         continue;
+      }
+      tmp.clear();
+      std::set_intersection(candidates.begin(), candidates.end(),
+         plist, plist+plen, std::back_inserter(tmp));
+      candidates.swap(tmp);
+      if (candidates.empty()) return;
+   }
+}
+
+
+/**
+ * Build a trigram -> posting-list index over a character vector
+ *
+ * See stri_trigram_index in R. The corpus is validated and re-encoded
+ * once; later indexed queries search the retained copies and never
+ * touch documents that the posting lists rule out.
+ *
+ * @param str character vector
+ * @return externalptr of class `stri_trigram_index` (finalized on gc),
+ *    with the input kept alive through the protected slot
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_trigram_index(SEXP str)
+{
+   PROTECT(str = stri_prepare_arg_string(str, "str"));
+   R_len_t n = LENGTH(str);
+   StriTrigramIndex* idx = NULL;
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   idx = new StriTrigramIndex();
+   if (!idx) throw StriException(MSG__MEM_ALLOC_ERROR);
+   idx->cont = new StriContainerUTF8(str, n, true);
+   if (!idx->cont) throw StriException(MSG__MEM_ALLOC_ERROR);
+   idx->n = n;
+
+   // postings are gathered per key in a sorted map first and then
+   // flattened; pushing the documents in id order keeps every list
+   // sorted with no extra pass
+   std::map<uint32_t, std::vector<int> > buckets;
+   std::vector<uint32_t> doc_keys;
+   StriInterruptCheckpoint checkpoint;
+   for (R_len_t i=0; i<n; ++i) {
+      checkpoint.touch();
+      if (idx->cont->isNA(i)) continue;
+      const char* s = idx->cont->get(i).c_str();
+      R_len_t s_len = idx->cont->get(i).length();
+      doc_keys.clear();
+      for (R_len_t j=0; j+3 <= s_len; ++j)
+         doc_keys.push_back(stri__trigram_key(s+j));
+      std::sort(doc_keys.begin(), doc_keys.end());
+      doc_keys.erase(std::unique(doc_keys.begin(), doc_keys.end()),
+         doc_keys.end());
+      for (size_t k=0; k<doc_keys.size(); ++k)
+         buckets[doc_keys[k]].push_back(i);
+   }
+
+   size_t total = 0;
+   for (std::map<uint32_t, std::vector<int> >::const_iterator it =
+         buckets.begin(); it != buckets.end(); ++it)
+      total += it->second.size();
+   idx->keys.reserve(buckets.size());
+   idx->offsets.reserve(buckets.size()+1);
+   idx->postings.reserve(total);
+   idx->offsets.push_back(0);
+   for (std::map<uint32_t, std::vector<int> >::const_iterator it =
+         buckets.begin(); it != buckets.end(); ++it) {
+      idx->keys.push_back(it->first);
+      idx->postings.insert(idx->postings.end(),
+         it->second.begin(), it->second.end());
+      idx->offsets.push_back(idx->postings.size());
+   }
+
+   SEXP ret;
+   STRI__PROTECT(ret = R_MakeExternalPtr(idx,
+      Rf_install("stri_trigram_index"), str));
+   R_RegisterCFinalizerEx(ret, stri__trigram_index_finalizer, TRUE);
+   Rf_setAttrib(ret, R_ClassSymbol, Rf_mkString("stri_trigram_index"));
+
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({
+      // the finalizer has not been registered yet
+      if (idx) delete idx;
+   })
+}
+
+
+/** prepare the single query pattern shared by the indexed frontends
+ *
+ * @param pattern single string, not NA, nonempty
+ * @return PROTECTed character vector of length 1
+ */
+static SEXP stri__trigram_prepare_pattern(SEXP pattern)
+{
+   PROTECT(pattern = stri_prepare_arg_string_1(pattern, "pattern"));
+   if (STRING_ELT(pattern, 0) == NA_STRING) {
+      UNPROTECT(1);
+      Rf_error(MSG__ARG_EXPECTED_NOT_NA, "pattern"); // error() call allowed here
+   }
+   return pattern;
+}
+
+
+/**
+ * Detect which indexed documents contain a fixed pattern
+ *
+ * @param index a stri_trigram_index externalptr
+ * @param pattern single string
+ * @param negate single bool
+ * @return logical vector, one element per indexed document
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_detect_fixed_indexed(SEXP index, SEXP pattern, SEXP negate)
+{
+   StriTrigramIndex* idx = stri__trigram_index_unwrap(index);
+   bool negate_1 = stri__prepare_arg_logical_1_notNA(negate, "negate");
+   PROTECT(pattern = stri__trigram_prepare_pattern(pattern));
+
+   StriByteSearchMatcher* matcher = NULL;
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriContainerUTF8 pattern_cont(pattern, 1);
+   const char* p = pattern_cont.get(0).c_str();
+   R_len_t p_len = pattern_cont.get(0).length();
+   if (p_len <= 0)
+      throw StriException(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+   matcher = StriContainerByteSearch::createMatcher(p, p_len,
+      StriContainerByteSearch::getByteSearchFlags(R_NilValue));
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(LGLSXP, idx->n));
+   int* ret_tab = LOGICAL(ret);
+   for (R_len_t i=0; i<idx->n; ++i)
+      ret_tab[i] = idx->cont->isNA(i) ? NA_LOGICAL : (int)negate_1;
+
+   if (p_len >= 3) {
+      // only the documents holding every trigram of the pattern can
+      // match - verify just those
+      std::vector<int> candidates;
+      stri__trigram_candidates(idx, p, p_len, candidates);
+      for (size_t k=0; k<candidates.size(); ++k) {
+         R_len_t i = candidates[k];
+         matcher->reset(idx->cont->get(i).c_str(), idx->cont->get(i).length());
+         if (matcher->findFirst() != USEARCH_DONE)
+            ret_tab[i] = (int)(!negate_1);
+      }
+   }
+   else {
+      // 1-2-byte patterns have no trigrams; fall back to a full scan
+      for (R_len_t i=0; i<idx->n; ++i) {
+         if (idx->cont->isNA(i) || idx->cont->get(i).length() <= 0) continue;
+         matcher->reset(idx->cont->get(i).c_str(), idx->cont->get(i).length());
+         if (matcher->findFirst() != USEARCH_DONE)
+            ret_tab[i] = (int)(!negate_1);
+      }
+   }
+
+   delete matcher; matcher = NULL;
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(
+      if (matcher) { delete matcher; matcher = NULL; }
+   )
+}
+
+
+/**
+ * Count occurrences of a fixed pattern in each indexed document
+ *
+ * @param index a stri_trigram_index externalptr
+ * @param pattern single string
+ * @return integer vector, one element per indexed document
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_count_fixed_indexed(SEXP index, SEXP pattern)
+{
+   StriTrigramIndex* idx = stri__trigram_index_unwrap(index);
+   PROTECT(pattern = stri__trigram_prepare_pattern(pattern));
+
+   StriByteSearchMatcher* matcher = NULL;
+   STRI__ERROR_HANDLER_BEGIN(1)
+   StriContainerUTF8 pattern_cont(pattern, 1);
+   const char* p = pattern_cont.get(0).c_str();
+   R_len_t p_len = pattern_cont.get(0).length();
+   if (p_len <= 0)
+      throw StriException(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+   matcher = StriContainerByteSearch::createMatcher(p, p_len,
+      StriContainerByteSearch::getByteSearchFlags(R_NilValue));
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(INTSXP, idx->n));
+   int* ret_tab = INTEGER(ret);
+   for (R_len_t i=0; i<idx->n; ++i)
+      ret_tab[i] = idx->cont->isNA(i) ? NA_INTEGER : 0;
+
+   std::vector<int> candidates;
+   if (p_len >= 3)
+      stri__trigram_candidates(idx, p, p_len, candidates);
+   else { // no trigrams to consult - every document is a candidate
+      for (R_len_t i=0; i<idx->n; ++i)
+         if (!idx->cont->isNA(i) && idx->cont->get(i).length() > 0)
+            candidates.push_back(i);
+   }
+
+   for (size_t k=0; k<candidates.size(); ++k) {
+      R_len_t i = candidates[k];
+      matcher->reset(idx->cont->get(i).c_str(), idx->cont->get(i).length());
+      int found = 0;
+      while (USEARCH_DONE != matcher->findNext())
+         ++found;
+      ret_tab[i] = found;
+   }
+
+   delete matcher; matcher = NULL;
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(
+      if (matcher) { delete matcher; matcher = NULL; }
+   )
+}
+
+
+/**
+ * Return the indexed documents that contain a fixed pattern
+ *
+ * @param index a stri_trigram_index externalptr
+ * @param pattern single string
+ * @param omit_na single bool
+ * @param negate single bool
+ * @return character vector (elements of the original corpus)
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+SEXP stri_subset_fixed_indexed(SEXP index, SEXP pattern, SEXP omit_na,
+   SEXP negate)
+{
+   StriTrigramIndex* idx = stri__trigram_index_unwrap(index);
+   bool omit_na1 = stri__prepare_arg_logical_1_notNA(omit_na, "omit_na");
+   bool negate_1 = stri__prepare_arg_logical_1_notNA(negate, "negate");
+
+   // the original corpus travels in the handle's protected slot; the
+   // result reuses its CHARSXPs, keeping the input encodings intact
+   SEXP orig = R_ExternalPtrProtected(index);
+   if (!isString(orig) || LENGTH(orig) != idx->n)
+      Rf_error(MSG__TRIGRAM_INDEX_INVALIDATED); // error() call allowed here
+   PROTECT(orig);
+   PROTECT(pattern = stri__trigram_prepare_pattern(pattern));
+
+   StriByteSearchMatcher* matcher = NULL;
+   STRI__ERROR_HANDLER_BEGIN(2)
+   StriContainerUTF8 pattern_cont(pattern, 1);
+   const char* p = pattern_cont.get(0).c_str();
+   R_len_t p_len = pattern_cont.get(0).length();
+   if (p_len <= 0)
+      throw StriException(MSG__EMPTY_SEARCH_PATTERN_UNSUPPORTED);
+   matcher = StriContainerByteSearch::createMatcher(p, p_len,
+      StriContainerByteSearch::getByteSearchFlags(R_NilValue));
+
+   std::vector<char> hit(idx->n, 0);
+   if (p_len >= 3) {
+      std::vector<int> candidates;
+      stri__trigram_candidates(idx, p, p_len, candidates);
+      for (size_t k=0; k<candidates.size(); ++k) {
+         R_len_t i = candidates[k];
+         matcher->reset(idx->cont->get(i).c_str(), idx->cont->get(i).length());
+         if (matcher->findFirst() != USEARCH_DONE) hit[i] = 1;
+      }
+   }
+   else {
+      for (R_len_t i=0; i<idx->n; ++i) {
+         if (idx->cont->isNA(i) || idx->cont->get(i).length() <= 0) continue;
+         matcher->reset(idx->cont->get(i).c_str(), idx->cont->get(i).length());
+         if (matcher->findFirst() != USEARCH_DONE) hit[i] = 1;
+      }
+   }
+
+   R_len_t ret_length = 0;
+   for (R_len_t i=0; i<idx->n; ++i) {
+      if (idx->cont->isNA(i)) { if (!omit_na1) ++ret_length; }
+      else if (negate_1 != (bool)hit[i]) ++ret_length;
+   }
+
+   SEXP ret;
+   STRI__PROTECT(ret = Rf_allocVector(STRSXP, ret_length));
+   R_len_t j = 0;
+   for (R_len_t i=0; i<idx->n; ++i) {
+      if (idx->cont->isNA(i)) {
+         if (!omit_na1) SET_STRING_ELT(ret, j++, NA_STRING);
+      }
+      else if (negate_1 != (bool)hit[i])
+         SET_STRING_ELT(ret, j++, STRING_ELT(orig, i));
+   }
+
+   delete matcher; matcher = NULL;
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END(
+      if (matcher) { delete matcher; matcher = NULL; }
+   )
+}
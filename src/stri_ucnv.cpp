@@ -31,6 +31,121 @@
 
 #include "stri_stringi.h"
 #include "stri_ucnv.h"
+#include "stri_usage.h"
+#include "stri_cache.h"
+#include <string>
+
+
+// how many distinct named converters are kept open across calls;
+// conversion tables (e.g. shift_jis) are loaded once per name
+#define STRI__UCNV_CACHE_SIZE 8
+
+
+/** one cached, pristine master converter (no callbacks registered) */
+struct StriCachedUcnv {
+   std::string key;   ///< converter name, "" if the slot is free
+   UConverter* ucnv;  ///< the master instance; only clones leave this file
+   unsigned stamp;    ///< last use, for LRU eviction
+
+   StriCachedUcnv() : ucnv(NULL), stamp(0) { }
+};
+
+static StriCachedUcnv stri__ucnv_cache[STRI__UCNV_CACHE_SIZE];
+// entries are stamped from the shared cross-cache clock, see stri_cache.h
+
+
+/** return a private clone of the cached master for `key`, or NULL
+ *
+ * Cloning skips the conversion table lookup and load that make
+ * repeated ucnv_open calls show up in many-small-calls profiles.
+ */
+static UConverter* stri__ucnv_cache_get(const std::string& key)
+{
+   for (int i=0; i<STRI__UCNV_CACHE_SIZE; ++i) {
+      if (stri__ucnv_cache[i].ucnv && stri__ucnv_cache[i].key == key) {
+         stri__ucnv_cache[i].stamp = stri__cache_tick();
+         UErrorCode status = U_ZERO_ERROR;
+         UConverter* clone = ucnv_safeClone(stri__ucnv_cache[i].ucnv,
+            NULL, NULL, &status);
+         if (U_FAILURE(status)) return NULL; // fall back to a fresh ucnv_open
+         ++stri__usage_converter.hits;
+         return clone;
+      }
+   }
+   return NULL;
+}
+
+
+/** hand `ucnv` over to the cache (it becomes the master for `key`),
+ *  evicting the least recently used entry if need be
+ */
+static void stri__ucnv_cache_put(const std::string& key, UConverter* ucnv)
+{
+   int slot = 0;
+   for (int i=0; i<STRI__UCNV_CACHE_SIZE; ++i) {
+      if (!stri__ucnv_cache[i].ucnv) { slot = i; break; }
+      if (stri__ucnv_cache[i].stamp < stri__ucnv_cache[slot].stamp)
+         slot = i;
+   }
+   if (stri__ucnv_cache[slot].ucnv)
+      ucnv_close(stri__ucnv_cache[slot].ucnv);
+   stri__ucnv_cache[slot].key = key;
+   stri__ucnv_cache[slot].ucnv = ucnv;
+   stri__ucnv_cache[slot].stamp = stri__cache_tick();
+   stri__cache_enforce_budget(); // see options(stringi.cache_max_entries=)
+}
+
+
+// the stri_cache.cpp hooks, see stri_cache.h
+
+R_len_t stri__ucnv_cache_count()
+{
+   R_len_t count = 0;
+   for (int i=0; i<STRI__UCNV_CACHE_SIZE; ++i)
+      if (stri__ucnv_cache[i].ucnv) ++count;
+   return count;
+}
+
+R_len_t stri__ucnv_cache_capacity()
+{
+   return STRI__UCNV_CACHE_SIZE;
+}
+
+unsigned stri__ucnv_cache_oldest()
+{
+   unsigned oldest = 0;
+   for (int i=0; i<STRI__UCNV_CACHE_SIZE; ++i)
+      if (stri__ucnv_cache[i].ucnv &&
+            (oldest == 0 || stri__ucnv_cache[i].stamp < oldest))
+         oldest = stri__ucnv_cache[i].stamp;
+   return oldest;
+}
+
+void stri__ucnv_cache_evict_oldest()
+{
+   int slot = -1;
+   for (int i=0; i<STRI__UCNV_CACHE_SIZE; ++i)
+      if (stri__ucnv_cache[i].ucnv &&
+            (slot < 0 || stri__ucnv_cache[i].stamp < stri__ucnv_cache[slot].stamp))
+         slot = i;
+   if (slot < 0) return;
+   ucnv_close(stri__ucnv_cache[slot].ucnv);
+   stri__ucnv_cache[slot].ucnv = NULL;
+   stri__ucnv_cache[slot].key.clear();
+   stri__ucnv_cache[slot].stamp = 0;
+}
+
+void stri__ucnv_cache_clear()
+{
+   for (int i=0; i<STRI__UCNV_CACHE_SIZE; ++i) {
+      if (stri__ucnv_cache[i].ucnv) {
+         ucnv_close(stri__ucnv_cache[i].ucnv);
+         stri__ucnv_cache[i].ucnv = NULL;
+      }
+      stri__ucnv_cache[i].key.clear();
+      stri__ucnv_cache[i].stamp = 0;
+   }
+}
 
 
 /**
@@ -50,6 +165,10 @@
  *
  * @version 0.4-1 (Marek Gagolewski, 2014-12-01)
  *    don't register callbacks by default
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    named converters are cached process-wide; each StriUcnv gets a
+ *    private clone, so per-instance callbacks and state do not leak
  */
 void StriUcnv::openConverter(bool register_callbacks) {
    if (m_ucnv)
@@ -57,8 +176,25 @@ void StriUcnv::openConverter(bool register_callbacks) {
 
    UErrorCode status = U_ZERO_ERROR;
 
-   m_ucnv = ucnv_open(m_name, &status);
-   STRI__CHECKICUSTATUS_THROW(status, { m_ucnv = NULL; })
+   // the default converter (m_name == NULL) may change during the
+   // session, hence its resolved name is used as the cache key
+   std::string key((m_name)?m_name:ucnv_getDefaultName());
+   m_ucnv = stri__ucnv_cache_get(key);
+   if (!m_ucnv) {
+      m_ucnv = ucnv_open(m_name, &status);
+      STRI__CHECKICUSTATUS_THROW(status, { m_ucnv = NULL; })
+      ++stri__usage_converter.opens;
+
+      // hand the pristine master over to the cache, keep a clone;
+      // if cloning fails, just skip caching this one
+      status = U_ZERO_ERROR;
+      UConverter* clone = ucnv_safeClone(m_ucnv, NULL, NULL, &status);
+      if (U_SUCCESS(status) && clone) {
+         stri__ucnv_cache_put(key, m_ucnv);
+         m_ucnv = clone;
+      }
+      status = U_ZERO_ERROR;
+   }
 
    if (register_callbacks) {
       status = U_ZERO_ERROR;
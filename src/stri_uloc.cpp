@@ -41,6 +41,9 @@
  * @return nothing (\code{R_NilValue})
  *
  * @version 0.1-?? (Marek Gagolewski)
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    invalidates the locale resolution memo
  */
 SEXP stri_locale_set(SEXP loc)
 {
@@ -48,6 +51,7 @@ SEXP stri_locale_set(SEXP loc)
    UErrorCode status = U_ZERO_ERROR;
    uloc_setDefault(qloc, &status);
    STRI__CHECKICUSTATUS_RFERROR(status, {/* do nothing special on err */}) // error() allowed here
+   stri__locale_cache_invalidate(); // memoized resolutions may be stale now
    return R_NilValue;
 }
 
@@ -0,0 +1,61 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_usage_h
+#define __stri_usage_h
+
+
+/** per-service tallies of ICU object churn (since package load)
+ *
+ * `opens` counts service objects configured from scratch (ucol_open,
+ * ucnv_open, RegexPattern::compile, ubrk_open and friends); `hits`
+ * counts requests answered from one of the caches - the caller still
+ * receives a clone, but cloning is memcpy-scale, so opens vs hits is
+ * the churn figure that matters. Updated from the main R thread only,
+ * like the caches themselves; reported by stri_info.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+struct StriUsageCounters {
+   unsigned opens;
+   unsigned hits;
+
+   StriUsageCounters() : opens(0), hits(0) { }
+};
+
+extern StriUsageCounters stri__usage_collator;  ///< see stri_collator.cpp
+extern StriUsageCounters stri__usage_converter; ///< see stri_ucnv.cpp
+extern StriUsageCounters stri__usage_regex;     ///< see stri_container_regex.cpp
+extern StriUsageCounters stri__usage_brkiter;   ///< see stri_brkiter.cpp
+extern StriUsageCounters stri__usage_usearch;   ///< see stri_container_usearch.cpp
+
+#endif
@@ -0,0 +1,107 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_utext_h
+#define __stri_utext_h
+
+#include <unicode/utext.h>
+#include "stri_exception.h"
+#include "stri_string8.h"
+
+
+/**
+ * A (reusable) UText over caller-owned UTF-8 bytes
+ *
+ * The zero-copy bridge between our UTF-8 containers/arenas and the
+ * ICU services that accept a UText (regex, break iteration): wrap()
+ * hands the bytes themselves to ICU, with no transcoding, and reuses
+ * the UText's storage across calls, exactly as the repeated
+ * utext_openUTF8(prev, ...) idiom did at every call site. Offsets
+ * reported by ICU against such text are native byte indices.
+ *
+ * Declare instances inside an STRI__ERROR_HANDLER block: the UText is
+ * then closed both on a normal return and when a StriException
+ * unwinds. The wrapped bytes are not owned and must outlive the use
+ * of the UText, not the object itself.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+class StriUText {
+
+   private:
+
+      UText* m_utext;
+
+   public:
+
+      StriUText() : m_utext(NULL) { }
+
+      // the UText's storage is owned, never shared: a copy starts
+      // out empty (this keeps default-filled containers of owners,
+      // e.g. the per-group break iterators, well-defined)
+      StriUText(const StriUText&) : m_utext(NULL) { }
+
+      StriUText& operator=(const StriUText&) {
+         close();
+         return *this;
+      }
+
+      ~StriUText() {
+         close();
+      }
+
+      /** (re)wrap a UTF-8 byte range; throws StriException on failure */
+      UText* wrap(const char* s, R_len_t n) {
+         UErrorCode status = U_ZERO_ERROR;
+         m_utext = utext_openUTF8(m_utext, s, n, &status);
+         STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+         return m_utext;
+      }
+
+      /** (re)wrap a String8's payload */
+      UText* wrap(const String8& s) {
+         return wrap(s.c_str(), s.length());
+      }
+
+      inline UText* get() {
+         return m_utext;
+      }
+
+      void close() {
+         if (m_utext) {
+            utext_close(m_utext);
+            m_utext = NULL;
+         }
+      }
+};
+
+#endif
@@ -0,0 +1,172 @@
+/* This file is part of the 'stringi' package for R.
+ * Copyright (c) 2013-2020, Marek Gagolewski and other contributors.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+ * BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __stri_utf8dfa_h
+#define __stri_utf8dfa_h
+
+#include <unicode/utypes.h>
+#include <cstring>
+
+
+/** Table-driven UTF-8 decoding
+ *
+ * A little DFA over byte classes: one class lookup and one transition
+ * lookup per input byte, with no data-dependent branching inside a
+ * multi-byte sequence. This behaves much better than the nested
+ * comparisons of U8_NEXT when ASCII and multi-byte text interleave
+ * unpredictably, and gives the scanning loops a single decoder
+ * implementation.
+ *
+ * The byte classes encode Unicode's well-formedness table (Table 3-7),
+ * so exactly the sequences U8_NEXT accepts are accepted: overlong
+ * forms, surrogates, and code points above U+10FFFF all land in the
+ * reject state.
+ *
+ * States are premultiplied row offsets into the transition table:
+ * STRI__UTF8_ACCEPT (a complete code point) and STRI__UTF8_REJECT
+ * (ill-formed input) are terminal; anything larger awaits continuation
+ * bytes.
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+
+#define STRI__UTF8_ACCEPT 0
+#define STRI__UTF8_REJECT 12
+
+// byte -> class; 0 is ASCII, 1..3 are continuation bytes (split by the
+// constraints that E0/ED/F0/F4 place on their first continuation),
+// 4..10 are lead bytes, 11 never occurs in well-formed UTF-8
+static const uint8_t stri__utf8dfa_class[256] = {
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+    2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,
+    3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,
+    3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,
+   11, 11,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+    4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,
+    5,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  7,  6,  6,
+    8,  9,  9,  9, 10, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11
+};
+
+// value bits contributed by the first byte of a sequence, per class
+static const uint8_t stri__utf8dfa_mask[12] = {
+   0x7f, 0x00, 0x00, 0x00, 0x1f, 0x0f, 0x0f, 0x0f, 0x07, 0x07, 0x07, 0x00
+};
+
+// state transitions, indexed by state (a premultiplied row offset) + class
+static const uint8_t stri__utf8dfa_trans[108] = {
+   /*  0 */  0, 12, 12, 12, 24, 48, 36, 60, 72, 96, 84, 12,
+   /* 12 */ 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+   /* 24 */ 12,  0,  0,  0, 12, 12, 12, 12, 12, 12, 12, 12,
+   /* 36 */ 12, 24, 24, 24, 12, 12, 12, 12, 12, 12, 12, 12,
+   /* 48 */ 12, 12, 12, 24, 12, 12, 12, 12, 12, 12, 12, 12,
+   /* 60 */ 12, 24, 24, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+   /* 72 */ 12, 12, 36, 36, 12, 12, 12, 12, 12, 12, 12, 12,
+   /* 84 */ 12, 36, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+   /* 96 */ 12, 36, 36, 36, 12, 12, 12, 12, 12, 12, 12, 12
+};
+
+
+/** feed one byte into the decoder
+ *
+ * @param state [in/out] STRI__UTF8_ACCEPT to start a code point
+ * @param cp [in/out] code point being assembled; complete iff
+ *    the returned state is STRI__UTF8_ACCEPT
+ * @param byte next input byte
+ * @return the new state, for convenience
+ */
+static inline uint32_t stri__utf8dfa_feed(uint32_t* state, UChar32* cp, uint8_t byte)
+{
+   uint32_t cls = (uint32_t)stri__utf8dfa_class[byte];
+   *cp = (*state == STRI__UTF8_ACCEPT)
+      ? (UChar32)(byte & stri__utf8dfa_mask[cls])
+      : (UChar32)((*cp << 6) | (byte & 0x3f));
+   *state = (uint32_t)stri__utf8dfa_trans[*state + cls];
+   return *state;
+}
+
+
+/** decode the next code point, U8_NEXT-style
+ *
+ * @param s UTF-8 string
+ * @param i [in/out] byte index, advanced past the decoded sequence
+ *    (on ill-formed input, past the bytes consumed so far)
+ * @param n length of s in bytes
+ * @return the code point, or a negative value on ill-formed input
+ *    (including a sequence truncated by the end of the string)
+ */
+static inline UChar32 stri__utf8dfa_next(const char* s, R_len_t& i, R_len_t n)
+{
+   uint32_t state = STRI__UTF8_ACCEPT;
+   UChar32 c = 0;
+   do {
+      stri__utf8dfa_feed(&state, &c, (uint8_t)s[i]);
+      ++i;
+   } while (state > STRI__UTF8_REJECT && i < n);
+   return (state == STRI__UTF8_ACCEPT)?c:(UChar32)-1;
+}
+
+
+/** find the end of the ASCII run starting at byte i
+ *
+ * Skims one machine word at a time (a word with no byte >= 0x80 is
+ * eight ASCII code points) and finishes bytewise. Within the returned
+ * range each byte is a whole code point, so callers can sweep the run
+ * with plain byte loads and no decoding at all; only the byte at the
+ * returned index (if < n) needs the full decoder.
+ *
+ * @param s UTF-8 string
+ * @param i byte index to start from
+ * @param n length of s in bytes
+ * @return index of the first byte >= 0x80 at or after i, or n
+ */
+static inline R_len_t stri__ascii_run_end(const char* s, R_len_t i, R_len_t n)
+{
+   while (i+(R_len_t)sizeof(uint64_t) <= n) {
+      uint64_t w; // memcpy - s+i may be unaligned
+      memcpy(&w, s+i, sizeof(uint64_t));
+      if (w & UINT64_C(0x8080808080808080)) break;
+      i += (R_len_t)sizeof(uint64_t);
+   }
+   while (i < n && (uint8_t)s[i] < 0x80)
+      ++i;
+   return i;
+}
+
+#endif
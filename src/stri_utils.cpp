@@ -33,6 +33,7 @@
 #include "stri_stringi.h"
 #include "stri_container_utf8.h"
 #include "stri_container_listutf8.h"
+#include <vector>
 
 
 /**
@@ -48,6 +49,10 @@
  *
  * @version 0.4-1 (Marek Gagolewski, 2014-12-04)
  *    new arg: n_min
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    byrow fill is cache-blocked; NA padding relies on fresh STRSXP
+ *    matrices being born NA-filled
  */
 SEXP stri_list2matrix(SEXP x, SEXP byrow, SEXP fill, SEXP n_min)
 {
@@ -67,30 +72,51 @@ SEXP stri_list2matrix(SEXP x, SEXP byrow, SEXP fill, SEXP n_min)
       if (k > m) m = k;
    }
 
+   // Rf_allocMatrix already initializes every STRSXP cell to NA, so
+   // NA padding (the default) needs no writes at all
+   bool fill_na = (fill2 == NA_STRING);
+
    SEXP ret;
    if (!byrow2) {
       STRI__PROTECT(ret = Rf_allocMatrix(STRSXP, m, n));
-      int ret_idx = 0;
       for (int i=0; i<n; ++i) {
          SEXP cur_str = VECTOR_ELT(x, i);
          R_len_t cur_len = LENGTH(cur_str);
+         int ret_idx = i*m;
          int j;
          for (j=0; j<cur_len; ++j)
             SET_STRING_ELT(ret, ret_idx++, STRING_ELT(cur_str, j));
-         for (; j<m; ++j)
-            SET_STRING_ELT(ret, ret_idx++, fill2);
+         if (!fill_na)
+            for (; j<m; ++j)
+               SET_STRING_ELT(ret, ret_idx++, fill2);
       }
    }
    else {
+      // this is a transpose: consecutive j land n cells apart in ret,
+      // so for a long list every write would touch a fresh cache line.
+      // Fill in square tiles instead - both the written window and the
+      // list rows being read then stay resident across a tile.
+      const R_len_t tile = 64;
       STRI__PROTECT(ret = Rf_allocMatrix(STRSXP, n, m));
-      for (int i=0; i<n; ++i) {
-         SEXP cur_str = VECTOR_ELT(x, i);
-         R_len_t cur_len = LENGTH(cur_str);
-         int j;
-         for (j=0; j<cur_len; ++j)
-            SET_STRING_ELT(ret, i+j*n, STRING_ELT(cur_str, j));
-         for (; j<m; ++j)
-            SET_STRING_ELT(ret, i+j*n, fill2);
+      std::vector<SEXP>    tile_str((size_t)tile);
+      std::vector<R_len_t> tile_len((size_t)tile);
+      for (R_len_t i0=0; i0<n; i0+=tile) {
+         R_len_t i1 = (i0+tile < n)?(i0+tile):n;
+         for (R_len_t i=i0; i<i1; ++i) {
+            tile_str[i-i0] = VECTOR_ELT(x, i);
+            tile_len[i-i0] = LENGTH(tile_str[i-i0]);
+         }
+         for (R_len_t j0=0; j0<m; j0+=tile) {
+            R_len_t j1 = (j0+tile < m)?(j0+tile):m;
+            for (R_len_t j=j0; j<j1; ++j) {
+               for (R_len_t i=i0; i<i1; ++i) {
+                  if (j < tile_len[i-i0])
+                     SET_STRING_ELT(ret, i+j*n, STRING_ELT(tile_str[i-i0], j));
+                  else if (!fill_na)
+                     SET_STRING_ELT(ret, i+j*n, fill2);
+               }
+            }
+         }
       }
    }
 
@@ -101,6 +127,138 @@ SEXP stri_list2matrix(SEXP x, SEXP byrow, SEXP fill, SEXP n_min)
 }
 
 
+/** Drop NA and/or empty elements from a character vector [internal]
+ *
+ * Returns x itself when nothing is to be dropped; otherwise a fresh
+ * vector sharing all kept CHARSXPs (nothing is re-interned), with the
+ * names attribute, if any, subset alongside.
+ *
+ * @param x character vector
+ * @param remove_empty drop zero-length strings?
+ * @param remove_na drop missing values?
+ * @return character vector
+ *
+ * @version 1.4.6 (2020-01-24)
+ */
+static SEXP stri__drop_elements(SEXP x, bool remove_empty, bool remove_na)
+{
+   R_len_t n = LENGTH(x);
+
+   R_len_t m = 0; // number of elements kept
+   for (R_len_t i=0; i<n; ++i) {
+      SEXP curs = STRING_ELT(x, i);
+      if ((curs == NA_STRING) ? !remove_na : (!remove_empty || LENGTH(curs) != 0))
+         ++m;
+   }
+   if (m == n)
+      return x; // nothing to drop - the input is its own result
+
+   SEXP xnames = Rf_getAttrib(x, R_NamesSymbol);
+   SEXP ret = PROTECT(Rf_allocVector(STRSXP, m));
+   SEXP retnames = R_NilValue;
+   if (!Rf_isNull(xnames))
+      retnames = PROTECT(Rf_allocVector(STRSXP, m));
+
+   R_len_t k = 0;
+   for (R_len_t i=0; i<n; ++i) {
+      SEXP curs = STRING_ELT(x, i);
+      if ((curs == NA_STRING) ? remove_na : (remove_empty && LENGTH(curs) == 0))
+         continue;
+      SET_STRING_ELT(ret, k, curs);
+      if (!Rf_isNull(retnames))
+         SET_STRING_ELT(retnames, k, STRING_ELT(xnames, i));
+      ++k;
+   }
+
+   if (!Rf_isNull(retnames)) {
+      Rf_setAttrib(ret, R_NamesSymbol, retnames);
+      UNPROTECT(2);
+   }
+   else
+      UNPROTECT(1);
+   return ret;
+}
+
+
+/** Replace missing values with empty strings
+ *
+ * @param x character vector
+ * @return character vector
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    moved down from R - NA-free input (the common case) is returned
+ *    unchanged, and a rebuilt vector shares all non-NA CHARSXPs
+ */
+SEXP stri_na2empty(SEXP x)
+{
+   PROTECT(x = stri_prepare_arg_string(x, "x"));
+   R_len_t n = LENGTH(x);
+
+   R_len_t i = 0;
+   while (i < n && STRING_ELT(x, i) != NA_STRING) ++i;
+   if (i >= n) {
+      UNPROTECT(1);
+      return x; // no NAs - the input is its own result
+   }
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   SEXP ret;
+   // duplicating an STRSXP copies the pointer array and attributes;
+   // the CHARSXPs themselves are shared
+   STRI__PROTECT(ret = Rf_duplicate(x));
+   for (; i < n; ++i)
+      if (STRING_ELT(ret, i) == NA_STRING)
+         SET_STRING_ELT(ret, i, R_BlankString);
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({/* no-op on err */})
+}
+
+
+/** Remove all empty strings, and possibly also NAs, from a character vector
+ *
+ * @param x character vector
+ * @param na_empty single logical value; drop missing values too?
+ * @return character vector
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    moved down from R - input with nothing to drop is returned unchanged
+ */
+SEXP stri_remove_empty(SEXP x, SEXP na_empty)
+{
+   bool na_empty2 = stri__prepare_arg_logical_1_notNA(na_empty, "na_empty");
+   PROTECT(x = stri_prepare_arg_string(x, "x"));
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   SEXP ret;
+   STRI__PROTECT(ret = stri__drop_elements(x, true, na_empty2));
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({/* no-op on err */})
+}
+
+
+/** Remove all missing values from a character vector
+ *
+ * @param x character vector
+ * @return character vector
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    moved down from R - input with nothing to drop is returned unchanged
+ */
+SEXP stri_remove_na(SEXP x)
+{
+   PROTECT(x = stri_prepare_arg_string(x, "x"));
+
+   STRI__ERROR_HANDLER_BEGIN(1)
+   SEXP ret;
+   STRI__PROTECT(ret = stri__drop_elements(x, false, true));
+   STRI__UNPROTECT_ALL
+   return ret;
+   STRI__ERROR_HANDLER_END({/* no-op on err */})
+}
+
+
 
 
 /**
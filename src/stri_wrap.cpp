@@ -32,6 +32,8 @@
 
 #include "stri_stringi.h"
 #include "stri_container_utf8_indexable.h"
+#include "stri_utext.h"
+#include "stri_utf8dfa.h"
 #include <deque>
 #include <vector>
 #include <utility>
@@ -241,6 +243,10 @@ struct StriWrapLineStart {
  *
  * @version 0.5-1 (Marek Gagolewski, 2015-06-09)
  *    BIGSKIP: no more CHARSXP on out on "" input
+ *
+ * @version 1.4.6 (2020-01-24)
+ *    ASCII fast path in word measurement, cached BMP widths,
+ *    per-element/per-line buffers reused across iterations
  */
 SEXP stri_wrap(SEXP str, SEXP width, SEXP cost_exponent,
    SEXP indent, SEXP exdent, SEXP prefix, SEXP initial, SEXP whitespace_only,
@@ -267,9 +273,9 @@ SEXP stri_wrap(SEXP str, SEXP width, SEXP cost_exponent,
    PROTECT(initial = stri_prepare_arg_string_1(initial, "initial"));
 
    BreakIterator* briter = NULL;
-   UText* str_text = NULL;
 
    STRI__ERROR_HANDLER_BEGIN(3)
+   StriUText str_text; // UTF-8 UText: may be slower, but definitely more convenient!
    UErrorCode status = U_ZERO_ERROR;
    briter = BreakIterator::createLineInstance(loc, status);
    STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
@@ -303,6 +309,16 @@ SEXP stri_wrap(SEXP str, SEXP width, SEXP cost_exponent,
 
    SEXP ret;
    STRI__PROTECT(ret = Rf_allocVector(VECSXP, str_length));
+
+   // scratch reused across elements (their capacity is retained)
+   deque< R_len_t > occurrences_list; // this could be an R_len_t queue
+   std::vector<R_len_t> end_pos_orig;
+   std::vector<R_len_t> widths_orig;  // total width/code points of each "word"
+   std::vector<R_len_t> widths_trim;  // the same, sans trailing whitespaces
+   std::vector<R_len_t> end_pos_trim; // end positions sans trailing whitespaces
+   std::deque<R_len_t> wrap_after; // wrap line after which word in {0..nwords-1}?
+   std::string cs; // current output line
+
    for (R_len_t i = 0; i < str_length; ++i)
    {
       if (str_cont.isNA(i) || prefix_cont.isNA(0) || initial_cont.isNA(0)) {
@@ -310,18 +326,16 @@ SEXP stri_wrap(SEXP str, SEXP width, SEXP cost_exponent,
          continue;
       }
 
-      status = U_ZERO_ERROR;
       const char* str_cur_s = str_cont.get(i).c_str();
       R_len_t str_cur_n = str_cont.get(i).length();
-      str_text = utext_openUTF8(str_text, str_cur_s, str_cont.get(i).length(), &status);
-      STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
+      str_text.wrap(str_cur_s, str_cont.get(i).length());
 
       status = U_ZERO_ERROR;
-      briter->setText(str_text, status);
+      briter->setText(str_text.get(), status);
       STRI__CHECKICUSTATUS_THROW(status, {/* do nothing special on err */})
 
       // first generate a list of positions of line breaks
-      deque< R_len_t > occurrences_list; // this could be an R_len_t queue
+      occurrences_list.clear();
       R_len_t match = briter->first();
       while (match != BreakIterator::DONE) {
 
@@ -358,7 +372,7 @@ SEXP stri_wrap(SEXP str, SEXP width, SEXP cost_exponent,
          throw StriException("NDEBUG: stri_wrap: (occurrences_list.at(0) != 0)");
 #endif
 
-      std::vector<R_len_t> end_pos_orig(nwords);
+      end_pos_orig.resize(nwords);
       deque<R_len_t>::iterator iter = ++(occurrences_list.begin());
       for (R_len_t j = 0; iter != occurrences_list.end(); ++iter, ++j) {
          end_pos_orig[j] = (*iter); // this is a UTF-8 index
@@ -367,12 +381,11 @@ SEXP stri_wrap(SEXP str, SEXP width, SEXP cost_exponent,
 
       // now:
       // we'll get the total widths/number of code points in each "word"
-      std::vector<R_len_t> widths_orig(nwords);
-      // we'll get the total widths/number of code points without trailing whitespaces
-      std::vector<R_len_t> widths_trim(nwords);
-      // we'll get the end positions without trailing whitespaces
-      std::vector<R_len_t> end_pos_trim(nwords);
+      // and the widths/end positions without trailing whitespaces;
       // detect line endings (fail on a match)
+      widths_orig.resize(nwords);
+      widths_trim.resize(nwords);
+      end_pos_trim.resize(nwords);
 
       UChar32 c = 0;
       R_len_t j = 0;
@@ -384,22 +397,38 @@ SEXP stri_wrap(SEXP str, SEXP width, SEXP cost_exponent,
       R_len_t cur_end_pos_trim = 0;
       while (j < str_cur_n) {
          R_len_t jlast = j;
-         U8_NEXT(str_cur_s, j, str_cur_n, c);
+         c = stri__utf8dfa_next(str_cur_s, j, str_cur_n);
          if (c < 0) // invalid utf-8 sequence
             throw StriException(MSG__INVALID_UTF8);
 
-         if (uset_linebreaks.contains(c))
-            throw StriException(MSG__NEWLINE_FOUND);
+         bool is_whitespace;
+         if (c < 0x80) {
+            // ASCII fast path - no ICU property calls;
+            // linebreaks here are 0x0A..0x0D, whitespaces add TAB and SPACE
+            if (c >= 0x0A && c <= 0x0D)
+               throw StriException(MSG__NEWLINE_FOUND);
+            cur_width_orig += (c >= 0x20 && c != 0x7f)?1:0;
+            is_whitespace = (c == 0x20 || c == 0x09);
+         }
+         else {
+            if (uset_linebreaks.contains(c))
+               throw StriException(MSG__NEWLINE_FOUND);
+            cur_width_orig += (c <= (UChar32)0xFFFF)
+               ?stri__width_char_cached(c):stri__width_char(c);
+            is_whitespace = (bool)uset_whitespaces.contains(c);
+         }
 
-         cur_width_orig += stri__width_char(c);
          ++cur_count_orig;
-         if (uset_whitespaces.contains(c)) {
+         if (is_whitespace) {
 // OLD: trim all white spaces from the end:
 //            ++cur_count_trim;
 //           [we have the normalize arg for that]
 
 // NEW: trim just one white space at the end:
-            cur_width_trim = stri__width_char(c);
+            cur_width_trim = (c < 0x80)
+               ?((c >= 0x20 && c != 0x7f)?1:0)
+               :((c <= (UChar32)0xFFFF)
+                  ?stri__width_char_cached(c):stri__width_char(c));
             cur_count_trim = 1;
             cur_end_pos_trim = jlast;
          }
@@ -430,7 +459,7 @@ SEXP stri_wrap(SEXP str, SEXP width, SEXP cost_exponent,
       }
 
       // do wrap
-      std::deque<R_len_t> wrap_after; // wrap line after which word in {0..nwords-1}?
+      wrap_after.clear();
       if (exponent_val <= 0.0) {
          stri__wrap_greedy(wrap_after, nwords, width_val,
             widths_orig, widths_trim,
@@ -454,10 +483,9 @@ SEXP stri_wrap(SEXP str, SEXP width, SEXP cost_exponent,
          R_len_t wrap_after_cur = *iter_wrap;
          R_len_t cur_pos = end_pos_trim[wrap_after_cur];
 
-         std::string cs;
-         if (i == 0 && u == 0)     cs = ii.str;
-         else if (i > 0 && u == 0) cs = pi.str;
-         else                      cs = pe.str;
+         if (i == 0 && u == 0)     cs.assign(ii.str);
+         else if (i > 0 && u == 0) cs.assign(pi.str);
+         else                      cs.assign(pe.str);
          cs.append(str_cur_s+last_pos, cur_pos-last_pos);
          SET_STRING_ELT(ans, u, Rf_mkCharLenCE(cs.c_str(), cs.size(), CE_UTF8));
 
@@ -465,10 +493,9 @@ SEXP stri_wrap(SEXP str, SEXP width, SEXP cost_exponent,
       }
 
       // last line goes here:
-      std::string cs;
-      if (i == 0 && nlines-1 == 0)     cs = ii.str;
-      else if (i > 0 && nlines-1 == 0) cs = pi.str;
-      else                             cs = pe.str;
+      if (i == 0 && nlines-1 == 0)     cs.assign(ii.str);
+      else if (i > 0 && nlines-1 == 0) cs.assign(pi.str);
+      else                             cs.assign(pe.str);
       cs.append(str_cur_s+last_pos, end_pos_trim[nwords-1]-last_pos);
       SET_STRING_ELT(ans, nlines-1, Rf_mkCharLenCE(cs.c_str(), cs.size(), CE_UTF8));
 
@@ -477,11 +504,9 @@ SEXP stri_wrap(SEXP str, SEXP width, SEXP cost_exponent,
    }
 
    if (briter) { delete briter; briter = NULL; }
-   if (str_text) { utext_close(str_text); str_text = NULL; }
    STRI__UNPROTECT_ALL
    return ret;
    STRI__ERROR_HANDLER_END({
       if (briter) { delete briter; briter = NULL; }
-      if (str_text) { utext_close(str_text); str_text = NULL; }
    })
 }